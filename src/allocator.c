@@ -0,0 +1,316 @@
+/*
+ * allocator.c - page allocator implementation
+ *
+ * Copyright (C) 2019 Emmanuel Marty
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*
+ * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
+ *
+ * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
+ * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
+ * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
+ * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include "allocator.h"
+
+/** Size of a huge page, on x86-64 and on arm64 with 4 Kb base pages */
+#define HUGE_PAGE_SIZE        0x200000
+
+/** Size of a regular page, for prefaulting */
+#define PAGE_SIZE_FOR_PREFAULT 4096
+
+/** Allocations at least this large are backed with huge pages */
+#define HUGE_PAGE_MIN_ALLOC_SIZE HUGE_PAGE_SIZE
+
+/** Internal flag: explicit huge pages are reserved and can be mapped */
+#define HUGE_PAGES_EXPLICIT   (1<<16)
+
+/** Internal flag: transparent huge pages can be requested with madvise() */
+#define HUGE_PAGES_TRANSPARENT (1<<17)
+
+/** Header stored just before the memory returned to the caller, to free the mapping it belongs to */
+typedef struct {
+   void *pBase;               /**< start of the mapping */
+   size_t nMappedSize;        /**< size of the mapping, in bytes */
+   size_t nPadding[2];        /**< keep the returned memory aligned to 32 bytes */
+} lz4ultra_page_header;
+
+/**
+ * Round a size up to a multiple of a power of two
+ *
+ * @param nSize size to round
+ * @param nAlignment power of two to round to
+ *
+ * @return rounded size
+ */
+static size_t lz4ultra_round_up(const size_t nSize, const size_t nAlignment) {
+   return (nSize + nAlignment - 1) & ~(nAlignment - 1);
+}
+
+/**
+ * Touch every page of a newly mapped range, so that it is faulted in now rather than during compression
+ *
+ * @param pData start of range
+ * @param nSize size of range, in bytes
+ */
+static void lz4ultra_prefault(unsigned char *pData, const size_t nSize) {
+   volatile unsigned char *pPage = (volatile unsigned char *)pData;
+   size_t i;
+
+   for (i = 0; i < nSize; i += PAGE_SIZE_FOR_PREFAULT)
+      pPage[i] = 0;
+}
+
+#ifdef _WIN32
+
+/**
+ * Map memory
+ *
+ * @param nSize number of bytes to map
+ * @param nFlags huge page flags
+ * @param pMappedSize returned size of the mapping
+ *
+ * @return start of the mapping, or NULL for failure
+ */
+static void *lz4ultra_map_pages(const size_t nSize, const unsigned int nFlags, size_t *pMappedSize) {
+   void *pBase = NULL;
+
+   if ((nFlags & HUGE_PAGES_EXPLICIT) && nSize >= HUGE_PAGE_MIN_ALLOC_SIZE) {
+      const size_t nLargePageSize = GetLargePageMinimum();
+
+      if (nLargePageSize) {
+         *pMappedSize = lz4ultra_round_up(nSize, nLargePageSize);
+         pBase = VirtualAlloc(NULL, *pMappedSize, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+      }
+   }
+
+   if (!pBase) {
+      *pMappedSize = nSize;
+      pBase = VirtualAlloc(NULL, nSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+   }
+
+   return pBase;
+}
+
+/**
+ * Unmap memory
+ *
+ * @param pBase start of the mapping
+ * @param nMappedSize size of the mapping
+ */
+static void lz4ultra_unmap_pages(void *pBase, const size_t nMappedSize) {
+   VirtualFree(pBase, 0, MEM_RELEASE);
+}
+
+/**
+ * Detect which kinds of huge pages can be used
+ *
+ * @return HUGE_PAGES_xxx flags
+ */
+static unsigned int lz4ultra_detect_huge_pages(void) {
+   HANDLE hToken;
+   TOKEN_PRIVILEGES privileges;
+   unsigned int nFlags = 0;
+
+   /* Large pages need the "lock pages in memory" privilege, that has to be enabled for the process */
+   if (!GetLargePageMinimum())
+      return 0;
+   if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &hToken))
+      return 0;
+
+   privileges.PrivilegeCount = 1;
+   privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+   if (LookupPrivilegeValueA(NULL, "SeLockMemoryPrivilege", &privileges.Privileges[0].Luid) &&
+      AdjustTokenPrivileges(hToken, FALSE, &privileges, 0, NULL, NULL) && GetLastError() == ERROR_SUCCESS)
+      nFlags |= HUGE_PAGES_EXPLICIT;
+   CloseHandle(hToken);
+
+   return nFlags;
+}
+
+#else
+
+/**
+ * Map memory
+ *
+ * @param nSize number of bytes to map
+ * @param nFlags huge page flags
+ * @param pMappedSize returned size of the mapping
+ *
+ * @return start of the mapping, or NULL for failure
+ */
+static void *lz4ultra_map_pages(const size_t nSize, const unsigned int nFlags, size_t *pMappedSize) {
+   void *pBase;
+
+   if (nSize >= HUGE_PAGE_MIN_ALLOC_SIZE) {
+#ifdef MAP_HUGETLB
+      if (nFlags & HUGE_PAGES_EXPLICIT) {
+         /* Use reserved huge pages, as long as there are enough left */
+         *pMappedSize = lz4ultra_round_up(nSize, HUGE_PAGE_SIZE);
+         pBase = mmap(NULL, *pMappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+         if (pBase != MAP_FAILED)
+            return pBase;
+      }
+#endif
+
+#ifdef MADV_HUGEPAGE
+      if (nFlags & HUGE_PAGES_TRANSPARENT) {
+         size_t nAlignedSize = lz4ultra_round_up(nSize, HUGE_PAGE_SIZE);
+         unsigned char *pAlignedBase;
+
+         /* Map an extra huge page so that the range handed out can start on a huge page boundary, and trim the rest */
+         *pMappedSize = nAlignedSize + HUGE_PAGE_SIZE;
+         pBase = mmap(NULL, *pMappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+         if (pBase == MAP_FAILED)
+            return NULL;
+
+         pAlignedBase = (unsigned char *)lz4ultra_round_up((size_t)pBase, HUGE_PAGE_SIZE);
+         if (pAlignedBase != (unsigned char *)pBase)
+            munmap(pBase, pAlignedBase - (unsigned char *)pBase);
+         if ((unsigned char *)pBase + *pMappedSize != pAlignedBase + nAlignedSize)
+            munmap(pAlignedBase + nAlignedSize, ((unsigned char *)pBase + *pMappedSize) - (pAlignedBase + nAlignedSize));
+
+         *pMappedSize = nAlignedSize;
+         madvise(pAlignedBase, nAlignedSize, MADV_HUGEPAGE);
+         return pAlignedBase;
+      }
+#endif
+   }
+
+   *pMappedSize = nSize;
+   pBase = mmap(NULL, nSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if (pBase == MAP_FAILED)
+      return NULL;
+   return pBase;
+}
+
+/**
+ * Unmap memory
+ *
+ * @param pBase start of the mapping
+ * @param nMappedSize size of the mapping
+ */
+static void lz4ultra_unmap_pages(void *pBase, const size_t nMappedSize) {
+   munmap(pBase, nMappedSize);
+}
+
+/**
+ * Detect which kinds of huge pages can be used
+ *
+ * @return HUGE_PAGES_xxx flags
+ */
+static unsigned int lz4ultra_detect_huge_pages(void) {
+   unsigned int nFlags = 0;
+#ifdef __linux__
+   char szLine[128];
+   FILE *f;
+
+   /* Transparent huge pages are used for madvise()'d ranges, unless they are disabled altogether */
+   f = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+   if (f) {
+      if (fgets(szLine, sizeof(szLine), f) && (strstr(szLine, "[always]") || strstr(szLine, "[madvise]")))
+         nFlags |= HUGE_PAGES_TRANSPARENT;
+      fclose(f);
+   }
+
+   /* Explicit huge pages are only available if the administrator reserved some */
+   f = fopen("/proc/sys/vm/nr_hugepages", "r");
+   if (f) {
+      if (fgets(szLine, sizeof(szLine), f) && atol(szLine) > 0)
+         nFlags |= HUGE_PAGES_EXPLICIT;
+      fclose(f);
+   }
+#endif
+   return nFlags;
+}
+
+#endif
+
+/**
+ * Allocate memory from the page allocator
+ *
+ * @param pOpaque huge page flags
+ * @param nSize number of bytes to allocate
+ *
+ * @return allocated memory, or NULL for failure
+ */
+static void *lz4ultra_page_alloc(void *pOpaque, size_t nSize) {
+   const unsigned int nFlags = (unsigned int)(size_t)pOpaque;
+   lz4ultra_page_header *pHeader;
+   size_t nMappedSize = 0;
+   unsigned char *pBase;
+
+   pBase = (unsigned char *)lz4ultra_map_pages(nSize + sizeof(lz4ultra_page_header), nFlags, &nMappedSize);
+   if (!pBase)
+      return NULL;
+
+   if (nFlags & LZ4ULTRA_HUGE_PAGES_PREFAULT)
+      lz4ultra_prefault(pBase, nMappedSize);
+
+   pHeader = (lz4ultra_page_header *)pBase;
+   pHeader->pBase = pBase;
+   pHeader->nMappedSize = nMappedSize;
+   return pHeader + 1;
+}
+
+/**
+ * Free memory allocated from the page allocator
+ *
+ * @param pOpaque huge page flags
+ * @param pPtr memory to free
+ */
+static void lz4ultra_page_free(void *pOpaque, void *pPtr) {
+   lz4ultra_page_header *pHeader = ((lz4ultra_page_header *)pPtr) - 1;
+
+   lz4ultra_unmap_pages(pHeader->pBase, pHeader->nMappedSize);
+}
+
+/**
+ * Get an allocator that maps the large arrays of compression contexts with huge pages, where the system provides them, to cut the TLB misses of the
+ * match finder's random accesses. Explicit huge pages are used when some are reserved, and transparent huge pages otherwise; allocations fall back
+ * to regular pages when neither is available
+ *
+ * @param pAllocator returned allocator, to pass to lz4ultra_ctx_set_allocator()
+ * @param nHugePageFlags LZ4ULTRA_HUGE_PAGES_xxx flags
+ *
+ * @return 1 if huge pages are available, 0 if the allocator only maps regular pages
+ */
+int lz4ultra_get_huge_page_allocator(lz4ultra_allocator *pAllocator, const unsigned int nHugePageFlags) {
+   const unsigned int nFlags = (nHugePageFlags & LZ4ULTRA_HUGE_PAGES_PREFAULT) | lz4ultra_detect_huge_pages();
+
+   pAllocator->alloc_mem = lz4ultra_page_alloc;
+   pAllocator->free_mem = lz4ultra_page_free;
+   pAllocator->pOpaque = (void *)(size_t)nFlags;
+
+   return (nFlags & (HUGE_PAGES_EXPLICIT | HUGE_PAGES_TRANSPARENT)) ? 1 : 0;
+}
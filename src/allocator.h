@@ -0,0 +1,69 @@
+/*
+ * allocator.h - caller-supplied memory allocator
+ *
+ * Copyright (C) 2019 Emmanuel Marty
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*
+ * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
+ *
+ * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
+ * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
+ * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
+ * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
+ *
+ */
+
+#ifndef _ALLOCATOR_H
+#define _ALLOCATOR_H
+
+#include <stdlib.h>
+#include "lz4ultra.h"
+
+/**
+ * Allocate memory
+ *
+ * @param pAllocator allocator, or NULL, or one with a NULL alloc_mem, to use malloc()
+ * @param nSize number of bytes to allocate
+ *
+ * @return allocated memory, or NULL for failure
+ */
+static inline void *lz4ultra_alloc(const lz4ultra_allocator *pAllocator, size_t nSize) {
+   if (pAllocator && pAllocator->alloc_mem)
+      return pAllocator->alloc_mem(pAllocator->pOpaque, nSize);
+   else
+      return malloc(nSize);
+}
+
+/**
+ * Free memory allocated with lz4ultra_alloc()
+ *
+ * @param pAllocator allocator that the memory was allocated with
+ * @param pPtr memory to free, or NULL for none
+ */
+static inline void lz4ultra_free(const lz4ultra_allocator *pAllocator, void *pPtr) {
+   if (!pPtr)
+      return;
+   if (pAllocator && pAllocator->alloc_mem)
+      pAllocator->free_mem(pAllocator->pOpaque, pPtr);
+   else
+      free(pPtr);
+}
+
+#endif /* _ALLOCATOR_H */
@@ -0,0 +1,347 @@
+/*
+ * asyncstream.c - asynchronous read-ahead and write-behind stream implementation
+ *
+ * Copyright (C) 2019 Emmanuel Marty
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*
+ * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
+ *
+ * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
+ * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
+ * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
+ * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "asyncstream.h"
+#include "thread.h"
+
+/** Asynchronous stream state */
+typedef struct {
+   lz4ultra_stream_t *pBaseStream;
+   lz4ultra_thread_t thread;
+   lz4ultra_mutex_t mutex;
+   lz4ultra_cond_t cond;
+   unsigned char *pBuffer;
+   size_t nBufferSize;
+   size_t nStart;
+   size_t nFill;
+   int nWrite;
+   int nEof;
+   int nError;
+   int nQuit;
+} lz4ultra_asyncstream;
+
+/**
+ * Background thread main loop, reading ahead from the underlying stream into free space of the ring buffer. Data is read
+ * without holding the lock, the caller only ever consumes data that was already read
+ *
+ * @param pAsync asynchronous stream state
+ */
+static void lz4ultra_asyncstream_read_loop(lz4ultra_asyncstream *pAsync) {
+   lz4ultra_mutex_lock(&pAsync->mutex);
+
+   for (;;) {
+      while (!pAsync->nQuit && pAsync->nFill == pAsync->nBufferSize)
+         lz4ultra_cond_wait(&pAsync->cond, &pAsync->mutex);
+      if (pAsync->nQuit)
+         break;
+
+      size_t nPos = (pAsync->nStart + pAsync->nFill) % pAsync->nBufferSize;
+      size_t nSize = pAsync->nBufferSize - pAsync->nFill;
+      if (nSize > (pAsync->nBufferSize - nPos))
+         nSize = pAsync->nBufferSize - nPos;
+
+      lz4ultra_mutex_unlock(&pAsync->mutex);
+      size_t nReadBytes = pAsync->pBaseStream->read(pAsync->pBaseStream, pAsync->pBuffer + nPos, nSize);
+      int nEof = (nReadBytes < nSize || pAsync->pBaseStream->eof(pAsync->pBaseStream)) ? 1 : 0;
+      lz4ultra_mutex_lock(&pAsync->mutex);
+
+      pAsync->nFill += nReadBytes;
+      pAsync->nEof = nEof;
+      lz4ultra_cond_broadcast(&pAsync->cond);
+      if (nEof)
+         break;
+   }
+
+   lz4ultra_mutex_unlock(&pAsync->mutex);
+}
+
+/**
+ * Background thread main loop, writing pending data from the ring buffer to the underlying stream. Data is written
+ * without holding the lock, the caller only ever adds data to the free space of the buffer
+ *
+ * @param pAsync asynchronous stream state
+ */
+static void lz4ultra_asyncstream_write_loop(lz4ultra_asyncstream *pAsync) {
+   lz4ultra_mutex_lock(&pAsync->mutex);
+
+   for (;;) {
+      while (!pAsync->nQuit && pAsync->nFill == 0)
+         lz4ultra_cond_wait(&pAsync->cond, &pAsync->mutex);
+      if (pAsync->nFill == 0)
+         break;
+
+      size_t nPos = pAsync->nStart;
+      size_t nSize = pAsync->nFill;
+      if (nSize > (pAsync->nBufferSize - nPos))
+         nSize = pAsync->nBufferSize - nPos;
+
+      lz4ultra_mutex_unlock(&pAsync->mutex);
+      int nError = 0;
+      if (!pAsync->nError && pAsync->pBaseStream->write(pAsync->pBaseStream, pAsync->pBuffer + nPos, nSize) != nSize)
+         nError = 1;
+      lz4ultra_mutex_lock(&pAsync->mutex);
+
+      if (nError)
+         pAsync->nError = 1;
+      pAsync->nStart = (nPos + nSize) % pAsync->nBufferSize;
+      pAsync->nFill -= nSize;
+      lz4ultra_cond_broadcast(&pAsync->cond);
+   }
+
+   lz4ultra_mutex_unlock(&pAsync->mutex);
+}
+
+/**
+ * Background thread entry point
+ *
+ * @param pArg asynchronous stream state
+ */
+static LZ4ULTRA_THREAD_FUNC(lz4ultra_asyncstream_main, pArg) {
+   lz4ultra_asyncstream *pAsync = (lz4ultra_asyncstream *)pArg;
+
+   if (pAsync->nWrite)
+      lz4ultra_asyncstream_write_loop(pAsync);
+   else
+      lz4ultra_asyncstream_read_loop(pAsync);
+   LZ4ULTRA_THREAD_RETURN;
+}
+
+/**
+ * Read from asynchronous stream, waiting for the background thread to read ahead as needed
+ *
+ * @param stream stream
+ * @param ptr buffer to read into
+ * @param size number of bytes to read
+ *
+ * @return number of bytes read
+ */
+static size_t lz4ultra_asyncstream_read(lz4ultra_stream_t *stream, void *ptr, size_t size) {
+   lz4ultra_asyncstream *pAsync = (lz4ultra_asyncstream *)stream->obj;
+   size_t nTotalBytes = 0;
+
+   lz4ultra_mutex_lock(&pAsync->mutex);
+
+   while (size) {
+      while (pAsync->nFill == 0 && !pAsync->nEof)
+         lz4ultra_cond_wait(&pAsync->cond, &pAsync->mutex);
+      if (pAsync->nFill == 0)
+         break;
+
+      size_t nPos = pAsync->nStart;
+      size_t nBytes = pAsync->nFill;
+      if (nBytes > (pAsync->nBufferSize - nPos))
+         nBytes = pAsync->nBufferSize - nPos;
+      if (nBytes > size)
+         nBytes = size;
+
+      lz4ultra_mutex_unlock(&pAsync->mutex);
+      memcpy((unsigned char *)ptr + nTotalBytes, pAsync->pBuffer + nPos, nBytes);
+      lz4ultra_mutex_lock(&pAsync->mutex);
+
+      pAsync->nStart = (nPos + nBytes) % pAsync->nBufferSize;
+      pAsync->nFill -= nBytes;
+      lz4ultra_cond_broadcast(&pAsync->cond);
+
+      nTotalBytes += nBytes;
+      size -= nBytes;
+   }
+
+   lz4ultra_mutex_unlock(&pAsync->mutex);
+   return nTotalBytes;
+}
+
+/**
+ * Write to asynchronous stream, waiting for the background thread to make room in the buffer as needed
+ *
+ * @param stream stream
+ * @param ptr buffer to write from
+ * @param size number of bytes to write
+ *
+ * @return number of bytes written
+ */
+static size_t lz4ultra_asyncstream_write(lz4ultra_stream_t *stream, void *ptr, size_t size) {
+   lz4ultra_asyncstream *pAsync = (lz4ultra_asyncstream *)stream->obj;
+   size_t nTotalBytes = 0;
+
+   lz4ultra_mutex_lock(&pAsync->mutex);
+
+   while (size && !pAsync->nError) {
+      while (pAsync->nFill == pAsync->nBufferSize && !pAsync->nError)
+         lz4ultra_cond_wait(&pAsync->cond, &pAsync->mutex);
+      if (pAsync->nError)
+         break;
+
+      size_t nPos = (pAsync->nStart + pAsync->nFill) % pAsync->nBufferSize;
+      size_t nBytes = pAsync->nBufferSize - pAsync->nFill;
+      if (nBytes > (pAsync->nBufferSize - nPos))
+         nBytes = pAsync->nBufferSize - nPos;
+      if (nBytes > size)
+         nBytes = size;
+
+      lz4ultra_mutex_unlock(&pAsync->mutex);
+      memcpy(pAsync->pBuffer + nPos, (const unsigned char *)ptr + nTotalBytes, nBytes);
+      lz4ultra_mutex_lock(&pAsync->mutex);
+
+      pAsync->nFill += nBytes;
+      lz4ultra_cond_broadcast(&pAsync->cond);
+
+      nTotalBytes += nBytes;
+      size -= nBytes;
+   }
+
+   lz4ultra_mutex_unlock(&pAsync->mutex);
+   return nTotalBytes;
+}
+
+/**
+ * Check if asynchronous stream has reached the end of the data, waiting for the background thread to find out as needed
+ *
+ * @param stream stream
+ *
+ * @return nonzero if the end of the data has been reached, 0 if there is more data
+ */
+static int lz4ultra_asyncstream_eof(lz4ultra_stream_t *stream) {
+   lz4ultra_asyncstream *pAsync = (lz4ultra_asyncstream *)stream->obj;
+   int nEof;
+
+   if (pAsync->nWrite)
+      return 0;
+
+   lz4ultra_mutex_lock(&pAsync->mutex);
+   while (pAsync->nFill == 0 && !pAsync->nEof)
+      lz4ultra_cond_wait(&pAsync->cond, &pAsync->mutex);
+   nEof = (pAsync->nFill == 0) ? 1 : 0;
+   lz4ultra_mutex_unlock(&pAsync->mutex);
+
+   return nEof;
+}
+
+/**
+ * Close asynchronous stream
+ *
+ * @param stream stream
+ */
+static void lz4ultra_asyncstream_close(lz4ultra_stream_t *stream) {
+   lz4ultra_asyncstream_finish(stream);
+}
+
+/**
+ * Create an I/O stream that reads ahead of, or writes behind the caller on a background thread, through a ring buffer, so that
+ * transfers with the underlying stream overlap with compression or decompression. The underlying stream is used solely by the
+ * background thread until the stream is closed, and isn't closed along with the stream
+ *
+ * @param stream stream to fill out
+ * @param pBaseStream underlying stream to read from or write to
+ * @param nWrite 1 to create a stream for writing, 0 to create a stream for reading
+ * @param nBufferSize size of the ring buffer, in bytes
+ *
+ * @return 0 for success, nonzero for failure
+ */
+int lz4ultra_asyncstream_open(lz4ultra_stream_t *stream, lz4ultra_stream_t *pBaseStream, const int nWrite, const size_t nBufferSize) {
+   lz4ultra_asyncstream *pAsync;
+
+   memset(stream, 0, sizeof(lz4ultra_stream_t));
+
+   pAsync = (lz4ultra_asyncstream *)malloc(sizeof(lz4ultra_asyncstream));
+   if (!pAsync)
+      return -1;
+
+   memset(pAsync, 0, sizeof(lz4ultra_asyncstream));
+   pAsync->pBaseStream = pBaseStream;
+   pAsync->nWrite = nWrite;
+   pAsync->nBufferSize = nBufferSize ? nBufferSize : 1;
+
+   pAsync->pBuffer = (unsigned char *)malloc(pAsync->nBufferSize);
+   if (!pAsync->pBuffer) {
+      free(pAsync);
+      return -1;
+   }
+
+   if (lz4ultra_mutex_init(&pAsync->mutex) != 0) {
+      free(pAsync->pBuffer);
+      free(pAsync);
+      return -1;
+   }
+   lz4ultra_cond_init(&pAsync->cond);
+
+   if (lz4ultra_thread_create(&pAsync->thread, lz4ultra_asyncstream_main, pAsync) != 0) {
+      lz4ultra_cond_destroy(&pAsync->cond);
+      lz4ultra_mutex_destroy(&pAsync->mutex);
+      free(pAsync->pBuffer);
+      free(pAsync);
+      return -1;
+   }
+
+   stream->obj = (void *)pAsync;
+   stream->read = lz4ultra_asyncstream_read;
+   stream->write = lz4ultra_asyncstream_write;
+   stream->eof = lz4ultra_asyncstream_eof;
+   stream->close = lz4ultra_asyncstream_close;
+   return 0;
+}
+
+/**
+ * Flush pending data to the underlying stream, stop the background thread and close the stream
+ *
+ * @param stream stream
+ *
+ * @return 0 for success, nonzero if some of the data written to the stream couldn't be written to the underlying stream
+ */
+int lz4ultra_asyncstream_finish(lz4ultra_stream_t *stream) {
+   lz4ultra_asyncstream *pAsync = (lz4ultra_asyncstream *)stream->obj;
+   int nError;
+
+   if (!pAsync)
+      return 0;
+
+   lz4ultra_mutex_lock(&pAsync->mutex);
+   pAsync->nQuit = 1;
+   lz4ultra_cond_broadcast(&pAsync->cond);
+   lz4ultra_mutex_unlock(&pAsync->mutex);
+
+   lz4ultra_thread_join(pAsync->thread);
+
+   nError = pAsync->nError;
+   lz4ultra_cond_destroy(&pAsync->cond);
+   lz4ultra_mutex_destroy(&pAsync->mutex);
+   free(pAsync->pBuffer);
+   free(pAsync);
+
+   stream->obj = NULL;
+   stream->read = NULL;
+   stream->write = NULL;
+   stream->eof = NULL;
+   stream->close = NULL;
+   return nError;
+}
@@ -0,0 +1,62 @@
+/*
+ * asyncstream.h - asynchronous read-ahead and write-behind stream definitions
+ *
+ * Copyright (C) 2019 Emmanuel Marty
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*
+ * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
+ *
+ * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
+ * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
+ * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
+ * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
+ *
+ */
+
+#ifndef _ASYNCSTREAM_H
+#define _ASYNCSTREAM_H
+
+#include <stddef.h>
+#include "stream.h"
+
+/**
+ * Create an I/O stream that reads ahead of, or writes behind the caller on a background thread, through a ring buffer, so that
+ * transfers with the underlying stream overlap with compression or decompression. The underlying stream is used solely by the
+ * background thread until the stream is closed, and isn't closed along with the stream
+ *
+ * @param stream stream to fill out
+ * @param pBaseStream underlying stream to read from or write to
+ * @param nWrite 1 to create a stream for writing, 0 to create a stream for reading
+ * @param nBufferSize size of the ring buffer, in bytes
+ *
+ * @return 0 for success, nonzero for failure
+ */
+int lz4ultra_asyncstream_open(lz4ultra_stream_t *stream, lz4ultra_stream_t *pBaseStream, const int nWrite, const size_t nBufferSize);
+
+/**
+ * Flush pending data to the underlying stream, stop the background thread and close the stream
+ *
+ * @param stream stream
+ *
+ * @return 0 for success, nonzero if some of the data written to the stream couldn't be written to the underlying stream
+ */
+int lz4ultra_asyncstream_finish(lz4ultra_stream_t *stream);
+
+#endif /* _ASYNCSTREAM_H */
@@ -0,0 +1,586 @@
+/*
+ * dedup.c - long-distance deduplication implementation
+ *
+ * Copyright (C) 2019 Emmanuel Marty
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*
+ * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
+ *
+ * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
+ * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
+ * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
+ * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "dedup.h"
+#include "frame.h"
+#define XXH_STATIC_LINKING_ONLY
+#include "xxhash.h"
+
+#define DEDUP_MIN_CHUNK_SIZE  8192
+#define DEDUP_MAX_CHUNK_SIZE  131072
+#define DEDUP_CHUNK_MASK      (0x3fffULL << 50)    /* cut on average 16 Kb past the minimum chunk size */
+#define DEDUP_MIN_REF_SIZE    4096
+#define DEDUP_MAX_REF_SIZE    0x40000000U
+#define DEDUP_INDEX_BATCH     256
+
+/** One chunk of the original data, in the chunk index */
+typedef struct {
+   unsigned long long nHash;
+   long long nOffset;
+   unsigned int nSize;           /**< size of the chunk, or 0 for an empty slot */
+} lz4ultra_dedup_chunk;
+
+/** State of a stream that reads or writes the original data around the repeated ranges */
+typedef struct {
+   const lz4ultra_dedup *pDedup;
+   const unsigned char *pInData;
+   unsigned char *pOutData;
+   long long nPos;
+   unsigned int nRefIndex;
+} lz4ultra_dedup_stream;
+
+/**
+ * Get the next value of a splitmix64 sequence
+ *
+ * @param pState sequence state, updated by this function
+ *
+ * @return value
+ */
+static unsigned long long lz4ultra_dedup_next_random(unsigned long long *pState) {
+   unsigned long long z = (*pState += 0x9E3779B97F4A7C15ULL);
+
+   z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+   z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+   return z ^ (z >> 31);
+}
+
+/**
+ * Find the end of the chunk that starts at the specified offset, where the gear hash of the last 64 bytes has its top bits cleared
+ *
+ * @param pGear random value for each byte value
+ * @param pInData original data
+ * @param nPos offset of the start of the chunk
+ * @param nEnd size of original data, in bytes
+ *
+ * @return offset of the end of the chunk
+ */
+static size_t lz4ultra_dedup_next_chunk(const unsigned long long *pGear, const unsigned char *pInData, const size_t nPos, const size_t nEnd) {
+   const size_t nMaxEnd = ((nEnd - nPos) > DEDUP_MAX_CHUNK_SIZE) ? (nPos + DEDUP_MAX_CHUNK_SIZE) : nEnd;
+   unsigned long long nHash = 0;
+   size_t i;
+
+   if ((nPos + DEDUP_MIN_CHUNK_SIZE) >= nMaxEnd)
+      return nMaxEnd;
+
+   /* Each byte shifts out of the hash after 64 more, start hashing that far before the minimum size */
+   for (i = nPos + DEDUP_MIN_CHUNK_SIZE - 64; i < nPos + DEDUP_MIN_CHUNK_SIZE; i++)
+      nHash = (nHash << 1) + pGear[pInData[i]];
+
+   for (; i < nMaxEnd; i++) {
+      nHash = (nHash << 1) + pGear[pInData[i]];
+      if (!(nHash & DEDUP_CHUNK_MASK))
+         return i + 1;
+   }
+
+   return nMaxEnd;
+}
+
+/**
+ * Add a repeated range, merging it with the previous one if they are contiguous both in the data and in the source
+ *
+ * @param pDedup repeated ranges
+ * @param nOffset offset of the range in the original data
+ * @param nSourceOffset offset of the earlier range that it repeats
+ * @param nSize size of the range, in bytes
+ *
+ * @return 0 for success, nonzero for failure
+ */
+static int lz4ultra_dedup_add_ref(lz4ultra_dedup *pDedup, const long long nOffset, const long long nSourceOffset, const unsigned int nSize) {
+   if (pDedup->nNumRefs) {
+      lz4ultra_dedup_ref *pPrevRef = &pDedup->pRefs[pDedup->nNumRefs - 1];
+
+      if ((pPrevRef->nOffset + pPrevRef->nSize) == nOffset && (pPrevRef->nSourceOffset + pPrevRef->nSize) == nSourceOffset &&
+          ((unsigned long long)pPrevRef->nSize + nSize) <= DEDUP_MAX_REF_SIZE) {
+         pPrevRef->nSize += nSize;
+         pDedup->nRefsSize += (long long)nSize;
+         return 0;
+      }
+   }
+
+   if (pDedup->nNumRefs == pDedup->nMaxRefs) {
+      unsigned int nNewMaxRefs = pDedup->nMaxRefs ? (pDedup->nMaxRefs * 2) : 256;
+      lz4ultra_dedup_ref *pNewRefs = (lz4ultra_dedup_ref *)lz4ultra_alloc(pDedup->pAllocator, nNewMaxRefs * sizeof(lz4ultra_dedup_ref));
+
+      if (!pNewRefs)
+         return 100;
+      if (pDedup->pRefs) {
+         memcpy(pNewRefs, pDedup->pRefs, pDedup->nNumRefs * sizeof(lz4ultra_dedup_ref));
+         lz4ultra_free(pDedup->pAllocator, pDedup->pRefs);
+      }
+      pDedup->pRefs = pNewRefs;
+      pDedup->nMaxRefs = nNewMaxRefs;
+   }
+
+   pDedup->pRefs[pDedup->nNumRefs].nOffset = nOffset;
+   pDedup->pRefs[pDedup->nNumRefs].nSourceOffset = nSourceOffset;
+   pDedup->pRefs[pDedup->nNumRefs].nSize = nSize;
+   pDedup->nNumRefs++;
+   pDedup->nRefsSize += (long long)nSize;
+   return 0;
+}
+
+/**
+ * Find the ranges of data that repeat earlier ranges, at any distance: the data is cut into chunks at content-defined boundaries, so that
+ * the same data is cut the same way wherever it is, and each chunk that repeats an earlier one is extended over the bytes that also match
+ * around it
+ *
+ * @param pDedup repeated ranges to fill out, to free with lz4ultra_dedup_free()
+ * @param pAllocator allocator for the ranges and for the chunk index, or NULL to use malloc()
+ * @param pInData original data
+ * @param nInDataSize size of original data, in bytes
+ *
+ * @return 0 for success, nonzero for failure
+ */
+int lz4ultra_dedup_find(lz4ultra_dedup *pDedup, const lz4ultra_allocator *pAllocator, const unsigned char *pInData, const size_t nInDataSize) {
+   unsigned long long nGear[256];
+   unsigned long long nRandomState = 0;
+   lz4ultra_dedup_chunk *pChunks;
+   size_t nTableSize, nNumChunks = 0;
+   size_t nPos, nRefEnd = 0;
+   int i;
+
+   memset(pDedup, 0, sizeof(lz4ultra_dedup));
+   pDedup->pAllocator = pAllocator;
+   pDedup->nOriginalSize = (long long)nInDataSize;
+
+   if (nInDataSize < (2 * DEDUP_MIN_CHUNK_SIZE))
+      return 0;
+
+   for (i = 0; i < 256; i++)
+      nGear[i] = lz4ultra_dedup_next_random(&nRandomState);
+
+   /* Size the chunk index for twice the average number of chunks; past three quarters full, chunks are only looked up */
+   nTableSize = 1024;
+   while (nTableSize < (nInDataSize / (DEDUP_MIN_CHUNK_SIZE * 2)) * 2 && nTableSize < ((size_t)1 << (sizeof(size_t) * 8 - 6)))
+      nTableSize <<= 1;
+   pChunks = (lz4ultra_dedup_chunk *)lz4ultra_alloc(pAllocator, nTableSize * sizeof(lz4ultra_dedup_chunk));
+   if (!pChunks)
+      return 100;
+   memset(pChunks, 0, nTableSize * sizeof(lz4ultra_dedup_chunk));
+
+   nPos = 0;
+   while (nPos < nInDataSize) {
+      const size_t nChunkEnd = lz4ultra_dedup_next_chunk(nGear, pInData, nPos, nInDataSize);
+      const unsigned int nChunkSize = (unsigned int)(nChunkEnd - nPos);
+      const unsigned long long nHash = XXH64(pInData + nPos, nChunkSize, 0);
+      size_t nSlot = (size_t)(nHash ^ (nHash >> 32)) & (nTableSize - 1);
+      const lz4ultra_dedup_chunk *pMatch = NULL;
+
+      while (pChunks[nSlot].nSize) {
+         if (pChunks[nSlot].nHash == nHash && pChunks[nSlot].nSize == nChunkSize && !memcmp(pInData + pChunks[nSlot].nOffset, pInData + nPos, nChunkSize)) {
+            pMatch = &pChunks[nSlot];
+            break;
+         }
+         nSlot = (nSlot + 1) & (nTableSize - 1);
+      }
+
+      if (pMatch) {
+         size_t nStart = nPos;
+         size_t nSource = (size_t)pMatch->nOffset;
+         size_t nSize = nChunkSize;
+         size_t nMaxForward, nForward = 0;
+
+         /* Extend the repeated range back over the preceding bytes, that the previous chunk only partly shared */
+         while (nStart > nRefEnd && nSource > 0 && (nSource + nSize) < nStart && nSize < DEDUP_MAX_REF_SIZE && pInData[nSource - 1] == pInData[nStart - 1]) {
+            nStart--;
+            nSource--;
+            nSize++;
+         }
+
+         /* And forward, over any following chunks that repeat too, without the source reaching the range itself */
+         nMaxForward = nInDataSize - (nStart + nSize);
+         if (nMaxForward > (nStart - (nSource + nSize)))
+            nMaxForward = nStart - (nSource + nSize);
+         if (nMaxForward > (DEDUP_MAX_REF_SIZE - nSize))
+            nMaxForward = DEDUP_MAX_REF_SIZE - nSize;
+         while ((nForward + 8) <= nMaxForward && !memcmp(pInData + nSource + nSize + nForward, pInData + nStart + nSize + nForward, 8))
+            nForward += 8;
+         while (nForward < nMaxForward && pInData[nSource + nSize + nForward] == pInData[nStart + nSize + nForward])
+            nForward++;
+         nSize += nForward;
+
+         if (nSize >= DEDUP_MIN_REF_SIZE) {
+            if (lz4ultra_dedup_add_ref(pDedup, (long long)nStart, (long long)nSource, (unsigned int)nSize)) {
+               lz4ultra_free(pAllocator, pChunks);
+               lz4ultra_dedup_free(pDedup);
+               return 100;
+            }
+            nRefEnd = nStart + nSize;
+            nPos = nRefEnd;
+            continue;
+         }
+      }
+      else if (nNumChunks < (nTableSize - (nTableSize >> 2))) {
+         pChunks[nSlot].nHash = nHash;
+         pChunks[nSlot].nOffset = (long long)nPos;
+         pChunks[nSlot].nSize = nChunkSize;
+         nNumChunks++;
+      }
+
+      nPos = nChunkEnd;
+   }
+
+   lz4ultra_free(pAllocator, pChunks);
+   return 0;
+}
+
+/**
+ * Load the repeated ranges from the deduplication index at the start of compressed data
+ *
+ * @param pDedup repeated ranges to fill out, to free with lz4ultra_dedup_free()
+ * @param pAllocator allocator for the ranges, or NULL to use malloc()
+ * @param pInData compressed data
+ * @param nInDataSize size of compressed data, in bytes
+ *
+ * @return 1 if the repeated ranges were loaded, 0 if the data doesn't start with a deduplication index, -1 if the index is invalid or for failure
+ */
+int lz4ultra_dedup_load_index(lz4ultra_dedup *pDedup, const lz4ultra_allocator *pAllocator, const unsigned char *pInData, const size_t nInDataSize) {
+   unsigned int nRefs = 0;
+   long long nOriginalSize = 0;
+   long long nPrevRefEnd = 0;
+   unsigned int i;
+
+   memset(pDedup, 0, sizeof(lz4ultra_dedup));
+   pDedup->pAllocator = pAllocator;
+
+   if (!lz4ultra_is_dedup_header(pInData, (nInDataSize > LZ4ULTRA_DEDUP_HEADER_SIZE) ? LZ4ULTRA_DEDUP_HEADER_SIZE : (int)nInDataSize))
+      return 0;
+   if (nInDataSize < LZ4ULTRA_DEDUP_HEADER_SIZE || lz4ultra_decode_dedup_header(pInData, LZ4ULTRA_DEDUP_HEADER_SIZE, &nRefs, &nOriginalSize) != LZ4ULTRA_DECODE_OK)
+      return -1;
+   if (((nInDataSize - LZ4ULTRA_DEDUP_HEADER_SIZE) / LZ4ULTRA_DEDUP_ENTRY_SIZE) < (size_t)nRefs)
+      return -1;
+
+   pDedup->nOriginalSize = nOriginalSize;
+   if (!nRefs)
+      return 1;
+
+   pDedup->pRefs = (lz4ultra_dedup_ref *)lz4ultra_alloc(pAllocator, nRefs * sizeof(lz4ultra_dedup_ref));
+   if (!pDedup->pRefs)
+      return -1;
+   pDedup->nMaxRefs = nRefs;
+
+   for (i = 0; i < nRefs; i++) {
+      lz4ultra_dedup_ref *pRef = &pDedup->pRefs[i];
+
+      if (lz4ultra_decode_dedup_entry(pInData + LZ4ULTRA_DEDUP_HEADER_SIZE + (size_t)i * LZ4ULTRA_DEDUP_ENTRY_SIZE, LZ4ULTRA_DEDUP_ENTRY_SIZE,
+             &pRef->nOffset, &pRef->nSourceOffset, &pRef->nSize) != LZ4ULTRA_DECODE_OK)
+         break;
+
+      /* Ranges must follow each other, fit in the original data, and only copy data that is already restored */
+      if (!pRef->nSize || pRef->nOffset < nPrevRefEnd || pRef->nOffset > (nOriginalSize - (long long)pRef->nSize) ||
+          (pRef->nSourceOffset + (long long)pRef->nSize) > pRef->nOffset)
+         break;
+
+      nPrevRefEnd = pRef->nOffset + (long long)pRef->nSize;
+      pDedup->nRefsSize += (long long)pRef->nSize;
+      pDedup->nNumRefs++;
+   }
+
+   if (pDedup->nNumRefs != nRefs) {
+      lz4ultra_dedup_free(pDedup);
+      return -1;
+   }
+
+   return 1;
+}
+
+/**
+ * Write the deduplication index of the repeated ranges, as a skippable frame
+ *
+ * @param pDedup repeated ranges
+ * @param pOutStream output(compressed) stream to write to
+ * @param pIndexSize pointer to returned number of bytes written, updated when this function is successful
+ *
+ * @return 0 for success, nonzero for failure
+ */
+int lz4ultra_dedup_write_index(const lz4ultra_dedup *pDedup, lz4ultra_stream_t *pOutStream, long long *pIndexSize) {
+   unsigned char cIndexData[DEDUP_INDEX_BATCH * LZ4ULTRA_DEDUP_ENTRY_SIZE];
+   int nHeaderSize;
+   unsigned int i;
+
+   nHeaderSize = lz4ultra_encode_dedup_header(cIndexData, sizeof(cIndexData), pDedup->nNumRefs, pDedup->nOriginalSize);
+   if (nHeaderSize < 0 || pOutStream->write(pOutStream, cIndexData, nHeaderSize) != (size_t)nHeaderSize)
+      return 100;
+
+   for (i = 0; i < pDedup->nNumRefs; i += DEDUP_INDEX_BATCH) {
+      const unsigned int nBatchRefs = ((pDedup->nNumRefs - i) < DEDUP_INDEX_BATCH) ? (pDedup->nNumRefs - i) : DEDUP_INDEX_BATCH;
+      unsigned int j;
+
+      for (j = 0; j < nBatchRefs; j++) {
+         const lz4ultra_dedup_ref *pRef = &pDedup->pRefs[i + j];
+
+         if (lz4ultra_encode_dedup_entry(cIndexData + j * LZ4ULTRA_DEDUP_ENTRY_SIZE, LZ4ULTRA_DEDUP_ENTRY_SIZE, pRef->nOffset, pRef->nSourceOffset, pRef->nSize) < 0)
+            return 100;
+      }
+
+      if (pOutStream->write(pOutStream, cIndexData, nBatchRefs * LZ4ULTRA_DEDUP_ENTRY_SIZE) != (size_t)(nBatchRefs * LZ4ULTRA_DEDUP_ENTRY_SIZE))
+         return 100;
+   }
+
+   *pIndexSize = (long long)nHeaderSize + (long long)pDedup->nNumRefs * LZ4ULTRA_DEDUP_ENTRY_SIZE;
+   return 0;
+}
+
+/**
+ * Free the repeated ranges
+ *
+ * @param pDedup repeated ranges
+ */
+void lz4ultra_dedup_free(lz4ultra_dedup *pDedup) {
+   if (pDedup->pRefs) {
+      lz4ultra_free(pDedup->pAllocator, pDedup->pRefs);
+      pDedup->pRefs = NULL;
+   }
+   pDedup->nNumRefs = 0;
+   pDedup->nMaxRefs = 0;
+   pDedup->nRefsSize = 0;
+}
+
+/**
+ * Step over the repeated ranges at the current offset of a stream
+ *
+ * @param pStream stream state
+ * @param nRestore 1 to copy the repeated ranges from the data already restored, when writing, 0 to skip them, when reading
+ */
+static void lz4ultra_dedup_stream_skip_refs(lz4ultra_dedup_stream *pStream, const int nRestore) {
+   const lz4ultra_dedup *pDedup = pStream->pDedup;
+
+   while (pStream->nRefIndex < pDedup->nNumRefs && pDedup->pRefs[pStream->nRefIndex].nOffset == pStream->nPos) {
+      const lz4ultra_dedup_ref *pRef = &pDedup->pRefs[pStream->nRefIndex];
+
+      if (nRestore)
+         memcpy(pStream->pOutData + pRef->nOffset, pStream->pOutData + pRef->nSourceOffset, pRef->nSize);
+      pStream->nPos += (long long)pRef->nSize;
+      pStream->nRefIndex++;
+   }
+}
+
+/**
+ * Get the number of bytes of data from the current offset of a stream to the next repeated range, or to the end of the data
+ *
+ * @param pStream stream state
+ *
+ * @return number of bytes
+ */
+static long long lz4ultra_dedup_stream_get_run(const lz4ultra_dedup_stream *pStream) {
+   const lz4ultra_dedup *pDedup = pStream->pDedup;
+
+   if (pStream->nRefIndex < pDedup->nNumRefs)
+      return pDedup->pRefs[pStream->nRefIndex].nOffset - pStream->nPos;
+   else
+      return pDedup->nOriginalSize - pStream->nPos;
+}
+
+/**
+ * Read from the original data, leaving out the repeated ranges
+ *
+ * @param stream stream
+ * @param ptr buffer to read into
+ * @param size number of bytes to read
+ *
+ * @return number of bytes read
+ */
+static size_t lz4ultra_dedup_reader_read(lz4ultra_stream_t *stream, void *ptr, size_t size) {
+   lz4ultra_dedup_stream *pStream = (lz4ultra_dedup_stream *)stream->obj;
+   size_t nRead = 0;
+
+   while (nRead < size) {
+      long long nRun;
+
+      lz4ultra_dedup_stream_skip_refs(pStream, 0);
+      nRun = lz4ultra_dedup_stream_get_run(pStream);
+      if (nRun <= 0)
+         break;
+      if ((unsigned long long)nRun > (unsigned long long)(size - nRead))
+         nRun = (long long)(size - nRead);
+
+      memcpy((unsigned char *)ptr + nRead, pStream->pInData + pStream->nPos, (size_t)nRun);
+      pStream->nPos += nRun;
+      nRead += (size_t)nRun;
+   }
+
+   return nRead;
+}
+
+/**
+ * Write to the original data, after restoring the repeated ranges that come first
+ *
+ * @param stream stream
+ * @param ptr buffer to write from
+ * @param size number of bytes to write
+ *
+ * @return number of bytes written
+ */
+static size_t lz4ultra_dedup_writer_write(lz4ultra_stream_t *stream, void *ptr, size_t size) {
+   lz4ultra_dedup_stream *pStream = (lz4ultra_dedup_stream *)stream->obj;
+   size_t nWritten = 0;
+
+   while (nWritten < size) {
+      long long nRun;
+
+      lz4ultra_dedup_stream_skip_refs(pStream, 1);
+      nRun = lz4ultra_dedup_stream_get_run(pStream);
+      if (nRun <= 0)
+         break;
+      if ((unsigned long long)nRun > (unsigned long long)(size - nWritten))
+         nRun = (long long)(size - nWritten);
+
+      memcpy(pStream->pOutData + pStream->nPos, (const unsigned char *)ptr + nWritten, (size_t)nRun);
+      pStream->nPos += nRun;
+      nWritten += (size_t)nRun;
+   }
+
+   return nWritten;
+}
+
+/**
+ * Read from a stream that is only written to
+ *
+ * @param stream stream
+ * @param ptr buffer to read into
+ * @param size number of bytes to read
+ *
+ * @return 0
+ */
+static size_t lz4ultra_dedup_writer_read(lz4ultra_stream_t *stream, void *ptr, size_t size) {
+   return 0;
+}
+
+/**
+ * Write to a stream that is only read from
+ *
+ * @param stream stream
+ * @param ptr buffer to write from
+ * @param size number of bytes to write
+ *
+ * @return 0
+ */
+static size_t lz4ultra_dedup_reader_write(lz4ultra_stream_t *stream, void *ptr, size_t size) {
+   return 0;
+}
+
+/**
+ * Check if the end of the original data has been reached
+ *
+ * @param stream stream
+ *
+ * @return nonzero if the end of the data has been reached, 0 if there is more data
+ */
+static int lz4ultra_dedup_stream_eof(lz4ultra_stream_t *stream) {
+   lz4ultra_dedup_stream *pStream = (lz4ultra_dedup_stream *)stream->obj;
+
+   return (lz4ultra_dedup_stream_get_run(pStream) <= 0 && pStream->nRefIndex >= pStream->pDedup->nNumRefs) ? 1 : 0;
+}
+
+/**
+ * Close stream
+ *
+ * @param stream stream
+ */
+static void lz4ultra_dedup_stream_close(lz4ultra_stream_t *stream) {
+   if (stream->obj) {
+      free(stream->obj);
+      stream->obj = NULL;
+   }
+}
+
+/**
+ * Create an input stream that reads the original data without the repeated ranges, to compress it
+ *
+ * @param stream stream to fill out
+ * @param pDedup repeated ranges, that must stay valid until the stream is closed
+ * @param pInData original data, that must stay valid until the stream is closed
+ *
+ * @return 0 for success, nonzero for failure
+ */
+int lz4ultra_dedup_reader_open(lz4ultra_stream_t *stream, const lz4ultra_dedup *pDedup, const unsigned char *pInData) {
+   lz4ultra_dedup_stream *pStream = (lz4ultra_dedup_stream *)malloc(sizeof(lz4ultra_dedup_stream));
+
+   if (!pStream)
+      return 100;
+   memset(pStream, 0, sizeof(lz4ultra_dedup_stream));
+   pStream->pDedup = pDedup;
+   pStream->pInData = pInData;
+
+   stream->obj = pStream;
+   stream->read = lz4ultra_dedup_reader_read;
+   stream->write = lz4ultra_dedup_reader_write;
+   stream->eof = lz4ultra_dedup_stream_eof;
+   stream->close = lz4ultra_dedup_stream_close;
+   return 0;
+}
+
+/**
+ * Create an output stream that the data without the repeated ranges is decompressed to, and that restores the original data, copying each
+ * repeated range from the data already restored
+ *
+ * @param stream stream to fill out
+ * @param pDedup repeated ranges, that must stay valid until the stream is closed
+ * @param pOutData buffer for the original data, of pDedup->nOriginalSize bytes, that must stay valid until the stream is closed
+ *
+ * @return 0 for success, nonzero for failure
+ */
+int lz4ultra_dedup_writer_open(lz4ultra_stream_t *stream, const lz4ultra_dedup *pDedup, unsigned char *pOutData) {
+   lz4ultra_dedup_stream *pStream = (lz4ultra_dedup_stream *)malloc(sizeof(lz4ultra_dedup_stream));
+
+   if (!pStream)
+      return 100;
+   memset(pStream, 0, sizeof(lz4ultra_dedup_stream));
+   pStream->pDedup = pDedup;
+   pStream->pOutData = pOutData;
+
+   stream->obj = pStream;
+   stream->read = lz4ultra_dedup_writer_read;
+   stream->write = lz4ultra_dedup_writer_write;
+   stream->eof = lz4ultra_dedup_stream_eof;
+   stream->close = lz4ultra_dedup_stream_close;
+   return 0;
+}
+
+/**
+ * Restore the repeated ranges that end the original data, and close an output stream created with lz4ultra_dedup_writer_open()
+ *
+ * @param stream stream
+ *
+ * @return 0 if all the original data was restored, nonzero if less or more data was written to the stream
+ */
+int lz4ultra_dedup_writer_finish(lz4ultra_stream_t *stream) {
+   lz4ultra_dedup_stream *pStream = (lz4ultra_dedup_stream *)stream->obj;
+   int nResult;
+
+   lz4ultra_dedup_stream_skip_refs(pStream, 1);
+   nResult = (pStream->nPos == pStream->pDedup->nOriginalSize) ? 0 : 100;
+
+   stream->close(stream);
+   return nResult;
+}
@@ -0,0 +1,132 @@
+/*
+ * dedup.h - long-distance deduplication definitions
+ *
+ * Copyright (C) 2019 Emmanuel Marty
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*
+ * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
+ *
+ * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
+ * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
+ * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
+ * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
+ *
+ */
+#ifndef _DEDUP_H
+#define _DEDUP_H
+
+#include <stddef.h>
+#include "stream.h"
+#include "allocator.h"
+
+/** One range of the original data that repeats an earlier range, and is left out of the compressed frame */
+typedef struct {
+   long long nOffset;            /**< offset of the range in the original data */
+   long long nSourceOffset;      /**< offset of the earlier range that it repeats, that ends at or before nOffset */
+   unsigned int nSize;           /**< size of the range, in bytes */
+} lz4ultra_dedup_ref;
+
+/** Repeated ranges of the original data, in increasing order of offset */
+typedef struct {
+   lz4ultra_dedup_ref *pRefs;
+   unsigned int nNumRefs;
+   unsigned int nMaxRefs;
+   long long nOriginalSize;      /**< size of the original data, with the repeated ranges */
+   long long nRefsSize;          /**< total size of the repeated ranges, in bytes */
+   const lz4ultra_allocator *pAllocator;  /**< allocator of the ranges */
+} lz4ultra_dedup;
+
+/**
+ * Find the ranges of data that repeat earlier ranges, at any distance: the data is cut into chunks at content-defined boundaries, so that
+ * the same data is cut the same way wherever it is, and each chunk that repeats an earlier one is extended over the bytes that also match
+ * around it
+ *
+ * @param pDedup repeated ranges to fill out, to free with lz4ultra_dedup_free()
+ * @param pAllocator allocator for the ranges and for the chunk index, or NULL to use malloc()
+ * @param pInData original data
+ * @param nInDataSize size of original data, in bytes
+ *
+ * @return 0 for success, nonzero for failure
+ */
+int lz4ultra_dedup_find(lz4ultra_dedup *pDedup, const lz4ultra_allocator *pAllocator, const unsigned char *pInData, const size_t nInDataSize);
+
+/**
+ * Load the repeated ranges from the deduplication index at the start of compressed data
+ *
+ * @param pDedup repeated ranges to fill out, to free with lz4ultra_dedup_free()
+ * @param pAllocator allocator for the ranges, or NULL to use malloc()
+ * @param pInData compressed data
+ * @param nInDataSize size of compressed data, in bytes
+ *
+ * @return 1 if the repeated ranges were loaded, 0 if the data doesn't start with a deduplication index, -1 if the index is invalid or for failure
+ */
+int lz4ultra_dedup_load_index(lz4ultra_dedup *pDedup, const lz4ultra_allocator *pAllocator, const unsigned char *pInData, const size_t nInDataSize);
+
+/**
+ * Write the deduplication index of the repeated ranges, as a skippable frame
+ *
+ * @param pDedup repeated ranges
+ * @param pOutStream output(compressed) stream to write to
+ * @param pIndexSize pointer to returned number of bytes written, updated when this function is successful
+ *
+ * @return 0 for success, nonzero for failure
+ */
+int lz4ultra_dedup_write_index(const lz4ultra_dedup *pDedup, lz4ultra_stream_t *pOutStream, long long *pIndexSize);
+
+/**
+ * Free the repeated ranges
+ *
+ * @param pDedup repeated ranges
+ */
+void lz4ultra_dedup_free(lz4ultra_dedup *pDedup);
+
+/**
+ * Create an input stream that reads the original data without the repeated ranges, to compress it
+ *
+ * @param stream stream to fill out
+ * @param pDedup repeated ranges, that must stay valid until the stream is closed
+ * @param pInData original data, that must stay valid until the stream is closed
+ *
+ * @return 0 for success, nonzero for failure
+ */
+int lz4ultra_dedup_reader_open(lz4ultra_stream_t *stream, const lz4ultra_dedup *pDedup, const unsigned char *pInData);
+
+/**
+ * Create an output stream that the data without the repeated ranges is decompressed to, and that restores the original data, copying each
+ * repeated range from the data already restored
+ *
+ * @param stream stream to fill out
+ * @param pDedup repeated ranges, that must stay valid until the stream is closed
+ * @param pOutData buffer for the original data, of pDedup->nOriginalSize bytes, that must stay valid until the stream is closed
+ *
+ * @return 0 for success, nonzero for failure
+ */
+int lz4ultra_dedup_writer_open(lz4ultra_stream_t *stream, const lz4ultra_dedup *pDedup, unsigned char *pOutData);
+
+/**
+ * Restore the repeated ranges that end the original data, and close an output stream created with lz4ultra_dedup_writer_open()
+ *
+ * @param stream stream
+ *
+ * @return 0 if all the original data was restored, nonzero if less or more data was written to the stream
+ */
+int lz4ultra_dedup_writer_finish(lz4ultra_stream_t *stream);
+
+#endif /* _DEDUP_H */
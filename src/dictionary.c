@@ -1,102 +1,411 @@
-/*
- * dictionary.c - dictionary implementation
- *
- * Copyright (C) 2019 Emmanuel Marty
- *
- * This software is provided 'as-is', without any express or implied
- * warranty.  In no event will the authors be held liable for any damages
- * arising from the use of this software.
- *
- * Permission is granted to anyone to use this software for any purpose,
- * including commercial applications, and to alter it and redistribute it
- * freely, subject to the following restrictions:
- *
- * 1. The origin of this software must not be misrepresented; you must not
- *    claim that you wrote the original software. If you use this software
- *    in a product, an acknowledgment in the product documentation would be
- *    appreciated but is not required.
- * 2. Altered source versions must be plainly marked as such, and must not be
- *    misrepresented as being the original software.
- * 3. This notice may not be removed or altered from any source distribution.
- */
-
-/*
- * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
- *
- * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
- * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
- * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
- * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
- *
- */
-
-#include <stdlib.h>
-#include "dictionary.h"
-#include "format.h"
-#include "lib.h"
-
-/**
- * Load dictionary contents
- *
- * @param pszDictionaryFilename name of dictionary file, or NULL for none
- * @param ppDictionaryData pointer to returned dictionary contents, or NULL for none
- * @param pDictionaryDataSize pointer to returned size of dictionary contents, or 0
- *
- * @return LZSA_OK for success, or an error value from lz4ultra_status_t
- */
-int lz4ultra_dictionary_load(const char *pszDictionaryFilename, void **ppDictionaryData, int *pDictionaryDataSize) {
-   unsigned char *pDictionaryData = NULL;
-   int nDictionaryDataSize = 0;
-
-   if (pszDictionaryFilename) {
-      pDictionaryData = (unsigned char *)malloc(HISTORY_SIZE);
-      if (!pDictionaryData) {
-         return LZ4ULTRA_ERROR_MEMORY;
-      }
-
-      FILE *f_dictionary = fopen(pszDictionaryFilename, "rb");
-      if (!f_dictionary) {
-         free(pDictionaryData);
-         pDictionaryData = NULL;
-
-         return LZ4ULTRA_ERROR_DICTIONARY;
-      }
-
-      fseek(f_dictionary, 0, SEEK_END);
-#ifdef _WIN32
-      __int64 nDictionaryFileSize = _ftelli64(f_dictionary);
-#else
-      off_t nDictionaryFileSize = ftello(f_dictionary);
-#endif
-      if (nDictionaryFileSize > HISTORY_SIZE) {
-         /* Use the last HISTORY_SIZE bytes of the dictionary */
-         fseek(f_dictionary, -HISTORY_SIZE, SEEK_END);
-      }
-      else {
-         fseek(f_dictionary, 0, SEEK_SET);
-      }
-
-      nDictionaryDataSize = (int)fread(pDictionaryData, 1, HISTORY_SIZE, f_dictionary);
-      if (nDictionaryDataSize < 0)
-         nDictionaryDataSize = 0;
-
-      fclose(f_dictionary);
-      f_dictionary = NULL;
-   }
-
-   *ppDictionaryData = pDictionaryData;
-   *pDictionaryDataSize = nDictionaryDataSize;
-   return LZ4ULTRA_OK;
-}
-
-/**
- * Free dictionary contents
- *
- * @param ppDictionaryData pointer to pointer to dictionary contents
- */
-void lz4ultra_dictionary_free(void **ppDictionaryData) {
-   if (*ppDictionaryData) {
-      free(*ppDictionaryData);
-      ppDictionaryData = NULL;
-   }
-}
+/*
+ * dictionary.c - dictionary implementation
+ *
+ * Copyright (C) 2019 Emmanuel Marty
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*
+ * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
+ *
+ * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
+ * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
+ * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
+ * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "dictionary.h"
+#include "matchfinder.h"
+#include "format.h"
+#include "lib.h"
+
+/* Size of the substrings whose number of samples is counted, to score the segments of the samples that a trained dictionary is built from */
+#define TRAIN_DMER_SIZE 6
+
+/* Size of the segments of the samples that a trained dictionary is built from */
+#define TRAIN_SEGMENT_SIZE 1024
+
+/**
+ * Load dictionary contents
+ *
+ * @param pszDictionaryFilename name of dictionary file, or NULL for none
+ * @param ppDictionaryData pointer to returned dictionary contents, or NULL for none
+ * @param pDictionaryDataSize pointer to returned size of dictionary contents, or 0
+ *
+ * @return LZSA_OK for success, or an error value from lz4ultra_status_t
+ */
+int lz4ultra_dictionary_load(const char *pszDictionaryFilename, void **ppDictionaryData, int *pDictionaryDataSize) {
+   unsigned char *pDictionaryData = NULL;
+   int nDictionaryDataSize = 0;
+
+   if (pszDictionaryFilename) {
+      pDictionaryData = (unsigned char *)malloc(HISTORY_SIZE);
+      if (!pDictionaryData) {
+         return LZ4ULTRA_ERROR_MEMORY;
+      }
+
+      FILE *f_dictionary = fopen(pszDictionaryFilename, "rb");
+      if (!f_dictionary) {
+         free(pDictionaryData);
+         pDictionaryData = NULL;
+
+         return LZ4ULTRA_ERROR_DICTIONARY;
+      }
+
+      fseek(f_dictionary, 0, SEEK_END);
+#ifdef _WIN32
+      __int64 nDictionaryFileSize = _ftelli64(f_dictionary);
+#else
+      off_t nDictionaryFileSize = ftello(f_dictionary);
+#endif
+      if (nDictionaryFileSize > HISTORY_SIZE) {
+         /* Use the last HISTORY_SIZE bytes of the dictionary */
+         fseek(f_dictionary, -HISTORY_SIZE, SEEK_END);
+      }
+      else {
+         fseek(f_dictionary, 0, SEEK_SET);
+      }
+
+      nDictionaryDataSize = (int)fread(pDictionaryData, 1, HISTORY_SIZE, f_dictionary);
+      if (nDictionaryDataSize < 0)
+         nDictionaryDataSize = 0;
+
+      fclose(f_dictionary);
+      f_dictionary = NULL;
+   }
+
+   *ppDictionaryData = pDictionaryData;
+   *pDictionaryDataSize = nDictionaryDataSize;
+   return LZ4ULTRA_OK;
+}
+
+/**
+ * Free dictionary contents
+ *
+ * @param ppDictionaryData pointer to pointer to dictionary contents
+ */
+void lz4ultra_dictionary_free(void **ppDictionaryData) {
+   if (*ppDictionaryData) {
+      free(*ppDictionaryData);
+      ppDictionaryData = NULL;
+   }
+}
+
+/**
+ * Prepare dictionary contents for compression. The dictionary's suffixes are sorted once, and the suffixes of each block that is compressed
+ * with the dictionary are then merged in, instead of sorting the dictionary along with every block
+ *
+ * @param pDictionaryData dictionary contents, as returned by lz4ultra_dictionary_load(), that are copied and don't need to be kept
+ * @param nDictionaryDataSize size of dictionary contents
+ *
+ * @return prepared dictionary, or NULL for failure
+ */
+lz4ultra_dictionary *lz4ultra_dictionary_prepare(const void *pDictionaryData, const int nDictionaryDataSize) {
+   lz4ultra_dictionary *pDictionary;
+
+   if (nDictionaryDataSize < 0 || nDictionaryDataSize > HISTORY_SIZE || (nDictionaryDataSize && !pDictionaryData))
+      return NULL;
+
+   /* The dictionary contents are stored right after the structure */
+   pDictionary = (lz4ultra_dictionary *)malloc(sizeof(lz4ultra_dictionary) + nDictionaryDataSize);
+   if (!pDictionary)
+      return NULL;
+
+   if (nDictionaryDataSize)
+      memcpy(pDictionary + 1, pDictionaryData, nDictionaryDataSize);
+   pDictionary->pData = (const unsigned char *)(pDictionary + 1);
+   pDictionary->nSize = nDictionaryDataSize;
+   pDictionary->pSuffixArray = NULL;
+   pDictionary->pPLCP = NULL;
+
+   if (!nDictionaryDataSize)
+      return pDictionary;
+
+   pDictionary->pSuffixArray = (int *)malloc(nDictionaryDataSize * sizeof(int));
+   pDictionary->pPLCP = (int *)malloc(nDictionaryDataSize * sizeof(int));
+   if (!pDictionary->pSuffixArray || !pDictionary->pPLCP ||
+       lz4ultra_build_dictionary_suffix_array(pDictionary->pData, nDictionaryDataSize, pDictionary->pSuffixArray, pDictionary->pPLCP)) {
+      lz4ultra_dictionary_destroy(pDictionary);
+      return NULL;
+   }
+
+   return pDictionary;
+}
+
+/**
+ * Group the positions of the training samples by the TRAIN_DMER_SIZE bytes that follow them, and count the samples that each group appears in
+ *
+ * @param pSuffixArray sorted suffixes of the concatenated samples, overwritten with the number of samples of each group
+ * @param PLCP permuted LCP of the concatenated samples
+ * @param pSampleStart offset of each sample in the concatenated samples, followed by the size of the concatenated samples
+ * @param pLastGroup buffer of one entry per sample, for the last group that each sample was seen in
+ * @param nInputSize size of the concatenated samples, in bytes
+ * @param nNumSamples number of samples
+ * @param pGroup pointer to returned group of each position, or -1 if it is within TRAIN_DMER_SIZE bytes of the end of its sample
+ */
+static void lz4ultra_dictionary_group_dmers(int *pSuffixArray, const int *PLCP, const int *pSampleStart, int *pLastGroup, const int nInputSize, const int nNumSamples,
+                                            int *pGroup) {
+   int *pGroupSamples = pSuffixArray;
+   int nNumGroups = 0;
+   int nMinLcp = 0;
+   int i;
+
+   for (i = 0; i < nNumSamples; i++)
+      pLastGroup[i] = -1;
+
+   /* Suffixes that start with the same bytes are next to each other in the suffix array. The groups are numbered in suffix order, so that the
+    * number of samples of each group is written over suffixes that were already read */
+   for (i = 0; i < nInputSize; i++) {
+      const int nPos = pSuffixArray[i];
+      int nLow = 0, nHigh = nNumSamples - 1;
+      int nLcp;
+
+      while (nLow < nHigh) {
+         const int nMid = (nLow + nHigh + 1) >> 1;
+
+         if (pSampleStart[nMid] <= nPos)
+            nLow = nMid;
+         else
+            nHigh = nMid - 1;
+      }
+
+      /* The samples are concatenated, but substrings don't carry over from one sample to the next: the suffixes within TRAIN_DMER_SIZE bytes of
+       * the end of their sample are left out, and the LCP with the previous suffix that isn't is the lowest LCP since then */
+      nLcp = (PLCP[nPos] < nMinLcp) ? PLCP[nPos] : nMinLcp;
+      if ((pSampleStart[nLow + 1] - nPos) < TRAIN_DMER_SIZE) {
+         pGroup[nPos] = -1;
+         nMinLcp = nLcp;
+         continue;
+      }
+      nMinLcp = 0x7fffffff;
+
+      if (!i || nLcp < TRAIN_DMER_SIZE) {
+         pGroupSamples[nNumGroups++] = 0;
+      }
+      pGroup[nPos] = nNumGroups - 1;
+
+      if (pLastGroup[nLow] != (nNumGroups - 1)) {
+         pLastGroup[nLow] = nNumGroups - 1;
+         pGroupSamples[nNumGroups - 1]++;
+      }
+   }
+}
+
+/**
+ * Fill a dictionary from its end with segments of the training samples. The samples are split in as many epochs as there are segments in the
+ * dictionary; in each epoch, the selected segment is the one whose distinct groups appear in the most samples in total, and the groups of the
+ * selected segments then don't count anymore
+ *
+ * @param pInput concatenated samples
+ * @param nInputSize size of the concatenated samples, in bytes
+ * @param pGroup group of each position, or -1
+ * @param pGroupSamples number of samples of each group, set to 0 for the groups of the selected segments
+ * @param pActive buffer of one entry per group, for the number of times that each group appears in the current segment, set to 0 on entry
+ * @param pOutData pointer to returned dictionary contents
+ * @param nMaxDictionarySize maximum size of the dictionary contents, in bytes
+ *
+ * @return size of the dictionary contents, that end at nMaxDictionarySize in pOutData
+ */
+static int lz4ultra_dictionary_select_segments(const unsigned char *pInput, const int nInputSize, const int *pGroup, int *pGroupSamples, int *pActive,
+                                               unsigned char *pOutData, const int nMaxDictionarySize) {
+   int nNumEpochs = nMaxDictionarySize / TRAIN_SEGMENT_SIZE;
+   int nDictionaryStart = nMaxDictionarySize;
+   int nEpochSize;
+   int bProgress = 1;
+
+   if (nNumEpochs > (nInputSize / TRAIN_SEGMENT_SIZE))
+      nNumEpochs = nInputSize / TRAIN_SEGMENT_SIZE;
+   if (nNumEpochs < 1)
+      nNumEpochs = 1;
+   nEpochSize = nInputSize / nNumEpochs;
+
+   /* Go through the epochs again while the dictionary isn't full, as the segments of small epochs can be shorter than TRAIN_SEGMENT_SIZE */
+   while (nDictionaryStart > 0 && bProgress) {
+      int nEpoch;
+
+      bProgress = 0;
+      for (nEpoch = 0; nEpoch < nNumEpochs && nDictionaryStart > 0; nEpoch++) {
+         const int nEpochStart = nEpoch * nEpochSize;
+         const int nEpochEnd = (nEpoch == (nNumEpochs - 1)) ? nInputSize : (nEpochStart + nEpochSize);
+         long long nScore = 0LL, nBestScore = 0LL;
+         int nBestStart = -1, nBestEnd = -1;
+         int nSegmentStart, nSegmentEnd, nLength;
+         int i;
+
+         /* Slide a window of TRAIN_SEGMENT_SIZE positions over the epoch */
+         for (i = nEpochStart; i < nEpochEnd; i++) {
+            if (pGroup[i] >= 0 && (pActive[pGroup[i]]++) == 0)
+               nScore += pGroupSamples[pGroup[i]];
+
+            if ((i - nEpochStart) >= TRAIN_SEGMENT_SIZE) {
+               const int nOldPos = i - TRAIN_SEGMENT_SIZE;
+
+               if (pGroup[nOldPos] >= 0 && (--pActive[pGroup[nOldPos]]) == 0)
+                  nScore -= pGroupSamples[pGroup[nOldPos]];
+            }
+
+            if (nBestScore < nScore) {
+               nBestScore = nScore;
+               nBestStart = ((i - nEpochStart) >= TRAIN_SEGMENT_SIZE) ? (i - TRAIN_SEGMENT_SIZE + 1) : nEpochStart;
+               nBestEnd = i + 1;
+            }
+         }
+
+         for (i = ((nEpochEnd - nEpochStart) > TRAIN_SEGMENT_SIZE) ? (nEpochEnd - TRAIN_SEGMENT_SIZE) : nEpochStart; i < nEpochEnd; i++) {
+            if (pGroup[i] >= 0)
+               pActive[pGroup[i]]--;
+         }
+
+         if (nBestStart < 0)
+            continue;
+
+         /* Trim the positions whose groups don't count, and take the bytes of the last group along */
+         nSegmentStart = nBestStart;
+         nSegmentEnd = nBestEnd;
+         while (nSegmentStart < nSegmentEnd && (pGroup[nSegmentStart] < 0 || !pGroupSamples[pGroup[nSegmentStart]]))
+            nSegmentStart++;
+         while (nSegmentEnd > nSegmentStart && (pGroup[nSegmentEnd - 1] < 0 || !pGroupSamples[pGroup[nSegmentEnd - 1]]))
+            nSegmentEnd--;
+         for (i = nSegmentStart; i < nSegmentEnd; i++) {
+            if (pGroup[i] >= 0)
+               pGroupSamples[pGroup[i]] = 0;
+         }
+         nSegmentEnd += TRAIN_DMER_SIZE - 1;
+
+         nLength = nSegmentEnd - nSegmentStart;
+         if (nLength > nDictionaryStart)
+            nLength = nDictionaryStart;
+         nDictionaryStart -= nLength;
+         memcpy(pOutData + nDictionaryStart, pInput + nSegmentStart, nLength);
+         bProgress = 1;
+      }
+   }
+
+   return nMaxDictionarySize - nDictionaryStart;
+}
+
+/**
+ * Build a dictionary from samples of the data that it will be used to compress. The sorted suffixes of all the samples give the number of samples
+ * that each substring of TRAIN_DMER_SIZE bytes appears in; the segments of the samples with the most frequent substrings, that aren't in the
+ * dictionary yet, are then added until it is full, the first ones last so that they stay in reach for longest
+ *
+ * @param ppSamples pointers to the contents of each sample
+ * @param pSampleSizes size of each sample, in bytes
+ * @param nNumSamples number of samples
+ * @param pDictionaryData pointer to returned dictionary contents
+ * @param nMaxDictionarySize size of the buffer for the dictionary contents, in bytes (only up to HISTORY_SIZE is used)
+ *
+ * @return size of the dictionary contents, or -1 for failure
+ */
+int lz4ultra_dictionary_train(const unsigned char * const *ppSamples, const size_t *pSampleSizes, const int nNumSamples, void *pDictionaryData, int nMaxDictionarySize) {
+   unsigned char *pOutData = (unsigned char *)pDictionaryData;
+   unsigned char *pInput;
+   int *pSampleStart;
+   int *pSuffixArray;
+   int *PLCP;
+   int *pGroup;
+   int *pLastGroup;
+   int nInputSize = 0;
+   int nResult = -1;
+   int i;
+
+   if (nMaxDictionarySize > HISTORY_SIZE)
+      nMaxDictionarySize = HISTORY_SIZE;
+   if (nNumSamples < 0 || nMaxDictionarySize < 0 || (nNumSamples && (!ppSamples || !pSampleSizes)) || (nMaxDictionarySize && !pDictionaryData))
+      return -1;
+
+   for (i = 0; i < nNumSamples; i++) {
+      if (pSampleSizes[i] > (size_t)(0x7fffffff - nInputSize))
+         return -1;
+      nInputSize += (int)pSampleSizes[i];
+   }
+
+   if (!nNumSamples || nInputSize < TRAIN_DMER_SIZE || !nMaxDictionarySize)
+      return 0;
+
+   pSampleStart = (int *)malloc((nNumSamples + 1) * sizeof(int));
+   pInput = (unsigned char *)malloc(nInputSize);
+   pSuffixArray = (int *)malloc(nInputSize * sizeof(int));
+   PLCP = (int *)malloc(nInputSize * sizeof(int));
+   pGroup = (int *)malloc(nInputSize * sizeof(int));
+   pLastGroup = (int *)malloc(nNumSamples * sizeof(int));
+
+   if (pSampleStart && pInput && pSuffixArray && PLCP && pGroup && pLastGroup) {
+      /* Concatenate all samples */
+      nInputSize = 0;
+      for (i = 0; i < nNumSamples; i++) {
+         pSampleStart[i] = nInputSize;
+         if (pSampleSizes[i])
+            memcpy(pInput + nInputSize, ppSamples[i], pSampleSizes[i]);
+         nInputSize += (int)pSampleSizes[i];
+      }
+      pSampleStart[nNumSamples] = nInputSize;
+
+      if (!lz4ultra_build_dictionary_suffix_array(pInput, nInputSize, pSuffixArray, PLCP)) {
+         int *pGroupSamples = pSuffixArray;
+         int *pActive = PLCP;
+
+         lz4ultra_dictionary_group_dmers(pSuffixArray, PLCP, pSampleStart, pLastGroup, nInputSize, nNumSamples, pGroup);
+
+         /* The permuted LCP isn't needed anymore, count the groups of the current segment in its place */
+         memset(pActive, 0, nInputSize * sizeof(int));
+         nResult = lz4ultra_dictionary_select_segments(pInput, nInputSize, pGroup, pGroupSamples, pActive, pOutData, nMaxDictionarySize);
+         if (nResult < nMaxDictionarySize)
+            memmove(pOutData, pOutData + nMaxDictionarySize - nResult, nResult);
+      }
+   }
+
+   if (pLastGroup)
+      free(pLastGroup);
+   if (pGroup)
+      free(pGroup);
+   if (PLCP)
+      free(PLCP);
+   if (pSuffixArray)
+      free(pSuffixArray);
+   if (pInput)
+      free(pInput);
+   if (pSampleStart)
+      free(pSampleStart);
+   return nResult;
+}
+
+/**
+ * Free up prepared dictionary
+ *
+ * @param pDictionary prepared dictionary, or NULL for none
+ */
+void lz4ultra_dictionary_destroy(lz4ultra_dictionary *pDictionary) {
+   if (!pDictionary)
+      return;
+
+   if (pDictionary->pPLCP) {
+      free(pDictionary->pPLCP);
+      pDictionary->pPLCP = NULL;
+   }
+
+   if (pDictionary->pSuffixArray) {
+      free(pDictionary->pSuffixArray);
+      pDictionary->pSuffixArray = NULL;
+   }
+
+   free(pDictionary);
+}
@@ -1,146 +1,388 @@
-/*
- * expand_block.c - block decompressor implementation
- *
- * Copyright (C) 2019 Emmanuel Marty
- *
- * This software is provided 'as-is', without any express or implied
- * warranty.  In no event will the authors be held liable for any damages
- * arising from the use of this software.
- *
- * Permission is granted to anyone to use this software for any purpose,
- * including commercial applications, and to alter it and redistribute it
- * freely, subject to the following restrictions:
- *
- * 1. The origin of this software must not be misrepresented; you must not
- *    claim that you wrote the original software. If you use this software
- *    in a product, an acknowledgment in the product documentation would be
- *    appreciated but is not required.
- * 2. Altered source versions must be plainly marked as such, and must not be
- *    misrepresented as being the original software.
- * 3. This notice may not be removed or altered from any source distribution.
- */
-
-/*
- * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
- *
- * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
- * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
- * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
- * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
- *
- */
-
-/* This code is mostly here to verify the compressor's output. You should use the real, optimized lz4 decompressor to decompress your data. */
-
-#include <stdlib.h>
-#include <string.h>
-#include "format.h"
-#include "expand_block.h"
-
-#if defined(__GNUC__) || defined(__clang__)
-#define likely(x)       __builtin_expect(!!(x), 1)
-#define unlikely(x)     __builtin_expect(!!(x), 0)
-#else
-#define likely(x)       (x)
-#define unlikely(x)     (x)
-#endif
-
-#define LZ4ULTRA_DECOMPRESSOR_BUILD_LEN(__len) { \
-   unsigned int byte; \
-   do { \
-      if (unlikely(pInBlock >= pInBlockEnd)) return -1; \
-      byte = (unsigned int)*pInBlock++; \
-      __len += byte; \
-   } while (unlikely(byte == 255)); \
-}
-
-/**
- * Decompress one data block
- *
- * @param pInBlock pointer to compressed data
- * @param nBlockSize size of compressed data, in bytes
- * @param pOutData pointer to output decompression buffer (previously decompressed bytes + room for decompressing this block)
- * @param nOutDataOffset starting index of where to store decompressed bytes in output buffer (and size of previously decompressed bytes)
- * @param nBlockMaxSize total size of output decompression buffer, in bytes
- *
- * @return size of decompressed data in bytes, or -1 for error
- */
-int lz4ultra_decompressor_expand_block(const unsigned char *pInBlock, int nBlockSize, unsigned char *pOutData, int nOutDataOffset, int nBlockMaxSize) {
-   const unsigned char *pInBlockEnd = pInBlock + nBlockSize;
-   unsigned char *pCurOutData = pOutData + nOutDataOffset;
-   const unsigned char *pOutDataEnd = pCurOutData + nBlockMaxSize;
-   const unsigned char *pOutDataFastEnd = pOutDataEnd - 18;
-
-   while (likely(pInBlock < pInBlockEnd)) {
-      const unsigned int token = (unsigned int)*pInBlock++;
-      unsigned int nLiterals = ((token & 0xf0) >> 4);
-
-      if (nLiterals != LITERALS_RUN_LEN && pCurOutData <= pOutDataFastEnd && (pInBlock + 16) <= pInBlockEnd) {
-         memcpy(pCurOutData, pInBlock, 16);
-      }
-      else {
-         if (likely(nLiterals == LITERALS_RUN_LEN))
-            LZ4ULTRA_DECOMPRESSOR_BUILD_LEN(nLiterals);
-
-         if (unlikely((pInBlock + nLiterals) > pInBlockEnd)) return -1;
-         if (unlikely((pCurOutData + nLiterals) > pOutDataEnd)) return -1;
-
-         memcpy(pCurOutData, pInBlock, nLiterals);
-      }
-
-      pInBlock += nLiterals;
-      pCurOutData += nLiterals;
-
-      if (likely((pInBlock + 2) <= pInBlockEnd)) {
-         unsigned int nMatchOffset;
-
-         nMatchOffset = (unsigned int)*pInBlock++;
-         nMatchOffset |= ((unsigned int)*pInBlock++) << 8;
-
-         unsigned int nMatchLen = (token & 0x0f);
-
-         nMatchLen += MIN_MATCH_SIZE;
-         if (nMatchLen != (MATCH_RUN_LEN + MIN_MATCH_SIZE) && nMatchOffset >= 8 && pCurOutData <= pOutDataFastEnd) {
-            const unsigned char *pSrc = pCurOutData - nMatchOffset;
-
-            if (unlikely(pSrc < pOutData)) return -1;
-
-            memcpy(pCurOutData, pSrc, 8);
-            memcpy(pCurOutData + 8, pSrc + 8, 8);
-            memcpy(pCurOutData + 16, pSrc + 16, 2);
-
-            pCurOutData += nMatchLen;
-         }
-         else {
-            if (likely(nMatchLen == (MATCH_RUN_LEN + MIN_MATCH_SIZE)))
-               LZ4ULTRA_DECOMPRESSOR_BUILD_LEN(nMatchLen);
-
-            if (unlikely((pCurOutData + nMatchLen) > pOutDataEnd)) return -1;
-
-            const unsigned char *pSrc = pCurOutData - nMatchOffset;
-            if (unlikely(pSrc < pOutData)) return -1;
-
-            if (nMatchOffset >= 16 && (pCurOutData + nMatchLen) <= pOutDataFastEnd) {
-               const unsigned char *pCopySrc = pSrc;
-               unsigned char *pCopyDst = pCurOutData;
-               const unsigned char *pCopyEndDst = pCurOutData + nMatchLen;
-
-               do {
-                  memcpy(pCopyDst, pCopySrc, 16);
-                  pCopySrc += 16;
-                  pCopyDst += 16;
-               } while (pCopyDst < pCopyEndDst);
-
-               pCurOutData += nMatchLen;
-            }
-            else {
-               while (nMatchLen--) {
-                  *pCurOutData++ = *pSrc++;
-               }
-            }
-         }
-      }
-   }
-
-   return (int)(pCurOutData - (pOutData + nOutDataOffset));
-}
+/*
+ * expand_block.c - block decompressor implementation
+ *
+ * Copyright (C) 2019 Emmanuel Marty
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*
+ * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
+ *
+ * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
+ * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
+ * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
+ * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
+ *
+ */
+
+/* This code is mostly here to verify the compressor's output. You should use the real, optimized lz4 decompressor to decompress your data. */
+
+#include <stdlib.h>
+#include <string.h>
+#include "format.h"
+#include "expand_block.h"
+
+#if defined(__GNUC__) || defined(__clang__)
+#define likely(x)       __builtin_expect(!!(x), 1)
+#define unlikely(x)     __builtin_expect(!!(x), 0)
+#else
+#define likely(x)       (x)
+#define unlikely(x)     (x)
+#endif
+
+/* Copy short-offset matches 16 bytes at a time with SSSE3: always when the build targets it, and otherwise on x86 with GCC or clang, by compiling
+ * the copy for SSSE3 only and checking that the CPU supports it at runtime */
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#define LZ4ULTRA_EXPAND_SSSE3
+#define LZ4ULTRA_SSSE3_FUNC      static inline
+#define lz4ultra_has_ssse3()     1
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <tmmintrin.h>
+#define LZ4ULTRA_EXPAND_SSSE3
+#define LZ4ULTRA_SSSE3_FUNC      static __attribute__((target("ssse3")))
+#define lz4ultra_has_ssse3()     __builtin_cpu_supports("ssse3")
+#endif
+
+/** Source adjustments that let matches with offsets below 8 be copied 8 bytes at a time after their first 8 bytes */
+static const unsigned char lz4ultra_overlap_inc[8] = { 0, 1, 2, 1, 0, 4, 4, 4 };
+static const signed char lz4ultra_overlap_dec[8] = { 0, 0, 0, -1, -4, 1, 2, 3 };
+
+#ifdef LZ4ULTRA_EXPAND_SSSE3
+/** Pattern copy advance for each match offset below 16: the largest multiple of the offset that fits in 16 bytes */
+static const unsigned char lz4ultra_pattern_step[16] = {
+   0, 16, 16, 15, 16, 15, 12, 14, 16, 9, 10, 11, 12, 13, 14, 15
+};
+
+/** Shuffle masks that repeat the last <offset> bytes of 16 previously decompressed bytes over 16 bytes */
+static const unsigned char lz4ultra_pattern_shuffle[16][16] = {
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },
+   { 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15 },
+   { 14, 15, 14, 15, 14, 15, 14, 15, 14, 15, 14, 15, 14, 15, 14, 15 },
+   { 13, 14, 15, 13, 14, 15, 13, 14, 15, 13, 14, 15, 13, 14, 15, 13 },
+   { 12, 13, 14, 15, 12, 13, 14, 15, 12, 13, 14, 15, 12, 13, 14, 15 },
+   { 11, 12, 13, 14, 15, 11, 12, 13, 14, 15, 11, 12, 13, 14, 15, 11 },
+   { 10, 11, 12, 13, 14, 15, 10, 11, 12, 13, 14, 15, 10, 11, 12, 13 },
+   {  9, 10, 11, 12, 13, 14, 15,  9, 10, 11, 12, 13, 14, 15,  9, 10 },
+   {  8,  9, 10, 11, 12, 13, 14, 15,  8,  9, 10, 11, 12, 13, 14, 15 },
+   {  7,  8,  9, 10, 11, 12, 13, 14, 15,  7,  8,  9, 10, 11, 12, 13 },
+   {  6,  7,  8,  9, 10, 11, 12, 13, 14, 15,  6,  7,  8,  9, 10, 11 },
+   {  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15,  5,  6,  7,  8,  9 },
+   {  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15,  4,  5,  6,  7 },
+   {  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15,  3,  4,  5 },
+   {  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15,  2,  3 },
+   {  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15,  1 },
+};
+#endif
+
+#ifdef LZ4ULTRA_EXPAND_SSSE3
+/**
+ * Copy a match that overlaps its own output, by replicating its repeating pattern 16 bytes at a time. The pattern is shuffled out of the 16
+ * bytes written just before the match, so at least 16 bytes must have been decompressed already
+ *
+ * @param pCurOutData pointer to where the match is copied to
+ * @param nMatchOffset match offset, 1..15
+ * @param nMatchLen match length in bytes; up to 15 bytes past the end of the match are also written to
+ */
+LZ4ULTRA_SSSE3_FUNC void lz4ultra_copy_pattern16(unsigned char *pCurOutData, const unsigned int nMatchOffset, const unsigned int nMatchLen) {
+   const unsigned char *pCopyEndDst = pCurOutData + nMatchLen;
+   const unsigned int nStep = lz4ultra_pattern_step[nMatchOffset];
+   const __m128i pattern = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(pCurOutData - 16)),
+      _mm_loadu_si128((const __m128i *)lz4ultra_pattern_shuffle[nMatchOffset]));
+
+   do {
+      _mm_storeu_si128((__m128i *)pCurOutData, pattern);
+      pCurOutData += nStep;
+   } while (pCurOutData < pCopyEndDst);
+}
+#endif
+
+/**
+ * Copy a match that overlaps its own output, by replicating its repeating pattern 8 bytes at a time
+ *
+ * @param pCurOutData pointer to where the match is copied to
+ * @param nMatchOffset match offset, 1..15
+ * @param nMatchLen match length in bytes; up to 7 bytes past the end of the match are also written to
+ */
+static inline void lz4ultra_copy_pattern(unsigned char *pCurOutData, const unsigned int nMatchOffset, const unsigned int nMatchLen) {
+   const unsigned char *pCopyEndDst = pCurOutData + nMatchLen;
+   const unsigned char *pSrc = pCurOutData - nMatchOffset;
+
+   if (nMatchOffset < 8) {
+      /* Copy the first 8 bytes one pattern period at a time, then move the source back so that it trails by at least 8 bytes */
+      pCurOutData[0] = pSrc[0];
+      pCurOutData[1] = pSrc[1];
+      pCurOutData[2] = pSrc[2];
+      pCurOutData[3] = pSrc[3];
+      pSrc += lz4ultra_overlap_inc[nMatchOffset];
+      memcpy(pCurOutData + 4, pSrc, 4);
+      pSrc -= lz4ultra_overlap_dec[nMatchOffset];
+   }
+   else {
+      memcpy(pCurOutData, pSrc, 8);
+      pSrc += 8;
+   }
+   pCurOutData += 8;
+
+   while (pCurOutData < pCopyEndDst) {
+      memcpy(pCurOutData, pSrc, 8);
+      pSrc += 8;
+      pCurOutData += 8;
+   }
+}
+
+#define LZ4ULTRA_DECOMPRESSOR_BUILD_LEN(__len) { \
+   unsigned int byte; \
+   do { \
+      if (unlikely(pInBlock >= pInBlockEnd)) return -1; \
+      byte = (unsigned int)*pInBlock++; \
+      __len += byte; \
+   } while (unlikely(byte == 255)); \
+}
+
+/**
+ * Decompress one data block
+ *
+ * @param pInBlock pointer to compressed data
+ * @param nBlockSize size of compressed data, in bytes
+ * @param pOutData pointer to output decompression buffer (previously decompressed bytes + room for decompressing this block)
+ * @param nOutDataOffset starting index of where to store decompressed bytes in output buffer (and size of previously decompressed bytes)
+ * @param nBlockMaxSize room for decompressing this block in output buffer, after nOutDataOffset, in bytes
+ *
+ * @return size of decompressed data in bytes, or -1 for error
+ */
+int lz4ultra_decompressor_expand_block(const unsigned char *pInBlock, int nBlockSize, unsigned char *pOutData, int nOutDataOffset, int nBlockMaxSize) {
+   const unsigned char *pInBlockEnd = pInBlock + nBlockSize;
+   unsigned char *pCurOutData = pOutData + nOutDataOffset;
+   const unsigned char *pOutDataEnd = pCurOutData + nBlockMaxSize;
+   const unsigned char *pOutDataFastEnd = pOutDataEnd - 18;
+#ifdef LZ4ULTRA_EXPAND_SSSE3
+   const int nHasSSSE3 = lz4ultra_has_ssse3();
+#endif
+
+   while (likely(pInBlock < pInBlockEnd)) {
+      const unsigned int token = (unsigned int)*pInBlock++;
+      unsigned int nLiterals = ((token & 0xf0) >> 4);
+
+      if (nLiterals != LITERALS_RUN_LEN && pCurOutData <= pOutDataFastEnd && (pInBlock + 16) <= pInBlockEnd) {
+         memcpy(pCurOutData, pInBlock, 16);
+      }
+      else {
+         if (likely(nLiterals == LITERALS_RUN_LEN))
+            LZ4ULTRA_DECOMPRESSOR_BUILD_LEN(nLiterals);
+
+         if (unlikely((pInBlock + nLiterals) > pInBlockEnd)) return -1;
+         if (unlikely((pCurOutData + nLiterals) > pOutDataEnd)) return -1;
+
+         memcpy(pCurOutData, pInBlock, nLiterals);
+      }
+
+      pInBlock += nLiterals;
+      pCurOutData += nLiterals;
+
+      if (likely((pInBlock + 2) <= pInBlockEnd)) {
+         unsigned int nMatchOffset;
+
+         nMatchOffset = (unsigned int)*pInBlock++;
+         nMatchOffset |= ((unsigned int)*pInBlock++) << 8;
+
+         unsigned int nMatchLen = (token & 0x0f);
+
+         nMatchLen += MIN_MATCH_SIZE;
+         if (nMatchLen != (MATCH_RUN_LEN + MIN_MATCH_SIZE) && nMatchOffset >= 8 && pCurOutData <= pOutDataFastEnd) {
+            const unsigned char *pSrc = pCurOutData - nMatchOffset;
+
+            if (unlikely(pSrc < pOutData)) return -1;
+
+            memcpy(pCurOutData, pSrc, 8);
+            memcpy(pCurOutData + 8, pSrc + 8, 8);
+            memcpy(pCurOutData + 16, pSrc + 16, 2);
+
+            pCurOutData += nMatchLen;
+         }
+         else {
+            if (likely(nMatchLen == (MATCH_RUN_LEN + MIN_MATCH_SIZE)))
+               LZ4ULTRA_DECOMPRESSOR_BUILD_LEN(nMatchLen);
+
+            if (unlikely((pCurOutData + nMatchLen) > pOutDataEnd)) return -1;
+
+            const unsigned char *pSrc = pCurOutData - nMatchOffset;
+            if (unlikely(pSrc < pOutData || pSrc == pCurOutData)) return -1;
+
+            if ((pCurOutData + nMatchLen) <= pOutDataFastEnd) {
+               if (nMatchOffset >= 16) {
+                  const unsigned char *pCopySrc = pSrc;
+                  unsigned char *pCopyDst = pCurOutData;
+                  const unsigned char *pCopyEndDst = pCurOutData + nMatchLen;
+
+                  do {
+                     memcpy(pCopyDst, pCopySrc, 16);
+                     pCopySrc += 16;
+                     pCopyDst += 16;
+                  } while (pCopyDst < pCopyEndDst);
+               }
+               else {
+#ifdef LZ4ULTRA_EXPAND_SSSE3
+                  if (nHasSSSE3 && likely((pCurOutData - pOutData) >= 16))
+                     lz4ultra_copy_pattern16(pCurOutData, nMatchOffset, nMatchLen);
+                  else
+#endif
+                     lz4ultra_copy_pattern(pCurOutData, nMatchOffset, nMatchLen);
+               }
+
+               pCurOutData += nMatchLen;
+            }
+            else {
+               /* Safe tail: too close to the end of the output buffer for wild copies */
+               while (nMatchLen--) {
+                  *pCurOutData++ = *pSrc++;
+               }
+            }
+         }
+      }
+   }
+
+   return (int)(pCurOutData - (pOutData + nOutDataOffset));
+}
+
+/**
+ * Read a little-endian 32-bit value from a raw block table
+ *
+ * @param pData pointer to value
+ *
+ * @return value
+ */
+static inline unsigned int lz4ultra_raw_table_read_u32(const unsigned char *pData) {
+   return ((unsigned int)pData[0]) | (((unsigned int)pData[1]) << 8) | (((unsigned int)pData[2]) << 16) | (((unsigned int)pData[3]) << 24);
+}
+
+/**
+ * Get the number of blocks in a raw block table, and its decompressed size
+ *
+ * @param pInData pointer to raw block table (LZ4ULTRA_FLAG_RAW_TABLE)
+ * @param nInDataSize size of raw block table, in bytes
+ * @param pDecompressedSize pointer to returned decompressed size, in bytes
+ *
+ * @return number of blocks, or -1 if the table isn't valid
+ */
+int lz4ultra_decompressor_get_raw_table_info(const unsigned char *pInData, size_t nInDataSize, size_t *pDecompressedSize) {
+   unsigned int nNumBlocks, nBlockSize, nLastBlockSize;
+
+   if (nInDataSize < RAW_TABLE_HEADER_SIZE)
+      return -1;
+
+   nNumBlocks = lz4ultra_raw_table_read_u32(pInData);
+   nBlockSize = lz4ultra_raw_table_read_u32(pInData + 4);
+   nLastBlockSize = lz4ultra_raw_table_read_u32(pInData + 8);
+
+   if (nNumBlocks == 0) {
+      if (nLastBlockSize != 0)
+         return -1;
+      *pDecompressedSize = 0;
+      return 0;
+   }
+
+   if (nBlockSize == 0 || nBlockSize > RAW_TABLE_MAX_BLOCK_SIZE || nLastBlockSize == 0 || nLastBlockSize > nBlockSize)
+      return -1;
+   if (nNumBlocks > RAW_TABLE_MAX_OFFSET || nNumBlocks > (nInDataSize - RAW_TABLE_HEADER_SIZE) / RAW_TABLE_ENTRY_SIZE)
+      return -1;
+   if ((size_t)(nNumBlocks - 1) > (((size_t)-1) - nLastBlockSize) / nBlockSize)
+      return -1;
+
+   *pDecompressedSize = (size_t)(nNumBlocks - 1) * (size_t)nBlockSize + (size_t)nLastBlockSize;
+   return (int)nNumBlocks;
+}
+
+/**
+ * Decompress one block of a raw block table to its place in the output buffer. Blocks are independent and can be decompressed in any order.
+ *
+ * @param pInData pointer to raw block table (LZ4ULTRA_FLAG_RAW_TABLE)
+ * @param nInDataSize size of raw block table, in bytes
+ * @param nBlockIndex index of block to decompress
+ * @param pOutData pointer to output decompression buffer, for all the blocks
+ * @param nMaxOutDataSize size of output decompression buffer, in bytes
+ *
+ * @return size of decompressed block in bytes, or -1 for error
+ */
+int lz4ultra_decompressor_expand_raw_table_block(const unsigned char *pInData, size_t nInDataSize, int nBlockIndex, unsigned char *pOutData, size_t nMaxOutDataSize) {
+   size_t nDecompressedSize;
+   int nNumBlocks = lz4ultra_decompressor_get_raw_table_info(pInData, nInDataSize, &nDecompressedSize);
+   const unsigned char *pEntry;
+   const unsigned char *pBlockData;
+   size_t nTableSize, nBlockDataSize, nInStart, nInEnd, nOutOffset, nOutSize;
+   unsigned int nEntry;
+
+   if (nNumBlocks < 0 || nBlockIndex < 0 || nBlockIndex >= nNumBlocks)
+      return -1;
+
+   nTableSize = RAW_TABLE_HEADER_SIZE + (size_t)nNumBlocks * RAW_TABLE_ENTRY_SIZE;
+   pEntry = pInData + RAW_TABLE_HEADER_SIZE + (size_t)nBlockIndex * RAW_TABLE_ENTRY_SIZE;
+   pBlockData = pInData + nTableSize;
+   nBlockDataSize = nInDataSize - nTableSize;
+
+   nEntry = lz4ultra_raw_table_read_u32(pEntry);
+   nInStart = (nBlockIndex > 0) ? (size_t)(lz4ultra_raw_table_read_u32(pEntry - RAW_TABLE_ENTRY_SIZE) & RAW_TABLE_MAX_OFFSET) : 0;
+   nInEnd = (size_t)(nEntry & RAW_TABLE_MAX_OFFSET);
+   if (nInStart > nInEnd || nInEnd > nBlockDataSize)
+      return -1;
+
+   nOutOffset = (size_t)nBlockIndex * (size_t)lz4ultra_raw_table_read_u32(pInData + 4);
+   nOutSize = (nBlockIndex == (nNumBlocks - 1)) ? (size_t)lz4ultra_raw_table_read_u32(pInData + 8) : (size_t)lz4ultra_raw_table_read_u32(pInData + 4);
+   if (nOutOffset > nMaxOutDataSize || nOutSize > (nMaxOutDataSize - nOutOffset))
+      return -1;
+
+   if (nEntry & RAW_TABLE_STORED_BLOCK) {
+      /* Stored block */
+      if ((nInEnd - nInStart) != nOutSize)
+         return -1;
+      memcpy(pOutData + nOutOffset, pBlockData + nInStart, nOutSize);
+   }
+   else {
+      /* Raw LZ4 block, without an EOD marker */
+      if (lz4ultra_decompressor_expand_block(pBlockData + nInStart, (int)(nInEnd - nInStart), pOutData + nOutOffset, 0, (int)nOutSize) != (int)nOutSize)
+         return -1;
+   }
+
+   return (int)nOutSize;
+}
+
+/**
+ * Decompress all the blocks of a raw block table, one after the other
+ *
+ * @param pInData pointer to raw block table (LZ4ULTRA_FLAG_RAW_TABLE)
+ * @param nInDataSize size of raw block table, in bytes
+ * @param pOutData pointer to output decompression buffer
+ * @param nMaxOutDataSize size of output decompression buffer, in bytes
+ *
+ * @return size of decompressed data in bytes, or -1 for error
+ */
+size_t lz4ultra_decompressor_expand_raw_table(const unsigned char *pInData, size_t nInDataSize, unsigned char *pOutData, size_t nMaxOutDataSize) {
+   size_t nDecompressedSize;
+   int nNumBlocks = lz4ultra_decompressor_get_raw_table_info(pInData, nInDataSize, &nDecompressedSize);
+   int nBlockIndex;
+
+   if (nNumBlocks < 0 || nDecompressedSize > nMaxOutDataSize)
+      return -1;
+
+   for (nBlockIndex = 0; nBlockIndex < nNumBlocks; nBlockIndex++) {
+      if (lz4ultra_decompressor_expand_raw_table_block(pInData, nInDataSize, nBlockIndex, pOutData, nMaxOutDataSize) < 0)
+         return -1;
+   }
+
+   return nDecompressedSize;
+}
@@ -1,188 +1,578 @@
-/*
- * expand_inmem.c - in-memory decompression implementation
- *
- * Copyright (C) 2019 Emmanuel Marty
- *
- * This software is provided 'as-is', without any express or implied
- * warranty.  In no event will the authors be held liable for any damages
- * arising from the use of this software.
- *
- * Permission is granted to anyone to use this software for any purpose,
- * including commercial applications, and to alter it and redistribute it
- * freely, subject to the following restrictions:
- *
- * 1. The origin of this software must not be misrepresented; you must not
- *    claim that you wrote the original software. If you use this software
- *    in a product, an acknowledgment in the product documentation would be
- *    appreciated but is not required.
- * 2. Altered source versions must be plainly marked as such, and must not be
- *    misrepresented as being the original software.
- * 3. This notice may not be removed or altered from any source distribution.
- */
-
-/*
- * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
- *
- * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
- * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
- * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
- * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
- *
- */
-
-#include <stdlib.h>
-#include <string.h>
-#include "expand_inmem.h"
-#include "lib.h"
-#include "frame.h"
-
-/**
- * Get maximum decompressed size of compressed data
- *
- * @param pFileData compressed data
- * @param nFileSize compressed size in bytes
- *
- * @return maximum decompressed size
- */
-size_t lz4ultra_inmem_get_max_decompressed_size(const unsigned char *pFileData, size_t nFileSize) {
-   const unsigned char *pCurFileData = pFileData;
-   const unsigned char *pEndFileData = pCurFileData + nFileSize;
-   int nBlockMaxCode = 0;
-   unsigned int nFlags = 0;
-   int nBlockMaxBits, nBlockMaxSize;
-   size_t nMaxDecompressedSize = 0;
-
-   /* Check header */
-   if ((pCurFileData + LZ4ULTRA_HEADER_SIZE) > pEndFileData)
-      return -1;
-   
-   int nExtraHeaderSize = lz4ultra_check_header(pCurFileData, LZ4ULTRA_HEADER_SIZE);
-   if (nExtraHeaderSize < 0)
-      return -1;
-
-   if (((pCurFileData + LZ4ULTRA_HEADER_SIZE + nExtraHeaderSize) > pEndFileData) || 
-       lz4ultra_decode_header(pCurFileData, LZ4ULTRA_HEADER_SIZE + nExtraHeaderSize, &nBlockMaxCode, &nFlags) != LZ4ULTRA_DECODE_OK)
-      return -1;
-
-   if (nFlags & LZ4ULTRA_FLAG_LEGACY_FRAMES)
-      nBlockMaxBits = 23;
-   else
-      nBlockMaxBits = 8 + (nBlockMaxCode << 1);
-   nBlockMaxSize = 1 << nBlockMaxBits;
-
-   pCurFileData += (LZ4ULTRA_HEADER_SIZE + nExtraHeaderSize);
-
-   while (pCurFileData < pEndFileData) {
-      unsigned int nBlockDataSize = 0;
-      int nIsUncompressed = 0;
-
-      /* Decode frame header */
-      if ((pCurFileData + LZ4ULTRA_FRAME_SIZE) > pEndFileData ||
-          lz4ultra_decode_frame(pCurFileData, LZ4ULTRA_FRAME_SIZE, nFlags, &nBlockDataSize, &nIsUncompressed) != LZ4ULTRA_DECODE_OK)
-         return -1;
-      pCurFileData += LZ4ULTRA_FRAME_SIZE;
-
-      if (!nBlockDataSize)
-         break;
-
-      /* Add one potentially full block to the decompressed size */
-      nMaxDecompressedSize += nBlockMaxSize;
-
-      if ((pCurFileData + nBlockDataSize) > pEndFileData)
-         return -1;
-
-      pCurFileData += nBlockDataSize;
-   }
-
-   return nMaxDecompressedSize;
-}
-
-/**
- * Decompress data in memory
- *
- * @param pFileData compressed data
- * @param pOutBuffer buffer for decompressed data
- * @param nFileSize compressed size in bytes
- * @param nMaxOutBufferSize maximum capacity of decompression buffer
- * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
- *
- * @return actual decompressed size, or -1 for error
- */
-size_t lz4ultra_decompress_inmem(const unsigned char *pFileData, unsigned char *pOutBuffer, size_t nFileSize, size_t nMaxOutBufferSize, unsigned int nFlags) {
-   const unsigned char *pCurFileData = pFileData;
-   const unsigned char *pEndFileData = pCurFileData + nFileSize;
-   unsigned char *pCurOutBuffer = pOutBuffer;
-   const unsigned char *pEndOutBuffer = pCurOutBuffer + nMaxOutBufferSize;
-   int nBlockMaxCode = 0;
-   int nBlockMaxBits, nBlockMaxSize, nPreviousBlockSize;
-
-   if (nFlags & LZ4ULTRA_FLAG_RAW_BLOCK) {
-      return (size_t)lz4ultra_decompressor_expand_block(pFileData, (int)nFileSize - 2 /* EOD marker */, pOutBuffer, 0, (int)nMaxOutBufferSize);
-   }
-
-   /* Check header */
-   if ((pCurFileData + LZ4ULTRA_HEADER_SIZE) > pEndFileData)
-      return -1;
-
-   int nExtraHeaderSize = lz4ultra_check_header(pCurFileData, LZ4ULTRA_HEADER_SIZE);
-   if (nExtraHeaderSize < 0)
-      return -1;
-
-   if (((pCurFileData + LZ4ULTRA_HEADER_SIZE + nExtraHeaderSize) > pEndFileData) ||
-       lz4ultra_decode_header(pCurFileData, LZ4ULTRA_HEADER_SIZE + nExtraHeaderSize, &nBlockMaxCode, &nFlags) != LZ4ULTRA_DECODE_OK)
-      return -1;
-
-   if (nFlags & LZ4ULTRA_FLAG_LEGACY_FRAMES)
-      nBlockMaxBits = 23;
-   else
-      nBlockMaxBits = 8 + (nBlockMaxCode << 1);
-   nBlockMaxSize = 1 << nBlockMaxBits;
-
-   pCurFileData += (LZ4ULTRA_HEADER_SIZE + nExtraHeaderSize);
-   nPreviousBlockSize = 0;
-
-   while (pCurFileData < pEndFileData) {
-      unsigned int nBlockDataSize = 0;
-      int nIsUncompressed = 0;
-
-      /* Decode frame header */
-      if ((pCurFileData + LZ4ULTRA_FRAME_SIZE) > pEndFileData ||
-          lz4ultra_decode_frame(pCurFileData, LZ4ULTRA_FRAME_SIZE, nFlags, &nBlockDataSize, &nIsUncompressed) != LZ4ULTRA_DECODE_OK)
-         return -1;
-      pCurFileData += LZ4ULTRA_FRAME_SIZE;
-
-      if (!nBlockDataSize)
-         break;
-
-      if (!nIsUncompressed) {
-         int nDecompressedSize;
-
-         /* Decompress block */
-         if ((pCurFileData + nBlockDataSize) > pEndFileData)
-            return -1;
-
-         if ((nFlags & LZ4ULTRA_FLAG_INDEP_BLOCKS) || (nPreviousBlockSize == 0))
-            nDecompressedSize = lz4ultra_decompressor_expand_block(pCurFileData, nBlockDataSize, pCurOutBuffer, 0, (int)(pEndOutBuffer - pCurOutBuffer));
-         else
-            nDecompressedSize = lz4ultra_decompressor_expand_block(pCurFileData, nBlockDataSize, pCurOutBuffer - nPreviousBlockSize, nPreviousBlockSize, (int)(pEndOutBuffer - pCurOutBuffer + nPreviousBlockSize));
-         if (nDecompressedSize < 0)
-            return -1;
-
-         pCurOutBuffer += nDecompressedSize;
-         nPreviousBlockSize = nDecompressedSize;
-      }
-      else {
-         /* Copy uncompressed block */
-         if ((pCurFileData + nBlockDataSize) > pEndFileData)
-            return -1;
-         if ((pCurOutBuffer + nBlockDataSize) > pEndOutBuffer)
-            return -1;
-         memcpy(pCurOutBuffer, pCurFileData, nBlockDataSize);
-         pCurOutBuffer += nBlockDataSize;
-      }
-
-      pCurFileData += nBlockDataSize;
-   }
-
-   return (int)(pCurOutBuffer - pOutBuffer);
-}
+/*
+ * expand_inmem.c - in-memory decompression implementation
+ *
+ * Copyright (C) 2019 Emmanuel Marty
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*
+ * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
+ *
+ * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
+ * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
+ * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
+ * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "expand_inmem.h"
+#include "lib.h"
+#include "format.h"
+#include "frame.h"
+#include "threadpool.h"
+#define XXH_STATIC_LINKING_ONLY
+#include "xxhash.h"
+
+/**
+ * Get size of the header of compressed data
+ *
+ * @param pFileData compressed data
+ * @param nFileSize compressed size in bytes
+ *
+ * @return header size in bytes, or -1 for error
+ */
+static int lz4ultra_get_header_size_inmem(const unsigned char *pFileData, size_t nFileSize) {
+   int nHeaderSize = LZ4ULTRA_HEADER_SIZE;
+   int nExtraHeaderSize;
+
+   if (nFileSize < (size_t)nHeaderSize)
+      return -1;
+
+   while ((nExtraHeaderSize = lz4ultra_check_header(pFileData, nHeaderSize)) > 0) {
+      if ((nFileSize - (size_t)nHeaderSize) < (size_t)nExtraHeaderSize)
+         return -1;
+      nHeaderSize += nExtraHeaderSize;
+   }
+
+   return (nExtraHeaderSize < 0) ? -1 : nHeaderSize;
+}
+
+/**
+ * Get maximum decompressed size of compressed data
+ *
+ * @param pFileData compressed data
+ * @param nFileSize compressed size in bytes
+ *
+ * @return maximum decompressed size, which is the exact size when the headers store it
+ */
+size_t lz4ultra_inmem_get_max_decompressed_size(const unsigned char *pFileData, size_t nFileSize) {
+   const unsigned char *pCurFileData = pFileData;
+   const unsigned char *pEndFileData = pCurFileData + nFileSize;
+   size_t nMaxDecompressedSize = 0;
+
+   /* Add up the decompressed size of each frame */
+   while (pCurFileData < pEndFileData) {
+      int nBlockMaxCode = 0;
+      unsigned int nFlags = 0;
+      unsigned int nSkipSize = 0;
+      int nBlockMaxBits, nBlockMaxSize;
+      size_t nFrameMaxDecompressedSize = 0;
+      long long nContentSize = -1LL;
+
+      /* Check header */
+      int nHeaderSize = lz4ultra_get_header_size_inmem(pCurFileData, (size_t)(pEndFileData - pCurFileData));
+      if (nHeaderSize < 0)
+         return -1;
+
+      if (lz4ultra_decode_skippable_header(pCurFileData, nHeaderSize, &nSkipSize) == LZ4ULTRA_DECODE_OK) {
+         if ((size_t)(pEndFileData - pCurFileData - nHeaderSize) < (size_t)nSkipSize || lz4ultra_is_dedup_header(pCurFileData, nHeaderSize))
+            return -1;
+         pCurFileData += nHeaderSize + nSkipSize;
+         continue;
+      }
+
+      if (lz4ultra_decode_header(pCurFileData, nHeaderSize, &nBlockMaxCode, &nFlags, &nContentSize) != LZ4ULTRA_DECODE_OK)
+         return -1;
+
+      if (nFlags & LZ4ULTRA_FLAG_LEGACY_FRAMES)
+         nBlockMaxBits = 23;
+      else
+         nBlockMaxBits = 8 + (nBlockMaxCode << 1);
+      nBlockMaxSize = 1 << nBlockMaxBits;
+
+      pCurFileData += nHeaderSize;
+
+      /* Walk the blocks to find the end of the frame */
+      while (pCurFileData < pEndFileData) {
+         unsigned int nBlockDataSize = 0;
+         int nIsUncompressed = 0;
+
+         /* Decode frame header */
+         if ((pCurFileData + LZ4ULTRA_FRAME_SIZE) > pEndFileData ||
+             lz4ultra_decode_frame(pCurFileData, LZ4ULTRA_FRAME_SIZE, &nBlockDataSize, &nIsUncompressed) != LZ4ULTRA_DECODE_OK)
+            return -1;
+
+         /* Legacy frames have no end mark; a block size that is too large is the magic number of the next frame */
+         if ((nFlags & LZ4ULTRA_FLAG_LEGACY_FRAMES) && (int)nBlockDataSize > nBlockMaxSize)
+            break;
+
+         pCurFileData += LZ4ULTRA_FRAME_SIZE;
+
+         if (!nBlockDataSize) {
+            if ((size_t)(pEndFileData - pCurFileData) < (size_t)lz4ultra_get_content_checksum_size(nFlags))
+               return -1;
+            pCurFileData += lz4ultra_get_content_checksum_size(nFlags);
+            break;
+         }
+
+         /* Add one potentially full block to the decompressed size */
+         nFrameMaxDecompressedSize += nBlockMaxSize;
+
+         if ((pCurFileData + nBlockDataSize + lz4ultra_get_block_checksum_size(nFlags)) > pEndFileData)
+            return -1;
+
+         pCurFileData += nBlockDataSize + lz4ultra_get_block_checksum_size(nFlags);
+      }
+
+      /* When the header stores the decompressed size, it is the frame's exact size */
+      if (nContentSize >= 0) {
+         if ((unsigned long long)(size_t)nContentSize != (unsigned long long)nContentSize)
+            return -1;
+         nFrameMaxDecompressedSize = (size_t)nContentSize;
+      }
+
+      nMaxDecompressedSize += nFrameMaxDecompressedSize;
+   }
+
+   return nMaxDecompressedSize;
+}
+
+/** One independent block, decompressed by a thread pool job */
+typedef struct {
+   const unsigned char *pInBlock;
+   unsigned int nBlockSize;
+   int nIsUncompressed;
+   unsigned char *pOutData;
+   int nMaxOutDataSize;
+   int nDecompressedSize;
+} lz4ultra_expand_inmem_block;
+
+/** Blocks shared with the worker threads */
+typedef struct {
+   lz4ultra_expand_inmem_block *pBlocks;
+   int nBlockChecksumSize;
+} lz4ultra_expand_inmem_jobs;
+
+/**
+ * Decompress one independent block, as a thread pool job
+ *
+ * @param pUserData blocks to decompress (lz4ultra_expand_inmem_jobs)
+ * @param nThreadIndex index of the thread running the job
+ * @param nJobIndex index of the block to decompress
+ */
+static void lz4ultra_decompress_inmem_block_job(void *pUserData, const int nThreadIndex, const int nJobIndex) {
+   lz4ultra_expand_inmem_jobs *pJobs = (lz4ultra_expand_inmem_jobs *)pUserData;
+   lz4ultra_expand_inmem_block *pBlock = &pJobs->pBlocks[nJobIndex];
+
+   if (pJobs->nBlockChecksumSize) {
+      /* Check the block's data before decompressing it; the checksum follows the block's data */
+      if (lz4ultra_decode_checksum(pBlock->pInBlock + pBlock->nBlockSize, pJobs->nBlockChecksumSize, XXH32(pBlock->pInBlock, pBlock->nBlockSize, 0)) != LZ4ULTRA_DECODE_OK) {
+         pBlock->nDecompressedSize = -1;
+         return;
+      }
+   }
+
+   if (pBlock->nIsUncompressed) {
+      if ((int)pBlock->nBlockSize > pBlock->nMaxOutDataSize) {
+         pBlock->nDecompressedSize = -1;
+         return;
+      }
+      memcpy(pBlock->pOutData, pBlock->pInBlock, pBlock->nBlockSize);
+      pBlock->nDecompressedSize = (int)pBlock->nBlockSize;
+   }
+   else {
+      pBlock->nDecompressedSize = lz4ultra_decompressor_expand_block(pBlock->pInBlock, pBlock->nBlockSize, pBlock->pOutData, 0, pBlock->nMaxOutDataSize);
+   }
+}
+
+/**
+ * Decompress independent blocks in memory, in parallel. Each block is decompressed at a multiple of the maximum block size in the output
+ * buffer, which is where it belongs as long as the blocks before it are full; the gaps left by shorter blocks are closed afterwards.
+ *
+ * @param pCurFileData compressed blocks, after the header
+ * @param pEndFileData end of compressed data
+ * @param pOutBuffer buffer for decompressed data
+ * @param nMaxOutBufferSize maximum capacity of decompression buffer
+ * @param nFlags compression flags, as decoded from the header
+ * @param nBlockMaxSize maximum decompressed size of one block, in bytes
+ * @param nThreads number of threads to decompress blocks with
+ * @param pDecompressedSize pointer to returned decompressed size, updated when this function is successful
+ * @param ppEndFrameData pointer to returned end of the frame's compressed data, updated when this function is successful
+ *
+ * @return 0 for success, -1 for error, or 1 if the blocks are better decompressed one after the other
+ */
+static int lz4ultra_decompress_inmem_parallel(const unsigned char *pCurFileData, const unsigned char *pEndFileData, unsigned char *pOutBuffer, size_t nMaxOutBufferSize,
+                                              const unsigned int nFlags, const int nBlockMaxSize, int nThreads, size_t *pDecompressedSize, const unsigned char **ppEndFrameData) {
+   const int nBlockChecksumSize = lz4ultra_get_block_checksum_size(nFlags);
+   const int nContentChecksumSize = lz4ultra_get_content_checksum_size(nFlags);
+   const unsigned char *pContentChecksum = NULL;
+   const unsigned char *pFrameData;
+   lz4ultra_expand_inmem_block *pBlocks;
+   lz4ultra_expand_inmem_jobs jobs;
+   lz4ultra_threadpool *pPool;
+   unsigned char *pCurOutBuffer;
+   int nBlocks = 0;
+   int i;
+
+   /* Count blocks, leaving malformed data to be reported by the serial decompressor */
+   pFrameData = pCurFileData;
+   while (pFrameData < pEndFileData) {
+      unsigned int nBlockDataSize = 0;
+      int nIsUncompressed = 0;
+
+      if ((pFrameData + LZ4ULTRA_FRAME_SIZE) > pEndFileData ||
+          lz4ultra_decode_frame(pFrameData, LZ4ULTRA_FRAME_SIZE, &nBlockDataSize, &nIsUncompressed) != LZ4ULTRA_DECODE_OK)
+         return 1;
+      pFrameData += LZ4ULTRA_FRAME_SIZE;
+
+      if (!nBlockDataSize) {
+         if (nContentChecksumSize) {
+            if ((pFrameData + nContentChecksumSize) > pEndFileData)
+               return 1;
+            pContentChecksum = pFrameData;
+            pFrameData += nContentChecksumSize;
+         }
+         break;
+      }
+
+      if ((int)nBlockDataSize > nBlockMaxSize || (size_t)(pEndFileData - pFrameData) < (size_t)nBlockDataSize + (size_t)nBlockChecksumSize)
+         return 1;
+      pFrameData += nBlockDataSize + nBlockChecksumSize;
+      nBlocks++;
+   }
+
+   if (nBlocks < 2 || (size_t)(nBlocks - 1) * (size_t)nBlockMaxSize >= nMaxOutBufferSize)
+      return 1;
+
+   pBlocks = (lz4ultra_expand_inmem_block *)malloc(nBlocks * sizeof(lz4ultra_expand_inmem_block));
+   if (!pBlocks)
+      return 1;
+
+   /* Give each block its own output slot */
+   *ppEndFrameData = pFrameData;
+   pFrameData = pCurFileData;
+   for (i = 0; i < nBlocks; i++) {
+      lz4ultra_expand_inmem_block *pBlock = &pBlocks[i];
+      size_t nOutOffset = (size_t)i * (size_t)nBlockMaxSize;
+
+      lz4ultra_decode_frame(pFrameData, LZ4ULTRA_FRAME_SIZE, &pBlock->nBlockSize, &pBlock->nIsUncompressed);
+      pFrameData += LZ4ULTRA_FRAME_SIZE;
+
+      pBlock->pInBlock = pFrameData;
+      pBlock->pOutData = pOutBuffer + nOutOffset;
+      pBlock->nMaxOutDataSize = ((nMaxOutBufferSize - nOutOffset) > (size_t)nBlockMaxSize) ? nBlockMaxSize : (int)(nMaxOutBufferSize - nOutOffset);
+      pBlock->nDecompressedSize = 0;
+      pFrameData += pBlock->nBlockSize + nBlockChecksumSize;
+   }
+
+   if (nThreads > nBlocks)
+      nThreads = nBlocks;
+   pPool = lz4ultra_threadpool_create(nThreads);
+   if (!pPool) {
+      free(pBlocks);
+      return 1;
+   }
+
+   /* Decompress all blocks at once */
+   jobs.pBlocks = pBlocks;
+   jobs.nBlockChecksumSize = nBlockChecksumSize;
+   lz4ultra_threadpool_run(pPool, lz4ultra_decompress_inmem_block_job, &jobs, nBlocks);
+   lz4ultra_threadpool_destroy(pPool);
+
+   /* Check blocks and close the gaps after blocks that are shorter than the maximum block size */
+   pCurOutBuffer = pOutBuffer;
+   for (i = 0; i < nBlocks; i++) {
+      lz4ultra_expand_inmem_block *pBlock = &pBlocks[i];
+
+      if (pBlock->nDecompressedSize < 0) {
+         free(pBlocks);
+         return -1;
+      }
+
+      if (pCurOutBuffer != pBlock->pOutData)
+         memmove(pCurOutBuffer, pBlock->pOutData, pBlock->nDecompressedSize);
+      pCurOutBuffer += pBlock->nDecompressedSize;
+   }
+
+   free(pBlocks);
+
+   if (pContentChecksum) {
+      if (lz4ultra_decode_checksum(pContentChecksum, nContentChecksumSize, XXH32(pOutBuffer, pCurOutBuffer - pOutBuffer, 0)) != LZ4ULTRA_DECODE_OK)
+         return -1;
+   }
+
+   *pDecompressedSize = (size_t)(pCurOutBuffer - pOutBuffer);
+   return 0;
+}
+
+/**
+ * Decompress the blocks of one frame in memory, after its header
+ *
+ * @param ppCurFileData pointer to the compressed blocks, after the header, updated to the end of the frame when this function is successful
+ * @param pEndFileData end of compressed data
+ * @param pOutBuffer buffer for decompressed data
+ * @param nMaxOutBufferSize maximum capacity of decompression buffer
+ * @param nFlags compression flags, as decoded from the header
+ * @param nBlockMaxSize maximum decompressed size of one block, in bytes
+ * @param nContentSize decompressed size stored in the header, or -1 if unknown
+ * @param nThreads number of threads to decompress independent blocks with (1 for single-threaded decompression)
+ *
+ * @return actual decompressed size, or -1 for error
+ */
+static size_t lz4ultra_decompress_inmem_frame(const unsigned char **ppCurFileData, const unsigned char *pEndFileData, unsigned char *pOutBuffer, size_t nMaxOutBufferSize,
+                                              const unsigned int nFlags, const int nBlockMaxSize, const long long nContentSize, int nThreads) {
+   const unsigned char *pCurFileData = *ppCurFileData;
+   unsigned char *pCurOutBuffer = pOutBuffer;
+   const unsigned char *pEndOutBuffer = pCurOutBuffer + nMaxOutBufferSize;
+   const int nBlockChecksumSize = lz4ultra_get_block_checksum_size(nFlags);
+   const int nContentChecksumSize = lz4ultra_get_content_checksum_size(nFlags);
+   XXH32_state_t contentChecksum;
+
+   XXH32_reset(&contentChecksum, 0);
+
+   if (nThreads > 1 && (nFlags & LZ4ULTRA_FLAG_INDEP_BLOCKS)) {
+      size_t nDecompressedSize = 0;
+      int nResult = lz4ultra_decompress_inmem_parallel(pCurFileData, pEndFileData, pOutBuffer, nMaxOutBufferSize, nFlags, nBlockMaxSize, nThreads, &nDecompressedSize, &pCurFileData);
+
+      if (nResult < 0)
+         return -1;
+      if (nResult == 0) {
+         if (nContentSize >= 0 && (long long)nDecompressedSize != nContentSize)
+            return -1;
+         *ppCurFileData = pCurFileData;
+         return nDecompressedSize;
+      }
+   }
+
+   while (pCurFileData < pEndFileData) {
+      unsigned int nBlockDataSize = 0;
+      int nIsUncompressed = 0;
+
+      /* Decode frame header */
+      if ((pCurFileData + LZ4ULTRA_FRAME_SIZE) > pEndFileData ||
+          lz4ultra_decode_frame(pCurFileData, LZ4ULTRA_FRAME_SIZE, &nBlockDataSize, &nIsUncompressed) != LZ4ULTRA_DECODE_OK)
+         return -1;
+
+      /* Legacy frames have no end mark; a block size that is too large is the magic number of the next frame */
+      if ((nFlags & LZ4ULTRA_FLAG_LEGACY_FRAMES) && (int)nBlockDataSize > nBlockMaxSize)
+         break;
+
+      pCurFileData += LZ4ULTRA_FRAME_SIZE;
+
+      if (!nBlockDataSize) {
+         if (nContentChecksumSize) {
+            if ((pCurFileData + nContentChecksumSize) > pEndFileData ||
+                lz4ultra_decode_checksum(pCurFileData, nContentChecksumSize, XXH32_digest(&contentChecksum)) != LZ4ULTRA_DECODE_OK)
+               return -1;
+            pCurFileData += nContentChecksumSize;
+         }
+         break;
+      }
+
+      if (nBlockChecksumSize) {
+         /* Check the block's data before decompressing it */
+         if ((pCurFileData + nBlockDataSize + nBlockChecksumSize) > pEndFileData ||
+             lz4ultra_decode_checksum(pCurFileData + nBlockDataSize, nBlockChecksumSize, XXH32(pCurFileData, nBlockDataSize, 0)) != LZ4ULTRA_DECODE_OK)
+            return -1;
+      }
+
+      if (!nIsUncompressed) {
+         /* Dependent blocks may reference up to HISTORY_SIZE bytes back, across several small blocks */
+         const int nHistorySize = ((pCurOutBuffer - pOutBuffer) > HISTORY_SIZE) ? HISTORY_SIZE : (int)(pCurOutBuffer - pOutBuffer);
+         int nDecompressedSize;
+
+         /* Decompress block */
+         if ((pCurFileData + nBlockDataSize) > pEndFileData)
+            return -1;
+
+         if ((nFlags & LZ4ULTRA_FLAG_INDEP_BLOCKS) || (nHistorySize == 0))
+            nDecompressedSize = lz4ultra_decompressor_expand_block(pCurFileData, nBlockDataSize, pCurOutBuffer, 0, (int)(pEndOutBuffer - pCurOutBuffer));
+         else
+            nDecompressedSize = lz4ultra_decompressor_expand_block(pCurFileData, nBlockDataSize, pCurOutBuffer - nHistorySize, nHistorySize, (int)(pEndOutBuffer - pCurOutBuffer));
+         if (nDecompressedSize < 0)
+            return -1;
+
+         if (nContentChecksumSize)
+            XXH32_update(&contentChecksum, pCurOutBuffer, nDecompressedSize);
+         pCurOutBuffer += nDecompressedSize;
+      }
+      else {
+         /* Copy uncompressed block */
+         if ((pCurFileData + nBlockDataSize) > pEndFileData)
+            return -1;
+         if ((pCurOutBuffer + nBlockDataSize) > pEndOutBuffer)
+            return -1;
+         memcpy(pCurOutBuffer, pCurFileData, nBlockDataSize);
+         if (nContentChecksumSize)
+            XXH32_update(&contentChecksum, pCurOutBuffer, nBlockDataSize);
+         pCurOutBuffer += nBlockDataSize;
+      }
+
+      pCurFileData += nBlockDataSize + nBlockChecksumSize;
+   }
+
+   if (nContentSize >= 0 && (long long)(pCurOutBuffer - pOutBuffer) != nContentSize)
+      return -1;
+
+   *ppCurFileData = pCurFileData;
+   return (size_t)(pCurOutBuffer - pOutBuffer);
+}
+
+/** Raw block table shared with the worker threads */
+typedef struct {
+   const unsigned char *pInData;
+   size_t nInDataSize;
+   unsigned char *pOutData;
+   size_t nMaxOutDataSize;
+   int *pDecompressedSizes;
+} lz4ultra_expand_raw_table_jobs;
+
+/**
+ * Decompress one block of a raw block table, as a thread pool job
+ *
+ * @param pUserData raw block table to decompress (lz4ultra_expand_raw_table_jobs)
+ * @param nThreadIndex index of the thread running the job
+ * @param nJobIndex index of the block to decompress
+ */
+static void lz4ultra_decompress_raw_table_block_job(void *pUserData, const int nThreadIndex, const int nJobIndex) {
+   lz4ultra_expand_raw_table_jobs *pJobs = (lz4ultra_expand_raw_table_jobs *)pUserData;
+
+   pJobs->pDecompressedSizes[nJobIndex] = lz4ultra_decompressor_expand_raw_table_block(pJobs->pInData, pJobs->nInDataSize, nJobIndex, pJobs->pOutData, pJobs->nMaxOutDataSize);
+}
+
+/**
+ * Decompress a raw block table in memory. Each block has a fixed place in the output buffer, so that the blocks can be decompressed in parallel.
+ *
+ * @param pFileData raw block table
+ * @param pOutBuffer buffer for decompressed data
+ * @param nFileSize size of raw block table in bytes
+ * @param nMaxOutBufferSize maximum capacity of decompression buffer
+ * @param nThreads number of threads to decompress blocks with
+ *
+ * @return actual decompressed size, or -1 for error
+ */
+static size_t lz4ultra_decompress_inmem_raw_table(const unsigned char *pFileData, unsigned char *pOutBuffer, size_t nFileSize, size_t nMaxOutBufferSize, int nThreads) {
+   lz4ultra_expand_raw_table_jobs jobs;
+   lz4ultra_threadpool *pPool;
+   size_t nDecompressedSize;
+   int nBlocks = lz4ultra_decompressor_get_raw_table_info(pFileData, nFileSize, &nDecompressedSize);
+   int i;
+
+   if (nBlocks < 0 || nDecompressedSize > nMaxOutBufferSize)
+      return -1;
+
+   if (nThreads > nBlocks)
+      nThreads = nBlocks;
+   if (nThreads < 2)
+      return lz4ultra_decompressor_expand_raw_table(pFileData, nFileSize, pOutBuffer, nMaxOutBufferSize);
+
+   jobs.pDecompressedSizes = (int *)malloc(nBlocks * sizeof(int));
+   if (!jobs.pDecompressedSizes)
+      return lz4ultra_decompressor_expand_raw_table(pFileData, nFileSize, pOutBuffer, nMaxOutBufferSize);
+
+   pPool = lz4ultra_threadpool_create(nThreads);
+   if (!pPool) {
+      free(jobs.pDecompressedSizes);
+      return lz4ultra_decompressor_expand_raw_table(pFileData, nFileSize, pOutBuffer, nMaxOutBufferSize);
+   }
+
+   /* Decompress all blocks at once, each to its own place */
+   jobs.pInData = pFileData;
+   jobs.nInDataSize = nFileSize;
+   jobs.pOutData = pOutBuffer;
+   jobs.nMaxOutDataSize = nMaxOutBufferSize;
+   lz4ultra_threadpool_run(pPool, lz4ultra_decompress_raw_table_block_job, &jobs, nBlocks);
+   lz4ultra_threadpool_destroy(pPool);
+
+   for (i = 0; i < nBlocks; i++) {
+      if (jobs.pDecompressedSizes[i] < 0) {
+         free(jobs.pDecompressedSizes);
+         return -1;
+      }
+   }
+
+   free(jobs.pDecompressedSizes);
+   return nDecompressedSize;
+}
+
+/**
+ * Decompress data in memory. The data can hold several concatenated frames, which are decompressed one after the other; skippable frames
+ * are skipped.
+ *
+ * @param pFileData compressed data
+ * @param pOutBuffer buffer for decompressed data
+ * @param nFileSize compressed size in bytes
+ * @param nMaxOutBufferSize maximum capacity of decompression buffer
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
+ * @param nThreads number of threads to decompress independent blocks with (1 for single-threaded decompression)
+ *
+ * @return actual decompressed size, or -1 for error
+ */
+size_t lz4ultra_decompress_inmem(const unsigned char *pFileData, unsigned char *pOutBuffer, size_t nFileSize, size_t nMaxOutBufferSize, unsigned int nFlags, int nThreads) {
+   const unsigned char *pCurFileData = pFileData;
+   const unsigned char *pEndFileData = pCurFileData + nFileSize;
+   size_t nOriginalSize = 0;
+
+   if (nFlags & LZ4ULTRA_FLAG_RAW_TABLE) {
+      return lz4ultra_decompress_inmem_raw_table(pFileData, pOutBuffer, nFileSize, nMaxOutBufferSize, nThreads);
+   }
+
+   if (nFlags & LZ4ULTRA_FLAG_RAW_BLOCK) {
+      return (size_t)lz4ultra_decompressor_expand_block(pFileData, (int)nFileSize - 2 /* EOD marker */, pOutBuffer, 0, (int)nMaxOutBufferSize);
+   }
+
+   do {
+      int nBlockMaxCode = 0;
+      int nBlockMaxBits;
+      unsigned int nSkipSize = 0;
+      long long nContentSize = -1LL;
+
+      /* Check header */
+      int nHeaderSize = lz4ultra_get_header_size_inmem(pCurFileData, (size_t)(pEndFileData - pCurFileData));
+      if (nHeaderSize < 0)
+         return -1;
+
+      if (lz4ultra_decode_skippable_header(pCurFileData, nHeaderSize, &nSkipSize) == LZ4ULTRA_DECODE_OK) {
+         /* Skippable frames hold no compressed data, but deduplicated data can only be restored when decompressing a file */
+         if ((size_t)(pEndFileData - pCurFileData - nHeaderSize) < (size_t)nSkipSize || lz4ultra_is_dedup_header(pCurFileData, nHeaderSize))
+            return -1;
+         pCurFileData += nHeaderSize + nSkipSize;
+         continue;
+      }
+
+      if (lz4ultra_decode_header(pCurFileData, nHeaderSize, &nBlockMaxCode, &nFlags, &nContentSize) != LZ4ULTRA_DECODE_OK)
+         return -1;
+
+      if (nFlags & LZ4ULTRA_FLAG_LEGACY_FRAMES)
+         nBlockMaxBits = 23;
+      else
+         nBlockMaxBits = 8 + (nBlockMaxCode << 1);
+
+      pCurFileData += nHeaderSize;
+
+      size_t nDecompressedSize = lz4ultra_decompress_inmem_frame(&pCurFileData, pEndFileData, pOutBuffer + nOriginalSize, nMaxOutBufferSize - nOriginalSize,
+         nFlags, 1 << nBlockMaxBits, nContentSize, nThreads);
+      if (nDecompressedSize == -1)
+         return -1;
+      nOriginalSize += nDecompressedSize;
+   } while (pCurFileData < pEndFileData);
+
+   return nOriginalSize;
+}
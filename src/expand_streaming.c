@@ -1,263 +1,1728 @@
-/*
- * expand_streaming.c - streaming decompression implementation
- *
- * Copyright (C) 2019 Emmanuel Marty
- *
- * This software is provided 'as-is', without any express or implied
- * warranty.  In no event will the authors be held liable for any damages
- * arising from the use of this software.
- *
- * Permission is granted to anyone to use this software for any purpose,
- * including commercial applications, and to alter it and redistribute it
- * freely, subject to the following restrictions:
- *
- * 1. The origin of this software must not be misrepresented; you must not
- *    claim that you wrote the original software. If you use this software
- *    in a product, an acknowledgment in the product documentation would be
- *    appreciated but is not required.
- * 2. Altered source versions must be plainly marked as such, and must not be
- *    misrepresented as being the original software.
- * 3. This notice may not be removed or altered from any source distribution.
- */
-
-/*
- * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
- *
- * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
- * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
- * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
- * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
- *
- */
-
-#include <stdlib.h>
-#include <string.h>
-#include "expand_streaming.h"
-#include "format.h"
-#include "frame.h"
-#include "lib.h"
-
-/*-------------- File API -------------- */
-
-/**
- * Decompress file
- *
- * @param pszInFilename name of input(compressed) file to decompress
- * @param pszOutFilename name of output(decompressed) file to generate
- * @param pszDictionaryFilename name of dictionary file, or NULL for none
- * @param nFlags compression flags (LZ4ULTRA_FLAG_RAW_BLOCK to decompress a raw block, or 0)
- * @param pOriginalSize pointer to returned output(decompressed) size, updated when this function is successful
- * @param pCompressedSize pointer to returned input(compressed) size, updated when this function is successful
- *
- * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
- */
-lz4ultra_status_t lz4ultra_decompress_file(const char *pszInFilename, const char *pszOutFilename, const char *pszDictionaryFilename, const unsigned int nFlags,
-                                           long long *pOriginalSize, long long *pCompressedSize) {
-   lz4ultra_stream_t inStream, outStream;
-   void *pDictionaryData = NULL;
-   int nDictionaryDataSize = 0;
-   lz4ultra_status_t nStatus;
-
-   if (lz4ultra_filestream_open(&inStream, pszInFilename, "rb") < 0) {
-      return LZ4ULTRA_ERROR_SRC;
-   }
-
-   if (lz4ultra_filestream_open(&outStream, pszOutFilename, "wb") < 0) {
-      inStream.close(&inStream);
-      return LZ4ULTRA_ERROR_DST;
-   }
-
-   nStatus = lz4ultra_dictionary_load(pszDictionaryFilename, &pDictionaryData, &nDictionaryDataSize);
-   if (nStatus) {
-      outStream.close(&outStream);
-      inStream.close(&inStream);
-
-      return nStatus;
-   }
-
-   nStatus = lz4ultra_decompress_stream(&inStream, &outStream, pDictionaryData, nDictionaryDataSize, nFlags, pOriginalSize, pCompressedSize);
-
-   lz4ultra_dictionary_free(&pDictionaryData);
-   outStream.close(&outStream);
-   inStream.close(&inStream);
-   
-   return nStatus;
-}
-
-/*-------------- Streaming API -------------- */
-
-/**
- * Decompress stream
- *
- * @param pInStream input(compressed) stream to decompress
- * @param pOutStream output(decompressed) stream to write to
- * @param pDictionaryData dictionary contents, or NULL for none
- * @param nDictionaryDataSize size of dictionary contents, or 0
- * @param pOriginalSize pointer to returned output(decompressed) size, updated when this function is successful
- * @param pCompressedSize pointer to returned input(compressed) size, updated when this function is successful
- *
- * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
- */
-lz4ultra_status_t lz4ultra_decompress_stream(lz4ultra_stream_t *pInStream, lz4ultra_stream_t *pOutStream, const void *pDictionaryData, int nDictionaryDataSize, unsigned int nFlags,
-                                             long long *pOriginalSize, long long *pCompressedSize) {
-   long long nOriginalSize = 0LL;
-   long long nCompressedSize = 0LL;
-   int nBlockMaxCode = 7;
-   unsigned char cFrameData[16];
-   unsigned char *pInBlock;
-   unsigned char *pOutData;
-
-   if ((nFlags & LZ4ULTRA_FLAG_RAW_BLOCK) == 0) {
-      memset(cFrameData, 0, 16);
-
-      if (pInStream->read(pInStream, cFrameData, LZ4ULTRA_HEADER_SIZE) != LZ4ULTRA_HEADER_SIZE) {
-         return LZ4ULTRA_ERROR_SRC;
-      }
-
-      int nExtraHeaderSize = lz4ultra_check_header(cFrameData, LZ4ULTRA_HEADER_SIZE);
-      if (nExtraHeaderSize < 0)
-         return LZ4ULTRA_ERROR_FORMAT;
-
-      if (pInStream->read(pInStream, cFrameData + LZ4ULTRA_HEADER_SIZE, nExtraHeaderSize) != nExtraHeaderSize) {
-         return LZ4ULTRA_ERROR_SRC;
-      }
-
-      int nSuccess = lz4ultra_decode_header(cFrameData, LZ4ULTRA_HEADER_SIZE + nExtraHeaderSize, &nBlockMaxCode, &nFlags);
-      if (nSuccess < 0) {
-         if (nSuccess == LZ4ULTRA_DECODE_ERR_SUM)
-            return LZ4ULTRA_ERROR_CHECKSUM;
-         else
-            return LZ4ULTRA_ERROR_FORMAT;
-      }
-
-      nCompressedSize += (long long)(LZ4ULTRA_HEADER_SIZE + nExtraHeaderSize);
-   }
-
-   int nBlockMaxBits;
-   if (nFlags & LZ4ULTRA_FLAG_LEGACY_FRAMES)
-      nBlockMaxBits = 23;
-   else
-      nBlockMaxBits = 8 + (nBlockMaxCode << 1);
-   int nBlockMaxSize = 1 << nBlockMaxBits;
-
-   pInBlock = (unsigned char*)malloc(nBlockMaxSize);
-   if (!pInBlock) {
-      return LZ4ULTRA_ERROR_MEMORY;
-   }
-
-   pOutData = (unsigned char*)malloc(nBlockMaxSize + HISTORY_SIZE);
-   if (!pOutData) {
-      free(pInBlock);
-      pInBlock = NULL;
-
-      return LZ4ULTRA_ERROR_MEMORY;
-   }
-
-   int nDecompressionError = 0;
-   int nPrevDecompressedSize = 0;
-   int nNumBlocks = 0;
-
-   while (!pInStream->eof(pInStream) && !nDecompressionError) {
-      unsigned int nBlockSize = 0;
-      int nIsUncompressed = 0;
-
-      if (nPrevDecompressedSize != 0) {
-         memcpy(pOutData + HISTORY_SIZE - nPrevDecompressedSize, pOutData + HISTORY_SIZE + (nBlockMaxSize - nPrevDecompressedSize), nPrevDecompressedSize);
-      }
-      else if (nDictionaryDataSize != 0) {
-         memcpy(pOutData + HISTORY_SIZE - nDictionaryDataSize, pDictionaryData, nDictionaryDataSize);
-         nPrevDecompressedSize = nDictionaryDataSize;
-
-         if (!(nFlags & LZ4ULTRA_FLAG_INDEP_BLOCKS))
-            nDictionaryDataSize = 0;
-      }
-
-      if ((nFlags & LZ4ULTRA_FLAG_RAW_BLOCK) == 0) {
-         memset(cFrameData, 0, 16);
-         if (pInStream->read(pInStream, cFrameData, LZ4ULTRA_FRAME_SIZE) == LZ4ULTRA_FRAME_SIZE) {
-            int nSuccess = lz4ultra_decode_frame(cFrameData, LZ4ULTRA_FRAME_SIZE, nFlags, &nBlockSize, &nIsUncompressed);
-            if (nSuccess < 0)
-               nBlockSize = 0;
-
-            nCompressedSize += (long long)LZ4ULTRA_FRAME_SIZE;
-         }
-         else {
-            nBlockSize = 0;
-         }
-      }
-      else {
-         if (!nNumBlocks)
-            nBlockSize = nBlockMaxSize;
-         else
-            nBlockSize = 0;
-      }
-
-      if (nBlockSize != 0) {
-         int nDecompressedSize = 0;
-
-         if ((int)nBlockSize > nBlockMaxSize) {
-            nDecompressionError = LZ4ULTRA_ERROR_FORMAT;
-            break;
-         }
-         size_t nReadBytes = pInStream->read(pInStream, pInBlock, nBlockSize);
-         if (nFlags & LZ4ULTRA_FLAG_RAW_BLOCK) {
-            if (nReadBytes > 2)
-               nReadBytes -= 2;
-            else
-               nReadBytes = 0;
-            nBlockSize = (unsigned int)nReadBytes;
-         }
-
-         if (nReadBytes == nBlockSize) {
-            nCompressedSize += (long long)nReadBytes;
-
-            if (nIsUncompressed) {
-               memcpy(pOutData + HISTORY_SIZE, pInBlock, nBlockSize);
-               nDecompressedSize = nBlockSize;
-            }
-            else {
-               nDecompressedSize = lz4ultra_decompressor_expand_block(pInBlock, nBlockSize, pOutData, HISTORY_SIZE, nBlockMaxSize);
-               if (nDecompressedSize < 0) {
-                  nDecompressionError = LZ4ULTRA_ERROR_DECOMPRESSION;
-                  break;
-               }
-            }
-
-            if (nDecompressedSize != 0) {
-               nOriginalSize += (long long)nDecompressedSize;
-
-               if (pOutStream->write(pOutStream, pOutData + HISTORY_SIZE, nDecompressedSize) != nDecompressedSize)
-                  nDecompressionError = LZ4ULTRA_ERROR_DST;
-
-               if (!(nFlags & LZ4ULTRA_FLAG_INDEP_BLOCKS)) {
-                  nPrevDecompressedSize = nDecompressedSize;
-                  if (nPrevDecompressedSize > HISTORY_SIZE)
-                     nPrevDecompressedSize = HISTORY_SIZE;
-               }
-               else {
-                  nPrevDecompressedSize = 0;
-               }
-               nDecompressedSize = 0;
-            }
-         }
-         else {
-            break;
-         }
-
-         nNumBlocks++;
-      }
-      else {
-         break;
-      }
-   }
-
-   free(pOutData);
-   pOutData = NULL;
-
-   free(pInBlock);
-   pInBlock = NULL;
-
-   *pOriginalSize = nOriginalSize;
-   *pCompressedSize = nCompressedSize;
-   return nDecompressionError;
-}
+/*
+ * expand_streaming.c - streaming decompression implementation
+ *
+ * Copyright (C) 2019 Emmanuel Marty
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*
+ * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
+ *
+ * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
+ * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
+ * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
+ * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "expand_streaming.h"
+#include "format.h"
+#include "frame.h"
+#include "lib.h"
+#include "filemap.h"
+#include "asyncstream.h"
+#include "threadpool.h"
+#include "dedup.h"
+#define XXH_STATIC_LINKING_ONLY
+#include "xxhash.h"
+
+static lz4ultra_status_t lz4ultra_decompress_blocks(lz4ultra_stream_t *pInStream, const unsigned char *pInMap, size_t nInMapSize, lz4ultra_stream_t *pOutStream, lz4ultra_filemap_t *pOutMap,
+                                                    const void *pDictionaryData, int nDictionaryDataSize, unsigned int nFlags, int nThreads, long long *pOriginalSize, long long *pCompressedSize);
+
+/*-------------- File API -------------- */
+
+/**
+ * Decompress deduplicated data into a mapping of the output file, where the repeated ranges are copied from the data that is already restored
+ *
+ * @param pInMap input(compressed) file, mapped for reading
+ * @param pDedup repeated ranges, loaded from the deduplication index at the start of the input file
+ * @param pszOutFilename name of output(decompressed) file to generate
+ * @param pDictionaryData dictionary contents, or NULL for none
+ * @param nDictionaryDataSize size of dictionary contents, or 0
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_ASYNC_IO or 0)
+ * @param nThreads number of threads to decompress independent blocks with (1 for single-threaded decompression)
+ * @param pOriginalSize pointer to returned output(decompressed) size, updated when this function is successful
+ * @param pCompressedSize pointer to returned input(compressed) size, updated when this function is successful
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+static lz4ultra_status_t lz4ultra_decompress_dedup(lz4ultra_filemap_t *pInMap, const lz4ultra_dedup *pDedup, const char *pszOutFilename, const void *pDictionaryData, int nDictionaryDataSize,
+                                                   const unsigned int nFlags, int nThreads, long long *pOriginalSize, long long *pCompressedSize) {
+   lz4ultra_filemap_t outMap;
+   lz4ultra_stream_t dedupStream;
+   long long nOriginalSize = 0LL;
+   lz4ultra_status_t nStatus;
+
+   /* The original data is restored in place, it needs to be mapped as a whole */
+   if (lz4ultra_filestream_is_stdio(pszOutFilename) || (unsigned long long)(size_t)pDedup->nOriginalSize != (unsigned long long)pDedup->nOriginalSize)
+      return LZ4ULTRA_ERROR_DEDUP;
+
+   if (lz4ultra_filemap_create(&outMap, pszOutFilename))
+      return LZ4ULTRA_ERROR_DST;
+   if (lz4ultra_filemap_resize(&outMap, (size_t)pDedup->nOriginalSize)) {
+      lz4ultra_filemap_close(&outMap);
+      return LZ4ULTRA_ERROR_DST;
+   }
+   if (lz4ultra_dedup_writer_open(&dedupStream, pDedup, outMap.pData)) {
+      lz4ultra_filemap_close(&outMap);
+      return LZ4ULTRA_ERROR_MEMORY;
+   }
+
+   nStatus = lz4ultra_decompress_blocks(NULL, pInMap->pData, pInMap->nSize, &dedupStream, NULL, pDictionaryData, nDictionaryDataSize,
+      (nFlags & ~LZ4ULTRA_FLAG_ASYNC_IO) | LZ4ULTRA_FLAG_DEDUP, nThreads, &nOriginalSize, pCompressedSize);
+   if (lz4ultra_dedup_writer_finish(&dedupStream) && nStatus == LZ4ULTRA_OK)
+      nStatus = LZ4ULTRA_ERROR_DECOMPRESSION;
+
+   lz4ultra_filemap_close(&outMap);
+
+   if (nStatus == LZ4ULTRA_OK)
+      *pOriginalSize = pDedup->nOriginalSize;
+   return nStatus;
+}
+
+/**
+ * Decompress file
+ *
+ * @param pszInFilename name of input(compressed) file to decompress
+ * @param pszOutFilename name of output(decompressed) file to generate
+ * @param pszDictionaryFilename name of dictionary file, or NULL for none
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_RAW_BLOCK to decompress a raw block, LZ4ULTRA_FLAG_RAW_TABLE to decompress a raw block table, LZ4ULTRA_FLAG_ASYNC_IO to read ahead and write behind on background threads, or 0)
+ * @param nThreads number of threads to decompress independent blocks with (1 for single-threaded decompression)
+ * @param pOriginalSize pointer to returned output(decompressed) size, updated when this function is successful
+ * @param pCompressedSize pointer to returned input(compressed) size, updated when this function is successful
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+lz4ultra_status_t lz4ultra_decompress_file(const char *pszInFilename, const char *pszOutFilename, const char *pszDictionaryFilename, const unsigned int nFlags, int nThreads,
+                                           long long *pOriginalSize, long long *pCompressedSize) {
+   lz4ultra_filemap_t inMap, outMap;
+   lz4ultra_stream_t inStream, outStream;
+   void *pDictionaryData = NULL;
+   int nDictionaryDataSize = 0;
+   int nInMapped, nOutMapped = 0;
+   lz4ultra_dedup dedup;
+   int nDedup = 0;
+   lz4ultra_status_t nStatus;
+
+   nStatus = lz4ultra_dictionary_load(pszDictionaryFilename, &pDictionaryData, &nDictionaryDataSize);
+   if (nStatus)
+      return nStatus;
+
+   /* Read compressed blocks straight from a memory mapping of regular files, falling back to reading them otherwise, for instance from a pipe,
+    * or when asked to read ahead and write behind */
+   if (lz4ultra_filestream_is_stdio(pszInFilename))
+      nInMapped = 0;
+   else
+      nInMapped = (lz4ultra_filemap_open(&inMap, pszInFilename) == 0) ? 1 : 0;
+   if (nInMapped) {
+      /* Deduplicated data starts with the index of the repeated ranges, raw block tables start with their block count */
+      nDedup = (nFlags & LZ4ULTRA_FLAG_RAW_TABLE) ? 0 : lz4ultra_dedup_load_index(&dedup, NULL, inMap.pData, inMap.nSize);
+      if (nDedup < 0) {
+         lz4ultra_filemap_close(&inMap);
+         lz4ultra_dictionary_free(&pDictionaryData);
+         return LZ4ULTRA_ERROR_FORMAT;
+      }
+      if (nDedup > 0) {
+         nStatus = lz4ultra_decompress_dedup(&inMap, &dedup, pszOutFilename, pDictionaryData, nDictionaryDataSize, nFlags, nThreads, pOriginalSize, pCompressedSize);
+         lz4ultra_dedup_free(&dedup);
+         lz4ultra_filemap_close(&inMap);
+         lz4ultra_dictionary_free(&pDictionaryData);
+         return nStatus;
+      }
+
+      if (nFlags & LZ4ULTRA_FLAG_ASYNC_IO) {
+         lz4ultra_filemap_close(&inMap);
+         nInMapped = 0;
+      }
+   }
+   if (!nInMapped && lz4ultra_filestream_open(&inStream, pszInFilename, "rb") < 0) {
+      lz4ultra_dictionary_free(&pDictionaryData);
+      return LZ4ULTRA_ERROR_SRC;
+   }
+
+   /* Decompress into a mapping of the output file as well, where history is simply the previously decompressed data, when there is
+    * no dictionary to place in front of the first block, and when the address space is large enough to map big files */
+   if (!pDictionaryData && sizeof(size_t) >= 8 && (nFlags & LZ4ULTRA_FLAG_ASYNC_IO) == 0 && !lz4ultra_filestream_is_stdio(pszOutFilename))
+      nOutMapped = (lz4ultra_filemap_create(&outMap, pszOutFilename) == 0) ? 1 : 0;
+   if (!nOutMapped && lz4ultra_filestream_open(&outStream, pszOutFilename, "wb") < 0) {
+      if (nInMapped)
+         lz4ultra_filemap_close(&inMap);
+      else
+         inStream.close(&inStream);
+      lz4ultra_dictionary_free(&pDictionaryData);
+      return LZ4ULTRA_ERROR_DST;
+   }
+
+   if (nOutMapped || nInMapped) {
+      nStatus = lz4ultra_decompress_blocks(nInMapped ? NULL : &inStream, nInMapped ? inMap.pData : NULL, nInMapped ? inMap.nSize : 0,
+         nOutMapped ? NULL : &outStream, nOutMapped ? &outMap : NULL,
+         pDictionaryData, nDictionaryDataSize, nFlags, nThreads, pOriginalSize, pCompressedSize);
+   }
+   else {
+      nStatus = lz4ultra_decompress_stream(&inStream, &outStream, pDictionaryData, nDictionaryDataSize, nFlags, nThreads, pOriginalSize, pCompressedSize);
+   }
+
+   lz4ultra_dictionary_free(&pDictionaryData);
+   if (nOutMapped)
+      lz4ultra_filemap_close(&outMap);
+   else
+      outStream.close(&outStream);
+   if (nInMapped)
+      lz4ultra_filemap_close(&inMap);
+   else
+      inStream.close(&inStream);
+   
+   return nStatus;
+}
+
+/**
+ * Decompress a range of bytes out of a file compressed with independent blocks and a seek table, only decompressing the blocks that the range covers
+ *
+ * @param pszInFilename name of input(compressed) file to decompress
+ * @param pszOutFilename name of output(decompressed) file to generate, that receives the decompressed bytes of the range
+ * @param pszDictionaryFilename name of dictionary file, or NULL for none
+ * @param nRangeOffset offset of the first decompressed byte of the range
+ * @param nRangeSize number of decompressed bytes in the range, which is clipped to the end of the decompressed data
+ * @param pOriginalSize pointer to returned number of decompressed bytes written, updated when this function is successful
+ * @param pCompressedSize pointer to returned number of compressed bytes that were decompressed, updated when this function is successful
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+lz4ultra_status_t lz4ultra_decompress_range(const char *pszInFilename, const char *pszOutFilename, const char *pszDictionaryFilename, long long nRangeOffset, long long nRangeSize,
+                                            long long *pOriginalSize, long long *pCompressedSize) {
+   lz4ultra_filemap_t inMap;
+   lz4ultra_stream_t outStream;
+   void *pDictionaryData = NULL;
+   int nDictionaryDataSize = 0;
+   unsigned char *pOutData;
+   long long nOriginalSize = 0LL, nCompressedSize = 0LL;
+   long long nRangeEnd;
+   lz4ultra_status_t nStatus;
+
+   if (nRangeOffset < 0 || nRangeSize < 0)
+      return LZ4ULTRA_ERROR_SRC;
+   nRangeEnd = ((0x7fffffffffffffffLL - nRangeOffset) < nRangeSize) ? 0x7fffffffffffffffLL : (nRangeOffset + nRangeSize);
+
+   nStatus = lz4ultra_dictionary_load(pszDictionaryFilename, &pDictionaryData, &nDictionaryDataSize);
+   if (nStatus)
+      return nStatus;
+
+   /* Random access needs the whole compressed file, in order to find the seek table at its end */
+   if (lz4ultra_filestream_is_stdio(pszInFilename) || lz4ultra_filemap_open(&inMap, pszInFilename)) {
+      lz4ultra_dictionary_free(&pDictionaryData);
+      return LZ4ULTRA_ERROR_SRC;
+   }
+
+   const unsigned char *pInData = inMap.pData;
+   const size_t nInSize = inMap.nSize;
+   int nHeaderSize = LZ4ULTRA_HEADER_SIZE;
+   int nExtraHeaderSize = LZ4ULTRA_DECODE_ERR_FORMAT;
+   int nBlockMaxCode = 7;
+   unsigned int nFlags = 0;
+   unsigned int nBlocks = 0;
+   size_t nSeekTableOffset = 0;
+
+   /* Decode the header */
+   if (nInSize >= (size_t)nHeaderSize) {
+      while ((nExtraHeaderSize = lz4ultra_check_header(pInData, nHeaderSize)) > 0) {
+         if ((nInSize - (size_t)nHeaderSize) < (size_t)nExtraHeaderSize) {
+            nExtraHeaderSize = LZ4ULTRA_DECODE_ERR_FORMAT;
+            break;
+         }
+         nHeaderSize += nExtraHeaderSize;
+      }
+   }
+   if (nExtraHeaderSize < 0 || lz4ultra_decode_header(pInData, nHeaderSize, &nBlockMaxCode, &nFlags, NULL) != LZ4ULTRA_DECODE_OK)
+      nStatus = LZ4ULTRA_ERROR_FORMAT;
+
+   /* Find the seek table, at the end of the file */
+   if (!nStatus) {
+      if ((nFlags & (LZ4ULTRA_FLAG_INDEP_BLOCKS | LZ4ULTRA_FLAG_LEGACY_FRAMES)) != LZ4ULTRA_FLAG_INDEP_BLOCKS ||
+          (nInSize - (size_t)nHeaderSize) < (size_t)(LZ4ULTRA_SEEK_TABLE_HEADER_SIZE + LZ4ULTRA_SEEK_TABLE_FOOTER_SIZE) ||
+          lz4ultra_decode_seek_table_footer(pInData + nInSize - LZ4ULTRA_SEEK_TABLE_FOOTER_SIZE, LZ4ULTRA_SEEK_TABLE_FOOTER_SIZE, &nBlocks) != LZ4ULTRA_DECODE_OK ||
+          ((nInSize - (size_t)nHeaderSize - LZ4ULTRA_SEEK_TABLE_HEADER_SIZE - LZ4ULTRA_SEEK_TABLE_FOOTER_SIZE) / LZ4ULTRA_SEEK_TABLE_ENTRY_SIZE) < (size_t)nBlocks) {
+         nStatus = LZ4ULTRA_ERROR_NO_SEEK_TABLE;
+      }
+      else {
+         nSeekTableOffset = nInSize - LZ4ULTRA_SEEK_TABLE_FOOTER_SIZE - (size_t)nBlocks * LZ4ULTRA_SEEK_TABLE_ENTRY_SIZE - LZ4ULTRA_SEEK_TABLE_HEADER_SIZE;
+         if (lz4ultra_decode_seek_table_header(pInData + nSeekTableOffset, LZ4ULTRA_SEEK_TABLE_HEADER_SIZE, nBlocks) != LZ4ULTRA_DECODE_OK)
+            nStatus = LZ4ULTRA_ERROR_NO_SEEK_TABLE;
+      }
+   }
+
+   if (nStatus) {
+      lz4ultra_filemap_close(&inMap);
+      lz4ultra_dictionary_free(&pDictionaryData);
+      return nStatus;
+   }
+
+   const int nBlockMaxSize = 1 << (8 + (nBlockMaxCode << 1));
+   const int nBlockChecksumSize = lz4ultra_get_block_checksum_size(nFlags);
+   const unsigned char *pSeekTableEntry = pInData + nSeekTableOffset + LZ4ULTRA_SEEK_TABLE_HEADER_SIZE;
+   size_t nBlockOffset = (size_t)nHeaderSize;
+   long long nBlockOriginalOffset = 0LL;
+   unsigned int nBlock;
+
+   /* Each independent block is decompressed after the dictionary, when there is one */
+   pOutData = (unsigned char *)malloc((size_t)nDictionaryDataSize + (size_t)nBlockMaxSize);
+   if (!pOutData) {
+      lz4ultra_filemap_close(&inMap);
+      lz4ultra_dictionary_free(&pDictionaryData);
+      return LZ4ULTRA_ERROR_MEMORY;
+   }
+   if (nDictionaryDataSize)
+      memcpy(pOutData, pDictionaryData, nDictionaryDataSize);
+   lz4ultra_dictionary_free(&pDictionaryData);
+
+   if (lz4ultra_filestream_open(&outStream, pszOutFilename, "wb") < 0) {
+      free(pOutData);
+      lz4ultra_filemap_close(&inMap);
+      return LZ4ULTRA_ERROR_DST;
+   }
+
+   for (nBlock = 0; nBlock < nBlocks && nBlockOriginalOffset < nRangeEnd && !nStatus; nBlock++, pSeekTableEntry += LZ4ULTRA_SEEK_TABLE_ENTRY_SIZE) {
+      unsigned int nEntryCompressedSize = 0, nEntryOriginalSize = 0;
+
+      lz4ultra_decode_seek_table_entry(pSeekTableEntry, LZ4ULTRA_SEEK_TABLE_ENTRY_SIZE, &nEntryCompressedSize, &nEntryOriginalSize);
+      if (nEntryCompressedSize < LZ4ULTRA_FRAME_SIZE || (nSeekTableOffset - nBlockOffset) < (size_t)nEntryCompressedSize || nEntryOriginalSize > (unsigned int)nBlockMaxSize) {
+         nStatus = LZ4ULTRA_ERROR_FORMAT;
+         break;
+      }
+
+      if ((nBlockOriginalOffset + (long long)nEntryOriginalSize) > nRangeOffset) {
+         /* This block is covered by the range */
+         const unsigned char *pFrameData = pInData + nBlockOffset;
+         unsigned int nBlockSize = 0;
+         int nIsUncompressed = 0;
+         int nDecompressedSize;
+
+         if (lz4ultra_decode_frame(pFrameData, LZ4ULTRA_FRAME_SIZE, &nBlockSize, &nIsUncompressed) != LZ4ULTRA_DECODE_OK ||
+             (size_t)nEntryCompressedSize != (size_t)LZ4ULTRA_FRAME_SIZE + (size_t)nBlockSize + (size_t)nBlockChecksumSize || nBlockSize == 0) {
+            nStatus = LZ4ULTRA_ERROR_FORMAT;
+            break;
+         }
+         pFrameData += LZ4ULTRA_FRAME_SIZE;
+
+         if (nBlockChecksumSize) {
+            if (lz4ultra_decode_checksum(pFrameData + nBlockSize, nBlockChecksumSize, XXH32(pFrameData, nBlockSize, 0)) != LZ4ULTRA_DECODE_OK) {
+               nStatus = LZ4ULTRA_ERROR_CHECKSUM;
+               break;
+            }
+         }
+
+         if (nIsUncompressed) {
+            if (nBlockSize > (unsigned int)nBlockMaxSize) {
+               nStatus = LZ4ULTRA_ERROR_FORMAT;
+               break;
+            }
+            memcpy(pOutData + nDictionaryDataSize, pFrameData, nBlockSize);
+            nDecompressedSize = (int)nBlockSize;
+         }
+         else {
+            nDecompressedSize = lz4ultra_decompressor_expand_block(pFrameData, nBlockSize, pOutData, nDictionaryDataSize, nBlockMaxSize);
+         }
+         if (nDecompressedSize != (int)nEntryOriginalSize) {
+            nStatus = LZ4ULTRA_ERROR_DECOMPRESSION;
+            break;
+         }
+
+         /* Write the part of the block that the range covers */
+         long long nCopyStart = (nRangeOffset > nBlockOriginalOffset) ? (nRangeOffset - nBlockOriginalOffset) : 0;
+         long long nCopyEnd = ((nRangeEnd - nBlockOriginalOffset) < (long long)nDecompressedSize) ? (nRangeEnd - nBlockOriginalOffset) : (long long)nDecompressedSize;
+         size_t nCopySize = (size_t)(nCopyEnd - nCopyStart);
+
+         if (outStream.write(&outStream, pOutData + nDictionaryDataSize + nCopyStart, nCopySize) != nCopySize) {
+            nStatus = LZ4ULTRA_ERROR_DST;
+            break;
+         }
+
+         nOriginalSize += (long long)nCopySize;
+         nCompressedSize += (long long)nEntryCompressedSize;
+      }
+
+      nBlockOffset += nEntryCompressedSize;
+      nBlockOriginalOffset += (long long)nEntryOriginalSize;
+   }
+
+   free(pOutData);
+   outStream.close(&outStream);
+   lz4ultra_filemap_close(&inMap);
+
+   if (nStatus)
+      return nStatus;
+
+   *pOriginalSize = nOriginalSize;
+   *pCompressedSize = nCompressedSize;
+   return LZ4ULTRA_OK;
+}
+
+/*-------------- Streaming API -------------- */
+
+/**
+ * Read compressed data
+ *
+ * @param pInStream input(compressed) stream, when pInMap is NULL
+ * @param pInMap input(compressed) data, or NULL to read from pInStream
+ * @param nInMapSize size of input data, when pInMap isn't NULL
+ * @param pInMapOffset pointer to the number of bytes of input data that were read, updated by this function when pInMap isn't NULL
+ * @param ptr buffer to read into
+ * @param size number of bytes to read
+ *
+ * @return number of bytes read
+ */
+static size_t lz4ultra_decompress_read(lz4ultra_stream_t *pInStream, const unsigned char *pInMap, size_t nInMapSize, size_t *pInMapOffset, void *ptr, size_t size) {
+   if (pInMap) {
+      if (size > (nInMapSize - *pInMapOffset))
+         size = nInMapSize - *pInMapOffset;
+      memcpy(ptr, pInMap + *pInMapOffset, size);
+      *pInMapOffset += size;
+      return size;
+   }
+   else {
+      return pInStream->read(pInStream, ptr, size);
+   }
+}
+
+/**
+ * Decompress blocks one after the other, each one using the previously decompressed block as history unless blocks are independent
+ *
+ * @param pInStream input(compressed) stream to decompress, when pInMap is NULL
+ * @param pInMap input(compressed) data to decompress, or NULL to read it from pInStream
+ * @param nInMapSize size of input data, when pInMap isn't NULL
+ * @param pInMapOffset pointer to the number of bytes of input data that were read, updated by this function when pInMap isn't NULL
+ * @param pOutStream output(decompressed) stream to write to, when pOutMap is NULL
+ * @param pOutMap file mapped for writing to decompress into, or NULL to write to pOutStream; not supported with a dictionary
+ * @param pDictionaryData dictionary contents, or NULL for none
+ * @param nDictionaryDataSize size of dictionary contents, or 0
+ * @param nFlags compression flags, as decoded from the header
+ * @param nBlockMaxSize maximum decompressed size of one block, in bytes
+ * @param nContentEnd output(decompressed) size at which the frame ends, according to the decompressed size stored in the header, or -1 if unknown
+ * @param pContentChecksum content checksum state, updated with the decompressed data when the frame has a content checksum
+ * @param pOriginalSize pointer to output(decompressed) size, updated by this function
+ * @param pCompressedSize pointer to input(compressed) size, updated by this function
+ * @param pNextHeaderData buffer of LZ4ULTRA_HEADER_SIZE bytes, that receives the magic number of the next frame when a legacy frame is followed by another frame
+ * @param pEndMarkFound pointer to returned flag, set to 1 if the end mark, or the next frame of a legacy stream, was read, or 0 if not
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+static lz4ultra_status_t lz4ultra_decompress_serial_blocks(lz4ultra_stream_t *pInStream, const unsigned char *pInMap, size_t nInMapSize, size_t *pInMapOffset, lz4ultra_stream_t *pOutStream, lz4ultra_filemap_t *pOutMap,
+                                                           const void *pDictionaryData, int nDictionaryDataSize, unsigned int nFlags, const int nBlockMaxSize, const long long nContentEnd,
+                                                           XXH32_state_t *pContentChecksum, long long *pOriginalSize, long long *pCompressedSize, unsigned char *pNextHeaderData, int *pEndMarkFound) {
+   long long nOriginalSize = *pOriginalSize;
+   long long nCompressedSize = *pCompressedSize;
+   size_t nInMapOffset = *pInMapOffset;
+   const int nBlockChecksumSize = lz4ultra_get_block_checksum_size(nFlags);
+   const int nContentChecksumSize = lz4ultra_get_content_checksum_size(nFlags);
+   unsigned char cFrameData[16];
+   unsigned char *pInBlock = NULL;
+   unsigned char *pOutData = NULL;
+
+   /* Compressed blocks are used in place when the input is in memory, and blocks are decompressed in place into mapped output files */
+   if (!pInMap) {
+      pInBlock = (unsigned char*)malloc(nBlockMaxSize);
+      if (!pInBlock) {
+         return LZ4ULTRA_ERROR_MEMORY;
+      }
+   }
+
+   /* Blocks are decompressed one after the other into the output window, after the previous block, which is their history; history is only
+    * moved back to the front of the window when there is no room left for another block */
+   int nOutWindowSize = HISTORY_SIZE + ((nBlockMaxSize < MIN_STREAM_WINDOW_SIZE) ? (MIN_STREAM_WINDOW_SIZE / nBlockMaxSize) : 1) * nBlockMaxSize;
+   int nOutWindowPos = HISTORY_SIZE;
+
+   if (!pOutMap) {
+      pOutData = (unsigned char*)malloc(nOutWindowSize);
+      if (!pOutData) {
+         if (pInBlock) {
+            free(pInBlock);
+            pInBlock = NULL;
+         }
+
+         return LZ4ULTRA_ERROR_MEMORY;
+      }
+   }
+
+   int nDecompressionError = 0;
+   int nPrevDecompressedSize = 0;
+   int nNumBlocks = 0;
+   int nEndMarkFound = 0;
+
+   while ((pInMap ? (nInMapOffset < nInMapSize) : !pInStream->eof(pInStream)) && !nDecompressionError) {
+      unsigned int nBlockSize = 0;
+      int nIsUncompressed = 0;
+      int nMaxOutDataSize = nBlockMaxSize;
+
+      if (nContentEnd >= 0 && (nContentEnd - nOriginalSize) < (long long)nBlockMaxSize) {
+         /* Don't decompress past the stored decompressed size */
+         nMaxOutDataSize = (nContentEnd > nOriginalSize) ? (int)(nContentEnd - nOriginalSize) : 0;
+      }
+
+      if (pOutMap) {
+         /* Make room for one more block in the output file; history is simply the previously decompressed data */
+         if ((size_t)nOriginalSize + (size_t)nMaxOutDataSize > pOutMap->nSize) {
+            size_t nNewOutSize = pOutMap->nSize * 2;
+
+            if (nNewOutSize < (size_t)nOriginalSize + (size_t)nMaxOutDataSize)
+               nNewOutSize = (size_t)nOriginalSize + (size_t)nMaxOutDataSize;
+            if (lz4ultra_filemap_resize(pOutMap, nNewOutSize)) {
+               nDecompressionError = LZ4ULTRA_ERROR_DST;
+               break;
+            }
+         }
+      }
+      else if (nPrevDecompressedSize != 0) {
+         if ((nOutWindowPos + nBlockMaxSize) > nOutWindowSize) {
+            memmove(pOutData + HISTORY_SIZE - nPrevDecompressedSize, pOutData + nOutWindowPos - nPrevDecompressedSize, nPrevDecompressedSize);
+            nOutWindowPos = HISTORY_SIZE;
+         }
+      }
+      else {
+         /* Without history, start again at the front of the window */
+         nOutWindowPos = HISTORY_SIZE;
+
+         if (nDictionaryDataSize != 0) {
+            memcpy(pOutData + HISTORY_SIZE - nDictionaryDataSize, pDictionaryData, nDictionaryDataSize);
+            nPrevDecompressedSize = nDictionaryDataSize;
+
+            if (!(nFlags & LZ4ULTRA_FLAG_INDEP_BLOCKS))
+               nDictionaryDataSize = 0;
+         }
+      }
+
+      if ((nFlags & LZ4ULTRA_FLAG_RAW_BLOCK) == 0) {
+         memset(cFrameData, 0, 16);
+         if (lz4ultra_decompress_read(pInStream, pInMap, nInMapSize, &nInMapOffset, cFrameData, LZ4ULTRA_FRAME_SIZE) == LZ4ULTRA_FRAME_SIZE) {
+            int nSuccess = lz4ultra_decode_frame(cFrameData, LZ4ULTRA_FRAME_SIZE, &nBlockSize, &nIsUncompressed);
+            if (nSuccess < 0) {
+               nBlockSize = 0;
+            }
+            else if ((nFlags & LZ4ULTRA_FLAG_LEGACY_FRAMES) && (int)nBlockSize > nBlockMaxSize) {
+               /* Legacy frames have no end mark; a block size that is too large is the magic number of the next frame */
+               memcpy(pNextHeaderData, cFrameData, LZ4ULTRA_HEADER_SIZE);
+               nBlockSize = 0;
+               nEndMarkFound = 1;
+            }
+            else {
+               if (nBlockSize == 0)
+                  nEndMarkFound = 1;
+               nCompressedSize += (long long)LZ4ULTRA_FRAME_SIZE;
+            }
+         }
+         else {
+            nBlockSize = 0;
+         }
+      }
+      else {
+         if (!nNumBlocks)
+            nBlockSize = nBlockMaxSize;
+         else
+            nBlockSize = 0;
+      }
+
+      if (nBlockSize != 0) {
+         const unsigned char *pCurInBlock;
+         unsigned char *pCurOutData;
+         int nDecompressedSize = 0;
+
+         if ((int)nBlockSize > nBlockMaxSize) {
+            nDecompressionError = LZ4ULTRA_ERROR_FORMAT;
+            break;
+         }
+
+         size_t nReadBytes;
+         if (pInMap) {
+            nReadBytes = (nBlockSize > (nInMapSize - nInMapOffset)) ? (nInMapSize - nInMapOffset) : nBlockSize;
+            pCurInBlock = pInMap + nInMapOffset;
+            nInMapOffset += nReadBytes;
+         }
+         else {
+            nReadBytes = pInStream->read(pInStream, pInBlock, nBlockSize);
+            pCurInBlock = pInBlock;
+         }
+         if (nFlags & LZ4ULTRA_FLAG_RAW_BLOCK) {
+            if (nReadBytes > 2)
+               nReadBytes -= 2;
+            else
+               nReadBytes = 0;
+            nBlockSize = (unsigned int)nReadBytes;
+         }
+
+         /* Pointer to the previously decompressed bytes, followed by room for this block */
+         if (pOutMap)
+            pCurOutData = pOutMap->pData + (size_t)nOriginalSize - nPrevDecompressedSize;
+         else
+            pCurOutData = pOutData + nOutWindowPos - nPrevDecompressedSize;
+
+         if (nReadBytes == nBlockSize) {
+            nCompressedSize += (long long)nReadBytes;
+
+            if (nBlockChecksumSize) {
+               /* Check the block's data before decompressing it, while it is in cache */
+               if (lz4ultra_decompress_read(pInStream, pInMap, nInMapSize, &nInMapOffset, cFrameData, nBlockChecksumSize) != nBlockChecksumSize) {
+                  nDecompressionError = LZ4ULTRA_ERROR_SRC;
+                  break;
+               }
+               if (lz4ultra_decode_checksum(cFrameData, nBlockChecksumSize, XXH32(pCurInBlock, nBlockSize, 0)) != LZ4ULTRA_DECODE_OK) {
+                  nDecompressionError = LZ4ULTRA_ERROR_CHECKSUM;
+                  break;
+               }
+               nCompressedSize += (long long)nBlockChecksumSize;
+            }
+
+            if (nIsUncompressed) {
+               if ((int)nBlockSize > nMaxOutDataSize) {
+                  nDecompressionError = LZ4ULTRA_ERROR_DECOMPRESSION;
+                  break;
+               }
+               memcpy(pCurOutData + nPrevDecompressedSize, pCurInBlock, nBlockSize);
+               nDecompressedSize = nBlockSize;
+            }
+            else {
+               nDecompressedSize = lz4ultra_decompressor_expand_block(pCurInBlock, nBlockSize, pCurOutData, nPrevDecompressedSize, nMaxOutDataSize);
+               if (nDecompressedSize < 0) {
+                  nDecompressionError = LZ4ULTRA_ERROR_DECOMPRESSION;
+                  break;
+               }
+            }
+
+            if (nDecompressedSize != 0) {
+               nOriginalSize += (long long)nDecompressedSize;
+
+               if (nContentChecksumSize) {
+                  /* Update the content checksum with the block that was just decompressed */
+                  XXH32_update(pContentChecksum, pCurOutData + nPrevDecompressedSize, nDecompressedSize);
+               }
+
+               if (!pOutMap) {
+                  if (pOutStream->write(pOutStream, pCurOutData + nPrevDecompressedSize, nDecompressedSize) != nDecompressedSize)
+                     nDecompressionError = LZ4ULTRA_ERROR_DST;
+                  nOutWindowPos += nDecompressedSize;
+               }
+
+               if (!(nFlags & LZ4ULTRA_FLAG_INDEP_BLOCKS)) {
+                  /* Dependent blocks may reference up to HISTORY_SIZE bytes back, across several small blocks */
+                  nPrevDecompressedSize += nDecompressedSize;
+                  if (nPrevDecompressedSize > HISTORY_SIZE)
+                     nPrevDecompressedSize = HISTORY_SIZE;
+               }
+               else {
+                  nPrevDecompressedSize = 0;
+               }
+               nDecompressedSize = 0;
+            }
+         }
+         else {
+            break;
+         }
+
+         nNumBlocks++;
+      }
+      else {
+         break;
+      }
+   }
+
+   if (pOutData) {
+      free(pOutData);
+      pOutData = NULL;
+   }
+
+   if (pInBlock) {
+      free(pInBlock);
+      pInBlock = NULL;
+   }
+
+   *pOriginalSize = nOriginalSize;
+   *pCompressedSize = nCompressedSize;
+   *pInMapOffset = nInMapOffset;
+   *pEndMarkFound = nEndMarkFound;
+   return nDecompressionError;
+}
+
+/** One independent block, decompressed by a thread pool job */
+typedef struct {
+   const unsigned char *pInBlock;
+   unsigned int nBlockSize;
+   int nIsUncompressed;
+   unsigned char cBlockChecksum[LZ4ULTRA_CHECKSUM_SIZE];
+   unsigned char *pOutData;
+   int nDecompressedSize;
+   int nError;
+} lz4ultra_expand_stream_block;
+
+/** Blocks shared with the worker threads */
+typedef struct {
+   lz4ultra_expand_stream_block *pBlocks;
+   int nBlockMaxSize;
+   int nDictionaryDataSize;
+   unsigned int nFlags;
+} lz4ultra_expand_stream_jobs;
+
+/**
+ * Decompress one independent block, as a thread pool job
+ *
+ * @param pUserData blocks to decompress (lz4ultra_expand_stream_jobs)
+ * @param nThreadIndex index of the thread running the job
+ * @param nJobIndex index of the block to decompress
+ */
+static void lz4ultra_decompress_stream_block_job(void *pUserData, const int nThreadIndex, const int nJobIndex) {
+   lz4ultra_expand_stream_jobs *pJobs = (lz4ultra_expand_stream_jobs *)pUserData;
+   lz4ultra_expand_stream_block *pBlock = &pJobs->pBlocks[nJobIndex];
+   const int nBlockChecksumSize = lz4ultra_get_block_checksum_size(pJobs->nFlags);
+
+   pBlock->nDecompressedSize = 0;
+   pBlock->nError = 0;
+
+   if (nBlockChecksumSize) {
+      /* Check the block's data before decompressing it, while it is in cache */
+      if (lz4ultra_decode_checksum(pBlock->cBlockChecksum, nBlockChecksumSize, XXH32(pBlock->pInBlock, pBlock->nBlockSize, 0)) != LZ4ULTRA_DECODE_OK) {
+         pBlock->nError = LZ4ULTRA_ERROR_CHECKSUM;
+         return;
+      }
+   }
+
+   if (pBlock->nIsUncompressed) {
+      memcpy(pBlock->pOutData + pJobs->nDictionaryDataSize, pBlock->pInBlock, pBlock->nBlockSize);
+      pBlock->nDecompressedSize = pBlock->nBlockSize;
+   }
+   else {
+      pBlock->nDecompressedSize = lz4ultra_decompressor_expand_block(pBlock->pInBlock, pBlock->nBlockSize, pBlock->pOutData, pJobs->nDictionaryDataSize, pJobs->nBlockMaxSize);
+      if (pBlock->nDecompressedSize < 0)
+         pBlock->nError = LZ4ULTRA_ERROR_DECOMPRESSION;
+   }
+}
+
+/**
+ * Decompress independent blocks in parallel: read one block for each thread, decompress them all at once into separate output slots, and write them in order
+ *
+ * @param pInStream input(compressed) stream to decompress, when pInMap is NULL
+ * @param pInMap input(compressed) data to decompress, or NULL to read it from pInStream
+ * @param nInMapSize size of input data, when pInMap isn't NULL
+ * @param pInMapOffset pointer to the number of bytes of input data that were read, updated by this function when pInMap isn't NULL
+ * @param pOutStream output(decompressed) stream to write to, when pOutMap is NULL
+ * @param pOutMap file mapped for writing to decompress into, or NULL to write to pOutStream; not supported with a dictionary
+ * @param pDictionaryData dictionary contents, or NULL for none
+ * @param nDictionaryDataSize size of dictionary contents, or 0
+ * @param nFlags compression flags, as decoded from the header
+ * @param nBlockMaxSize maximum decompressed size of one block, in bytes
+ * @param nThreads number of threads to decompress blocks with
+ * @param pContentChecksum content checksum state, updated with the decompressed data when the frame has a content checksum
+ * @param pOriginalSize pointer to output(decompressed) size, updated by this function
+ * @param pCompressedSize pointer to input(compressed) size, updated by this function
+ * @param pEndMarkFound pointer to returned flag, set to 1 if the end mark was read, or 0 if not
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+static lz4ultra_status_t lz4ultra_decompress_parallel_blocks(lz4ultra_stream_t *pInStream, const unsigned char *pInMap, size_t nInMapSize, size_t *pInMapOffset, lz4ultra_stream_t *pOutStream, lz4ultra_filemap_t *pOutMap,
+                                                             const void *pDictionaryData, int nDictionaryDataSize, unsigned int nFlags, const int nBlockMaxSize, const int nThreads,
+                                                             XXH32_state_t *pContentChecksum, long long *pOriginalSize, long long *pCompressedSize, int *pEndMarkFound) {
+   long long nOriginalSize = *pOriginalSize;
+   long long nCompressedSize = *pCompressedSize;
+   size_t nInMapOffset = *pInMapOffset;
+   const int nBlockChecksumSize = lz4ultra_get_block_checksum_size(nFlags);
+   const int nContentChecksumSize = lz4ultra_get_content_checksum_size(nFlags);
+   const size_t nOutSlotSize = (size_t)nDictionaryDataSize + (size_t)nBlockMaxSize;
+   lz4ultra_expand_stream_block *pBlocks;
+   lz4ultra_expand_stream_jobs jobs;
+   lz4ultra_threadpool *pPool;
+   unsigned char cFrameData[16];
+   unsigned char *pInData = NULL;
+   unsigned char *pOutData = NULL;
+   int nDecompressionError = 0;
+   int nEndMarkFound = 0;
+   int nInputEnd = 0;
+   int i;
+
+   pBlocks = (lz4ultra_expand_stream_block *)malloc(nThreads * sizeof(lz4ultra_expand_stream_block));
+   if (!pBlocks) {
+      return LZ4ULTRA_ERROR_MEMORY;
+   }
+   memset(pBlocks, 0, nThreads * sizeof(lz4ultra_expand_stream_block));
+
+   /* Compressed blocks are used in place when the input is in memory, and blocks are decompressed in place into mapped output files */
+   if (!pInMap)
+      pInData = (unsigned char *)malloc((size_t)nThreads * (size_t)nBlockMaxSize);
+   if (!pOutMap)
+      pOutData = (unsigned char *)malloc((size_t)nThreads * nOutSlotSize);
+   pPool = lz4ultra_threadpool_create(nThreads);
+
+   if ((!pInMap && !pInData) || (!pOutMap && !pOutData) || !pPool) {
+      lz4ultra_threadpool_destroy(pPool);
+      if (pOutData)
+         free(pOutData);
+      if (pInData)
+         free(pInData);
+      free(pBlocks);
+      return LZ4ULTRA_ERROR_MEMORY;
+   }
+
+   if (pOutData && nDictionaryDataSize) {
+      /* Every block is preceded by the dictionary, which is copied in front of each output slot once */
+      for (i = 0; i < nThreads; i++)
+         memcpy(pOutData + (size_t)i * nOutSlotSize, pDictionaryData, nDictionaryDataSize);
+   }
+
+   jobs.pBlocks = pBlocks;
+   jobs.nBlockMaxSize = nBlockMaxSize;
+   jobs.nDictionaryDataSize = pOutData ? nDictionaryDataSize : 0;
+   jobs.nFlags = nFlags;
+
+   while (!nEndMarkFound && !nInputEnd && !nDecompressionError && (pInMap ? (nInMapOffset < nInMapSize) : !pInStream->eof(pInStream))) {
+      int nBatchBlocks = 0;
+
+      /* Read one block of compressed data for each thread */
+      while (nBatchBlocks < nThreads && (pInMap ? (nInMapOffset < nInMapSize) : !pInStream->eof(pInStream))) {
+         lz4ultra_expand_stream_block *pBlock = &pBlocks[nBatchBlocks];
+         unsigned int nBlockSize = 0;
+         int nIsUncompressed = 0;
+
+         memset(cFrameData, 0, 16);
+         if (lz4ultra_decompress_read(pInStream, pInMap, nInMapSize, &nInMapOffset, cFrameData, LZ4ULTRA_FRAME_SIZE) != LZ4ULTRA_FRAME_SIZE ||
+             lz4ultra_decode_frame(cFrameData, LZ4ULTRA_FRAME_SIZE, &nBlockSize, &nIsUncompressed) < 0) {
+            nInputEnd = 1;
+            break;
+         }
+         nCompressedSize += (long long)LZ4ULTRA_FRAME_SIZE;
+
+         if (nBlockSize == 0) {
+            nEndMarkFound = 1;
+            break;
+         }
+
+         if ((int)nBlockSize > nBlockMaxSize) {
+            nDecompressionError = LZ4ULTRA_ERROR_FORMAT;
+            break;
+         }
+
+         if (pInMap) {
+            if (nBlockSize > (nInMapSize - nInMapOffset)) {
+               nInputEnd = 1;
+               break;
+            }
+            pBlock->pInBlock = pInMap + nInMapOffset;
+            nInMapOffset += nBlockSize;
+         }
+         else {
+            unsigned char *pCurInBlock = pInData + (size_t)nBatchBlocks * (size_t)nBlockMaxSize;
+
+            if (pInStream->read(pInStream, pCurInBlock, nBlockSize) != nBlockSize) {
+               nInputEnd = 1;
+               break;
+            }
+            pBlock->pInBlock = pCurInBlock;
+         }
+         nCompressedSize += (long long)nBlockSize;
+
+         if (nBlockChecksumSize) {
+            if (lz4ultra_decompress_read(pInStream, pInMap, nInMapSize, &nInMapOffset, pBlock->cBlockChecksum, nBlockChecksumSize) != nBlockChecksumSize) {
+               nDecompressionError = LZ4ULTRA_ERROR_SRC;
+               break;
+            }
+            nCompressedSize += (long long)nBlockChecksumSize;
+         }
+
+         pBlock->nBlockSize = nBlockSize;
+         pBlock->nIsUncompressed = nIsUncompressed;
+         nBatchBlocks++;
+      }
+
+      if (nDecompressionError || !nBatchBlocks)
+         break;
+
+      if (pOutMap) {
+         /* Make room for one full block per thread in the output file, after the previously decompressed data */
+         size_t nNeededOutSize = (size_t)nOriginalSize + (size_t)nBatchBlocks * (size_t)nBlockMaxSize;
+
+         if (nNeededOutSize > pOutMap->nSize) {
+            size_t nNewOutSize = pOutMap->nSize * 2;
+
+            if (nNewOutSize < nNeededOutSize)
+               nNewOutSize = nNeededOutSize;
+            if (lz4ultra_filemap_resize(pOutMap, nNewOutSize)) {
+               nDecompressionError = LZ4ULTRA_ERROR_DST;
+               break;
+            }
+         }
+      }
+
+      for (i = 0; i < nBatchBlocks; i++) {
+         if (pOutMap)
+            pBlocks[i].pOutData = pOutMap->pData + (size_t)nOriginalSize + (size_t)i * (size_t)nBlockMaxSize;
+         else
+            pBlocks[i].pOutData = pOutData + (size_t)i * nOutSlotSize;
+      }
+
+      /* Decompress all the blocks that were read, in parallel */
+      lz4ultra_threadpool_run(pPool, lz4ultra_decompress_stream_block_job, &jobs, nBatchBlocks);
+
+      /* Write decompressed blocks, in order */
+      for (i = 0; i < nBatchBlocks && !nDecompressionError; i++) {
+         lz4ultra_expand_stream_block *pBlock = &pBlocks[i];
+         const int nDecompressedSize = pBlock->nDecompressedSize;
+         unsigned char *pDecompressedData = pBlock->pOutData + jobs.nDictionaryDataSize;
+
+         if (pBlock->nError) {
+            nDecompressionError = pBlock->nError;
+            break;
+         }
+
+         if (pOutMap) {
+            /* Blocks are decompressed one maximum block size apart; close the gap after blocks that are shorter than that */
+            unsigned char *pCurOutData = pOutMap->pData + (size_t)nOriginalSize;
+
+            if (pCurOutData != pDecompressedData)
+               memmove(pCurOutData, pDecompressedData, nDecompressedSize);
+            pDecompressedData = pCurOutData;
+         }
+
+         if (nContentChecksumSize) {
+            /* Update the content checksum with the decompressed blocks, in order */
+            XXH32_update(pContentChecksum, pDecompressedData, nDecompressedSize);
+         }
+
+         if (!pOutMap) {
+            if (pOutStream->write(pOutStream, pDecompressedData, nDecompressedSize) != nDecompressedSize)
+               nDecompressionError = LZ4ULTRA_ERROR_DST;
+         }
+
+         nOriginalSize += (long long)nDecompressedSize;
+      }
+   }
+
+   lz4ultra_threadpool_destroy(pPool);
+   if (pOutData)
+      free(pOutData);
+   if (pInData)
+      free(pInData);
+   free(pBlocks);
+
+   *pOriginalSize = nOriginalSize;
+   *pCompressedSize = nCompressedSize;
+   *pInMapOffset = nInMapOffset;
+   *pEndMarkFound = nEndMarkFound;
+   return nDecompressionError;
+}
+
+/**
+ * Skip the data of a skippable frame
+ *
+ * @param pInStream input(compressed) stream, when pInMap is NULL
+ * @param pInMap input(compressed) data, or NULL to read from pInStream
+ * @param nInMapSize size of input data, when pInMap isn't NULL
+ * @param pInMapOffset pointer to the number of bytes of input data that were read, updated by this function when pInMap isn't NULL
+ * @param nSkipSize number of bytes to skip
+ *
+ * @return LZ4ULTRA_OK for success, or LZ4ULTRA_ERROR_SRC if the input ends first
+ */
+static lz4ultra_status_t lz4ultra_decompress_skip(lz4ultra_stream_t *pInStream, const unsigned char *pInMap, size_t nInMapSize, size_t *pInMapOffset, unsigned int nSkipSize) {
+   if (pInMap) {
+      if ((size_t)nSkipSize > (nInMapSize - *pInMapOffset))
+         return LZ4ULTRA_ERROR_SRC;
+      *pInMapOffset += nSkipSize;
+   }
+   else {
+      unsigned char cSkipData[1024];
+
+      while (nSkipSize) {
+         size_t nSkipChunkSize = (nSkipSize < sizeof(cSkipData)) ? nSkipSize : sizeof(cSkipData);
+
+         if (pInStream->read(pInStream, cSkipData, nSkipChunkSize) != nSkipChunkSize)
+            return LZ4ULTRA_ERROR_SRC;
+         nSkipSize -= (unsigned int)nSkipChunkSize;
+      }
+   }
+
+   return LZ4ULTRA_OK;
+}
+
+/**
+ * Decompress the blocks of one frame, after its header, followed by the frame's content checksum
+ *
+ * @param pInStream input(compressed) stream to decompress, when pInMap is NULL
+ * @param pInMap input(compressed) data to decompress, or NULL to read it from pInStream
+ * @param nInMapSize size of input data, when pInMap isn't NULL
+ * @param pInMapOffset pointer to the number of bytes of input data that were read, updated by this function when pInMap isn't NULL
+ * @param pOutStream output(decompressed) stream to write to, when pOutMap is NULL
+ * @param pOutMap file mapped for writing to decompress into, or NULL to write to pOutStream; not supported with a dictionary
+ * @param pDictionaryData dictionary contents, or NULL for none
+ * @param nDictionaryDataSize size of dictionary contents, or 0
+ * @param nFlags compression flags, as decoded from the header
+ * @param nBlockMaxCode max block size code (4-7), as decoded from the header
+ * @param nContentSize decompressed size stored in the header, or -1 if unknown
+ * @param nThreads number of threads to decompress independent blocks with (1 for single-threaded decompression)
+ * @param pOriginalSize pointer to output(decompressed) size, updated by this function
+ * @param pCompressedSize pointer to input(compressed) size, updated by this function
+ * @param pNextHeaderData buffer of LZ4ULTRA_HEADER_SIZE bytes, that receives the magic number of the next frame when a legacy frame is followed by another frame
+ * @param pEndMarkFound pointer to returned flag, set to 1 if the frame ended, so that another frame may follow, or 0 if the input ended first
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+static lz4ultra_status_t lz4ultra_decompress_frame(lz4ultra_stream_t *pInStream, const unsigned char *pInMap, size_t nInMapSize, size_t *pInMapOffset, lz4ultra_stream_t *pOutStream, lz4ultra_filemap_t *pOutMap,
+                                                   const void *pDictionaryData, int nDictionaryDataSize, unsigned int nFlags, const int nBlockMaxCode, const long long nContentSize, int nThreads,
+                                                   long long *pOriginalSize, long long *pCompressedSize, unsigned char *pNextHeaderData, int *pEndMarkFound) {
+   const long long nFrameStart = *pOriginalSize;
+   const int nContentChecksumSize = lz4ultra_get_content_checksum_size(nFlags);
+   long long nContentEnd = -1LL;
+   unsigned char cFrameData[16];
+   XXH32_state_t contentChecksum;
+
+   XXH32_reset(&contentChecksum, 0);
+   *pEndMarkFound = 0;
+
+   int nBlockMaxBits;
+   if (nFlags & LZ4ULTRA_FLAG_LEGACY_FRAMES)
+      nBlockMaxBits = 23;
+   else
+      nBlockMaxBits = 8 + (nBlockMaxCode << 1);
+   int nBlockMaxSize = 1 << nBlockMaxBits;
+
+   if (nContentSize >= 0) {
+      if (nContentSize > (LLONG_MAX - nFrameStart))
+         return LZ4ULTRA_ERROR_FORMAT;
+      nContentEnd = nFrameStart + nContentSize;
+
+      if (pOutMap && (size_t)nContentEnd > pOutMap->nSize) {
+         /* The header stores the decompressed size, allocate the whole frame in the output file upfront */
+         if ((unsigned long long)(size_t)nContentEnd != (unsigned long long)nContentEnd || lz4ultra_filemap_resize(pOutMap, (size_t)nContentEnd)) {
+            return LZ4ULTRA_ERROR_DST;
+         }
+      }
+   }
+
+   int nDecompressionError;
+   int nEndMarkFound = 0;
+
+   if (nThreads > 1 && (nFlags & (LZ4ULTRA_FLAG_INDEP_BLOCKS | LZ4ULTRA_FLAG_RAW_BLOCK)) == LZ4ULTRA_FLAG_INDEP_BLOCKS) {
+      nDecompressionError = lz4ultra_decompress_parallel_blocks(pInStream, pInMap, nInMapSize, pInMapOffset, pOutStream, pOutMap, pDictionaryData, nDictionaryDataSize, nFlags, nBlockMaxSize,
+         nThreads, &contentChecksum, pOriginalSize, pCompressedSize, &nEndMarkFound);
+   }
+   else {
+      nDecompressionError = lz4ultra_decompress_serial_blocks(pInStream, pInMap, nInMapSize, pInMapOffset, pOutStream, pOutMap, pDictionaryData, nDictionaryDataSize, nFlags, nBlockMaxSize,
+         nContentEnd, &contentChecksum, pOriginalSize, pCompressedSize, pNextHeaderData, &nEndMarkFound);
+   }
+
+   if (!nDecompressionError && nContentEnd >= 0 && *pOriginalSize != nContentEnd)
+      nDecompressionError = LZ4ULTRA_ERROR_DECOMPRESSION;
+
+   if (!nDecompressionError && nEndMarkFound && nContentChecksumSize) {
+      if (lz4ultra_decompress_read(pInStream, pInMap, nInMapSize, pInMapOffset, cFrameData, nContentChecksumSize) != nContentChecksumSize)
+         nDecompressionError = LZ4ULTRA_ERROR_SRC;
+      else if (lz4ultra_decode_checksum(cFrameData, nContentChecksumSize, XXH32_digest(&contentChecksum)) != LZ4ULTRA_DECODE_OK)
+         nDecompressionError = LZ4ULTRA_ERROR_CHECKSUM;
+      else
+         *pCompressedSize += (long long)nContentChecksumSize;
+   }
+
+   *pEndMarkFound = nEndMarkFound;
+   return nDecompressionError;
+}
+
+/**
+ * Decompress a raw block table, read from a stream or from memory, to a stream or to a memory-mapped file. The whole table is decompressed in
+ * memory, its blocks in parallel when several threads are requested
+ *
+ * @param pInStream input(compressed) stream to decompress, when pInMap is NULL
+ * @param pInMap input(compressed) data to decompress, or NULL to read it from pInStream
+ * @param nInMapSize size of input data, when pInMap isn't NULL
+ * @param pOutStream output(decompressed) stream to write to, when pOutMap is NULL
+ * @param pOutMap file mapped for writing to decompress into, or NULL to write to pOutStream
+ * @param nThreads number of threads to decompress blocks with (1 for single-threaded decompression)
+ * @param pOriginalSize pointer to returned output(decompressed) size, updated when this function is successful
+ * @param pCompressedSize pointer to returned input(compressed) size, updated when this function is successful
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+static lz4ultra_status_t lz4ultra_decompress_raw_table(lz4ultra_stream_t *pInStream, const unsigned char *pInMap, size_t nInMapSize, lz4ultra_stream_t *pOutStream, lz4ultra_filemap_t *pOutMap,
+                                                       int nThreads, long long *pOriginalSize, long long *pCompressedSize) {
+   unsigned char *pInData = NULL;
+   unsigned char *pOutData = NULL;
+   size_t nInDataSize, nOutDataSize;
+   lz4ultra_status_t nStatus = LZ4ULTRA_OK;
+
+   if (pInMap) {
+      nInDataSize = nInMapSize;
+   }
+   else {
+      if (lz4ultra_stream_read_all(pInStream, NULL, &pInData, &nInDataSize))
+         return LZ4ULTRA_ERROR_MEMORY;
+      pInMap = pInData;
+   }
+
+   if (lz4ultra_decompressor_get_raw_table_info(pInMap, nInDataSize, &nOutDataSize) < 0) {
+      free(pInData);
+      return LZ4ULTRA_ERROR_FORMAT;
+   }
+
+   /* Decompress straight into the output mapping, sized for the table, or into a buffer that is then written */
+   if (pOutMap) {
+      if (lz4ultra_filemap_resize(pOutMap, nOutDataSize))
+         nStatus = LZ4ULTRA_ERROR_DST;
+      else
+         pOutData = pOutMap->pData;
+   }
+   else if (nOutDataSize) {
+      pOutData = (unsigned char *)malloc(nOutDataSize);
+      if (!pOutData)
+         nStatus = LZ4ULTRA_ERROR_MEMORY;
+   }
+
+   if (!nStatus && lz4ultra_decompress_inmem(pInMap, pOutData, nInDataSize, nOutDataSize, LZ4ULTRA_FLAG_RAW_TABLE, nThreads) != nOutDataSize)
+      nStatus = LZ4ULTRA_ERROR_DECOMPRESSION;
+
+   if (!nStatus && !pOutMap) {
+      if (pOutStream->write(pOutStream, pOutData, nOutDataSize) != nOutDataSize)
+         nStatus = LZ4ULTRA_ERROR_DST;
+   }
+
+   if (!pOutMap)
+      free(pOutData);
+   free(pInData);
+
+   if (nStatus == LZ4ULTRA_OK) {
+      *pOriginalSize = (long long)nOutDataSize;
+      *pCompressedSize = (long long)nInDataSize;
+   }
+   return nStatus;
+}
+
+/**
+ * Decompress input data, read from a stream or from memory, to a stream or to a memory-mapped file. The input can hold several concatenated
+ * frames, which are decompressed one after the other; skippable frames, such as the seek table, are skipped.
+ *
+ * @param pInStream input(compressed) stream to decompress, when pInMap is NULL
+ * @param pInMap input(compressed) data to decompress, or NULL to read it from pInStream
+ * @param nInMapSize size of input data, when pInMap isn't NULL
+ * @param pOutStream output(decompressed) stream to write to, when pOutMap is NULL
+ * @param pOutMap file mapped for writing to decompress into, or NULL to write to pOutStream; not supported with a dictionary
+ * @param pDictionaryData dictionary contents, or NULL for none
+ * @param nDictionaryDataSize size of dictionary contents, or 0
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_RAW_BLOCK to decompress a raw block, LZ4ULTRA_FLAG_RAW_TABLE to decompress a raw block table, LZ4ULTRA_FLAG_ASYNC_IO to read ahead and write behind on background threads, or 0)
+ * @param nThreads number of threads to decompress independent blocks with (1 for single-threaded decompression)
+ * @param pOriginalSize pointer to returned output(decompressed) size, updated when this function is successful
+ * @param pCompressedSize pointer to returned input(compressed) size, updated when this function is successful
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+static lz4ultra_status_t lz4ultra_decompress_blocks(lz4ultra_stream_t *pInStream, const unsigned char *pInMap, size_t nInMapSize, lz4ultra_stream_t *pOutStream, lz4ultra_filemap_t *pOutMap,
+                                                    const void *pDictionaryData, int nDictionaryDataSize, unsigned int nFlags, int nThreads, long long *pOriginalSize, long long *pCompressedSize) {
+   long long nOriginalSize = 0LL;
+   long long nCompressedSize = 0LL;
+   size_t nInMapOffset = 0;
+   unsigned char cFrameData[16];
+   int nDecompressionError = 0;
+   int nEndMarkFound = 0;
+
+   if (nFlags & LZ4ULTRA_FLAG_RAW_TABLE) {
+      /* A raw block table is self-contained, its blocks don't refer to a dictionary */
+      if (pDictionaryData)
+         return LZ4ULTRA_ERROR_DICTIONARY;
+      return lz4ultra_decompress_raw_table(pInStream, pInMap, nInMapSize, pOutStream, pOutMap, nThreads, pOriginalSize, pCompressedSize);
+   }
+
+   if ((nFlags & LZ4ULTRA_FLAG_RAW_BLOCK) == 0) {
+      memset(cFrameData, 0, 16);
+
+      if (lz4ultra_decompress_read(pInStream, pInMap, nInMapSize, &nInMapOffset, cFrameData, LZ4ULTRA_HEADER_SIZE) != LZ4ULTRA_HEADER_SIZE) {
+         return LZ4ULTRA_ERROR_SRC;
+      }
+
+      while (!nDecompressionError) {
+         int nHeaderSize = LZ4ULTRA_HEADER_SIZE;
+         int nExtraHeaderSize;
+         unsigned int nSkipSize = 0;
+
+         while ((nExtraHeaderSize = lz4ultra_check_header(cFrameData, nHeaderSize)) > 0) {
+            if (lz4ultra_decompress_read(pInStream, pInMap, nInMapSize, &nInMapOffset, cFrameData + nHeaderSize, nExtraHeaderSize) != nExtraHeaderSize) {
+               nDecompressionError = LZ4ULTRA_ERROR_SRC;
+               break;
+            }
+            nHeaderSize += nExtraHeaderSize;
+         }
+         if (nDecompressionError)
+            break;
+         if (nExtraHeaderSize < 0) {
+            nDecompressionError = LZ4ULTRA_ERROR_FORMAT;
+            break;
+         }
+
+         if (lz4ultra_decode_skippable_header(cFrameData, nHeaderSize, &nSkipSize) == LZ4ULTRA_DECODE_OK) {
+            /* Skippable frames hold no compressed data. The deduplication index that starts deduplicated data is only skipped when the caller
+             * restores the ranges that it lists */
+            if (lz4ultra_is_dedup_header(cFrameData, nHeaderSize) && ((nFlags & LZ4ULTRA_FLAG_DEDUP) == 0 || nCompressedSize != 0)) {
+               nDecompressionError = LZ4ULTRA_ERROR_DEDUP;
+               break;
+            }
+            nDecompressionError = lz4ultra_decompress_skip(pInStream, pInMap, nInMapSize, &nInMapOffset, nSkipSize);
+            if (nDecompressionError)
+               break;
+            nCompressedSize += (long long)nHeaderSize + (long long)nSkipSize;
+         }
+         else {
+            int nBlockMaxCode = 7;
+            unsigned int nFrameFlags = 0;
+            long long nContentSize = -1LL;
+
+            int nSuccess = lz4ultra_decode_header(cFrameData, nHeaderSize, &nBlockMaxCode, &nFrameFlags, &nContentSize);
+            if (nSuccess < 0) {
+               if (nSuccess == LZ4ULTRA_DECODE_ERR_SUM)
+                  nDecompressionError = LZ4ULTRA_ERROR_CHECKSUM;
+               else
+                  nDecompressionError = LZ4ULTRA_ERROR_FORMAT;
+               break;
+            }
+
+            nCompressedSize += (long long)nHeaderSize;
+
+            /* The header of a deduplicated frame stores the size of the original data, that the frame is without the repeated ranges of. The
+             * deduplication writer checks that size, once the ranges are restored */
+            if (nFlags & LZ4ULTRA_FLAG_DEDUP)
+               nContentSize = -1LL;
+
+            nDecompressionError = lz4ultra_decompress_frame(pInStream, pInMap, nInMapSize, &nInMapOffset, pOutStream, pOutMap, pDictionaryData, nDictionaryDataSize,
+               nFrameFlags, nBlockMaxCode, nContentSize, nThreads, &nOriginalSize, &nCompressedSize, cFrameData, &nEndMarkFound);
+            if (nDecompressionError || !nEndMarkFound)
+               break;
+
+            /* A legacy frame ends with the magic number of the next frame, which has already been read */
+            if (nFrameFlags & LZ4ULTRA_FLAG_LEGACY_FRAMES)
+               continue;
+         }
+
+         /* Read the magic number of the next frame, if there is one */
+         size_t nReadBytes = lz4ultra_decompress_read(pInStream, pInMap, nInMapSize, &nInMapOffset, cFrameData, LZ4ULTRA_HEADER_SIZE);
+         if (nReadBytes == 0)
+            break;
+         if (nReadBytes != LZ4ULTRA_HEADER_SIZE)
+            nDecompressionError = LZ4ULTRA_ERROR_SRC;
+      }
+   }
+   else {
+      nFlags &= ~(LZ4ULTRA_FLAG_BLOCK_CHECKSUM | LZ4ULTRA_FLAG_CONTENT_CHECKSUM);
+      nDecompressionError = lz4ultra_decompress_frame(pInStream, pInMap, nInMapSize, &nInMapOffset, pOutStream, pOutMap, pDictionaryData, nDictionaryDataSize,
+         nFlags, 7, -1LL, nThreads, &nOriginalSize, &nCompressedSize, cFrameData, &nEndMarkFound);
+   }
+
+   if (pOutMap) {
+      /* Trim the output file to the decompressed size */
+      if (lz4ultra_filemap_resize(pOutMap, (size_t)nOriginalSize) && !nDecompressionError)
+         nDecompressionError = LZ4ULTRA_ERROR_DST;
+   }
+
+   *pOriginalSize = nOriginalSize;
+   *pCompressedSize = nCompressedSize;
+   return nDecompressionError;
+}
+
+/**
+ * Decompress stream
+ *
+ * @param pInStream input(compressed) stream to decompress
+ * @param pOutStream output(decompressed) stream to write to
+ * @param pDictionaryData dictionary contents, or NULL for none
+ * @param nDictionaryDataSize size of dictionary contents, or 0
+ * @param pOriginalSize pointer to returned output(decompressed) size, updated when this function is successful
+ * @param pCompressedSize pointer to returned input(compressed) size, updated when this function is successful
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+lz4ultra_status_t lz4ultra_decompress_stream(lz4ultra_stream_t *pInStream, lz4ultra_stream_t *pOutStream, const void *pDictionaryData, int nDictionaryDataSize, unsigned int nFlags, int nThreads,
+                                             long long *pOriginalSize, long long *pCompressedSize) {
+   lz4ultra_stream_t asyncInStream, asyncOutStream;
+   lz4ultra_status_t nStatus;
+
+   if ((nFlags & LZ4ULTRA_FLAG_ASYNC_IO) == 0)
+      return lz4ultra_decompress_blocks(pInStream, NULL, 0, pOutStream, NULL, pDictionaryData, nDictionaryDataSize, nFlags, nThreads, pOriginalSize, pCompressedSize);
+
+   /* Read the next compressed blocks ahead and write the previously decompressed ones behind, while the current block decompresses */
+   if (lz4ultra_asyncstream_open(&asyncInStream, pInStream, 0, MIN_STREAM_WINDOW_SIZE))
+      return LZ4ULTRA_ERROR_MEMORY;
+   if (lz4ultra_asyncstream_open(&asyncOutStream, pOutStream, 1, MIN_STREAM_WINDOW_SIZE)) {
+      lz4ultra_asyncstream_finish(&asyncInStream);
+      return LZ4ULTRA_ERROR_MEMORY;
+   }
+
+   nStatus = lz4ultra_decompress_blocks(&asyncInStream, NULL, 0, &asyncOutStream, NULL, pDictionaryData, nDictionaryDataSize, nFlags, nThreads, pOriginalSize, pCompressedSize);
+
+   if (lz4ultra_asyncstream_finish(&asyncOutStream) && nStatus == LZ4ULTRA_OK)
+      nStatus = LZ4ULTRA_ERROR_DST;
+   lz4ultra_asyncstream_finish(&asyncInStream);
+   return nStatus;
+}
+
+/*-------------- Push API -------------- */
+
+/** Part of a frame that a decompression stream expects next */
+typedef enum {
+   LZ4ULTRA_DSTREAM_HEADER = 0,           /**< magic number and header of the next frame */
+   LZ4ULTRA_DSTREAM_SKIP,                 /**< data of a skippable frame */
+   LZ4ULTRA_DSTREAM_FRAME,                /**< size of the next block, or end mark */
+   LZ4ULTRA_DSTREAM_BLOCK,                /**< data of the current block, followed by its checksum if the frame has block checksums */
+   LZ4ULTRA_DSTREAM_CONTENT_CHECKSUM,     /**< content checksum, after the end mark */
+} lz4ultra_dstream_state;
+
+/** Decompression stream */
+struct _lz4ultra_dstream {
+   const unsigned char *pDictionaryData;  /**< dictionary contents, or NULL for none */
+   int nDictionaryDataSize;               /**< size of dictionary contents, or 0 */
+   lz4ultra_dstream_state nState;         /**< part of the frame that is expected next */
+   lz4ultra_status_t nError;              /**< first error that occurred, reported by all the following calls */
+   unsigned char cFrameData[16];          /**< header, block frame or checksum gathered so far */
+   int nFrameDataSize;                    /**< number of bytes in cFrameData */
+   int nHeaderSize;                       /**< number of header bytes to gather into cFrameData before checking them again */
+   unsigned int nFlags;                   /**< compression flags of the current frame, as decoded from its header */
+   int nBlockMaxSize;                     /**< maximum decompressed size of one block of the current frame, in bytes */
+   long long nContentSize;                /**< decompressed size of the current frame stored in its header, or -1 if unknown */
+   long long nFrameSize;                  /**< number of bytes decompressed so far in the current frame */
+   XXH32_state_t contentChecksum;         /**< checksum of the data decompressed in the current frame, when it has a content checksum */
+   unsigned int nSkipSize;                /**< number of bytes of the skippable frame that are left to skip */
+   unsigned int nBlockSize;               /**< size of the current block's data in the input, in bytes */
+   int nIsUncompressed;                   /**< 1 if the current block is stored uncompressed, 0 if not */
+   unsigned char *pInBlock;               /**< current block's data and checksum, when it arrives in several pieces */
+   int nInBlockSize;                      /**< number of bytes in pInBlock */
+   int nInBlockAllocSize;                 /**< size of the pInBlock buffer, in bytes */
+   unsigned char *pOutData;               /**< output window: history, then the decompressed blocks */
+   int nOutWindowSize;                    /**< size of the output window, in bytes */
+   int nOutWindowPos;                     /**< offset in the output window where the next block is decompressed */
+   int nPrevDecompressedSize;             /**< number of bytes of history in front of nOutWindowPos */
+   int nFrameDictionarySize;              /**< size of the dictionary to place in front of the next block, that it references, or 0 */
+   int nPendingSize;                      /**< number of decompressed bytes in front of nOutWindowPos that the caller didn't receive yet */
+   long long nOriginalSize;               /**< number of output(decompressed) bytes returned so far */
+   long long nCompressedSize;             /**< number of input(compressed) bytes consumed so far */
+   lz4ultra_allocator allocator;          /**< allocator of the stream and of its buffers */
+};
+
+/**
+ * Create a decompression stream, that compressed data is pushed into as it arrives, in pieces of any size, with lz4ultra_dstream_decompress().
+ * The input can hold several concatenated frames; skippable frames, such as the seek table, are skipped. Raw blocks and raw block tables aren't supported
+ *
+ * @param pDictionaryData dictionary contents, that must stay valid until the stream is ended, or NULL for none
+ * @param nDictionaryDataSize size of dictionary contents (up to HISTORY_SIZE), or 0
+ * @param pAllocator allocator of the stream and of its buffers, that is copied, or NULL to use malloc()
+ *
+ * @return decompression stream, or NULL for failure
+ */
+lz4ultra_dstream *lz4ultra_dstream_create(const void *pDictionaryData, int nDictionaryDataSize, const lz4ultra_allocator *pAllocator) {
+   lz4ultra_dstream *pStream;
+
+   if (nDictionaryDataSize < 0 || nDictionaryDataSize > HISTORY_SIZE || (nDictionaryDataSize && !pDictionaryData))
+      return NULL;
+
+   if (pAllocator && pAllocator->alloc_mem && !pAllocator->free_mem)
+      return NULL;
+
+   pStream = (lz4ultra_dstream *)lz4ultra_alloc(pAllocator, sizeof(lz4ultra_dstream));
+   if (!pStream)
+      return NULL;
+   memset(pStream, 0, sizeof(lz4ultra_dstream));
+
+   if (pAllocator)
+      pStream->allocator = *pAllocator;
+
+   pStream->pDictionaryData = (const unsigned char *)pDictionaryData;
+   pStream->nDictionaryDataSize = pDictionaryData ? nDictionaryDataSize : 0;
+   pStream->nState = LZ4ULTRA_DSTREAM_HEADER;
+   pStream->nHeaderSize = LZ4ULTRA_HEADER_SIZE;
+   pStream->nError = LZ4ULTRA_OK;
+   return pStream;
+}
+
+/**
+ * Gather bytes of a header, block frame or checksum, that may arrive in several pieces, into a decompression stream
+ *
+ * @param pStream decompression stream
+ * @param ppInData pointer to the input data, advanced past the consumed bytes by this function
+ * @param pInDataSize pointer to the number of bytes of input data, decreased by the number of consumed bytes by this function
+ * @param nSize number of bytes that must be gathered in total
+ *
+ * @return 1 if all the bytes were gathered, 0 if more input data is needed
+ */
+static int lz4ultra_dstream_gather(lz4ultra_dstream *pStream, const unsigned char **ppInData, size_t *pInDataSize, const int nSize) {
+   size_t nCopySize = (size_t)(nSize - pStream->nFrameDataSize);
+
+   if (nCopySize > *pInDataSize)
+      nCopySize = *pInDataSize;
+   memcpy(pStream->cFrameData + pStream->nFrameDataSize, *ppInData, nCopySize);
+   pStream->nFrameDataSize += (int)nCopySize;
+   *ppInData += nCopySize;
+   *pInDataSize -= nCopySize;
+
+   return (pStream->nFrameDataSize == nSize) ? 1 : 0;
+}
+
+/**
+ * Start decompressing a frame, once its header was decoded: size the buffers for its blocks and reset its history
+ *
+ * @param pStream decompression stream
+ * @param nFlags compression flags, as decoded from the header
+ * @param nBlockMaxCode max block size code (4-7), as decoded from the header
+ * @param nContentSize decompressed size stored in the header, or -1 if unknown
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+static lz4ultra_status_t lz4ultra_dstream_start_frame(lz4ultra_dstream *pStream, const unsigned int nFlags, const int nBlockMaxCode, const long long nContentSize) {
+   int nBlockMaxBits;
+   if (nFlags & LZ4ULTRA_FLAG_LEGACY_FRAMES)
+      nBlockMaxBits = 23;
+   else
+      nBlockMaxBits = 8 + (nBlockMaxCode << 1);
+   const int nBlockMaxSize = 1 << nBlockMaxBits;
+   const int nOutWindowSize = HISTORY_SIZE + ((nBlockMaxSize < MIN_STREAM_WINDOW_SIZE) ? (MIN_STREAM_WINDOW_SIZE / nBlockMaxSize) : 1) * nBlockMaxSize;
+
+   /* Buffers are kept from one frame to the next, and only grow when a frame has larger blocks */
+   if (pStream->nInBlockAllocSize < nBlockMaxSize + LZ4ULTRA_CHECKSUM_SIZE) {
+      if (pStream->pInBlock)
+         lz4ultra_free(&pStream->allocator, pStream->pInBlock);
+      pStream->pInBlock = (unsigned char *)lz4ultra_alloc(&pStream->allocator, nBlockMaxSize + LZ4ULTRA_CHECKSUM_SIZE);
+      pStream->nInBlockAllocSize = pStream->pInBlock ? (nBlockMaxSize + LZ4ULTRA_CHECKSUM_SIZE) : 0;
+      if (!pStream->pInBlock)
+         return LZ4ULTRA_ERROR_MEMORY;
+   }
+   if (pStream->nOutWindowSize < nOutWindowSize) {
+      if (pStream->pOutData)
+         lz4ultra_free(&pStream->allocator, pStream->pOutData);
+      pStream->pOutData = (unsigned char *)lz4ultra_alloc(&pStream->allocator, nOutWindowSize);
+      pStream->nOutWindowSize = pStream->pOutData ? nOutWindowSize : 0;
+      if (!pStream->pOutData)
+         return LZ4ULTRA_ERROR_MEMORY;
+   }
+
+   pStream->nFlags = nFlags;
+   pStream->nBlockMaxSize = nBlockMaxSize;
+   pStream->nContentSize = nContentSize;
+   pStream->nFrameSize = 0LL;
+   XXH32_reset(&pStream->contentChecksum, 0);
+   pStream->nOutWindowPos = HISTORY_SIZE;
+   pStream->nPrevDecompressedSize = 0;
+   pStream->nFrameDictionarySize = pStream->nDictionaryDataSize;
+   return LZ4ULTRA_OK;
+}
+
+/**
+ * Check and decompress the current block of a decompression stream, into its output window, after the history
+ *
+ * @param pStream decompression stream
+ * @param pInBlock block's data, followed by its checksum if the frame has block checksums
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+static lz4ultra_status_t lz4ultra_dstream_expand_block(lz4ultra_dstream *pStream, const unsigned char *pInBlock) {
+   const int nBlockChecksumSize = lz4ultra_get_block_checksum_size(pStream->nFlags);
+   const int nBlockSize = (int)pStream->nBlockSize;
+   int nMaxOutDataSize = pStream->nBlockMaxSize;
+   int nDecompressedSize;
+
+   if (nBlockChecksumSize) {
+      if (lz4ultra_decode_checksum(pInBlock + nBlockSize, nBlockChecksumSize, XXH32(pInBlock, nBlockSize, 0)) != LZ4ULTRA_DECODE_OK)
+         return LZ4ULTRA_ERROR_CHECKSUM;
+   }
+
+   if (pStream->nContentSize >= 0 && (pStream->nContentSize - pStream->nFrameSize) < (long long)nMaxOutDataSize) {
+      /* Don't decompress past the stored decompressed size */
+      nMaxOutDataSize = (int)(pStream->nContentSize - pStream->nFrameSize);
+   }
+
+   if (pStream->nPrevDecompressedSize != 0) {
+      if ((pStream->nOutWindowPos + pStream->nBlockMaxSize) > pStream->nOutWindowSize) {
+         memmove(pStream->pOutData + HISTORY_SIZE - pStream->nPrevDecompressedSize, pStream->pOutData + pStream->nOutWindowPos - pStream->nPrevDecompressedSize, pStream->nPrevDecompressedSize);
+         pStream->nOutWindowPos = HISTORY_SIZE;
+      }
+   }
+   else {
+      /* Without history, start again at the front of the window */
+      pStream->nOutWindowPos = HISTORY_SIZE;
+
+      if (pStream->nFrameDictionarySize != 0) {
+         memcpy(pStream->pOutData + HISTORY_SIZE - pStream->nFrameDictionarySize, pStream->pDictionaryData, pStream->nFrameDictionarySize);
+         pStream->nPrevDecompressedSize = pStream->nFrameDictionarySize;
+
+         if (!(pStream->nFlags & LZ4ULTRA_FLAG_INDEP_BLOCKS))
+            pStream->nFrameDictionarySize = 0;
+      }
+   }
+
+   unsigned char *pCurOutData = pStream->pOutData + pStream->nOutWindowPos - pStream->nPrevDecompressedSize;
+
+   if (pStream->nIsUncompressed) {
+      if (nBlockSize > nMaxOutDataSize)
+         return LZ4ULTRA_ERROR_DECOMPRESSION;
+      memcpy(pCurOutData + pStream->nPrevDecompressedSize, pInBlock, nBlockSize);
+      nDecompressedSize = nBlockSize;
+   }
+   else {
+      nDecompressedSize = lz4ultra_decompressor_expand_block(pInBlock, nBlockSize, pCurOutData, pStream->nPrevDecompressedSize, nMaxOutDataSize);
+      if (nDecompressedSize < 0)
+         return LZ4ULTRA_ERROR_DECOMPRESSION;
+   }
+
+   if (lz4ultra_get_content_checksum_size(pStream->nFlags))
+      XXH32_update(&pStream->contentChecksum, pCurOutData + pStream->nPrevDecompressedSize, nDecompressedSize);
+
+   pStream->nFrameSize += (long long)nDecompressedSize;
+   pStream->nOutWindowPos += nDecompressedSize;
+   pStream->nPendingSize = nDecompressedSize;
+
+   if (!(pStream->nFlags & LZ4ULTRA_FLAG_INDEP_BLOCKS)) {
+      /* Dependent blocks may reference up to HISTORY_SIZE bytes back, across several small blocks */
+      pStream->nPrevDecompressedSize += nDecompressedSize;
+      if (pStream->nPrevDecompressedSize > HISTORY_SIZE)
+         pStream->nPrevDecompressedSize = HISTORY_SIZE;
+   }
+   else {
+      pStream->nPrevDecompressedSize = 0;
+   }
+
+   return LZ4ULTRA_OK;
+}
+
+/**
+ * Decompress data pushed into a decompression stream. This consumes as much input data as possible, until it runs out or until the output buffer is
+ * full; decompressed bytes that don't fit are returned by the next calls, that may push no new input data. Blocks that are entirely contained in the
+ * input data are decompressed straight from it; only blocks that arrive in several pieces are gathered first
+ *
+ * @param pStream decompression stream
+ * @param pInData input(compressed) data, or NULL if pInDataSize points to 0
+ * @param pInDataSize pointer to the number of bytes of input data, set to the number of bytes that were consumed by this function
+ * @param pOutData buffer for output(decompressed) data
+ * @param pOutDataSize pointer to the size of the output buffer, in bytes, set to the number of decompressed bytes written by this function
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+lz4ultra_status_t lz4ultra_dstream_decompress(lz4ultra_dstream *pStream, const void *pInData, size_t *pInDataSize, void *pOutData, size_t *pOutDataSize) {
+   const unsigned char *pCurInData = (const unsigned char *)pInData;
+   size_t nInDataLeft = *pInDataSize;
+   unsigned char *pCurOutData = (unsigned char *)pOutData;
+   size_t nOutDataLeft = *pOutDataSize;
+   lz4ultra_status_t nError = pStream->nError;
+
+   while (!nError) {
+      if (pStream->nPendingSize) {
+         /* Return the decompressed bytes of the last block first; the next block can't be decompressed before, as it may move the history */
+         size_t nCopySize = (size_t)pStream->nPendingSize;
+
+         if (nCopySize > nOutDataLeft)
+            nCopySize = nOutDataLeft;
+         memcpy(pCurOutData, pStream->pOutData + pStream->nOutWindowPos - pStream->nPendingSize, nCopySize);
+         pCurOutData += nCopySize;
+         nOutDataLeft -= nCopySize;
+         pStream->nPendingSize -= (int)nCopySize;
+         pStream->nOriginalSize += (long long)nCopySize;
+         if (pStream->nPendingSize)
+            break;
+      }
+
+      const lz4ultra_dstream_state nPrevState = pStream->nState;
+      const int nPrevHeaderSize = pStream->nHeaderSize;
+      const size_t nPrevInDataLeft = nInDataLeft;
+
+      switch (pStream->nState) {
+      case LZ4ULTRA_DSTREAM_HEADER:
+         if (lz4ultra_dstream_gather(pStream, &pCurInData, &nInDataLeft, pStream->nHeaderSize)) {
+            int nExtraHeaderSize = lz4ultra_check_header(pStream->cFrameData, pStream->nFrameDataSize);
+
+            if (nExtraHeaderSize < 0) {
+               nError = LZ4ULTRA_ERROR_FORMAT;
+               break;
+            }
+            if (nExtraHeaderSize > 0) {
+               /* The magic number or the flags tell how many more header bytes follow */
+               pStream->nHeaderSize += nExtraHeaderSize;
+               break;
+            }
+
+            unsigned int nSkipSize = 0;
+
+            if (lz4ultra_decode_skippable_header(pStream->cFrameData, pStream->nFrameDataSize, &nSkipSize) == LZ4ULTRA_DECODE_OK) {
+               /* Skippable frames hold no compressed data, but deduplicated data can't be restored from a stream */
+               if (lz4ultra_is_dedup_header(pStream->cFrameData, pStream->nFrameDataSize))
+                  nError = LZ4ULTRA_ERROR_DEDUP;
+               pStream->nSkipSize = nSkipSize;
+               pStream->nState = LZ4ULTRA_DSTREAM_SKIP;
+            }
+            else {
+               int nBlockMaxCode = 7;
+               unsigned int nFrameFlags = 0;
+               long long nContentSize = -1LL;
+
+               int nSuccess = lz4ultra_decode_header(pStream->cFrameData, pStream->nFrameDataSize, &nBlockMaxCode, &nFrameFlags, &nContentSize);
+               if (nSuccess < 0) {
+                  if (nSuccess == LZ4ULTRA_DECODE_ERR_SUM)
+                     nError = LZ4ULTRA_ERROR_CHECKSUM;
+                  else
+                     nError = LZ4ULTRA_ERROR_FORMAT;
+               }
+               else {
+                  nError = lz4ultra_dstream_start_frame(pStream, nFrameFlags, nBlockMaxCode, nContentSize);
+                  pStream->nState = LZ4ULTRA_DSTREAM_FRAME;
+               }
+            }
+            pStream->nFrameDataSize = 0;
+            pStream->nHeaderSize = LZ4ULTRA_HEADER_SIZE;
+         }
+         break;
+
+      case LZ4ULTRA_DSTREAM_SKIP:
+         {
+            size_t nSkipSize = (size_t)pStream->nSkipSize;
+
+            if (nSkipSize > nInDataLeft)
+               nSkipSize = nInDataLeft;
+            pCurInData += nSkipSize;
+            nInDataLeft -= nSkipSize;
+            pStream->nSkipSize -= (unsigned int)nSkipSize;
+            if (!pStream->nSkipSize)
+               pStream->nState = LZ4ULTRA_DSTREAM_HEADER;
+         }
+         break;
+
+      case LZ4ULTRA_DSTREAM_FRAME:
+         if (lz4ultra_dstream_gather(pStream, &pCurInData, &nInDataLeft, LZ4ULTRA_FRAME_SIZE)) {
+            unsigned int nBlockSize = 0;
+            int nIsUncompressed = 0;
+
+            pStream->nFrameDataSize = 0;
+            if (lz4ultra_decode_frame(pStream->cFrameData, LZ4ULTRA_FRAME_SIZE, &nBlockSize, &nIsUncompressed) < 0) {
+               nError = LZ4ULTRA_ERROR_FORMAT;
+            }
+            else if ((pStream->nFlags & LZ4ULTRA_FLAG_LEGACY_FRAMES) && (int)nBlockSize > pStream->nBlockMaxSize) {
+               /* Legacy frames have no end mark; a block size that is too large is the magic number of the next frame */
+               pStream->nFrameDataSize = LZ4ULTRA_HEADER_SIZE;
+               pStream->nState = LZ4ULTRA_DSTREAM_HEADER;
+            }
+            else if (nBlockSize == 0) {
+               if (pStream->nContentSize >= 0 && pStream->nFrameSize != pStream->nContentSize)
+                  nError = LZ4ULTRA_ERROR_DECOMPRESSION;
+               else if (lz4ultra_get_content_checksum_size(pStream->nFlags))
+                  pStream->nState = LZ4ULTRA_DSTREAM_CONTENT_CHECKSUM;
+               else
+                  pStream->nState = LZ4ULTRA_DSTREAM_HEADER;
+            }
+            else if ((int)nBlockSize > pStream->nBlockMaxSize) {
+               nError = LZ4ULTRA_ERROR_FORMAT;
+            }
+            else {
+               pStream->nBlockSize = nBlockSize;
+               pStream->nIsUncompressed = nIsUncompressed;
+               pStream->nInBlockSize = 0;
+               pStream->nState = LZ4ULTRA_DSTREAM_BLOCK;
+            }
+         }
+         break;
+
+      case LZ4ULTRA_DSTREAM_BLOCK:
+         {
+            const int nInBlockSize = (int)pStream->nBlockSize + lz4ultra_get_block_checksum_size(pStream->nFlags);
+
+            if (pStream->nInBlockSize == 0 && nInDataLeft >= (size_t)nInBlockSize) {
+               /* The whole block is in the input data, decompress it from there */
+               nError = lz4ultra_dstream_expand_block(pStream, pCurInData);
+               pCurInData += nInBlockSize;
+               nInDataLeft -= nInBlockSize;
+               pStream->nState = LZ4ULTRA_DSTREAM_FRAME;
+            }
+            else {
+               size_t nCopySize = (size_t)(nInBlockSize - pStream->nInBlockSize);
+
+               if (nCopySize > nInDataLeft)
+                  nCopySize = nInDataLeft;
+               memcpy(pStream->pInBlock + pStream->nInBlockSize, pCurInData, nCopySize);
+               pStream->nInBlockSize += (int)nCopySize;
+               pCurInData += nCopySize;
+               nInDataLeft -= nCopySize;
+
+               if (pStream->nInBlockSize == nInBlockSize) {
+                  nError = lz4ultra_dstream_expand_block(pStream, pStream->pInBlock);
+                  pStream->nInBlockSize = 0;
+                  pStream->nState = LZ4ULTRA_DSTREAM_FRAME;
+               }
+            }
+         }
+         break;
+
+      case LZ4ULTRA_DSTREAM_CONTENT_CHECKSUM:
+         if (lz4ultra_dstream_gather(pStream, &pCurInData, &nInDataLeft, LZ4ULTRA_CHECKSUM_SIZE)) {
+            pStream->nFrameDataSize = 0;
+            if (lz4ultra_decode_checksum(pStream->cFrameData, LZ4ULTRA_CHECKSUM_SIZE, XXH32_digest(&pStream->contentChecksum)) != LZ4ULTRA_DECODE_OK)
+               nError = LZ4ULTRA_ERROR_CHECKSUM;
+            else
+               pStream->nState = LZ4ULTRA_DSTREAM_HEADER;
+         }
+         break;
+      }
+
+      pStream->nCompressedSize += (long long)(nPrevInDataLeft - nInDataLeft);
+
+      /* Stop once more input data is needed to go on */
+      if (nInDataLeft == nPrevInDataLeft && pStream->nState == nPrevState && pStream->nHeaderSize == nPrevHeaderSize && !pStream->nPendingSize)
+         break;
+   }
+
+   pStream->nError = nError;
+   *pInDataSize -= nInDataLeft;
+   *pOutDataSize -= nOutDataLeft;
+   return nError;
+}
+
+/**
+ * End a decompression stream, once all the input data was pushed and all the decompressed data was returned, and free the stream. The stream can't
+ * be used afterwards, even if an error is returned
+ *
+ * @param pStream decompression stream
+ * @param pOriginalSize pointer to returned output(decompressed) size, updated when this function is successful, or NULL
+ * @param pCompressedSize pointer to returned input(compressed) size, updated when this function is successful, or NULL
+ *
+ * @return LZ4ULTRA_OK for success, LZ4ULTRA_ERROR_SRC if the input data stops in the middle of a frame, or an error value from lz4ultra_status_t
+ */
+lz4ultra_status_t lz4ultra_dstream_end(lz4ultra_dstream *pStream, long long *pOriginalSize, long long *pCompressedSize) {
+   lz4ultra_status_t nError = pStream->nError;
+   lz4ultra_allocator allocator;
+
+   if (!nError && pStream->nPendingSize)
+      nError = LZ4ULTRA_ERROR_DST;
+   if (!nError && pStream->nFrameDataSize)
+      nError = LZ4ULTRA_ERROR_SRC;
+   if (!nError && pStream->nCompressedSize == 0)
+      nError = LZ4ULTRA_ERROR_SRC;
+   if (!nError && pStream->nState != LZ4ULTRA_DSTREAM_HEADER) {
+      /* Legacy frames have no end mark, and end with the input data at a block boundary */
+      if (pStream->nState != LZ4ULTRA_DSTREAM_FRAME || !(pStream->nFlags & LZ4ULTRA_FLAG_LEGACY_FRAMES))
+         nError = LZ4ULTRA_ERROR_SRC;
+   }
+
+   if (!nError) {
+      if (pOriginalSize)
+         *pOriginalSize = pStream->nOriginalSize;
+      if (pCompressedSize)
+         *pCompressedSize = pStream->nCompressedSize;
+   }
+
+   if (pStream->pOutData) {
+      lz4ultra_free(&pStream->allocator, pStream->pOutData);
+      pStream->pOutData = NULL;
+   }
+   if (pStream->pInBlock) {
+      lz4ultra_free(&pStream->allocator, pStream->pInBlock);
+      pStream->pInBlock = NULL;
+   }
+   allocator = pStream->allocator;
+   lz4ultra_free(&allocator, pStream);
+
+   return nError;
+}
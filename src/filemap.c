@@ -0,0 +1,326 @@
+/*
+ * filemap.c - memory-mapped file implementation
+ *
+ * Copyright (C) 2019 Emmanuel Marty
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*
+ * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
+ *
+ * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
+ * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
+ * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
+ * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "filemap.h"
+
+#ifdef _WIN32
+
+/**
+ * Map the current contents of a file
+ *
+ * @param pMap mapping
+ *
+ * @return 0 for success, nonzero for failure
+ */
+static int lz4ultra_filemap_map(lz4ultra_filemap_t *pMap) {
+   const unsigned long long nSize = (unsigned long long)pMap->nSize;
+
+   if (!pMap->nSize)
+      return 0;
+
+   pMap->hMapping = CreateFileMappingA((HANDLE)pMap->hFile, NULL, pMap->nWritable ? PAGE_READWRITE : PAGE_READONLY,
+                                       (DWORD)(nSize >> 32), (DWORD)(nSize & 0xffffffffULL), NULL);
+   if (!pMap->hMapping)
+      return -1;
+
+   pMap->pData = (unsigned char *)MapViewOfFile((HANDLE)pMap->hMapping, pMap->nWritable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, pMap->nSize);
+   if (!pMap->pData) {
+      CloseHandle((HANDLE)pMap->hMapping);
+      pMap->hMapping = NULL;
+      return -1;
+   }
+
+   return 0;
+}
+
+/**
+ * Unmap the contents of a file, keeping the file open
+ *
+ * @param pMap mapping
+ */
+static void lz4ultra_filemap_unmap(lz4ultra_filemap_t *pMap) {
+   if (pMap->pData) {
+      UnmapViewOfFile(pMap->pData);
+      pMap->pData = NULL;
+   }
+
+   if (pMap->hMapping) {
+      CloseHandle((HANDLE)pMap->hMapping);
+      pMap->hMapping = NULL;
+   }
+}
+
+/**
+ * Map an existing, regular file for reading
+ *
+ * @param pMap mapping to fill out
+ * @param pszFilename name of file to map
+ *
+ * @return 0 for success, nonzero for failure (for instance if the file is empty, or is not a regular file, such as a pipe)
+ */
+int lz4ultra_filemap_open(lz4ultra_filemap_t *pMap, const char *pszFilename) {
+   LARGE_INTEGER nFileSize;
+
+   memset(pMap, 0, sizeof(lz4ultra_filemap_t));
+
+   pMap->hFile = (void *)CreateFileA(pszFilename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+   if ((HANDLE)pMap->hFile == INVALID_HANDLE_VALUE)
+      return -1;
+
+   if (GetFileType((HANDLE)pMap->hFile) != FILE_TYPE_DISK || !GetFileSizeEx((HANDLE)pMap->hFile, &nFileSize) ||
+       nFileSize.QuadPart <= 0 || (unsigned long long)nFileSize.QuadPart > (unsigned long long)((size_t)-1)) {
+      CloseHandle((HANDLE)pMap->hFile);
+      return -1;
+   }
+
+   pMap->nSize = (size_t)nFileSize.QuadPart;
+   if (lz4ultra_filemap_map(pMap)) {
+      CloseHandle((HANDLE)pMap->hFile);
+      return -1;
+   }
+
+   return 0;
+}
+
+/**
+ * Create an empty file, or truncate an existing one, and map it for writing with lz4ultra_filemap_resize()
+ *
+ * @param pMap mapping to fill out
+ * @param pszFilename name of file to create
+ *
+ * @return 0 for success, nonzero for failure
+ */
+int lz4ultra_filemap_create(lz4ultra_filemap_t *pMap, const char *pszFilename) {
+   memset(pMap, 0, sizeof(lz4ultra_filemap_t));
+
+   pMap->hFile = (void *)CreateFileA(pszFilename, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+   if ((HANDLE)pMap->hFile == INVALID_HANDLE_VALUE)
+      return -1;
+
+   if (GetFileType((HANDLE)pMap->hFile) != FILE_TYPE_DISK) {
+      CloseHandle((HANDLE)pMap->hFile);
+      return -1;
+   }
+
+   pMap->nWritable = 1;
+   return 0;
+}
+
+/**
+ * Change the size of a file that is mapped for writing, and remap it. The contents up to the smaller of the old and new sizes are preserved,
+ * but the mapping's address may change
+ *
+ * @param pMap mapping
+ * @param nSize new size, in bytes
+ *
+ * @return 0 for success, nonzero for failure
+ */
+int lz4ultra_filemap_resize(lz4ultra_filemap_t *pMap, size_t nSize) {
+   LARGE_INTEGER nFilePos;
+
+   if (!pMap->nWritable)
+      return -1;
+
+   lz4ultra_filemap_unmap(pMap);
+
+   nFilePos.QuadPart = (LONGLONG)nSize;
+   if (!SetFilePointerEx((HANDLE)pMap->hFile, nFilePos, NULL, FILE_BEGIN) || !SetEndOfFile((HANDLE)pMap->hFile)) {
+      pMap->nSize = 0;
+      return -1;
+   }
+
+   pMap->nSize = nSize;
+   return lz4ultra_filemap_map(pMap);
+}
+
+/**
+ * Unmap and close file
+ *
+ * @param pMap mapping
+ */
+void lz4ultra_filemap_close(lz4ultra_filemap_t *pMap) {
+   lz4ultra_filemap_unmap(pMap);
+
+   if (pMap->hFile && (HANDLE)pMap->hFile != INVALID_HANDLE_VALUE) {
+      CloseHandle((HANDLE)pMap->hFile);
+      pMap->hFile = NULL;
+   }
+}
+
+#else
+
+/**
+ * Map the current contents of a file
+ *
+ * @param pMap mapping
+ *
+ * @return 0 for success, nonzero for failure
+ */
+static int lz4ultra_filemap_map(lz4ultra_filemap_t *pMap) {
+   void *pData;
+
+   if (!pMap->nSize)
+      return 0;
+
+   pData = mmap(NULL, pMap->nSize, pMap->nWritable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, pMap->fd, 0);
+   if (pData == MAP_FAILED)
+      return -1;
+
+#ifdef MADV_SEQUENTIAL
+   if (!pMap->nWritable)
+      madvise(pData, pMap->nSize, MADV_SEQUENTIAL);
+#endif
+
+   pMap->pData = (unsigned char *)pData;
+   return 0;
+}
+
+/**
+ * Unmap the contents of a file, keeping the file open
+ *
+ * @param pMap mapping
+ */
+static void lz4ultra_filemap_unmap(lz4ultra_filemap_t *pMap) {
+   if (pMap->pData) {
+      munmap(pMap->pData, pMap->nSize);
+      pMap->pData = NULL;
+   }
+}
+
+/**
+ * Map an existing, regular file for reading
+ *
+ * @param pMap mapping to fill out
+ * @param pszFilename name of file to map
+ *
+ * @return 0 for success, nonzero for failure (for instance if the file is empty, or is not a regular file, such as a pipe)
+ */
+int lz4ultra_filemap_open(lz4ultra_filemap_t *pMap, const char *pszFilename) {
+   struct stat st;
+
+   memset(pMap, 0, sizeof(lz4ultra_filemap_t));
+
+   pMap->fd = open(pszFilename, O_RDONLY);
+   if (pMap->fd < 0)
+      return -1;
+
+   if (fstat(pMap->fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+       st.st_size <= 0 || (unsigned long long)st.st_size > (unsigned long long)((size_t)-1)) {
+      close(pMap->fd);
+      return -1;
+   }
+
+   pMap->nSize = (size_t)st.st_size;
+   if (lz4ultra_filemap_map(pMap)) {
+      close(pMap->fd);
+      return -1;
+   }
+
+   return 0;
+}
+
+/**
+ * Create an empty file, or truncate an existing one, and map it for writing with lz4ultra_filemap_resize()
+ *
+ * @param pMap mapping to fill out
+ * @param pszFilename name of file to create
+ *
+ * @return 0 for success, nonzero for failure
+ */
+int lz4ultra_filemap_create(lz4ultra_filemap_t *pMap, const char *pszFilename) {
+   struct stat st;
+
+   memset(pMap, 0, sizeof(lz4ultra_filemap_t));
+
+   pMap->fd = open(pszFilename, O_RDWR | O_CREAT | O_TRUNC, 0666);
+   if (pMap->fd < 0)
+      return -1;
+
+   if (fstat(pMap->fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+      close(pMap->fd);
+      return -1;
+   }
+
+   pMap->nWritable = 1;
+   return 0;
+}
+
+/**
+ * Change the size of a file that is mapped for writing, and remap it. The contents up to the smaller of the old and new sizes are preserved,
+ * but the mapping's address may change
+ *
+ * @param pMap mapping
+ * @param nSize new size, in bytes
+ *
+ * @return 0 for success, nonzero for failure
+ */
+int lz4ultra_filemap_resize(lz4ultra_filemap_t *pMap, size_t nSize) {
+   if (!pMap->nWritable)
+      return -1;
+
+   lz4ultra_filemap_unmap(pMap);
+
+   if ((unsigned long long)(off_t)nSize != (unsigned long long)nSize || ftruncate(pMap->fd, (off_t)nSize) != 0) {
+      pMap->nSize = 0;
+      return -1;
+   }
+
+   pMap->nSize = nSize;
+   return lz4ultra_filemap_map(pMap);
+}
+
+/**
+ * Unmap and close file
+ *
+ * @param pMap mapping
+ */
+void lz4ultra_filemap_close(lz4ultra_filemap_t *pMap) {
+   lz4ultra_filemap_unmap(pMap);
+
+   if (pMap->fd >= 0) {
+      close(pMap->fd);
+      pMap->fd = -1;
+   }
+}
+
+#endif
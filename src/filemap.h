@@ -0,0 +1,97 @@
+/*
+ * filemap.h - memory-mapped file definitions
+ *
+ * Copyright (C) 2019 Emmanuel Marty
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*
+ * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
+ *
+ * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
+ * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
+ * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
+ * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
+ *
+ */
+
+#ifndef _FILEMAP_H
+#define _FILEMAP_H
+
+#include <stdlib.h>
+
+/** Memory-mapped file */
+typedef struct {
+   /** Mapped file contents, or NULL if the file is empty */
+   unsigned char *pData;
+
+   /** Current size of the file, in bytes */
+   size_t nSize;
+
+   /** Non-zero if the mapping can be resized and written to */
+   int nWritable;
+
+#ifdef _WIN32
+   /** File and file mapping handles */
+   void *hFile;
+   void *hMapping;
+#else
+   /** File descriptor */
+   int fd;
+#endif
+} lz4ultra_filemap_t;
+
+/**
+ * Map an existing, regular file for reading
+ *
+ * @param pMap mapping to fill out
+ * @param pszFilename name of file to map
+ *
+ * @return 0 for success, nonzero for failure (for instance if the file is empty, or is not a regular file, such as a pipe)
+ */
+int lz4ultra_filemap_open(lz4ultra_filemap_t *pMap, const char *pszFilename);
+
+/**
+ * Create an empty file, or truncate an existing one, and map it for writing with lz4ultra_filemap_resize()
+ *
+ * @param pMap mapping to fill out
+ * @param pszFilename name of file to create
+ *
+ * @return 0 for success, nonzero for failure
+ */
+int lz4ultra_filemap_create(lz4ultra_filemap_t *pMap, const char *pszFilename);
+
+/**
+ * Change the size of a file that is mapped for writing, and remap it. The contents up to the smaller of the old and new sizes are preserved,
+ * but the mapping's address may change
+ *
+ * @param pMap mapping
+ * @param nSize new size, in bytes
+ *
+ * @return 0 for success, nonzero for failure
+ */
+int lz4ultra_filemap_resize(lz4ultra_filemap_t *pMap, size_t nSize);
+
+/**
+ * Unmap and close file
+ *
+ * @param pMap mapping
+ */
+void lz4ultra_filemap_close(lz4ultra_filemap_t *pMap);
+
+#endif /* _FILEMAP_H */
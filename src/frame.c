@@ -1,262 +1,738 @@
-/*
- * frame.c - lz4 frame implementation
- *
- * Copyright (C) 2019 Emmanuel Marty
- *
- * This software is provided 'as-is', without any express or implied
- * warranty.  In no event will the authors be held liable for any damages
- * arising from the use of this software.
- *
- * Permission is granted to anyone to use this software for any purpose,
- * including commercial applications, and to alter it and redistribute it
- * freely, subject to the following restrictions:
- *
- * 1. The origin of this software must not be misrepresented; you must not
- *    claim that you wrote the original software. If you use this software
- *    in a product, an acknowledgment in the product documentation would be
- *    appreciated but is not required.
- * 2. Altered source versions must be plainly marked as such, and must not be
- *    misrepresented as being the original software.
- * 3. This notice may not be removed or altered from any source distribution.
- */
-
-/*
- * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
- *
- * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
- * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
- * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
- * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
- *
- */
-
-#include "frame.h"
-#include "lib.h"
-#include "xxhash.h"
-
-/**
- * Encode compressed stream header
- *
- * @param pFrameData encoding buffer
- * @param nMaxFrameDataSize max encoding buffer size, in bytes
- * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
- * @param nBlockMaxCode max block size code (4-7)
- *
- * @return number of encoded bytes, or -1 for failure
- */
-int lz4ultra_encode_header(unsigned char *pFrameData, const int nMaxFrameDataSize, const unsigned int nFlags, int nBlockMaxCode) {
-   if (nFlags & LZ4ULTRA_FLAG_LEGACY_FRAMES) {
-      if (nMaxFrameDataSize >= 4) {
-         pFrameData[0] = 0x02;                              /* Legacy magic number: 0x184D2204 */
-         pFrameData[1] = 0x21;
-         pFrameData[2] = 0x4C;
-         pFrameData[3] = 0x18;
-
-         return 4;
-      }
-      else {
-         return LZ4ULTRA_ENCODE_ERR;
-      }
-   }
-   else {
-      if (nMaxFrameDataSize >= 7) {
-         pFrameData[0] = 0x04;                              /* Magic number: 0x184D2204 */
-         pFrameData[1] = 0x22;
-         pFrameData[2] = 0x4D;
-         pFrameData[3] = 0x18;
-
-         pFrameData[4] = 0b01000000;                        /* Version.Hi Version.Lo !B.Indep B.Checksum Content.Size Content.Checksum Reserved.Hi Reserved.Lo */
-         if (nFlags & LZ4ULTRA_FLAG_INDEP_BLOCKS)
-            pFrameData[4] |= 0b00100000;                    /*                       B.Indep */
-         pFrameData[5] = nBlockMaxCode << 4;                /* Block MaxSize */
-
-         XXH32_hash_t headerSum = XXH32(pFrameData + 4, 2, 0);
-         pFrameData[6] = (headerSum >> 8) & 0xff;           /* Header checksum */
-
-         return 7;
-      }
-      else {
-         return LZ4ULTRA_ENCODE_ERR;
-      }
-   }
-}
-
-/**
- * Encode compressed block frame header
- *
- * @param pFrameData encoding buffer
- * @param nMaxFrameDataSize max encoding buffer size, in bytes
- * @param nFlags compression flags
- * @param nBlockDataSize compressed block's data size, in bytes
- *
- * @return number of encoded bytes, or -1 for failure
- */
-int lz4ultra_encode_compressed_block_frame(unsigned char *pFrameData, const int nMaxFrameDataSize, const unsigned int nFlags, const int nBlockDataSize) {
-   if (nMaxFrameDataSize >= 4 && (nBlockDataSize & 0x80000000) == 0) {
-      pFrameData[0] = nBlockDataSize & 0xff;
-      pFrameData[1] = (nBlockDataSize >> 8) & 0xff;
-      pFrameData[2] = (nBlockDataSize >> 16) & 0xff;
-      pFrameData[3] = (nBlockDataSize >> 24) & 0x7f;            /* Compressed block */
-      return 4;
-   }
-   else {
-      return LZ4ULTRA_ENCODE_ERR;
-   }
-}
-
-/**
- * Encode uncompressed block frame header
- *
- * @param pFrameData encoding buffer
- * @param nMaxFrameDataSize max encoding buffer size, in bytes
- * @param nFlags compression flags
- * @param nBlockDataSize uncompressed block's data size, in bytes
- *
- * @return number of encoded bytes, or -1 for failure
- */
-int lz4ultra_encode_uncompressed_block_frame(unsigned char *pFrameData, const int nMaxFrameDataSize, const unsigned int nFlags, const int nBlockDataSize) {
-   if (nFlags & LZ4ULTRA_FLAG_LEGACY_FRAMES)
-      return LZ4ULTRA_ERROR_RAW_UNCOMPRESSED;
-
-   if (nMaxFrameDataSize >= 4 && (nBlockDataSize & 0x80000000) == 0) {
-      pFrameData[0] = nBlockDataSize & 0xff;
-      pFrameData[1] = (nBlockDataSize >> 8) & 0xff;
-      pFrameData[2] = (nBlockDataSize >> 16) & 0xff;
-      pFrameData[3] = ((nBlockDataSize >> 24) & 0x7f) | 0x80;   /* Uncompressed block */
-      return 4;
-   }
-   else {
-      return LZ4ULTRA_ENCODE_ERR;
-   }
-}
-
-/**
- * Encode terminal frame header
- *
- * @param pFrameData encoding buffer
- * @param nMaxFrameDataSize max encoding buffer size, in bytes
- * @param nFlags compression flags
- *
- * @return number of encoded bytes, or -1 for failure
- */
-int lz4ultra_encode_footer_frame(unsigned char *pFrameData, const int nMaxFrameDataSize, const unsigned int nFlags) {
-   if (nFlags & LZ4ULTRA_FLAG_LEGACY_FRAMES)
-      return 0;
-
-   if (nMaxFrameDataSize >= 4) {
-      pFrameData[0] = 0x00;         /* EOD frame */
-      pFrameData[1] = 0x00;
-      pFrameData[2] = 0x00;
-      pFrameData[3] = 0x00;
-      return 4;
-   }
-   else {
-      return LZ4ULTRA_ENCODE_ERR;
-   }
-}
-
-/**
- * Check compressed stream header
- *
- * @param pFrameData data bytes
- * @param nFrameDataSize number of bytes to check
- *
- * @return the number of extra header bytes to read for decoding, or LZ4ULTRA_DECODE_ERR_xxx for failure
- */
-int lz4ultra_check_header(const unsigned char *pFrameData, const int nFrameDataSize) {
-   if (nFrameDataSize == 4) {
-      if (pFrameData[0] == 0x04 &&
-         pFrameData[1] == 0x22 &&
-         pFrameData[2] == 0x4D &&
-         pFrameData[3] == 0x18) {
-         /* LZ4 magic number */
-         return 3;
-      }
-
-      if (pFrameData[0] == 0x02 &&
-         pFrameData[1] == 0x21 &&
-         pFrameData[2] == 0x4C &&
-         pFrameData[3] == 0x18) {
-         /* Legacy magic number */
-         return 0;
-      }
-   }
-
-   return LZ4ULTRA_DECODE_ERR_FORMAT;
-}
-
-/**
- * Decode compressed stream header
- *
- * @param pFrameData data bytes
- * @param nFrameDataSize number of bytes to decode
- * @param nBlockMaxCode pointer to max block size code (4-7), updated if this function succeeds
- * @param nFlags returned compression flags
- *
- * @return LZ4ULTRA_DECODE_OK for success, or LZ4ULTRA_DECODE_ERR_xxx for failure
- */
-int lz4ultra_decode_header(const unsigned char *pFrameData, const int nFrameDataSize, int *nBlockMaxCode, unsigned int *nFlags) {
-   if (nFrameDataSize == 7) {
-      if (pFrameData[0] != 0x04 ||
-         pFrameData[1] != 0x22 ||
-         pFrameData[2] != 0x4D ||
-         pFrameData[3] != 0x18 ||
-         (pFrameData[4] & 0xc0) != 0b01000000 ||
-         (pFrameData[5] & 0x0f) != 0) {
-         return LZ4ULTRA_DECODE_ERR_FORMAT;
-      }
-
-      XXH32_hash_t headerSum = XXH32(pFrameData + 4, 2, 0);
-      if (((headerSum >> 8) & 0xff) != pFrameData[6]) {
-         return LZ4ULTRA_DECODE_ERR_SUM;
-      }
-
-      *nFlags = (pFrameData[4] & 0x20) ? LZ4ULTRA_FLAG_INDEP_BLOCKS : 0;
-      *nBlockMaxCode = (pFrameData[5] >> 4);
-
-      return LZ4ULTRA_DECODE_OK;
-   }
-   else if (nFrameDataSize == 4) {
-      if (pFrameData[0] != 0x02 ||
-         pFrameData[1] != 0x21 ||
-         pFrameData[2] != 0x4C ||
-         pFrameData[3] != 0x18) {
-         return LZ4ULTRA_DECODE_ERR_FORMAT;
-      }
-
-      *nFlags = LZ4ULTRA_FLAG_LEGACY_FRAMES;
-      *nBlockMaxCode = 0;
-
-      return LZ4ULTRA_DECODE_OK;
-   }
-   else {
-      return LZ4ULTRA_DECODE_ERR_FORMAT;
-   }
-}
-
-/**
- * Decode frame header
- *
- * @param pFrameData data bytes
- * @param nFrameDataSize number of bytes to decode
- * @param nFlags compression flags
- * @param nBlockSize pointer to block size, updated if this function succeeds (set to 0 if this is the terminal frame)
- * @param nIsUncompressed pointer to compressed block flag, updated if this function succeeds
- *
- * @return LZ4ULTRA_DECODE_OK for success, or LZ4ULTRA_DECODE_ERR_FORMAT for failure
- */
-int lz4ultra_decode_frame(const unsigned char *pFrameData, const int nFrameDataSize, const unsigned int nFlags, unsigned int *nBlockSize, int *nIsUncompressed) {
-   if (nFrameDataSize == 4) {
-      *nBlockSize = ((unsigned int)pFrameData[0]) |
-         (((unsigned int)pFrameData[1]) << 8) |
-         (((unsigned int)pFrameData[2]) << 16) |
-         (((unsigned int)pFrameData[3]) << 24);
-
-      *nIsUncompressed = ((*nBlockSize) & 0x80000000) ? 1 : 0;
-      (*nBlockSize) &= 0x7fffffff;
-      return 0;
-   }
-   else {
-      return LZ4ULTRA_DECODE_ERR_FORMAT;
-   }
-}
+/*
+ * frame.c - lz4 frame implementation
+ *
+ * Copyright (C) 2019 Emmanuel Marty
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*
+ * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
+ *
+ * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
+ * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
+ * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
+ * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
+ *
+ */
+
+#include "frame.h"
+#include "lib.h"
+#include "xxhash.h"
+
+#define LZ4ULTRA_SEEK_TABLE_MAGIC         0x184D2A5EU    /* Skippable frame magic number */
+#define LZ4ULTRA_SEEK_TABLE_FOOTER_MAGIC  0x4B455355U    /* 'USEK' */
+#define LZ4ULTRA_SEEK_TABLE_MAX_BLOCKS    ((0xffffffffU - LZ4ULTRA_SEEK_TABLE_FOOTER_SIZE) / LZ4ULTRA_SEEK_TABLE_ENTRY_SIZE)
+#define LZ4ULTRA_DEDUP_MAGIC              0x184D2A5DU    /* Skippable frame magic number */
+#define LZ4ULTRA_DEDUP_SIGNATURE          0x50444455U    /* 'UDDP' */
+#define LZ4ULTRA_DEDUP_MAX_REFS           ((0xffffffffU - (LZ4ULTRA_DEDUP_HEADER_SIZE - LZ4ULTRA_SKIPPABLE_HEADER_SIZE)) / LZ4ULTRA_DEDUP_ENTRY_SIZE)
+
+/**
+ * Encode compressed stream header
+ *
+ * @param pFrameData encoding buffer
+ * @param nMaxFrameDataSize max encoding buffer size, in bytes
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
+ * @param nBlockMaxCode max block size code (4-7)
+ * @param nContentSize size of the data to compress, stored when LZ4ULTRA_FLAG_CONTENT_SIZE is set, or -1 if unknown
+ *
+ * @return number of encoded bytes, or -1 for failure
+ */
+int lz4ultra_encode_header(unsigned char *pFrameData, const int nMaxFrameDataSize, const unsigned int nFlags, int nBlockMaxCode, const long long nContentSize) {
+   if (nFlags & LZ4ULTRA_FLAG_LEGACY_FRAMES) {
+      if (nMaxFrameDataSize >= 4) {
+         pFrameData[0] = 0x02;                              /* Legacy magic number: 0x184D2204 */
+         pFrameData[1] = 0x21;
+         pFrameData[2] = 0x4C;
+         pFrameData[3] = 0x18;
+
+         return 4;
+      }
+      else {
+         return LZ4ULTRA_ENCODE_ERR;
+      }
+   }
+   else {
+      const int nStoreContentSize = ((nFlags & LZ4ULTRA_FLAG_CONTENT_SIZE) && nContentSize >= 0) ? 1 : 0;
+      const int nDescriptorSize = nStoreContentSize ? 10 : 2;
+
+      if (nMaxFrameDataSize >= (5 + nDescriptorSize)) {
+         pFrameData[0] = 0x04;                              /* Magic number: 0x184D2204 */
+         pFrameData[1] = 0x22;
+         pFrameData[2] = 0x4D;
+         pFrameData[3] = 0x18;
+
+         pFrameData[4] = 0b01000000;                        /* Version.Hi Version.Lo !B.Indep B.Checksum Content.Size Content.Checksum Reserved.Hi Reserved.Lo */
+         if (nFlags & LZ4ULTRA_FLAG_INDEP_BLOCKS)
+            pFrameData[4] |= 0b00100000;                    /*                       B.Indep */
+         if (nFlags & LZ4ULTRA_FLAG_BLOCK_CHECKSUM)
+            pFrameData[4] |= 0b00010000;                    /*                               B.Checksum */
+         if (nFlags & LZ4ULTRA_FLAG_CONTENT_CHECKSUM)
+            pFrameData[4] |= 0b00000100;                    /*                                                       Content.Checksum */
+         if (nStoreContentSize)
+            pFrameData[4] |= 0b00001000;                    /*                                          Content.Size */
+         pFrameData[5] = nBlockMaxCode << 4;                /* Block MaxSize */
+
+         if (nStoreContentSize) {
+            int i;
+
+            for (i = 0; i < 8; i++)
+               pFrameData[6 + i] = (unsigned char)(((unsigned long long)nContentSize >> (i << 3)) & 0xff);   /* Content.Size, little-endian */
+         }
+
+         XXH32_hash_t headerSum = XXH32(pFrameData + 4, nDescriptorSize, 0);
+         pFrameData[4 + nDescriptorSize] = (headerSum >> 8) & 0xff;   /* Header checksum */
+
+         return 5 + nDescriptorSize;
+      }
+      else {
+         return LZ4ULTRA_ENCODE_ERR;
+      }
+   }
+}
+
+/**
+ * Encode compressed block frame header
+ *
+ * @param pFrameData encoding buffer
+ * @param nMaxFrameDataSize max encoding buffer size, in bytes
+ * @param nBlockDataSize compressed block's data size, in bytes
+ *
+ * @return number of encoded bytes, or -1 for failure
+ */
+int lz4ultra_encode_compressed_block_frame(unsigned char *pFrameData, const int nMaxFrameDataSize, const int nBlockDataSize) {
+   if (nMaxFrameDataSize >= 4 && (nBlockDataSize & 0x80000000) == 0) {
+      pFrameData[0] = nBlockDataSize & 0xff;
+      pFrameData[1] = (nBlockDataSize >> 8) & 0xff;
+      pFrameData[2] = (nBlockDataSize >> 16) & 0xff;
+      pFrameData[3] = (nBlockDataSize >> 24) & 0x7f;            /* Compressed block */
+      return 4;
+   }
+   else {
+      return LZ4ULTRA_ENCODE_ERR;
+   }
+}
+
+/**
+ * Encode uncompressed block frame header
+ *
+ * @param pFrameData encoding buffer
+ * @param nMaxFrameDataSize max encoding buffer size, in bytes
+ * @param nFlags compression flags
+ * @param nBlockDataSize uncompressed block's data size, in bytes
+ *
+ * @return number of encoded bytes, or -1 for failure
+ */
+int lz4ultra_encode_uncompressed_block_frame(unsigned char *pFrameData, const int nMaxFrameDataSize, const unsigned int nFlags, const int nBlockDataSize) {
+   if (nFlags & LZ4ULTRA_FLAG_LEGACY_FRAMES)
+      return LZ4ULTRA_ENCODE_ERR;
+
+   if (nMaxFrameDataSize >= 4 && (nBlockDataSize & 0x80000000) == 0) {
+      pFrameData[0] = nBlockDataSize & 0xff;
+      pFrameData[1] = (nBlockDataSize >> 8) & 0xff;
+      pFrameData[2] = (nBlockDataSize >> 16) & 0xff;
+      pFrameData[3] = ((nBlockDataSize >> 24) & 0x7f) | 0x80;   /* Uncompressed block */
+      return 4;
+   }
+   else {
+      return LZ4ULTRA_ENCODE_ERR;
+   }
+}
+
+/**
+ * Encode block checksum, that follows the data of each block when block checksums are enabled
+ *
+ * @param pFrameData encoding buffer
+ * @param nMaxFrameDataSize max encoding buffer size, in bytes
+ * @param nFlags compression flags
+ * @param nBlockChecksum XXH32 checksum of the block's data, as stored in the stream
+ *
+ * @return number of encoded bytes (0 if block checksums are disabled), or -1 for failure
+ */
+int lz4ultra_encode_block_checksum(unsigned char *pFrameData, const int nMaxFrameDataSize, const unsigned int nFlags, const unsigned int nBlockChecksum) {
+   if ((nFlags & (LZ4ULTRA_FLAG_BLOCK_CHECKSUM | LZ4ULTRA_FLAG_LEGACY_FRAMES)) != LZ4ULTRA_FLAG_BLOCK_CHECKSUM)
+      return 0;
+
+   if (nMaxFrameDataSize >= 4) {
+      pFrameData[0] = nBlockChecksum & 0xff;
+      pFrameData[1] = (nBlockChecksum >> 8) & 0xff;
+      pFrameData[2] = (nBlockChecksum >> 16) & 0xff;
+      pFrameData[3] = (nBlockChecksum >> 24) & 0xff;
+      return 4;
+   }
+   else {
+      return LZ4ULTRA_ENCODE_ERR;
+   }
+}
+
+/**
+ * Encode terminal frame header, followed by the content checksum when it is enabled
+ *
+ * @param pFrameData encoding buffer
+ * @param nMaxFrameDataSize max encoding buffer size, in bytes
+ * @param nFlags compression flags
+ * @param nContentChecksum XXH32 checksum of all the decompressed data, if content checksums are enabled
+ *
+ * @return number of encoded bytes, or -1 for failure
+ */
+int lz4ultra_encode_footer_frame(unsigned char *pFrameData, const int nMaxFrameDataSize, const unsigned int nFlags, const unsigned int nContentChecksum) {
+   if (nFlags & LZ4ULTRA_FLAG_LEGACY_FRAMES)
+      return 0;
+
+   if (nFlags & LZ4ULTRA_FLAG_CONTENT_CHECKSUM) {
+      if (nMaxFrameDataSize >= 8) {
+         pFrameData[0] = 0x00;         /* EOD frame */
+         pFrameData[1] = 0x00;
+         pFrameData[2] = 0x00;
+         pFrameData[3] = 0x00;
+         pFrameData[4] = nContentChecksum & 0xff;
+         pFrameData[5] = (nContentChecksum >> 8) & 0xff;
+         pFrameData[6] = (nContentChecksum >> 16) & 0xff;
+         pFrameData[7] = (nContentChecksum >> 24) & 0xff;
+         return 8;
+      }
+      else {
+         return LZ4ULTRA_ENCODE_ERR;
+      }
+   }
+
+   if (nMaxFrameDataSize >= 4) {
+      pFrameData[0] = 0x00;         /* EOD frame */
+      pFrameData[1] = 0x00;
+      pFrameData[2] = 0x00;
+      pFrameData[3] = 0x00;
+      return 4;
+   }
+   else {
+      return LZ4ULTRA_ENCODE_ERR;
+   }
+}
+
+/**
+ * Check compressed stream header. The header is variable-sized: this function is first called with the LZ4ULTRA_HEADER_SIZE bytes of
+ * the magic number, and then again with the extra bytes that it requests appended, until it returns 0 and the header can be decoded
+ *
+ * @param pFrameData data bytes
+ * @param nFrameDataSize number of bytes to check
+ *
+ * @return the number of extra header bytes to read, 0 if the whole header has been read, or LZ4ULTRA_DECODE_ERR_xxx for failure
+ */
+int lz4ultra_check_header(const unsigned char *pFrameData, const int nFrameDataSize) {
+   if (nFrameDataSize >= 4 &&
+      pFrameData[0] == 0x04 &&
+      pFrameData[1] == 0x22 &&
+      pFrameData[2] == 0x4D &&
+      pFrameData[3] == 0x18) {
+      /* LZ4 magic number, followed by the FLG byte, that tells the size of the rest of the header */
+      if (nFrameDataSize == 4)
+         return 1;
+
+      int nHeaderSize = 4 + 1 /* FLG */ + 1 /* BD */ + ((pFrameData[4] & 0x08) ? 8 : 0) /* Content.Size */ + 1 /* HC */;
+      if (nFrameDataSize < nHeaderSize)
+         return nHeaderSize - nFrameDataSize;
+      else if (nFrameDataSize == nHeaderSize)
+         return 0;
+      else
+         return LZ4ULTRA_DECODE_ERR_FORMAT;
+   }
+
+   if (nFrameDataSize >= 4 &&
+      (pFrameData[0] & 0xF0) == 0x50 &&
+      pFrameData[1] == 0x2A &&
+      pFrameData[2] == 0x4D &&
+      pFrameData[3] == 0x18) {
+      /* Skippable frame magic number, followed by the size of the frame's data */
+      if (nFrameDataSize == 4)
+         return LZ4ULTRA_SKIPPABLE_HEADER_SIZE - 4;
+      else if (nFrameDataSize == LZ4ULTRA_SKIPPABLE_HEADER_SIZE)
+         return 0;
+      else
+         return LZ4ULTRA_DECODE_ERR_FORMAT;
+   }
+
+   if (nFrameDataSize == 4) {
+      if (pFrameData[0] == 0x02 &&
+         pFrameData[1] == 0x21 &&
+         pFrameData[2] == 0x4C &&
+         pFrameData[3] == 0x18) {
+         /* Legacy magic number */
+         return 0;
+      }
+   }
+
+   return LZ4ULTRA_DECODE_ERR_FORMAT;
+}
+
+/**
+ * Decode compressed stream header
+ *
+ * @param pFrameData data bytes
+ * @param nFrameDataSize number of bytes to decode
+ * @param nBlockMaxCode pointer to max block size code (4-7), updated if this function succeeds
+ * @param nFlags returned compression flags
+ * @param pContentSize pointer to returned decompressed size, set to -1 if the header doesn't store it, or NULL
+ *
+ * @return LZ4ULTRA_DECODE_OK for success, or LZ4ULTRA_DECODE_ERR_xxx for failure
+ */
+int lz4ultra_decode_header(const unsigned char *pFrameData, const int nFrameDataSize, int *nBlockMaxCode, unsigned int *nFlags, long long *pContentSize) {
+   if (nFrameDataSize == 7 || nFrameDataSize == 15) {
+      const int nDescriptorSize = nFrameDataSize - 5;
+
+      if (pFrameData[0] != 0x04 ||
+         pFrameData[1] != 0x22 ||
+         pFrameData[2] != 0x4D ||
+         pFrameData[3] != 0x18 ||
+         (pFrameData[4] & 0xc3) != 0b01000000 ||            /* Dict.ID and reserved bits aren't supported */
+         ((pFrameData[4] & 0x08) ? 10 : 2) != nDescriptorSize ||
+         (pFrameData[5] & 0x0f) != 0) {
+         return LZ4ULTRA_DECODE_ERR_FORMAT;
+      }
+
+      XXH32_hash_t headerSum = XXH32(pFrameData + 4, nDescriptorSize, 0);
+      if (((headerSum >> 8) & 0xff) != pFrameData[4 + nDescriptorSize]) {
+         return LZ4ULTRA_DECODE_ERR_SUM;
+      }
+
+      if (pContentSize) {
+         *pContentSize = -1LL;
+
+         if (pFrameData[4] & 0x08) {
+            unsigned long long nContentSize = 0;
+            int i;
+
+            for (i = 7; i >= 0; i--)
+               nContentSize = (nContentSize << 8) | pFrameData[6 + i];
+            if (nContentSize & 0x8000000000000000ULL)
+               return LZ4ULTRA_DECODE_ERR_FORMAT;
+            *pContentSize = (long long)nContentSize;
+         }
+      }
+
+      *nFlags = (pFrameData[4] & 0x20) ? LZ4ULTRA_FLAG_INDEP_BLOCKS : 0;
+      if (pFrameData[4] & 0x10)
+         *nFlags |= LZ4ULTRA_FLAG_BLOCK_CHECKSUM;
+      if (pFrameData[4] & 0x04)
+         *nFlags |= LZ4ULTRA_FLAG_CONTENT_CHECKSUM;
+      if (pFrameData[4] & 0x08)
+         *nFlags |= LZ4ULTRA_FLAG_CONTENT_SIZE;
+      *nBlockMaxCode = (pFrameData[5] >> 4);
+
+      return LZ4ULTRA_DECODE_OK;
+   }
+   else if (nFrameDataSize == 4) {
+      if (pFrameData[0] != 0x02 ||
+         pFrameData[1] != 0x21 ||
+         pFrameData[2] != 0x4C ||
+         pFrameData[3] != 0x18) {
+         return LZ4ULTRA_DECODE_ERR_FORMAT;
+      }
+
+      *nFlags = LZ4ULTRA_FLAG_LEGACY_FRAMES;
+      *nBlockMaxCode = 0;
+      if (pContentSize)
+         *pContentSize = -1LL;
+
+      return LZ4ULTRA_DECODE_OK;
+   }
+   else {
+      return LZ4ULTRA_DECODE_ERR_FORMAT;
+   }
+}
+
+/**
+ * Decode skippable frame header
+ *
+ * @param pFrameData data bytes
+ * @param nFrameDataSize number of bytes to decode
+ * @param nSkipSize pointer to the size of the frame's data, that follows the header and is to be skipped, updated if this function succeeds
+ *
+ * @return LZ4ULTRA_DECODE_OK if this is the header of a skippable frame, or LZ4ULTRA_DECODE_ERR_FORMAT if not
+ */
+int lz4ultra_decode_skippable_header(const unsigned char *pFrameData, const int nFrameDataSize, unsigned int *nSkipSize) {
+   if (nFrameDataSize == LZ4ULTRA_SKIPPABLE_HEADER_SIZE &&
+      (pFrameData[0] & 0xF0) == 0x50 &&
+      pFrameData[1] == 0x2A &&
+      pFrameData[2] == 0x4D &&
+      pFrameData[3] == 0x18) {
+      *nSkipSize = ((unsigned int)pFrameData[4]) |
+         (((unsigned int)pFrameData[5]) << 8) |
+         (((unsigned int)pFrameData[6]) << 16) |
+         (((unsigned int)pFrameData[7]) << 24);
+      return LZ4ULTRA_DECODE_OK;
+   }
+   else {
+      return LZ4ULTRA_DECODE_ERR_FORMAT;
+   }
+}
+
+/**
+ * Decode frame header
+ *
+ * @param pFrameData data bytes
+ * @param nFrameDataSize number of bytes to decode
+ * @param nBlockSize pointer to block size, updated if this function succeeds (set to 0 if this is the terminal frame)
+ * @param nIsUncompressed pointer to compressed block flag, updated if this function succeeds
+ *
+ * @return LZ4ULTRA_DECODE_OK for success, or LZ4ULTRA_DECODE_ERR_FORMAT for failure
+ */
+int lz4ultra_decode_frame(const unsigned char *pFrameData, const int nFrameDataSize, unsigned int *nBlockSize, int *nIsUncompressed) {
+   if (nFrameDataSize == 4) {
+      *nBlockSize = ((unsigned int)pFrameData[0]) |
+         (((unsigned int)pFrameData[1]) << 8) |
+         (((unsigned int)pFrameData[2]) << 16) |
+         (((unsigned int)pFrameData[3]) << 24);
+
+      *nIsUncompressed = ((*nBlockSize) & 0x80000000) ? 1 : 0;
+      (*nBlockSize) &= 0x7fffffff;
+      return 0;
+   }
+   else {
+      return LZ4ULTRA_DECODE_ERR_FORMAT;
+   }
+}
+
+/**
+ * Get size of the checksum that follows the data of each block
+ *
+ * @param nFlags compression flags
+ *
+ * @return size in bytes, 0 if block checksums are disabled
+ */
+int lz4ultra_get_block_checksum_size(const unsigned int nFlags) {
+   return ((nFlags & (LZ4ULTRA_FLAG_BLOCK_CHECKSUM | LZ4ULTRA_FLAG_LEGACY_FRAMES)) == LZ4ULTRA_FLAG_BLOCK_CHECKSUM) ? LZ4ULTRA_CHECKSUM_SIZE : 0;
+}
+
+/**
+ * Get size of the checksum that follows the terminal frame
+ *
+ * @param nFlags compression flags
+ *
+ * @return size in bytes, 0 if content checksums are disabled
+ */
+int lz4ultra_get_content_checksum_size(const unsigned int nFlags) {
+   return ((nFlags & (LZ4ULTRA_FLAG_CONTENT_CHECKSUM | LZ4ULTRA_FLAG_LEGACY_FRAMES)) == LZ4ULTRA_FLAG_CONTENT_CHECKSUM) ? LZ4ULTRA_CHECKSUM_SIZE : 0;
+}
+
+/**
+ * Decode block or content checksum, and check it against the checksum of the decompressed data
+ *
+ * @param pFrameData data bytes
+ * @param nFrameDataSize number of bytes to decode
+ * @param nChecksum expected XXH32 checksum
+ *
+ * @return LZ4ULTRA_DECODE_OK for success, LZ4ULTRA_DECODE_ERR_SUM if the checksums don't match, or LZ4ULTRA_DECODE_ERR_FORMAT for failure
+ */
+int lz4ultra_decode_checksum(const unsigned char *pFrameData, const int nFrameDataSize, const unsigned int nChecksum) {
+   if (nFrameDataSize == 4) {
+      unsigned int nStoredChecksum = ((unsigned int)pFrameData[0]) |
+         (((unsigned int)pFrameData[1]) << 8) |
+         (((unsigned int)pFrameData[2]) << 16) |
+         (((unsigned int)pFrameData[3]) << 24);
+
+      return (nStoredChecksum == nChecksum) ? LZ4ULTRA_DECODE_OK : LZ4ULTRA_DECODE_ERR_SUM;
+   }
+   else {
+      return LZ4ULTRA_DECODE_ERR_FORMAT;
+   }
+}
+
+/**
+ * Write 32-bit little-endian value
+ *
+ * @param pFrameData encoding buffer, with room for 4 bytes
+ * @param nValue value to write
+ */
+static void lz4ultra_write_le32(unsigned char *pFrameData, const unsigned int nValue) {
+   pFrameData[0] = nValue & 0xff;
+   pFrameData[1] = (nValue >> 8) & 0xff;
+   pFrameData[2] = (nValue >> 16) & 0xff;
+   pFrameData[3] = (nValue >> 24) & 0xff;
+}
+
+/**
+ * Read 32-bit little-endian value
+ *
+ * @param pFrameData data bytes, at least 4
+ *
+ * @return value
+ */
+static unsigned int lz4ultra_read_le32(const unsigned char *pFrameData) {
+   return ((unsigned int)pFrameData[0]) |
+      (((unsigned int)pFrameData[1]) << 8) |
+      (((unsigned int)pFrameData[2]) << 16) |
+      (((unsigned int)pFrameData[3]) << 24);
+}
+
+/**
+ * Write 64-bit little-endian value
+ *
+ * @param pFrameData encoding buffer, with room for 8 bytes
+ * @param nValue value to write
+ */
+static void lz4ultra_write_le64(unsigned char *pFrameData, const unsigned long long nValue) {
+   lz4ultra_write_le32(pFrameData, (unsigned int)(nValue & 0xffffffffU));
+   lz4ultra_write_le32(pFrameData + 4, (unsigned int)(nValue >> 32));
+}
+
+/**
+ * Read 64-bit little-endian value
+ *
+ * @param pFrameData data bytes, at least 8
+ *
+ * @return value
+ */
+static unsigned long long lz4ultra_read_le64(const unsigned char *pFrameData) {
+   return ((unsigned long long)lz4ultra_read_le32(pFrameData)) |
+      (((unsigned long long)lz4ultra_read_le32(pFrameData + 4)) << 32);
+}
+
+/**
+ * Encode header of the seek table, a skippable frame that follows the compressed frame and stores the compressed and decompressed size
+ * of each block. The header is followed by one entry per block, and by the seek table footer.
+ *
+ * @param pFrameData encoding buffer
+ * @param nMaxFrameDataSize max encoding buffer size, in bytes
+ * @param nBlocks number of blocks in the compressed frame
+ *
+ * @return number of encoded bytes, or -1 for failure
+ */
+int lz4ultra_encode_seek_table_header(unsigned char *pFrameData, const int nMaxFrameDataSize, const unsigned int nBlocks) {
+   if (nMaxFrameDataSize >= LZ4ULTRA_SEEK_TABLE_HEADER_SIZE && nBlocks <= LZ4ULTRA_SEEK_TABLE_MAX_BLOCKS) {
+      lz4ultra_write_le32(pFrameData, LZ4ULTRA_SEEK_TABLE_MAGIC);
+      lz4ultra_write_le32(pFrameData + 4, nBlocks * LZ4ULTRA_SEEK_TABLE_ENTRY_SIZE + LZ4ULTRA_SEEK_TABLE_FOOTER_SIZE);
+      return LZ4ULTRA_SEEK_TABLE_HEADER_SIZE;
+   }
+   else {
+      return LZ4ULTRA_ENCODE_ERR;
+   }
+}
+
+/**
+ * Encode seek table entry for one block
+ *
+ * @param pFrameData encoding buffer
+ * @param nMaxFrameDataSize max encoding buffer size, in bytes
+ * @param nCompressedSize size of the block in the compressed frame, including its frame header and checksum, in bytes
+ * @param nOriginalSize decompressed size of the block, in bytes
+ *
+ * @return number of encoded bytes, or -1 for failure
+ */
+int lz4ultra_encode_seek_table_entry(unsigned char *pFrameData, const int nMaxFrameDataSize, const unsigned int nCompressedSize, const unsigned int nOriginalSize) {
+   if (nMaxFrameDataSize >= LZ4ULTRA_SEEK_TABLE_ENTRY_SIZE) {
+      lz4ultra_write_le32(pFrameData, nCompressedSize);
+      lz4ultra_write_le32(pFrameData + 4, nOriginalSize);
+      return LZ4ULTRA_SEEK_TABLE_ENTRY_SIZE;
+   }
+   else {
+      return LZ4ULTRA_ENCODE_ERR;
+   }
+}
+
+/**
+ * Encode seek table footer, that ends the seek table so that it can be found from the end of the file
+ *
+ * @param pFrameData encoding buffer
+ * @param nMaxFrameDataSize max encoding buffer size, in bytes
+ * @param nBlocks number of blocks in the compressed frame
+ *
+ * @return number of encoded bytes, or -1 for failure
+ */
+int lz4ultra_encode_seek_table_footer(unsigned char *pFrameData, const int nMaxFrameDataSize, const unsigned int nBlocks) {
+   if (nMaxFrameDataSize >= LZ4ULTRA_SEEK_TABLE_FOOTER_SIZE && nBlocks <= LZ4ULTRA_SEEK_TABLE_MAX_BLOCKS) {
+      lz4ultra_write_le32(pFrameData, nBlocks);
+      lz4ultra_write_le32(pFrameData + 4, LZ4ULTRA_SEEK_TABLE_FOOTER_MAGIC);
+      return LZ4ULTRA_SEEK_TABLE_FOOTER_SIZE;
+   }
+   else {
+      return LZ4ULTRA_ENCODE_ERR;
+   }
+}
+
+/**
+ * Decode seek table header
+ *
+ * @param pFrameData data bytes
+ * @param nFrameDataSize number of bytes to decode
+ * @param nBlocks number of blocks, as decoded from the seek table footer
+ *
+ * @return LZ4ULTRA_DECODE_OK for success, or LZ4ULTRA_DECODE_ERR_FORMAT for failure
+ */
+int lz4ultra_decode_seek_table_header(const unsigned char *pFrameData, const int nFrameDataSize, const unsigned int nBlocks) {
+   if (nFrameDataSize == LZ4ULTRA_SEEK_TABLE_HEADER_SIZE && nBlocks <= LZ4ULTRA_SEEK_TABLE_MAX_BLOCKS &&
+       lz4ultra_read_le32(pFrameData) == LZ4ULTRA_SEEK_TABLE_MAGIC &&
+       lz4ultra_read_le32(pFrameData + 4) == (nBlocks * LZ4ULTRA_SEEK_TABLE_ENTRY_SIZE + LZ4ULTRA_SEEK_TABLE_FOOTER_SIZE)) {
+      return LZ4ULTRA_DECODE_OK;
+   }
+   else {
+      return LZ4ULTRA_DECODE_ERR_FORMAT;
+   }
+}
+
+/**
+ * Decode seek table entry for one block
+ *
+ * @param pFrameData data bytes
+ * @param nFrameDataSize number of bytes to decode
+ * @param pCompressedSize pointer to size of the block in the compressed frame, including its frame header and checksum, updated if this function succeeds
+ * @param pOriginalSize pointer to decompressed size of the block, updated if this function succeeds
+ *
+ * @return LZ4ULTRA_DECODE_OK for success, or LZ4ULTRA_DECODE_ERR_FORMAT for failure
+ */
+int lz4ultra_decode_seek_table_entry(const unsigned char *pFrameData, const int nFrameDataSize, unsigned int *pCompressedSize, unsigned int *pOriginalSize) {
+   if (nFrameDataSize == LZ4ULTRA_SEEK_TABLE_ENTRY_SIZE) {
+      *pCompressedSize = lz4ultra_read_le32(pFrameData);
+      *pOriginalSize = lz4ultra_read_le32(pFrameData + 4);
+      return LZ4ULTRA_DECODE_OK;
+   }
+   else {
+      return LZ4ULTRA_DECODE_ERR_FORMAT;
+   }
+}
+
+/**
+ * Decode seek table footer
+ *
+ * @param pFrameData data bytes
+ * @param nFrameDataSize number of bytes to decode
+ * @param pBlocks pointer to number of blocks, updated if this function succeeds
+ *
+ * @return LZ4ULTRA_DECODE_OK for success, or LZ4ULTRA_DECODE_ERR_FORMAT if the data isn't a seek table footer
+ */
+int lz4ultra_decode_seek_table_footer(const unsigned char *pFrameData, const int nFrameDataSize, unsigned int *pBlocks) {
+   if (nFrameDataSize == LZ4ULTRA_SEEK_TABLE_FOOTER_SIZE && lz4ultra_read_le32(pFrameData + 4) == LZ4ULTRA_SEEK_TABLE_FOOTER_MAGIC &&
+       lz4ultra_read_le32(pFrameData) <= LZ4ULTRA_SEEK_TABLE_MAX_BLOCKS) {
+      *pBlocks = lz4ultra_read_le32(pFrameData);
+      return LZ4ULTRA_DECODE_OK;
+   }
+   else {
+      return LZ4ULTRA_DECODE_ERR_FORMAT;
+   }
+}
+
+/**
+ * Encode header of the deduplication index, a skippable frame that precedes the compressed frame of deduplicated data, and lists the ranges
+ * of the original data that were left out of the compressed frame as they repeat earlier ranges. The header is followed by one entry per range
+ *
+ * @param pFrameData encoding buffer
+ * @param nMaxFrameDataSize max encoding buffer size, in bytes
+ * @param nRefs number of repeated ranges
+ * @param nOriginalSize size of the original data, with the repeated ranges
+ *
+ * @return number of encoded bytes, or -1 for failure
+ */
+int lz4ultra_encode_dedup_header(unsigned char *pFrameData, const int nMaxFrameDataSize, const unsigned int nRefs, const long long nOriginalSize) {
+   if (nMaxFrameDataSize >= LZ4ULTRA_DEDUP_HEADER_SIZE && nRefs <= LZ4ULTRA_DEDUP_MAX_REFS && nOriginalSize >= 0) {
+      lz4ultra_write_le32(pFrameData, LZ4ULTRA_DEDUP_MAGIC);
+      lz4ultra_write_le32(pFrameData + 4, (LZ4ULTRA_DEDUP_HEADER_SIZE - LZ4ULTRA_SKIPPABLE_HEADER_SIZE) + nRefs * LZ4ULTRA_DEDUP_ENTRY_SIZE);
+      lz4ultra_write_le32(pFrameData + 8, LZ4ULTRA_DEDUP_SIGNATURE);
+      lz4ultra_write_le32(pFrameData + 12, nRefs);
+      lz4ultra_write_le64(pFrameData + 16, (unsigned long long)nOriginalSize);
+      return LZ4ULTRA_DEDUP_HEADER_SIZE;
+   }
+   else {
+      return LZ4ULTRA_ENCODE_ERR;
+   }
+}
+
+/**
+ * Encode deduplication index entry for one repeated range
+ *
+ * @param pFrameData encoding buffer
+ * @param nMaxFrameDataSize max encoding buffer size, in bytes
+ * @param nOffset offset of the repeated range in the original data
+ * @param nSourceOffset offset of the earlier range that it repeats, in the original data
+ * @param nSize size of the range, in bytes
+ *
+ * @return number of encoded bytes, or -1 for failure
+ */
+int lz4ultra_encode_dedup_entry(unsigned char *pFrameData, const int nMaxFrameDataSize, const long long nOffset, const long long nSourceOffset, const unsigned int nSize) {
+   if (nMaxFrameDataSize >= LZ4ULTRA_DEDUP_ENTRY_SIZE && nSourceOffset >= 0 && nOffset > nSourceOffset) {
+      lz4ultra_write_le64(pFrameData, (unsigned long long)nOffset);
+      lz4ultra_write_le64(pFrameData + 8, (unsigned long long)nSourceOffset);
+      lz4ultra_write_le32(pFrameData + 16, nSize);
+      return LZ4ULTRA_DEDUP_ENTRY_SIZE;
+   }
+   else {
+      return LZ4ULTRA_ENCODE_ERR;
+   }
+}
+
+/**
+ * Check if a skippable frame header starts a deduplication index
+ *
+ * @param pFrameData data bytes
+ * @param nFrameDataSize number of bytes to decode
+ *
+ * @return nonzero if the data is the header of a deduplication index, 0 if not
+ */
+int lz4ultra_is_dedup_header(const unsigned char *pFrameData, const int nFrameDataSize) {
+   return (nFrameDataSize >= LZ4ULTRA_SKIPPABLE_HEADER_SIZE && lz4ultra_read_le32(pFrameData) == LZ4ULTRA_DEDUP_MAGIC) ? 1 : 0;
+}
+
+/**
+ * Decode deduplication index header
+ *
+ * @param pFrameData data bytes
+ * @param nFrameDataSize number of bytes to decode
+ * @param pRefs pointer to number of repeated ranges, updated if this function succeeds
+ * @param pOriginalSize pointer to size of the original data, updated if this function succeeds
+ *
+ * @return LZ4ULTRA_DECODE_OK for success, or LZ4ULTRA_DECODE_ERR_FORMAT if the data isn't a deduplication index header
+ */
+int lz4ultra_decode_dedup_header(const unsigned char *pFrameData, const int nFrameDataSize, unsigned int *pRefs, long long *pOriginalSize) {
+   if (nFrameDataSize == LZ4ULTRA_DEDUP_HEADER_SIZE && lz4ultra_read_le32(pFrameData) == LZ4ULTRA_DEDUP_MAGIC &&
+       lz4ultra_read_le32(pFrameData + 8) == LZ4ULTRA_DEDUP_SIGNATURE) {
+      const unsigned int nRefs = lz4ultra_read_le32(pFrameData + 12);
+      const unsigned long long nOriginalSize = lz4ultra_read_le64(pFrameData + 16);
+
+      if (nRefs <= LZ4ULTRA_DEDUP_MAX_REFS && nOriginalSize <= 0x7fffffffffffffffULL &&
+          lz4ultra_read_le32(pFrameData + 4) == ((LZ4ULTRA_DEDUP_HEADER_SIZE - LZ4ULTRA_SKIPPABLE_HEADER_SIZE) + nRefs * LZ4ULTRA_DEDUP_ENTRY_SIZE)) {
+         *pRefs = nRefs;
+         *pOriginalSize = (long long)nOriginalSize;
+         return LZ4ULTRA_DECODE_OK;
+      }
+   }
+
+   return LZ4ULTRA_DECODE_ERR_FORMAT;
+}
+
+/**
+ * Decode deduplication index entry for one repeated range
+ *
+ * @param pFrameData data bytes
+ * @param nFrameDataSize number of bytes to decode
+ * @param pOffset pointer to offset of the repeated range in the original data, updated if this function succeeds
+ * @param pSourceOffset pointer to offset of the earlier range that it repeats, updated if this function succeeds
+ * @param pSize pointer to size of the range, updated if this function succeeds
+ *
+ * @return LZ4ULTRA_DECODE_OK for success, or LZ4ULTRA_DECODE_ERR_FORMAT for failure
+ */
+int lz4ultra_decode_dedup_entry(const unsigned char *pFrameData, const int nFrameDataSize, long long *pOffset, long long *pSourceOffset, unsigned int *pSize) {
+   if (nFrameDataSize == LZ4ULTRA_DEDUP_ENTRY_SIZE) {
+      const unsigned long long nOffset = lz4ultra_read_le64(pFrameData);
+      const unsigned long long nSourceOffset = lz4ultra_read_le64(pFrameData + 8);
+
+      if (nOffset <= 0x7fffffffffffffffULL && nSourceOffset < nOffset) {
+         *pOffset = (long long)nOffset;
+         *pSourceOffset = (long long)nSourceOffset;
+         *pSize = lz4ultra_read_le32(pFrameData + 16);
+         return LZ4ULTRA_DECODE_OK;
+      }
+   }
+
+   return LZ4ULTRA_DECODE_ERR_FORMAT;
+}
@@ -1,130 +1,323 @@
-/*
- * frame.h - lz4 frame definitions
- *
- * Copyright (C) 2019 Emmanuel Marty
- *
- * This software is provided 'as-is', without any express or implied
- * warranty.  In no event will the authors be held liable for any damages
- * arising from the use of this software.
- *
- * Permission is granted to anyone to use this software for any purpose,
- * including commercial applications, and to alter it and redistribute it
- * freely, subject to the following restrictions:
- *
- * 1. The origin of this software must not be misrepresented; you must not
- *    claim that you wrote the original software. If you use this software
- *    in a product, an acknowledgment in the product documentation would be
- *    appreciated but is not required.
- * 2. Altered source versions must be plainly marked as such, and must not be
- *    misrepresented as being the original software.
- * 3. This notice may not be removed or altered from any source distribution.
- */
-
-/*
- * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
- *
- * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
- * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
- * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
- * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
- *
- */
-
-#ifndef _FRAME_H
-#define _FRAME_H
-
-#include <stdio.h>
-
-#define LZ4ULTRA_HEADER_SIZE        4
-#define LZ4ULTRA_MAX_HEADER_SIZE    7
-#define LZ4ULTRA_FRAME_SIZE         4
-
-#define LZ4ULTRA_ENCODE_ERR         (-1)
-
-#define LZ4ULTRA_DECODE_OK          0
-#define LZ4ULTRA_DECODE_ERR_FORMAT  (-1)
-#define LZ4ULTRA_DECODE_ERR_SUM     (-2)
-
-/**
- * Encode compressed stream header
- *
- * @param pFrameData encoding buffer
- * @param nMaxFrameDataSize max encoding buffer size, in bytes
- * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
- * @param nBlockMaxCode max block size code (4-7)
- *
- * @return number of encoded bytes, or -1 for failure
- */
-int lz4ultra_encode_header(unsigned char *pFrameData, const int nMaxFrameDataSize, const unsigned int nFlags, int nBlockMaxCode);
-
-/**
- * Encode compressed block frame header
- *
- * @param pFrameData encoding buffer
- * @param nMaxFrameDataSize max encoding buffer size, in bytes
- * @param nFlags compression flags
- * @param nBlockDataSize compressed block's data size, in bytes
- *
- * @return number of encoded bytes, or -1 for failure
- */
-int lz4ultra_encode_compressed_block_frame(unsigned char *pFrameData, const int nMaxFrameDataSize, const unsigned int nFlags, const int nBlockDataSize);
-
-/**
- * Encode uncompressed block frame header
- *
- * @param pFrameData encoding buffer
- * @param nMaxFrameDataSize max encoding buffer size, in bytes
- * @param nFlags compression flags
- * @param nBlockDataSize uncompressed block's data size, in bytes
- *
- * @return number of encoded bytes, or -1 for failure
- */
-int lz4ultra_encode_uncompressed_block_frame(unsigned char *pFrameData, const int nMaxFrameDataSize, const unsigned int nFlags, const int nBlockDataSize);
-
-/**
- * Encode terminal frame header
- *
- * @param pFrameData encoding buffer
- * @param nMaxFrameDataSize max encoding buffer size, in bytes
- * @param nFlags compression flags
- *
- * @return number of encoded bytes, or -1 for failure
- */
-int lz4ultra_encode_footer_frame(unsigned char *pFrameData, const int nMaxFrameDataSize, const unsigned int nFlags);
-
-/**
- * Check compressed stream header
- *
- * @param pFrameData data bytes
- * @param nFrameDataSize number of bytes to check
- *
- * @return the number of extra header bytes to read for decoding, or LZ4ULTRA_DECODE_ERR_xxx for failure
- */
-int lz4ultra_check_header(const unsigned char *pFrameData, const int nFrameDataSize);
-
-/**
- * Decode compressed stream header
- *
- * @param pFrameData data bytes
- * @param nFrameDataSize number of bytes to decode
- * @param nBlockMaxCode pointer to max block size code (4-7), updated if this function succeeds
- * @param nFlags returned compression flags
- *
- * @return LZ4ULTRA_DECODE_OK for success, or LZ4ULTRA_DECODE_ERR_xxx for failure
- */
-int lz4ultra_decode_header(const unsigned char *pFrameData, const int nFrameDataSize, int *nBlockMaxCode, unsigned int *nFlags);
-
-/**
- * Decode frame header
- *
- * @param pFrameData data bytes
- * @param nFrameDataSize number of bytes to decode
- * @param nFlags compression flags
- * @param nBlockSize pointer to block size, updated if this function succeeds (set to 0 if this is the terminal frame)
- * @param nIsUncompressed pointer to compressed block flag, updated if this function succeeds
- *
- * @return LZ4ULTRA_DECODE_OK for success, or LZ4ULTRA_DECODE_ERR_FORMAT for failure
- */
-int lz4ultra_decode_frame(const unsigned char *pFrameData, const int nFrameDataSize, const unsigned int nFlags, unsigned int *nBlockSize, int *nIsUncompressed);
-
-#endif /* _FRAME_H */
+/*
+ * frame.h - lz4 frame definitions
+ *
+ * Copyright (C) 2019 Emmanuel Marty
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*
+ * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
+ *
+ * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
+ * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
+ * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
+ * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
+ *
+ */
+
+#ifndef _FRAME_H
+#define _FRAME_H
+
+#include <stdio.h>
+
+#define LZ4ULTRA_HEADER_SIZE        4
+#define LZ4ULTRA_MAX_HEADER_SIZE    15
+#define LZ4ULTRA_FRAME_SIZE         4
+#define LZ4ULTRA_CHECKSUM_SIZE      4
+
+#define LZ4ULTRA_SKIPPABLE_HEADER_SIZE    8
+#define LZ4ULTRA_SEEK_TABLE_HEADER_SIZE   8
+#define LZ4ULTRA_SEEK_TABLE_ENTRY_SIZE    8
+#define LZ4ULTRA_SEEK_TABLE_FOOTER_SIZE   8
+
+#define LZ4ULTRA_DEDUP_HEADER_SIZE        24
+#define LZ4ULTRA_DEDUP_ENTRY_SIZE         20
+
+#define LZ4ULTRA_ENCODE_ERR         (-1)
+
+#define LZ4ULTRA_DECODE_OK          0
+#define LZ4ULTRA_DECODE_ERR_FORMAT  (-1)
+#define LZ4ULTRA_DECODE_ERR_SUM     (-2)
+
+/**
+ * Encode compressed stream header
+ *
+ * @param pFrameData encoding buffer
+ * @param nMaxFrameDataSize max encoding buffer size, in bytes
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
+ * @param nBlockMaxCode max block size code (4-7)
+ * @param nContentSize size of the data to compress, stored when LZ4ULTRA_FLAG_CONTENT_SIZE is set, or -1 if unknown
+ *
+ * @return number of encoded bytes, or -1 for failure
+ */
+int lz4ultra_encode_header(unsigned char *pFrameData, const int nMaxFrameDataSize, const unsigned int nFlags, int nBlockMaxCode, const long long nContentSize);
+
+/**
+ * Encode compressed block frame header
+ *
+ * @param pFrameData encoding buffer
+ * @param nMaxFrameDataSize max encoding buffer size, in bytes
+ * @param nBlockDataSize compressed block's data size, in bytes
+ *
+ * @return number of encoded bytes, or -1 for failure
+ */
+int lz4ultra_encode_compressed_block_frame(unsigned char *pFrameData, const int nMaxFrameDataSize, const int nBlockDataSize);
+
+/**
+ * Encode uncompressed block frame header
+ *
+ * @param pFrameData encoding buffer
+ * @param nMaxFrameDataSize max encoding buffer size, in bytes
+ * @param nFlags compression flags
+ * @param nBlockDataSize uncompressed block's data size, in bytes
+ *
+ * @return number of encoded bytes, or -1 for failure
+ */
+int lz4ultra_encode_uncompressed_block_frame(unsigned char *pFrameData, const int nMaxFrameDataSize, const unsigned int nFlags, const int nBlockDataSize);
+
+/**
+ * Encode block checksum, that follows the data of each block when block checksums are enabled
+ *
+ * @param pFrameData encoding buffer
+ * @param nMaxFrameDataSize max encoding buffer size, in bytes
+ * @param nFlags compression flags
+ * @param nBlockChecksum XXH32 checksum of the block's data, as stored in the stream
+ *
+ * @return number of encoded bytes (0 if block checksums are disabled), or -1 for failure
+ */
+int lz4ultra_encode_block_checksum(unsigned char *pFrameData, const int nMaxFrameDataSize, const unsigned int nFlags, const unsigned int nBlockChecksum);
+
+/**
+ * Encode terminal frame header, followed by the content checksum when it is enabled
+ *
+ * @param pFrameData encoding buffer
+ * @param nMaxFrameDataSize max encoding buffer size, in bytes
+ * @param nFlags compression flags
+ * @param nContentChecksum XXH32 checksum of all the decompressed data, if content checksums are enabled
+ *
+ * @return number of encoded bytes, or -1 for failure
+ */
+int lz4ultra_encode_footer_frame(unsigned char *pFrameData, const int nMaxFrameDataSize, const unsigned int nFlags, const unsigned int nContentChecksum);
+
+/**
+ * Check compressed stream header. The header is variable-sized: this function is first called with the LZ4ULTRA_HEADER_SIZE bytes of
+ * the magic number, and then again with the extra bytes that it requests appended, until it returns 0 and the header can be decoded
+ *
+ * @param pFrameData data bytes
+ * @param nFrameDataSize number of bytes to check
+ *
+ * @return the number of extra header bytes to read, 0 if the whole header has been read, or LZ4ULTRA_DECODE_ERR_xxx for failure
+ */
+int lz4ultra_check_header(const unsigned char *pFrameData, const int nFrameDataSize);
+
+/**
+ * Decode compressed stream header
+ *
+ * @param pFrameData data bytes
+ * @param nFrameDataSize number of bytes to decode
+ * @param nBlockMaxCode pointer to max block size code (4-7), updated if this function succeeds
+ * @param nFlags returned compression flags
+ * @param pContentSize pointer to returned decompressed size, set to -1 if the header doesn't store it, or NULL
+ *
+ * @return LZ4ULTRA_DECODE_OK for success, or LZ4ULTRA_DECODE_ERR_xxx for failure
+ */
+int lz4ultra_decode_header(const unsigned char *pFrameData, const int nFrameDataSize, int *nBlockMaxCode, unsigned int *nFlags, long long *pContentSize);
+
+/**
+ * Decode skippable frame header
+ *
+ * @param pFrameData data bytes
+ * @param nFrameDataSize number of bytes to decode
+ * @param nSkipSize pointer to the size of the frame's data, that follows the header and is to be skipped, updated if this function succeeds
+ *
+ * @return LZ4ULTRA_DECODE_OK if this is the header of a skippable frame, or LZ4ULTRA_DECODE_ERR_FORMAT if not
+ */
+int lz4ultra_decode_skippable_header(const unsigned char *pFrameData, const int nFrameDataSize, unsigned int *nSkipSize);
+
+/**
+ * Decode frame header
+ *
+ * @param pFrameData data bytes
+ * @param nFrameDataSize number of bytes to decode
+ * @param nBlockSize pointer to block size, updated if this function succeeds (set to 0 if this is the terminal frame)
+ * @param nIsUncompressed pointer to compressed block flag, updated if this function succeeds
+ *
+ * @return LZ4ULTRA_DECODE_OK for success, or LZ4ULTRA_DECODE_ERR_FORMAT for failure
+ */
+int lz4ultra_decode_frame(const unsigned char *pFrameData, const int nFrameDataSize, unsigned int *nBlockSize, int *nIsUncompressed);
+
+/**
+ * Get size of the checksum that follows the data of each block
+ *
+ * @param nFlags compression flags
+ *
+ * @return size in bytes, 0 if block checksums are disabled
+ */
+int lz4ultra_get_block_checksum_size(const unsigned int nFlags);
+
+/**
+ * Get size of the checksum that follows the terminal frame
+ *
+ * @param nFlags compression flags
+ *
+ * @return size in bytes, 0 if content checksums are disabled
+ */
+int lz4ultra_get_content_checksum_size(const unsigned int nFlags);
+
+/**
+ * Decode block or content checksum, and check it against the checksum of the decompressed data
+ *
+ * @param pFrameData data bytes
+ * @param nFrameDataSize number of bytes to decode
+ * @param nChecksum expected XXH32 checksum
+ *
+ * @return LZ4ULTRA_DECODE_OK for success, LZ4ULTRA_DECODE_ERR_SUM if the checksums don't match, or LZ4ULTRA_DECODE_ERR_FORMAT for failure
+ */
+int lz4ultra_decode_checksum(const unsigned char *pFrameData, const int nFrameDataSize, const unsigned int nChecksum);
+
+/**
+ * Encode header of the seek table, a skippable frame that follows the compressed frame and stores the compressed and decompressed size
+ * of each block. The header is followed by one entry per block, and by the seek table footer.
+ *
+ * @param pFrameData encoding buffer
+ * @param nMaxFrameDataSize max encoding buffer size, in bytes
+ * @param nBlocks number of blocks in the compressed frame
+ *
+ * @return number of encoded bytes, or -1 for failure
+ */
+int lz4ultra_encode_seek_table_header(unsigned char *pFrameData, const int nMaxFrameDataSize, const unsigned int nBlocks);
+
+/**
+ * Encode seek table entry for one block
+ *
+ * @param pFrameData encoding buffer
+ * @param nMaxFrameDataSize max encoding buffer size, in bytes
+ * @param nCompressedSize size of the block in the compressed frame, including its frame header and checksum, in bytes
+ * @param nOriginalSize decompressed size of the block, in bytes
+ *
+ * @return number of encoded bytes, or -1 for failure
+ */
+int lz4ultra_encode_seek_table_entry(unsigned char *pFrameData, const int nMaxFrameDataSize, const unsigned int nCompressedSize, const unsigned int nOriginalSize);
+
+/**
+ * Encode seek table footer, that ends the seek table so that it can be found from the end of the file
+ *
+ * @param pFrameData encoding buffer
+ * @param nMaxFrameDataSize max encoding buffer size, in bytes
+ * @param nBlocks number of blocks in the compressed frame
+ *
+ * @return number of encoded bytes, or -1 for failure
+ */
+int lz4ultra_encode_seek_table_footer(unsigned char *pFrameData, const int nMaxFrameDataSize, const unsigned int nBlocks);
+
+/**
+ * Decode seek table header
+ *
+ * @param pFrameData data bytes
+ * @param nFrameDataSize number of bytes to decode
+ * @param nBlocks number of blocks, as decoded from the seek table footer
+ *
+ * @return LZ4ULTRA_DECODE_OK for success, or LZ4ULTRA_DECODE_ERR_FORMAT for failure
+ */
+int lz4ultra_decode_seek_table_header(const unsigned char *pFrameData, const int nFrameDataSize, const unsigned int nBlocks);
+
+/**
+ * Decode seek table entry for one block
+ *
+ * @param pFrameData data bytes
+ * @param nFrameDataSize number of bytes to decode
+ * @param pCompressedSize pointer to size of the block in the compressed frame, including its frame header and checksum, updated if this function succeeds
+ * @param pOriginalSize pointer to decompressed size of the block, updated if this function succeeds
+ *
+ * @return LZ4ULTRA_DECODE_OK for success, or LZ4ULTRA_DECODE_ERR_FORMAT for failure
+ */
+int lz4ultra_decode_seek_table_entry(const unsigned char *pFrameData, const int nFrameDataSize, unsigned int *pCompressedSize, unsigned int *pOriginalSize);
+
+/**
+ * Decode seek table footer
+ *
+ * @param pFrameData data bytes
+ * @param nFrameDataSize number of bytes to decode
+ * @param pBlocks pointer to number of blocks, updated if this function succeeds
+ *
+ * @return LZ4ULTRA_DECODE_OK for success, or LZ4ULTRA_DECODE_ERR_FORMAT if the data isn't a seek table footer
+ */
+int lz4ultra_decode_seek_table_footer(const unsigned char *pFrameData, const int nFrameDataSize, unsigned int *pBlocks);
+
+/**
+ * Encode header of the deduplication index, a skippable frame that precedes the compressed frame of deduplicated data, and lists the ranges
+ * of the original data that were left out of the compressed frame as they repeat earlier ranges. The header is followed by one entry per range
+ *
+ * @param pFrameData encoding buffer
+ * @param nMaxFrameDataSize max encoding buffer size, in bytes
+ * @param nRefs number of repeated ranges
+ * @param nOriginalSize size of the original data, with the repeated ranges
+ *
+ * @return number of encoded bytes, or -1 for failure
+ */
+int lz4ultra_encode_dedup_header(unsigned char *pFrameData, const int nMaxFrameDataSize, const unsigned int nRefs, const long long nOriginalSize);
+
+/**
+ * Encode deduplication index entry for one repeated range
+ *
+ * @param pFrameData encoding buffer
+ * @param nMaxFrameDataSize max encoding buffer size, in bytes
+ * @param nOffset offset of the repeated range in the original data
+ * @param nSourceOffset offset of the earlier range that it repeats, in the original data
+ * @param nSize size of the range, in bytes
+ *
+ * @return number of encoded bytes, or -1 for failure
+ */
+int lz4ultra_encode_dedup_entry(unsigned char *pFrameData, const int nMaxFrameDataSize, const long long nOffset, const long long nSourceOffset, const unsigned int nSize);
+
+/**
+ * Check if a skippable frame header starts a deduplication index
+ *
+ * @param pFrameData data bytes
+ * @param nFrameDataSize number of bytes to decode
+ *
+ * @return nonzero if the data is the header of a deduplication index, 0 if not
+ */
+int lz4ultra_is_dedup_header(const unsigned char *pFrameData, const int nFrameDataSize);
+
+/**
+ * Decode deduplication index header
+ *
+ * @param pFrameData data bytes
+ * @param nFrameDataSize number of bytes to decode
+ * @param pRefs pointer to number of repeated ranges, updated if this function succeeds
+ * @param pOriginalSize pointer to size of the original data, updated if this function succeeds
+ *
+ * @return LZ4ULTRA_DECODE_OK for success, or LZ4ULTRA_DECODE_ERR_FORMAT if the data isn't a deduplication index header
+ */
+int lz4ultra_decode_dedup_header(const unsigned char *pFrameData, const int nFrameDataSize, unsigned int *pRefs, long long *pOriginalSize);
+
+/**
+ * Decode deduplication index entry for one repeated range
+ *
+ * @param pFrameData data bytes
+ * @param nFrameDataSize number of bytes to decode
+ * @param pOffset pointer to offset of the repeated range in the original data, updated if this function succeeds
+ * @param pSourceOffset pointer to offset of the earlier range that it repeats, updated if this function succeeds
+ * @param pSize pointer to size of the range, updated if this function succeeds
+ *
+ * @return LZ4ULTRA_DECODE_OK for success, or LZ4ULTRA_DECODE_ERR_FORMAT for failure
+ */
+int lz4ultra_decode_dedup_entry(const unsigned char *pFrameData, const int nFrameDataSize, long long *pOffset, long long *pSourceOffset, unsigned int *pSize);
+
+#endif /* _FRAME_H */
@@ -0,0 +1,188 @@
+/*
+ * hashchain.c - hash chain match finder and parser, for fast compression levels
+ *
+ * Copyright (C) 2019 Emmanuel Marty
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*
+ * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
+ *
+ * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
+ * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
+ * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
+ * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "hashchain.h"
+#include "shrink_context.h"
+#include "format.h"
+#include "matchlen.h"
+#include "lib.h"
+
+/** Match finding and parsing parameters of a fast compression level */
+typedef struct {
+   int nMaxChainDepth;     /**< maximum number of earlier positions with the same hash to compare at each position */
+   int nNiceMatchLen;      /**< length at which a match is taken right away, without looking for a longer one */
+   int nLazy;              /**< 1 to look for a longer match at the next position before taking a match (lazy parsing), 0 for greedy parsing */
+} lz4ultra_hashchain_level;
+
+/** Parameters of the fast compression levels, from LZ4ULTRA_MIN_LEVEL to LZ4ULTRA_MAX_LEVEL - 1 */
+static const lz4ultra_hashchain_level g_hashChainLevels[LZ4ULTRA_MAX_LEVEL - LZ4ULTRA_MIN_LEVEL] = {
+   { 1, 16, 0 },
+   { 2, 32, 0 },
+   { 4, 32, 0 },
+   { 8, 64, 1 },
+   { 16, 64, 1 },
+   { 32, 128, 1 },
+   { 64, 256, 1 },
+   { 256, 512, 1 },
+   { 1024, 1024, 1 },
+};
+
+/**
+ * Hash the 4 bytes at the specified offset in the input window
+ *
+ * @param pInWindow pointer to input data window
+ * @param nOffset offset in input window
+ *
+ * @return hash value, from 0 to HASH_SIZE - 1
+ */
+static inline unsigned int lz4ultra_hashchain_hash(const unsigned char *pInWindow, const int nOffset) {
+   const unsigned char *pData = pInWindow + nOffset;
+   const unsigned int nValue = ((unsigned int)pData[0]) | (((unsigned int)pData[1]) << 8) | (((unsigned int)pData[2]) << 16) | (((unsigned int)pData[3]) << 24);
+
+   return (nValue * 2654435761U) >> (32 - HASH_BITS);
+}
+
+/**
+ * Find the longest match at the specified offset in the input window, among earlier positions with the same hash
+ *
+ * @param pCompressor compression context
+ * @param pInWindow pointer to input data window
+ * @param nOffset offset to find a match at, in the input window; all earlier positions must already have been inserted into the hash chain
+ * @param nMaxLen maximum match length
+ * @param pLevel parameters of the compression level
+ * @param pMatch pointer to returned match
+ *
+ * @return 1 if a match was found, 0 if not
+ */
+static int lz4ultra_hashchain_find_match(lz4ultra_compressor *pCompressor, const unsigned char *pInWindow, const int nOffset, const int nMaxLen, const lz4ultra_hashchain_level *pLevel, lz4ultra_match *pMatch) {
+   const unsigned char *pCur = pInWindow + nOffset;
+   const int *hash_chain = pCompressor->hash_chain;
+   int nCandidate = pCompressor->hash_heads[lz4ultra_hashchain_hash(pInWindow, nOffset)];
+   int nDepth = pLevel->nMaxChainDepth;
+   int nBestLen = 0;
+   int nBestOffset = 0;
+
+   while (nCandidate >= 0 && (nOffset - nCandidate) <= MAX_OFFSET && nDepth-- > 0) {
+      const unsigned char *pRef = pInWindow + nCandidate;
+
+      /* Only compare candidates that can be longer than the best match so far */
+      if (pRef[nBestLen] == pCur[nBestLen]) {
+         const int nLen = lz4ultra_get_match_len(pRef, pCur, 0, nMaxLen);
+
+         if (nLen > nBestLen) {
+            nBestLen = nLen;
+            nBestOffset = nOffset - nCandidate;
+            if (nLen >= pLevel->nNiceMatchLen || nLen >= nMaxLen)
+               break;
+         }
+      }
+
+      nCandidate = hash_chain[nCandidate];
+   }
+
+   if (nBestLen < MIN_MATCH_SIZE)
+      return 0;
+
+   pMatch->length = (unsigned int)nBestLen;
+   pMatch->offset = (unsigned int)nBestOffset;
+   return 1;
+}
+
+/**
+ * Find matches with a hash chain and select them with greedy or lazy parsing, according to the compression level, instead
+ * of finding all matches with the suffix array and running the optimal parser
+ *
+ * @param pCompressor compression context
+ * @param pInWindow pointer to input data window (previously compressed bytes + bytes to compress)
+ * @param nStartOffset current offset in input window (typically the number of previously compressed bytes)
+ * @param nEndOffset offset to end finding matches at (typically the size of the total input window in bytes
+ */
+void lz4ultra_hashchain_parse(lz4ultra_compressor *pCompressor, const unsigned char *pInWindow, const int nStartOffset, const int nEndOffset) {
+   const lz4ultra_hashchain_level *pLevel = &g_hashChainLevels[pCompressor->level - LZ4ULTRA_MIN_LEVEL];
+   const int nMatchEndOffset = nEndOffset - LAST_MATCH_OFFSET;  /* No match may start after this offset */
+   int *hash_heads = pCompressor->hash_heads;
+   int *hash_chain = pCompressor->hash_chain;
+   lz4ultra_match *pMatch = pCompressor->match;
+   int nNextInsertOffset = 0;
+   int i;
+
+   memset(hash_heads, 0xff, HASH_SIZE * sizeof(int));
+
+   for (i = nStartOffset; i < nEndOffset; ) {
+      lz4ultra_match match;
+      int nFound = 0;
+
+      if (i <= nMatchEndOffset) {
+         /* Insert all earlier positions, including the previously compressed bytes, into the hash chain */
+         for (; nNextInsertOffset < i; nNextInsertOffset++) {
+            const unsigned int nHash = lz4ultra_hashchain_hash(pInWindow, nNextInsertOffset);
+            hash_chain[nNextInsertOffset] = hash_heads[nHash];
+            hash_heads[nHash] = nNextInsertOffset;
+         }
+
+         nFound = lz4ultra_hashchain_find_match(pCompressor, pInWindow, i, (nEndOffset - LAST_LITERALS) - i, pLevel, &match);
+
+         if (nFound && pLevel->nLazy) {
+            /* Emit literals for as long as the next position has a longer match */
+            while ((int)match.length < pLevel->nNiceMatchLen && (i + 1) <= nMatchEndOffset) {
+               lz4ultra_match nextMatch;
+               const unsigned int nHash = lz4ultra_hashchain_hash(pInWindow, i);
+
+               hash_chain[i] = hash_heads[nHash];
+               hash_heads[nHash] = i;
+               nNextInsertOffset = i + 1;
+
+               if (!lz4ultra_hashchain_find_match(pCompressor, pInWindow, i + 1, (nEndOffset - LAST_LITERALS) - (i + 1), pLevel, &nextMatch) ||
+                  nextMatch.length <= match.length)
+                  break;
+
+               pMatch[i].length = 0;
+               pMatch[i].offset = 0;
+               i++;
+               match = nextMatch;
+            }
+         }
+      }
+
+      if (nFound) {
+         pMatch[i] = match;
+         i += match.length;
+      }
+      else {
+         pMatch[i].length = 0;
+         pMatch[i].offset = 0;
+         i++;
+      }
+   }
+}
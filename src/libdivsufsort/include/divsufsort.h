@@ -27,6 +27,8 @@
 #ifndef _DIVSUFSORT_H
 #define _DIVSUFSORT_H 1
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
@@ -50,10 +52,25 @@ typedef int saidx_t;
 #define PRIdSAIDX_T "d"
 #endif
 
+/*- job runner, used to sort the type B* buckets on several threads */
+typedef void (*divsufsort_job_t)(void *user_data, const int thread_index, const int job_index);
+typedef void (*divsufsort_run_jobs_t)(void *runner, divsufsort_job_t job, void *user_data, const int num_jobs);
+
+/*- memory allocator, used instead of malloc() and free() for the context's buckets */
+typedef void *(*divsufsort_alloc_t)(void *opaque, size_t size);
+typedef void (*divsufsort_free_t)(void *opaque, void *ptr);
+
 /*- divsufsort context */
 typedef struct _divsufsort_ctx_t {
    saidx_t *bucket_A;
    saidx_t *bucket_B;
+   saidx_t *bstar_ranges;
+   saint_t num_threads;
+   divsufsort_run_jobs_t run_jobs;
+   void *runner;
+   divsufsort_alloc_t alloc_func;
+   divsufsort_free_t free_func;
+   void *alloc_opaque;
 } divsufsort_ctx_t;
 
 /*- Prototypes -*/
@@ -61,9 +78,14 @@ typedef struct _divsufsort_ctx_t {
 /**
  * Initialize suffix array context
  *
+ * @param ctx suffix array context to initialize
+ * @param alloc_func function that allocates the context's memory, or NULL to use malloc() and free()
+ * @param free_func function that frees memory returned by alloc_func
+ * @param alloc_opaque opaque pointer passed to alloc_func and free_func
+ *
  * @return 0 for success, or non-zero in case of an error
  */
-int divsufsort_init(divsufsort_ctx_t *ctx);
+int divsufsort_init(divsufsort_ctx_t *ctx, divsufsort_alloc_t alloc_func, divsufsort_free_t free_func, void *alloc_opaque);
 
 /**
  * Destroy suffix array context
@@ -72,6 +94,18 @@ int divsufsort_init(divsufsort_ctx_t *ctx);
  */
 void divsufsort_destroy(divsufsort_ctx_t *ctx);
 
+/**
+ * Set the threads used to sort the type B* buckets when building suffix arrays
+ *
+ * @param ctx suffix array context
+ * @param num_threads number of threads that run_jobs may run jobs on (1 to sort serially)
+ * @param run_jobs function that runs num_jobs jobs, passing thread indices from 0 to num_threads - 1, and returns once they are all done
+ * @param runner opaque pointer passed to run_jobs
+ *
+ * @return 0 for success, or non-zero in case of an error
+ */
+int divsufsort_set_threads(divsufsort_ctx_t *ctx, saint_t num_threads, divsufsort_run_jobs_t run_jobs, void *runner);
+
 /**
  * Constructs the suffix array of a given string.
  * @param ctx suffix array context
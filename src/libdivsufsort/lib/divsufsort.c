@@ -32,10 +32,35 @@
 
 /*- Private Functions -*/
 
+#ifndef _OPENMP
+/* Type B* buckets to sort on several threads. */
+typedef struct _sssort_jobs_t {
+  const sauchar_t *T;
+  const saidx_t *PAb;
+  saidx_t *SA;
+  const saidx_t *ranges;
+  saidx_t *buf;
+  saidx_t bufsize;
+  saidx_t n;
+  saidx_t m;
+} sssort_jobs_t;
+
+/* Sorts one type B* bucket, using the working area of the thread running it. */
+static
+void
+sssort_job(void *user_data, const int thread_index, const int job_index) {
+  const sssort_jobs_t *jobs = (const sssort_jobs_t *)user_data;
+  saidx_t i = jobs->ranges[job_index * 2], j = jobs->ranges[job_index * 2 + 1];
+
+  sssort(jobs->T, jobs->PAb, jobs->SA + i, jobs->SA + j,
+         jobs->buf + thread_index * jobs->bufsize, jobs->bufsize, 2, jobs->n, *(jobs->SA + i) == (jobs->m - 1));
+}
+#endif
+
 /* Sorts suffixes of type B*. */
 static
 saidx_t
-sort_typeBstar(const sauchar_t *T, saidx_t *SA,
+sort_typeBstar(const divsufsort_ctx_t *ctx, const sauchar_t *T, saidx_t *SA,
                saidx_t *bucket_A, saidx_t *bucket_B,
                saidx_t n) {
   saidx_t *PAb, *ISAb, *buf;
@@ -130,13 +155,36 @@ note:
       }
     }
 #else
-    buf = SA + m, bufsize = n - (2 * m);
-    for(c0 = ALPHABET_SIZE - 2, j = m; 0 < j; --c0) {
-      for(c1 = ALPHABET_SIZE - 1; c0 < c1; j = i, --c1) {
-        i = BUCKET_BSTAR(c0, c1);
-        if(1 < (j - i)) {
-          sssort(T, PAb, SA + i, SA + j,
-                 buf, bufsize, 2, n, *(SA + i) == (m - 1));
+    if((ctx != NULL) && (1 < ctx->num_threads) && (ctx->run_jobs != NULL) && (ctx->bstar_ranges != NULL)) {
+      /* Collect the buckets that need sorting, and sort them on the caller's
+         threads, splitting the working area between the threads. */
+      sssort_jobs_t jobs;
+      saidx_t *ranges = ctx->bstar_ranges;
+      saint_t num_jobs = 0;
+
+      for(c0 = ALPHABET_SIZE - 2, j = m; 0 < j; --c0) {
+        for(c1 = ALPHABET_SIZE - 1; c0 < c1; j = i, --c1) {
+          i = BUCKET_BSTAR(c0, c1);
+          if(1 < (j - i)) {
+            ranges[num_jobs * 2] = i, ranges[num_jobs * 2 + 1] = j;
+            ++num_jobs;
+          }
+        }
+      }
+
+      jobs.T = T, jobs.PAb = PAb, jobs.SA = SA, jobs.ranges = ranges;
+      jobs.buf = SA + m, jobs.bufsize = (n - (2 * m)) / ctx->num_threads;
+      jobs.n = n, jobs.m = m;
+      ctx->run_jobs(ctx->runner, sssort_job, &jobs, num_jobs);
+    } else {
+      buf = SA + m, bufsize = n - (2 * m);
+      for(c0 = ALPHABET_SIZE - 2, j = m; 0 < j; --c0) {
+        for(c1 = ALPHABET_SIZE - 1; c0 < c1; j = i, --c1) {
+          i = BUCKET_BSTAR(c0, c1);
+          if(1 < (j - i)) {
+            sssort(T, PAb, SA + i, SA + j,
+                   buf, bufsize, 2, n, *(SA + i) == (m - 1));
+          }
         }
       }
     }
@@ -327,17 +375,57 @@ construct_BWT(const sauchar_t *T, saidx_t *SA,
 
 /*---------------------------------------------------------------------------*/
 
+/**
+ * Allocate memory for a suffix array context
+ *
+ * @param ctx suffix array context
+ * @param size number of bytes to allocate
+ *
+ * @return allocated memory, or NULL for failure
+ */
+static void *divsufsort_alloc(divsufsort_ctx_t *ctx, size_t size) {
+   if (ctx->alloc_func != NULL)
+      return ctx->alloc_func(ctx->alloc_opaque, size);
+   else
+      return malloc(size);
+}
+
+/**
+ * Free memory allocated with divsufsort_alloc()
+ *
+ * @param ctx suffix array context
+ * @param ptr memory to free
+ */
+static void divsufsort_free(divsufsort_ctx_t *ctx, void *ptr) {
+   if (ctx->alloc_func != NULL)
+      ctx->free_func(ctx->alloc_opaque, ptr);
+   else
+      free(ptr);
+}
+
 /**
  * Initialize suffix array context
  *
+ * @param ctx suffix array context to initialize
+ * @param alloc_func function that allocates the context's memory, or NULL to use malloc() and free()
+ * @param free_func function that frees memory returned by alloc_func
+ * @param alloc_opaque opaque pointer passed to alloc_func and free_func
+ *
  * @return 0 for success, or non-zero in case of an error
  */
-int divsufsort_init(divsufsort_ctx_t *ctx) {
-   ctx->bucket_A = (saidx_t *)malloc(BUCKET_A_SIZE * sizeof(saidx_t));
+int divsufsort_init(divsufsort_ctx_t *ctx, divsufsort_alloc_t alloc_func, divsufsort_free_t free_func, void *alloc_opaque) {
+   ctx->alloc_func = alloc_func;
+   ctx->free_func = free_func;
+   ctx->alloc_opaque = alloc_opaque;
+   ctx->bucket_A = (saidx_t *)divsufsort_alloc(ctx, BUCKET_A_SIZE * sizeof(saidx_t));
    ctx->bucket_B = NULL;
+   ctx->bstar_ranges = NULL;
+   ctx->num_threads = 1;
+   ctx->run_jobs = NULL;
+   ctx->runner = NULL;
 
    if (ctx->bucket_A) {
-      ctx->bucket_B = (saidx_t *)malloc(BUCKET_B_SIZE * sizeof(saidx_t));
+      ctx->bucket_B = (saidx_t *)divsufsort_alloc(ctx, BUCKET_B_SIZE * sizeof(saidx_t));
 
       if (ctx->bucket_B)
          return 0;
@@ -353,17 +441,48 @@ int divsufsort_init(divsufsort_ctx_t *ctx) {
  * @param ctx suffix array context to destroy
  */
 void divsufsort_destroy(divsufsort_ctx_t *ctx) {
+   if (ctx->bstar_ranges) {
+      divsufsort_free(ctx, ctx->bstar_ranges);
+      ctx->bstar_ranges = NULL;
+   }
+
    if (ctx->bucket_B) {
-      free(ctx->bucket_B);
+      divsufsort_free(ctx, ctx->bucket_B);
       ctx->bucket_B = NULL;
    }
 
    if (ctx->bucket_A) {
-      free(ctx->bucket_A);
+      divsufsort_free(ctx, ctx->bucket_A);
       ctx->bucket_A = NULL;
    }
 }
 
+/**
+ * Set the threads used to sort the type B* buckets when building suffix arrays
+ *
+ * @param ctx suffix array context
+ * @param num_threads number of threads that run_jobs may run jobs on (1 to sort serially)
+ * @param run_jobs function that runs num_jobs jobs, passing thread indices from 0 to num_threads - 1, and returns once they are all done
+ * @param runner opaque pointer passed to run_jobs
+ *
+ * @return 0 for success, or non-zero in case of an error
+ */
+int divsufsort_set_threads(divsufsort_ctx_t *ctx, saint_t num_threads, divsufsort_run_jobs_t run_jobs, void *runner) {
+   if (num_threads > 1 && run_jobs != NULL && ctx->bstar_ranges == NULL) {
+      /* Start and end of each type B* bucket (c0 < c1); there are fewer than BUCKET_B_SIZE / 2 of them */
+      ctx->bstar_ranges = (saidx_t *)divsufsort_alloc(ctx, BUCKET_B_SIZE * sizeof(saidx_t));
+      if (ctx->bstar_ranges == NULL)
+         return -1;
+   }
+
+   if (num_threads < 1 || run_jobs == NULL)
+      num_threads = 1;
+   ctx->num_threads = num_threads;
+   ctx->run_jobs = run_jobs;
+   ctx->runner = runner;
+   return 0;
+}
+
 /*- Function -*/
 
 saint_t
@@ -379,7 +498,7 @@ divsufsort_build_array(divsufsort_ctx_t *ctx, const sauchar_t *T, saidx_t *SA, s
 
   /* Suffixsort. */
   if((ctx->bucket_A != NULL) && (ctx->bucket_B != NULL)) {
-    m = sort_typeBstar(T, SA, ctx->bucket_A, ctx->bucket_B, n);
+    m = sort_typeBstar(ctx, T, SA, ctx->bucket_A, ctx->bucket_B, n);
     construct_SA(T, SA, ctx->bucket_A, ctx->bucket_B, n, m);
   } else {
     err = -2;
@@ -405,7 +524,7 @@ divbwt(const sauchar_t *T, sauchar_t *U, saidx_t *A, saidx_t n) {
 
   /* Burrows-Wheeler Transform. */
   if((B != NULL) && (bucket_A != NULL) && (bucket_B != NULL)) {
-    m = sort_typeBstar(T, B, bucket_A, bucket_B, n);
+    m = sort_typeBstar(NULL, T, B, bucket_A, bucket_B, n);
     pidx = construct_BWT(T, B, bucket_A, bucket_B, n, m);
 
     /* Copy to output string. */
@@ -1,1020 +1,3518 @@
-/*
- * main.c - command line optimal compression utility for the lz4 format
- *
- * Copyright (C) 2019 Emmanuel Marty
- *
- * This software is provided 'as-is', without any express or implied
- * warranty.  In no event will the authors be held liable for any damages
- * arising from the use of this software.
- *
- * Permission is granted to anyone to use this software for any purpose,
- * including commercial applications, and to alter it and redistribute it
- * freely, subject to the following restrictions:
- *
- * 1. The origin of this software must not be misrepresented; you must not
- *    claim that you wrote the original software. If you use this software
- *    in a product, an acknowledgment in the product documentation would be
- *    appreciated but is not required.
- * 2. Altered source versions must be plainly marked as such, and must not be
- *    misrepresented as being the original software.
- * 3. This notice may not be removed or altered from any source distribution.
- */
-
-/*
- * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
- *
- * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
- * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
- * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
- * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
- *
- */
-
-#include <stdio.h>
-#include <stdbool.h>
-#include <stdlib.h>
-#include <string.h>
-#ifdef _WIN32
-#include <windows.h>
-#include <sys/timeb.h>
-#else
-#include <sys/time.h>
-#endif
-#include "lib.h"
-#include "format.h"
-#include "frame.h"
-
-#define OPT_VERBOSE        1
-#define OPT_FAVOR_RATIO    2
-#define OPT_RAW            4
-#define OPT_INDEP_BLOCKS   8
-#define OPT_LEGACY_FRAMES  16
-
-#define TOOL_VERSION "1.3.0"
-
-/*---------------------------------------------------------------------------*/
-
-#ifdef _WIN32
-LARGE_INTEGER hpc_frequency;
-BOOL hpc_available = FALSE;
-#endif
-
-static void do_init_time() {
-#ifdef _WIN32
-   hpc_frequency.QuadPart = 0;
-   hpc_available = QueryPerformanceFrequency(&hpc_frequency);
-#endif
-}
-
-static long long do_get_time() {
-   long long nTime;
-
-#ifdef _WIN32
-   if (hpc_available) {
-      LARGE_INTEGER nCurTime;
-
-      /* Use HPC hardware for best precision */
-      QueryPerformanceCounter(&nCurTime);
-      nTime = (long long)(nCurTime.QuadPart * 1000000LL / hpc_frequency.QuadPart);
-   }
-   else {
-      struct _timeb tb;
-      _ftime(&tb);
-
-      nTime = ((long long)tb.time * 1000LL + (long long)tb.millitm) * 1000LL;
-   }
-#else
-   struct timeval tm;
-   gettimeofday(&tm, NULL);
-
-   nTime = (long long)tm.tv_sec * 1000000LL + (long long)tm.tv_usec;
-#endif
-   return nTime;
-}
-
-/*---------------------------------------------------------------------------*/
-
-static void compression_start(int nBlockMaxCode, const unsigned int nFlags) {
-   const int nBlockMaxBits = 8 + (nBlockMaxCode << 1);
-   const int nBlockMaxSize = 1 << nBlockMaxBits;
-
-   fprintf(stdout, "Use %d Kb blocks, independent blocks: %s\n", nBlockMaxSize >> 10, (nFlags & LZ4ULTRA_FLAG_INDEP_BLOCKS) ? "yes" : "no");
-}
-
-static void compression_progress(long long nOriginalSize, long long nCompressedSize) {
-   fprintf(stdout, "\r%lld => %lld (%g %%)     \b\b\b\b\b", nOriginalSize, nCompressedSize, (double)(nCompressedSize * 100.0 / nOriginalSize));
-   fflush(stdout);
-}
-
-static int do_compress(const char *pszInFilename, const char *pszOutFilename, const char *pszDictionaryFilename, const unsigned int nOptions, int nBlockMaxCode) {
-   long long nStartTime = 0LL, nEndTime = 0LL;
-   long long nOriginalSize = 0LL, nCompressedSize = 0LL;
-   lz4ultra_status_t nStatus;
-   int nCommandCount = 0;
-   int nFlags;
-
-   nFlags = 0;
-   if (nOptions & OPT_FAVOR_RATIO)
-      nFlags |= LZ4ULTRA_FLAG_FAVOR_RATIO;
-   if (nOptions & OPT_RAW)
-      nFlags |= LZ4ULTRA_FLAG_RAW_BLOCK;
-   if (nOptions & OPT_INDEP_BLOCKS)
-      nFlags |= LZ4ULTRA_FLAG_INDEP_BLOCKS;
-   if (nOptions & OPT_LEGACY_FRAMES)
-      nFlags |= LZ4ULTRA_FLAG_LEGACY_FRAMES;
-
-   if (nOptions & OPT_VERBOSE) {
-      nStartTime = do_get_time();
-   }
-
-   nStatus = lz4ultra_compress_file(pszInFilename, pszOutFilename, pszDictionaryFilename, nFlags, nBlockMaxCode,
-      (nOptions & OPT_VERBOSE) ? compression_start : NULL, compression_progress,
-      &nOriginalSize, &nCompressedSize, &nCommandCount);
-   switch (nStatus) {
-   case LZ4ULTRA_ERROR_SRC: fprintf(stderr, "error reading '%s'\n", pszInFilename); break;
-   case LZ4ULTRA_ERROR_DST: fprintf(stderr, "error writing '%s'\n", pszOutFilename); break;
-   case LZ4ULTRA_ERROR_DICTIONARY: fprintf(stderr, "error reading dictionary '%s'\n", pszDictionaryFilename); break;
-   case LZ4ULTRA_ERROR_MEMORY: fprintf(stderr, "out of memory\n"); break;
-   case LZ4ULTRA_ERROR_COMPRESSION: fprintf(stderr, "internal compression error\n"); break;
-   case LZ4ULTRA_ERROR_RAW_TOOLARGE: fprintf(stderr, "error: raw blocks can only be used with files <= 4 Mb\n"); break;
-   case LZ4ULTRA_ERROR_RAW_UNCOMPRESSED: fprintf(stderr, "error: data is incompressible, raw blocks only support compressed data\n"); break;
-   case LZ4ULTRA_OK: break;
-   default: fprintf(stderr, "unknown compression error %d\n", nStatus); break;
-   }
-
-   if (nStatus)
-      return 100;
-
-   if (nOptions & OPT_VERBOSE) {
-      nEndTime = do_get_time();
-
-      double fDelta = ((double)(nEndTime - nStartTime)) / 1000000.0;
-      double fSpeed = ((double)nOriginalSize / 1048576.0) / fDelta;
-      fprintf(stdout, "\rCompressed '%s' in %g seconds, %.02g Mb/s, %d tokens (%lld bytes/token), %lld into %lld bytes ==> %g %%\n",
-         pszInFilename, fDelta, fSpeed, nCommandCount, nCommandCount ? (nOriginalSize / ((long long)nCommandCount)) : 0,
-         nOriginalSize, nCompressedSize, nOriginalSize ? (double)(nCompressedSize * 100.0 / nOriginalSize) : 100.0);
-   }
-
-   return 0;
-}
-
-/*---------------------------------------------------------------------------*/
-
-static int do_decompress(const char *pszInFilename, const char *pszOutFilename, const char *pszDictionaryFilename, const unsigned int nOptions) {
-   long long nStartTime = 0LL, nEndTime = 0LL;
-   long long nOriginalSize = 0LL, nCompressedSize = 0LL;
-   lz4ultra_status_t nStatus;
-   int nFlags;
-
-   nFlags = 0;
-   if (nOptions & OPT_RAW)
-      nFlags |= LZ4ULTRA_FLAG_RAW_BLOCK;
-
-   if (nOptions & OPT_VERBOSE) {
-      nStartTime = do_get_time();
-   }
-
-   nStatus = lz4ultra_decompress_file(pszInFilename, pszOutFilename, pszDictionaryFilename, nFlags, &nOriginalSize, &nCompressedSize);
-
-   switch (nStatus) {
-   case LZ4ULTRA_ERROR_SRC: fprintf(stderr, "error reading '%s'\n", pszInFilename); break;
-   case LZ4ULTRA_ERROR_DST: fprintf(stderr, "error comparing compressed file '%s' with original '%s'\n", pszInFilename, pszOutFilename); break;
-   case LZ4ULTRA_ERROR_DICTIONARY: fprintf(stderr, "error reading dictionary '%s'\n", pszDictionaryFilename); break;
-   case LZ4ULTRA_ERROR_MEMORY: fprintf(stderr, "out of memory\n"); break;
-   case LZ4ULTRA_ERROR_FORMAT: fprintf(stderr, "invalid magic number, version, flags, or block size in input file\n"); break;
-   case LZ4ULTRA_ERROR_CHECKSUM: fprintf(stderr, "invalid checksum in input file\n"); break;
-   case LZ4ULTRA_ERROR_DECOMPRESSION: fprintf(stderr, "internal decompression error\n"); break;
-   case LZ4ULTRA_OK: break;
-   default: fprintf(stderr, "unknown decompression error %d\n", nStatus); break;
-   }
-
-   if (nStatus) {
-      fprintf(stderr, "decompression error for '%s'\n", pszInFilename);
-      return 100;
-   }
-   else {
-      if (nOptions & OPT_VERBOSE) {
-         nEndTime = do_get_time();
-         double fDelta = ((double)(nEndTime - nStartTime)) / 1000000.0;
-         double fSpeed = ((double)nOriginalSize / 1048576.0) / fDelta;
-         fprintf(stdout, "Decompressed '%s' in %g seconds, %g Mb/s\n",
-            pszInFilename, fDelta, fSpeed);
-      }
-
-      return 0;
-   }
-}
-
-/*---------------------------------------------------------------------------*/
-
-typedef struct {
-   FILE *f;
-   void *pCompareDataBuf;
-   size_t nCompareDataSize;
-} compare_stream_t;
-
-void comparestream_close(lz4ultra_stream_t *stream) {
-   if (stream->obj) {
-      compare_stream_t *pCompareStream = (compare_stream_t *)stream->obj;
-      if (pCompareStream->pCompareDataBuf) {
-         free(pCompareStream->pCompareDataBuf);
-         pCompareStream->pCompareDataBuf = NULL;
-      }
-
-      fclose(pCompareStream->f);
-      free(pCompareStream);
-
-      stream->obj = NULL;
-      stream->read = NULL;
-      stream->write = NULL;
-      stream->eof = NULL;
-      stream->close = NULL;
-   }
-}
-
-size_t comparestream_read(lz4ultra_stream_t *stream, void *ptr, size_t size) {
-   return 0;
-}
-
-size_t comparestream_write(lz4ultra_stream_t *stream, void *ptr, size_t size) {
-   compare_stream_t *pCompareStream = (compare_stream_t *)stream->obj;
-
-   if (!pCompareStream->pCompareDataBuf || pCompareStream->nCompareDataSize < size) {
-      pCompareStream->nCompareDataSize = size;
-      pCompareStream->pCompareDataBuf = realloc(pCompareStream->pCompareDataBuf, pCompareStream->nCompareDataSize);
-      if (!pCompareStream->pCompareDataBuf)
-         return 0;
-   }
-
-   size_t nReadBytes = fread(pCompareStream->pCompareDataBuf, 1, size, pCompareStream->f);
-   if (nReadBytes != size) {
-      return 0;
-   }
-
-   if (memcmp(ptr, pCompareStream->pCompareDataBuf, size)) {
-      return 0;
-   }
-
-   return size;
-}
-
-int comparestream_eof(lz4ultra_stream_t *stream) {
-   compare_stream_t *pCompareStream = (compare_stream_t *)stream->obj;
-   return feof(pCompareStream->f);
-}
-
-int comparestream_open(lz4ultra_stream_t *stream, const char *pszCompareFilename, const char *pszMode) {
-   compare_stream_t *pCompareStream;
-
-   pCompareStream = (compare_stream_t*)malloc(sizeof(compare_stream_t));
-   if (!pCompareStream)
-      return -1;
-
-   pCompareStream->pCompareDataBuf = NULL;
-   pCompareStream->nCompareDataSize = 0;
-   pCompareStream->f = (void*)fopen(pszCompareFilename, pszMode);
-
-   if (pCompareStream->f) {
-      stream->obj = pCompareStream;
-      stream->read = comparestream_read;
-      stream->write = comparestream_write;
-      stream->eof = comparestream_eof;
-      stream->close = comparestream_close;
-      return 0;
-   }
-   else {
-      free(pCompareStream);
-      return -1;
-   }
-}
-
-static int do_compare(const char *pszInFilename, const char *pszOutFilename, const char *pszDictionaryFilename, const unsigned int nOptions) {
-   lz4ultra_stream_t inStream, compareStream;
-   long long nStartTime = 0LL, nEndTime = 0LL;
-   long long nOriginalSize = 0LL, nCompressedSize = 0LL;
-   void *pDictionaryData = NULL;
-   int nDictionaryDataSize = 0;
-   lz4ultra_status_t nStatus;
-   int nFlags;
-
-   if (lz4ultra_filestream_open(&inStream, pszInFilename, "rb") < 0) {
-      fprintf(stderr, "error opening compressed input file\n");
-      return 100;
-   }
-
-   if (comparestream_open(&compareStream, pszOutFilename, "rb") < 0) {
-      fprintf(stderr, "error opening original uncompressed file\n");
-      inStream.close(&inStream);
-      return 100;
-   }
-
-   nStatus = lz4ultra_dictionary_load(pszDictionaryFilename, &pDictionaryData, &nDictionaryDataSize);
-   if (nStatus) {
-      compareStream.close(&compareStream);
-      inStream.close(&inStream);
-      fprintf(stderr, "error reading dictionary '%s'\n", pszDictionaryFilename);
-      return 100;
-   }
-
-   nFlags = 0;
-   if (nOptions & OPT_RAW)
-      nFlags |= LZ4ULTRA_FLAG_RAW_BLOCK;
-
-   if (nOptions & OPT_VERBOSE) {
-      nStartTime = do_get_time();
-   }
-
-   nStatus = lz4ultra_decompress_stream(&inStream, &compareStream, pDictionaryData, nDictionaryDataSize, nFlags, &nOriginalSize, &nCompressedSize);
-   switch (nStatus) {
-   case LZ4ULTRA_ERROR_SRC: fprintf(stderr, "error reading '%s'\n", pszInFilename); break;
-   case LZ4ULTRA_ERROR_DST: fprintf(stderr, "error comparing compressed file '%s' with original '%s'\n", pszInFilename, pszOutFilename); break;
-   case LZ4ULTRA_ERROR_MEMORY: fprintf(stderr, "out of memory\n"); break;
-   case LZ4ULTRA_ERROR_FORMAT: fprintf(stderr, "invalid magic number, version, flags, or block size in input file\n"); break;
-   case LZ4ULTRA_ERROR_CHECKSUM: fprintf(stderr, "invalid checksum in input file\n"); break;
-   case LZ4ULTRA_ERROR_DECOMPRESSION: fprintf(stderr, "internal decompression error\n"); break;
-   case LZ4ULTRA_OK: break;
-   default: fprintf(stderr, "unknown decompression error %d\n", nStatus); break;
-   }
-        
-   lz4ultra_dictionary_free(&pDictionaryData);
-   compareStream.close(&compareStream);
-   inStream.close(&inStream);
-
-   if (nStatus) {
-      return 100;
-   }
-   else {
-      if (nOptions & OPT_VERBOSE) {
-         nEndTime = do_get_time();
-         double fDelta = ((double)(nEndTime - nStartTime)) / 1000000.0;
-         double fSpeed = ((double)nOriginalSize / 1048576.0) / fDelta;
-         fprintf(stdout, "Compared '%s' in %g seconds, %g Mb/s\n",
-            pszInFilename, fDelta, fSpeed);
-      }
-
-      return 0;
-   }
-}
-
-/*---------------------------------------------------------------------------*/
-
-static void generate_compressible_data(unsigned char *pBuffer, size_t nBufferSize, unsigned int nSeed, int nNumLiteralValues, float fMatchProbability) {
-   size_t nIndex = 0;
-   int nMatchProbability = (int)(fMatchProbability * 1023.0f);
-
-   srand(nSeed);
-
-   if (nBufferSize == 0) return;
-   pBuffer[nIndex++] = rand() % nNumLiteralValues;
-
-   while (nIndex < nBufferSize) {
-      if ((rand() & 1023) >= nMatchProbability) {
-         size_t nLiteralCount = rand() & 127;
-         if (nLiteralCount > (nBufferSize - nIndex))
-            nLiteralCount = nBufferSize - nIndex;
-
-         while (nLiteralCount--)
-            pBuffer[nIndex++] = rand() % nNumLiteralValues;
-      }
-      else {
-         size_t nMatchLength = MIN_MATCH_SIZE + (rand() & 1023);
-         size_t nMatchOffset;
-
-         if (nMatchLength > (nBufferSize - nIndex))
-            nMatchLength = nBufferSize - nIndex;
-         if (nMatchLength > nIndex)
-            nMatchLength = nIndex;
-
-         if (nMatchLength < nIndex)
-            nMatchOffset = rand() % (nIndex - nMatchLength);
-         else
-            nMatchOffset = 0;
-
-         while (nMatchLength--) {
-            pBuffer[nIndex] = pBuffer[nIndex - nMatchOffset];
-            nIndex++;
-         }
-      }
-   }
-}
-
-static void xor_data(unsigned char *pBuffer, size_t nBufferSize, unsigned int nSeed, float fXorProbability) {
-   size_t nIndex = 0;
-   int nXorProbability = (int)(fXorProbability * 1023.0f);
-
-   srand(nSeed);
-
-   while (nIndex < nBufferSize) {
-      if ((rand() & 1023) < nXorProbability) {
-         pBuffer[nIndex] ^= 0xff;
-      }
-      nIndex++;
-   }
-}
-
-static int do_self_test(const unsigned int nOptions, int nBlockMaxCode) {
-   unsigned char *pGeneratedData;
-   unsigned char *pCompressedData;
-   unsigned char *pTmpCompressedData;
-   unsigned char *pTmpDecompressedData;
-   size_t nGeneratedDataSize;
-   size_t nMaxCompressedDataSize;
-   unsigned int nSeed = 123;
-   int nFlags;
-   int i;
-
-   nFlags = 0;
-   if (nOptions & OPT_FAVOR_RATIO)
-      nFlags |= LZ4ULTRA_FLAG_FAVOR_RATIO;
-   if (nOptions & OPT_RAW)
-      nFlags |= LZ4ULTRA_FLAG_RAW_BLOCK;
-   if (nOptions & OPT_INDEP_BLOCKS)
-      nFlags |= LZ4ULTRA_FLAG_INDEP_BLOCKS;
-   if (nOptions & OPT_LEGACY_FRAMES)
-      nFlags |= LZ4ULTRA_FLAG_LEGACY_FRAMES;
-
-   pGeneratedData = (unsigned char*)malloc(4 * HISTORY_SIZE);
-   if (!pGeneratedData) {
-      fprintf(stderr, "out of memory, %d bytes needed\n", 4 * HISTORY_SIZE);
-      return 100;
-   }
-
-   nMaxCompressedDataSize = lz4ultra_get_max_compressed_size_inmem(4 * HISTORY_SIZE, nFlags, nBlockMaxCode);
-   pCompressedData = (unsigned char*)malloc(nMaxCompressedDataSize);
-   if (!pCompressedData) {
-      free(pGeneratedData);
-      pGeneratedData = NULL;
-
-      fprintf(stderr, "out of memory, %zu bytes needed\n", nMaxCompressedDataSize);
-      return 100;
-   }
-
-   pTmpCompressedData = (unsigned char*)malloc(nMaxCompressedDataSize);
-   if (!pTmpCompressedData) {
-      free(pCompressedData);
-      pCompressedData = NULL;
-      free(pGeneratedData);
-      pGeneratedData = NULL;
-
-      fprintf(stderr, "out of memory, %zu bytes needed\n", nMaxCompressedDataSize);
-      return 100;
-   }
-
-   pTmpDecompressedData = (unsigned char*)malloc(4 * HISTORY_SIZE);
-   if (!pTmpDecompressedData) {
-      free(pTmpCompressedData);
-      pTmpCompressedData = NULL;
-      free(pCompressedData);
-      pCompressedData = NULL;
-      free(pGeneratedData);
-      pGeneratedData = NULL;
-
-      fprintf(stderr, "out of memory, %d bytes needed\n", 4 * HISTORY_SIZE);
-      return 100;
-   }
-
-   memset(pGeneratedData, 0, 4 * HISTORY_SIZE);
-   memset(pCompressedData, 0, nMaxCompressedDataSize);
-   memset(pTmpCompressedData, 0, nMaxCompressedDataSize);
-
-   /* Test compressing with a too small buffer to do anything, expect to fail cleanly */
-   for (i = 0; i < 12; i++) {
-      generate_compressible_data(pGeneratedData, i, nSeed, 256, 0.5f);
-      lz4ultra_compress_inmem(pGeneratedData, pCompressedData, i, i, nFlags, nBlockMaxCode);
-   }
-
-   size_t nDataSizeStep = 128;
-   float fProbabilitySizeStep = 0.0005f;
-
-   for (nGeneratedDataSize = 16384; nGeneratedDataSize <= (4 * HISTORY_SIZE); nGeneratedDataSize += nDataSizeStep) {
-      float fMatchProbability;
-
-      fprintf(stdout, "size %zu", nGeneratedDataSize);
-      for (fMatchProbability = (nOptions & (OPT_RAW|OPT_LEGACY_FRAMES)) ? 0.1f : 0; fMatchProbability <= 0.995f; fMatchProbability += fProbabilitySizeStep) {
-         int nNumLiteralValues[12] = { 1, 2, 3, 15, 30, 56, 96, 137, 178, 191, 255, 256 };
-         float fXorProbability;
-
-         fputc('.', stdout);
-         fflush(stdout);
-
-         for (i = 0; i < 12; i++) {
-            /* Generate data to compress */
-            generate_compressible_data(pGeneratedData, nGeneratedDataSize, nSeed, nNumLiteralValues[i], fMatchProbability);
-
-            /* Try to compress it, expected to succeed */
-            size_t nActualCompressedSize = lz4ultra_compress_inmem(pGeneratedData, pCompressedData, nGeneratedDataSize, lz4ultra_get_max_compressed_size_inmem(nGeneratedDataSize, nFlags, nBlockMaxCode), 
-               nFlags, nBlockMaxCode);
-            if (nActualCompressedSize == (size_t)-1 || nActualCompressedSize < (LZ4ULTRA_HEADER_SIZE + LZ4ULTRA_FRAME_SIZE + LZ4ULTRA_FRAME_SIZE /* footer */)) {
-               free(pTmpDecompressedData);
-               pTmpDecompressedData = NULL;
-               free(pTmpCompressedData);
-               pTmpCompressedData = NULL;
-               free(pCompressedData);
-               pCompressedData = NULL;
-               free(pGeneratedData);
-               pGeneratedData = NULL;
-
-               fprintf(stderr, "\nself-test: error compressing size %zu, seed %u, match probability %f, literals range %d\n", nGeneratedDataSize, nSeed, fMatchProbability, nNumLiteralValues[i]);
-               return 100;
-            }
-
-            /* Try to decompress it, expected to succeed */
-            size_t nActualDecompressedSize;
-            nActualDecompressedSize = lz4ultra_decompress_inmem(pCompressedData, pTmpDecompressedData, nActualCompressedSize, nGeneratedDataSize, nFlags);
-            if (nActualDecompressedSize == (size_t)-1) {
-               free(pTmpDecompressedData);
-               pTmpDecompressedData = NULL;
-               free(pTmpCompressedData);
-               pTmpCompressedData = NULL;
-               free(pCompressedData);
-               pCompressedData = NULL;
-               free(pGeneratedData);
-               pGeneratedData = NULL;
-
-               fprintf(stderr, "\nself-test: error decompressing size %zu, seed %u, match probability %f, literals range %d\n", nGeneratedDataSize, nSeed, fMatchProbability, nNumLiteralValues[i]);
-               return 100;
-            }
-
-            if (memcmp(pGeneratedData, pTmpDecompressedData, nGeneratedDataSize)) {
-               free(pTmpDecompressedData);
-               pTmpDecompressedData = NULL;
-               free(pTmpCompressedData);
-               pTmpCompressedData = NULL;
-               free(pCompressedData);
-               pCompressedData = NULL;
-               free(pGeneratedData);
-               pGeneratedData = NULL;
-
-               fprintf(stderr, "\nself-test: error comparing decompressed and original data, size %zu, seed %u, match probability %f, literals range %d\n", nGeneratedDataSize, nSeed, fMatchProbability, nNumLiteralValues[i]);
-               return 100;
-            }
-
-            /* Try to decompress corrupted data, expected to fail cleanly, without crashing or corrupting memory outside the output buffer */
-            for (fXorProbability = 0.05f; fXorProbability <= 0.5f; fXorProbability += 0.05f) {
-               memcpy(pTmpCompressedData, pCompressedData, nActualCompressedSize);
-               xor_data(pTmpCompressedData + LZ4ULTRA_HEADER_SIZE + LZ4ULTRA_FRAME_SIZE, nActualCompressedSize - LZ4ULTRA_HEADER_SIZE - LZ4ULTRA_FRAME_SIZE - LZ4ULTRA_FRAME_SIZE /* footer */, nSeed, fXorProbability);
-               lz4ultra_decompress_inmem(pTmpCompressedData, pGeneratedData, nActualCompressedSize, nGeneratedDataSize, nFlags);
-            }
-         }
-
-         nSeed++;
-      }
-
-      fputc(10, stdout);
-      fflush(stdout);
-
-      nDataSizeStep <<= 1;
-      if (nDataSizeStep > (128 * 4096))
-         nDataSizeStep = 128 * 4096;
-      fProbabilitySizeStep *= 1.25;
-      if (fProbabilitySizeStep > (0.0005f * 4096))
-         fProbabilitySizeStep = 0.0005f * 4096;
-   }
-
-   free(pTmpDecompressedData);
-   pTmpDecompressedData = NULL;
-
-   free(pTmpCompressedData);
-   pTmpCompressedData = NULL;
-
-   free(pCompressedData);
-   pCompressedData = NULL;
-
-   free(pGeneratedData);
-   pGeneratedData = NULL;
-
-   fprintf(stdout, "All tests passed.\n");
-   return 0;
-}
-
-/*---------------------------------------------------------------------------*/
-
-static int do_compr_benchmark(const char *pszInFilename, const char *pszOutFilename, const char *pszDictionaryFilename, const unsigned int nOptions, int nBlockMaxCode) {
-   size_t nFileSize, nMaxCompressedSize;
-   unsigned char *pFileData;
-   unsigned char *pCompressedData;
-   int nFlags;
-   int i;
-
-   nFlags = 0;
-   if (nOptions & OPT_FAVOR_RATIO)
-      nFlags |= LZ4ULTRA_FLAG_FAVOR_RATIO;
-   if (nOptions & OPT_RAW)
-      nFlags |= LZ4ULTRA_FLAG_RAW_BLOCK;
-   if (nOptions & OPT_INDEP_BLOCKS)
-      nFlags |= LZ4ULTRA_FLAG_INDEP_BLOCKS;
-   if (nOptions & OPT_LEGACY_FRAMES)
-      nFlags |= LZ4ULTRA_FLAG_LEGACY_FRAMES;
-
-   if (pszDictionaryFilename) {
-      fprintf(stderr, "in-memory benchmarking does not support dictionaries\n");
-      return 100;
-   }
-
-   /* Read the whole original file in memory */
-
-   FILE *f_in = fopen(pszInFilename, "rb");
-   if (!f_in) {
-      fprintf(stderr, "error opening '%s' for reading\n", pszInFilename);
-      return 100;
-   }
-
-   fseek(f_in, 0, SEEK_END);
-   nFileSize = (size_t)ftell(f_in);
-   fseek(f_in, 0, SEEK_SET);
-
-   pFileData = (unsigned char*)malloc(nFileSize);
-   if (!pFileData) {
-      fclose(f_in);
-      fprintf(stderr, "out of memory for reading '%s', %zu bytes needed\n", pszInFilename, nFileSize);
-      return 100;
-   }
-
-   if (fread(pFileData, 1, nFileSize, f_in) != nFileSize) {
-      free(pFileData);
-      fclose(f_in);
-      fprintf(stderr, "I/O error while reading '%s'\n", pszInFilename);
-      return 100;
-   }
-
-   fclose(f_in);
-
-   /* Allocate max compressed size */
-
-   nMaxCompressedSize = lz4ultra_get_max_compressed_size_inmem(nFileSize, nFlags, nBlockMaxCode);
-
-   pCompressedData = (unsigned char*)malloc(nMaxCompressedSize + 2048);
-   if (!pCompressedData) {
-      free(pFileData);
-      fprintf(stderr, "out of memory for compressing '%s', %zu bytes needed\n", pszInFilename, nMaxCompressedSize);
-      return 100;
-   }
-
-   memset(pCompressedData + 1024, 0, nMaxCompressedSize);
-
-   long long nBestCompTime = -1;
-
-   size_t nActualCompressedSize = 0;
-   size_t nRightGuardPos = nMaxCompressedSize;
-
-   for (i = 0; i < 5; i++) {
-      unsigned char nGuard = 0x33 + i;
-      int j;
-
-      /* Write guard bytes around the output buffer, to help check for writes outside of it by the compressor */
-      memset(pCompressedData, nGuard, 1024);
-      memset(pCompressedData + 1024 + nRightGuardPos, nGuard, 1024);
-
-      long long t0 = do_get_time();
-      nActualCompressedSize = lz4ultra_compress_inmem(pFileData, pCompressedData + 1024, nFileSize, nRightGuardPos, nFlags, nBlockMaxCode);
-      long long t1 = do_get_time();
-      if (nActualCompressedSize == (size_t)-1) {
-         free(pCompressedData);
-         free(pFileData);
-         fprintf(stderr, "compression error\n");
-         return 100;
-      }
-
-      long long nCurDecTime = t1 - t0;
-      if (nBestCompTime == (size_t)-1 || nBestCompTime > nCurDecTime)
-         nBestCompTime = nCurDecTime;
-
-      /* Check guard bytes before the output buffer */
-      for (j = 0; j < 1024; j++) {
-         if (pCompressedData[j] != nGuard) {
-            free(pCompressedData);
-            free(pFileData);
-            fprintf(stderr, "error, wrote outside of output buffer at %d!\n", j - 1024);
-            return 100;
-         }
-      }
-
-      /* Check guard bytes after the output buffer */
-      for (j = 0; j < 1024; j++) {
-         if (pCompressedData[1024 + nRightGuardPos + j] != nGuard) {
-            free(pCompressedData);
-            free(pFileData);
-            fprintf(stderr, "error, wrote outside of output buffer at %d!\n", j);
-            return 100;
-         }
-      }
-
-      nRightGuardPos = nActualCompressedSize;
-   }
-
-   if (pszOutFilename) {
-      FILE *f_out;
-
-      /* Write whole compressed file out */
-
-      f_out = fopen(pszOutFilename, "wb");
-      if (f_out) {
-         fwrite(pCompressedData + 1024, 1, nActualCompressedSize, f_out);
-         fclose(f_out);
-      }
-   }
-
-   free(pCompressedData);
-   free(pFileData);
-
-   fprintf(stdout, "compressed size: %zu bytes\n", nActualCompressedSize);
-   fprintf(stdout, "compression time: %lld microseconds (%g Mb/s)\n", nBestCompTime, ((double)nActualCompressedSize / 1024.0) / ((double)nBestCompTime / 1000.0));
-
-   return 0;
-}
-
-/*---------------------------------------------------------------------------*/
-
-static int do_dec_benchmark(const char *pszInFilename, const char *pszOutFilename, const char *pszDictionaryFilename, const unsigned int nOptions) {
-   size_t nFileSize, nMaxDecompressedSize;
-   unsigned char *pFileData;
-   unsigned char *pDecompressedData;
-   int nFlags;
-   int i;
-
-   nFlags = 0;
-   if (nOptions & OPT_RAW)
-      nFlags |= LZ4ULTRA_FLAG_RAW_BLOCK;
-
-   if (pszDictionaryFilename) {
-      fprintf(stderr, "in-memory benchmarking does not support dictionaries\n");
-      return 100;
-   }
-   
-   /* Read the whole compressed file in memory */
-
-   FILE *f_in = fopen(pszInFilename, "rb");
-   if (!f_in) {
-      fprintf(stderr, "error opening '%s' for reading\n", pszInFilename);
-      return 100;
-   }
-
-   fseek(f_in, 0, SEEK_END);
-   nFileSize = (size_t)ftell(f_in);
-   fseek(f_in, 0, SEEK_SET);
-
-   pFileData = (unsigned char*)malloc(nFileSize);
-   if (!pFileData) {
-      fclose(f_in);
-      fprintf(stderr, "out of memory for reading '%s', %zu bytes needed\n", pszInFilename, nFileSize);
-      return 100;
-   }
-
-   if (fread(pFileData, 1, nFileSize, f_in) != nFileSize) {
-      free(pFileData);
-      fclose(f_in);
-      fprintf(stderr, "I/O error while reading '%s'\n", pszInFilename);
-      return 100;
-   }
-
-   fclose(f_in);
-
-   /* Allocate max decompressed size */
-
-   if (nOptions & OPT_RAW)
-      nMaxDecompressedSize = 0x400000;
-   else
-      nMaxDecompressedSize = lz4ultra_inmem_get_max_decompressed_size(pFileData, nFileSize);
-   if (nMaxDecompressedSize == (size_t)-1) {
-      free(pFileData);
-      fprintf(stderr, "invalid compressed format for file '%s'\n", pszInFilename);
-      return 100;
-   }
-
-   pDecompressedData = (unsigned char*)malloc(nMaxDecompressedSize);
-   if (!pDecompressedData) {
-      free(pFileData);
-      fprintf(stderr, "out of memory for decompressing '%s', %zu bytes needed\n", pszInFilename, nMaxDecompressedSize);
-      return 100;
-   }
-
-   memset(pDecompressedData, 0, nMaxDecompressedSize);
-
-   long long nBestDecTime = -1;
-
-   size_t nActualDecompressedSize = 0;
-   for (i = 0; i < 50; i++) {
-      long long t0 = do_get_time();
-      nActualDecompressedSize = lz4ultra_decompress_inmem(pFileData, pDecompressedData, nFileSize, nMaxDecompressedSize, nFlags);
-      long long t1 = do_get_time();
-      if (nActualDecompressedSize == (size_t)-1) {
-         free(pDecompressedData);
-         free(pFileData);
-         fprintf(stderr, "decompression error\n");
-         return 100;
-      }
-
-      long long nCurDecTime = t1 - t0;
-      if (nBestDecTime == (size_t)-1 || nBestDecTime > nCurDecTime)
-         nBestDecTime = nCurDecTime;
-   }
-
-   if (pszOutFilename) {
-      FILE *f_out;
-
-      /* Write whole decompressed file out */
-
-      f_out = fopen(pszOutFilename, "wb");
-      if (f_out) {
-         fwrite(pDecompressedData, 1, nActualDecompressedSize, f_out);
-         fclose(f_out);
-      }
-   }
-
-   free(pDecompressedData);
-   free(pFileData);
-
-   fprintf(stdout, "decompressed size: %zu bytes\n", nActualDecompressedSize);
-   fprintf(stdout, "decompression time: %lld microseconds (%g Mb/s)\n", nBestDecTime, ((double)nActualDecompressedSize / 1024.0) / ((double)nBestDecTime / 1000.0));
-
-   return 0;
-}
-
-/*---------------------------------------------------------------------------*/
-
-int main(int argc, char **argv) {
-   int i;
-   const char *pszInFilename = NULL;
-   const char *pszOutFilename = NULL;
-   const char *pszDictionaryFilename = NULL;
-   bool bArgsError = false;
-   bool bCommandDefined = false;
-   bool bVerifyCompression = false;
-   int nBlockMaxCode = 7;
-   bool bBlockCodeDefined = false;
-   bool bBlockDependenceDefined = false;
-   char cCommand = 'z';
-   unsigned int nOptions = OPT_FAVOR_RATIO;
-
-   for (i = 1; i < argc; i++) {
-      if (!strcmp(argv[i], "-d")) {
-         if (!bCommandDefined) {
-            bCommandDefined = true;
-            cCommand = 'd';
-         }
-         else
-            bArgsError = true;
-      }
-      else if (!strcmp(argv[i], "-z")) {
-         if (!bCommandDefined) {
-            bCommandDefined = true;
-            cCommand = 'z';
-         }
-         else
-            bArgsError = true;
-      }
-      else if (!strcmp(argv[i], "-c")) {
-         if (!bVerifyCompression) {
-            bVerifyCompression = true;
-         }
-         else
-            bArgsError = true;
-      }
-      else if (!strcmp(argv[i], "-cbench")) {
-         if (!bCommandDefined) {
-            bCommandDefined = true;
-            cCommand = 'B';
-         }
-         else
-            bArgsError = true;
-      }
-      else if (!strcmp(argv[i], "-dbench")) {
-         if (!bCommandDefined) {
-            bCommandDefined = true;
-            cCommand = 'b';
-         }
-         else
-            bArgsError = true;
-      }
-      else if (!strcmp(argv[i], "-test")) {
-         if (!bCommandDefined) {
-            bCommandDefined = true;
-            cCommand = 't';
-         }
-         else
-            bArgsError = true;
-      }
-      else if (!strcmp(argv[i], "-D")) {
-         if (!pszDictionaryFilename && (i + 1) < argc) {
-            pszDictionaryFilename = argv[i + 1];
-            i++;
-         }
-         else
-            bArgsError = true;
-      }
-      else if (!strncmp(argv[i], "-D", 2)) {
-         if (!pszDictionaryFilename) {
-            pszDictionaryFilename = argv[i] + 2;
-         }
-         else
-            bArgsError = true;
-      }
-      else if (!strcmp(argv[i], "-BD")) {
-         if (!bBlockDependenceDefined) {
-            bBlockDependenceDefined = true;
-            nOptions &= ~OPT_INDEP_BLOCKS;
-         }
-         else
-            bArgsError = true;
-      }
-      else if (!strcmp(argv[i], "-BI")) {
-         if (!bBlockDependenceDefined) {
-            bBlockDependenceDefined = true;
-            nOptions |= OPT_INDEP_BLOCKS;
-         }
-         else
-            bArgsError = true;
-      }
-      else if (!strncmp(argv[i], "-B", 2)) {
-         if (!bBlockCodeDefined) {
-            nBlockMaxCode = atoi(argv[i] + 2);
-            if (nBlockMaxCode < 4 || nBlockMaxCode > 7)
-               bArgsError = true;
-         }
-         else
-            bArgsError = true;
-      }
-      else if (!strcmp(argv[i], "-l")) {
-         if ((nOptions & OPT_LEGACY_FRAMES) == 0) {
-            nOptions |= OPT_LEGACY_FRAMES;
-         }
-         else
-            bArgsError = true;
-      }
-      else if (!strcmp(argv[i], "-v")) {
-         if ((nOptions & OPT_VERBOSE) == 0) {
-            nOptions |= OPT_VERBOSE;
-         }
-         else
-            bArgsError = true;
-      }
-      else if (!strcmp(argv[i], "-r")) {
-         if ((nOptions & OPT_RAW) == 0) {
-            nOptions |= OPT_RAW;
-         }
-         else
-            bArgsError = true;
-      }
-      else if (!strcmp(argv[i], "--favor-decSpeed")) {
-         if ((nOptions & OPT_FAVOR_RATIO) != 0) {
-            nOptions &= (~OPT_FAVOR_RATIO);
-         }
-         else
-            bArgsError = true;
-      }
-      else {
-         if (!pszInFilename)
-            pszInFilename = argv[i];
-         else {
-            if (!pszOutFilename)
-               pszOutFilename = argv[i];
-            else
-               bArgsError = true;
-         }
-      }
-   }
-
-   if (!bArgsError && cCommand == 't') {
-      return do_self_test(nOptions, nBlockMaxCode);
-   }
-
-   if (bArgsError || !pszInFilename || !pszOutFilename) {
-      fprintf(stderr, "lz4ultra v" TOOL_VERSION " by Emmanuel Marty and spke\n");
-      fprintf(stderr, "usage: %s [-c] [-d] [-v] [-r] <infile> <outfile>\n", argv[0]);
-      fprintf(stderr, "              -c: check resulting stream after compressing\n");
-      fprintf(stderr, "              -d: decompress (default: compress)\n");
-      fprintf(stderr, "         -cbench: benchmark in-memory compression\n");
-      fprintf(stderr, "         -dbench: benchmark in-memory decompression\n");
-      fprintf(stderr, "           -test: run automated self-tests\n");
-      fprintf(stderr, "          -B4..7: compress with 64, 256, 1024 or 4096 Kb blocks (defaults to -B7)\n");
-      fprintf(stderr, "             -BD: use block-dependent compression (default)\n");
-      fprintf(stderr, "             -BI: use block-independent compression\n");
-      fprintf(stderr, "              -v: be verbose\n");
-      fprintf(stderr, "              -r: raw block format (max. 4 Mb files)\n");
-      fprintf(stderr, "              -l: legacy format compression\n");
-      fprintf(stderr, "--favor-decSpeed: trade some ratio for faster decompression\n");
-      fprintf(stderr, "   -D <filename>: use dictionary file\n");
-      return 100;
-   }
-
-   do_init_time();
-
-   if (cCommand == 'z') {
-      int nResult = do_compress(pszInFilename, pszOutFilename, pszDictionaryFilename, nOptions, nBlockMaxCode);
-      if (nResult == 0 && bVerifyCompression) {
-         return do_compare(pszOutFilename, pszInFilename, pszDictionaryFilename, nOptions);
-      }
-   }
-   else if (cCommand == 'd') {
-      return do_decompress(pszInFilename, pszOutFilename, pszDictionaryFilename, nOptions);
-   }
-   else if (cCommand == 'B') {
-      return do_compr_benchmark(pszInFilename, pszOutFilename, pszDictionaryFilename, nOptions, nBlockMaxCode);
-   }
-   else if (cCommand == 'b') {
-      return do_dec_benchmark(pszInFilename, pszOutFilename, pszDictionaryFilename, nOptions);
-   }
-   else {
-      return 100;
-   }
-}
+/*
+ * main.c - command line optimal compression utility for the lz4 format
+ *
+ * Copyright (C) 2019 Emmanuel Marty
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*
+ * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
+ *
+ * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
+ * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
+ * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
+ * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
+ *
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <sys/timeb.h>
+#else
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+#endif
+#include "lib.h"
+#include "format.h"
+#include "frame.h"
+#include "threadpool.h"
+
+#define OPT_VERBOSE        1
+#define OPT_FAVOR_RATIO    2
+#define OPT_RAW            4
+#define OPT_INDEP_BLOCKS   8
+#define OPT_LEGACY_FRAMES  16
+#define OPT_ASYNC_IO       32
+#define OPT_BLOCK_CHECKSUM 64
+#define OPT_CONTENT_CHECKSUM 128
+#define OPT_CONTENT_SIZE   256
+#define OPT_SEEK_TABLE     512
+#define OPT_STATS          1024
+#define OPT_ADAPTIVE_BLOCKS 2048
+#define OPT_HUGE_PAGES     4096
+#define OPT_PREFAULT       8192
+#define OPT_VERIFY         16384
+#define OPT_DEDUP          32768
+#define OPT_APPEND         65536
+#define OPT_RAW_TABLE      131072
+
+#define TOOL_VERSION "1.3.0"
+
+#define BENCH_COMPRESS_RUNS      5
+#define BENCH_DECOMPRESS_RUNS    25
+
+#define SELF_TEST_MAX_PATH       1024
+
+#define TRAIN_MAX_SAMPLES_SIZE   (16 * 1024 * 1024)
+#define TRAIN_HOLDOUT_INTERVAL   10
+
+/*---------------------------------------------------------------------------*/
+
+/* Where progress, statistics and verbose messages go: stderr when compressed or decompressed data is written to stdout */
+static FILE *info_file = NULL;
+
+#ifdef _WIN32
+LARGE_INTEGER hpc_frequency;
+BOOL hpc_available = FALSE;
+#endif
+
+static void do_init_time() {
+#ifdef _WIN32
+   hpc_frequency.QuadPart = 0;
+   hpc_available = QueryPerformanceFrequency(&hpc_frequency);
+#endif
+}
+
+static long long do_get_time() {
+   long long nTime;
+
+#ifdef _WIN32
+   if (hpc_available) {
+      LARGE_INTEGER nCurTime;
+
+      /* Use HPC hardware for best precision */
+      QueryPerformanceCounter(&nCurTime);
+      nTime = (long long)(nCurTime.QuadPart * 1000000LL / hpc_frequency.QuadPart);
+   }
+   else {
+      struct _timeb tb;
+      _ftime(&tb);
+
+      nTime = ((long long)tb.time * 1000LL + (long long)tb.millitm) * 1000LL;
+   }
+#else
+   struct timeval tm;
+   gettimeofday(&tm, NULL);
+
+   nTime = (long long)tm.tv_sec * 1000000LL + (long long)tm.tv_usec;
+#endif
+   return nTime;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void compression_start(int nBlockMaxCode, const unsigned int nFlags) {
+   const int nBlockMaxBits = 8 + (nBlockMaxCode << 1);
+   const int nBlockMaxSize = 1 << nBlockMaxBits;
+
+   fprintf(info_file, "Use %d Kb blocks, independent blocks: %s\n", nBlockMaxSize >> 10, (nFlags & LZ4ULTRA_FLAG_INDEP_BLOCKS) ? "yes" : "no");
+}
+
+static void compression_progress(long long nOriginalSize, long long nCompressedSize) {
+   fprintf(info_file, "\r%lld => %lld (%g %%)     \b\b\b\b\b", nOriginalSize, nCompressedSize, (double)(nCompressedSize * 100.0 / nOriginalSize));
+   fflush(info_file);
+}
+
+static void print_compression_stats(const lz4ultra_stats *pStats) {
+   static const char *pszPhaseNames[LZ4ULTRA_NUM_PHASES] = { "suffix sorting", "intervals", "history", "match finding", "optimal parse", "command reduction", "writing" };
+   long long nTotalTime = 0;
+   int i;
+
+   for (i = 0; i < LZ4ULTRA_NUM_PHASES; i++)
+      nTotalTime += pStats->phase_time[i];
+
+   fprintf(info_file, "blocks: %lld\n", pStats->num_blocks);
+   fprintf(info_file, "bytes processed: %lld\n", pStats->bytes_processed);
+   fprintf(info_file, "matches found: %lld (average length: %.02f)\n", pStats->matches_found,
+      pStats->matches_found ? ((double)pStats->match_bytes_found / (double)pStats->matches_found) : 0.0);
+   fprintf(info_file, "tokens: %lld\n", pStats->num_tokens);
+   fprintf(info_file, "literal bytes: %lld\n", pStats->literal_bytes);
+   fprintf(info_file, "match bytes: %lld\n", pStats->match_bytes);
+   fprintf(info_file, "joined matches: %lld\n", pStats->joined_matches);
+   fprintf(info_file, "matches reduced to literals: %lld\n", pStats->reduced_matches);
+   for (i = 0; i < LZ4ULTRA_NUM_PHASES; i++) {
+      fprintf(info_file, "%s time: %lld microseconds (%g %%)\n", pszPhaseNames[i], pStats->phase_time[i],
+         nTotalTime ? ((double)pStats->phase_time[i] * 100.0 / (double)nTotalTime) : 0.0);
+   }
+}
+
+static int do_set_huge_pages(lz4ultra_ctx *pCtx, const unsigned int nOptions) {
+   lz4ultra_allocator allocator;
+   int nHugePagesAvailable;
+
+   if ((nOptions & OPT_HUGE_PAGES) == 0)
+      return 0;
+
+   nHugePagesAvailable = lz4ultra_get_huge_page_allocator(&allocator, (nOptions & OPT_PREFAULT) ? LZ4ULTRA_HUGE_PAGES_PREFAULT : 0);
+   if (!nHugePagesAvailable && (nOptions & OPT_VERBOSE))
+      fprintf(stderr, "huge pages are not available, using regular pages\n");
+
+   lz4ultra_ctx_set_allocator(pCtx, -1, &allocator);
+   return nHugePagesAvailable;
+}
+
+static int do_compress(const char *pszInFilename, const char *pszOutFilename, const char *pszDictionaryFilename, const unsigned int nOptions, int nBlockMaxCode, int nCompressionLevel, int nThreads,
+                       int nDecodeCost, int nMatchCandidates, int nMaxMemory) {
+   long long nStartTime = 0LL, nEndTime = 0LL;
+   long long nOriginalSize = 0LL, nCompressedSize = 0LL;
+   lz4ultra_stats stats;
+   lz4ultra_status_t nStatus;
+   lz4ultra_ctx *pCtx;
+   int nCommandCount = 0;
+   int nFlags;
+
+   nFlags = 0;
+   if (nOptions & OPT_FAVOR_RATIO)
+      nFlags |= LZ4ULTRA_FLAG_FAVOR_RATIO;
+   if (nOptions & OPT_RAW)
+      nFlags |= LZ4ULTRA_FLAG_RAW_BLOCK;
+   if (nOptions & OPT_RAW_TABLE)
+      nFlags |= LZ4ULTRA_FLAG_RAW_TABLE;
+   if (nOptions & OPT_INDEP_BLOCKS)
+      nFlags |= LZ4ULTRA_FLAG_INDEP_BLOCKS;
+   if (nOptions & OPT_LEGACY_FRAMES)
+      nFlags |= LZ4ULTRA_FLAG_LEGACY_FRAMES;
+   if (nOptions & OPT_ASYNC_IO)
+      nFlags |= LZ4ULTRA_FLAG_ASYNC_IO;
+   if (nOptions & OPT_BLOCK_CHECKSUM)
+      nFlags |= LZ4ULTRA_FLAG_BLOCK_CHECKSUM;
+   if (nOptions & OPT_CONTENT_CHECKSUM)
+      nFlags |= LZ4ULTRA_FLAG_CONTENT_CHECKSUM;
+   if (nOptions & OPT_CONTENT_SIZE)
+      nFlags |= LZ4ULTRA_FLAG_CONTENT_SIZE;
+   if (nOptions & OPT_ADAPTIVE_BLOCKS)
+      nFlags |= LZ4ULTRA_FLAG_ADAPTIVE_BLOCKS;
+   if (nOptions & OPT_SEEK_TABLE)
+      nFlags |= LZ4ULTRA_FLAG_SEEK_TABLE;
+   if (nOptions & OPT_STATS)
+      nFlags |= LZ4ULTRA_FLAG_STATS;
+   if (nOptions & OPT_VERIFY)
+      nFlags |= LZ4ULTRA_FLAG_VERIFY;
+   if (nOptions & OPT_DEDUP)
+      nFlags |= LZ4ULTRA_FLAG_DEDUP;
+
+   pCtx = lz4ultra_ctx_create((nThreads < 1) ? 1 : nThreads);
+   if (!pCtx) {
+      fprintf(stderr, "out of memory\n");
+      return 100;
+   }
+   do_set_huge_pages(pCtx, nOptions);
+   lz4ultra_ctx_set_decode_cost(pCtx, nDecodeCost);
+   lz4ultra_ctx_set_match_candidates(pCtx, nMatchCandidates);
+
+   if (nMaxMemory > 0) {
+      /* Lower the block size until compression fits in the budget, assuming a full dictionary */
+      nBlockMaxCode = lz4ultra_ctx_get_block_max_code_for_memory(pCtx, (size_t)nMaxMemory << 20, nFlags, nBlockMaxCode, nCompressionLevel,
+         pszDictionaryFilename ? HISTORY_SIZE : 0);
+      if (nBlockMaxCode < 0) {
+         fprintf(stderr, "compression needs more than %d Mb of memory with these settings\n", nMaxMemory);
+         lz4ultra_ctx_destroy(pCtx);
+         return 100;
+      }
+   }
+
+   if (nOptions & OPT_VERBOSE) {
+      nStartTime = do_get_time();
+   }
+
+   if (nOptions & OPT_APPEND) {
+      nStatus = lz4ultra_append_file_ctx(pCtx, pszInFilename, pszOutFilename, pszDictionaryFilename, nFlags, nCompressionLevel,
+         (nOptions & OPT_VERBOSE) ? compression_start : NULL, compression_progress,
+         &nOriginalSize, &nCompressedSize, &nCommandCount);
+   }
+   else {
+      nStatus = lz4ultra_compress_file_ctx(pCtx, pszInFilename, pszOutFilename, pszDictionaryFilename, nFlags, nBlockMaxCode, nCompressionLevel,
+         (nOptions & OPT_VERBOSE) ? compression_start : NULL, compression_progress,
+         &nOriginalSize, &nCompressedSize, &nCommandCount);
+   }
+   lz4ultra_ctx_get_stats(pCtx, &stats);
+   lz4ultra_ctx_destroy(pCtx);
+
+   switch (nStatus) {
+   case LZ4ULTRA_ERROR_SRC: fprintf(stderr, "error reading '%s'\n", pszInFilename); break;
+   case LZ4ULTRA_ERROR_DST: fprintf(stderr, "error writing '%s'\n", pszOutFilename); break;
+   case LZ4ULTRA_ERROR_DICTIONARY: fprintf(stderr, "error reading dictionary '%s'\n", pszDictionaryFilename); break;
+   case LZ4ULTRA_ERROR_MEMORY: fprintf(stderr, "out of memory\n"); break;
+   case LZ4ULTRA_ERROR_COMPRESSION: fprintf(stderr, "internal compression error\n"); break;
+   case LZ4ULTRA_ERROR_RAW_TOOLARGE: fprintf(stderr, "error: raw blocks can only be used with files <= 4 Mb, use --raw-table for larger files\n"); break;
+   case LZ4ULTRA_ERROR_RAW_UNCOMPRESSED: fprintf(stderr, "error: data is incompressible, raw blocks and legacy frames only support compressed data\n"); break;
+   case LZ4ULTRA_ERROR_VERIFY: fprintf(stderr, "verification failed: compressed data doesn't decompress back to '%s'\n", pszInFilename); break;
+   case LZ4ULTRA_ERROR_APPEND: fprintf(stderr, "can't append to '%s': it must end with a single lz4 frame, without a seek table or a deduplication index\n", pszOutFilename); break;
+   case LZ4ULTRA_ERROR_FORMAT: fprintf(stderr, "invalid magic number, version, flags, or block size in '%s'\n", pszOutFilename); break;
+   case LZ4ULTRA_ERROR_CHECKSUM: fprintf(stderr, "invalid checksum in '%s'\n", pszOutFilename); break;
+   case LZ4ULTRA_ERROR_DECOMPRESSION: fprintf(stderr, "error decompressing the end of '%s'\n", pszOutFilename); break;
+   case LZ4ULTRA_OK: break;
+   default: fprintf(stderr, "unknown compression error %d\n", nStatus); break;
+   }
+
+   if (nStatus)
+      return 100;
+
+   if (nOptions & OPT_VERBOSE) {
+      nEndTime = do_get_time();
+
+      double fDelta = ((double)(nEndTime - nStartTime)) / 1000000.0;
+      double fSpeed = ((double)nOriginalSize / 1048576.0) / fDelta;
+      fprintf(info_file, "\rCompressed '%s' in %g seconds, %.02g Mb/s, %d tokens (%lld bytes/token), %lld into %lld bytes ==> %g %%\n",
+         pszInFilename, fDelta, fSpeed, nCommandCount, nCommandCount ? (nOriginalSize / ((long long)nCommandCount)) : 0,
+         nOriginalSize, nCompressedSize, nOriginalSize ? (double)(nCompressedSize * 100.0 / nOriginalSize) : 100.0);
+   }
+
+   if (nOptions & OPT_STATS) {
+      if (!(nOptions & OPT_VERBOSE))
+         fprintf(info_file, "\n");
+      print_compression_stats(&stats);
+   }
+
+   return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static int do_decompress(const char *pszInFilename, const char *pszOutFilename, const char *pszDictionaryFilename, const unsigned int nOptions, int nThreads,
+                         long long nRangeOffset, long long nRangeSize) {
+   long long nStartTime = 0LL, nEndTime = 0LL;
+   long long nOriginalSize = 0LL, nCompressedSize = 0LL;
+   lz4ultra_status_t nStatus;
+   int nFlags;
+
+   nFlags = 0;
+   if (nOptions & OPT_RAW)
+      nFlags |= LZ4ULTRA_FLAG_RAW_BLOCK;
+   if (nOptions & OPT_RAW_TABLE)
+      nFlags |= LZ4ULTRA_FLAG_RAW_TABLE;
+   if (nOptions & OPT_ASYNC_IO)
+      nFlags |= LZ4ULTRA_FLAG_ASYNC_IO;
+
+   if (nOptions & OPT_VERBOSE) {
+      nStartTime = do_get_time();
+   }
+
+   if (nRangeOffset >= 0)
+      nStatus = lz4ultra_decompress_range(pszInFilename, pszOutFilename, pszDictionaryFilename, nRangeOffset, nRangeSize, &nOriginalSize, &nCompressedSize);
+   else
+      nStatus = lz4ultra_decompress_file(pszInFilename, pszOutFilename, pszDictionaryFilename, nFlags, nThreads, &nOriginalSize, &nCompressedSize);
+
+   switch (nStatus) {
+   case LZ4ULTRA_ERROR_SRC: fprintf(stderr, "error reading '%s'\n", pszInFilename); break;
+   case LZ4ULTRA_ERROR_DST: fprintf(stderr, "error comparing compressed file '%s' with original '%s'\n", pszInFilename, pszOutFilename); break;
+   case LZ4ULTRA_ERROR_DICTIONARY: fprintf(stderr, "error reading dictionary '%s'\n", pszDictionaryFilename); break;
+   case LZ4ULTRA_ERROR_MEMORY: fprintf(stderr, "out of memory\n"); break;
+   case LZ4ULTRA_ERROR_FORMAT: fprintf(stderr, "invalid magic number, version, flags, or block size in input file\n"); break;
+   case LZ4ULTRA_ERROR_CHECKSUM: fprintf(stderr, "invalid checksum in input file\n"); break;
+   case LZ4ULTRA_ERROR_DECOMPRESSION: fprintf(stderr, "internal decompression error\n"); break;
+   case LZ4ULTRA_ERROR_NO_SEEK_TABLE: fprintf(stderr, "input file wasn't compressed with -BI --seek-table, can't decompress a range\n"); break;
+   case LZ4ULTRA_ERROR_DEDUP: fprintf(stderr, "input file was compressed with --dedup, it can only be decompressed from a file to a file\n"); break;
+   case LZ4ULTRA_OK: break;
+   default: fprintf(stderr, "unknown decompression error %d\n", nStatus); break;
+   }
+
+   if (nStatus) {
+      fprintf(stderr, "decompression error for '%s'\n", pszInFilename);
+      return 100;
+   }
+   else {
+      if (nOptions & OPT_VERBOSE) {
+         nEndTime = do_get_time();
+         double fDelta = ((double)(nEndTime - nStartTime)) / 1000000.0;
+         double fSpeed = ((double)nOriginalSize / 1048576.0) / fDelta;
+         fprintf(info_file, "Decompressed '%s' in %g seconds, %g Mb/s\n",
+            pszInFilename, fDelta, fSpeed);
+      }
+
+      return 0;
+   }
+}
+
+/*---------------------------------------------------------------------------*/
+
+typedef struct {
+   lz4ultra_stream_t fileStream;
+   void *pCompareDataBuf;
+   size_t nCompareDataSize;
+} compare_stream_t;
+
+void comparestream_close(lz4ultra_stream_t *stream) {
+   if (stream->obj) {
+      compare_stream_t *pCompareStream = (compare_stream_t *)stream->obj;
+      if (pCompareStream->pCompareDataBuf) {
+         free(pCompareStream->pCompareDataBuf);
+         pCompareStream->pCompareDataBuf = NULL;
+      }
+
+      pCompareStream->fileStream.close(&pCompareStream->fileStream);
+      free(pCompareStream);
+
+      stream->obj = NULL;
+      stream->read = NULL;
+      stream->write = NULL;
+      stream->eof = NULL;
+      stream->close = NULL;
+   }
+}
+
+size_t comparestream_read(lz4ultra_stream_t *stream, void *ptr, size_t size) {
+   return 0;
+}
+
+size_t comparestream_write(lz4ultra_stream_t *stream, void *ptr, size_t size) {
+   compare_stream_t *pCompareStream = (compare_stream_t *)stream->obj;
+
+   if (!pCompareStream->pCompareDataBuf || pCompareStream->nCompareDataSize < size) {
+      pCompareStream->nCompareDataSize = size;
+      pCompareStream->pCompareDataBuf = realloc(pCompareStream->pCompareDataBuf, pCompareStream->nCompareDataSize);
+      if (!pCompareStream->pCompareDataBuf)
+         return 0;
+   }
+
+   size_t nReadBytes = pCompareStream->fileStream.read(&pCompareStream->fileStream, pCompareStream->pCompareDataBuf, size);
+   if (nReadBytes != size) {
+      return 0;
+   }
+
+   if (memcmp(ptr, pCompareStream->pCompareDataBuf, size)) {
+      return 0;
+   }
+
+   return size;
+}
+
+int comparestream_eof(lz4ultra_stream_t *stream) {
+   compare_stream_t *pCompareStream = (compare_stream_t *)stream->obj;
+   return pCompareStream->fileStream.eof(&pCompareStream->fileStream);
+}
+
+int comparestream_open(lz4ultra_stream_t *stream, const char *pszCompareFilename, const char *pszMode) {
+   compare_stream_t *pCompareStream;
+
+   pCompareStream = (compare_stream_t*)malloc(sizeof(compare_stream_t));
+   if (!pCompareStream)
+      return -1;
+
+   pCompareStream->pCompareDataBuf = NULL;
+   pCompareStream->nCompareDataSize = 0;
+
+   if (lz4ultra_filestream_open(&pCompareStream->fileStream, pszCompareFilename, pszMode) == 0) {
+      stream->obj = pCompareStream;
+      stream->read = comparestream_read;
+      stream->write = comparestream_write;
+      stream->eof = comparestream_eof;
+      stream->close = comparestream_close;
+      return 0;
+   }
+   else {
+      free(pCompareStream);
+      return -1;
+   }
+}
+
+static int do_compare(const char *pszInFilename, const char *pszOutFilename, const char *pszDictionaryFilename, const unsigned int nOptions, int nThreads) {
+   lz4ultra_stream_t inStream, compareStream;
+   long long nStartTime = 0LL, nEndTime = 0LL;
+   long long nOriginalSize = 0LL, nCompressedSize = 0LL;
+   void *pDictionaryData = NULL;
+   int nDictionaryDataSize = 0;
+   lz4ultra_status_t nStatus;
+   int nFlags;
+
+   if (lz4ultra_filestream_open(&inStream, pszInFilename, "rb") < 0) {
+      fprintf(stderr, "error opening compressed input file\n");
+      return 100;
+   }
+
+   if (comparestream_open(&compareStream, pszOutFilename, "rb") < 0) {
+      fprintf(stderr, "error opening original uncompressed file\n");
+      inStream.close(&inStream);
+      return 100;
+   }
+
+   nStatus = lz4ultra_dictionary_load(pszDictionaryFilename, &pDictionaryData, &nDictionaryDataSize);
+   if (nStatus) {
+      compareStream.close(&compareStream);
+      inStream.close(&inStream);
+      fprintf(stderr, "error reading dictionary '%s'\n", pszDictionaryFilename);
+      return 100;
+   }
+
+   nFlags = 0;
+   if (nOptions & OPT_RAW)
+      nFlags |= LZ4ULTRA_FLAG_RAW_BLOCK;
+   if (nOptions & OPT_RAW_TABLE)
+      nFlags |= LZ4ULTRA_FLAG_RAW_TABLE;
+   if (nOptions & OPT_ASYNC_IO)
+      nFlags |= LZ4ULTRA_FLAG_ASYNC_IO;
+
+   if (nOptions & OPT_VERBOSE) {
+      nStartTime = do_get_time();
+   }
+
+   nStatus = lz4ultra_decompress_stream(&inStream, &compareStream, pDictionaryData, nDictionaryDataSize, nFlags, nThreads, &nOriginalSize, &nCompressedSize);
+   switch (nStatus) {
+   case LZ4ULTRA_ERROR_SRC: fprintf(stderr, "error reading '%s'\n", pszInFilename); break;
+   case LZ4ULTRA_ERROR_DST: fprintf(stderr, "error comparing compressed file '%s' with original '%s'\n", pszInFilename, pszOutFilename); break;
+   case LZ4ULTRA_ERROR_MEMORY: fprintf(stderr, "out of memory\n"); break;
+   case LZ4ULTRA_ERROR_FORMAT: fprintf(stderr, "invalid magic number, version, flags, or block size in input file\n"); break;
+   case LZ4ULTRA_ERROR_CHECKSUM: fprintf(stderr, "invalid checksum in input file\n"); break;
+   case LZ4ULTRA_ERROR_DECOMPRESSION: fprintf(stderr, "internal decompression error\n"); break;
+   case LZ4ULTRA_ERROR_DEDUP: fprintf(stderr, "input file was compressed with --dedup, it can't be compared as a stream\n"); break;
+   case LZ4ULTRA_OK: break;
+   default: fprintf(stderr, "unknown decompression error %d\n", nStatus); break;
+   }
+        
+   lz4ultra_dictionary_free(&pDictionaryData);
+   compareStream.close(&compareStream);
+   inStream.close(&inStream);
+
+   if (nStatus) {
+      return 100;
+   }
+   else {
+      if (nOptions & OPT_VERBOSE) {
+         nEndTime = do_get_time();
+         double fDelta = ((double)(nEndTime - nStartTime)) / 1000000.0;
+         double fSpeed = ((double)nOriginalSize / 1048576.0) / fDelta;
+         fprintf(info_file, "Compared '%s' in %g seconds, %g Mb/s\n",
+            pszInFilename, fDelta, fSpeed);
+      }
+
+      return 0;
+   }
+}
+
+/*---------------------------------------------------------------------------*/
+
+typedef struct {
+   const unsigned char *pData;
+   unsigned char *pOutData;
+   size_t nDataSize;
+   size_t nOffset;
+} memory_stream_t;
+
+static size_t memorystream_read(lz4ultra_stream_t *stream, void *ptr, size_t size) {
+   memory_stream_t *pMemoryStream = (memory_stream_t *)stream->obj;
+
+   if (size > (pMemoryStream->nDataSize - pMemoryStream->nOffset))
+      size = pMemoryStream->nDataSize - pMemoryStream->nOffset;
+   if (size)
+      memcpy(ptr, pMemoryStream->pData + pMemoryStream->nOffset, size);
+   pMemoryStream->nOffset += size;
+   return size;
+}
+
+static size_t memorystream_write(lz4ultra_stream_t *stream, void *ptr, size_t size) {
+   memory_stream_t *pMemoryStream = (memory_stream_t *)stream->obj;
+
+   if (pMemoryStream->pOutData) {
+      /* Store the written bytes, failing writes that don't fit */
+      if (size > (pMemoryStream->nDataSize - pMemoryStream->nOffset))
+         return 0;
+      if (size)
+         memcpy(pMemoryStream->pOutData + pMemoryStream->nOffset, ptr, size);
+   }
+
+   /* Otherwise, only count the written bytes */
+   pMemoryStream->nOffset += size;
+   return size;
+}
+
+static int memorystream_eof(lz4ultra_stream_t *stream) {
+   memory_stream_t *pMemoryStream = (memory_stream_t *)stream->obj;
+   return (pMemoryStream->nOffset >= pMemoryStream->nDataSize) ? 1 : 0;
+}
+
+static void memorystream_close(lz4ultra_stream_t *stream) {
+}
+
+static void memorystream_open(lz4ultra_stream_t *stream, memory_stream_t *pMemoryStream, const unsigned char *pData, size_t nDataSize) {
+   pMemoryStream->pData = pData;
+   pMemoryStream->pOutData = NULL;
+   pMemoryStream->nDataSize = nDataSize;
+   pMemoryStream->nOffset = 0;
+
+   stream->obj = pMemoryStream;
+   stream->read = memorystream_read;
+   stream->write = memorystream_write;
+   stream->eof = memorystream_eof;
+   stream->close = memorystream_close;
+}
+
+static void memorystream_open_output(lz4ultra_stream_t *stream, memory_stream_t *pMemoryStream, unsigned char *pOutData, size_t nOutDataSize) {
+   memorystream_open(stream, pMemoryStream, NULL, nOutDataSize);
+   pMemoryStream->pOutData = pOutData;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void generate_compressible_data(unsigned char *pBuffer, size_t nBufferSize, unsigned int nSeed, int nNumLiteralValues, float fMatchProbability, size_t nMaxMatchOffset) {
+   size_t nIndex = 0;
+   int nMatchProbability = (int)(fMatchProbability * 1023.0f);
+
+   srand(nSeed);
+
+   if (nBufferSize == 0) return;
+   pBuffer[nIndex++] = rand() % nNumLiteralValues;
+
+   while (nIndex < nBufferSize) {
+      if ((rand() & 1023) >= nMatchProbability) {
+         size_t nLiteralCount = rand() & 127;
+         if (nLiteralCount > (nBufferSize - nIndex))
+            nLiteralCount = nBufferSize - nIndex;
+
+         while (nLiteralCount--)
+            pBuffer[nIndex++] = rand() % nNumLiteralValues;
+      }
+      else {
+         size_t nMatchLength = MIN_MATCH_SIZE + (rand() & 1023);
+         size_t nMatchOffset;
+
+         if (nMatchLength > (nBufferSize - nIndex))
+            nMatchLength = nBufferSize - nIndex;
+         if (nMatchLength > nIndex)
+            nMatchLength = nIndex;
+
+         if (nMatchLength < nIndex) {
+            nMatchOffset = nIndex - nMatchLength;
+            if (nMaxMatchOffset && nMatchOffset > nMaxMatchOffset)
+               nMatchOffset = nMaxMatchOffset;
+            nMatchOffset = rand() % nMatchOffset;
+         }
+         else
+            nMatchOffset = 0;
+
+         while (nMatchLength--) {
+            pBuffer[nIndex] = pBuffer[nIndex - nMatchOffset];
+            nIndex++;
+         }
+      }
+   }
+}
+
+static void xor_data(unsigned char *pBuffer, size_t nBufferSize, unsigned int nSeed, float fXorProbability) {
+   size_t nIndex = 0;
+   int nXorProbability = (int)(fXorProbability * 1023.0f);
+
+   srand(nSeed);
+
+   while (nIndex < nBufferSize) {
+      if ((rand() & 1023) < nXorProbability) {
+         pBuffer[nIndex] ^= 0xff;
+      }
+      nIndex++;
+   }
+}
+
+static void generate_sparse_repeats(unsigned char *pBuffer, size_t nBufferSize, unsigned int nSeed, size_t nGapSize, int nMinRepeatSize, int nMaxRepeatSize) {
+   size_t nIndex;
+
+   srand(nSeed);
+
+   for (nIndex = 0; nIndex < nBufferSize; nIndex++)
+      pBuffer[nIndex] = rand() & 0xff;
+
+   /* Copy a few bytes from an earlier position once every nGapSize bytes of otherwise random data */
+   for (nIndex = nGapSize; nIndex < nBufferSize; nIndex += nGapSize) {
+      size_t nRepeatSize = nMinRepeatSize + (rand() % (nMaxRepeatSize - nMinRepeatSize + 1));
+      size_t nMaxOffset = (nIndex > (MAX_OFFSET - nRepeatSize)) ? (MAX_OFFSET - nRepeatSize) : (nIndex - nRepeatSize);
+      size_t nOffset = nRepeatSize + (rand() % (nMaxOffset - nRepeatSize + 1));
+
+      if (nRepeatSize > (nBufferSize - nIndex))
+         nRepeatSize = nBufferSize - nIndex;
+      memcpy(pBuffer + nIndex, pBuffer + nIndex - nOffset, nRepeatSize);
+   }
+}
+
+static int do_sparse_repeats_test(lz4ultra_ctx *pCtx, unsigned int nFlags, int nBlockMaxCode, int nCompressionLevel, int nThreads) {
+   static const int nTestCases[3][3] = { { 400, 16, 16 }, { 800, 8, 16 }, { 2000, 12, 24 } };
+   const size_t nDataSize = 4 * HISTORY_SIZE;
+   const size_t nMaxCompressedSize = lz4ultra_get_max_compressed_size_inmem(nDataSize, nFlags, nBlockMaxCode);
+   unsigned char *pData = (unsigned char*)malloc(nDataSize);
+   unsigned char *pDecompressedData = (unsigned char*)malloc(nDataSize);
+   unsigned char *pCompressedData = (unsigned char*)malloc(nMaxCompressedSize);
+   int nResult = 0;
+   int i;
+
+   if (!pData || !pDecompressedData || !pCompressedData) {
+      fprintf(stderr, "out of memory, %zu bytes needed\n", nDataSize * 2 + nMaxCompressedSize);
+      nResult = 100;
+   }
+
+   /* Random data with sparse short repeats compresses by a few percent, that must not be given up by storing the blocks as is; legacy frames
+    * can't store blocks at all */
+   for (i = 0; i < 3 && !nResult; i++) {
+      size_t nCompressedSize, nDecompressedSize;
+
+      generate_sparse_repeats(pData, nDataSize, 1000 + i, nTestCases[i][0], nTestCases[i][1], nTestCases[i][2]);
+
+      nCompressedSize = lz4ultra_compress_inmem_ctx(pCtx, pData, pCompressedData, nDataSize, nMaxCompressedSize, nFlags, nBlockMaxCode, nCompressionLevel);
+      if (nCompressedSize == (size_t)-1 || nCompressedSize >= nDataSize) {
+         fprintf(stderr, "self-test: sparse repeats every %d bytes %s, flags %x\n", nTestCases[i][0],
+            (nCompressedSize == (size_t)-1) ? "failed to compress" : "were stored uncompressed", nFlags);
+         nResult = 100;
+         break;
+      }
+
+      nDecompressedSize = lz4ultra_decompress_inmem(pCompressedData, pDecompressedData, nCompressedSize, nDataSize, nFlags, nThreads);
+      if (nDecompressedSize != nDataSize || memcmp(pData, pDecompressedData, nDataSize)) {
+         fprintf(stderr, "self-test: error decompressing sparse repeats every %d bytes, flags %x\n", nTestCases[i][0], nFlags);
+         nResult = 100;
+         break;
+      }
+   }
+
+   free(pCompressedData);
+   free(pDecompressedData);
+   free(pData);
+   return nResult;
+}
+
+static int get_self_test_filename(char *pszFilename, const char *pszName) {
+   /* Name temporary files after the process, so that concurrent self-tests don't overwrite each other's files */
+#ifdef _WIN32
+   const char *pszTempPath = getenv("TEMP");
+   const unsigned long nProcessId = (unsigned long)GetCurrentProcessId();
+#else
+   const char *pszTempPath = getenv("TMPDIR");
+   const unsigned long nProcessId = (unsigned long)getpid();
+#endif
+
+   if (!pszTempPath || !pszTempPath[0])
+#ifdef _WIN32
+      pszTempPath = ".";
+#else
+      pszTempPath = "/tmp";
+#endif
+   if ((strlen(pszTempPath) + strlen(pszName) + 32) > SELF_TEST_MAX_PATH) {
+      fprintf(stderr, "self-test: temporary path '%s' is too long\n", pszTempPath);
+      return 100;
+   }
+
+   sprintf(pszFilename, "%s/lz4ultra-test-%lu-%s", pszTempPath, nProcessId, pszName);
+   return 0;
+}
+
+static int write_self_test_file(const char *pszFilename, const unsigned char *pData, size_t nDataSize) {
+   FILE *f_out = fopen(pszFilename, "wb");
+   int nResult = 0;
+
+   if (!f_out) {
+      fprintf(stderr, "self-test: error creating '%s'\n", pszFilename);
+      return 100;
+   }
+
+   if (nDataSize && fwrite(pData, 1, nDataSize, f_out) != nDataSize)
+      nResult = 100;
+   if (fclose(f_out))
+      nResult = 100;
+   if (nResult)
+      fprintf(stderr, "self-test: error writing '%s'\n", pszFilename);
+   return nResult;
+}
+
+static size_t read_self_test_file(const char *pszFilename, unsigned char *pData, size_t nMaxDataSize) {
+   FILE *f_in = fopen(pszFilename, "rb");
+   size_t nDataSize;
+
+   if (!f_in)
+      return (size_t)-1;
+
+   /* Fail files that don't fit, rather than returning part of them */
+   nDataSize = fread(pData, 1, nMaxDataSize, f_in);
+   if (ferror(f_in) || fgetc(f_in) != EOF)
+      nDataSize = (size_t)-1;
+   fclose(f_in);
+   return nDataSize;
+}
+
+static int do_dedup_file_test(lz4ultra_ctx *pCtx, unsigned int nFlags, int nBlockMaxCode, int nCompressionLevel, int nThreads) {
+   const size_t nRepeatSize = 1024 * 1024;
+   const size_t nDataSize = nRepeatSize + 4 * HISTORY_SIZE + nRepeatSize + 1000;
+   const size_t nMaxCompressedSize = lz4ultra_get_max_compressed_size_inmem(nDataSize, nFlags, nBlockMaxCode) + 1024;
+   unsigned char *pData = (unsigned char*)malloc(nDataSize);
+   unsigned char *pDecompressedData = (unsigned char*)malloc(nDataSize);
+   unsigned char *pCompressedData = (unsigned char*)malloc(nMaxCompressedSize);
+   char szInFilename[SELF_TEST_MAX_PATH], szCompressedFilename[SELF_TEST_MAX_PATH], szOutFilename[SELF_TEST_MAX_PATH];
+   long long nOriginalSize = 0, nCompressedSize = 0;
+   int nCommandCount = 0;
+   int nResult = 0;
+   size_t nIndex;
+
+   if (!pData || !pDecompressedData || !pCompressedData) {
+      fprintf(stderr, "out of memory, %zu bytes needed\n", nDataSize * 2 + nMaxCompressedSize);
+      nResult = 100;
+   }
+
+   if (!nResult && (get_self_test_filename(szInFilename, "dedup.dat") || get_self_test_filename(szCompressedFilename, "dedup.lz4") ||
+                    get_self_test_filename(szOutFilename, "dedup.out"))) {
+      nResult = 100;
+   }
+
+   if (!nResult) {
+      /* Random data that repeats its first megabyte much further than a match can reach, so that it can only be left out as a repeated range */
+      srand(2000);
+      for (nIndex = 0; nIndex < nDataSize; nIndex++)
+         pData[nIndex] = rand() & 0xff;
+      memcpy(pData + nRepeatSize + 4 * HISTORY_SIZE, pData, nRepeatSize);
+
+      nResult = write_self_test_file(szInFilename, pData, nDataSize);
+   }
+
+   if (!nResult) {
+      if (lz4ultra_compress_file_ctx(pCtx, szInFilename, szCompressedFilename, NULL, nFlags | LZ4ULTRA_FLAG_DEDUP, nBlockMaxCode, nCompressionLevel, NULL, NULL,
+                                     &nOriginalSize, &nCompressedSize, &nCommandCount) != LZ4ULTRA_OK ||
+          nOriginalSize != (long long)nDataSize || nCompressedSize >= (long long)(nDataSize - nRepeatSize / 2)) {
+         fprintf(stderr, "self-test: repeated range wasn't left out when compressing with deduplication, flags %x\n", nFlags);
+         nResult = 100;
+      }
+   }
+
+   if (!nResult) {
+      if (lz4ultra_decompress_file(szCompressedFilename, szOutFilename, NULL, 0, nThreads, &nOriginalSize, &nCompressedSize) != LZ4ULTRA_OK ||
+          read_self_test_file(szOutFilename, pDecompressedData, nDataSize) != nDataSize || memcmp(pData, pDecompressedData, nDataSize)) {
+         fprintf(stderr, "self-test: error decompressing deduplicated file, flags %x\n", nFlags);
+         nResult = 100;
+      }
+   }
+
+   if (!nResult) {
+      size_t nFileSize = read_self_test_file(szCompressedFilename, pCompressedData, nMaxCompressedSize);
+      size_t nIndexSize = 0;
+
+      /* Decoders that skip the deduplication index, as it is a skippable frame, and don't restore the repeated ranges must fail rather than
+       * return the data without them */
+      if (nFileSize != (size_t)-1 && nFileSize >= LZ4ULTRA_HEADER_SIZE + 4)
+         nIndexSize = 8 + (size_t)(pCompressedData[4] | (pCompressedData[5] << 8) | (pCompressedData[6] << 16) | ((unsigned int)pCompressedData[7] << 24));
+      if (nFileSize == (size_t)-1 || nIndexSize >= nFileSize ||
+          lz4ultra_decompress_inmem(pCompressedData, pDecompressedData, nFileSize, nDataSize, 0, nThreads) != (size_t)-1 ||
+          lz4ultra_decompress_inmem(pCompressedData + nIndexSize, pDecompressedData, nFileSize - nIndexSize, nDataSize, 0, nThreads) != (size_t)-1) {
+         fprintf(stderr, "self-test: deduplicated file decompressed without restoring the repeated ranges, flags %x\n", nFlags);
+         nResult = 100;
+      }
+   }
+
+   remove(szOutFilename);
+   remove(szCompressedFilename);
+   remove(szInFilename);
+   free(pCompressedData);
+   free(pDecompressedData);
+   free(pData);
+   return nResult;
+}
+
+static size_t decompress_dstream_pieces(const unsigned char *pCompressedData, size_t nCompressedSize, unsigned char *pOutData, size_t nMaxOutDataSize,
+                                        const void *pDictionaryData, int nDictionaryDataSize) {
+   lz4ultra_dstream *pStream = lz4ultra_dstream_create(pDictionaryData, nDictionaryDataSize, NULL);
+   size_t nInOffset = 0, nOutOffset = 0;
+   long long nOriginalSize = 0, nDecompressedSize = 0;
+   lz4ultra_status_t nStatus = LZ4ULTRA_OK;
+   int nPiece = 0;
+
+   if (!pStream)
+      return (size_t)-1;
+
+   /* Push the compressed data in uneven pieces, some splitting headers and blocks, into an output buffer that is often too small */
+   while (nStatus == LZ4ULTRA_OK) {
+      size_t nInSize = (size_t)((nPiece * 7919) % 9000 + 1);
+      size_t nOutSize = (size_t)((nPiece * 104729) % 70000 + 1);
+
+      if (nInSize > (nCompressedSize - nInOffset))
+         nInSize = nCompressedSize - nInOffset;
+      if (nOutSize > (nMaxOutDataSize - nOutOffset))
+         nOutSize = nMaxOutDataSize - nOutOffset;
+
+      nStatus = lz4ultra_dstream_decompress(pStream, pCompressedData + nInOffset, &nInSize, pOutData + nOutOffset, &nOutSize);
+      if (!nInSize && !nOutSize)
+         break;
+      nInOffset += nInSize;
+      nOutOffset += nOutSize;
+      nPiece++;
+   }
+
+   if (lz4ultra_dstream_end(pStream, &nOriginalSize, &nDecompressedSize) != LZ4ULTRA_OK || nStatus != LZ4ULTRA_OK || nInOffset != nCompressedSize ||
+       nOriginalSize != (long long)nOutOffset || nDecompressedSize != (long long)nCompressedSize)
+      return (size_t)-1;
+   return nOutOffset;
+}
+
+static int do_cstream_test(lz4ultra_ctx *pCtx, unsigned int nFlags, int nCompressionLevel, int nThreads) {
+   const int nBlockMaxCode = 4;
+   const size_t nDataSize = 5 * 65536 + 1234;
+   const int nDictionaryDataSize = 32768;
+   const size_t nMaxCompressedSize = lz4ultra_get_max_compressed_size_inmem(nDataSize, nFlags | LZ4ULTRA_FLAG_INDEP_BLOCKS, nBlockMaxCode) + 4096;
+   unsigned char *pData = (unsigned char*)malloc(nDataSize + nDictionaryDataSize);
+   unsigned char *pDecompressedData = (unsigned char*)malloc(nDataSize);
+   unsigned char *pCompressedData = (unsigned char*)malloc(nMaxCompressedSize);
+   int nResult = 0;
+   int i;
+
+   if (!pData || !pDecompressedData || !pCompressedData) {
+      fprintf(stderr, "out of memory, %zu bytes needed\n", nDataSize * 2 + nDictionaryDataSize + nMaxCompressedSize);
+      nResult = 100;
+   }
+
+   if (!nResult) {
+      /* The dictionary is made of the same kind of data, generated with another seed, that is stored right after the data to compress */
+      generate_compressible_data(pData, nDataSize, 3000, 56, 0.5f, 0);
+      generate_compressible_data(pData + nDataSize, nDictionaryDataSize, 3001, 56, 0.5f, 0);
+   }
+
+   /* Compress with and without a dictionary, with linked and independent blocks */
+   for (i = 0; i < 4 && !nResult; i++) {
+      const unsigned int nStreamFlags = nFlags | ((i & 1) ? LZ4ULTRA_FLAG_INDEP_BLOCKS : 0);
+      const unsigned char *pDictionaryData = (i & 2) ? (pData + nDataSize) : NULL;
+      const int nStreamDictionarySize = (i & 2) ? nDictionaryDataSize : 0;
+      lz4ultra_stream_t outStream;
+      memory_stream_t outMemoryStream;
+      lz4ultra_cstream *pStream;
+      long long nOriginalSize = 0, nCompressedSize = 0;
+      size_t nOffset = 0;
+      int nChunk = 0;
+
+      memorystream_open_output(&outStream, &outMemoryStream, pCompressedData, nMaxCompressedSize);
+      pStream = lz4ultra_cstream_create(pCtx, &outStream, pDictionaryData, nStreamDictionarySize, nStreamFlags, nBlockMaxCode, nCompressionLevel);
+      if (!pStream) {
+         fprintf(stderr, "self-test: error creating compression stream, flags %x\n", nStreamFlags);
+         nResult = 100;
+         break;
+      }
+
+      /* Push uneven chunks, from single bytes to more than one block, flushing after some of them */
+      while (nOffset < nDataSize && !nResult) {
+         static const size_t nChunkSizes[8] = { 1, 3000, 70000, 17, 65536, 12345, 0, 100001 };
+         size_t nChunkSize = nChunkSizes[nChunk & 7];
+
+         if (nChunkSize > (nDataSize - nOffset))
+            nChunkSize = nDataSize - nOffset;
+         if (lz4ultra_cstream_update(pStream, pData + nOffset, nChunkSize) != LZ4ULTRA_OK ||
+             ((nChunk % 3) == 1 && lz4ultra_cstream_flush(pStream) != LZ4ULTRA_OK)) {
+            nResult = 100;
+         }
+         nOffset += nChunkSize;
+         nChunk++;
+      }
+
+      if (lz4ultra_cstream_end(pStream, &nOriginalSize, &nCompressedSize) != LZ4ULTRA_OK || nResult ||
+          nOriginalSize != (long long)nDataSize || nCompressedSize != (long long)outMemoryStream.nOffset) {
+         fprintf(stderr, "self-test: error compressing with compression stream, flags %x\n", nStreamFlags);
+         nResult = 100;
+         break;
+      }
+
+      /* Decompress in memory, or as a stream when there is a dictionary as the in-memory decompressor takes none, then with a decompression stream */
+      if (pDictionaryData) {
+         lz4ultra_stream_t inStream;
+         memory_stream_t inMemoryStream;
+
+         memorystream_open(&inStream, &inMemoryStream, pCompressedData, (size_t)nCompressedSize);
+         memorystream_open_output(&outStream, &outMemoryStream, pDecompressedData, nDataSize);
+         if (lz4ultra_decompress_stream(&inStream, &outStream, pDictionaryData, nStreamDictionarySize, 0, nThreads, &nOriginalSize, &nCompressedSize) != LZ4ULTRA_OK ||
+             nOriginalSize != (long long)nDataSize)
+            nResult = 100;
+      }
+      else {
+         if (lz4ultra_decompress_inmem(pCompressedData, pDecompressedData, (size_t)nCompressedSize, nDataSize, 0, nThreads) != nDataSize)
+            nResult = 100;
+      }
+
+      if (nResult || memcmp(pData, pDecompressedData, nDataSize)) {
+         fprintf(stderr, "self-test: error decompressing output of compression stream, flags %x\n", nStreamFlags);
+         nResult = 100;
+         break;
+      }
+
+      memset(pDecompressedData, 0, nDataSize);
+      if (decompress_dstream_pieces(pCompressedData, (size_t)nCompressedSize, pDecompressedData, nDataSize, pDictionaryData, nStreamDictionarySize) != nDataSize ||
+          memcmp(pData, pDecompressedData, nDataSize)) {
+         fprintf(stderr, "self-test: error decompressing output of compression stream with decompression stream, flags %x\n", nStreamFlags);
+         nResult = 100;
+         break;
+      }
+   }
+
+   free(pCompressedData);
+   free(pDecompressedData);
+   free(pData);
+   return nResult;
+}
+
+static int do_batch_test(unsigned int nFlags, int nBlockMaxCode, int nCompressionLevel) {
+   const int nBuffers = 40;
+   const int nTooSmallBuffer = 23;
+   const size_t nMaxInputSize = 6000;
+   const size_t nMaxCompressedSize = lz4ultra_get_max_compressed_size_inmem(nMaxInputSize, nFlags, nBlockMaxCode);
+   lz4ultra_batch_buffer *pBuffers = (lz4ultra_batch_buffer*)malloc(nBuffers * sizeof(lz4ultra_batch_buffer));
+   unsigned char *pData = (unsigned char*)malloc(nBuffers * nMaxInputSize);
+   unsigned char *pCompressedData = (unsigned char*)malloc(nBuffers * nMaxCompressedSize);
+   unsigned char *pDecompressedData = (unsigned char*)malloc(nMaxInputSize);
+   lz4ultra_ctx *pCtx = lz4ultra_ctx_create(4);
+   int nResult = 0;
+   int i;
+
+   if (!pBuffers || !pData || !pCompressedData || !pDecompressedData || !pCtx) {
+      fprintf(stderr, "out of memory\n");
+      nResult = 100;
+   }
+
+   if (!nResult) {
+      /* Small records of different sizes and contents, the first one empty, and one with an output buffer that can't even hold the header */
+      for (i = 0; i < nBuffers; i++) {
+         pBuffers[i].pInputData = pData + i * nMaxInputSize;
+         pBuffers[i].nInputSize = (size_t)((i * 2999) % (int)nMaxInputSize);
+         pBuffers[i].pOutBuffer = pCompressedData + i * nMaxCompressedSize;
+         pBuffers[i].nMaxOutBufferSize = (i == nTooSmallBuffer) ? 4 : nMaxCompressedSize;
+         pBuffers[i].nCompressedSize = 0;
+         generate_compressible_data(pData + i * nMaxInputSize, nMaxInputSize, 4000 + i, 1 + (i * 37) % 256, (float)(i % 10) * 0.1f, 0);
+      }
+
+      if (lz4ultra_compress_batch(pCtx, pBuffers, nBuffers, nFlags, nBlockMaxCode, nCompressionLevel) != 1) {
+         fprintf(stderr, "self-test: batch compression didn't fail for exactly one buffer, flags %x\n", nFlags);
+         nResult = 100;
+      }
+   }
+
+   for (i = 0; i < nBuffers && !nResult; i++) {
+      if (i == nTooSmallBuffer) {
+         if (pBuffers[i].nCompressedSize != (size_t)-1) {
+            fprintf(stderr, "self-test: batch compression into a too small buffer didn't fail, flags %x\n", nFlags);
+            nResult = 100;
+         }
+      }
+      else if (pBuffers[i].nCompressedSize == (size_t)-1 ||
+               lz4ultra_decompress_inmem(pBuffers[i].pOutBuffer, pDecompressedData, pBuffers[i].nCompressedSize, nMaxInputSize, 0, 1) != pBuffers[i].nInputSize ||
+               memcmp(pBuffers[i].pInputData, pDecompressedData, pBuffers[i].nInputSize)) {
+         fprintf(stderr, "self-test: error compressing buffer %d of %zu bytes in a batch, flags %x\n", i, pBuffers[i].nInputSize, nFlags);
+         nResult = 100;
+      }
+   }
+
+   if (pCtx)
+      lz4ultra_ctx_destroy(pCtx);
+   free(pDecompressedData);
+   free(pCompressedData);
+   free(pData);
+   free(pBuffers);
+   return nResult;
+}
+
+static int do_range_test(lz4ultra_ctx *pCtx, unsigned int nFlags, int nCompressionLevel) {
+   static const long long nRanges[6][2] = {
+      { 1000, 2000 },                           /* starts and ends in the first block */
+      { 65536 + 100, 3 * 65536 },               /* starts and ends in the middle of blocks, covering several */
+      { 65536, 65536 },                         /* exactly one block */
+      { 5 * 65536 - 300, 5000 },                /* runs past the end */
+      { 2 * 65536 + 7, 0x7fffffffffffffffLL },  /* to the end */
+      { 6 * 65536, 10 } };                      /* entirely past the end */
+   const int nBlockMaxCode = 4;
+   const size_t nDataSize = 5 * 65536 + 777;
+   unsigned char *pData = (unsigned char*)malloc(nDataSize);
+   unsigned char *pDecompressedData = (unsigned char*)malloc(nDataSize + 1);
+   char szInFilename[SELF_TEST_MAX_PATH], szCompressedFilename[SELF_TEST_MAX_PATH], szOutFilename[SELF_TEST_MAX_PATH];
+   long long nOriginalSize = 0, nCompressedSize = 0;
+   int nCommandCount = 0;
+   int nResult = 0;
+   int i;
+
+   if (!pData || !pDecompressedData) {
+      fprintf(stderr, "out of memory, %zu bytes needed\n", nDataSize * 2 + 1);
+      nResult = 100;
+   }
+
+   if (!nResult && (get_self_test_filename(szInFilename, "range.dat") || get_self_test_filename(szCompressedFilename, "range.lz4") ||
+                    get_self_test_filename(szOutFilename, "range.out"))) {
+      nResult = 100;
+   }
+
+   if (!nResult) {
+      generate_compressible_data(pData, nDataSize, 5000, 96, 0.5f, 0);
+      nResult = write_self_test_file(szInFilename, pData, nDataSize);
+   }
+
+   if (!nResult && lz4ultra_compress_file_ctx(pCtx, szInFilename, szCompressedFilename, NULL, nFlags | LZ4ULTRA_FLAG_INDEP_BLOCKS | LZ4ULTRA_FLAG_SEEK_TABLE, nBlockMaxCode,
+                                              nCompressionLevel, NULL, NULL, &nOriginalSize, &nCompressedSize, &nCommandCount) != LZ4ULTRA_OK) {
+      fprintf(stderr, "self-test: error compressing with a seek table, flags %x\n", nFlags);
+      nResult = 100;
+   }
+
+   for (i = 0; i < 6 && !nResult; i++) {
+      const long long nRangeOffset = nRanges[i][0];
+      const long long nRangeEnd = (nRanges[i][1] > ((long long)nDataSize - nRangeOffset)) ? (long long)nDataSize : (nRangeOffset + nRanges[i][1]);
+      const size_t nExpectedSize = (nRangeEnd > nRangeOffset) ? (size_t)(nRangeEnd - nRangeOffset) : 0;
+
+      if (lz4ultra_decompress_range(szCompressedFilename, szOutFilename, NULL, nRangeOffset, nRanges[i][1], &nOriginalSize, &nCompressedSize) != LZ4ULTRA_OK ||
+          nOriginalSize != (long long)nExpectedSize || read_self_test_file(szOutFilename, pDecompressedData, nDataSize + 1) != nExpectedSize ||
+          (nExpectedSize && memcmp(pData + nRangeOffset, pDecompressedData, nExpectedSize))) {
+         fprintf(stderr, "self-test: error decompressing range of %lld bytes at %lld, flags %x\n", nRanges[i][1], nRangeOffset, nFlags);
+         nResult = 100;
+      }
+   }
+
+   /* Without a seek table, ranges can't be decompressed */
+   if (!nResult && lz4ultra_compress_file_ctx(pCtx, szInFilename, szCompressedFilename, NULL, nFlags | LZ4ULTRA_FLAG_INDEP_BLOCKS, nBlockMaxCode,
+                                              nCompressionLevel, NULL, NULL, &nOriginalSize, &nCompressedSize, &nCommandCount) != LZ4ULTRA_OK) {
+      fprintf(stderr, "self-test: error compressing without a seek table, flags %x\n", nFlags);
+      nResult = 100;
+   }
+
+   if (!nResult && lz4ultra_decompress_range(szCompressedFilename, szOutFilename, NULL, 1000, 2000, &nOriginalSize, &nCompressedSize) != LZ4ULTRA_ERROR_NO_SEEK_TABLE) {
+      fprintf(stderr, "self-test: range was decompressed without a seek table, flags %x\n", nFlags);
+      nResult = 100;
+   }
+
+   remove(szOutFilename);
+   remove(szCompressedFilename);
+   remove(szInFilename);
+   free(pDecompressedData);
+   free(pData);
+   return nResult;
+}
+
+static int do_append_test(lz4ultra_ctx *pCtx, unsigned int nFlags, int nCompressionLevel, int nThreads) {
+   static const char *pszCases[2] = { "a seek table", "a deduplication index" };
+   const int nBlockMaxCode = 4;
+   const size_t nPartSizes[3] = { 2 * 65536 + 5000, 12345, 65536 + 1 };
+   const size_t nDataSize = nPartSizes[0] + nPartSizes[1] + nPartSizes[2];
+   unsigned char *pData = (unsigned char*)malloc(nDataSize);
+   unsigned char *pDecompressedData = (unsigned char*)malloc(2 * nDataSize);
+   char szInFilename[SELF_TEST_MAX_PATH], szCompressedFilename[SELF_TEST_MAX_PATH], szOutFilename[SELF_TEST_MAX_PATH];
+   long long nOriginalSize = 0, nCompressedSize = 0;
+   int nCommandCount = 0;
+   int nResult = 0;
+   size_t nOffset = 0;
+   int i;
+
+   if (!pData || !pDecompressedData) {
+      fprintf(stderr, "out of memory, %zu bytes needed\n", nDataSize * 3);
+      nResult = 100;
+   }
+
+   if (!nResult && (get_self_test_filename(szInFilename, "append.dat") || get_self_test_filename(szCompressedFilename, "append.lz4") ||
+                    get_self_test_filename(szOutFilename, "append.out"))) {
+      nResult = 100;
+   }
+
+   if (!nResult)
+      generate_compressible_data(pData, nDataSize, 6000, 137, 0.6f, 0);
+
+   /* Compress the first part with a checksum and the size of the decompressed data, then append the other parts to the same frame */
+   for (i = 0; i < 3 && !nResult; i++) {
+      lz4ultra_status_t nStatus;
+
+      nResult = write_self_test_file(szInFilename, pData + nOffset, nPartSizes[i]);
+      if (nResult)
+         break;
+
+      if (i == 0) {
+         nStatus = lz4ultra_compress_file_ctx(pCtx, szInFilename, szCompressedFilename, NULL, nFlags | LZ4ULTRA_FLAG_CONTENT_CHECKSUM | LZ4ULTRA_FLAG_CONTENT_SIZE,
+            nBlockMaxCode, nCompressionLevel, NULL, NULL, &nOriginalSize, &nCompressedSize, &nCommandCount);
+      }
+      else {
+         nStatus = lz4ultra_append_file_ctx(pCtx, szInFilename, szCompressedFilename, NULL, nFlags & LZ4ULTRA_FLAG_FAVOR_RATIO, nCompressionLevel, NULL, NULL,
+            &nOriginalSize, &nCompressedSize, &nCommandCount);
+      }
+      if (nStatus != LZ4ULTRA_OK || nOriginalSize != (long long)nPartSizes[i]) {
+         fprintf(stderr, "self-test: error %s part %d of %zu bytes, flags %x\n", i ? "appending" : "compressing", i, nPartSizes[i], nFlags);
+         nResult = 100;
+         break;
+      }
+      nOffset += nPartSizes[i];
+
+      if (lz4ultra_decompress_file(szCompressedFilename, szOutFilename, NULL, 0, nThreads, &nOriginalSize, &nCompressedSize) != LZ4ULTRA_OK ||
+          nOriginalSize != (long long)nOffset || read_self_test_file(szOutFilename, pDecompressedData, nDataSize + 1) != nOffset ||
+          memcmp(pData, pDecompressedData, nOffset)) {
+         fprintf(stderr, "self-test: error decompressing file after %s part %d, flags %x\n", i ? "appending" : "compressing", i, nFlags);
+         nResult = 100;
+      }
+   }
+
+   /* Files whose frame doesn't end them can't be appended to */
+   for (i = 0; i < 2 && !nResult; i++) {
+      if (i == 0) {
+         nResult = write_self_test_file(szInFilename, pData, nPartSizes[0]);
+         if (!nResult && lz4ultra_compress_file_ctx(pCtx, szInFilename, szCompressedFilename, NULL, nFlags | LZ4ULTRA_FLAG_INDEP_BLOCKS | LZ4ULTRA_FLAG_SEEK_TABLE,
+                                                    nBlockMaxCode, nCompressionLevel, NULL, NULL, &nOriginalSize, &nCompressedSize, &nCommandCount) != LZ4ULTRA_OK)
+            nResult = 100;
+      }
+      else {
+         /* Repeat random data further than a match can reach, so that the repeat is left out in a deduplication index */
+         size_t nIndex;
+
+         srand(6001);
+         for (nIndex = 0; nIndex < nPartSizes[0]; nIndex++)
+            pDecompressedData[nIndex] = rand() & 0xff;
+         memcpy(pDecompressedData + nPartSizes[0], pDecompressedData, nPartSizes[0]);
+         nResult = write_self_test_file(szInFilename, pDecompressedData, 2 * nPartSizes[0]);
+         if (!nResult && lz4ultra_compress_file_ctx(pCtx, szInFilename, szCompressedFilename, NULL, nFlags | LZ4ULTRA_FLAG_DEDUP,
+                                                    nBlockMaxCode, nCompressionLevel, NULL, NULL, &nOriginalSize, &nCompressedSize, &nCommandCount) != LZ4ULTRA_OK)
+            nResult = 100;
+      }
+      if (nResult) {
+         fprintf(stderr, "self-test: error compressing file with %s to append to, flags %x\n", pszCases[i], nFlags);
+         break;
+      }
+
+      if (lz4ultra_append_file_ctx(pCtx, szInFilename, szCompressedFilename, NULL, nFlags & LZ4ULTRA_FLAG_FAVOR_RATIO, nCompressionLevel, NULL, NULL,
+                                   &nOriginalSize, &nCompressedSize, &nCommandCount) != LZ4ULTRA_ERROR_APPEND) {
+         fprintf(stderr, "self-test: file with %s was appended to, flags %x\n", pszCases[i], nFlags);
+         nResult = 100;
+      }
+   }
+
+   remove(szOutFilename);
+   remove(szCompressedFilename);
+   remove(szInFilename);
+   free(pDecompressedData);
+   free(pData);
+   return nResult;
+}
+
+static int do_self_test(const unsigned int nOptions, int nBlockMaxCode, int nCompressionLevel, int nThreads) {
+   unsigned char *pGeneratedData;
+   unsigned char *pCompressedData;
+   unsigned char *pTmpCompressedData;
+   unsigned char *pTmpDecompressedData;
+   lz4ultra_ctx *pCtx;
+   size_t nGeneratedDataSize;
+   size_t nMaxCompressedDataSize;
+   unsigned int nSeed = 123;
+   int nFlags;
+   int i;
+
+   nFlags = 0;
+   if (nOptions & OPT_FAVOR_RATIO)
+      nFlags |= LZ4ULTRA_FLAG_FAVOR_RATIO;
+   if (nOptions & OPT_RAW)
+      nFlags |= LZ4ULTRA_FLAG_RAW_BLOCK;
+   if (nOptions & OPT_RAW_TABLE)
+      nFlags |= LZ4ULTRA_FLAG_RAW_TABLE;
+   if (nOptions & OPT_INDEP_BLOCKS)
+      nFlags |= LZ4ULTRA_FLAG_INDEP_BLOCKS;
+   if (nOptions & OPT_LEGACY_FRAMES)
+      nFlags |= LZ4ULTRA_FLAG_LEGACY_FRAMES;
+   if (nOptions & OPT_BLOCK_CHECKSUM)
+      nFlags |= LZ4ULTRA_FLAG_BLOCK_CHECKSUM;
+   if (nOptions & OPT_CONTENT_CHECKSUM)
+      nFlags |= LZ4ULTRA_FLAG_CONTENT_CHECKSUM;
+   if (nOptions & OPT_CONTENT_SIZE)
+      nFlags |= LZ4ULTRA_FLAG_CONTENT_SIZE;
+   if (nOptions & OPT_ADAPTIVE_BLOCKS)
+      nFlags |= LZ4ULTRA_FLAG_ADAPTIVE_BLOCKS;
+
+   pGeneratedData = (unsigned char*)malloc(4 * HISTORY_SIZE);
+   if (!pGeneratedData) {
+      fprintf(stderr, "out of memory, %d bytes needed\n", 4 * HISTORY_SIZE);
+      return 100;
+   }
+
+   nMaxCompressedDataSize = lz4ultra_get_max_compressed_size_inmem(4 * HISTORY_SIZE, nFlags, nBlockMaxCode);
+   pCompressedData = (unsigned char*)malloc(nMaxCompressedDataSize);
+   if (!pCompressedData) {
+      free(pGeneratedData);
+      pGeneratedData = NULL;
+
+      fprintf(stderr, "out of memory, %zu bytes needed\n", nMaxCompressedDataSize);
+      return 100;
+   }
+
+   pTmpCompressedData = (unsigned char*)malloc(nMaxCompressedDataSize);
+   if (!pTmpCompressedData) {
+      free(pCompressedData);
+      pCompressedData = NULL;
+      free(pGeneratedData);
+      pGeneratedData = NULL;
+
+      fprintf(stderr, "out of memory, %zu bytes needed\n", nMaxCompressedDataSize);
+      return 100;
+   }
+
+   pTmpDecompressedData = (unsigned char*)malloc(4 * HISTORY_SIZE);
+   if (!pTmpDecompressedData) {
+      free(pTmpCompressedData);
+      pTmpCompressedData = NULL;
+      free(pCompressedData);
+      pCompressedData = NULL;
+      free(pGeneratedData);
+      pGeneratedData = NULL;
+
+      fprintf(stderr, "out of memory, %d bytes needed\n", 4 * HISTORY_SIZE);
+      return 100;
+   }
+
+   pCtx = lz4ultra_ctx_create(1);
+   if (!pCtx) {
+      free(pTmpDecompressedData);
+      pTmpDecompressedData = NULL;
+      free(pTmpCompressedData);
+      pTmpCompressedData = NULL;
+      free(pCompressedData);
+      pCompressedData = NULL;
+      free(pGeneratedData);
+      pGeneratedData = NULL;
+
+      fprintf(stderr, "out of memory\n");
+      return 100;
+   }
+
+   memset(pGeneratedData, 0, 4 * HISTORY_SIZE);
+   memset(pCompressedData, 0, nMaxCompressedDataSize);
+   memset(pTmpCompressedData, 0, nMaxCompressedDataSize);
+
+   /* Test compressing with a too small buffer to do anything, expect to fail cleanly */
+   for (i = 0; i < 12; i++) {
+      generate_compressible_data(pGeneratedData, i, nSeed, 256, 0.5f, 0);
+      lz4ultra_compress_inmem_ctx(pCtx, pGeneratedData, pCompressedData, i, i, nFlags, nBlockMaxCode, nCompressionLevel);
+   }
+
+   /* Test slightly compressible data with the selected format, and with legacy frames. Adaptive blocks deliberately store chunks that save
+    * less than 1/32 of their size, and are left out. Then test deduplicated files, with and without a checksum of the decompressed data, when
+    * the selected format is a frame, and compression streams and batches, ranges of files with a seek table, and appending to files, that
+    * always use frames */
+   if (do_sparse_repeats_test(pCtx, nFlags & ~LZ4ULTRA_FLAG_ADAPTIVE_BLOCKS, nBlockMaxCode, nCompressionLevel, nThreads) ||
+       do_sparse_repeats_test(pCtx, LZ4ULTRA_FLAG_LEGACY_FRAMES | (nFlags & LZ4ULTRA_FLAG_FAVOR_RATIO), nBlockMaxCode, nCompressionLevel, nThreads) ||
+       (!(nFlags & (LZ4ULTRA_FLAG_RAW_BLOCK | LZ4ULTRA_FLAG_RAW_TABLE | LZ4ULTRA_FLAG_LEGACY_FRAMES)) &&
+        (do_dedup_file_test(pCtx, nFlags, nBlockMaxCode, nCompressionLevel, nThreads) ||
+         do_dedup_file_test(pCtx, nFlags | LZ4ULTRA_FLAG_CONTENT_CHECKSUM, nBlockMaxCode, nCompressionLevel, nThreads))) ||
+       do_cstream_test(pCtx, nFlags & (LZ4ULTRA_FLAG_FAVOR_RATIO | LZ4ULTRA_FLAG_BLOCK_CHECKSUM | LZ4ULTRA_FLAG_CONTENT_CHECKSUM | LZ4ULTRA_FLAG_ADAPTIVE_BLOCKS),
+          nCompressionLevel, nThreads) ||
+       do_batch_test(nFlags & ~(LZ4ULTRA_FLAG_RAW_BLOCK | LZ4ULTRA_FLAG_RAW_TABLE | LZ4ULTRA_FLAG_LEGACY_FRAMES), nBlockMaxCode, nCompressionLevel) ||
+       do_range_test(pCtx, nFlags & (LZ4ULTRA_FLAG_FAVOR_RATIO | LZ4ULTRA_FLAG_BLOCK_CHECKSUM | LZ4ULTRA_FLAG_CONTENT_CHECKSUM | LZ4ULTRA_FLAG_CONTENT_SIZE |
+          LZ4ULTRA_FLAG_ADAPTIVE_BLOCKS), nCompressionLevel) ||
+       do_append_test(pCtx, nFlags & (LZ4ULTRA_FLAG_FAVOR_RATIO | LZ4ULTRA_FLAG_INDEP_BLOCKS | LZ4ULTRA_FLAG_BLOCK_CHECKSUM | LZ4ULTRA_FLAG_ADAPTIVE_BLOCKS),
+          nCompressionLevel, nThreads)) {
+      lz4ultra_ctx_destroy(pCtx);
+      pCtx = NULL;
+      free(pTmpDecompressedData);
+      pTmpDecompressedData = NULL;
+      free(pTmpCompressedData);
+      pTmpCompressedData = NULL;
+      free(pCompressedData);
+      pCompressedData = NULL;
+      free(pGeneratedData);
+      pGeneratedData = NULL;
+      return 100;
+   }
+
+   size_t nDataSizeStep = 128;
+   float fProbabilitySizeStep = 0.0005f;
+
+   for (nGeneratedDataSize = 16384; nGeneratedDataSize <= (4 * HISTORY_SIZE); nGeneratedDataSize += nDataSizeStep) {
+      float fMatchProbability;
+
+      fprintf(stdout, "size %zu", nGeneratedDataSize);
+      for (fMatchProbability = (nOptions & (OPT_RAW|OPT_LEGACY_FRAMES)) ? 0.1f : 0; fMatchProbability <= 0.995f; fMatchProbability += fProbabilitySizeStep) {
+         int nNumLiteralValues[12] = { 1, 2, 3, 15, 30, 56, 96, 137, 178, 191, 255, 256 };
+         float fXorProbability;
+
+         fputc('.', stdout);
+         fflush(stdout);
+
+         for (i = 0; i < 12; i++) {
+            /* Generate data to compress */
+            generate_compressible_data(pGeneratedData, nGeneratedDataSize, nSeed, nNumLiteralValues[i], fMatchProbability, 0);
+
+            /* Try to compress it, expected to succeed */
+            size_t nActualCompressedSize = lz4ultra_compress_inmem_ctx(pCtx, pGeneratedData, pCompressedData, nGeneratedDataSize, lz4ultra_get_max_compressed_size_inmem(nGeneratedDataSize, nFlags, nBlockMaxCode), 
+               nFlags, nBlockMaxCode, nCompressionLevel);
+            if (nActualCompressedSize == (size_t)-1 || nActualCompressedSize < (LZ4ULTRA_HEADER_SIZE + LZ4ULTRA_FRAME_SIZE + LZ4ULTRA_FRAME_SIZE /* footer */)) {
+               lz4ultra_ctx_destroy(pCtx);
+               pCtx = NULL;
+               free(pTmpDecompressedData);
+               pTmpDecompressedData = NULL;
+               free(pTmpCompressedData);
+               pTmpCompressedData = NULL;
+               free(pCompressedData);
+               pCompressedData = NULL;
+               free(pGeneratedData);
+               pGeneratedData = NULL;
+
+               fprintf(stderr, "\nself-test: error compressing size %zu, seed %u, match probability %f, literals range %d\n", nGeneratedDataSize, nSeed, fMatchProbability, nNumLiteralValues[i]);
+               return 100;
+            }
+
+            /* Try to decompress it, expected to succeed */
+            size_t nActualDecompressedSize;
+            nActualDecompressedSize = lz4ultra_decompress_inmem(pCompressedData, pTmpDecompressedData, nActualCompressedSize, nGeneratedDataSize, nFlags, nThreads);
+            if (nActualDecompressedSize == (size_t)-1) {
+               lz4ultra_ctx_destroy(pCtx);
+               pCtx = NULL;
+               free(pTmpDecompressedData);
+               pTmpDecompressedData = NULL;
+               free(pTmpCompressedData);
+               pTmpCompressedData = NULL;
+               free(pCompressedData);
+               pCompressedData = NULL;
+               free(pGeneratedData);
+               pGeneratedData = NULL;
+
+               fprintf(stderr, "\nself-test: error decompressing size %zu, seed %u, match probability %f, literals range %d\n", nGeneratedDataSize, nSeed, fMatchProbability, nNumLiteralValues[i]);
+               return 100;
+            }
+
+            if (memcmp(pGeneratedData, pTmpDecompressedData, nGeneratedDataSize)) {
+               lz4ultra_ctx_destroy(pCtx);
+               pCtx = NULL;
+               free(pTmpDecompressedData);
+               pTmpDecompressedData = NULL;
+               free(pTmpCompressedData);
+               pTmpCompressedData = NULL;
+               free(pCompressedData);
+               pCompressedData = NULL;
+               free(pGeneratedData);
+               pGeneratedData = NULL;
+
+               fprintf(stderr, "\nself-test: error comparing decompressed and original data, size %zu, seed %u, match probability %f, literals range %d\n", nGeneratedDataSize, nSeed, fMatchProbability, nNumLiteralValues[i]);
+               return 100;
+            }
+
+            /* Try to decompress corrupted data, expected to fail cleanly, without crashing or corrupting memory outside the output buffer */
+            for (fXorProbability = 0.05f; fXorProbability <= 0.5f; fXorProbability += 0.05f) {
+               memcpy(pTmpCompressedData, pCompressedData, nActualCompressedSize);
+               xor_data(pTmpCompressedData + LZ4ULTRA_HEADER_SIZE + LZ4ULTRA_FRAME_SIZE, nActualCompressedSize - LZ4ULTRA_HEADER_SIZE - LZ4ULTRA_FRAME_SIZE - LZ4ULTRA_FRAME_SIZE /* footer */, nSeed, fXorProbability);
+               lz4ultra_decompress_inmem(pTmpCompressedData, pGeneratedData, nActualCompressedSize, nGeneratedDataSize, nFlags, nThreads);
+            }
+         }
+
+         nSeed++;
+      }
+
+      fputc(10, stdout);
+      fflush(stdout);
+
+      nDataSizeStep <<= 1;
+      if (nDataSizeStep > (128 * 4096))
+         nDataSizeStep = 128 * 4096;
+      fProbabilitySizeStep *= 1.25;
+      if (fProbabilitySizeStep > (0.0005f * 4096))
+         fProbabilitySizeStep = 0.0005f * 4096;
+   }
+
+   lz4ultra_ctx_destroy(pCtx);
+   pCtx = NULL;
+
+   free(pTmpDecompressedData);
+   pTmpDecompressedData = NULL;
+
+   free(pTmpCompressedData);
+   pTmpCompressedData = NULL;
+
+   free(pCompressedData);
+   pCompressedData = NULL;
+
+   free(pGeneratedData);
+   pGeneratedData = NULL;
+
+   fprintf(stdout, "All tests passed.\n");
+   return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static int do_compr_benchmark(const char *pszInFilename, const char *pszOutFilename, const char *pszDictionaryFilename, const unsigned int nOptions, int nBlockMaxCode, int nCompressionLevel,
+                              int nDecodeCost, int nMatchCandidates) {
+   size_t nFileSize, nMaxCompressedSize;
+   unsigned char *pFileData;
+   unsigned char *pCompressedData;
+   lz4ultra_ctx *pCtx;
+   lz4ultra_stats stats;
+   int nFlags;
+   int i;
+
+   nFlags = 0;
+   if (nOptions & OPT_FAVOR_RATIO)
+      nFlags |= LZ4ULTRA_FLAG_FAVOR_RATIO;
+   if (nOptions & OPT_RAW)
+      nFlags |= LZ4ULTRA_FLAG_RAW_BLOCK;
+   if (nOptions & OPT_RAW_TABLE)
+      nFlags |= LZ4ULTRA_FLAG_RAW_TABLE;
+   if (nOptions & OPT_INDEP_BLOCKS)
+      nFlags |= LZ4ULTRA_FLAG_INDEP_BLOCKS;
+   if (nOptions & OPT_LEGACY_FRAMES)
+      nFlags |= LZ4ULTRA_FLAG_LEGACY_FRAMES;
+   if (nOptions & OPT_BLOCK_CHECKSUM)
+      nFlags |= LZ4ULTRA_FLAG_BLOCK_CHECKSUM;
+   if (nOptions & OPT_CONTENT_CHECKSUM)
+      nFlags |= LZ4ULTRA_FLAG_CONTENT_CHECKSUM;
+   if (nOptions & OPT_CONTENT_SIZE)
+      nFlags |= LZ4ULTRA_FLAG_CONTENT_SIZE;
+   if (nOptions & OPT_ADAPTIVE_BLOCKS)
+      nFlags |= LZ4ULTRA_FLAG_ADAPTIVE_BLOCKS;
+   if (nOptions & OPT_STATS)
+      nFlags |= LZ4ULTRA_FLAG_STATS;
+
+   if (pszDictionaryFilename) {
+      fprintf(stderr, "in-memory benchmarking does not support dictionaries\n");
+      return 100;
+   }
+
+   /* Read the whole original file in memory */
+
+   FILE *f_in = fopen(pszInFilename, "rb");
+   if (!f_in) {
+      fprintf(stderr, "error opening '%s' for reading\n", pszInFilename);
+      return 100;
+   }
+
+   fseek(f_in, 0, SEEK_END);
+   nFileSize = (size_t)ftell(f_in);
+   fseek(f_in, 0, SEEK_SET);
+
+   pFileData = (unsigned char*)malloc(nFileSize);
+   if (!pFileData) {
+      fclose(f_in);
+      fprintf(stderr, "out of memory for reading '%s', %zu bytes needed\n", pszInFilename, nFileSize);
+      return 100;
+   }
+
+   if (fread(pFileData, 1, nFileSize, f_in) != nFileSize) {
+      free(pFileData);
+      fclose(f_in);
+      fprintf(stderr, "I/O error while reading '%s'\n", pszInFilename);
+      return 100;
+   }
+
+   fclose(f_in);
+
+   /* Allocate max compressed size */
+
+   nMaxCompressedSize = lz4ultra_get_max_compressed_size_inmem(nFileSize, nFlags, nBlockMaxCode);
+
+   pCompressedData = (unsigned char*)malloc(nMaxCompressedSize + 2048);
+   if (!pCompressedData) {
+      free(pFileData);
+      fprintf(stderr, "out of memory for compressing '%s', %zu bytes needed\n", pszInFilename, nMaxCompressedSize);
+      return 100;
+   }
+
+   memset(pCompressedData + 1024, 0, nMaxCompressedSize);
+
+   /* Reuse the same compression context for all runs, so that only the first one pays for allocating it */
+   pCtx = lz4ultra_ctx_create(1);
+   if (!pCtx) {
+      free(pCompressedData);
+      free(pFileData);
+      fprintf(stderr, "out of memory for compressing '%s'\n", pszInFilename);
+      return 100;
+   }
+   do_set_huge_pages(pCtx, nOptions);
+   lz4ultra_ctx_set_decode_cost(pCtx, nDecodeCost);
+   lz4ultra_ctx_set_match_candidates(pCtx, nMatchCandidates);
+
+   long long nBestCompTime = -1;
+
+   size_t nActualCompressedSize = 0;
+   size_t nRightGuardPos = nMaxCompressedSize;
+
+   for (i = 0; i < 5; i++) {
+      unsigned char nGuard = 0x33 + i;
+      int j;
+
+      /* Write guard bytes around the output buffer, to help check for writes outside of it by the compressor */
+      memset(pCompressedData, nGuard, 1024);
+      memset(pCompressedData + 1024 + nRightGuardPos, nGuard, 1024);
+
+      long long t0 = do_get_time();
+      nActualCompressedSize = lz4ultra_compress_inmem_ctx(pCtx, pFileData, pCompressedData + 1024, nFileSize, nRightGuardPos, nFlags, nBlockMaxCode, nCompressionLevel);
+      long long t1 = do_get_time();
+      if (nActualCompressedSize == (size_t)-1) {
+         lz4ultra_ctx_destroy(pCtx);
+         free(pCompressedData);
+         free(pFileData);
+         fprintf(stderr, "compression error\n");
+         return 100;
+      }
+
+      long long nCurDecTime = t1 - t0;
+      if (nBestCompTime == (size_t)-1 || nBestCompTime > nCurDecTime)
+         nBestCompTime = nCurDecTime;
+
+      /* Check guard bytes before the output buffer */
+      for (j = 0; j < 1024; j++) {
+         if (pCompressedData[j] != nGuard) {
+            lz4ultra_ctx_destroy(pCtx);
+            free(pCompressedData);
+            free(pFileData);
+            fprintf(stderr, "error, wrote outside of output buffer at %d!\n", j - 1024);
+            return 100;
+         }
+      }
+
+      /* Check guard bytes after the output buffer */
+      for (j = 0; j < 1024; j++) {
+         if (pCompressedData[1024 + nRightGuardPos + j] != nGuard) {
+            lz4ultra_ctx_destroy(pCtx);
+            free(pCompressedData);
+            free(pFileData);
+            fprintf(stderr, "error, wrote outside of output buffer at %d!\n", j);
+            return 100;
+         }
+      }
+
+      nRightGuardPos = nActualCompressedSize;
+   }
+
+   /* Each run resets the context, the statistics are the last run's */
+   size_t nMemorySize = lz4ultra_ctx_get_memory_size(pCtx);
+   lz4ultra_ctx_get_stats(pCtx, &stats);
+   lz4ultra_ctx_destroy(pCtx);
+   pCtx = NULL;
+
+   if (pszOutFilename) {
+      FILE *f_out;
+
+      /* Write whole compressed file out */
+
+      f_out = fopen(pszOutFilename, "wb");
+      if (f_out) {
+         fwrite(pCompressedData + 1024, 1, nActualCompressedSize, f_out);
+         fclose(f_out);
+      }
+   }
+
+   free(pCompressedData);
+   free(pFileData);
+
+   fprintf(stdout, "compressed size: %zu bytes\n", nActualCompressedSize);
+   fprintf(stdout, "compression memory: %zu bytes\n", nMemorySize);
+   fprintf(stdout, "compression time: %lld microseconds (%g Mb/s)\n", nBestCompTime, ((double)nFileSize / 1024.0) / ((double)nBestCompTime / 1000.0));
+   if (nOptions & OPT_STATS)
+      print_compression_stats(&stats);
+
+   return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static int do_dec_benchmark(const char *pszInFilename, const char *pszOutFilename, const char *pszDictionaryFilename, const unsigned int nOptions, int nThreads) {
+   size_t nFileSize, nMaxDecompressedSize;
+   unsigned char *pFileData;
+   unsigned char *pDecompressedData;
+   int nFlags;
+   int i;
+
+   nFlags = 0;
+   if (nOptions & OPT_RAW)
+      nFlags |= LZ4ULTRA_FLAG_RAW_BLOCK;
+   if (nOptions & OPT_RAW_TABLE)
+      nFlags |= LZ4ULTRA_FLAG_RAW_TABLE;
+
+   if (pszDictionaryFilename) {
+      fprintf(stderr, "in-memory benchmarking does not support dictionaries\n");
+      return 100;
+   }
+   
+   /* Read the whole compressed file in memory */
+
+   FILE *f_in = fopen(pszInFilename, "rb");
+   if (!f_in) {
+      fprintf(stderr, "error opening '%s' for reading\n", pszInFilename);
+      return 100;
+   }
+
+   fseek(f_in, 0, SEEK_END);
+   nFileSize = (size_t)ftell(f_in);
+   fseek(f_in, 0, SEEK_SET);
+
+   pFileData = (unsigned char*)malloc(nFileSize);
+   if (!pFileData) {
+      fclose(f_in);
+      fprintf(stderr, "out of memory for reading '%s', %zu bytes needed\n", pszInFilename, nFileSize);
+      return 100;
+   }
+
+   if (fread(pFileData, 1, nFileSize, f_in) != nFileSize) {
+      free(pFileData);
+      fclose(f_in);
+      fprintf(stderr, "I/O error while reading '%s'\n", pszInFilename);
+      return 100;
+   }
+
+   fclose(f_in);
+
+   /* Allocate max decompressed size */
+
+   if (nOptions & OPT_RAW)
+      nMaxDecompressedSize = 0x400000;
+   else if (nOptions & OPT_RAW_TABLE) {
+      if (lz4ultra_decompressor_get_raw_table_info(pFileData, nFileSize, &nMaxDecompressedSize) < 0)
+         nMaxDecompressedSize = (size_t)-1;
+   }
+   else
+      nMaxDecompressedSize = lz4ultra_inmem_get_max_decompressed_size(pFileData, nFileSize);
+   if (nMaxDecompressedSize == (size_t)-1) {
+      free(pFileData);
+      fprintf(stderr, "invalid compressed format for file '%s'\n", pszInFilename);
+      return 100;
+   }
+
+   pDecompressedData = (unsigned char*)malloc(nMaxDecompressedSize);
+   if (!pDecompressedData) {
+      free(pFileData);
+      fprintf(stderr, "out of memory for decompressing '%s', %zu bytes needed\n", pszInFilename, nMaxDecompressedSize);
+      return 100;
+   }
+
+   memset(pDecompressedData, 0, nMaxDecompressedSize);
+
+   long long nBestDecTime = -1;
+
+   size_t nActualDecompressedSize = 0;
+   for (i = 0; i < 50; i++) {
+      long long t0 = do_get_time();
+      nActualDecompressedSize = lz4ultra_decompress_inmem(pFileData, pDecompressedData, nFileSize, nMaxDecompressedSize, nFlags, nThreads);
+      long long t1 = do_get_time();
+      if (nActualDecompressedSize == (size_t)-1) {
+         free(pDecompressedData);
+         free(pFileData);
+         fprintf(stderr, "decompression error\n");
+         return 100;
+      }
+
+      long long nCurDecTime = t1 - t0;
+      if (nBestDecTime == (size_t)-1 || nBestDecTime > nCurDecTime)
+         nBestDecTime = nCurDecTime;
+   }
+
+   if (pszOutFilename) {
+      FILE *f_out;
+
+      /* Write whole decompressed file out */
+
+      f_out = fopen(pszOutFilename, "wb");
+      if (f_out) {
+         fwrite(pDecompressedData, 1, nActualDecompressedSize, f_out);
+         fclose(f_out);
+      }
+   }
+
+   free(pDecompressedData);
+   free(pFileData);
+
+   fprintf(stdout, "decompressed size: %zu bytes\n", nActualDecompressedSize);
+   fprintf(stdout, "decompression time: %lld microseconds (%g Mb/s)\n", nBestDecTime, ((double)nActualDecompressedSize / 1024.0) / ((double)nBestDecTime / 1000.0));
+
+   return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static int compare_filenames(const void *a, const void *b) {
+   return strcmp(*(const char * const *)a, *(const char * const *)b);
+}
+
+static int compare_times(const void *a, const void *b) {
+   const long long nTimeA = *(const long long *)a;
+   const long long nTimeB = *(const long long *)b;
+
+   return (nTimeA > nTimeB) - (nTimeA < nTimeB);
+}
+
+static int add_corpus_file(char ***pppszFilenames, int *pNumFiles, const char *pszDirectory, const char *pszName) {
+   size_t nDirectoryLen = pszDirectory ? strlen(pszDirectory) : 0;
+   char **ppszFilenames;
+   char *pszFilename;
+
+   ppszFilenames = (char **)realloc(*pppszFilenames, (*pNumFiles + 1) * sizeof(char *));
+   if (!ppszFilenames)
+      return -1;
+   *pppszFilenames = ppszFilenames;
+
+   pszFilename = (char *)malloc(nDirectoryLen + 1 + strlen(pszName) + 1);
+   if (!pszFilename)
+      return -1;
+
+   if (nDirectoryLen && pszDirectory[nDirectoryLen - 1] != '/' && pszDirectory[nDirectoryLen - 1] != '\\')
+      sprintf(pszFilename, "%s/%s", pszDirectory, pszName);
+   else
+      sprintf(pszFilename, "%s%s", pszDirectory ? pszDirectory : "", pszName);
+
+   ppszFilenames[(*pNumFiles)++] = pszFilename;
+   return 0;
+}
+
+static void free_corpus(char **ppszFilenames, int nNumFiles) {
+   int i;
+
+   for (i = 0; i < nNumFiles; i++)
+      free(ppszFilenames[i]);
+   free(ppszFilenames);
+}
+
+static char **list_corpus(const char *pszCorpusPath, int *pNumFiles) {
+   char **ppszFilenames = NULL;
+   int nResult = 0;
+
+   *pNumFiles = 0;
+
+   /* List the regular files in the corpus directory, sorted by name so that reports can be compared; a file is a corpus of its own */
+#ifdef _WIN32
+   DWORD nAttributes = GetFileAttributesA(pszCorpusPath);
+
+   if (nAttributes != INVALID_FILE_ATTRIBUTES && (nAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+      WIN32_FIND_DATAA findData;
+      char *pszPattern = (char *)malloc(strlen(pszCorpusPath) + 3);
+      HANDLE hFind = INVALID_HANDLE_VALUE;
+
+      if (pszPattern) {
+         sprintf(pszPattern, "%s\\*", pszCorpusPath);
+         hFind = FindFirstFileA(pszPattern, &findData);
+         free(pszPattern);
+      }
+      if (hFind == INVALID_HANDLE_VALUE) {
+         free_corpus(ppszFilenames, *pNumFiles);
+         return NULL;
+      }
+
+      do {
+         if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+            nResult = add_corpus_file(&ppszFilenames, pNumFiles, pszCorpusPath, findData.cFileName);
+      } while (!nResult && FindNextFileA(hFind, &findData));
+      FindClose(hFind);
+   }
+   else {
+      nResult = add_corpus_file(&ppszFilenames, pNumFiles, NULL, pszCorpusPath);
+   }
+#else
+   DIR *pDir = opendir(pszCorpusPath);
+
+   if (pDir) {
+      struct dirent *pEntry;
+
+      while (!nResult && (pEntry = readdir(pDir)) != NULL) {
+         struct stat fileStat;
+
+         nResult = add_corpus_file(&ppszFilenames, pNumFiles, pszCorpusPath, pEntry->d_name);
+         if (!nResult && (stat(ppszFilenames[*pNumFiles - 1], &fileStat) || !S_ISREG(fileStat.st_mode))) {
+            /* Skip subdirectories and special files */
+            free(ppszFilenames[--(*pNumFiles)]);
+         }
+      }
+      closedir(pDir);
+   }
+   else {
+      nResult = add_corpus_file(&ppszFilenames, pNumFiles, NULL, pszCorpusPath);
+   }
+#endif
+
+   if (nResult) {
+      free_corpus(ppszFilenames, *pNumFiles);
+      return NULL;
+   }
+
+   qsort(ppszFilenames, *pNumFiles, sizeof(char *), compare_filenames);
+   return ppszFilenames;
+}
+
+static long long get_percentile_time(const long long *pSortedTimes, int nRuns, int nPercentile) {
+   return pSortedTimes[((nRuns - 1) * nPercentile + 50) / 100];
+}
+
+static double get_throughput(size_t nSize, long long nTime) {
+   return nTime ? (((double)nSize / 1024.0) / ((double)nTime / 1000.0)) : 0.0;
+}
+
+static void write_json_string(FILE *f_out, const char *pszString) {
+   fputc('"', f_out);
+   for (; *pszString; pszString++) {
+      if (*pszString == '"' || *pszString == '\\')
+         fprintf(f_out, "\\%c", *pszString);
+      else if ((unsigned char)*pszString < 0x20)
+         fprintf(f_out, "\\u%04x", (unsigned char)*pszString);
+      else
+         fputc(*pszString, f_out);
+   }
+   fputc('"', f_out);
+}
+
+static void write_csv_string(FILE *f_out, const char *pszString) {
+   fputc('"', f_out);
+   for (; *pszString; pszString++) {
+      if (*pszString == '"')
+         fputc('"', f_out);
+      fputc(*pszString, f_out);
+   }
+   fputc('"', f_out);
+}
+
+static int do_bench_suite(const char *pszCorpusPath, const char *pszReportFilename, const char *pszDictionaryFilename, const unsigned int nOptions, int nCompressionLevel,
+                          int nThreads, bool bJsonReport) {
+   long long nCompressTimes[BENCH_COMPRESS_RUNS];
+   long long nDecompressTimes[BENCH_DECOMPRESS_RUNS];
+   char **ppszFilenames;
+   int nNumFiles = 0;
+   int nNumResults = 0;
+   lz4ultra_ctx *pCtx[2];
+   FILE *f_out;
+   int nNumPageModes;
+   int nHugePagesAvailable = 0;
+   int nBaseFlags;
+   int nResult = 0;
+   int i;
+
+   nBaseFlags = 0;
+   if (nOptions & OPT_BLOCK_CHECKSUM)
+      nBaseFlags |= LZ4ULTRA_FLAG_BLOCK_CHECKSUM;
+   if (nOptions & OPT_CONTENT_CHECKSUM)
+      nBaseFlags |= LZ4ULTRA_FLAG_CONTENT_CHECKSUM;
+   if (nOptions & OPT_CONTENT_SIZE)
+      nBaseFlags |= LZ4ULTRA_FLAG_CONTENT_SIZE;
+
+   if (pszDictionaryFilename) {
+      fprintf(stderr, "in-memory benchmarking does not support dictionaries\n");
+      return 100;
+   }
+
+   if (nOptions & (OPT_RAW | OPT_LEGACY_FRAMES)) {
+      fprintf(stderr, "the benchmark suite only supports the LZ4 frame format\n");
+      return 100;
+   }
+
+   ppszFilenames = list_corpus(pszCorpusPath, &nNumFiles);
+   if (!ppszFilenames || !nNumFiles) {
+      if (ppszFilenames)
+         free_corpus(ppszFilenames, nNumFiles);
+      fprintf(stderr, "no files to benchmark in '%s'\n", pszCorpusPath);
+      return 100;
+   }
+
+   if (pszReportFilename) {
+      f_out = fopen(pszReportFilename, "w");
+      if (!f_out) {
+         free_corpus(ppszFilenames, nNumFiles);
+         fprintf(stderr, "error opening '%s' for writing\n", pszReportFilename);
+         return 100;
+      }
+   }
+   else {
+      f_out = stdout;
+   }
+
+   /* Reuse the same compression contexts for all runs, so that only the first one pays for allocating them. With huge pages, every configuration is
+    * run with regular pages and then with huge pages, to compare both */
+   nNumPageModes = (nOptions & OPT_HUGE_PAGES) ? 2 : 1;
+   pCtx[0] = lz4ultra_ctx_create(1);
+   pCtx[1] = (nNumPageModes > 1) ? lz4ultra_ctx_create(1) : NULL;
+   if (!pCtx[0] || (nNumPageModes > 1 && !pCtx[1])) {
+      if (pCtx[1])
+         lz4ultra_ctx_destroy(pCtx[1]);
+      if (pCtx[0])
+         lz4ultra_ctx_destroy(pCtx[0]);
+      if (f_out != stdout)
+         fclose(f_out);
+      free_corpus(ppszFilenames, nNumFiles);
+      fprintf(stderr, "out of memory for benchmarking\n");
+      return 100;
+   }
+   if (nNumPageModes > 1)
+      nHugePagesAvailable = do_set_huge_pages(pCtx[1], nOptions);
+
+   if (bJsonReport)
+      fprintf(f_out, "{\n  \"version\": \"" TOOL_VERSION "\",\n  \"level\": %d,\n  \"threads\": %d,\n  \"huge_pages_available\": %s,\n  \"results\": [", nCompressionLevel, nThreads,
+         nHugePagesAvailable ? "true" : "false");
+   else
+      fprintf(f_out, "file,block_code,independent_blocks,favor_ratio,huge_pages,original_size,compressed_size,"
+         "compress_min_us,compress_median_us,compress_p90_us,compress_mb_s,decompress_min_us,decompress_median_us,decompress_p90_us,decompress_mb_s\n");
+
+   for (i = 0; i < nNumFiles && !nResult; i++) {
+      const char *pszFilename = ppszFilenames[i];
+      unsigned char *pFileData = NULL;
+      unsigned char *pCompressedData = NULL;
+      unsigned char *pDecompressedData = NULL;
+      size_t nFileSize;
+      int nConfig;
+
+      /* Read the whole original file in memory */
+
+      FILE *f_in = fopen(pszFilename, "rb");
+      if (!f_in) {
+         fprintf(stderr, "error opening '%s' for reading\n", pszFilename);
+         nResult = 100;
+         break;
+      }
+
+      fseek(f_in, 0, SEEK_END);
+      nFileSize = (size_t)ftell(f_in);
+      fseek(f_in, 0, SEEK_SET);
+
+      pFileData = (unsigned char*)malloc(nFileSize ? nFileSize : 1);
+      pDecompressedData = (unsigned char*)malloc(nFileSize ? nFileSize : 1);
+      pCompressedData = (unsigned char*)malloc(lz4ultra_get_max_compressed_size_inmem(nFileSize, nBaseFlags, 4));
+      if (!pFileData || !pDecompressedData || !pCompressedData) {
+         fprintf(stderr, "out of memory for benchmarking '%s'\n", pszFilename);
+         nResult = 100;
+      }
+      else if (fread(pFileData, 1, nFileSize, f_in) != nFileSize) {
+         fprintf(stderr, "I/O error while reading '%s'\n", pszFilename);
+         nResult = 100;
+      }
+
+      fclose(f_in);
+
+      /* Run every block size, with dependent and independent blocks, favoring ratio and decompression speed, and with each kind of pages */
+      for (nConfig = 0; nConfig < 16 * nNumPageModes && !nResult; nConfig++) {
+         const int nPageMode = nConfig % nNumPageModes;
+         const int nSetting = nConfig / nNumPageModes;
+         const int nBlockMaxCode = 4 + (nSetting >> 2);
+         const int nFlags = nBaseFlags | ((nSetting & 2) ? LZ4ULTRA_FLAG_INDEP_BLOCKS : 0) | ((nSetting & 1) ? 0 : LZ4ULTRA_FLAG_FAVOR_RATIO);
+         const size_t nMaxCompressedSize = lz4ultra_get_max_compressed_size_inmem(nFileSize, nFlags, nBlockMaxCode);
+         size_t nCompressedSize = 0;
+         size_t nDecompressedSize = 0;
+         int j;
+
+         if (nOptions & OPT_VERBOSE) {
+            fprintf(stderr, "%s: -B%d%s%s%s\n", pszFilename, nBlockMaxCode, (nFlags & LZ4ULTRA_FLAG_INDEP_BLOCKS) ? " -BI" : "", (nFlags & LZ4ULTRA_FLAG_FAVOR_RATIO) ? "" : " --favor-decSpeed",
+               nPageMode ? " --huge-pages" : "");
+         }
+
+         for (j = 0; j < BENCH_COMPRESS_RUNS; j++) {
+            long long t0 = do_get_time();
+            nCompressedSize = lz4ultra_compress_inmem_ctx(pCtx[nPageMode], pFileData, pCompressedData, nFileSize, nMaxCompressedSize, nFlags, nBlockMaxCode, nCompressionLevel);
+            long long t1 = do_get_time();
+            if (nCompressedSize == (size_t)-1) {
+               fprintf(stderr, "compression error for '%s'\n", pszFilename);
+               nResult = 100;
+               break;
+            }
+            nCompressTimes[j] = t1 - t0;
+         }
+
+         for (j = 0; j < BENCH_DECOMPRESS_RUNS && !nResult; j++) {
+            long long t0 = do_get_time();
+            nDecompressedSize = lz4ultra_decompress_inmem(pCompressedData, pDecompressedData, nCompressedSize, nFileSize, 0, nThreads);
+            long long t1 = do_get_time();
+            if (nDecompressedSize != nFileSize || memcmp(pDecompressedData, pFileData, nFileSize)) {
+               fprintf(stderr, "decompression error for '%s'\n", pszFilename);
+               nResult = 100;
+               break;
+            }
+            nDecompressTimes[j] = t1 - t0;
+         }
+
+         if (nResult)
+            break;
+
+         qsort(nCompressTimes, BENCH_COMPRESS_RUNS, sizeof(long long), compare_times);
+         qsort(nDecompressTimes, BENCH_DECOMPRESS_RUNS, sizeof(long long), compare_times);
+
+         const long long nCompressMedianTime = get_percentile_time(nCompressTimes, BENCH_COMPRESS_RUNS, 50);
+         const long long nDecompressMedianTime = get_percentile_time(nDecompressTimes, BENCH_DECOMPRESS_RUNS, 50);
+
+         if (bJsonReport) {
+            fprintf(f_out, "%s\n    { \"file\": ", nNumResults ? "," : "");
+            write_json_string(f_out, pszFilename);
+            fprintf(f_out, ", \"block_code\": %d, \"independent_blocks\": %s, \"favor_ratio\": %s, \"huge_pages\": %s, \"original_size\": %zu, \"compressed_size\": %zu,\n",
+               nBlockMaxCode, (nFlags & LZ4ULTRA_FLAG_INDEP_BLOCKS) ? "true" : "false", (nFlags & LZ4ULTRA_FLAG_FAVOR_RATIO) ? "true" : "false",
+               (nPageMode && nHugePagesAvailable) ? "true" : "false", nFileSize, nCompressedSize);
+            fprintf(f_out, "      \"compress\": { \"min_us\": %lld, \"median_us\": %lld, \"p90_us\": %lld, \"mb_s\": %g },\n",
+               nCompressTimes[0], nCompressMedianTime, get_percentile_time(nCompressTimes, BENCH_COMPRESS_RUNS, 90), get_throughput(nFileSize, nCompressMedianTime));
+            fprintf(f_out, "      \"decompress\": { \"min_us\": %lld, \"median_us\": %lld, \"p90_us\": %lld, \"mb_s\": %g } }",
+               nDecompressTimes[0], nDecompressMedianTime, get_percentile_time(nDecompressTimes, BENCH_DECOMPRESS_RUNS, 90), get_throughput(nFileSize, nDecompressMedianTime));
+         }
+         else {
+            write_csv_string(f_out, pszFilename);
+            fprintf(f_out, ",%d,%d,%d,%d,%zu,%zu,%lld,%lld,%lld,%g,%lld,%lld,%lld,%g\n", nBlockMaxCode, (nFlags & LZ4ULTRA_FLAG_INDEP_BLOCKS) ? 1 : 0,
+               (nFlags & LZ4ULTRA_FLAG_FAVOR_RATIO) ? 1 : 0, (nPageMode && nHugePagesAvailable) ? 1 : 0, nFileSize, nCompressedSize,
+               nCompressTimes[0], nCompressMedianTime, get_percentile_time(nCompressTimes, BENCH_COMPRESS_RUNS, 90), get_throughput(nFileSize, nCompressMedianTime),
+               nDecompressTimes[0], nDecompressMedianTime, get_percentile_time(nDecompressTimes, BENCH_DECOMPRESS_RUNS, 90), get_throughput(nFileSize, nDecompressMedianTime));
+         }
+         fflush(f_out);
+         nNumResults++;
+      }
+
+      if (pCompressedData)
+         free(pCompressedData);
+      if (pDecompressedData)
+         free(pDecompressedData);
+      if (pFileData)
+         free(pFileData);
+   }
+
+   if (bJsonReport)
+      fprintf(f_out, "\n  ]\n}\n");
+
+   if (pCtx[1])
+      lz4ultra_ctx_destroy(pCtx[1]);
+   lz4ultra_ctx_destroy(pCtx[0]);
+   if (f_out != stdout)
+      fclose(f_out);
+   free_corpus(ppszFilenames, nNumFiles);
+
+   return nResult;
+}
+
+/*---------------------------------------------------------------------------*/
+
+typedef struct {
+   char **ppszFilenames;
+   int nNumFiles;
+   lz4ultra_ctx **ppCtx;
+   const char *pszDictionaryFilename;
+   unsigned int nOptions;
+   int nFlags;
+   int nBlockMaxCode;
+   int nCompressionLevel;
+   char cCommand;
+   long long *pOriginalSizes;
+   long long *pCompressedSizes;
+   int *pResults;
+} batch_t;
+
+static bool is_compressed_filename(const char *pszFilename) {
+   const size_t nLen = strlen(pszFilename);
+
+   return nLen > 4 && !strcmp(pszFilename + nLen - 4, ".lz4");
+}
+
+static int add_batch_path(char ***pppszFilenames, int *pNumFiles, const char *pszPath, const char cCommand, const bool bFromDirectory) {
+   /* Walk directories recursively. Files found inside are the ones that the command applies to: not yet compressed ones when compressing, and
+    * compressed ones when decompressing. Files that are named explicitly are always kept, so that errors are reported for them */
+#ifdef _WIN32
+   DWORD nAttributes = GetFileAttributesA(pszPath);
+
+   if (nAttributes != INVALID_FILE_ATTRIBUTES && (nAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+      WIN32_FIND_DATAA findData;
+      char *pszPattern = (char *)malloc(strlen(pszPath) + 3);
+      HANDLE hFind = INVALID_HANDLE_VALUE;
+      int nResult = 0;
+
+      if (pszPattern) {
+         sprintf(pszPattern, "%s\\*", pszPath);
+         hFind = FindFirstFileA(pszPattern, &findData);
+         free(pszPattern);
+      }
+      if (hFind == INVALID_HANDLE_VALUE)
+         return -1;
+
+      do {
+         if (strcmp(findData.cFileName, ".") && strcmp(findData.cFileName, "..")) {
+            char *pszChildPath = (char *)malloc(strlen(pszPath) + 1 + strlen(findData.cFileName) + 1);
+
+            if (!pszChildPath)
+               nResult = -1;
+            else {
+               sprintf(pszChildPath, "%s\\%s", pszPath, findData.cFileName);
+               nResult = add_batch_path(pppszFilenames, pNumFiles, pszChildPath, cCommand, true);
+               free(pszChildPath);
+            }
+         }
+      } while (!nResult && FindNextFileA(hFind, &findData));
+      FindClose(hFind);
+      return nResult;
+   }
+#else
+   struct stat fileStat;
+
+   if (!stat(pszPath, &fileStat) && S_ISDIR(fileStat.st_mode)) {
+      DIR *pDir = opendir(pszPath);
+      struct dirent *pEntry;
+      int nResult = 0;
+
+      if (!pDir)
+         return -1;
+
+      while (!nResult && (pEntry = readdir(pDir)) != NULL) {
+         if (strcmp(pEntry->d_name, ".") && strcmp(pEntry->d_name, "..")) {
+            char *pszChildPath = (char *)malloc(strlen(pszPath) + 1 + strlen(pEntry->d_name) + 1);
+
+            if (!pszChildPath)
+               nResult = -1;
+            else {
+               sprintf(pszChildPath, "%s/%s", pszPath, pEntry->d_name);
+               nResult = add_batch_path(pppszFilenames, pNumFiles, pszChildPath, cCommand, true);
+               free(pszChildPath);
+            }
+         }
+      }
+      closedir(pDir);
+      return nResult;
+   }
+
+   if (bFromDirectory && (stat(pszPath, &fileStat) || !S_ISREG(fileStat.st_mode))) {
+      /* Skip special files */
+      return 0;
+   }
+#endif
+
+   if (bFromDirectory && is_compressed_filename(pszPath) != (cCommand == 'd'))
+      return 0;
+
+   return add_corpus_file(pppszFilenames, pNumFiles, NULL, pszPath);
+}
+
+static void batch_job(void *pUserData, const int nThreadIndex, const int nJobIndex) {
+   batch_t *pBatch = (batch_t *)pUserData;
+   const char *pszInFilename = pBatch->ppszFilenames[nJobIndex];
+   const size_t nInFilenameLen = strlen(pszInFilename);
+   long long nOriginalSize = 0LL, nCompressedSize = 0LL;
+   lz4ultra_status_t nStatus;
+   char *pszOutFilename;
+
+   pBatch->pResults[nJobIndex] = 100;
+
+   if (pBatch->cCommand == 'd' && !is_compressed_filename(pszInFilename)) {
+      fprintf(stderr, "'%s' doesn't have the .lz4 extension, skipping\n", pszInFilename);
+      return;
+   }
+
+   /* Compress to <name>.lz4, and decompress <name>.lz4 to <name> */
+   pszOutFilename = (char *)malloc(nInFilenameLen + 5);
+   if (!pszOutFilename) {
+      fprintf(stderr, "out of memory for '%s'\n", pszInFilename);
+      return;
+   }
+   if (pBatch->cCommand == 'd') {
+      memcpy(pszOutFilename, pszInFilename, nInFilenameLen - 4);
+      pszOutFilename[nInFilenameLen - 4] = 0;
+   }
+   else {
+      sprintf(pszOutFilename, "%s.lz4", pszInFilename);
+   }
+
+   if (pBatch->cCommand == 'd') {
+      nStatus = lz4ultra_decompress_file(pszInFilename, pszOutFilename, pBatch->pszDictionaryFilename, pBatch->nFlags, 1, &nOriginalSize, &nCompressedSize);
+   }
+   else {
+      int nCommandCount = 0;
+
+      nStatus = lz4ultra_compress_file_ctx(pBatch->ppCtx[nThreadIndex], pszInFilename, pszOutFilename, pBatch->pszDictionaryFilename, pBatch->nFlags,
+         pBatch->nBlockMaxCode, pBatch->nCompressionLevel, NULL, NULL, &nOriginalSize, &nCompressedSize, &nCommandCount);
+   }
+
+   switch (nStatus) {
+   case LZ4ULTRA_ERROR_SRC: fprintf(stderr, "error reading '%s'\n", pszInFilename); break;
+   case LZ4ULTRA_ERROR_DST: fprintf(stderr, "error writing '%s'\n", pszOutFilename); break;
+   case LZ4ULTRA_ERROR_DICTIONARY: fprintf(stderr, "error reading dictionary '%s'\n", pBatch->pszDictionaryFilename); break;
+   case LZ4ULTRA_ERROR_MEMORY: fprintf(stderr, "out of memory for '%s'\n", pszInFilename); break;
+   case LZ4ULTRA_ERROR_VERIFY: fprintf(stderr, "verification failed: compressed data doesn't decompress back to '%s'\n", pszInFilename); break;
+   case LZ4ULTRA_ERROR_DEDUP: fprintf(stderr, "'%s' was compressed with --dedup, it can only be decompressed to a file\n", pszInFilename); break;
+   case LZ4ULTRA_OK: break;
+   default: fprintf(stderr, "%s error %d for '%s'\n", (pBatch->cCommand == 'd') ? "decompression" : "compression", nStatus, pszInFilename); break;
+   }
+
+   if (nStatus == LZ4ULTRA_OK) {
+      if (pBatch->nOptions & OPT_VERBOSE) {
+         fprintf(stdout, "%s '%s', %lld into %lld bytes\n", (pBatch->cCommand == 'd') ? "Decompressed" : "Compressed", pszInFilename,
+            (pBatch->cCommand == 'd') ? nCompressedSize : nOriginalSize, (pBatch->cCommand == 'd') ? nOriginalSize : nCompressedSize);
+      }
+
+      pBatch->pOriginalSizes[nJobIndex] = nOriginalSize;
+      pBatch->pCompressedSizes[nJobIndex] = nCompressedSize;
+      pBatch->pResults[nJobIndex] = 0;
+   }
+
+   free(pszOutFilename);
+}
+
+static int do_batch(const char cCommand, const char **ppszPaths, int nNumPaths, const char *pszDictionaryFilename, const unsigned int nOptions, int nBlockMaxCode,
+                    int nCompressionLevel, int nThreads, int nDecodeCost, int nMatchCandidates, int nMaxMemory) {
+   long long nStartTime, nEndTime;
+   long long nOriginalSize = 0LL, nCompressedSize = 0LL;
+   lz4ultra_threadpool *pPool = NULL;
+   batch_t batch;
+   int nFailedFiles = 0;
+   int nResult = 0;
+   int i;
+
+   memset(&batch, 0, sizeof(batch_t));
+   batch.pszDictionaryFilename = pszDictionaryFilename;
+   batch.nOptions = nOptions;
+   batch.nBlockMaxCode = nBlockMaxCode;
+   batch.nCompressionLevel = nCompressionLevel;
+   batch.cCommand = cCommand;
+   if (nThreads < 1)
+      nThreads = 1;
+
+   if (cCommand == 'd') {
+      if (nOptions & OPT_RAW)
+         batch.nFlags |= LZ4ULTRA_FLAG_RAW_BLOCK;
+      if (nOptions & OPT_RAW_TABLE)
+         batch.nFlags |= LZ4ULTRA_FLAG_RAW_TABLE;
+   }
+   else {
+      if (nOptions & OPT_FAVOR_RATIO)
+         batch.nFlags |= LZ4ULTRA_FLAG_FAVOR_RATIO;
+      if (nOptions & OPT_RAW)
+         batch.nFlags |= LZ4ULTRA_FLAG_RAW_BLOCK;
+      if (nOptions & OPT_RAW_TABLE)
+         batch.nFlags |= LZ4ULTRA_FLAG_RAW_TABLE;
+      if (nOptions & OPT_INDEP_BLOCKS)
+         batch.nFlags |= LZ4ULTRA_FLAG_INDEP_BLOCKS;
+      if (nOptions & OPT_LEGACY_FRAMES)
+         batch.nFlags |= LZ4ULTRA_FLAG_LEGACY_FRAMES;
+      if (nOptions & OPT_BLOCK_CHECKSUM)
+         batch.nFlags |= LZ4ULTRA_FLAG_BLOCK_CHECKSUM;
+      if (nOptions & OPT_CONTENT_CHECKSUM)
+         batch.nFlags |= LZ4ULTRA_FLAG_CONTENT_CHECKSUM;
+      if (nOptions & OPT_CONTENT_SIZE)
+         batch.nFlags |= LZ4ULTRA_FLAG_CONTENT_SIZE;
+      if (nOptions & OPT_ADAPTIVE_BLOCKS)
+         batch.nFlags |= LZ4ULTRA_FLAG_ADAPTIVE_BLOCKS;
+      if (nOptions & OPT_SEEK_TABLE)
+         batch.nFlags |= LZ4ULTRA_FLAG_SEEK_TABLE;
+      if (nOptions & OPT_VERIFY)
+         batch.nFlags |= LZ4ULTRA_FLAG_VERIFY;
+      if (nOptions & OPT_DEDUP)
+         batch.nFlags |= LZ4ULTRA_FLAG_DEDUP;
+   }
+
+   /* List the files to process, from the command line, or one per line from stdin if none is given */
+   if (nNumPaths) {
+      for (i = 0; i < nNumPaths && !nResult; i++) {
+         if (add_batch_path(&batch.ppszFilenames, &batch.nNumFiles, ppszPaths[i], cCommand, false)) {
+            fprintf(stderr, "error listing '%s'\n", ppszPaths[i]);
+            nResult = 100;
+         }
+      }
+   }
+   else {
+      char szLine[4096];
+
+      while (!nResult && fgets(szLine, sizeof(szLine), stdin)) {
+         size_t nLen = strlen(szLine);
+
+         while (nLen && (szLine[nLen - 1] == '\n' || szLine[nLen - 1] == '\r'))
+            szLine[--nLen] = 0;
+         if (nLen && add_batch_path(&batch.ppszFilenames, &batch.nNumFiles, szLine, cCommand, false)) {
+            fprintf(stderr, "error listing '%s'\n", szLine);
+            nResult = 100;
+         }
+      }
+   }
+
+   if (!nResult && !batch.nNumFiles) {
+      fprintf(stderr, "no files to %s\n", (cCommand == 'd') ? "decompress" : "compress");
+      nResult = 100;
+   }
+
+   if (!nResult) {
+      batch.pOriginalSizes = (long long *)calloc(batch.nNumFiles, sizeof(long long));
+      batch.pCompressedSizes = (long long *)calloc(batch.nNumFiles, sizeof(long long));
+      batch.pResults = (int *)calloc(batch.nNumFiles, sizeof(int));
+      batch.ppCtx = (lz4ultra_ctx **)calloc(nThreads, sizeof(lz4ultra_ctx *));
+      if (!batch.pOriginalSizes || !batch.pCompressedSizes || !batch.pResults || !batch.ppCtx) {
+         fprintf(stderr, "out of memory\n");
+         nResult = 100;
+      }
+   }
+
+   /* Process as many files at once as there are threads. Each thread keeps its compression context from one file to the next, so that its
+    * memory is only allocated once */
+   if (!nResult && cCommand != 'd') {
+      for (i = 0; i < nThreads && !nResult; i++) {
+         batch.ppCtx[i] = lz4ultra_ctx_create(1);
+         if (!batch.ppCtx[i]) {
+            fprintf(stderr, "out of memory\n");
+            nResult = 100;
+            break;
+         }
+         do_set_huge_pages(batch.ppCtx[i], nOptions);
+         lz4ultra_ctx_set_decode_cost(batch.ppCtx[i], nDecodeCost);
+         lz4ultra_ctx_set_match_candidates(batch.ppCtx[i], nMatchCandidates);
+      }
+
+      if (!nResult && nMaxMemory > 0) {
+         /* Share the budget between the files compressed at once */
+         batch.nBlockMaxCode = lz4ultra_ctx_get_block_max_code_for_memory(batch.ppCtx[0], ((size_t)nMaxMemory << 20) / nThreads, batch.nFlags, nBlockMaxCode,
+            nCompressionLevel, pszDictionaryFilename ? HISTORY_SIZE : 0);
+         if (batch.nBlockMaxCode < 0) {
+            fprintf(stderr, "compression needs more than %d Mb of memory with these settings\n", nMaxMemory);
+            nResult = 100;
+         }
+      }
+   }
+
+   if (!nResult && nThreads > 1) {
+      pPool = lz4ultra_threadpool_create(nThreads);
+      if (!pPool) {
+         fprintf(stderr, "out of memory\n");
+         nResult = 100;
+      }
+   }
+
+   if (!nResult) {
+      nStartTime = do_get_time();
+      lz4ultra_threadpool_run(pPool, batch_job, &batch, batch.nNumFiles);
+      nEndTime = do_get_time();
+
+      for (i = 0; i < batch.nNumFiles; i++) {
+         if (batch.pResults[i])
+            nFailedFiles++;
+         nOriginalSize += batch.pOriginalSizes[i];
+         nCompressedSize += batch.pCompressedSizes[i];
+      }
+
+      double fDelta = ((double)(nEndTime - nStartTime)) / 1000000.0;
+      double fSpeed = fDelta ? ((double)nOriginalSize / 1048576.0) / fDelta : 0.0;
+      fprintf(stdout, "%s %d files", (cCommand == 'd') ? "Decompressed" : "Compressed", batch.nNumFiles - nFailedFiles);
+      if (nFailedFiles)
+         fprintf(stdout, " (%d failed)", nFailedFiles);
+      fprintf(stdout, " in %g seconds, %g Mb/s, %lld into %lld bytes ==> %g %%\n", fDelta, fSpeed,
+         (cCommand == 'd') ? nCompressedSize : nOriginalSize, (cCommand == 'd') ? nOriginalSize : nCompressedSize,
+         nOriginalSize ? (double)(nCompressedSize * 100.0 / nOriginalSize) : 100.0);
+
+      if (nFailedFiles)
+         nResult = 100;
+   }
+
+   if (pPool)
+      lz4ultra_threadpool_destroy(pPool);
+   if (batch.ppCtx) {
+      for (i = 0; i < nThreads; i++) {
+         if (batch.ppCtx[i])
+            lz4ultra_ctx_destroy(batch.ppCtx[i]);
+      }
+      free(batch.ppCtx);
+   }
+   if (batch.pResults)
+      free(batch.pResults);
+   if (batch.pCompressedSizes)
+      free(batch.pCompressedSizes);
+   if (batch.pOriginalSizes)
+      free(batch.pOriginalSizes);
+   if (batch.ppszFilenames)
+      free_corpus(batch.ppszFilenames, batch.nNumFiles);
+
+   return nResult;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static long long get_compressed_size(lz4ultra_ctx *pCtx, const unsigned char *pData, size_t nDataSize, const lz4ultra_dictionary *pDictionary, const unsigned int nFlags,
+                                     int nBlockMaxCode, int nCompressionLevel) {
+   lz4ultra_stream_t inStream, outStream;
+   memory_stream_t inMemoryStream, outMemoryStream;
+   long long nOriginalSize = 0LL, nCompressedSize = 0LL;
+   int nCommandCount = 0;
+
+   memorystream_open(&inStream, &inMemoryStream, pData, nDataSize);
+   memorystream_open(&outStream, &outMemoryStream, NULL, 0);
+
+   if (lz4ultra_compress_stream_dict(pCtx, &inStream, &outStream, pDictionary, nFlags, nBlockMaxCode, nCompressionLevel, NULL, NULL,
+         &nOriginalSize, &nCompressedSize, &nCommandCount) != LZ4ULTRA_OK)
+      return -1LL;
+   return (long long)outMemoryStream.nOffset;
+}
+
+static int do_train(const char *pszSamplesPath, const char *pszOutFilename, const char *pszDictionaryFilename, const unsigned int nOptions, int nBlockMaxCode,
+                    int nCompressionLevel) {
+   long long nStartTime, nEndTime;
+   long long nTrainingSize = 0LL, nHeldOutSize = 0LL;
+   long long nPlainCompressedSize = 0LL, nDictionaryCompressedSize = 0LL;
+   unsigned char **ppSamples;
+   size_t *pSampleSizes;
+   char **ppszFilenames;
+   lz4ultra_dictionary *pDictionary = NULL;
+   lz4ultra_ctx *pCtx = NULL;
+   unsigned char *pDictionaryData;
+   int nNumFiles = 0;
+   int nNumTrainingSamples = 0;
+   int nNumHeldOutSamples = 0;
+   int nDictionaryDataSize = -1;
+   int nFlags;
+   int nResult = 0;
+   int i;
+
+   if (pszDictionaryFilename) {
+      fprintf(stderr, "training builds a new dictionary and doesn't use one\n");
+      return 100;
+   }
+
+   nFlags = 0;
+   if (nOptions & OPT_FAVOR_RATIO)
+      nFlags |= LZ4ULTRA_FLAG_FAVOR_RATIO;
+   if (nOptions & OPT_RAW)
+      nFlags |= LZ4ULTRA_FLAG_RAW_BLOCK;
+   if (nOptions & OPT_INDEP_BLOCKS)
+      nFlags |= LZ4ULTRA_FLAG_INDEP_BLOCKS;
+   if (nOptions & OPT_LEGACY_FRAMES)
+      nFlags |= LZ4ULTRA_FLAG_LEGACY_FRAMES;
+   if (nOptions & OPT_BLOCK_CHECKSUM)
+      nFlags |= LZ4ULTRA_FLAG_BLOCK_CHECKSUM;
+   if (nOptions & OPT_CONTENT_CHECKSUM)
+      nFlags |= LZ4ULTRA_FLAG_CONTENT_CHECKSUM;
+   if (nOptions & OPT_CONTENT_SIZE)
+      nFlags |= LZ4ULTRA_FLAG_CONTENT_SIZE;
+
+   ppszFilenames = list_corpus(pszSamplesPath, &nNumFiles);
+   if (!ppszFilenames || !nNumFiles) {
+      if (ppszFilenames)
+         free_corpus(ppszFilenames, nNumFiles);
+      fprintf(stderr, "no samples to train with in '%s'\n", pszSamplesPath);
+      return 100;
+   }
+
+   ppSamples = (unsigned char **)malloc(nNumFiles * sizeof(unsigned char *));
+   pSampleSizes = (size_t *)malloc(nNumFiles * sizeof(size_t));
+   pDictionaryData = (unsigned char *)malloc(HISTORY_SIZE);
+   if (!ppSamples || !pSampleSizes || !pDictionaryData) {
+      fprintf(stderr, "out of memory for training\n");
+      nResult = 100;
+   }
+
+   /* Read each sample file in memory, up to TRAIN_MAX_SAMPLES_SIZE in total. One sample out of every TRAIN_HOLDOUT_INTERVAL is held out and stored at
+    * the end of the array, to estimate the gain on samples that the dictionary wasn't trained with */
+   for (i = 0; i < nNumFiles && !nResult; i++) {
+      const char *pszFilename = ppszFilenames[i];
+      const bool bHeldOut = (nNumFiles >= TRAIN_HOLDOUT_INTERVAL && (i % TRAIN_HOLDOUT_INTERVAL) == (TRAIN_HOLDOUT_INTERVAL - 1));
+      const int nSampleIndex = bHeldOut ? (nNumFiles - 1 - nNumHeldOutSamples) : nNumTrainingSamples;
+      size_t nFileSize;
+
+      FILE *f_in = fopen(pszFilename, "rb");
+      if (!f_in) {
+         fprintf(stderr, "error opening '%s' for reading\n", pszFilename);
+         nResult = 100;
+         break;
+      }
+
+      fseek(f_in, 0, SEEK_END);
+      nFileSize = (size_t)ftell(f_in);
+      fseek(f_in, 0, SEEK_SET);
+
+      if ((nTrainingSize + nHeldOutSize + (long long)nFileSize) > TRAIN_MAX_SAMPLES_SIZE) {
+         fclose(f_in);
+         fprintf(stderr, "warning: only using the first %d samples, up to %d Mb\n", i, TRAIN_MAX_SAMPLES_SIZE >> 20);
+         break;
+      }
+
+      ppSamples[nSampleIndex] = (unsigned char *)malloc(nFileSize ? nFileSize : 1);
+      if (!ppSamples[nSampleIndex]) {
+         fprintf(stderr, "out of memory for training\n");
+         nResult = 100;
+      }
+      else if (fread(ppSamples[nSampleIndex], 1, nFileSize, f_in) != nFileSize) {
+         fprintf(stderr, "I/O error while reading '%s'\n", pszFilename);
+         free(ppSamples[nSampleIndex]);
+         nResult = 100;
+      }
+      else {
+         pSampleSizes[nSampleIndex] = nFileSize;
+         if (bHeldOut) {
+            nHeldOutSize += (long long)nFileSize;
+            nNumHeldOutSamples++;
+         }
+         else {
+            nTrainingSize += (long long)nFileSize;
+            nNumTrainingSamples++;
+         }
+      }
+
+      fclose(f_in);
+   }
+
+   if (!nResult) {
+      nStartTime = do_get_time();
+      nDictionaryDataSize = lz4ultra_dictionary_train((const unsigned char * const *)ppSamples, pSampleSizes, nNumTrainingSamples, pDictionaryData, HISTORY_SIZE);
+      nEndTime = do_get_time();
+
+      if (nDictionaryDataSize < 0) {
+         fprintf(stderr, "out of memory for training\n");
+         nResult = 100;
+      }
+   }
+
+   if (!nResult) {
+      FILE *f_out = fopen(pszOutFilename, "wb");
+
+      if (!f_out) {
+         fprintf(stderr, "error opening '%s' for writing\n", pszOutFilename);
+         nResult = 100;
+      }
+      else {
+         if (fwrite(pDictionaryData, 1, nDictionaryDataSize, f_out) != (size_t)nDictionaryDataSize) {
+            fprintf(stderr, "error writing '%s'\n", pszOutFilename);
+            nResult = 100;
+         }
+         fclose(f_out);
+      }
+   }
+
+   if (!nResult) {
+      /* Without held out samples, estimate the gain on the training samples, which overestimates it */
+      const int nFirstEvalSample = nNumHeldOutSamples ? (nNumFiles - nNumHeldOutSamples) : 0;
+      const int nLastEvalSample = nNumHeldOutSamples ? nNumFiles : nNumTrainingSamples;
+      const long long nEvalSize = nNumHeldOutSamples ? nHeldOutSize : nTrainingSize;
+
+      fprintf(stdout, "Trained %d byte dictionary from %d samples (%lld bytes) in %g seconds\n", nDictionaryDataSize, nNumTrainingSamples, nTrainingSize,
+         ((double)(nEndTime - nStartTime)) / 1000000.0);
+
+      pCtx = lz4ultra_ctx_create(1);
+      pDictionary = lz4ultra_dictionary_prepare(pDictionaryData, nDictionaryDataSize);
+      if (!pCtx || !pDictionary) {
+         fprintf(stderr, "out of memory for estimating the gain\n");
+         nResult = 100;
+      }
+
+      for (i = nFirstEvalSample; i < nLastEvalSample && !nResult; i++) {
+         const long long nPlainSize = get_compressed_size(pCtx, ppSamples[i], pSampleSizes[i], NULL, nFlags, nBlockMaxCode, nCompressionLevel);
+         const long long nDictionarySize = get_compressed_size(pCtx, ppSamples[i], pSampleSizes[i], pDictionary, nFlags, nBlockMaxCode, nCompressionLevel);
+
+         if (nPlainSize < 0 || nDictionarySize < 0) {
+            fprintf(stderr, "compression error while estimating the gain\n");
+            nResult = 100;
+            break;
+         }
+
+         nPlainCompressedSize += nPlainSize;
+         nDictionaryCompressedSize += nDictionarySize;
+      }
+
+      if (!nResult) {
+         if (nNumHeldOutSamples)
+            fprintf(stdout, "%d held-out samples: %lld bytes\n", nNumHeldOutSamples, nEvalSize);
+         else
+            fprintf(stdout, "fewer than %d samples, none held out: estimating on the %lld bytes of training samples\n", TRAIN_HOLDOUT_INTERVAL, nEvalSize);
+         fprintf(stdout, "without dictionary: %lld bytes (%g %%)\n", nPlainCompressedSize, nEvalSize ? ((double)nPlainCompressedSize * 100.0 / (double)nEvalSize) : 100.0);
+         fprintf(stdout, "with dictionary: %lld bytes (%g %%)\n", nDictionaryCompressedSize, nEvalSize ? ((double)nDictionaryCompressedSize * 100.0 / (double)nEvalSize) : 100.0);
+         fprintf(stdout, "estimated gain: %g %% smaller\n", nPlainCompressedSize ? ((double)(nPlainCompressedSize - nDictionaryCompressedSize) * 100.0 / (double)nPlainCompressedSize) : 0.0);
+      }
+   }
+
+   lz4ultra_dictionary_destroy(pDictionary);
+   if (pCtx)
+      lz4ultra_ctx_destroy(pCtx);
+   for (i = 0; i < nNumTrainingSamples; i++)
+      free(ppSamples[i]);
+   for (i = nNumFiles - nNumHeldOutSamples; i < nNumFiles; i++)
+      free(ppSamples[i]);
+   if (pDictionaryData)
+      free(pDictionaryData);
+   if (pSampleSizes)
+      free(pSampleSizes);
+   if (ppSamples)
+      free(ppSamples);
+   free_corpus(ppszFilenames, nNumFiles);
+
+   return nResult;
+}
+
+/*---------------------------------------------------------------------------*/
+
+#define STRESS_CHUNK_SIZE           0x100000
+#define STRESS_DEFAULT_SIZE         4
+
+#define STRESS_PASS_COMPRESS        0
+#define STRESS_PASS_DECOMPRESS      1
+#define STRESS_PASS_RECOMPRESS      2
+#define STRESS_PASS_DICT_COMPRESS   3
+#define STRESS_PASS_DICT_DECOMPRESS 4
+
+static const char *g_pszStressPassNames[5] = { "compressing", "decompressing", "recompressing", "compressing with a dictionary", "decompressing with a dictionary" };
+
+typedef struct {
+   lz4ultra_ctx **ppCtx;
+   unsigned char **ppScratchData;
+   const unsigned char *pData;
+   size_t nDataSize;
+   unsigned char *pCompressedData;
+   unsigned char *pDecompressedData;
+   size_t nMaxChunkCompressedSize;
+   size_t *pCompressedSizes;
+   int *pResults;
+   int nNumChunks;
+   int nPass;
+   unsigned int nFlags;
+   int nBlockMaxCode;
+   int nCompressionLevel;
+   const void *pDictionaryData;
+   int nDictionaryDataSize;
+   const lz4ultra_dictionary *pDictionary;
+} stress_t;
+
+static void stress_job(void *pUserData, const int nThreadIndex, const int nJobIndex) {
+   stress_t *pStress = (stress_t *)pUserData;
+   /* Check the chunks again in the reverse order, so that each one is compressed in another context, after other data */
+   const int nChunk = (pStress->nPass == STRESS_PASS_RECOMPRESS) ? (pStress->nNumChunks - 1 - nJobIndex) : nJobIndex;
+   const size_t nChunkOffset = (size_t)nChunk * STRESS_CHUNK_SIZE;
+   const size_t nChunkSize = ((pStress->nDataSize - nChunkOffset) < STRESS_CHUNK_SIZE) ? (pStress->nDataSize - nChunkOffset) : STRESS_CHUNK_SIZE;
+   const unsigned char *pChunkData = pStress->pData + nChunkOffset;
+   unsigned char *pCompressedChunk = pStress->pCompressedData + (size_t)nChunk * pStress->nMaxChunkCompressedSize;
+   unsigned char *pDecompressedChunk = pStress->pDecompressedData + nChunkOffset;
+   lz4ultra_ctx *pCtx = pStress->ppCtx[nThreadIndex];
+   const void *pDictionaryData = pStress->pDictionaryData;
+   int nDictionaryDataSize = pStress->nDictionaryDataSize;
+   int nResult = 0;
+
+   if (!pStress->pDictionary) {
+      /* Without a dictionary file, use the data right before the chunk */
+      nDictionaryDataSize = (nChunkOffset < HISTORY_SIZE) ? (int)nChunkOffset : HISTORY_SIZE;
+      pDictionaryData = pChunkData - nDictionaryDataSize;
+   }
+
+   switch (pStress->nPass) {
+   case STRESS_PASS_COMPRESS:
+      pStress->pCompressedSizes[nChunk] = lz4ultra_compress_inmem_ctx(pCtx, pChunkData, pCompressedChunk, nChunkSize, pStress->nMaxChunkCompressedSize,
+         pStress->nFlags, pStress->nBlockMaxCode, pStress->nCompressionLevel);
+      if (pStress->pCompressedSizes[nChunk] == (size_t)-1)
+         nResult = 100;
+      break;
+
+   case STRESS_PASS_DECOMPRESS:
+      if (lz4ultra_decompress_inmem(pCompressedChunk, pDecompressedChunk, pStress->pCompressedSizes[nChunk], nChunkSize, pStress->nFlags, 1) != nChunkSize ||
+          memcmp(pChunkData, pDecompressedChunk, nChunkSize))
+         nResult = 100;
+      break;
+
+   case STRESS_PASS_RECOMPRESS:
+      /* Compressing the same data in another context must give the same bytes, whatever the context compressed before */
+      if (lz4ultra_compress_inmem_ctx(pCtx, pChunkData, pStress->ppScratchData[nThreadIndex], nChunkSize, pStress->nMaxChunkCompressedSize,
+            pStress->nFlags, pStress->nBlockMaxCode, pStress->nCompressionLevel) != pStress->pCompressedSizes[nChunk] ||
+          memcmp(pStress->ppScratchData[nThreadIndex], pCompressedChunk, pStress->pCompressedSizes[nChunk]))
+         nResult = 100;
+      break;
+
+   case STRESS_PASS_DICT_COMPRESS: {
+      lz4ultra_stream_t inStream, outStream;
+      memory_stream_t inMemoryStream, outMemoryStream;
+      long long nOriginalSize = 0LL, nCompressedSize = 0LL;
+      int nCommandCount = 0;
+      lz4ultra_status_t nStatus;
+
+      memorystream_open(&inStream, &inMemoryStream, pChunkData, nChunkSize);
+      memorystream_open_output(&outStream, &outMemoryStream, pCompressedChunk, pStress->nMaxChunkCompressedSize);
+
+      if (pStress->pDictionary) {
+         nStatus = lz4ultra_compress_stream_dict(pCtx, &inStream, &outStream, pStress->pDictionary, pStress->nFlags, pStress->nBlockMaxCode, pStress->nCompressionLevel,
+            NULL, NULL, &nOriginalSize, &nCompressedSize, &nCommandCount);
+      }
+      else {
+         nStatus = lz4ultra_compress_stream_ctx(pCtx, &inStream, &outStream, pDictionaryData, nDictionaryDataSize, pStress->nFlags, pStress->nBlockMaxCode,
+            pStress->nCompressionLevel, NULL, NULL, &nOriginalSize, &nCompressedSize, &nCommandCount);
+      }
+
+      pStress->pCompressedSizes[nChunk] = outMemoryStream.nOffset;
+      if (nStatus != LZ4ULTRA_OK || nOriginalSize != (long long)nChunkSize)
+         nResult = 100;
+      break;
+   }
+
+   case STRESS_PASS_DICT_DECOMPRESS: {
+      lz4ultra_dstream *pDecompressStream = lz4ultra_dstream_create(pDictionaryData, nDictionaryDataSize, NULL);
+
+      if (pDecompressStream) {
+         size_t nInOffset = 0, nOutOffset = 0;
+         size_t nInDataSize, nOutDataSize;
+         lz4ultra_status_t nStatus;
+
+         /* Push the compressed chunk until the stream neither consumes nor returns anything */
+         do {
+            nInDataSize = pStress->pCompressedSizes[nChunk] - nInOffset;
+            nOutDataSize = nChunkSize - nOutOffset;
+            nStatus = lz4ultra_dstream_decompress(pDecompressStream, pCompressedChunk + nInOffset, &nInDataSize, pDecompressedChunk + nOutOffset, &nOutDataSize);
+            nInOffset += nInDataSize;
+            nOutOffset += nOutDataSize;
+         } while (nStatus == LZ4ULTRA_OK && (nInDataSize || nOutDataSize));
+
+         if (lz4ultra_dstream_end(pDecompressStream, NULL, NULL) != LZ4ULTRA_OK || nStatus != LZ4ULTRA_OK ||
+             nInOffset != pStress->pCompressedSizes[nChunk] || nOutOffset != nChunkSize || memcmp(pChunkData, pDecompressedChunk, nChunkSize))
+            nResult = 100;
+      }
+      else {
+         nResult = 100;
+      }
+      break;
+   }
+
+   default:
+      nResult = 100;
+      break;
+   }
+
+   pStress->pResults[nChunk] = nResult;
+}
+
+static long long run_stress_pass(lz4ultra_threadpool *pPool, stress_t *pStress, const int nPass, int *pFailedChunk) {
+   long long nStartTime, nEndTime;
+   int i;
+
+   pStress->nPass = nPass;
+
+   nStartTime = do_get_time();
+   lz4ultra_threadpool_run(pPool, stress_job, pStress, pStress->nNumChunks);
+   nEndTime = do_get_time();
+
+   *pFailedChunk = -1;
+   for (i = 0; i < pStress->nNumChunks; i++) {
+      if (pStress->pResults[i]) {
+         *pFailedChunk = i;
+         break;
+      }
+   }
+
+   return nEndTime - nStartTime;
+}
+
+static size_t get_stress_compressed_size(const stress_t *pStress) {
+   size_t nCompressedSize = 0;
+   int i;
+
+   for (i = 0; i < pStress->nNumChunks; i++)
+      nCompressedSize += pStress->pCompressedSizes[i];
+   return nCompressedSize;
+}
+
+static int do_stress_test(const char *pszDictionaryFilename, const unsigned int nOptions, int nBlockMaxCode, int nCompressionLevel, int nThreads, int nDecodeCost,
+                          int nMatchCandidates, long long nStressSize) {
+   const float fMatchProbabilities[6] = { 0.0f, 0.25f, 0.5f, 0.75f, 0.9f, 0.99f };
+   const int nNumLiteralValues[2] = { 16, 256 };
+   lz4ultra_threadpool *pPool = NULL;
+   lz4ultra_dictionary *pDictionary = NULL;
+   unsigned char *pGeneratedData = NULL;
+   void *pDictionaryData = NULL;
+   int nDictionaryDataSize = 0;
+   bool bDictionaryPass;
+   unsigned int nSeed = 123;
+   stress_t stress;
+   int nResult = 0;
+   int i, j;
+
+   memset(&stress, 0, sizeof(stress_t));
+   stress.nBlockMaxCode = nBlockMaxCode;
+   stress.nCompressionLevel = nCompressionLevel;
+
+   stress.nFlags = 0;
+   if (nOptions & OPT_FAVOR_RATIO)
+      stress.nFlags |= LZ4ULTRA_FLAG_FAVOR_RATIO;
+   if (nOptions & OPT_RAW)
+      stress.nFlags |= LZ4ULTRA_FLAG_RAW_BLOCK;
+   if (nOptions & OPT_INDEP_BLOCKS)
+      stress.nFlags |= LZ4ULTRA_FLAG_INDEP_BLOCKS;
+   if (nOptions & OPT_LEGACY_FRAMES)
+      stress.nFlags |= LZ4ULTRA_FLAG_LEGACY_FRAMES;
+   if (nOptions & OPT_BLOCK_CHECKSUM)
+      stress.nFlags |= LZ4ULTRA_FLAG_BLOCK_CHECKSUM;
+   if (nOptions & OPT_CONTENT_CHECKSUM)
+      stress.nFlags |= LZ4ULTRA_FLAG_CONTENT_CHECKSUM;
+   if (nOptions & OPT_CONTENT_SIZE)
+      stress.nFlags |= LZ4ULTRA_FLAG_CONTENT_SIZE;
+   if (nOptions & OPT_ADAPTIVE_BLOCKS)
+      stress.nFlags |= LZ4ULTRA_FLAG_ADAPTIVE_BLOCKS;
+
+   /* Raw blocks and legacy frames can't carry a dictionary stream; the raw block pass still covers the former */
+   bDictionaryPass = (stress.nFlags & (LZ4ULTRA_FLAG_RAW_BLOCK | LZ4ULTRA_FLAG_LEGACY_FRAMES)) ? false : true;
+
+   if (nStressSize > (long long)(((size_t)-1) >> 21)) {
+      fprintf(stderr, "%lld Mb is too large for this build\n", nStressSize);
+      return 100;
+   }
+   stress.nDataSize = (size_t)nStressSize << 20;
+   stress.nNumChunks = (int)((stress.nDataSize + (STRESS_CHUNK_SIZE - 1)) / STRESS_CHUNK_SIZE);
+
+   /* Size every chunk's slot for the larger of the frame (or dictionary stream) and raw block outputs */
+   stress.nMaxChunkCompressedSize = lz4ultra_get_max_compressed_size_inmem(STRESS_CHUNK_SIZE, stress.nFlags, nBlockMaxCode);
+   if (stress.nMaxChunkCompressedSize < lz4ultra_get_max_compressed_size_inmem(STRESS_CHUNK_SIZE, LZ4ULTRA_FLAG_RAW_BLOCK, 7))
+      stress.nMaxChunkCompressedSize = lz4ultra_get_max_compressed_size_inmem(STRESS_CHUNK_SIZE, LZ4ULTRA_FLAG_RAW_BLOCK, 7);
+
+   if (pszDictionaryFilename) {
+      if (lz4ultra_dictionary_load(pszDictionaryFilename, &pDictionaryData, &nDictionaryDataSize)) {
+         fprintf(stderr, "error reading dictionary '%s'\n", pszDictionaryFilename);
+         return 100;
+      }
+
+      stress.pDictionaryData = pDictionaryData;
+      stress.nDictionaryDataSize = nDictionaryDataSize;
+      pDictionary = lz4ultra_dictionary_prepare(pDictionaryData, nDictionaryDataSize);
+      stress.pDictionary = pDictionary;
+      if (!pDictionary) {
+         fprintf(stderr, "out of memory\n");
+         nResult = 100;
+      }
+   }
+
+   if (!nResult) {
+      pGeneratedData = (unsigned char *)malloc(stress.nDataSize);
+      stress.pCompressedData = (unsigned char *)malloc((size_t)stress.nNumChunks * stress.nMaxChunkCompressedSize);
+      stress.pDecompressedData = (unsigned char *)malloc(stress.nDataSize);
+      stress.pCompressedSizes = (size_t *)calloc(stress.nNumChunks, sizeof(size_t));
+      stress.pResults = (int *)calloc(stress.nNumChunks, sizeof(int));
+      stress.ppCtx = (lz4ultra_ctx **)calloc(nThreads, sizeof(lz4ultra_ctx *));
+      stress.ppScratchData = (unsigned char **)calloc(nThreads, sizeof(unsigned char *));
+      if (!pGeneratedData || !stress.pCompressedData || !stress.pDecompressedData || !stress.pCompressedSizes || !stress.pResults || !stress.ppCtx || !stress.ppScratchData) {
+         fprintf(stderr, "out of memory, %lld Mb of data to test\n", nStressSize);
+         nResult = 100;
+      }
+      stress.pData = pGeneratedData;
+   }
+
+   /* Each thread compresses its chunks with its own, independent context */
+   for (i = 0; i < nThreads && !nResult; i++) {
+      stress.ppCtx[i] = lz4ultra_ctx_create(1);
+      stress.ppScratchData[i] = (unsigned char *)malloc(stress.nMaxChunkCompressedSize);
+      if (!stress.ppCtx[i] || !stress.ppScratchData[i]) {
+         fprintf(stderr, "out of memory\n");
+         nResult = 100;
+         break;
+      }
+      do_set_huge_pages(stress.ppCtx[i], nOptions);
+      lz4ultra_ctx_set_decode_cost(stress.ppCtx[i], nDecodeCost);
+      lz4ultra_ctx_set_match_candidates(stress.ppCtx[i], nMatchCandidates);
+   }
+
+   if (!nResult && nThreads > 1) {
+      pPool = lz4ultra_threadpool_create(nThreads);
+      if (!pPool) {
+         fprintf(stderr, "out of memory\n");
+         nResult = 100;
+      }
+   }
+
+   if (!nResult) {
+      fprintf(stdout, "Stress-testing %lld Mb per profile, in %d chunks, on %d thread%s\n", nStressSize, stress.nNumChunks, nThreads, (nThreads > 1) ? "s" : "");
+      fprintf(stdout, "profile                  frame ratio, compress/decompress  raw ratio, compress/decompress     dict ratio, compress/decompress\n");
+   }
+
+   for (i = 0; i < 2 && !nResult; i++) {
+      for (j = 0; j < 6 && !nResult; j++) {
+         const unsigned int nFrameFlags = stress.nFlags;
+         long long nCompressTime, nDecompressTime = 0LL;
+         size_t nCompressedSize;
+         int nFailedChunk = -1;
+         int nPass = 0;
+         int k;
+
+         /* Keep matches within the window, so that the match probability sets how compressible the data is, at any size */
+         memset(pGeneratedData, 0, stress.nDataSize);
+         generate_compressible_data(pGeneratedData, stress.nDataSize, nSeed, nNumLiteralValues[i], fMatchProbabilities[j], HISTORY_SIZE - 1);
+
+         fprintf(stdout, "literals %3d, prob. %.2f:", nNumLiteralValues[i], fMatchProbabilities[j]);
+         fflush(stdout);
+
+         /* Frames, as selected on the command line */
+         nCompressTime = run_stress_pass(pPool, &stress, (nPass = STRESS_PASS_COMPRESS), &nFailedChunk);
+         nCompressedSize = get_stress_compressed_size(&stress);
+         if (nFailedChunk < 0)
+            nDecompressTime = run_stress_pass(pPool, &stress, (nPass = STRESS_PASS_DECOMPRESS), &nFailedChunk);
+         if (nFailedChunk < 0)
+            run_stress_pass(pPool, &stress, (nPass = STRESS_PASS_RECOMPRESS), &nFailedChunk);
+         if (nFailedChunk >= 0) {
+            fprintf(stdout, "\n");
+            fprintf(stderr, "stress-test: error %s, chunk %d, seed %u, match probability %f, literals range %d\n",
+               g_pszStressPassNames[nPass], nFailedChunk, nSeed, fMatchProbabilities[j], nNumLiteralValues[i]);
+            nResult = 100;
+            break;
+         }
+
+         fprintf(stdout, "   %6.2f%%, %8.2f/%8.2f Mb/s", (double)nCompressedSize * 100.0 / (double)stress.nDataSize,
+            get_throughput(stress.nDataSize, nCompressTime), get_throughput(stress.nDataSize, nDecompressTime));
+         fflush(stdout);
+
+         /* Decompress corrupted chunks, expected to fail cleanly, without crashing or corrupting memory outside the output buffer */
+         for (k = 0; k < stress.nNumChunks; k++) {
+            const size_t nChunkOffset = (size_t)k * STRESS_CHUNK_SIZE;
+            const size_t nChunkSize = ((stress.nDataSize - nChunkOffset) < STRESS_CHUNK_SIZE) ? (stress.nDataSize - nChunkOffset) : STRESS_CHUNK_SIZE;
+            const size_t nActualCompressedSize = stress.pCompressedSizes[k];
+
+            if (nActualCompressedSize > (LZ4ULTRA_HEADER_SIZE + LZ4ULTRA_FRAME_SIZE + LZ4ULTRA_FRAME_SIZE /* footer */)) {
+               memcpy(stress.ppScratchData[0], stress.pCompressedData + (size_t)k * stress.nMaxChunkCompressedSize, nActualCompressedSize);
+               xor_data(stress.ppScratchData[0] + LZ4ULTRA_HEADER_SIZE + LZ4ULTRA_FRAME_SIZE, nActualCompressedSize - LZ4ULTRA_HEADER_SIZE - LZ4ULTRA_FRAME_SIZE - LZ4ULTRA_FRAME_SIZE /* footer */,
+                  nSeed + k, 0.05f);
+               lz4ultra_decompress_inmem(stress.ppScratchData[0], stress.pDecompressedData + nChunkOffset, nActualCompressedSize, nChunkSize, stress.nFlags, 1);
+            }
+         }
+
+         /* Raw blocks, for data where matches are frequent enough for every block to compress */
+         if (fMatchProbabilities[j] >= 0.1f) {
+            stress.nFlags = LZ4ULTRA_FLAG_RAW_BLOCK | (nFrameFlags & LZ4ULTRA_FLAG_FAVOR_RATIO);
+            stress.nBlockMaxCode = 7;
+            nCompressTime = run_stress_pass(pPool, &stress, (nPass = STRESS_PASS_COMPRESS), &nFailedChunk);
+            nCompressedSize = get_stress_compressed_size(&stress);
+            if (nFailedChunk < 0)
+               nDecompressTime = run_stress_pass(pPool, &stress, (nPass = STRESS_PASS_DECOMPRESS), &nFailedChunk);
+            stress.nFlags = nFrameFlags;
+            stress.nBlockMaxCode = nBlockMaxCode;
+            if (nFailedChunk >= 0) {
+               fprintf(stdout, "\n");
+               fprintf(stderr, "stress-test: error %s raw blocks, chunk %d, seed %u, match probability %f, literals range %d\n",
+                  g_pszStressPassNames[nPass], nFailedChunk, nSeed, fMatchProbabilities[j], nNumLiteralValues[i]);
+               nResult = 100;
+               break;
+            }
+
+            fprintf(stdout, "   %6.2f%%, %8.2f/%8.2f Mb/s", (double)nCompressedSize * 100.0 / (double)stress.nDataSize,
+               get_throughput(stress.nDataSize, nCompressTime), get_throughput(stress.nDataSize, nDecompressTime));
+         }
+         else {
+            fprintf(stdout, "   %32s", "-");
+         }
+         fflush(stdout);
+
+         /* Dictionary streams: the dictionary file, or the data right before each chunk */
+         if (bDictionaryPass) {
+            nCompressTime = run_stress_pass(pPool, &stress, (nPass = STRESS_PASS_DICT_COMPRESS), &nFailedChunk);
+            nCompressedSize = get_stress_compressed_size(&stress);
+            if (nFailedChunk < 0)
+               nDecompressTime = run_stress_pass(pPool, &stress, (nPass = STRESS_PASS_DICT_DECOMPRESS), &nFailedChunk);
+            if (nFailedChunk >= 0) {
+               fprintf(stdout, "\n");
+               fprintf(stderr, "stress-test: error %s, chunk %d, seed %u, match probability %f, literals range %d\n",
+                  g_pszStressPassNames[nPass], nFailedChunk, nSeed, fMatchProbabilities[j], nNumLiteralValues[i]);
+               nResult = 100;
+               break;
+            }
+
+            fprintf(stdout, "   %6.2f%%, %8.2f/%8.2f Mb/s", (double)nCompressedSize * 100.0 / (double)stress.nDataSize,
+               get_throughput(stress.nDataSize, nCompressTime), get_throughput(stress.nDataSize, nDecompressTime));
+         }
+         fprintf(stdout, "\n");
+         fflush(stdout);
+
+         nSeed++;
+      }
+   }
+
+   if (pPool)
+      lz4ultra_threadpool_destroy(pPool);
+   if (stress.ppScratchData) {
+      for (i = 0; i < nThreads; i++) {
+         if (stress.ppScratchData[i])
+            free(stress.ppScratchData[i]);
+      }
+      free(stress.ppScratchData);
+   }
+   if (stress.ppCtx) {
+      for (i = 0; i < nThreads; i++) {
+         if (stress.ppCtx[i])
+            lz4ultra_ctx_destroy(stress.ppCtx[i]);
+      }
+      free(stress.ppCtx);
+   }
+   if (stress.pResults)
+      free(stress.pResults);
+   if (stress.pCompressedSizes)
+      free(stress.pCompressedSizes);
+   if (stress.pDecompressedData)
+      free(stress.pDecompressedData);
+   if (stress.pCompressedData)
+      free(stress.pCompressedData);
+   if (pGeneratedData)
+      free(pGeneratedData);
+   if (pDictionary)
+      lz4ultra_dictionary_destroy(pDictionary);
+   if (pDictionaryData)
+      lz4ultra_dictionary_free(&pDictionaryData);
+
+   if (!nResult)
+      fprintf(stdout, "All tests passed.\n");
+   return nResult;
+}
+
+/*---------------------------------------------------------------------------*/
+
+int main(int argc, char **argv) {
+   int i;
+   const char *pszInFilename = NULL;
+   const char *pszOutFilename = NULL;
+   const char *pszDictionaryFilename = NULL;
+   bool bArgsError = false;
+   bool bCommandDefined = false;
+   bool bVerifyCompression = false;
+   bool bJsonReport = false;
+   int nBlockMaxCode = 7;
+   int nCompressionLevel = LZ4ULTRA_MAX_LEVEL;
+   int nThreads = 1;
+   int nDecodeCost = -1;
+   int nMatchCandidates = -1;
+   int nMaxMemory = -1;
+   long long nRangeOffset = -1LL;
+   long long nRangeSize = 0LL;
+   long long nStressSize = -1LL;
+   bool bBlockCodeDefined = false;
+   bool bCompressionLevelDefined = false;
+   bool bThreadsDefined = false;
+   bool bBatch = false;
+   int nNumFilenames = 0;
+   bool bBlockDependenceDefined = false;
+   char cCommand = 'z';
+   unsigned int nOptions = OPT_FAVOR_RATIO;
+
+   info_file = stdout;
+
+   for (i = 1; i < argc; i++) {
+      if (!strcmp(argv[i], "-d")) {
+         if (!bCommandDefined) {
+            bCommandDefined = true;
+            cCommand = 'd';
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strcmp(argv[i], "-z")) {
+         if (!bCommandDefined) {
+            bCommandDefined = true;
+            cCommand = 'z';
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strcmp(argv[i], "-m")) {
+         if (!bBatch) {
+            bBatch = true;
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strcmp(argv[i], "-c")) {
+         if ((nOptions & OPT_VERIFY) == 0) {
+            nOptions |= OPT_VERIFY;
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strcmp(argv[i], "-a")) {
+         if ((nOptions & OPT_APPEND) == 0) {
+            nOptions |= OPT_APPEND;
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strcmp(argv[i], "--check-file")) {
+         if (!bVerifyCompression) {
+            bVerifyCompression = true;
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strcmp(argv[i], "-cbench")) {
+         if (!bCommandDefined) {
+            bCommandDefined = true;
+            cCommand = 'B';
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strcmp(argv[i], "-dbench")) {
+         if (!bCommandDefined) {
+            bCommandDefined = true;
+            cCommand = 'b';
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strcmp(argv[i], "-bench")) {
+         if (!bCommandDefined) {
+            bCommandDefined = true;
+            cCommand = 'S';
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strcmp(argv[i], "-train")) {
+         if (!bCommandDefined) {
+            bCommandDefined = true;
+            cCommand = 'T';
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strcmp(argv[i], "--json")) {
+         if (!bJsonReport) {
+            bJsonReport = true;
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strcmp(argv[i], "-test")) {
+         if (!bCommandDefined) {
+            bCommandDefined = true;
+            cCommand = 't';
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strcmp(argv[i], "-stress")) {
+         if (!bCommandDefined) {
+            bCommandDefined = true;
+            cCommand = 's';
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strcmp(argv[i], "--size")) {
+         if (nStressSize < 0 && (i + 1) < argc) {
+            char *pszSizeEnd = NULL;
+
+            nStressSize = strtoll(argv[i + 1], &pszSizeEnd, 10);
+            if (pszSizeEnd == argv[i + 1] || !pszSizeEnd || *pszSizeEnd || nStressSize < 1 || nStressSize > 1048576)
+               bArgsError = true;
+            i++;
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strcmp(argv[i], "-D")) {
+         if (!pszDictionaryFilename && (i + 1) < argc) {
+            pszDictionaryFilename = argv[i + 1];
+            i++;
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strncmp(argv[i], "-D", 2)) {
+         if (!pszDictionaryFilename) {
+            pszDictionaryFilename = argv[i] + 2;
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strcmp(argv[i], "-BX")) {
+         if ((nOptions & OPT_BLOCK_CHECKSUM) == 0) {
+            nOptions |= OPT_BLOCK_CHECKSUM;
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strcmp(argv[i], "--frame-crc")) {
+         if ((nOptions & OPT_CONTENT_CHECKSUM) == 0) {
+            nOptions |= OPT_CONTENT_CHECKSUM;
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strcmp(argv[i], "--content-size")) {
+         if ((nOptions & OPT_CONTENT_SIZE) == 0) {
+            nOptions |= OPT_CONTENT_SIZE;
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strcmp(argv[i], "-BD")) {
+         if (!bBlockDependenceDefined) {
+            bBlockDependenceDefined = true;
+            nOptions &= ~OPT_INDEP_BLOCKS;
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strcmp(argv[i], "-BI")) {
+         if (!bBlockDependenceDefined) {
+            bBlockDependenceDefined = true;
+            nOptions |= OPT_INDEP_BLOCKS;
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strncmp(argv[i], "-B", 2)) {
+         if (!bBlockCodeDefined) {
+            nBlockMaxCode = atoi(argv[i] + 2);
+            if (nBlockMaxCode < 4 || nBlockMaxCode > 7)
+               bArgsError = true;
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strncmp(argv[i], "-T", 2)) {
+         if (!bThreadsDefined) {
+            bThreadsDefined = true;
+            nThreads = atoi(argv[i] + 2);
+            if (nThreads < 1 || nThreads > 256)
+               bArgsError = true;
+         }
+         else
+            bArgsError = true;
+      }
+      else if (argv[i][0] == '-' && argv[i][1] >= '1' && argv[i][1] <= '9' && argv[i][2] == 0) {
+         if (!bCompressionLevelDefined) {
+            bCompressionLevelDefined = true;
+            nCompressionLevel = argv[i][1] - '0';
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strcmp(argv[i], "-l")) {
+         if ((nOptions & OPT_LEGACY_FRAMES) == 0) {
+            nOptions |= OPT_LEGACY_FRAMES;
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strcmp(argv[i], "-v")) {
+         if ((nOptions & OPT_VERBOSE) == 0) {
+            nOptions |= OPT_VERBOSE;
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strcmp(argv[i], "-r")) {
+         if ((nOptions & OPT_RAW) == 0) {
+            nOptions |= OPT_RAW;
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strcmp(argv[i], "--raw-table")) {
+         if ((nOptions & OPT_RAW_TABLE) == 0) {
+            nOptions |= OPT_RAW_TABLE;
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strcmp(argv[i], "--favor-decSpeed")) {
+         if ((nOptions & OPT_FAVOR_RATIO) != 0) {
+            nOptions &= (~OPT_FAVOR_RATIO);
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strcmp(argv[i], "-stats")) {
+         if ((nOptions & OPT_STATS) == 0) {
+            nOptions |= OPT_STATS;
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strcmp(argv[i], "--seek-table")) {
+         if ((nOptions & OPT_SEEK_TABLE) == 0) {
+            nOptions |= OPT_SEEK_TABLE;
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strcmp(argv[i], "--adaptive")) {
+         if ((nOptions & OPT_ADAPTIVE_BLOCKS) == 0) {
+            nOptions |= OPT_ADAPTIVE_BLOCKS;
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strcmp(argv[i], "--range")) {
+         if (nRangeOffset < 0 && (i + 1) < argc) {
+            char *pszRangeEnd = NULL;
+
+            /* <offset>[,<size>], to the end of the decompressed data if the size is omitted */
+            nRangeOffset = strtoll(argv[i + 1], &pszRangeEnd, 10);
+            nRangeSize = 0x7fffffffffffffffLL;
+            if (pszRangeEnd && *pszRangeEnd == ',')
+               nRangeSize = strtoll(pszRangeEnd + 1, &pszRangeEnd, 10);
+            if (pszRangeEnd == argv[i + 1] || !pszRangeEnd || *pszRangeEnd || nRangeOffset < 0 || nRangeSize < 0)
+               bArgsError = true;
+            i++;
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strcmp(argv[i], "--dec-cost")) {
+         if (nDecodeCost < 0 && (i + 1) < argc) {
+            char *pszCostEnd = NULL;
+
+            nDecodeCost = (int)strtol(argv[i + 1], &pszCostEnd, 10);
+            if (pszCostEnd == argv[i + 1] || !pszCostEnd || *pszCostEnd || nDecodeCost < 0 || nDecodeCost > LZ4ULTRA_MAX_DECODE_COST)
+               bArgsError = true;
+            i++;
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strcmp(argv[i], "--candidates")) {
+         if (nMatchCandidates < 0 && (i + 1) < argc) {
+            char *pszCandidatesEnd = NULL;
+
+            nMatchCandidates = (int)strtol(argv[i + 1], &pszCandidatesEnd, 10);
+            if (pszCandidatesEnd == argv[i + 1] || !pszCandidatesEnd || *pszCandidatesEnd || nMatchCandidates < 1 || nMatchCandidates > LZ4ULTRA_MAX_MATCH_CANDIDATES)
+               bArgsError = true;
+            i++;
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strcmp(argv[i], "--memory")) {
+         if (nMaxMemory < 0 && (i + 1) < argc) {
+            char *pszMemoryEnd = NULL;
+
+            nMaxMemory = (int)strtol(argv[i + 1], &pszMemoryEnd, 10);
+            if (pszMemoryEnd == argv[i + 1] || !pszMemoryEnd || *pszMemoryEnd || nMaxMemory < 1 || nMaxMemory > 1048576)
+               bArgsError = true;
+            i++;
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strcmp(argv[i], "--huge-pages")) {
+         if ((nOptions & OPT_HUGE_PAGES) == 0) {
+            nOptions |= OPT_HUGE_PAGES;
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strcmp(argv[i], "--dedup")) {
+         if ((nOptions & OPT_DEDUP) == 0) {
+            nOptions |= OPT_DEDUP;
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strcmp(argv[i], "--prefault")) {
+         if ((nOptions & OPT_PREFAULT) == 0) {
+            nOptions |= OPT_PREFAULT;
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strcmp(argv[i], "--async-io")) {
+         if ((nOptions & OPT_ASYNC_IO) == 0) {
+            nOptions |= OPT_ASYNC_IO;
+         }
+         else
+            bArgsError = true;
+      }
+      else {
+         /* Gather all the filenames at the start of argv, for -m */
+         argv[1 + nNumFilenames++] = argv[i];
+         if (!pszInFilename)
+            pszInFilename = argv[i];
+         else {
+            if (!pszOutFilename)
+               pszOutFilename = argv[i];
+         }
+      }
+   }
+
+   if (nNumFilenames > 2 && !bBatch)
+      bArgsError = true;
+
+   if (bBatch && ((cCommand != 'z' && cCommand != 'd') || bVerifyCompression || nRangeOffset >= 0))
+      bArgsError = true;
+
+   if (nRangeOffset >= 0 && cCommand != 'd')
+      bArgsError = true;
+
+   /* Appending keeps the format of the compressed file, and only compresses one file */
+   if ((nOptions & OPT_APPEND) && (cCommand != 'z' || bBatch || bVerifyCompression || (nOptions & (OPT_RAW | OPT_LEGACY_FRAMES | OPT_SEEK_TABLE | OPT_DEDUP))))
+      bArgsError = true;
+
+   /* A raw block table is self-contained and is compressed and decompressed in memory, as a whole, so a memory budget can't be honored */
+   if ((nOptions & OPT_RAW_TABLE) && ((cCommand != 'z' && cCommand != 'd' && cCommand != 'B' && cCommand != 'b' && cCommand != 't') || pszDictionaryFilename || nRangeOffset >= 0 ||
+       nMaxMemory > 0 ||
+       (nOptions & (OPT_RAW | OPT_LEGACY_FRAMES | OPT_SEEK_TABLE | OPT_DEDUP | OPT_APPEND))))
+      bArgsError = true;
+
+   /* Checking the whole file needs to read both the original and the compressed data again, after compressing */
+   if (bVerifyCompression && ((pszInFilename && lz4ultra_filestream_is_stdio(pszInFilename)) || (pszOutFilename && lz4ultra_filestream_is_stdio(pszOutFilename))))
+      bArgsError = true;
+
+   /* Keep messages out of data piped to stdout */
+   if ((cCommand == 'z' || cCommand == 'd') && pszOutFilename && lz4ultra_filestream_is_stdio(pszOutFilename))
+      info_file = stderr;
+
+   if (bJsonReport && cCommand != 'S')
+      bArgsError = true;
+
+   if (nStressSize >= 0 && cCommand != 's')
+      bArgsError = true;
+
+   if (nDecodeCost < 0)
+      nDecodeCost = 0;
+   if (nMatchCandidates < 0)
+      nMatchCandidates = 1;
+
+   if (!bArgsError && cCommand == 't') {
+      return do_self_test(nOptions, nBlockMaxCode, nCompressionLevel, nThreads);
+   }
+
+   if (!bArgsError && cCommand == 's') {
+      do_init_time();
+      return do_stress_test(pszDictionaryFilename, nOptions, nBlockMaxCode, nCompressionLevel, nThreads, nDecodeCost, nMatchCandidates,
+         (nStressSize > 0) ? nStressSize : STRESS_DEFAULT_SIZE);
+   }
+
+   if (!bArgsError && cCommand == 'S' && pszInFilename) {
+      do_init_time();
+      return do_bench_suite(pszInFilename, pszOutFilename, pszDictionaryFilename, nOptions, nCompressionLevel, nThreads, bJsonReport);
+   }
+
+   if (!bArgsError && bBatch) {
+      do_init_time();
+      return do_batch(cCommand, (const char **)(argv + 1), nNumFilenames, pszDictionaryFilename, nOptions, nBlockMaxCode, nCompressionLevel, nThreads,
+         nDecodeCost, nMatchCandidates, nMaxMemory);
+   }
+
+   if (bArgsError || !pszInFilename || !pszOutFilename) {
+      fprintf(stderr, "lz4ultra v" TOOL_VERSION " by Emmanuel Marty and spke\n");
+      fprintf(stderr, "usage: %s [-c] [-d] [-v] [-r] <infile> <outfile>\n", argv[0]);
+      fprintf(stderr, "       %s -m [-c] [-d] [-v] [-T<n>] [<file or dir>...]\n", argv[0]);
+      fprintf(stderr, "                  <infile> and <outfile> can be - (or stdin and stdout) to read from and write to a pipe\n");
+      fprintf(stderr, "              -c: check each block by decompressing it right after compressing it\n");
+      fprintf(stderr, "    --check-file: check the resulting file by decompressing all of it again after compressing\n");
+      fprintf(stderr, "              -d: decompress (default: compress)\n");
+      fprintf(stderr, "              -a: compress <infile> to the end of the existing compressed <outfile>, keeping its block size and flags\n");
+      fprintf(stderr, "              -m: compress each file to <file>.lz4, or decompress it back with -d, n files at once with -T<n>; directories are\n"
+                      "                  walked recursively, and names are read from stdin if none is given\n");
+      fprintf(stderr, "         -cbench: benchmark in-memory compression\n");
+      fprintf(stderr, "         -dbench: benchmark in-memory decompression\n");
+      fprintf(stderr, "          -bench: benchmark block sizes and modes over a corpus file or directory, writing CSV to <outfile> or stdout\n");
+      fprintf(stderr, "          --json: write the -bench report as JSON\n");
+      fprintf(stderr, "          -train: build a dictionary for -D into <outfile>, from a directory of samples <infile>\n");
+      fprintf(stderr, "           -test: run automated self-tests\n");
+      fprintf(stderr, "         -stress: check and time compression of generated data profiles, with frames, raw blocks and dictionaries,\n"
+                      "                  on n independent contexts at once with -T<n>\n");
+      fprintf(stderr, "      --size <n>: size of each -stress data profile, in Mb (default %d)\n", STRESS_DEFAULT_SIZE);
+      fprintf(stderr, "          -B4..7: compress with 64, 256, 1024 or 4096 Kb blocks (defaults to -B7)\n");
+      fprintf(stderr, "             -BD: use block-dependent compression (default)\n");
+      fprintf(stderr, "             -BI: use block-independent compression\n");
+      fprintf(stderr, "             -BX: add a checksum to each block\n");
+      fprintf(stderr, "     --frame-crc: add a checksum of the decompressed data\n");
+      fprintf(stderr, "  --content-size: store the decompressed size in the header\n");
+      fprintf(stderr, "    --seek-table: index blocks at the end of the file, for -d --range with -BI\n");
+      fprintf(stderr, "      --adaptive: end blocks early between compressible and incompressible data, storing the latter as is\n");
+      fprintf(stderr, "         --dedup: leave out ranges that repeat earlier data at any distance, restored by lz4ultra -d only\n");
+      fprintf(stderr, "   --range <o,n>: decompress n bytes starting at offset o (to the end if n is omitted)\n");
+      fprintf(stderr, "          -1..-9: compress faster, with a lower ratio (default: best ratio)\n");
+      fprintf(stderr, "           -T<n>: compress, or decompress -BI streams, using n threads (defaults to -T1)\n");
+      fprintf(stderr, "              -v: be verbose\n");
+      fprintf(stderr, "          -stats: show compression counters and the time spent in each phase, when compressing or with -cbench\n");
+      fprintf(stderr, "              -r: raw block format (max. 4 Mb files)\n");
+      fprintf(stderr, "     --raw-table: raw blocks of any number behind a table of their ends, storing incompressible ones, for block-parallel\n"
+                      "                  decompression in place (compressed in memory, no dictionary or --memory)\n");
+      fprintf(stderr, "              -l: legacy format compression\n");
+      fprintf(stderr, "--favor-decSpeed: trade some ratio for faster decompression\n");
+      fprintf(stderr, "  --dec-cost <n>: trade ratio for modeled decompression time, n bits per unit of about 1 ns (0..%d, default 0)\n", LZ4ULTRA_MAX_DECODE_COST);
+      fprintf(stderr, "--candidates <n>: let the optimal parser pick from n match candidates at each position, with --dec-cost (1..%d, default 1)\n", LZ4ULTRA_MAX_MATCH_CANDIDATES);
+      fprintf(stderr, "    --memory <n>: compress within n Mb of memory, lowering the block size to fit\n");
+      fprintf(stderr, "    --huge-pages: map the compressor's arrays with huge pages where available; -bench compares them with regular pages\n");
+      fprintf(stderr, "      --prefault: with --huge-pages, fault in the compressor's memory upfront\n");
+      fprintf(stderr, "      --async-io: read ahead and write behind on background threads\n");
+      fprintf(stderr, "   -D <filename>: use dictionary file\n");
+      return 100;
+   }
+
+   do_init_time();
+
+   if (cCommand == 'z') {
+      int nResult = do_compress(pszInFilename, pszOutFilename, pszDictionaryFilename, nOptions, nBlockMaxCode, nCompressionLevel, nThreads, nDecodeCost, nMatchCandidates, nMaxMemory);
+      if (nResult == 0 && bVerifyCompression) {
+         return do_compare(pszOutFilename, pszInFilename, pszDictionaryFilename, nOptions, nThreads);
+      }
+      return nResult;
+   }
+   else if (cCommand == 'd') {
+      return do_decompress(pszInFilename, pszOutFilename, pszDictionaryFilename, nOptions, nThreads, nRangeOffset, nRangeSize);
+   }
+   else if (cCommand == 'B') {
+      return do_compr_benchmark(pszInFilename, pszOutFilename, pszDictionaryFilename, nOptions, nBlockMaxCode, nCompressionLevel, nDecodeCost, nMatchCandidates);
+   }
+   else if (cCommand == 'b') {
+      return do_dec_benchmark(pszInFilename, pszOutFilename, pszDictionaryFilename, nOptions, nThreads);
+   }
+   else if (cCommand == 'T') {
+      return do_train(pszInFilename, pszOutFilename, pszDictionaryFilename, nOptions, nBlockMaxCode, nCompressionLevel);
+   }
+   else {
+      return 100;
+   }
+}
@@ -0,0 +1,857 @@
+/*
+ * lz4ultra.h - public interface of the lz4ultra library
+ *
+ * Copyright (C) 2019 Emmanuel Marty
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*
+ * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
+ *
+ * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
+ * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
+ * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
+ * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
+ *
+ */
+
+#ifndef _LZ4ULTRA_H
+#define _LZ4ULTRA_H
+
+#include <stddef.h>
+
+/*
+ * This header is all that is needed to compress and decompress with liblz4ultra: compression contexts, dictionaries and streams are
+ * opaque, and the functions declared here are the only ones exported from the shared library. Define LZ4ULTRA_DLL when linking with
+ * the Windows DLL.
+ */
+#if defined(_WIN32)
+#if defined(LZ4ULTRA_DLL_EXPORT)
+#define LZ4ULTRA_API __declspec(dllexport)
+#elif defined(LZ4ULTRA_DLL)
+#define LZ4ULTRA_API __declspec(dllimport)
+#else
+#define LZ4ULTRA_API
+#endif
+#elif defined(__GNUC__) && (__GNUC__ >= 4)
+#define LZ4ULTRA_API __attribute__((visibility("default")))
+#else
+#define LZ4ULTRA_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** High level status for compression and decompression */
+typedef enum _lz4ultra_status_t {
+   LZ4ULTRA_OK = 0,                          /**< Success */
+   LZ4ULTRA_ERROR_SRC,                       /**< Error reading input */
+   LZ4ULTRA_ERROR_DST,                       /**< Error reading output */
+   LZ4ULTRA_ERROR_DICTIONARY,                /**< Error reading dictionary */
+   LZ4ULTRA_ERROR_MEMORY,                    /**< Out of memory */
+
+   /* Compression-specific status codes */
+   LZ4ULTRA_ERROR_COMPRESSION,               /**< Internal compression error */
+   LZ4ULTRA_ERROR_RAW_TOOLARGE,              /**< Input is too large to be compressed to a raw block */
+   LZ4ULTRA_ERROR_RAW_UNCOMPRESSED,          /**< Input is incompressible and raw blocks or legacy frames don't support uncompressed data */
+   LZ4ULTRA_ERROR_VERIFY,                    /**< A compressed block doesn't decompress back to its input data, with LZ4ULTRA_FLAG_VERIFY */
+   LZ4ULTRA_ERROR_APPEND,                    /**< Output isn't a single modern lz4 frame that ends the file, without a seek table, and can't be appended to */
+
+   /* Decompression-specific status codes */
+   LZ4ULTRA_ERROR_FORMAT,                    /**< Invalid input format or magic number when decompressing */
+   LZ4ULTRA_ERROR_CHECKSUM,                  /**< Invalid checksum when decompressing */
+   LZ4ULTRA_ERROR_DECOMPRESSION,             /**< Internal decompression error */
+   LZ4ULTRA_ERROR_NO_SEEK_TABLE,             /**< Input has no seek table or dependent blocks, and can't be decompressed from an arbitrary offset */
+   LZ4ULTRA_ERROR_DEDUP,                     /**< Input was deduplicated with LZ4ULTRA_FLAG_DEDUP, and can only be restored by decompressing a file to a file */
+} lz4ultra_status_t;
+
+/* Compression flags */
+#define LZ4ULTRA_FLAG_FAVOR_RATIO    (1<<0)           /**< 1 to compress with the best ratio, 0 to trade some compression ratio for extra decompression speed */
+#define LZ4ULTRA_FLAG_RAW_BLOCK      (1<<1)           /**< 1 to emit raw block */
+#define LZ4ULTRA_FLAG_INDEP_BLOCKS   (1<<2)           /**< 1 if blocks are independent, 0 if using inter-block back references */
+#define LZ4ULTRA_FLAG_LEGACY_FRAMES  (1<<3)           /**< 1 if using the legacy frames format, 0 if using the modern lz4 frame format */
+#define LZ4ULTRA_FLAG_ASYNC_IO       (1<<4)           /**< 1 to read ahead and write behind streams on background threads, overlapping I/O with (de)compression */
+#define LZ4ULTRA_FLAG_BLOCK_CHECKSUM (1<<5)           /**< 1 to follow each block with the XXH32 checksum of its data, 0 for none (modern lz4 frame format only) */
+#define LZ4ULTRA_FLAG_CONTENT_CHECKSUM (1<<6)         /**< 1 to end the frame with the XXH32 checksum of the decompressed data, 0 for none (modern lz4 frame format only) */
+#define LZ4ULTRA_FLAG_CONTENT_SIZE   (1<<7)           /**< 1 to store the decompressed size in the frame header when it is known upfront, 0 for none (modern lz4 frame format only) */
+#define LZ4ULTRA_FLAG_SEEK_TABLE     (1<<8)           /**< 1 to follow the frame with a skippable frame indexing its blocks, for random access with -BI, 0 for none (modern lz4 frame format only) */
+#define LZ4ULTRA_FLAG_STATS          (1<<9)           /**< 1 to time each compression phase in the compression statistics, 0 to only keep their counters */
+#define LZ4ULTRA_FLAG_ADAPTIVE_BLOCKS (1<<10)         /**< 1 to end blocks early where the data changes between compressible and incompressible runs, storing incompressible runs without searching for matches, 0 for fixed-size blocks (modern lz4 frame format only) */
+#define LZ4ULTRA_FLAG_VERIFY         (1<<11)          /**< 1 to decompress each block right after compressing it and compare it with the input data, failing with LZ4ULTRA_ERROR_VERIFY if they differ (streaming compression only) */
+#define LZ4ULTRA_FLAG_DEDUP          (1<<12)          /**< 1 to leave ranges that repeat earlier data at any distance out of the compressed frame, listing them in a deduplication index that only lz4ultra restores, 0 for none (compression of regular files, modern lz4 frame format only) */
+#define LZ4ULTRA_FLAG_RAW_TABLE      (1<<13)          /**< 1 to emit any number of independent raw blocks behind a table of where each one ends, storing blocks that don't compress as is, instead of a frame (data is compressed and decompressed in memory, without a dictionary) */
+
+/* Compression levels */
+#define LZ4ULTRA_MIN_LEVEL           1                /**< fastest compression level, using a hash chain match finder and greedy parsing */
+#define LZ4ULTRA_MAX_LEVEL           10               /**< best compression level, using a suffix array match finder and the optimal parser (default) */
+
+/* Weight of the modeled decompression time, see lz4ultra_ctx_set_decode_cost() */
+#define LZ4ULTRA_MAX_DECODE_COST     64               /**< largest weight: 64 bits of compressed data per unit of modeled decompression time */
+
+/* Match candidates for each position, see lz4ultra_ctx_set_match_candidates() */
+#define LZ4ULTRA_MAX_MATCH_CANDIDATES 8               /**< largest number of match candidates kept for each position */
+
+/* Opaque types */
+typedef struct _lz4ultra_ctx lz4ultra_ctx;
+typedef struct _lz4ultra_dictionary lz4ultra_dictionary;
+typedef struct _lz4ultra_cstream lz4ultra_cstream;
+typedef struct _lz4ultra_dstream lz4ultra_dstream;
+
+/* Forward declaration */
+typedef struct _lz4ultra_stream_t lz4ultra_stream_t;
+
+/* I/O stream */
+struct _lz4ultra_stream_t {
+   /** Opaque stream-specific pointer */
+   void *obj;
+
+   /**
+    * Read from stream
+    *
+    * @param stream stream
+    * @param ptr buffer to read into
+    * @param size number of bytes to read
+    *
+    * @return number of bytes read
+    */
+   size_t(*read)(lz4ultra_stream_t *stream, void *ptr, size_t size);
+
+   /**
+    * Write to stream
+    *
+    * @param stream stream
+    * @param ptr buffer to write from
+    * @param size number of bytes to write
+    *
+    * @return number of bytes written
+    */
+   size_t(*write)(lz4ultra_stream_t *stream, void *ptr, size_t size);
+
+
+   /**
+    * Check if stream has reached the end of the data
+    *
+    * @param stream stream
+    *
+    * @return nonzero if the end of the data has been reached, 0 if there is more data
+    */
+   int(*eof)(lz4ultra_stream_t *stream);
+
+   /**
+    * Close stream
+    *
+    * @param stream stream
+    */
+   void(*close)(lz4ultra_stream_t *stream);
+};
+
+/** Memory allocator, to take the memory of compression contexts and decompression streams from a pool or an arena instead of the heap */
+typedef struct _lz4ultra_allocator {
+   void *(*alloc_mem)(void *pOpaque, size_t nSize);     /**< allocate nSize bytes, returning NULL for failure */
+   void (*free_mem)(void *pOpaque, void *pPtr);         /**< free memory returned by alloc_mem */
+   void *pOpaque;                                        /**< opaque pointer passed to alloc_mem and free_mem */
+} lz4ultra_allocator;
+
+/** Fault in all the memory of the page allocator when it is mapped, rather than when compression first touches it */
+#define LZ4ULTRA_HUGE_PAGES_PREFAULT (1<<0)
+
+/* Compression phases, timed in the compression statistics */
+#define LZ4ULTRA_PHASE_SUFFIX_SORT     0     /**< sorting the window's suffixes (divsufsort) */
+#define LZ4ULTRA_PHASE_INTERVALS       1     /**< building the PLCP, LCP and LCP intervals */
+#define LZ4ULTRA_PHASE_SKIP_MATCHES    2     /**< walking the history that precedes the block */
+#define LZ4ULTRA_PHASE_FIND_MATCHES    3     /**< finding matches, or hash chain matching and parsing for the fast compression levels */
+#define LZ4ULTRA_PHASE_OPTIMAL_PARSE   4     /**< backward optimal parse */
+#define LZ4ULTRA_PHASE_COMMAND_COUNT   5     /**< reducing the number of commands */
+#define LZ4ULTRA_PHASE_WRITE           6     /**< writing the compressed block */
+#define LZ4ULTRA_NUM_PHASES            7
+
+/** Compression statistics, accumulated by each compression context over the blocks that it compressed */
+typedef struct _lz4ultra_stats {
+   long long phase_time[LZ4ULTRA_NUM_PHASES];   /**< time spent in each phase, in microseconds, only measured when LZ4ULTRA_FLAG_STATS is set */
+   long long num_blocks;                        /**< number of blocks compressed */
+   long long bytes_processed;                   /**< number of input bytes compressed, excluding history */
+   long long matches_found;                     /**< matches found: the longest match at each position with the suffix array, or the matches selected by the hash chain's parser, only counted when LZ4ULTRA_FLAG_STATS is set */
+   long long match_bytes_found;                 /**< total length of the matches found, only counted when LZ4ULTRA_FLAG_STATS is set */
+   long long num_tokens;                        /**< number of tokens (compression commands) emitted */
+   long long literal_bytes;                     /**< number of literal bytes emitted */
+   long long match_bytes;                       /**< number of bytes emitted as matches */
+   long long joined_matches;                    /**< number of matches joined with the match that follows them */
+   long long reduced_matches;                   /**< number of matches replaced by literals, to reduce the number of commands */
+} lz4ultra_stats;
+
+/** One buffer of a batch, compressed with lz4ultra_compress_batch() */
+typedef struct {
+   const unsigned char *pInputData;    /**< pointer to input(source) data to compress */
+   size_t nInputSize;                  /**< input(source) size in bytes */
+   unsigned char *pOutBuffer;          /**< buffer for compressed data */
+   size_t nMaxOutBufferSize;           /**< maximum capacity of compression buffer */
+   size_t nCompressedSize;             /**< returned actual compressed size, or -1 for error */
+} lz4ultra_batch_buffer;
+
+/*-------------- Compression contexts -------------- */
+
+/**
+ * Create reusable compression context. Memory is only allocated when compressing, for the block size that is actually used, and
+ * is then kept for subsequent calls.
+ *
+ * @param nThreads number of threads to compress with (1 for single-threaded compression)
+ *
+ * @return compression context, or NULL for failure
+ */
+LZ4ULTRA_API lz4ultra_ctx *lz4ultra_ctx_create(int nThreads);
+
+/**
+ * Reset reusable compression context before compressing unrelated data, keeping all allocated memory
+ *
+ * @param pCtx compression context
+ */
+LZ4ULTRA_API void lz4ultra_ctx_reset(lz4ultra_ctx *pCtx);
+
+/**
+ * Free up reusable compression context and all associated resources
+ *
+ * @param pCtx compression context, or NULL for none
+ */
+LZ4ULTRA_API void lz4ultra_ctx_destroy(lz4ultra_ctx *pCtx);
+
+/**
+ * Set the allocator that a reusable compression context takes its memory from, instead of malloc(), for instance to use a pool of huge pages, or
+ * memory that is local to the NUMA node of each thread. It must be set before the memory is allocated, that is before compressing. The context
+ * itself is still allocated with malloc() by lz4ultra_ctx_create()
+ *
+ * @param pCtx compression context
+ * @param nThread index of the thread whose compression context and streaming output buffer are taken from the allocator, or -1 for all the
+ *                threads, and for the input window and the state of each compression call, that are shared by the threads
+ * @param pAllocator allocator, that is copied, or NULL to use malloc()
+ *
+ * @return 0 for success, non-zero for failure (invalid thread, or memory already allocated)
+ */
+LZ4ULTRA_API int lz4ultra_ctx_set_allocator(lz4ultra_ctx *pCtx, const int nThread, const lz4ultra_allocator *pAllocator);
+
+/**
+ * Set the weight of the modeled decompression time in the optimal parse of the best compression level: instead of the smallest output, the parser
+ * then picks the commands that minimize the output size plus the modeled time of each token and of its slow decompression paths
+ *
+ * @param pCtx compression context
+ * @param nDecodeCost bits of compressed data that one unit of modeled decompression time (about a nanosecond) is worth, or 0 to only minimize the size (default)
+ *
+ * @return 0 for success, non-zero for failure
+ */
+LZ4ULTRA_API int lz4ultra_ctx_set_decode_cost(lz4ultra_ctx *pCtx, const int nDecodeCost);
+
+/**
+ * Set the number of match candidates that the best compression level keeps for each position: the longest match, and then shorter matches
+ * with closer offsets, that the optimal parser also considers. More candidates use more memory and compress more slowly
+ *
+ * @param pCtx compression context
+ * @param nMatchCandidates number of match candidates (1..LZ4ULTRA_MAX_MATCH_CANDIDATES, 1 to only keep the longest match, default)
+ *
+ * @return 0 for success, non-zero for failure
+ */
+LZ4ULTRA_API int lz4ultra_ctx_set_match_candidates(lz4ultra_ctx *pCtx, const int nMatchCandidates);
+
+/**
+ * Get the total amount of memory allocated by a reusable compression context
+ *
+ * @param pCtx compression context
+ *
+ * @return size in bytes
+ */
+LZ4ULTRA_API size_t lz4ultra_ctx_get_memory_size(lz4ultra_ctx *pCtx);
+
+/**
+ * Get the total number of compression commands issued in compressed data blocks by all the threads of a compression context
+ *
+ * @param pCtx compression context
+ *
+ * @return number of commands
+ */
+LZ4ULTRA_API int lz4ultra_ctx_get_command_count(lz4ultra_ctx *pCtx);
+
+/**
+ * Get the compression statistics of all the threads of a compression context, accumulated since the context was last reset
+ *
+ * @param pCtx compression context
+ * @param pStats pointer to returned statistics
+ */
+LZ4ULTRA_API void lz4ultra_ctx_get_stats(lz4ultra_ctx *pCtx, lz4ultra_stats *pStats);
+
+/**
+ * Get an allocator that maps the large arrays of compression contexts with huge pages, where the system provides them, to cut the TLB misses of the
+ * match finder's random accesses. Explicit huge pages are used when some are reserved, and transparent huge pages otherwise; allocations fall back
+ * to regular pages when neither is available
+ *
+ * @param pAllocator returned allocator, to pass to lz4ultra_ctx_set_allocator()
+ * @param nHugePageFlags LZ4ULTRA_HUGE_PAGES_xxx flags
+ *
+ * @return 1 if huge pages are available, 0 if the allocator only maps regular pages
+ */
+LZ4ULTRA_API int lz4ultra_get_huge_page_allocator(lz4ultra_allocator *pAllocator, const unsigned int nHugePageFlags);
+
+/*-------------- Dictionaries -------------- */
+
+/**
+ * Load dictionary contents
+ *
+ * @param pszDictionaryFilename name of dictionary file, or NULL for none
+ * @param ppDictionaryData pointer to returned dictionary contents, or NULL for none
+ * @param pDictionaryDataSize pointer to returned size of dictionary contents, or 0
+ *
+ * @return LZSA_OK for success, or an error value from lz4ultra_status_t
+ */
+LZ4ULTRA_API int lz4ultra_dictionary_load(const char *pszDictionaryFilename, void **ppDictionaryData, int *pDictionaryDataSize);
+
+/**
+ * Free dictionary contents
+ *
+ * @param ppDictionaryData pointer to pointer to dictionary contents
+ */
+LZ4ULTRA_API void lz4ultra_dictionary_free(void **ppDictionaryData);
+
+/**
+ * Prepare dictionary contents for compression. The dictionary's suffixes are sorted once, and the suffixes of each block that is compressed
+ * with the dictionary are then merged in, instead of sorting the dictionary along with every block
+ *
+ * @param pDictionaryData dictionary contents, as returned by lz4ultra_dictionary_load(), that are copied and don't need to be kept
+ * @param nDictionaryDataSize size of dictionary contents
+ *
+ * @return prepared dictionary, or NULL for failure
+ */
+LZ4ULTRA_API lz4ultra_dictionary *lz4ultra_dictionary_prepare(const void *pDictionaryData, const int nDictionaryDataSize);
+
+/**
+ * Build a dictionary from samples of the data that it will be used to compress. The sorted suffixes of all the samples give the number of samples
+ * that each substring of TRAIN_DMER_SIZE bytes appears in; the segments of the samples with the most frequent substrings, that aren't in the
+ * dictionary yet, are then added until it is full, the first ones last so that they stay in reach for longest
+ *
+ * @param ppSamples pointers to the contents of each sample
+ * @param pSampleSizes size of each sample, in bytes
+ * @param nNumSamples number of samples
+ * @param pDictionaryData pointer to returned dictionary contents
+ * @param nMaxDictionarySize size of the buffer for the dictionary contents, in bytes (only up to HISTORY_SIZE is used)
+ *
+ * @return size of the dictionary contents, or -1 for failure
+ */
+LZ4ULTRA_API int lz4ultra_dictionary_train(const unsigned char * const *ppSamples, const size_t *pSampleSizes, const int nNumSamples, void *pDictionaryData, int nMaxDictionarySize);
+
+/**
+ * Free up prepared dictionary
+ *
+ * @param pDictionary prepared dictionary, or NULL for none
+ */
+LZ4ULTRA_API void lz4ultra_dictionary_destroy(lz4ultra_dictionary *pDictionary);
+
+/*-------------- Streams -------------- */
+
+/**
+ * Open file and create an I/O stream from it. A filename that lz4ultra_filestream_is_stdio() accepts opens the standard input when reading,
+ * and the standard output when writing, in binary mode
+ *
+ * @param stream stream to fill out
+ * @param pszInFilename filename
+ * @param pszMode open mode, as with fopen()
+ *
+ * @return 0 for success, nonzero for failure
+ */
+LZ4ULTRA_API int lz4ultra_filestream_open(lz4ultra_stream_t *stream, const char *pszInFilename, const char *pszMode);
+
+/*-------------- In-memory compression -------------- */
+
+/**
+ * Get maximum compressed size of input(source) data
+ *
+ * @param nInputSize input(source) size in bytes
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
+ * @param nBlockMaxCode maximum block size code (4..7 for 64 Kb..4 Mb)
+ *
+ * @return maximum compressed size
+ */
+LZ4ULTRA_API size_t lz4ultra_get_max_compressed_size_inmem(size_t nInputSize, unsigned int nFlags,
+   int nBlockMaxCode);
+
+/**
+ * Compress memory
+ *
+ * @param pInputData pointer to input(source) data to compress
+ * @param pOutBuffer buffer for compressed data
+ * @param nInputSize input(source) size in bytes
+ * @param nMaxOutBufferSize maximum capacity of compression buffer
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
+ * @param nBlockMaxCode maximum block size code (4..7 for 64 Kb..4 Mb)
+ * @param nCompressionLevel compression level (LZ4ULTRA_MIN_LEVEL..LZ4ULTRA_MAX_LEVEL, LZ4ULTRA_MAX_LEVEL for the best ratio)
+ *
+ * @return actual compressed size, or -1 for error
+ */
+LZ4ULTRA_API size_t lz4ultra_compress_inmem(const unsigned char *pInputData, unsigned char *pOutBuffer, size_t nInputSize, size_t nMaxOutBufferSize, unsigned int nFlags,
+   int nBlockMaxCode, int nCompressionLevel);
+
+/**
+ * Compress memory, using a reusable compression context
+ *
+ * @param pCtx compression context
+ * @param pInputData pointer to input(source) data to compress
+ * @param pOutBuffer buffer for compressed data
+ * @param nInputSize input(source) size in bytes
+ * @param nMaxOutBufferSize maximum capacity of compression buffer
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
+ * @param nBlockMaxCode maximum block size code (4..7 for 64 Kb..4 Mb)
+ * @param nCompressionLevel compression level (LZ4ULTRA_MIN_LEVEL..LZ4ULTRA_MAX_LEVEL, LZ4ULTRA_MAX_LEVEL for the best ratio)
+ *
+ * @return actual compressed size, or -1 for error
+ */
+LZ4ULTRA_API size_t lz4ultra_compress_inmem_ctx(lz4ultra_ctx *pCtx, const unsigned char *pInputData, unsigned char *pOutBuffer, size_t nInputSize, size_t nMaxOutBufferSize, unsigned int nFlags,
+   int nBlockMaxCode, int nCompressionLevel);
+
+/**
+ * Compress a batch of independent buffers, each into its own frame, sharing one compression context that is prepared once for the largest buffer.
+ * When the context was created with several threads, the buffers are compressed in parallel, one per thread at a time
+ *
+ * @param pCtx compression context, or NULL to create a single-threaded one for this batch
+ * @param pBuffers buffers to compress, whose nCompressedSize is set to the actual compressed size, or to -1 for error
+ * @param nBuffers number of buffers to compress
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
+ * @param nBlockMaxCode maximum block size code (4..7 for 64 Kb..4 Mb)
+ * @param nCompressionLevel compression level (LZ4ULTRA_MIN_LEVEL..LZ4ULTRA_MAX_LEVEL, LZ4ULTRA_MAX_LEVEL for the best ratio)
+ *
+ * @return number of buffers that couldn't be compressed (0 for success), or -1 if the compression context couldn't be prepared
+ */
+LZ4ULTRA_API int lz4ultra_compress_batch(lz4ultra_ctx *pCtx, lz4ultra_batch_buffer *pBuffers, int nBuffers, unsigned int nFlags, int nBlockMaxCode, int nCompressionLevel);
+
+/*-------------- File and stream compression -------------- */
+
+/**
+ * Compress file
+ *
+ * @param pszInFilename name of input(source) file to compress
+ * @param pszOutFilename name of output(compressed) file to generate
+ * @param pszDictionaryFilename name of dictionary file, or NULL for none
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
+ * @param nBlockMaxCode maximum block size code (4..7 for 64 Kb..4 Mb)
+ * @param nCompressionLevel compression level (LZ4ULTRA_MIN_LEVEL..LZ4ULTRA_MAX_LEVEL, LZ4ULTRA_MAX_LEVEL for the best ratio)
+ * @param nThreads number of threads to compress blocks with (1 for single-threaded compression)
+ * @param start start function, called when the max block size is finalized and compression is about to start, or NULL for none
+ * @param progress progress function, called after compressing each block, or NULL for none
+ * @param pOriginalSize pointer to returned input(source) size, updated when this function is successful
+ * @param pCompressedSize pointer to returned output(compressed) size, updated when this function is successful
+ * @param pCommandCount pointer to returned token(compression commands) count, updated when this function is successful
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+LZ4ULTRA_API lz4ultra_status_t lz4ultra_compress_file(const char *pszInFilename, const char *pszOutFilename, const char *pszDictionaryFilename, const unsigned int nFlags,
+   int nBlockMaxCode, int nCompressionLevel, int nThreads,
+   void(*start)(int nBlockMaxCode, const unsigned int nFlags),
+   void(*progress)(long long nOriginalSize, long long nCompressedSize), long long *pOriginalSize, long long *pCompressedSize, int *pCommandCount);
+
+/**
+ * Compress file, using a reusable compression context
+ *
+ * @param pCtx compression context, that also selects the number of threads to compress blocks with
+ * @param pszInFilename name of input(source) file to compress
+ * @param pszOutFilename name of output(compressed) file to generate
+ * @param pszDictionaryFilename name of dictionary file, or NULL for none
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
+ * @param nBlockMaxCode maximum block size code (4..7 for 64 Kb..4 Mb)
+ * @param nCompressionLevel compression level (LZ4ULTRA_MIN_LEVEL..LZ4ULTRA_MAX_LEVEL, LZ4ULTRA_MAX_LEVEL for the best ratio)
+ * @param start start function, called when the max block size is finalized and compression is about to start, or NULL for none
+ * @param progress progress function, called after compressing each block, or NULL for none
+ * @param pOriginalSize pointer to returned input(source) size, updated when this function is successful
+ * @param pCompressedSize pointer to returned output(compressed) size, updated when this function is successful
+ * @param pCommandCount pointer to returned token(compression commands) count, updated when this function is successful
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+LZ4ULTRA_API lz4ultra_status_t lz4ultra_compress_file_ctx(lz4ultra_ctx *pCtx, const char *pszInFilename, const char *pszOutFilename, const char *pszDictionaryFilename, const unsigned int nFlags,
+   int nBlockMaxCode, int nCompressionLevel,
+   void(*start)(int nBlockMaxCode, const unsigned int nFlags),
+   void(*progress)(long long nOriginalSize, long long nCompressedSize), long long *pOriginalSize, long long *pCompressedSize, int *pCommandCount);
+
+/**
+ * Compress file and append it to an existing compressed file, using a reusable compression context. The blocks are added to the file's frame,
+ * overwriting its end, and are compressed with its block size and flags, after the last HISTORY_SIZE bytes of its decompressed data when its
+ * blocks are linked. Linked blocks, and frames that end with a checksum, are decompressed to find those bytes and the checksum. The frame must
+ * end the file, which rules out a seek table, a deduplication index or legacy frames. If appending fails, the compressed file is left without
+ * the end of its frame
+ *
+ * @param pCtx compression context, that also selects the number of threads to compress blocks with
+ * @param pszInFilename name of input(source) file to compress
+ * @param pszOutFilename name of existing output(compressed) file to append to
+ * @param pszDictionaryFilename name of dictionary file that the compressed file was created with, or NULL for none
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx), except the ones that select the frame format, taken from the compressed file
+ * @param nCompressionLevel compression level (LZ4ULTRA_MIN_LEVEL..LZ4ULTRA_MAX_LEVEL, LZ4ULTRA_MAX_LEVEL for the best ratio)
+ * @param start start function, called when the max block size is finalized and compression is about to start, or NULL for none
+ * @param progress progress function, called after compressing each block, or NULL for none
+ * @param pOriginalSize pointer to returned input(source) size, updated when this function is successful
+ * @param pCompressedSize pointer to returned number of bytes written to the output, from the end of the frame that was overwritten, updated when
+ *                        this function is successful
+ * @param pCommandCount pointer to returned token(compression commands) count, updated when this function is successful
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+LZ4ULTRA_API lz4ultra_status_t lz4ultra_append_file_ctx(lz4ultra_ctx *pCtx, const char *pszInFilename, const char *pszOutFilename, const char *pszDictionaryFilename,
+   const unsigned int nFlags, int nCompressionLevel,
+   void(*start)(int nBlockMaxCode, const unsigned int nFlags),
+   void(*progress)(long long nOriginalSize, long long nCompressedSize), long long *pOriginalSize, long long *pCompressedSize, int *pCommandCount);
+
+/**
+ * Compress file and append it to an existing compressed file, see lz4ultra_append_file_ctx()
+ *
+ * @param pszInFilename name of input(source) file to compress
+ * @param pszOutFilename name of existing output(compressed) file to append to
+ * @param pszDictionaryFilename name of dictionary file that the compressed file was created with, or NULL for none
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx), except the ones that select the frame format, taken from the compressed file
+ * @param nCompressionLevel compression level (LZ4ULTRA_MIN_LEVEL..LZ4ULTRA_MAX_LEVEL, LZ4ULTRA_MAX_LEVEL for the best ratio)
+ * @param nThreads number of threads to compress blocks with (1 for single-threaded compression)
+ * @param start start function, called when the max block size is finalized and compression is about to start, or NULL for none
+ * @param progress progress function, called after compressing each block, or NULL for none
+ * @param pOriginalSize pointer to returned input(source) size, updated when this function is successful
+ * @param pCompressedSize pointer to returned number of bytes written to the output, from the end of the frame that was overwritten, updated when
+ *                        this function is successful
+ * @param pCommandCount pointer to returned token(compression commands) count, updated when this function is successful
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+LZ4ULTRA_API lz4ultra_status_t lz4ultra_append_file(const char *pszInFilename, const char *pszOutFilename, const char *pszDictionaryFilename,
+   const unsigned int nFlags, int nCompressionLevel, int nThreads,
+   void(*start)(int nBlockMaxCode, const unsigned int nFlags),
+   void(*progress)(long long nOriginalSize, long long nCompressedSize), long long *pOriginalSize, long long *pCompressedSize, int *pCommandCount);
+
+/**
+ * Compress stream
+ *
+ * @param pInStream input(source) stream to compress
+ * @param pOutStream output(compressed) stream to write to
+ * @param pDictionaryData dictionary contents, or NULL for none
+ * @param nDictionaryDataSize size of dictionary contents, or 0
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
+ * @param nBlockMaxCode maximum block size code (4..7 for 64 Kb..4 Mb)
+ * @param nCompressionLevel compression level (LZ4ULTRA_MIN_LEVEL..LZ4ULTRA_MAX_LEVEL, LZ4ULTRA_MAX_LEVEL for the best ratio)
+ * @param nThreads number of threads to compress blocks with (1 for single-threaded compression)
+ * @param start start function, called when the max block size is finalized and compression is about to start, or NULL for none
+ * @param progress progress function, called after compressing each block, or NULL for none
+ * @param pOriginalSize pointer to returned input(source) size, updated when this function is successful
+ * @param pCompressedSize pointer to returned output(compressed) size, updated when this function is successful
+ * @param pCommandCount pointer to returned token(compression commands) count, updated when this function is successful
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+LZ4ULTRA_API lz4ultra_status_t lz4ultra_compress_stream(lz4ultra_stream_t *pInStream, lz4ultra_stream_t *pOutStream, const void *pDictionaryData, int nDictionaryDataSize, unsigned int nFlags,
+   int nBlockMaxCode, int nCompressionLevel, int nThreads,
+   void(*start)(int nBlockMaxCode, const unsigned int nFlags),
+   void(*progress)(long long nOriginalSize, long long nCompressedSize), long long *pOriginalSize, long long *pCompressedSize, int *pCommandCount);
+
+/**
+ * Get the amount of memory that a reusable compression context allocates for compressing a stream, with its number of threads and of match
+ * candidates, when the data to compress is larger than the maximum block size
+ *
+ * @param pCtx compression context
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
+ * @param nBlockMaxCode maximum block size code (4..7 for 64 Kb..4 Mb)
+ * @param nCompressionLevel compression level (LZ4ULTRA_MIN_LEVEL..LZ4ULTRA_MAX_LEVEL, LZ4ULTRA_MAX_LEVEL for the best ratio)
+ * @param nDictionaryDataSize size of dictionary contents, or 0
+ *
+ * @return size in bytes
+ */
+LZ4ULTRA_API size_t lz4ultra_ctx_get_stream_memory_size(lz4ultra_ctx *pCtx, const unsigned int nFlags, const int nBlockMaxCode, int nCompressionLevel, const int nDictionaryDataSize);
+
+/**
+ * Get the largest maximum block size code, up to the requested one, that compressing a stream with a reusable compression context fits in a
+ * memory budget with. Windows of up to COMPACT_INTERVALS_MAX_WINDOW_SIZE bytes, that is 64 and 256 Kb blocks, also use the match finder's
+ * 32-bit layout, that takes half the memory
+ *
+ * @param pCtx compression context
+ * @param nMaxMemorySize memory budget, in bytes
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
+ * @param nBlockMaxCode largest maximum block size code to return (4..7 for 64 Kb..4 Mb)
+ * @param nCompressionLevel compression level (LZ4ULTRA_MIN_LEVEL..LZ4ULTRA_MAX_LEVEL, LZ4ULTRA_MAX_LEVEL for the best ratio)
+ * @param nDictionaryDataSize size of dictionary contents, or 0
+ *
+ * @return maximum block size code (4..7), or -1 if the budget is too small for 64 Kb blocks or for legacy frames
+ */
+LZ4ULTRA_API int lz4ultra_ctx_get_block_max_code_for_memory(lz4ultra_ctx *pCtx, const size_t nMaxMemorySize, const unsigned int nFlags, int nBlockMaxCode, const int nCompressionLevel,
+                                                const int nDictionaryDataSize);
+
+/**
+ * Compress stream, using a reusable compression context
+ *
+ * @param pCtx compression context, that also selects the number of threads to compress blocks with
+ * @param pInStream input(source) stream to compress
+ * @param pOutStream output(compressed) stream to write to
+ * @param pDictionaryData dictionary contents, or NULL for none
+ * @param nDictionaryDataSize size of dictionary contents, or 0
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
+ * @param nBlockMaxCode maximum block size code (4..7 for 64 Kb..4 Mb)
+ * @param nCompressionLevel compression level (LZ4ULTRA_MIN_LEVEL..LZ4ULTRA_MAX_LEVEL, LZ4ULTRA_MAX_LEVEL for the best ratio)
+ * @param start start function, called when the max block size is finalized and compression is about to start, or NULL for none
+ * @param progress progress function, called after compressing each block, or NULL for none
+ * @param pOriginalSize pointer to returned input(source) size, updated when this function is successful
+ * @param pCompressedSize pointer to returned output(compressed) size, updated when this function is successful
+ * @param pCommandCount pointer to returned token(compression commands) count, updated when this function is successful
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+LZ4ULTRA_API lz4ultra_status_t lz4ultra_compress_stream_ctx(lz4ultra_ctx *pCtx, lz4ultra_stream_t *pInStream, lz4ultra_stream_t *pOutStream, const void *pDictionaryData, int nDictionaryDataSize, unsigned int nFlags,
+   int nBlockMaxCode, int nCompressionLevel,
+   void(*start)(int nBlockMaxCode, const unsigned int nFlags),
+   void(*progress)(long long nOriginalSize, long long nCompressedSize), long long *pOriginalSize, long long *pCompressedSize, int *pCommandCount);
+
+/**
+ * Compress stream with a prepared dictionary, using a reusable compression context. Each block that starts with the dictionary, that is every
+ * block with LZ4ULTRA_FLAG_INDEP_BLOCKS, then only needs its own suffixes sorted when it is small compared to the dictionary
+ *
+ * @param pCtx compression context, that also selects the number of threads to compress blocks with
+ * @param pInStream input(source) stream to compress
+ * @param pOutStream output(compressed) stream to write to
+ * @param pDictionary prepared dictionary, or NULL for none
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
+ * @param nBlockMaxCode maximum block size code (4..7 for 64 Kb..4 Mb)
+ * @param nCompressionLevel compression level (LZ4ULTRA_MIN_LEVEL..LZ4ULTRA_MAX_LEVEL, LZ4ULTRA_MAX_LEVEL for the best ratio)
+ * @param start start function, called when the max block size is finalized and compression is about to start, or NULL for none
+ * @param progress progress function, called after compressing each block, or NULL for none
+ * @param pOriginalSize pointer to returned input(source) size, updated when this function is successful
+ * @param pCompressedSize pointer to returned output(compressed) size, updated when this function is successful
+ * @param pCommandCount pointer to returned token(compression commands) count, updated when this function is successful
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+LZ4ULTRA_API lz4ultra_status_t lz4ultra_compress_stream_dict(lz4ultra_ctx *pCtx, lz4ultra_stream_t *pInStream, lz4ultra_stream_t *pOutStream, const lz4ultra_dictionary *pDictionary, unsigned int nFlags,
+   int nBlockMaxCode, int nCompressionLevel,
+   void(*start)(int nBlockMaxCode, const unsigned int nFlags),
+   void(*progress)(long long nOriginalSize, long long nCompressedSize), long long *pOriginalSize, long long *pCompressedSize, int *pCommandCount);
+
+/**
+ * Create a compression stream, that input data is pushed into with lz4ultra_cstream_update(), and that writes a frame of compressed blocks to an
+ * output stream: one block whenever the maximum block size worth of data was pushed, and one block with the pending data on each
+ * lz4ultra_cstream_flush(). Blocks are compressed in the calling thread, one at a time
+ *
+ * @param pCtx compression context, or NULL to create a single-threaded one for this stream
+ * @param pOutStream output(compressed) stream to write to
+ * @param pDictionaryData dictionary contents, that must stay valid until the stream is ended, or NULL for none
+ * @param nDictionaryDataSize size of dictionary contents (up to HISTORY_SIZE), or 0
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx), LZ4ULTRA_FLAG_RAW_BLOCK, LZ4ULTRA_FLAG_RAW_TABLE and LZ4ULTRA_FLAG_LEGACY_FRAMES aren't
+ *               supported, and LZ4ULTRA_FLAG_CONTENT_SIZE is ignored as the size isn't known upfront
+ * @param nBlockMaxCode maximum block size code (4..7 for 64 Kb..4 Mb)
+ * @param nCompressionLevel compression level (LZ4ULTRA_MIN_LEVEL..LZ4ULTRA_MAX_LEVEL, LZ4ULTRA_MAX_LEVEL for the best ratio)
+ *
+ * @return compression stream, or NULL for failure
+ */
+LZ4ULTRA_API lz4ultra_cstream *lz4ultra_cstream_create(lz4ultra_ctx *pCtx, lz4ultra_stream_t *pOutStream, const void *pDictionaryData, int nDictionaryDataSize, unsigned int nFlags,
+   int nBlockMaxCode, int nCompressionLevel);
+
+/**
+ * Push input data into a compression stream. Each time the maximum block size worth of data is pending, it is compressed and written out
+ *
+ * @param pStream compression stream
+ * @param pData input data to compress
+ * @param nDataSize size of input data, in bytes
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+LZ4ULTRA_API lz4ultra_status_t lz4ultra_cstream_update(lz4ultra_cstream *pStream, const void *pData, size_t nDataSize);
+
+/**
+ * Compress all the pending input data of a compression stream as one block, and write it out before returning, so that the output stream holds
+ * everything that was pushed so far. The following blocks still reference the data as history
+ *
+ * @param pStream compression stream
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+LZ4ULTRA_API lz4ultra_status_t lz4ultra_cstream_flush(lz4ultra_cstream *pStream);
+
+/**
+ * End a compression stream: flush the pending input data, write the end of the frame, and free the stream. The stream can't be used afterwards,
+ * even if an error is returned
+ *
+ * @param pStream compression stream
+ * @param pOriginalSize pointer to returned input(source) size, updated when this function is successful, or NULL
+ * @param pCompressedSize pointer to returned output(compressed) size, updated when this function is successful, or NULL
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+LZ4ULTRA_API lz4ultra_status_t lz4ultra_cstream_end(lz4ultra_cstream *pStream, long long *pOriginalSize, long long *pCompressedSize);
+
+/*-------------- Decompression -------------- */
+
+/**
+ * Decompress one data block
+ *
+ * @param pInBlock pointer to compressed data
+ * @param nBlockSize size of compressed data, in bytes
+ * @param pOutData pointer to output decompression buffer (previously decompressed bytes + room for decompressing this block)
+ * @param nOutDataOffset starting index of where to store decompressed bytes in output buffer (and size of previously decompressed bytes)
+ * @param nBlockMaxSize room for decompressing this block in output buffer, after nOutDataOffset, in bytes
+ *
+ * @return size of decompressed data in bytes, or -1 for error
+ */
+LZ4ULTRA_API int lz4ultra_decompressor_expand_block(const unsigned char *pInBlock, int nBlockSize, unsigned char *pOutData, int nOutDataOffset, int nBlockMaxSize);
+
+/**
+ * Get the number of blocks in a raw block table, and its decompressed size
+ *
+ * @param pInData pointer to raw block table (LZ4ULTRA_FLAG_RAW_TABLE)
+ * @param nInDataSize size of raw block table, in bytes
+ * @param pDecompressedSize pointer to returned decompressed size, in bytes
+ *
+ * @return number of blocks, or -1 if the table isn't valid
+ */
+LZ4ULTRA_API int lz4ultra_decompressor_get_raw_table_info(const unsigned char *pInData, size_t nInDataSize, size_t *pDecompressedSize);
+
+/**
+ * Decompress one block of a raw block table to its place in the output buffer. Blocks are independent and can be decompressed in any order.
+ *
+ * @param pInData pointer to raw block table (LZ4ULTRA_FLAG_RAW_TABLE)
+ * @param nInDataSize size of raw block table, in bytes
+ * @param nBlockIndex index of block to decompress
+ * @param pOutData pointer to output decompression buffer, for all the blocks
+ * @param nMaxOutDataSize size of output decompression buffer, in bytes
+ *
+ * @return size of decompressed block in bytes, or -1 for error
+ */
+LZ4ULTRA_API int lz4ultra_decompressor_expand_raw_table_block(const unsigned char *pInData, size_t nInDataSize, int nBlockIndex, unsigned char *pOutData, size_t nMaxOutDataSize);
+
+/**
+ * Decompress all the blocks of a raw block table, one after the other
+ *
+ * @param pInData pointer to raw block table (LZ4ULTRA_FLAG_RAW_TABLE)
+ * @param nInDataSize size of raw block table, in bytes
+ * @param pOutData pointer to output decompression buffer
+ * @param nMaxOutDataSize size of output decompression buffer, in bytes
+ *
+ * @return size of decompressed data in bytes, or -1 for error
+ */
+LZ4ULTRA_API size_t lz4ultra_decompressor_expand_raw_table(const unsigned char *pInData, size_t nInDataSize, unsigned char *pOutData, size_t nMaxOutDataSize);
+
+/**
+ * Get maximum decompressed size of compressed data
+ *
+ * @param pFileData compressed data
+ * @param nFileSize compressed size in bytes
+ *
+ * @return maximum decompressed size, which is the exact size when the headers store it
+ */
+LZ4ULTRA_API size_t lz4ultra_inmem_get_max_decompressed_size(const unsigned char *pFileData, size_t nFileSize);
+
+/**
+ * Decompress data in memory. The data can hold several concatenated frames, which are decompressed one after the other; skippable frames
+ * are skipped.
+ *
+ * @param pFileData compressed data
+ * @param pOutBuffer buffer for decompressed data
+ * @param nFileSize compressed size in bytes
+ * @param nMaxOutBufferSize maximum capacity of decompression buffer
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
+ * @param nThreads number of threads to decompress independent blocks with (1 for single-threaded decompression)
+ *
+ * @return actual decompressed size, or -1 for error
+ */
+LZ4ULTRA_API size_t lz4ultra_decompress_inmem(const unsigned char *pFileData, unsigned char *pOutBuffer, size_t nFileSize, size_t nMaxOutBufferSize, unsigned int nFlags, int nThreads);
+
+/**
+ * Decompress file
+ *
+ * @param pszInFilename name of input(compressed) file to decompress
+ * @param pszOutFilename name of output(decompressed) file to generate
+ * @param pszDictionaryFilename name of dictionary file, or NULL for none
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_RAW_BLOCK to decompress a raw block, LZ4ULTRA_FLAG_RAW_TABLE to decompress a raw block table, LZ4ULTRA_FLAG_ASYNC_IO to read ahead and write behind on background threads, or 0)
+ * @param nThreads number of threads to decompress independent blocks with (1 for single-threaded decompression)
+ * @param pOriginalSize pointer to returned output(decompressed) size, updated when this function is successful
+ * @param pCompressedSize pointer to returned input(compressed) size, updated when this function is successful
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+LZ4ULTRA_API lz4ultra_status_t lz4ultra_decompress_file(const char *pszInFilename, const char *pszOutFilename, const char *pszDictionaryFilename, const unsigned int nFlags, int nThreads,
+   long long *pOriginalSize, long long *pCompressedSize);
+
+/**
+ * Decompress a range of bytes out of a file compressed with independent blocks and a seek table, only decompressing the blocks that the range covers
+ *
+ * @param pszInFilename name of input(compressed) file to decompress
+ * @param pszOutFilename name of output(decompressed) file to generate, that receives the decompressed bytes of the range
+ * @param pszDictionaryFilename name of dictionary file, or NULL for none
+ * @param nRangeOffset offset of the first decompressed byte of the range
+ * @param nRangeSize number of decompressed bytes in the range, which is clipped to the end of the decompressed data
+ * @param pOriginalSize pointer to returned number of decompressed bytes written, updated when this function is successful
+ * @param pCompressedSize pointer to returned number of compressed bytes that were decompressed, updated when this function is successful
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+LZ4ULTRA_API lz4ultra_status_t lz4ultra_decompress_range(const char *pszInFilename, const char *pszOutFilename, const char *pszDictionaryFilename, long long nRangeOffset, long long nRangeSize,
+   long long *pOriginalSize, long long *pCompressedSize);
+
+/**
+ * Decompress stream
+ *
+ * @param pInStream input(compressed) stream to decompress
+ * @param pOutStream output(decompressed) stream to write to
+ * @param pDictionaryData dictionary contents, or NULL for none
+ * @param nDictionaryDataSize size of dictionary contents, or 0
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_RAW_BLOCK to decompress a raw block, LZ4ULTRA_FLAG_RAW_TABLE to decompress a raw block table, LZ4ULTRA_FLAG_ASYNC_IO to read ahead and write behind on background threads, or 0)
+ * @param nThreads number of threads to decompress independent blocks with (1 for single-threaded decompression)
+ * @param pOriginalSize pointer to returned output(decompressed) size, updated when this function is successful
+ * @param pCompressedSize pointer to returned input(compressed) size, updated when this function is successful
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+LZ4ULTRA_API lz4ultra_status_t lz4ultra_decompress_stream(lz4ultra_stream_t *pInStream, lz4ultra_stream_t *pOutStream, const void *pDictionaryData, int nDictionaryDataSize, unsigned int nFlags, int nThreads,
+   long long *pOriginalSize, long long *pCompressedSize);
+
+/**
+ * Create a decompression stream, that compressed data is pushed into as it arrives, in pieces of any size, with lz4ultra_dstream_decompress().
+ * The input can hold several concatenated frames; skippable frames, such as the seek table, are skipped. Raw blocks and raw block tables aren't supported
+ *
+ * @param pDictionaryData dictionary contents, that must stay valid until the stream is ended, or NULL for none
+ * @param nDictionaryDataSize size of dictionary contents (up to HISTORY_SIZE), or 0
+ * @param pAllocator allocator of the stream and of its buffers, that is copied, or NULL to use malloc()
+ *
+ * @return decompression stream, or NULL for failure
+ */
+LZ4ULTRA_API lz4ultra_dstream *lz4ultra_dstream_create(const void *pDictionaryData, int nDictionaryDataSize, const lz4ultra_allocator *pAllocator);
+
+/**
+ * Decompress data pushed into a decompression stream. This consumes as much input data as possible, until it runs out or until the output buffer is
+ * full; decompressed bytes that don't fit are returned by the next calls, that may push no new input data. Blocks that are entirely contained in the
+ * input data are decompressed straight from it; only blocks that arrive in several pieces are gathered first
+ *
+ * @param pStream decompression stream
+ * @param pInData input(compressed) data, or NULL if pInDataSize points to 0
+ * @param pInDataSize pointer to the number of bytes of input data, set to the number of bytes that were consumed by this function
+ * @param pOutData buffer for output(decompressed) data
+ * @param pOutDataSize pointer to the size of the output buffer, in bytes, set to the number of decompressed bytes written by this function
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+LZ4ULTRA_API lz4ultra_status_t lz4ultra_dstream_decompress(lz4ultra_dstream *pStream, const void *pInData, size_t *pInDataSize, void *pOutData, size_t *pOutDataSize);
+
+/**
+ * End a decompression stream, once all the input data was pushed and all the decompressed data was returned, and free the stream. The stream can't
+ * be used afterwards, even if an error is returned
+ *
+ * @param pStream decompression stream
+ * @param pOriginalSize pointer to returned output(decompressed) size, updated when this function is successful, or NULL
+ * @param pCompressedSize pointer to returned input(compressed) size, updated when this function is successful, or NULL
+ *
+ * @return LZ4ULTRA_OK for success, LZ4ULTRA_ERROR_SRC if the input data stops in the middle of a frame, or an error value from lz4ultra_status_t
+ */
+LZ4ULTRA_API lz4ultra_status_t lz4ultra_dstream_end(lz4ultra_dstream *pStream, long long *pOriginalSize, long long *pCompressedSize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _LZ4ULTRA_H */
@@ -1,287 +1,340 @@
-/*
- * matchfinder.c - LZ match finder implementation
- *
- * The following copying information applies to this specific source code file:
- *
- * Written in 2019 by Emmanuel Marty <marty.emmanuel@gmail.com>
- * Portions written in 2014-2015 by Eric Biggers <ebiggers3@gmail.com>
- *
- * To the extent possible under law, the author(s) have dedicated all copyright
- * and related and neighboring rights to this software to the public domain
- * worldwide via the Creative Commons Zero 1.0 Universal Public Domain
- * Dedication (the "CC0").
- *
- * This software is distributed in the hope that it will be useful, but WITHOUT
- * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
- * FOR A PARTICULAR PURPOSE. See the CC0 for more details.
- *
- * You should have received a copy of the CC0 along with this software; if not
- * see <http://creativecommons.org/publicdomain/zero/1.0/>.
- */
-
-/*
- * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
- *
- * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
- * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
- * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
- * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
- *
- */
-
-#include <stdlib.h>
-#include <string.h>
-#include "lib.h"
-#include "format.h"
-#include "matchfinder.h"
-
-/**
- * Parse input data, build suffix array and overlaid data structures to speed up match finding
- *
- * @param pCompressor compression context
- * @param pInWindow pointer to input data window (previously compressed bytes + bytes to compress)
- * @param nInWindowSize total input size in bytes (previously compressed bytes + bytes to compress)
- *
- * @return 0 for success, non-zero for failure
- */
-int lz4ultra_build_suffix_array(lz4ultra_compressor *pCompressor, const unsigned char *pInWindow, const int nInWindowSize) {
-   unsigned long long *intervals = pCompressor->intervals;
-
-   /* Build suffix array from input data */
-   saidx_t *suffixArray = (saidx_t*)intervals;
-   if (divsufsort_build_array(&pCompressor->divsufsort_context, pInWindow, suffixArray, nInWindowSize) != 0) {
-      return 100;
-   }
-
-   int i;
-
-   for (i = nInWindowSize - 1; i >= 0; i--) {
-      intervals[i] = suffixArray[i];
-   }
-
-   int *PLCP = (int*)pCompressor->pos_data;  /* Use temporarily */
-   int *Phi = PLCP;
-   int nCurLen = 0;
-
-   /* Compute the permuted LCP first (Krkkinen method) */
-   Phi[intervals[0]] = -1;
-   for (i = 1; i < nInWindowSize; i++)
-      Phi[intervals[i]] = (unsigned int)intervals[i - 1];
-   for (i = 0; i < nInWindowSize; i++) {
-      if (Phi[i] == -1) {
-         PLCP[i] = 0;
-         continue;
-      }
-      int nMaxLen = (i > Phi[i]) ? (nInWindowSize - i) : (nInWindowSize - Phi[i]);
-      while (nCurLen < nMaxLen && pInWindow[i + nCurLen] == pInWindow[Phi[i] + nCurLen]) nCurLen++;
-      PLCP[i] = nCurLen;
-      if (nCurLen > 0)
-         nCurLen--;
-   }
-
-   /* Rotate permuted LCP into the LCP. This has better cache locality than the direct Kasai LCP method. This also
-    * saves us from having to build the inverse suffix array index, as the LCP is calculated without it using this method,
-    * and the interval builder below doesn't need it either. */
-   intervals[0] &= POS_MASK;
-   for (i = 1; i < nInWindowSize; i++) {
-      int nIndex = (int)(intervals[i] & POS_MASK);
-      int nLen = PLCP[nIndex];
-      if (nLen < MIN_MATCH_SIZE)
-         nLen = 0;
-      if (nLen > LCP_MAX)
-         nLen = LCP_MAX;
-      intervals[i] = ((unsigned long long)nIndex) | (((unsigned long long)nLen) << LCP_SHIFT);
-   }
-
-   /**
-    * Build intervals for finding matches
-    *
-    * Methodology and code fragment taken from wimlib (CC0 license):
-    * https://wimlib.net/git/?p=wimlib;a=blob_plain;f=src/lcpit_matchfinder.c;h=a2d6a1e0cd95200d1f3a5464d8359d5736b14cbe;hb=HEAD
-    */
-   unsigned long long * const SA_and_LCP = intervals;
-   unsigned long long *pos_data = pCompressor->pos_data;
-   unsigned long long next_interval_idx;
-   unsigned long long *top = pCompressor->open_intervals;
-   unsigned long long prev_pos = SA_and_LCP[0] & POS_MASK;
-
-   *top = 0;
-   intervals[0] = 0;
-   next_interval_idx = 1;
-
-   for (int r = 1; r < nInWindowSize; r++) {
-      const unsigned long long next_pos = SA_and_LCP[r] & POS_MASK;
-      const unsigned long long next_lcp = SA_and_LCP[r] & LCP_MASK;
-      const unsigned long long top_lcp = *top & LCP_MASK;
-
-      if (next_lcp == top_lcp) {
-         /* Continuing the deepest open interval  */
-         pos_data[prev_pos] = *top;
-      }
-      else if (next_lcp > top_lcp) {
-         /* Opening a new interval  */
-         *++top = next_lcp | next_interval_idx++;
-         pos_data[prev_pos] = *top;
-      }
-      else {
-         /* Closing the deepest open interval  */
-         pos_data[prev_pos] = *top;
-         for (;;) {
-            const unsigned long long closed_interval_idx = *top-- & POS_MASK;
-            const unsigned long long superinterval_lcp = *top & LCP_MASK;
-
-            if (next_lcp == superinterval_lcp) {
-               /* Continuing the superinterval */
-               intervals[closed_interval_idx] = *top;
-               break;
-            }
-            else if (next_lcp > superinterval_lcp) {
-               /* Creating a new interval that is a
-                * superinterval of the one being
-                * closed, but still a subinterval of
-                * its superinterval  */
-               *++top = next_lcp | next_interval_idx++;
-               intervals[closed_interval_idx] = *top;
-               break;
-            }
-            else {
-               /* Also closing the superinterval  */
-               intervals[closed_interval_idx] = *top;
-            }
-         }
-      }
-      prev_pos = next_pos;
-   }
-
-   /* Close any still-open intervals.  */
-   pos_data[prev_pos] = *top;
-   for (; top > pCompressor->open_intervals; top--)
-      intervals[*top & POS_MASK] = *(top - 1);
-
-   /* Success */
-   return 0;
-}
-
-/**
- * Find matches at the specified offset in the input window
- *
- * @param pCompressor compression context
- * @param nOffset offset to find matches at, in the input window
- * @param pMatches pointer to returned matches
- * @param nMaxMatches maximum number of matches to return (0 for none)
- *
- * @return number of matches
- */
-static int lz4ultra_find_matches_at(lz4ultra_compressor *pCompressor, const int nOffset, lz4ultra_match *pMatches, const int nMaxMatches) {
-   unsigned long long *intervals = pCompressor->intervals;
-   unsigned long long *pos_data = pCompressor->pos_data;
-   unsigned long long ref;
-   unsigned long long super_ref;
-   unsigned long long match_pos;
-   lz4ultra_match *matchptr;
-
-   /**
-    * Find matches using intervals
-    *
-    * Taken from wimlib (CC0 license):
-    * https://wimlib.net/git/?p=wimlib;a=blob_plain;f=src/lcpit_matchfinder.c;h=a2d6a1e0cd95200d1f3a5464d8359d5736b14cbe;hb=HEAD
-    */
-
-    /* Get the deepest lcp-interval containing the current suffix. */
-   ref = pos_data[nOffset];
-
-   pos_data[nOffset] = 0;
-
-   /* Ascend until we reach a visited interval, the root, or a child of the
-    * root.  Link unvisited intervals to the current suffix as we go.  */
-   while ((super_ref = intervals[ref & POS_MASK]) & LCP_MASK) {
-      intervals[ref & POS_MASK] = nOffset | VISITED_FLAG;
-      ref = super_ref;
-   }
-
-   if (super_ref == 0) {
-      /* In this case, the current interval may be any of:
-       * (1) the root;
-       * (2) an unvisited child of the root */
-
-      if (ref != 0)  /* Not the root?  */
-         intervals[ref & POS_MASK] = nOffset | VISITED_FLAG;
-      return 0;
-   }
-
-   /* Ascend indirectly via pos_data[] links.  */
-   match_pos = super_ref & EXCL_VISITED_MASK;
-   matchptr = pMatches;
-   for (;;) {
-      while ((super_ref = pos_data[match_pos]) > ref)
-         match_pos = intervals[super_ref & POS_MASK] & EXCL_VISITED_MASK;
-      intervals[ref & POS_MASK] = nOffset | VISITED_FLAG;
-      pos_data[match_pos] = (unsigned long long)ref;
-
-      if ((matchptr - pMatches) < nMaxMatches) {
-         int nMatchOffset = (int)(nOffset - match_pos);
-
-         if (nMatchOffset <= MAX_OFFSET) {
-            matchptr->length = (unsigned int)(ref >> LCP_SHIFT);
-            matchptr->offset = (unsigned int)nMatchOffset;
-            matchptr++;
-         }
-      }
-
-      if (super_ref == 0)
-         break;
-      ref = super_ref;
-      match_pos = intervals[ref & POS_MASK] & EXCL_VISITED_MASK;
-   }
-
-   return (int)(matchptr - pMatches);
-}
-
-/**
- * Skip previously compressed bytes
- *
- * @param pCompressor compression context
- * @param nStartOffset current offset in input window (typically 0)
- * @param nEndOffset offset to skip to in input window (typically the number of previously compressed bytes)
- */
-void lz4ultra_skip_matches(lz4ultra_compressor *pCompressor, const int nStartOffset, const int nEndOffset) {
-   lz4ultra_match match;
-   int i;
-
-   /* Skipping still requires scanning for matches, as this also performs a lazy update of the intervals. However,
-    * we don't store the matches. */
-   for (i = nStartOffset; i < nEndOffset; i++) {
-      lz4ultra_find_matches_at(pCompressor, i, &match, 0);
-   }
-}
-
-/**
- * Find all matches for the data to be compressed.
- *
- * @param pCompressor compression context
- * @param nStartOffset current offset in input window (typically the number of previously compressed bytes)
- * @param nEndOffset offset to end finding matches at (typically the size of the total input window in bytes
- */
-void lz4ultra_find_all_matches(lz4ultra_compressor *pCompressor, const int nStartOffset, const int nEndOffset) {
-   lz4ultra_match *pMatch = pCompressor->match + nStartOffset;
-   int i;
-
-   for (i = nStartOffset; i < nEndOffset; i++) {
-      int nMatches = lz4ultra_find_matches_at(pCompressor, i, pMatch, 1);
-
-      if (nMatches == 0 || i > (nEndOffset - LAST_MATCH_OFFSET)) {
-         pMatch->length = 0;
-         pMatch->offset = 0;
-      }
-      else {
-         int nMaxLen = (nEndOffset - LAST_LITERALS) - i;
-         if (nMaxLen < 0)
-            nMaxLen = 0;
-         if (pMatch->length > (unsigned int)nMaxLen)
-            pMatch->length = (unsigned int)nMaxLen;
-      }
-
-      pMatch++;
-   }
-}
-
+/*
+ * matchfinder.c - LZ match finder implementation
+ *
+ * The following copying information applies to this specific source code file:
+ *
+ * Written in 2019 by Emmanuel Marty <marty.emmanuel@gmail.com>
+ * Portions written in 2014-2015 by Eric Biggers <ebiggers3@gmail.com>
+ *
+ * To the extent possible under law, the author(s) have dedicated all copyright
+ * and related and neighboring rights to this software to the public domain
+ * worldwide via the Creative Commons Zero 1.0 Universal Public Domain
+ * Dedication (the "CC0").
+ *
+ * This software is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the CC0 for more details.
+ *
+ * You should have received a copy of the CC0 along with this software; if not
+ * see <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+/*
+ * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
+ *
+ * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
+ * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
+ * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
+ * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "lib.h"
+#include "format.h"
+#include "matchfinder.h"
+#include "matchlen.h"
+
+/* Largest size of data to compress after a prepared dictionary, relative to the dictionary's size, for which merging suffixes is faster than sorting them */
+#define DICTIONARY_MERGE_MAX_DATA_SHIFT 0
+
+/* Number of bytes that may be compared while merging suffixes with a prepared dictionary's, for each byte of the input window */
+#define DICTIONARY_MERGE_COMPARE_FACTOR 64
+
+/* Number of positions ahead of the current one whose deepest LCP interval is prefetched while finding matches */
+#define MATCHFINDER_PREFETCH_DISTANCE 16
+
+#if defined(__GNUC__) || defined(__clang__)
+#define MATCHFINDER_PREFETCH(p) __builtin_prefetch((p), 1)
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#define MATCHFINDER_PREFETCH(p) _mm_prefetch((const char *)(p), _MM_HINT_T0)
+#else
+#define MATCHFINDER_PREFETCH(p) ((void)(p))
+#endif
+
+/* Specialize the match finder for 64-bit LCP intervals, that fit any window */
+#define MF_ENTRY unsigned long long
+#define MF_FUNC(name) name##_64
+#define MF_LCP_MAX LCP_MAX
+#define MF_LCP_SHIFT LCP_SHIFT
+#define MF_LCP_MASK LCP_MASK
+#define MF_POS_MASK POS_MASK
+#define MF_VISITED_FLAG VISITED_FLAG
+#define MF_EXCL_VISITED_MASK EXCL_VISITED_MASK
+#include "matchfinder_impl.h"
+
+/* Specialize the match finder for packed 32-bit LCP intervals, that halve the memory used for small windows */
+#define MF_ENTRY unsigned int
+#define MF_FUNC(name) name##_32
+#define MF_LCP_MAX LCP32_MAX
+#define MF_LCP_SHIFT LCP32_SHIFT
+#define MF_LCP_MASK LCP32_MASK
+#define MF_POS_MASK POS32_MASK
+#define MF_VISITED_FLAG VISITED32_FLAG
+#define MF_EXCL_VISITED_MASK EXCL_VISITED32_MASK
+#include "matchfinder_impl.h"
+
+/**
+ * Compute the permuted LCP of a range of positions, from the position that precedes each of them in the suffix array
+ *
+ * @param PLCP for each position in the range, the position that precedes it in the suffix array (or -1 for none) on entry, and its LCP with it on return
+ * @param pInWindow pointer to input data window
+ * @param nStartOffset offset of the first position in the input window
+ * @param nEndOffset offset of the end of the positions in the input window
+ * @param nInWindowSize total input size in bytes
+ * @param nDictionarySize size of the prepared dictionary at the start of the window, whose suffixes end with it, or 0 for none
+ */
+static void lz4ultra_build_plcp(int *PLCP, const unsigned char *pInWindow, const int nStartOffset, const int nEndOffset, const int nInWindowSize, const int nDictionarySize) {
+   const int *Phi = PLCP;
+   int nCurLen = 0;
+   int i;
+
+   /* Compute the permuted LCP first (Krkkinen method) */
+   for (i = nStartOffset; i < nEndOffset; i++) {
+      if (Phi[i] == -1) {
+         PLCP[i] = 0;
+         continue;
+      }
+      /* The suffixes of a prepared dictionary end with it, so that their order doesn't depend on the data that follows */
+      const int nEnd = (i < nDictionarySize) ? nDictionarySize : nInWindowSize;
+      const int nPrevEnd = (Phi[i] < nDictionarySize) ? nDictionarySize : nInWindowSize;
+      int nMaxLen = ((nEnd - i) < (nPrevEnd - Phi[i])) ? (nEnd - i) : (nPrevEnd - Phi[i]);
+      /* Most suffixes mismatch at the first compared byte: only call the wider comparison when that byte matches */
+      if (nCurLen < nMaxLen && pInWindow[i + nCurLen] == pInWindow[Phi[i] + nCurLen])
+         nCurLen = lz4ultra_get_match_len(pInWindow + i, pInWindow + Phi[i], nCurLen + 1, nMaxLen);
+      PLCP[i] = nCurLen;
+      if (nCurLen > 0)
+         nCurLen--;
+   }
+}
+
+/**
+ * Compute the permuted LCP of input data from its suffix array
+ *
+ * @param pSuffixArray suffix array of the input data
+ * @param PLCP pointer to returned permuted LCP, of nInWindowSize entries
+ * @param pInWindow pointer to input data window
+ * @param nInWindowSize total input size in bytes
+ */
+static void lz4ultra_build_plcp_from_suffix_array(const saidx_t *pSuffixArray, int *PLCP, const unsigned char *pInWindow, const int nInWindowSize) {
+   int i;
+
+   PLCP[pSuffixArray[0]] = -1;
+   for (i = 1; i < nInWindowSize; i++)
+      PLCP[pSuffixArray[i]] = pSuffixArray[i - 1];
+   lz4ultra_build_plcp(PLCP, pInWindow, 0, nInWindowSize, nInWindowSize, 0);
+}
+
+/**
+ * Build overlaid data structures to speed up match finding, once the suffix array and permuted LCP are computed
+ *
+ * @param pCompressor compression context
+ * @param nInWindowSize total input size in bytes (previously compressed bytes + bytes to compress)
+ */
+static void lz4ultra_build_intervals(lz4ultra_compressor *pCompressor, const int nInWindowSize) {
+   if (pCompressor->compact_intervals)
+      lz4ultra_build_intervals_32(pCompressor, nInWindowSize);
+   else
+      lz4ultra_build_intervals_64(pCompressor, nInWindowSize);
+}
+
+/**
+ * Parse input data, build suffix array and overlaid data structures to speed up match finding
+ *
+ * @param pCompressor compression context
+ * @param pInWindow pointer to input data window (previously compressed bytes + bytes to compress)
+ * @param nInWindowSize total input size in bytes (previously compressed bytes + bytes to compress)
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int lz4ultra_build_suffix_array(lz4ultra_compressor *pCompressor, const unsigned char *pInWindow, const int nInWindowSize) {
+   saidx_t *suffixArray = (saidx_t *)pCompressor->intervals;
+   int *PLCP = (int *)pCompressor->pos_data;  /* Use temporarily */
+
+   /* Build suffix array from input data */
+   if (divsufsort_build_array(&pCompressor->divsufsort_context, pInWindow, suffixArray, nInWindowSize) != 0) {
+      return 100;
+   }
+   lz4ultra_compressor_end_phase(pCompressor, LZ4ULTRA_PHASE_SUFFIX_SORT);
+
+   lz4ultra_build_plcp_from_suffix_array(suffixArray, PLCP, pInWindow, nInWindowSize);
+   lz4ultra_build_intervals(pCompressor, nInWindowSize);
+   return 0;
+}
+
+/**
+ * Sort the suffixes of a dictionary on its own, and compute their permuted LCP, for merging the suffixes of the data that follows the dictionary with them,
+ * or for finding the substrings repeated in samples to train a dictionary with
+ *
+ * @param pDictionaryData dictionary contents
+ * @param nDictionarySize size of dictionary contents
+ * @param pSuffixArray pointer to returned suffix array, of nDictionarySize entries
+ * @param PLCP pointer to returned permuted LCP, of nDictionarySize entries
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int lz4ultra_build_dictionary_suffix_array(const unsigned char *pDictionaryData, const int nDictionarySize, int *pSuffixArray, int *PLCP) {
+   divsufsort_ctx_t divsufsort_context;
+   int nResult;
+
+   nResult = divsufsort_init(&divsufsort_context, NULL, NULL, NULL);
+   if (!nResult) {
+      nResult = divsufsort_build_array(&divsufsort_context, pDictionaryData, (saidx_t *)pSuffixArray, nDictionarySize);
+      divsufsort_destroy(&divsufsort_context);
+   }
+
+   if (nResult)
+      return 100;
+
+   lz4ultra_build_plcp_from_suffix_array((const saidx_t *)pSuffixArray, PLCP, pDictionaryData, nDictionarySize);
+   return 0;
+}
+
+/**
+ * Check if a suffix of a prepared dictionary sorts before a suffix of the data that follows it, the dictionary's suffixes ending with it
+ *
+ * @param pInWindow pointer to input data window (prepared dictionary + bytes to compress)
+ * @param nDictionaryPos offset of the dictionary suffix in the input window
+ * @param nDictionarySize size of the prepared dictionary
+ * @param nDataPos offset of the data suffix in the input window
+ * @param nInWindowSize total input size in bytes (prepared dictionary + bytes to compress)
+ * @param pCompareBudget pointer to the number of bytes that may still be compared, decreased by the number of identical bytes
+ *
+ * @return 1 if the dictionary suffix sorts first, 0 if the data suffix does
+ */
+static inline int lz4ultra_dictionary_suffix_sorts_first(const unsigned char *pInWindow, const int nDictionaryPos, const int nDictionarySize, const int nDataPos, const int nInWindowSize, long long *pCompareBudget) {
+   const int nDictionaryLen = nDictionarySize - nDictionaryPos;
+   const int nDataLen = nInWindowSize - nDataPos;
+   const int nMaxLen = (nDictionaryLen < nDataLen) ? nDictionaryLen : nDataLen;
+   const int nLen = lz4ultra_get_match_len(pInWindow + nDictionaryPos, pInWindow + nDataPos, 0, nMaxLen);
+
+   *pCompareBudget -= (long long)nLen;
+   if (nLen < nMaxLen)
+      return (pInWindow[nDictionaryPos + nLen] < pInWindow[nDataPos + nLen]) ? 1 : 0;
+
+   /* When one suffix is a prefix of the other one, the shortest suffix sorts first; the dictionary suffix sorts first if they are identical */
+   return (nDictionaryLen <= nDataLen) ? 1 : 0;
+}
+
+/**
+ * Parse input data that follows a prepared dictionary: sort the suffixes of the data to compress, merge them with the dictionary's suffixes, that
+ * were sorted once when preparing it, and build overlaid data structures to speed up match finding. The dictionary's suffixes end with it, and
+ * matches into the dictionary stop at its end. Falls back to sorting the whole window when merging would take longer.
+ *
+ * @param pCompressor compression context
+ * @param pDictionary prepared dictionary, that the window starts with
+ * @param pInWindow pointer to input data window (prepared dictionary + bytes to compress)
+ * @param nInWindowSize total input size in bytes (prepared dictionary + bytes to compress)
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int lz4ultra_build_suffix_array_dict(lz4ultra_compressor *pCompressor, const lz4ultra_dictionary *pDictionary, const unsigned char *pInWindow, const int nInWindowSize) {
+   const int nDictionarySize = pDictionary->nSize;
+   const int nDataSize = nInWindowSize - nDictionarySize;
+   const saidx_t *pDictionarySA = (const saidx_t *)pDictionary->pSuffixArray;
+   saidx_t *suffixArray = (saidx_t *)pCompressor->intervals;
+   int *PLCP = (int *)pCompressor->pos_data;  /* Use temporarily */
+   saidx_t *pDataSA = (saidx_t *)pCompressor->match;   /* Use temporarily */
+   long long nCompareBudget;
+   int nDictionaryIndex = 0;
+   int nOutIndex = 0;
+   int nPrevPos = -1;
+   int i;
+
+   /* Each suffix of the data is inserted with a binary search over the dictionary's suffixes, which only beats sorting the whole window for
+    * data that is small compared to the dictionary */
+   if (!pDictionarySA || nDictionarySize <= 0 || nDataSize <= 0 || nDataSize > (nDictionarySize >> DICTIONARY_MERGE_MAX_DATA_SHIFT))
+      return lz4ultra_build_suffix_array(pCompressor, pInWindow, nInWindowSize);
+
+   if (divsufsort_build_array(&pCompressor->divsufsort_context, pInWindow + nDictionarySize, pDataSA, nDataSize) != 0) {
+      return 100;
+   }
+
+   /* The dictionary's suffixes keep the LCP with the suffix that precedes them, unless a suffix of the data is inserted in between */
+   memcpy(PLCP, pDictionary->pPLCP, nDictionarySize * sizeof(int));
+
+   /* Highly repetitive data makes the comparisons long; stop merging and sort the whole window if they add up to too many bytes */
+   nCompareBudget = (long long)nInWindowSize * DICTIONARY_MERGE_COMPARE_FACTOR;
+
+   for (i = 0; i <= nDataSize; i++) {
+      const int nDataPos = (i < nDataSize) ? (nDictionarySize + pDataSA[i]) : -1;
+      int nLow = nDictionaryIndex, nHigh = nDictionarySize;
+
+      /* The data suffixes are visited in order, so each one is inserted after the previous one. The remaining dictionary suffixes follow the last one */
+      if (nDataPos >= 0) {
+         while (nLow < nHigh) {
+            const int nMid = (nLow + nHigh) >> 1;
+
+            if (lz4ultra_dictionary_suffix_sorts_first(pInWindow, pDictionarySA[nMid], nDictionarySize, nDataPos, nInWindowSize, &nCompareBudget))
+               nLow = nMid + 1;
+            else
+               nHigh = nMid;
+         }
+
+         if (nCompareBudget < 0)
+            return lz4ultra_build_suffix_array(pCompressor, pInWindow, nInWindowSize);
+      }
+      else {
+         nLow = nDictionarySize;
+      }
+
+      if (nLow > nDictionaryIndex) {
+         const int nFirstPos = pDictionarySA[nDictionaryIndex];
+
+         memcpy(suffixArray + nOutIndex, pDictionarySA + nDictionaryIndex, (nLow - nDictionaryIndex) * sizeof(saidx_t));
+         nOutIndex += nLow - nDictionaryIndex;
+         nDictionaryIndex = nLow;
+
+         if (nPrevPos >= nDictionarySize) {
+            /* The first dictionary suffix of the run now follows a data suffix */
+            const int nDictionaryLen = nDictionarySize - nFirstPos;
+            const int nDataLen = nInWindowSize - nPrevPos;
+
+            PLCP[nFirstPos] = lz4ultra_get_match_len(pInWindow + nFirstPos, pInWindow + nPrevPos, 0, (nDictionaryLen < nDataLen) ? nDictionaryLen : nDataLen);
+         }
+         nPrevPos = pDictionarySA[nLow - 1];
+      }
+
+      if (nDataPos >= 0) {
+         suffixArray[nOutIndex++] = nDataPos;
+         PLCP[nDataPos] = nPrevPos;    /* Phi, turned into the permuted LCP below */
+         nPrevPos = nDataPos;
+      }
+   }
+   lz4ultra_compressor_end_phase(pCompressor, LZ4ULTRA_PHASE_SUFFIX_SORT);
+
+   lz4ultra_build_plcp(PLCP, pInWindow, nDictionarySize, nInWindowSize, nInWindowSize, nDictionarySize);
+   lz4ultra_build_intervals(pCompressor, nInWindowSize);
+   return 0;
+}
+
+/**
+ * Skip previously compressed bytes
+ *
+ * @param pCompressor compression context
+ * @param nStartOffset current offset in input window (typically 0)
+ * @param nEndOffset offset to skip to in input window (typically the number of previously compressed bytes)
+ */
+void lz4ultra_skip_matches(lz4ultra_compressor *pCompressor, const int nStartOffset, const int nEndOffset) {
+   if (pCompressor->compact_intervals)
+      lz4ultra_skip_matches_32(pCompressor, nStartOffset, nEndOffset);
+   else
+      lz4ultra_skip_matches_64(pCompressor, nStartOffset, nEndOffset);
+}
+
+/**
+ * Find all matches for the data to be compressed.
+ *
+ * @param pCompressor compression context
+ * @param pInWindow pointer to input data window (previously compressed bytes + bytes to compress)
+ * @param nStartOffset current offset in input window (typically the number of previously compressed bytes)
+ * @param nEndOffset offset to end finding matches at (typically the size of the total input window in bytes
+ */
+void lz4ultra_find_all_matches(lz4ultra_compressor *pCompressor, const unsigned char *pInWindow, const int nStartOffset, const int nEndOffset) {
+   if (pCompressor->compact_intervals)
+      lz4ultra_find_all_matches_32(pCompressor, pInWindow, nStartOffset, nEndOffset);
+   else
+      lz4ultra_find_all_matches_64(pCompressor, pInWindow, nStartOffset, nEndOffset);
+}
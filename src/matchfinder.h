@@ -1,69 +1,98 @@
-/*
- * matchfinder.h - LZ match finder implementation
- *
- * Copyright (C) 2019 Emmanuel Marty
- *
- * This software is provided 'as-is', without any express or implied
- * warranty.  In no event will the authors be held liable for any damages
- * arising from the use of this software.
- *
- * Permission is granted to anyone to use this software for any purpose,
- * including commercial applications, and to alter it and redistribute it
- * freely, subject to the following restrictions:
- *
- * 1. The origin of this software must not be misrepresented; you must not
- *    claim that you wrote the original software. If you use this software
- *    in a product, an acknowledgment in the product documentation would be
- *    appreciated but is not required.
- * 2. Altered source versions must be plainly marked as such, and must not be
- *    misrepresented as being the original software.
- * 3. This notice may not be removed or altered from any source distribution.
- */
-
-/*
- * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
- *
- * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
- * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
- * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
- * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
- *
- */
-
-#ifndef _MATCHFINDER_H
-#define _MATCHFINDER_H
-
-/* Forward declarations */
-typedef struct _lz4ultra_match lz4ultra_match;
-typedef struct _lz4ultra_compressor lz4ultra_compressor;
-
-/**
- * Parse input data, build suffix array and overlaid data structures to speed up match finding
- *
- * @param pCompressor compression context
- * @param pInWindow pointer to input data window (previously compressed bytes + bytes to compress)
- * @param nInWindowSize total input size in bytes (previously compressed bytes + bytes to compress)
- *
- * @return 0 for success, non-zero for failure
- */
-int lz4ultra_build_suffix_array(lz4ultra_compressor *pCompressor, const unsigned char *pInWindow, const int nInWindowSize);
-
-/**
- * Skip previously compressed bytes
- *
- * @param pCompressor compression context
- * @param nStartOffset current offset in input window (typically 0)
- * @param nEndOffset offset to skip to in input window (typically the number of previously compressed bytes)
- */
-void lz4ultra_skip_matches(lz4ultra_compressor *pCompressor, const int nStartOffset, const int nEndOffset);
-
-/**
- * Find all matches for the data to be compressed.
- *
- * @param pCompressor compression context
- * @param nStartOffset current offset in input window (typically the number of previously compressed bytes)
- * @param nEndOffset offset to end finding matches at (typically the size of the total input window in bytes
- */
-void lz4ultra_find_all_matches(lz4ultra_compressor *pCompressor, const int nStartOffset, const int nEndOffset);
-
-#endif /* _MATCHFINDER_H */
+/*
+ * matchfinder.h - LZ match finder implementation
+ *
+ * Copyright (C) 2019 Emmanuel Marty
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*
+ * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
+ *
+ * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
+ * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
+ * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
+ * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
+ *
+ */
+
+#ifndef _MATCHFINDER_H
+#define _MATCHFINDER_H
+
+/* Forward declarations */
+typedef struct _lz4ultra_match lz4ultra_match;
+typedef struct _lz4ultra_compressor lz4ultra_compressor;
+typedef struct _lz4ultra_dictionary lz4ultra_dictionary;
+
+/**
+ * Parse input data, build suffix array and overlaid data structures to speed up match finding
+ *
+ * @param pCompressor compression context
+ * @param pInWindow pointer to input data window (previously compressed bytes + bytes to compress)
+ * @param nInWindowSize total input size in bytes (previously compressed bytes + bytes to compress)
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int lz4ultra_build_suffix_array(lz4ultra_compressor *pCompressor, const unsigned char *pInWindow, const int nInWindowSize);
+
+/**
+ * Parse input data that follows a prepared dictionary: sort the suffixes of the data to compress, merge them with the dictionary's suffixes, that
+ * were sorted once when preparing it, and build overlaid data structures to speed up match finding. The dictionary's suffixes end with it, and
+ * matches into the dictionary stop at its end. Falls back to sorting the whole window when merging would take longer.
+ *
+ * @param pCompressor compression context
+ * @param pDictionary prepared dictionary, that the window starts with
+ * @param pInWindow pointer to input data window (prepared dictionary + bytes to compress)
+ * @param nInWindowSize total input size in bytes (prepared dictionary + bytes to compress)
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int lz4ultra_build_suffix_array_dict(lz4ultra_compressor *pCompressor, const lz4ultra_dictionary *pDictionary, const unsigned char *pInWindow, const int nInWindowSize);
+
+/**
+ * Sort the suffixes of a dictionary on its own, and compute their permuted LCP, for merging the suffixes of the data that follows the dictionary with them,
+ * or for finding the substrings repeated in samples to train a dictionary with
+ *
+ * @param pDictionaryData dictionary contents
+ * @param nDictionarySize size of dictionary contents
+ * @param pSuffixArray pointer to returned suffix array, of nDictionarySize entries
+ * @param PLCP pointer to returned permuted LCP, of nDictionarySize entries
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int lz4ultra_build_dictionary_suffix_array(const unsigned char *pDictionaryData, const int nDictionarySize, int *pSuffixArray, int *PLCP);
+
+/**
+ * Skip previously compressed bytes
+ *
+ * @param pCompressor compression context
+ * @param nStartOffset current offset in input window (typically 0)
+ * @param nEndOffset offset to skip to in input window (typically the number of previously compressed bytes)
+ */
+void lz4ultra_skip_matches(lz4ultra_compressor *pCompressor, const int nStartOffset, const int nEndOffset);
+
+/**
+ * Find all matches for the data to be compressed.
+ *
+ * @param pCompressor compression context
+ * @param pInWindow pointer to input data window (previously compressed bytes + bytes to compress)
+ * @param nStartOffset current offset in input window (typically the number of previously compressed bytes)
+ * @param nEndOffset offset to end finding matches at (typically the size of the total input window in bytes
+ */
+void lz4ultra_find_all_matches(lz4ultra_compressor *pCompressor, const unsigned char *pInWindow, const int nStartOffset, const int nEndOffset);
+
+#endif /* _MATCHFINDER_H */
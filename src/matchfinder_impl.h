@@ -0,0 +1,386 @@
+/*
+ * matchfinder_impl.h - LZ match finder implementation, specialized for each layout of the LCP intervals
+ *
+ * Copyright (C) 2019 Emmanuel Marty
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*
+ * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
+ *
+ * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
+ * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
+ * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
+ * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
+ *
+ */
+
+/*
+ * This file is intentionally included several times by matchfinder.c, once for each layout of the LCP intervals, and has
+ * no include guard. Before including it, define:
+ *
+ * MF_ENTRY               type of suffix array, LCP interval and position entries
+ * MF_FUNC(name)          name of the specialized version of a function
+ * MF_LCP_MAX             maximum LCP (match length) that can be stored
+ * MF_LCP_SHIFT           bit position of the LCP in entries
+ * MF_LCP_MASK            mask of the LCP in entries
+ * MF_POS_MASK            mask of the position or interval index in entries
+ * MF_VISITED_FLAG        flag marking visited intervals
+ * MF_EXCL_VISITED_MASK   mask to remove the visited flag from entries
+ */
+
+/**
+ * Build the LCP intervals that speed up match finding, from the suffix array and permuted LCP of the input data
+ *
+ * @param pCompressor compression context, with the suffix array of the input window stored as saidx_t entries at the start of its intervals,
+ *                    and the permuted LCP stored as int entries at the start of its pos_data
+ * @param nInWindowSize total input size in bytes (previously compressed bytes + bytes to compress)
+ */
+static void MF_FUNC(lz4ultra_build_intervals)(lz4ultra_compressor *pCompressor, const int nInWindowSize) {
+   MF_ENTRY *intervals = (MF_ENTRY *)pCompressor->intervals;
+   saidx_t *suffixArray = (saidx_t*)intervals;
+   const int *PLCP = (const int*)pCompressor->pos_data;
+   int i;
+
+   if (sizeof(MF_ENTRY) != sizeof(saidx_t)) {
+      for (i = nInWindowSize - 1; i >= 0; i--) {
+         intervals[i] = suffixArray[i];
+      }
+   }
+
+   /* Rotate permuted LCP into the LCP. This has better cache locality than the direct Kasai LCP method. This also
+    * saves us from having to build the inverse suffix array index, as the LCP is calculated without it using this method,
+    * and the interval builder below doesn't need it either. */
+   intervals[0] &= MF_POS_MASK;
+   for (i = 1; i < nInWindowSize; i++) {
+      int nIndex = (int)(intervals[i] & MF_POS_MASK);
+      int nLen = PLCP[nIndex];
+      if (nLen < MIN_MATCH_SIZE)
+         nLen = 0;
+      if (nLen > MF_LCP_MAX)
+         nLen = MF_LCP_MAX;
+      intervals[i] = ((MF_ENTRY)nIndex) | (((MF_ENTRY)nLen) << MF_LCP_SHIFT);
+   }
+
+   /**
+    * Build intervals for finding matches
+    *
+    * Methodology and code fragment taken from wimlib (CC0 license):
+    * https://wimlib.net/git/?p=wimlib;a=blob_plain;f=src/lcpit_matchfinder.c;h=a2d6a1e0cd95200d1f3a5464d8359d5736b14cbe;hb=HEAD
+    */
+   MF_ENTRY * const SA_and_LCP = intervals;
+   MF_ENTRY *pos_data = (MF_ENTRY *)pCompressor->pos_data;
+   MF_ENTRY next_interval_idx;
+   MF_ENTRY *top = (MF_ENTRY *)pCompressor->open_intervals;
+   MF_ENTRY prev_pos = SA_and_LCP[0] & MF_POS_MASK;
+
+   *top = 0;
+   intervals[0] = 0;
+   next_interval_idx = 1;
+
+   for (int r = 1; r < nInWindowSize; r++) {
+      const MF_ENTRY next_pos = SA_and_LCP[r] & MF_POS_MASK;
+      const MF_ENTRY next_lcp = SA_and_LCP[r] & MF_LCP_MASK;
+      const MF_ENTRY top_lcp = *top & MF_LCP_MASK;
+
+      if (next_lcp == top_lcp) {
+         /* Continuing the deepest open interval  */
+         pos_data[prev_pos] = *top;
+      }
+      else if (next_lcp > top_lcp) {
+         /* Opening a new interval  */
+         *++top = next_lcp | next_interval_idx++;
+         pos_data[prev_pos] = *top;
+      }
+      else {
+         /* Closing the deepest open interval  */
+         pos_data[prev_pos] = *top;
+         for (;;) {
+            const MF_ENTRY closed_interval_idx = *top-- & MF_POS_MASK;
+            const MF_ENTRY superinterval_lcp = *top & MF_LCP_MASK;
+
+            if (next_lcp == superinterval_lcp) {
+               /* Continuing the superinterval */
+               intervals[closed_interval_idx] = *top;
+               break;
+            }
+            else if (next_lcp > superinterval_lcp) {
+               /* Creating a new interval that is a
+                * superinterval of the one being
+                * closed, but still a subinterval of
+                * its superinterval  */
+               *++top = next_lcp | next_interval_idx++;
+               intervals[closed_interval_idx] = *top;
+               break;
+            }
+            else {
+               /* Also closing the superinterval  */
+               intervals[closed_interval_idx] = *top;
+            }
+         }
+      }
+      prev_pos = next_pos;
+   }
+
+   /* Close any still-open intervals.  */
+   pos_data[prev_pos] = *top;
+   for (; top > (MF_ENTRY *)pCompressor->open_intervals; top--)
+      intervals[*top & MF_POS_MASK] = *(top - 1);
+}
+
+/**
+ * Prefetch the deepest LCP interval of the position a few bytes ahead of the current one, that finding matches there starts ascending from.
+ * Positions are visited in order and only relink the pos_data[] entries of earlier positions, so that interval is already known
+ *
+ * @param pCompressor compression context
+ * @param nOffset current offset in the input window
+ * @param nEndOffset offset to end finding matches at
+ */
+static inline void MF_FUNC(lz4ultra_prefetch_matches)(lz4ultra_compressor *pCompressor, const int nOffset, const int nEndOffset) {
+   const MF_ENTRY *intervals = (const MF_ENTRY *)pCompressor->intervals;
+   const MF_ENTRY *pos_data = (const MF_ENTRY *)pCompressor->pos_data;
+
+   if ((nOffset + MATCHFINDER_PREFETCH_DISTANCE) < nEndOffset) {
+      MATCHFINDER_PREFETCH(&intervals[pos_data[nOffset + MATCHFINDER_PREFETCH_DISTANCE] & MF_POS_MASK]);
+   }
+}
+
+/**
+ * Find matches at the specified offset in the input window
+ *
+ * @param pCompressor compression context
+ * @param nOffset offset to find matches at, in the input window
+ * @param pMatches pointer to returned matches
+ * @param nMaxMatches maximum number of matches to return (0 for none)
+ *
+ * @return number of matches
+ */
+static int MF_FUNC(lz4ultra_find_matches_at)(lz4ultra_compressor *pCompressor, const int nOffset, lz4ultra_match *pMatches, const int nMaxMatches) {
+   MF_ENTRY *intervals = (MF_ENTRY *)pCompressor->intervals;
+   MF_ENTRY *pos_data = (MF_ENTRY *)pCompressor->pos_data;
+   MF_ENTRY ref;
+   MF_ENTRY super_ref;
+   MF_ENTRY match_pos;
+   lz4ultra_match *matchptr;
+
+   /**
+    * Find matches using intervals
+    *
+    * Taken from wimlib (CC0 license):
+    * https://wimlib.net/git/?p=wimlib;a=blob_plain;f=src/lcpit_matchfinder.c;h=a2d6a1e0cd95200d1f3a5464d8359d5736b14cbe;hb=HEAD
+    */
+
+    /* Get the deepest lcp-interval containing the current suffix. */
+   ref = pos_data[nOffset];
+
+   pos_data[nOffset] = 0;
+
+   /* Ascend until we reach a visited interval, the root, or a child of the
+    * root.  Link unvisited intervals to the current suffix as we go.  */
+   while ((super_ref = intervals[ref & MF_POS_MASK]) & MF_LCP_MASK) {
+      intervals[ref & MF_POS_MASK] = nOffset | MF_VISITED_FLAG;
+      ref = super_ref;
+   }
+
+   if (super_ref == 0) {
+      /* In this case, the current interval may be any of:
+       * (1) the root;
+       * (2) an unvisited child of the root */
+
+      if (ref != 0)  /* Not the root?  */
+         intervals[ref & MF_POS_MASK] = nOffset | MF_VISITED_FLAG;
+      return 0;
+   }
+
+   /* Ascend indirectly via pos_data[] links.  */
+   match_pos = super_ref & MF_EXCL_VISITED_MASK;
+   matchptr = pMatches;
+   for (;;) {
+      while ((super_ref = pos_data[match_pos]) > ref)
+         match_pos = intervals[super_ref & MF_POS_MASK] & MF_EXCL_VISITED_MASK;
+      intervals[ref & MF_POS_MASK] = nOffset | MF_VISITED_FLAG;
+      pos_data[match_pos] = ref;
+
+      if ((matchptr - pMatches) < nMaxMatches) {
+         int nMatchOffset = (int)(nOffset - match_pos);
+
+         if (nMatchOffset <= MAX_OFFSET) {
+            matchptr->length = (unsigned int)(ref >> MF_LCP_SHIFT);
+            matchptr->offset = (unsigned int)nMatchOffset;
+            matchptr++;
+         }
+      }
+
+      if (super_ref == 0)
+         break;
+      ref = super_ref;
+      match_pos = intervals[ref & MF_POS_MASK] & MF_EXCL_VISITED_MASK;
+   }
+
+   return (int)(matchptr - pMatches);
+}
+
+/**
+ * Skip previously compressed bytes
+ *
+ * @param pCompressor compression context
+ * @param nStartOffset current offset in input window (typically 0)
+ * @param nEndOffset offset to skip to in input window (typically the number of previously compressed bytes)
+ */
+static void MF_FUNC(lz4ultra_skip_matches)(lz4ultra_compressor *pCompressor, const int nStartOffset, const int nEndOffset) {
+   lz4ultra_match match;
+   int i;
+
+   /* Skipping still requires scanning for matches, as this also performs a lazy update of the intervals. However,
+    * we don't store the matches. */
+   for (i = nStartOffset; i < nEndOffset; i++) {
+      MF_FUNC(lz4ultra_prefetch_matches)(pCompressor, i, nEndOffset);
+      MF_FUNC(lz4ultra_find_matches_at)(pCompressor, i, &match, 0);
+   }
+}
+
+/**
+ * Find the longest match, and up to match_candidates - 1 more candidates, at each position of the data to be compressed. The LCP intervals
+ * give shorter matches with closer offsets; when the longest match has an offset below 16, that decompresses more slowly, the same bytes
+ * are also looked for 16 bytes back or more, at a multiple of the offset, which the intervals don't give
+ *
+ * @param pCompressor compression context
+ * @param pInWindow pointer to input data window (previously compressed bytes + bytes to compress)
+ * @param nStartOffset current offset in input window (typically the number of previously compressed bytes)
+ * @param nEndOffset offset to end finding matches at (typically the size of the total input window in bytes
+ */
+static void MF_FUNC(lz4ultra_find_all_candidates)(lz4ultra_compressor *pCompressor, const unsigned char *pInWindow, const int nStartOffset, const int nEndOffset) {
+   const int nMaxCandidates = pCompressor->match_candidates - 1;
+   lz4ultra_match *pMatch = pCompressor->match + nStartOffset;
+   lz4ultra_candidate *pCandidates = pCompressor->candidates + (size_t)nStartOffset * nMaxCandidates;
+   lz4ultra_match matches[LZ4ULTRA_MAX_MATCH_CANDIDATES];
+   int i;
+
+   for (i = nStartOffset; i < nEndOffset; i++) {
+      int nMatches;
+      int nCandidates = 0;
+
+      MF_FUNC(lz4ultra_prefetch_matches)(pCompressor, i, nEndOffset);
+      nMatches = MF_FUNC(lz4ultra_find_matches_at)(pCompressor, i, matches, nMaxCandidates + 1);
+
+      if (nMatches == 0 || i > (nEndOffset - LAST_MATCH_OFFSET)) {
+         pMatch->length = 0;
+         pMatch->offset = 0;
+      }
+      else {
+         int nMaxLen = (nEndOffset - LAST_LITERALS) - i;
+         int m;
+
+         if (nMaxLen < 0)
+            nMaxLen = 0;
+         if (matches[0].length > (unsigned int)nMaxLen)
+            matches[0].length = (unsigned int)nMaxLen;
+         *pMatch = matches[0];
+
+         /* The shorter candidates only matter to the optimal parser when the longest match isn't left alone */
+         if (matches[0].length < LEAVE_ALONE_MATCH_SIZE) {
+            unsigned int nPrevOffset = matches[0].offset;
+
+            if (matches[0].offset < 16) {
+               const int nFarOffset = ((16 + matches[0].offset - 1) / matches[0].offset) * matches[0].offset;
+
+               if (i >= nFarOffset) {
+                  const int nFarLen = lz4ultra_get_match_len(pInWindow + i, pInWindow + i - nFarOffset, 0, matches[0].length);
+
+                  if (nFarLen >= MIN_MATCH_SIZE) {
+                     pCandidates[nCandidates].length = (unsigned short)nFarLen;
+                     pCandidates[nCandidates].offset = (unsigned short)nFarOffset;
+                     nCandidates++;
+                  }
+               }
+            }
+
+            for (m = 1; m < nMatches && nCandidates < nMaxCandidates; m++) {
+               unsigned int nCandidateLen = matches[m].length;
+
+               if (nCandidateLen > (unsigned int)nMaxLen)
+                  nCandidateLen = (unsigned int)nMaxLen;
+               if (nCandidateLen < MIN_MATCH_SIZE)
+                  break;
+
+               /* A shorter match at the same offset is already covered by truncating the previous one */
+               if (matches[m].offset != nPrevOffset) {
+                  pCandidates[nCandidates].length = (unsigned short)nCandidateLen;
+                  pCandidates[nCandidates].offset = (unsigned short)matches[m].offset;
+                  nCandidates++;
+                  nPrevOffset = matches[m].offset;
+               }
+            }
+         }
+      }
+
+      if (nCandidates < nMaxCandidates)
+         pCandidates[nCandidates].length = 0;
+
+      pMatch++;
+      pCandidates += nMaxCandidates;
+   }
+}
+
+/**
+ * Find all matches for the data to be compressed.
+ *
+ * @param pCompressor compression context
+ * @param pInWindow pointer to input data window (previously compressed bytes + bytes to compress)
+ * @param nStartOffset current offset in input window (typically the number of previously compressed bytes)
+ * @param nEndOffset offset to end finding matches at (typically the size of the total input window in bytes
+ */
+static void MF_FUNC(lz4ultra_find_all_matches)(lz4ultra_compressor *pCompressor, const unsigned char *pInWindow, const int nStartOffset, const int nEndOffset) {
+   lz4ultra_match *pMatch = pCompressor->match + nStartOffset;
+   int i;
+
+   if (pCompressor->match_candidates > 1) {
+      MF_FUNC(lz4ultra_find_all_candidates)(pCompressor, pInWindow, nStartOffset, nEndOffset);
+      return;
+   }
+
+   for (i = nStartOffset; i < nEndOffset; i++) {
+      int nMatches;
+
+      MF_FUNC(lz4ultra_prefetch_matches)(pCompressor, i, nEndOffset);
+      nMatches = MF_FUNC(lz4ultra_find_matches_at)(pCompressor, i, pMatch, 1);
+
+      if (nMatches == 0 || i > (nEndOffset - LAST_MATCH_OFFSET)) {
+         pMatch->length = 0;
+         pMatch->offset = 0;
+      }
+      else {
+         int nMaxLen = (nEndOffset - LAST_LITERALS) - i;
+         if (nMaxLen < 0)
+            nMaxLen = 0;
+         if (pMatch->length > (unsigned int)nMaxLen)
+            pMatch->length = (unsigned int)nMaxLen;
+      }
+
+      pMatch++;
+   }
+}
+
+#undef MF_ENTRY
+#undef MF_FUNC
+#undef MF_LCP_MAX
+#undef MF_LCP_SHIFT
+#undef MF_LCP_MASK
+#undef MF_POS_MASK
+#undef MF_VISITED_FLAG
+#undef MF_EXCL_VISITED_MASK
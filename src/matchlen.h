@@ -0,0 +1,110 @@
+/*
+ * matchlen.h - fast match length computation
+ *
+ * Copyright (C) 2019 Emmanuel Marty
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*
+ * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
+ *
+ * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
+ * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
+ * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
+ * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
+ *
+ */
+
+#ifndef _MATCHLEN_H
+#define _MATCHLEN_H
+
+#include <string.h>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+#include <intrin.h>
+#define LZ4ULTRA_MATCHLEN_WORDS
+#elif defined(__GNUC__) && defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define LZ4ULTRA_MATCHLEN_WORDS
+#endif
+
+#if defined(LZ4ULTRA_MATCHLEN_WORDS) && (defined(__SSE2__) || defined(_M_X64))
+#include <emmintrin.h>
+#define LZ4ULTRA_MATCHLEN_SSE2
+#endif
+
+#ifdef LZ4ULTRA_MATCHLEN_WORDS
+/**
+ * Get the index of the lowest set bit in a non-zero value
+ *
+ * @param nValue value to scan, must not be 0
+ *
+ * @return index of lowest set bit
+ */
+static inline int lz4ultra_get_lowest_set_bit(const unsigned long long nValue) {
+#ifdef _MSC_VER
+   unsigned long nIndex;
+   _BitScanForward64(&nIndex, nValue);
+   return (int)nIndex;
+#else
+   return __builtin_ctzll(nValue);
+#endif
+}
+#endif
+
+/**
+ * Get the number of identical bytes at the start of two memory areas, comparing 16 or 8 bytes at a time where supported
+ *
+ * @param pData1 first memory area
+ * @param pData2 second memory area
+ * @param nLen number of bytes already known to be identical
+ * @param nMaxLen maximum number of bytes to compare; no bytes are read beyond this length
+ *
+ * @return number of identical bytes, from nLen to nMaxLen
+ */
+static inline int lz4ultra_get_match_len(const unsigned char *pData1, const unsigned char *pData2, int nLen, const int nMaxLen) {
+#ifdef LZ4ULTRA_MATCHLEN_SSE2
+   while ((nLen + 16) <= nMaxLen) {
+      const __m128i v1 = _mm_loadu_si128((const __m128i *)(pData1 + nLen));
+      const __m128i v2 = _mm_loadu_si128((const __m128i *)(pData2 + nLen));
+      const unsigned int nMismatchMask = ((unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v1, v2))) ^ 0xffff;
+
+      if (nMismatchMask)
+         return nLen + lz4ultra_get_lowest_set_bit(nMismatchMask);
+      nLen += 16;
+   }
+#endif
+
+#ifdef LZ4ULTRA_MATCHLEN_WORDS
+   while ((nLen + 8) <= nMaxLen) {
+      unsigned long long nValue1, nValue2;
+
+      memcpy(&nValue1, pData1 + nLen, 8);
+      memcpy(&nValue2, pData2 + nLen, 8);
+      if (nValue1 != nValue2)
+         return nLen + (lz4ultra_get_lowest_set_bit(nValue1 ^ nValue2) >> 3);
+      nLen += 8;
+   }
+#endif
+
+   while (nLen < nMaxLen && pData1[nLen] == pData2[nLen])
+      nLen++;
+
+   return nLen;
+}
+
+#endif /* _MATCHLEN_H */
@@ -0,0 +1,200 @@
+/*
+ * matchlen.h - fast match length computation
+ *
+ * Copyright (C) 2019 Emmanuel Marty
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*
+ * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
+ *
+ * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
+ * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
+ * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
+ * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
+ *
+ */
+
+#ifndef _MINCOST_H
+#define _MINCOST_H
+
+#include <limits.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define LZ4ULTRA_MINCOST_AVX2
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#define LZ4ULTRA_MINCOST_SSE41
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define LZ4ULTRA_MINCOST_SSE2
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define LZ4ULTRA_MINCOST_NEON
+#endif
+
+#if defined(LZ4ULTRA_MINCOST_AVX2)
+#define MINCOST_LANES 8
+typedef __m256i lz4ultra_mincost_vec;
+typedef __m256i lz4ultra_mincost_mask;
+#define MINCOST_LOAD(p) _mm256_loadu_si256((const __m256i *)(p))
+#define MINCOST_SET1(n) _mm256_set1_epi32(n)
+#define MINCOST_MIN(a, b) _mm256_min_epi32(a, b)
+#define MINCOST_CMPEQ(a, b) _mm256_cmpeq_epi32(a, b)
+#define MINCOST_AND(a, b) _mm256_and_si256(a, b)
+#define MINCOST_SELECT(m, a, b) _mm256_blendv_epi8(b, a, m)
+#define MINCOST_ANY(m) _mm256_movemask_epi8(m)
+
+static inline int lz4ultra_mincost_hmin(const __m256i v) {
+   __m128i vMin = _mm_min_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+   vMin = _mm_min_epi32(vMin, _mm_shuffle_epi32(vMin, _MM_SHUFFLE(1, 0, 3, 2)));
+   vMin = _mm_min_epi32(vMin, _mm_shuffle_epi32(vMin, _MM_SHUFFLE(2, 3, 0, 1)));
+   return _mm_cvtsi128_si32(vMin);
+}
+#elif defined(LZ4ULTRA_MINCOST_SSE41) || defined(LZ4ULTRA_MINCOST_SSE2)
+#define MINCOST_LANES 4
+typedef __m128i lz4ultra_mincost_vec;
+typedef __m128i lz4ultra_mincost_mask;
+#define MINCOST_LOAD(p) _mm_loadu_si128((const __m128i *)(p))
+#define MINCOST_SET1(n) _mm_set1_epi32(n)
+#define MINCOST_CMPEQ(a, b) _mm_cmpeq_epi32(a, b)
+#define MINCOST_AND(a, b) _mm_and_si128(a, b)
+#define MINCOST_ANY(m) _mm_movemask_epi8(m)
+#ifdef LZ4ULTRA_MINCOST_SSE41
+#define MINCOST_MIN(a, b) _mm_min_epi32(a, b)
+#define MINCOST_SELECT(m, a, b) _mm_blendv_epi8(b, a, m)
+#else
+#define MINCOST_SELECT(m, a, b) _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b))
+
+static inline __m128i lz4ultra_mincost_min_sse2(const __m128i a, const __m128i b) {
+   return MINCOST_SELECT(_mm_cmpgt_epi32(a, b), b, a);
+}
+
+#define MINCOST_MIN(a, b) lz4ultra_mincost_min_sse2(a, b)
+#endif
+
+static inline int lz4ultra_mincost_hmin(const __m128i v) {
+   __m128i vMin = MINCOST_MIN(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+   vMin = MINCOST_MIN(vMin, _mm_shuffle_epi32(vMin, _MM_SHUFFLE(2, 3, 0, 1)));
+   return _mm_cvtsi128_si32(vMin);
+}
+#elif defined(LZ4ULTRA_MINCOST_NEON)
+#define MINCOST_LANES 4
+typedef int32x4_t lz4ultra_mincost_vec;
+typedef uint32x4_t lz4ultra_mincost_mask;
+#define MINCOST_LOAD(p) vld1q_s32(p)
+#define MINCOST_SET1(n) vdupq_n_s32(n)
+#define MINCOST_MIN(a, b) vminq_s32(a, b)
+#define MINCOST_CMPEQ(a, b) vceqq_s32(a, b)
+#define MINCOST_AND(a, b) vandq_u32(a, b)
+#define MINCOST_SELECT(m, a, b) vbslq_s32(m, a, b)
+#define MINCOST_ANY(m) vmaxvq_u32(m)
+#define lz4ultra_mincost_hmin(v) vminvq_s32(v)
+#endif
+
+/**
+ * Find the length with the lowest cost in a range of lengths of the optimal parser, and, among those, the lowest score, comparing
+ * several lengths at a time where supported. The longest length wins ties, like when scanning lengths from the longest one.
+ *
+ * @param pCost cost of each length
+ * @param pScore score of each length
+ * @param nMinLen shortest length to consider
+ * @param nMaxLen longest length to consider, must be at least nMinLen
+ * @param nCostLimit cost that the length must be below, or match with a score below nScoreLimit
+ * @param nScoreLimit score that the length must be below when its cost is nCostLimit
+ * @param pMinCost returned cost of the found length
+ * @param pMinScore returned score of the found length
+ *
+ * @return found length, or 0 if no length in the range is below the limits
+ */
+static inline int lz4ultra_find_min_cost_len(const int *pCost, const int *pScore, const int nMinLen, const int nMaxLen, const int nCostLimit, const int nScoreLimit, int *pMinCost, int *pMinScore) {
+   int nMinCost, nMinScore, nFoundLen;
+   int k;
+
+#ifdef MINCOST_LANES
+   if ((nMaxLen - nMinLen + 1) >= MINCOST_LANES) {
+      const int nLastLen = nMaxLen - MINCOST_LANES + 1;
+      lz4ultra_mincost_vec vMinCost, vMinScore;
+      lz4ultra_mincost_vec vMaxScore = MINCOST_SET1(INT_MAX);
+
+      /* Lowest cost first. The last lengths are loaded overlapping the previous ones rather than handled one by one, as the minimum
+       * isn't affected by comparing some lengths twice */
+      vMinCost = MINCOST_LOAD(pCost + nLastLen);
+      for (k = nMinLen; k < nLastLen; k += MINCOST_LANES)
+         vMinCost = MINCOST_MIN(vMinCost, MINCOST_LOAD(pCost + k));
+      nMinCost = lz4ultra_mincost_hmin(vMinCost);
+      if (nMinCost > nCostLimit)
+         return 0;
+
+      /* Lowest score among the lengths with the lowest cost */
+      vMinCost = MINCOST_SET1(nMinCost);
+      vMinScore = MINCOST_SELECT(MINCOST_CMPEQ(MINCOST_LOAD(pCost + nLastLen), vMinCost), MINCOST_LOAD(pScore + nLastLen), vMaxScore);
+      for (k = nMinLen; k < nLastLen; k += MINCOST_LANES)
+         vMinScore = MINCOST_MIN(vMinScore, MINCOST_SELECT(MINCOST_CMPEQ(MINCOST_LOAD(pCost + k), vMinCost), MINCOST_LOAD(pScore + k), vMaxScore));
+      nMinScore = lz4ultra_mincost_hmin(vMinScore);
+      if (nMinCost == nCostLimit && nMinScore >= nScoreLimit)
+         return 0;
+
+      /* Longest length with both */
+      vMinScore = MINCOST_SET1(nMinScore);
+      k = nLastLen;
+      while (1) {
+         const lz4ultra_mincost_mask vFound = MINCOST_AND(MINCOST_CMPEQ(MINCOST_LOAD(pCost + k), vMinCost), MINCOST_CMPEQ(MINCOST_LOAD(pScore + k), vMinScore));
+
+         if (MINCOST_ANY(vFound)) {
+            int nLen;
+
+            for (nLen = k + MINCOST_LANES - 1; pCost[nLen] != nMinCost || pScore[nLen] != nMinScore; nLen--)
+               ;
+
+            *pMinCost = nMinCost;
+            *pMinScore = nMinScore;
+            return nLen;
+         }
+
+         if (k == nMinLen)
+            break;
+         k -= MINCOST_LANES;
+         if (k < nMinLen)
+            k = nMinLen;
+      }
+
+      return 0;
+   }
+#endif
+
+   nMinCost = nCostLimit;
+   nMinScore = nScoreLimit;
+   nFoundLen = 0;
+   for (k = nMaxLen; k >= nMinLen; k--) {
+      if (nMinCost > pCost[k] || (nMinCost == pCost[k] && nMinScore > pScore[k])) {
+         nMinCost = pCost[k];
+         nMinScore = pScore[k];
+         nFoundLen = k;
+      }
+   }
+
+   if (nFoundLen) {
+      *pMinCost = nMinCost;
+      *pMinScore = nMinScore;
+   }
+   return nFoundLen;
+}
+
+#endif /* _MINCOST_H */
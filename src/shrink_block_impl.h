@@ -0,0 +1,155 @@
+/*
+ * shrink_block_impl.h - optimal LZ4 parser implementation, specialized for each compression mode
+ *
+ * Copyright (C) 2019 Emmanuel Marty
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*
+ * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
+ *
+ * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
+ * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
+ * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
+ * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
+ *
+ */
+
+/*
+ * This file is intentionally included several times by shrink_block.c, once with the best ratio and once trading some ratio for
+ * decompression speed, and has no include guard. Before including it, define:
+ *
+ * PARSE_FUNC(name)       name of the specialized version of a function
+ * PARSE_FAVOR_RATIO      1 to compress with the best ratio (LZ4ULTRA_FLAG_FAVOR_RATIO), 0 to shorten matches for decompression speed
+ */
+
+/**
+ * Attempt to pick optimal matches, so as to produce the smallest possible output that decompresses to the same input, or the output with the
+ * smallest sum of size and weighted, modeled decompression time when the compression context has a decode cost
+ *
+ * @param pCompressor compression context
+ * @param nStartOffset current offset in input window (typically the number of previously compressed bytes)
+ * @param nEndOffset offset to end finding matches at (typically the size of the total input window in bytes
+ */
+static void PARSE_FUNC(lz4ultra_optimize_matches_lz4)(lz4ultra_compressor *pCompressor, const int nStartOffset, const int nEndOffset) {
+   int *cost = (int*)pCompressor->pos_data;  /* Reuse */
+   int *score = (int*)pCompressor->intervals;  /* Reuse */
+   const int nExtraMatchScore = PARSE_FAVOR_RATIO ? 1 : 5;
+   const int nDecodeCost = pCompressor->decode_cost;
+   int nLastLiteralsOffset;
+   int i;
+
+   /* The cost of each position includes the penalty for switching from literals to the match that starts there, that every command reaching it
+    * pays, so that the inner loops don't have to look up the match again */
+   cost[nEndOffset - 1] = 8 + ((pCompressor->match[nEndOffset - 1].length >= MIN_MATCH_SIZE) ? MODESWITCH_PENALTY : 0);
+   score[nEndOffset - 1] = 0;
+   nLastLiteralsOffset = nEndOffset;
+
+   for (i = nEndOffset - 2; i != (nStartOffset - 1); i--) {
+      int nBestCost, nBestScore, nBestMatchLen, nBestMatchOffset;
+
+      const int nLiteralsLen = nLastLiteralsOffset - i;
+      nBestCost = 8 + cost[i + 1];
+      nBestScore = 1 + score[i + 1];
+      if (nLiteralsLen >= LITERALS_RUN_LEN && ((nLiteralsLen - LITERALS_RUN_LEN) % 255) == 0) {
+         /* Add to the cost of encoding literals as their number crosses a variable length encoding boundary.
+          * The cost automatically accumulates down the chain. */
+         nBestCost += 8;
+      }
+      if (nLiteralsLen == LITERALS_RUN_LEN)
+         nBestCost += nDecodeCost * DECODE_LONG_LITERALS_COST;
+      nBestMatchLen = 0;
+      nBestMatchOffset = 0;
+
+      lz4ultra_match *pMatch = pCompressor->match + i;
+
+      if (pMatch->length >= MIN_MATCH_SIZE) {
+         if (pMatch->length >= LEAVE_ALONE_MATCH_SIZE) {
+            int nCurCost, nCurScore;
+            int nMatchLen = pMatch->length;
+
+            if ((i + nMatchLen) > (nEndOffset - LAST_LITERALS))
+               nMatchLen = nEndOffset - LAST_LITERALS - i;
+
+            nCurCost = 8 + 16 + lz4ultra_get_match_varlen_size(nMatchLen - MIN_MATCH_SIZE);
+            nCurCost += nDecodeCost * lz4ultra_get_match_decode_cost(nMatchLen, pMatch->offset);
+            nCurCost += cost[i + nMatchLen];
+            nCurScore = nExtraMatchScore + score[i + nMatchLen];
+
+            if (nBestCost > nCurCost || (nBestCost == nCurCost && nBestScore > nCurScore)) {
+               nBestCost = nCurCost;
+               nBestScore = nCurScore;
+               nBestMatchLen = nMatchLen;
+               nBestMatchOffset = pMatch->offset;
+            }
+         }
+         else {
+            int nMatchLen = pMatch->length;
+            const int nMatchDecodeCost = nDecodeCost * lz4ultra_get_match_decode_cost(MIN_MATCH_SIZE, pMatch->offset);
+            const int nLongMatchDecodeCost = nDecodeCost * lz4ultra_get_match_decode_cost(MATCH_RUN_LEN + MIN_MATCH_SIZE, pMatch->offset);
+            int nLen;
+
+            if ((i + nMatchLen) > (nEndOffset - LAST_LITERALS))
+               nMatchLen = nEndOffset - LAST_LITERALS - i;
+
+            if (!PARSE_FAVOR_RATIO) {
+               /* If the match is just above the size where it would use the fast decompression path, shorten it so it does use it,
+                * giving up some ratio for extra decompression speed */
+               if (nMatchLen > (MATCH_RUN_LEN + MIN_MATCH_SIZE - 1) && nMatchLen <= (2 * (MATCH_RUN_LEN + MIN_MATCH_SIZE - 1)))
+                  nMatchLen = MATCH_RUN_LEN + MIN_MATCH_SIZE - 1;
+            }
+
+            nLen = lz4ultra_get_best_match_len(cost + i, score + i, nMatchLen, nMatchDecodeCost, nLongMatchDecodeCost, nExtraMatchScore, &nBestCost, &nBestScore);
+            if (nLen) {
+               nBestMatchLen = nLen;
+               nBestMatchOffset = pMatch->offset;
+            }
+
+            if (pCompressor->candidates) {
+               /* Also try the other match candidates, and their truncations. Each offset costs as much to encode, so they can
+                * only be picked for their modeled decompression time */
+               const lz4ultra_candidate *pCandidate = pCompressor->candidates + (size_t)i * (pCompressor->match_candidates - 1);
+               const lz4ultra_candidate *pCandidatesEnd = pCandidate + (pCompressor->match_candidates - 1);
+
+               for (; pCandidate < pCandidatesEnd && pCandidate->length >= MIN_MATCH_SIZE; pCandidate++) {
+                  const int nCandidateDecodeCost = nDecodeCost * lz4ultra_get_match_decode_cost(MIN_MATCH_SIZE, pCandidate->offset);
+                  const int nLongCandidateDecodeCost = nDecodeCost * lz4ultra_get_match_decode_cost(MATCH_RUN_LEN + MIN_MATCH_SIZE, pCandidate->offset);
+
+                  nLen = lz4ultra_get_best_match_len(cost + i, score + i, (pCandidate->length < nMatchLen) ? pCandidate->length : nMatchLen,
+                     nCandidateDecodeCost, nLongCandidateDecodeCost, nExtraMatchScore, &nBestCost, &nBestScore);
+                  if (nLen) {
+                     nBestMatchLen = nLen;
+                     nBestMatchOffset = pCandidate->offset;
+                  }
+               }
+            }
+         }
+      }
+
+      if (nBestMatchLen >= MIN_MATCH_SIZE)
+         nLastLiteralsOffset = i;
+
+      cost[i] = nBestCost + ((nBestMatchLen >= MIN_MATCH_SIZE) ? MODESWITCH_PENALTY : 0);
+      score[i] = nBestScore;
+      pMatch->length = nBestMatchLen;
+      pMatch->offset = nBestMatchOffset;
+   }
+}
+
+#undef PARSE_FUNC
+#undef PARSE_FAVOR_RATIO
@@ -1,140 +1,966 @@
-/*
- * shrink_context.c - compression context implementation
- *
- * Copyright (C) 2019 Emmanuel Marty
- *
- * This software is provided 'as-is', without any express or implied
- * warranty.  In no event will the authors be held liable for any damages
- * arising from the use of this software.
- *
- * Permission is granted to anyone to use this software for any purpose,
- * including commercial applications, and to alter it and redistribute it
- * freely, subject to the following restrictions:
- *
- * 1. The origin of this software must not be misrepresented; you must not
- *    claim that you wrote the original software. If you use this software
- *    in a product, an acknowledgment in the product documentation would be
- *    appreciated but is not required.
- * 2. Altered source versions must be plainly marked as such, and must not be
- *    misrepresented as being the original software.
- * 3. This notice may not be removed or altered from any source distribution.
- */
-
-/*
- * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
- *
- * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
- * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
- * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
- * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
- *
- */
-
-#include <stdlib.h>
-#include <string.h>
-#include "shrink_context.h"
-#include "shrink_block.h"
-#include "matchfinder.h"
-
-/**
- * Initialize compression context
- *
- * @param pCompressor compression context to initialize
- * @param nMaxWindowSize maximum size of input data window (previously compressed bytes + bytes to compress)
- * @param nFlags compression flags
- *
- * @return 0 for success, non-zero for failure
- */
-int lz4ultra_compressor_init(lz4ultra_compressor *pCompressor, const int nMaxWindowSize, const int nFlags) {
-   int nResult;
-
-   nResult = divsufsort_init(&pCompressor->divsufsort_context);
-   pCompressor->intervals = NULL;
-   pCompressor->pos_data = NULL;
-   pCompressor->open_intervals = NULL;
-   pCompressor->match = NULL;
-   pCompressor->flags = nFlags;
-   pCompressor->num_commands = 0;
-
-   if (!nResult) {
-      pCompressor->intervals = (unsigned long long *)malloc(nMaxWindowSize * sizeof(unsigned long long));
-
-      if (pCompressor->intervals) {
-         pCompressor->pos_data = (unsigned long long *)malloc(nMaxWindowSize * sizeof(unsigned long long));
-
-         if (pCompressor->pos_data) {
-            pCompressor->open_intervals = (unsigned long long *)malloc((LCP_MAX + 1) * sizeof(unsigned long long));
-
-            if (pCompressor->open_intervals) {
-               pCompressor->match = (lz4ultra_match *)malloc(nMaxWindowSize * sizeof(lz4ultra_match));
-
-               if (pCompressor->match)
-                  return 0;
-            }
-         }
-      }
-   }
-
-   lz4ultra_compressor_destroy(pCompressor);
-   return 100;
-}
-
-/**
- * Clean up compression context and free up any associated resources
- *
- * @param pCompressor compression context to clean up
- */
-void lz4ultra_compressor_destroy(lz4ultra_compressor *pCompressor) {
-   divsufsort_destroy(&pCompressor->divsufsort_context);
-
-   if (pCompressor->match) {
-      free(pCompressor->match);
-      pCompressor->match = NULL;
-   }
-
-   if (pCompressor->open_intervals) {
-      free(pCompressor->open_intervals);
-      pCompressor->open_intervals = NULL;
-   }
-
-   if (pCompressor->pos_data) {
-      free(pCompressor->pos_data);
-      pCompressor->pos_data = NULL;
-   }
-
-   if (pCompressor->intervals) {
-      free(pCompressor->intervals);
-      pCompressor->intervals = NULL;
-   }
-}
-
-/**
- * Compress one block of data
- *
- * @param pCompressor compression context
- * @param pInWindow pointer to input data window (previously compressed bytes + bytes to compress)
- * @param nPreviousBlockSize number of previously compressed bytes (or 0 for none)
- * @param nInDataSize number of input bytes to compress
- * @param pOutData pointer to output buffer
- * @param nMaxOutDataSize maximum size of output buffer, in bytes
- *
- * @return size of compressed data in output buffer, or -1 if the data is uncompressible
- */
-int lz4ultra_compressor_shrink_block(lz4ultra_compressor *pCompressor, const unsigned char *pInWindow, const int nPreviousBlockSize, const int nInDataSize, unsigned char *pOutData, const int nMaxOutDataSize) {
-   if (lz4ultra_build_suffix_array(pCompressor, pInWindow, nPreviousBlockSize + nInDataSize))
-      return -1;
-   if (nPreviousBlockSize) {
-      lz4ultra_skip_matches(pCompressor, 0, nPreviousBlockSize);
-   }
-   lz4ultra_find_all_matches(pCompressor, nPreviousBlockSize, nPreviousBlockSize + nInDataSize);
-   return lz4ultra_optimize_and_write_block(pCompressor, pInWindow, nPreviousBlockSize, nInDataSize, pOutData, nMaxOutDataSize);
-}
-
-/**
- * Get the number of compression commands issued in compressed data blocks
- *
- * @return number of commands
- */
-int lz4ultra_compressor_get_command_count(lz4ultra_compressor *pCompressor) {
-   return pCompressor->num_commands;
-}
+/*
+ * shrink_context.c - compression context implementation
+ *
+ * Copyright (C) 2019 Emmanuel Marty
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*
+ * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
+ *
+ * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
+ * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
+ * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
+ * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+#include "shrink_context.h"
+#include "shrink_block.h"
+#include "matchfinder.h"
+#include "hashchain.h"
+#include "threadpool.h"
+#include "format.h"
+#include "lib.h"
+#include "matchlen.h"
+
+/**
+ * Initialize compression context
+ *
+ * @param pCompressor compression context to initialize
+ * @param pAllocator allocator of the context's memory, or NULL to use malloc()
+ * @param nMaxWindowSize maximum size of input data window (previously compressed bytes + bytes to compress)
+ * @param nFlags compression flags
+ * @param nCompressionLevel compression level (LZ4ULTRA_MIN_LEVEL..LZ4ULTRA_MAX_LEVEL)
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int lz4ultra_compressor_init(lz4ultra_compressor *pCompressor, const lz4ultra_allocator *pAllocator, const int nMaxWindowSize, const int nFlags, const int nCompressionLevel) {
+   int nResult;
+   size_t nEntrySize;
+
+   pCompressor->divsufsort_context.bucket_A = NULL;
+   pCompressor->divsufsort_context.bucket_B = NULL;
+   pCompressor->divsufsort_context.bstar_ranges = NULL;
+   pCompressor->intervals = NULL;
+   pCompressor->pos_data = NULL;
+   pCompressor->open_intervals = NULL;
+   pCompressor->match = NULL;
+   pCompressor->candidates = NULL;
+   pCompressor->hash_heads = NULL;
+   pCompressor->hash_chain = NULL;
+   pCompressor->level = nCompressionLevel;
+   pCompressor->flags = nFlags;
+   pCompressor->match_candidates = 1;
+   pCompressor->decode_cost = 0;
+   pCompressor->num_commands = 0;
+   memset(&pCompressor->stats, 0, sizeof(lz4ultra_stats));
+   pCompressor->phase_start_time = 0;
+   if (pAllocator)
+      pCompressor->allocator = *pAllocator;
+   else
+      memset(&pCompressor->allocator, 0, sizeof(lz4ultra_allocator));
+   pCompressor->memory_size = lz4ultra_compressor_get_init_memory_size(nMaxWindowSize, nCompressionLevel, 1);
+
+   if (nCompressionLevel < LZ4ULTRA_MAX_LEVEL) {
+      /* Fast compression levels only need a hash chain, and not the suffix array match finder's structures */
+      pCompressor->compact_intervals = 0;
+
+      pCompressor->hash_heads = (int *)lz4ultra_alloc(&pCompressor->allocator, HASH_SIZE * sizeof(int));
+
+      if (pCompressor->hash_heads) {
+         pCompressor->hash_chain = (int *)lz4ultra_alloc(&pCompressor->allocator, nMaxWindowSize * sizeof(int));
+
+         if (pCompressor->hash_chain) {
+            pCompressor->match = (lz4ultra_match *)lz4ultra_alloc(&pCompressor->allocator, nMaxWindowSize * sizeof(lz4ultra_match));
+
+            if (pCompressor->match)
+               return 0;
+         }
+      }
+
+      lz4ultra_compressor_destroy(pCompressor);
+      return 100;
+   }
+
+   nResult = divsufsort_init(&pCompressor->divsufsort_context, pCompressor->allocator.alloc_mem, pCompressor->allocator.free_mem, pCompressor->allocator.pOpaque);
+
+   /* Use packed 32-bit LCP intervals when the window is small enough for them, to halve the match finder's memory
+    * and cache footprint; larger windows need 64-bit entries to store both positions and long enough match lengths */
+   pCompressor->compact_intervals = (nMaxWindowSize <= COMPACT_INTERVALS_MAX_WINDOW_SIZE) ? 1 : 0;
+   nEntrySize = pCompressor->compact_intervals ? sizeof(unsigned int) : sizeof(unsigned long long);
+
+   if (!nResult) {
+      pCompressor->intervals = lz4ultra_alloc(&pCompressor->allocator, nMaxWindowSize * nEntrySize);
+
+      if (pCompressor->intervals) {
+         pCompressor->pos_data = lz4ultra_alloc(&pCompressor->allocator, nMaxWindowSize * nEntrySize);
+
+         if (pCompressor->pos_data) {
+            pCompressor->open_intervals = lz4ultra_alloc(&pCompressor->allocator, ((pCompressor->compact_intervals ? LCP32_MAX : LCP_MAX) + 1) * nEntrySize);
+
+            if (pCompressor->open_intervals) {
+               pCompressor->match = (lz4ultra_match *)lz4ultra_alloc(&pCompressor->allocator, nMaxWindowSize * sizeof(lz4ultra_match));
+
+               if (pCompressor->match)
+                  return 0;
+            }
+         }
+      }
+   }
+
+   lz4ultra_compressor_destroy(pCompressor);
+   return 100;
+}
+
+/**
+ * Get the amount of memory that a compression context allocates when it is initialized
+ *
+ * @param nMaxWindowSize maximum size of input data window (previously compressed bytes + bytes to compress)
+ * @param nCompressionLevel compression level (LZ4ULTRA_MIN_LEVEL..LZ4ULTRA_MAX_LEVEL)
+ * @param nMatchCandidates number of match candidates for each position, that the best compression level allocates room for
+ *
+ * @return size in bytes
+ */
+size_t lz4ultra_compressor_get_init_memory_size(const int nMaxWindowSize, const int nCompressionLevel, const int nMatchCandidates) {
+   size_t nEntrySize;
+
+   if (nCompressionLevel < LZ4ULTRA_MAX_LEVEL)
+      return (HASH_SIZE + (size_t)nMaxWindowSize) * sizeof(int) + (size_t)nMaxWindowSize * sizeof(lz4ultra_match);
+
+   nEntrySize = (nMaxWindowSize <= COMPACT_INTERVALS_MAX_WINDOW_SIZE) ? sizeof(unsigned int) : sizeof(unsigned long long);
+   return DIVSUFSORT_BUCKETS_SIZE + (2 * (size_t)nMaxWindowSize + ((nMaxWindowSize <= COMPACT_INTERVALS_MAX_WINDOW_SIZE) ? LCP32_MAX : LCP_MAX) + 1) * nEntrySize +
+      (size_t)nMaxWindowSize * sizeof(lz4ultra_match) + (size_t)nMaxWindowSize * (nMatchCandidates - 1) * sizeof(lz4ultra_candidate);
+}
+
+/**
+ * Clean up compression context and free up any associated resources
+ *
+ * @param pCompressor compression context to clean up
+ */
+void lz4ultra_compressor_destroy(lz4ultra_compressor *pCompressor) {
+   divsufsort_destroy(&pCompressor->divsufsort_context);
+
+   if (pCompressor->hash_chain) {
+      lz4ultra_free(&pCompressor->allocator, pCompressor->hash_chain);
+      pCompressor->hash_chain = NULL;
+   }
+
+   if (pCompressor->hash_heads) {
+      lz4ultra_free(&pCompressor->allocator, pCompressor->hash_heads);
+      pCompressor->hash_heads = NULL;
+   }
+
+   if (pCompressor->candidates) {
+      lz4ultra_free(&pCompressor->allocator, pCompressor->candidates);
+      pCompressor->candidates = NULL;
+   }
+
+   if (pCompressor->match) {
+      lz4ultra_free(&pCompressor->allocator, pCompressor->match);
+      pCompressor->match = NULL;
+   }
+
+   if (pCompressor->open_intervals) {
+      lz4ultra_free(&pCompressor->allocator, pCompressor->open_intervals);
+      pCompressor->open_intervals = NULL;
+   }
+
+   if (pCompressor->pos_data) {
+      lz4ultra_free(&pCompressor->allocator, pCompressor->pos_data);
+      pCompressor->pos_data = NULL;
+   }
+
+   if (pCompressor->intervals) {
+      lz4ultra_free(&pCompressor->allocator, pCompressor->intervals);
+      pCompressor->intervals = NULL;
+   }
+}
+
+/**
+ * Set the number of match candidates that a compression context using the suffix array match finder keeps for each position, allocating
+ * room for the shorter candidates
+ *
+ * @param pCompressor compression context
+ * @param nMaxWindowSize maximum size of input data window that the compression context was initialized for
+ * @param nMatchCandidates number of match candidates (1..LZ4ULTRA_MAX_MATCH_CANDIDATES)
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int lz4ultra_compressor_set_match_candidates(lz4ultra_compressor *pCompressor, const int nMaxWindowSize, const int nMatchCandidates) {
+   if (nMatchCandidates < 1 || nMatchCandidates > LZ4ULTRA_MAX_MATCH_CANDIDATES)
+      return 100;
+
+   if (pCompressor->candidates) {
+      lz4ultra_free(&pCompressor->allocator, pCompressor->candidates);
+      pCompressor->candidates = NULL;
+      pCompressor->memory_size -= (size_t)nMaxWindowSize * (pCompressor->match_candidates - 1) * sizeof(lz4ultra_candidate);
+   }
+   pCompressor->match_candidates = 1;
+
+   if (nMatchCandidates > 1) {
+      pCompressor->candidates = (lz4ultra_candidate *)lz4ultra_alloc(&pCompressor->allocator, (size_t)nMaxWindowSize * (nMatchCandidates - 1) * sizeof(lz4ultra_candidate));
+      if (!pCompressor->candidates)
+         return 100;
+      pCompressor->memory_size += (size_t)nMaxWindowSize * (nMatchCandidates - 1) * sizeof(lz4ultra_candidate);
+      pCompressor->match_candidates = nMatchCandidates;
+   }
+
+   return 0;
+}
+
+/**
+ * Get the current time, for timing compression phases
+ *
+ * @return time in microseconds
+ */
+static long long lz4ultra_compressor_get_time(void) {
+#ifdef _WIN32
+   LARGE_INTEGER nFrequency, nCurTime;
+
+   if (QueryPerformanceFrequency(&nFrequency) && nFrequency.QuadPart) {
+      QueryPerformanceCounter(&nCurTime);
+      return (long long)((nCurTime.QuadPart / nFrequency.QuadPart) * 1000000LL + ((nCurTime.QuadPart % nFrequency.QuadPart) * 1000000LL) / nFrequency.QuadPart);
+   }
+   return (long long)GetTickCount64() * 1000LL;
+#else
+   struct timeval tm;
+   gettimeofday(&tm, NULL);
+
+   return (long long)tm.tv_sec * 1000000LL + (long long)tm.tv_usec;
+#endif
+}
+
+/**
+ * Start timing a compression phase, when LZ4ULTRA_FLAG_STATS is set
+ *
+ * @param pCompressor compression context
+ */
+void lz4ultra_compressor_start_phase(lz4ultra_compressor *pCompressor) {
+   if (pCompressor->flags & LZ4ULTRA_FLAG_STATS)
+      pCompressor->phase_start_time = lz4ultra_compressor_get_time();
+}
+
+/**
+ * Add the time elapsed since the current compression phase started to its statistics, and start timing the next phase, when LZ4ULTRA_FLAG_STATS is set
+ *
+ * @param pCompressor compression context
+ * @param nPhase phase that just ended (LZ4ULTRA_PHASE_xxx)
+ */
+void lz4ultra_compressor_end_phase(lz4ultra_compressor *pCompressor, const int nPhase) {
+   if (pCompressor->flags & LZ4ULTRA_FLAG_STATS) {
+      const long long nCurTime = lz4ultra_compressor_get_time();
+
+      pCompressor->stats.phase_time[nPhase] += nCurTime - pCompressor->phase_start_time;
+      pCompressor->phase_start_time = nCurTime;
+   }
+}
+
+/**
+ * Count the matches that were found for a block, when LZ4ULTRA_FLAG_STATS is set. Counting isn't timed as part of any phase.
+ *
+ * @param pCompressor compression context
+ * @param nStartOffset offset of the block in the input window
+ * @param nEndOffset offset of the end of the block in the input window
+ * @param nAllPositions 1 to count the match found at every position, 0 to only count the matches selected by parsing, skipping the bytes that they cover
+ */
+static void lz4ultra_compressor_count_matches(lz4ultra_compressor *pCompressor, const int nStartOffset, const int nEndOffset, const int nAllPositions) {
+   if (pCompressor->flags & LZ4ULTRA_FLAG_STATS) {
+      const lz4ultra_match *pMatch = pCompressor->match;
+      long long nMatches = 0, nMatchBytes = 0;
+      int i;
+
+      for (i = nStartOffset; i < nEndOffset; ) {
+         if (pMatch[i].length >= MIN_MATCH_SIZE) {
+            nMatches++;
+            nMatchBytes += (long long)pMatch[i].length;
+            i += nAllPositions ? 1 : pMatch[i].length;
+         }
+         else {
+            i++;
+         }
+      }
+
+      pCompressor->stats.matches_found += nMatches;
+      pCompressor->stats.match_bytes_found += nMatchBytes;
+      lz4ultra_compressor_start_phase(pCompressor);
+   }
+}
+
+/**
+ * Estimate the number of bytes that 4-byte matches save in one chunk of input data, with a hash table of earlier positions, optionally skipping
+ * faster over data that doesn't match
+ *
+ * @param pInData pointer to the input data of the block
+ * @param nStartOffset offset of the chunk in the input data
+ * @param nEndOffset offset of the end of the chunk in the input data
+ * @param pHashTable hash table of the last position + 1 of each hashed 4-byte value in the input data, or 0 for none, updated by this function
+ * @param nHashBits number of bits of the hash table's index
+ * @param nSkipMisses 1 to look at fewer positions as the data keeps not matching, which misses sparse matches, 0 to look at every position
+ *
+ * @return estimated number of bytes saved
+ */
+static int lz4ultra_estimate_chunk_savings(const unsigned char *pInData, const int nStartOffset, const int nEndOffset, int *pHashTable, const int nHashBits, const int nSkipMisses) {
+   int nSavings = 0;
+   int nMisses = 0;
+   int i = nStartOffset;
+
+   while ((i + MIN_MATCH_SIZE) <= nEndOffset) {
+      unsigned int nValue;
+      memcpy(&nValue, pInData + i, sizeof(nValue));
+
+      const unsigned int nHash = (nValue * 2654435761U) >> (32 - nHashBits);
+      const int nCandidate = pHashTable[nHash] - 1;
+      pHashTable[nHash] = i + 1;
+
+      if (nCandidate >= 0 && (i - nCandidate) <= MAX_OFFSET && !memcmp(pInData + nCandidate, pInData + i, MIN_MATCH_SIZE)) {
+         const int nMatchLen = lz4ultra_get_match_len(pInData + nCandidate, pInData + i, MIN_MATCH_SIZE, nEndOffset - i);
+
+         /* A match replaces its bytes with about one token and a 2-byte offset */
+         nSavings += nMatchLen - 3;
+         nMisses = 0;
+         i += nMatchLen;
+      }
+      else {
+         /* Look at fewer positions as the data keeps not matching */
+         if (nSkipMisses)
+            nMisses++;
+         i += 1 + (nMisses >> 5);
+      }
+   }
+
+   return nSavings;
+}
+
+/**
+ * Check if a block is quickly estimated to be incompressible, so that it can be stored uncompressed without building the suffix array. Every
+ * position is looked at, and the block is only incompressible if matches save no more than the tokens and lengths that a block of literals
+ * adds over the stored block. Raw blocks and legacy frames can't store blocks uncompressed, and are never estimated to be incompressible
+ *
+ * @param pCompressor compression context
+ * @param pInWindow pointer to input data window (previously compressed bytes + bytes to compress)
+ * @param nPreviousBlockSize number of previously compressed bytes (or 0 for none)
+ * @param nInDataSize number of input bytes to compress
+ *
+ * @return 1 if the block is estimated to be incompressible, 0 if it should be compressed
+ */
+static int lz4ultra_compressor_is_incompressible(lz4ultra_compressor *pCompressor, const unsigned char *pInWindow, const int nPreviousBlockSize, const int nInDataSize) {
+   int *pHashTable = (int *)pCompressor->pos_data;  /* Use temporarily */
+   const int nLiteralsOverhead = 1 /* token */ + 1 + (nInDataSize - LITERALS_RUN_LEN) / 255 /* literals length */;
+   int nHashBits = 1;
+   int i;
+
+   if (nInDataSize < INCOMPRESSIBLE_MIN_BLOCK_SIZE || (pCompressor->flags & (LZ4ULTRA_FLAG_RAW_BLOCK | LZ4ULTRA_FLAG_LEGACY_FRAMES)))
+      return 0;
+
+   /* Size the hash table for the window, so that matches with the history and far back in the block are rarely missed */
+   while (nHashBits < HASH_BITS && (1 << (nHashBits + 1)) <= (nPreviousBlockSize + nInDataSize))
+      nHashBits++;
+   memset(pHashTable, 0, (1 << nHashBits) * sizeof(int));
+
+   for (i = 0; (i + MIN_MATCH_SIZE) <= nPreviousBlockSize; i++) {
+      unsigned int nValue;
+      memcpy(&nValue, pInWindow + i, sizeof(nValue));
+
+      pHashTable[(nValue * 2654435761U) >> (32 - nHashBits)] = i + 1;
+   }
+
+   return (lz4ultra_estimate_chunk_savings(pInWindow, nPreviousBlockSize, nPreviousBlockSize + nInDataSize, pHashTable, nHashBits, 0) <= nLiteralsOverhead) ? 1 : 0;
+}
+
+/**
+ * Compress one block of data
+ *
+ * @param pCompressor compression context
+ * @param pDictionary prepared dictionary that the previously compressed bytes consist of, to merge the block's suffixes with its sorted suffixes, or NULL to sort them all
+ * @param pInWindow pointer to input data window (previously compressed bytes + bytes to compress)
+ * @param nPreviousBlockSize number of previously compressed bytes (or 0 for none)
+ * @param nInDataSize number of input bytes to compress
+ * @param pOutData pointer to output buffer
+ * @param nMaxOutDataSize maximum size of output buffer, in bytes
+ *
+ * @return size of compressed data in output buffer, or -1 if the data is uncompressible
+ */
+int lz4ultra_compressor_shrink_block(lz4ultra_compressor *pCompressor, const lz4ultra_dictionary *pDictionary, const unsigned char *pInWindow, const int nPreviousBlockSize, const int nInDataSize, unsigned char *pOutData, const int nMaxOutDataSize) {
+   int nResult;
+
+   pCompressor->stats.num_blocks++;
+   pCompressor->stats.bytes_processed += (long long)nInDataSize;
+   lz4ultra_compressor_start_phase(pCompressor);
+
+   if (pCompressor->level < LZ4ULTRA_MAX_LEVEL) {
+      lz4ultra_hashchain_parse(pCompressor, pInWindow, nPreviousBlockSize, nPreviousBlockSize + nInDataSize);
+      lz4ultra_compressor_end_phase(pCompressor, LZ4ULTRA_PHASE_FIND_MATCHES);
+      lz4ultra_compressor_count_matches(pCompressor, nPreviousBlockSize, nPreviousBlockSize + nInDataSize, 0);
+
+      nResult = lz4ultra_write_block(pCompressor, pInWindow, nPreviousBlockSize, nInDataSize, pOutData, nMaxOutDataSize);
+      lz4ultra_compressor_end_phase(pCompressor, LZ4ULTRA_PHASE_WRITE);
+      return nResult;
+   }
+
+   if (lz4ultra_compressor_is_incompressible(pCompressor, pInWindow, nPreviousBlockSize, nInDataSize))
+      return -1;
+
+   if (pDictionary && pDictionary->nSize == nPreviousBlockSize)
+      nResult = lz4ultra_build_suffix_array_dict(pCompressor, pDictionary, pInWindow, nPreviousBlockSize + nInDataSize);
+   else
+      nResult = lz4ultra_build_suffix_array(pCompressor, pInWindow, nPreviousBlockSize + nInDataSize);
+   if (nResult)
+      return -1;
+   lz4ultra_compressor_end_phase(pCompressor, LZ4ULTRA_PHASE_INTERVALS);
+   if (nPreviousBlockSize) {
+      lz4ultra_skip_matches(pCompressor, 0, nPreviousBlockSize);
+      lz4ultra_compressor_end_phase(pCompressor, LZ4ULTRA_PHASE_SKIP_MATCHES);
+   }
+   lz4ultra_find_all_matches(pCompressor, pInWindow, nPreviousBlockSize, nPreviousBlockSize + nInDataSize);
+   lz4ultra_compressor_end_phase(pCompressor, LZ4ULTRA_PHASE_FIND_MATCHES);
+   lz4ultra_compressor_count_matches(pCompressor, nPreviousBlockSize, nPreviousBlockSize + nInDataSize, 1);
+
+   return lz4ultra_optimize_and_write_block(pCompressor, pInWindow, nPreviousBlockSize, nInDataSize, pOutData, nMaxOutDataSize);
+}
+
+/**
+ * Get the size of a run of chunks of one kind, that ends where a long enough run of the other kind starts; shorter runs of the other kind are absorbed
+ *
+ * @param pChunkIsIncompressible kind of each chunk: 1 if it is estimated to be incompressible, 0 if not
+ * @param nChunks number of chunks
+ * @param nIsIncompressible kind of the run
+ * @param nMinOtherRunSize minimum size of a run of the other kind that ends this run, in bytes
+ * @param nInDataSize number of bytes in all the chunks
+ *
+ * @return size of the run, in bytes
+ */
+static int lz4ultra_get_adaptive_run_size(const unsigned char *pChunkIsIncompressible, const int nChunks, const int nIsIncompressible, const int nMinOtherRunSize, const int nInDataSize) {
+   int nRunEndChunk = 0;
+   int i;
+
+   for (i = 0; i < nChunks; i++) {
+      if (pChunkIsIncompressible[i] == nIsIncompressible)
+         nRunEndChunk = i + 1;
+      else if ((i + 1 - nRunEndChunk) * ADAPTIVE_CHUNK_SIZE >= nMinOtherRunSize)
+         return nRunEndChunk * ADAPTIVE_CHUNK_SIZE;
+   }
+
+   return nInDataSize;
+}
+
+/**
+ * Get the size of the next block to compress, ending it early where the data changes between compressible and incompressible runs, according to a
+ * quick estimate of the savings of 4-byte matches in each chunk. Only runs of at least ADAPTIVE_MIN_RUN_SIZE bytes of the other kind end the block
+ *
+ * @param pInData pointer to the input data that the next block starts at
+ * @param nInDataSize number of bytes available for the next block (up to the maximum block size)
+ * @param pIsIncompressible pointer to returned flag, set to 1 if the block is estimated to be incompressible, so that it should be stored
+ *                          uncompressed without searching for matches, or 0 if it should be compressed
+ *
+ * @return size of the next block, in bytes
+ */
+int lz4ultra_get_adaptive_block_size(const unsigned char *pInData, const int nInDataSize, int *pIsIncompressible) {
+   int nHashTable[1 << ADAPTIVE_HASH_BITS];
+   unsigned char cChunkIsIncompressible[0x400000 / ADAPTIVE_CHUNK_SIZE];
+   const int nChunks = (nInDataSize + ADAPTIVE_CHUNK_SIZE - 1) / ADAPTIVE_CHUNK_SIZE;
+   int nBlockSize;
+   int i;
+
+   *pIsIncompressible = 0;
+   if (nInDataSize <= 0 || nChunks > (int)sizeof(cChunkIsIncompressible))
+      return nInDataSize;
+
+   memset(nHashTable, 0, sizeof(nHashTable));
+   for (i = 0; i < nChunks; i++) {
+      const int nOffset = i * ADAPTIVE_CHUNK_SIZE;
+      const int nChunkSize = ((nInDataSize - nOffset) > ADAPTIVE_CHUNK_SIZE) ? ADAPTIVE_CHUNK_SIZE : (nInDataSize - nOffset);
+
+      cChunkIsIncompressible[i] = (lz4ultra_estimate_chunk_savings(pInData, nOffset, nOffset + nChunkSize, nHashTable, ADAPTIVE_HASH_BITS, 1) < (nChunkSize >> ADAPTIVE_MIN_SAVINGS_SHIFT)) ? 1 : 0;
+   }
+
+   if (cChunkIsIncompressible[0]) {
+      /* Only store a run uncompressed if it is long enough; the first chunks have the least history to match with, and are more often
+       * estimated wrong. The run ends at the first compressible chunk, as storing compressible data as is costs more than an extra block */
+      nBlockSize = lz4ultra_get_adaptive_run_size(cChunkIsIncompressible, nChunks, 1, ADAPTIVE_CHUNK_SIZE, nInDataSize);
+      if (nBlockSize >= ADAPTIVE_MIN_RUN_SIZE || nBlockSize == nInDataSize) {
+         *pIsIncompressible = 1;
+         return nBlockSize;
+      }
+   }
+
+   return lz4ultra_get_adaptive_run_size(cChunkIsIncompressible, nChunks, 0, ADAPTIVE_MIN_RUN_SIZE, nInDataSize);
+}
+
+/**
+ * Get the number of compression commands issued in compressed data blocks
+ *
+ * @return number of commands
+ */
+int lz4ultra_compressor_get_command_count(lz4ultra_compressor *pCompressor) {
+   return pCompressor->num_commands;
+}
+
+/**
+ * Get the amount of memory allocated by a compression context
+ *
+ * @param pCompressor compression context
+ *
+ * @return size in bytes
+ */
+size_t lz4ultra_compressor_get_memory_size(lz4ultra_compressor *pCompressor) {
+   return pCompressor->memory_size;
+}
+
+/**
+ * Create reusable compression context. Memory is only allocated when compressing, for the block size that is actually used, and
+ * is then kept for subsequent calls.
+ *
+ * @param nThreads number of threads to compress with (1 for single-threaded compression)
+ *
+ * @return compression context, or NULL for failure
+ */
+lz4ultra_ctx *lz4ultra_ctx_create(int nThreads) {
+   lz4ultra_ctx *pCtx;
+
+   if (nThreads < 1)
+      nThreads = 1;
+
+   pCtx = (lz4ultra_ctx *)malloc(sizeof(lz4ultra_ctx));
+   if (!pCtx)
+      return NULL;
+
+   pCtx->nThreads = nThreads;
+   pCtx->pPool = NULL;
+   pCtx->pInWindow = NULL;
+   pCtx->nInWindowSize = 0;
+   pCtx->nDecodeCost = 0;
+   pCtx->nMatchCandidates = 1;
+   memset(&pCtx->allocator, 0, sizeof(lz4ultra_allocator));
+   pCtx->pThreads = (lz4ultra_thread_ctx *)malloc(nThreads * sizeof(lz4ultra_thread_ctx));
+   if (!pCtx->pThreads) {
+      free(pCtx);
+      return NULL;
+   }
+
+   memset(pCtx->pThreads, 0, nThreads * sizeof(lz4ultra_thread_ctx));
+   return pCtx;
+}
+
+/**
+ * Reset reusable compression context before compressing unrelated data, keeping all allocated memory
+ *
+ * @param pCtx compression context
+ */
+void lz4ultra_ctx_reset(lz4ultra_ctx *pCtx) {
+   int i;
+
+   for (i = 0; i < pCtx->nThreads; i++) {
+      pCtx->pThreads[i].compressor.num_commands = 0;
+      memset(&pCtx->pThreads[i].compressor.stats, 0, sizeof(lz4ultra_stats));
+   }
+}
+
+/**
+ * Free up reusable compression context and all associated resources
+ *
+ * @param pCtx compression context, or NULL for none
+ */
+void lz4ultra_ctx_destroy(lz4ultra_ctx *pCtx) {
+   int i;
+
+   if (!pCtx)
+      return;
+
+   if (pCtx->pPool) {
+      lz4ultra_threadpool_destroy(pCtx->pPool);
+      pCtx->pPool = NULL;
+   }
+
+   for (i = 0; i < pCtx->nThreads; i++) {
+      lz4ultra_thread_ctx *pThread = &pCtx->pThreads[i];
+
+      if (pThread->nMaxWindowSize) {
+         lz4ultra_compressor_destroy(&pThread->compressor);
+         pThread->nMaxWindowSize = 0;
+      }
+
+      if (pThread->pOutData) {
+         lz4ultra_free(&pThread->allocator, pThread->pOutData);
+         pThread->pOutData = NULL;
+      }
+
+      if (pThread->pVerifyData) {
+         lz4ultra_free(&pThread->allocator, pThread->pVerifyData);
+         pThread->pVerifyData = NULL;
+      }
+   }
+
+   if (pCtx->pInWindow) {
+      lz4ultra_free(&pCtx->allocator, pCtx->pInWindow);
+      pCtx->pInWindow = NULL;
+   }
+
+   free(pCtx->pThreads);
+   pCtx->pThreads = NULL;
+
+   free(pCtx);
+}
+
+/**
+ * Make sure that the compression contexts for the specified number of threads are initialized for a window size, growing them if required
+ *
+ * @param pCtx compression context
+ * @param nThreads number of threads to initialize compression contexts for (at most the number of threads that the context was created with)
+ * @param nMaxWindowSize maximum size of input data window (previously compressed bytes + bytes to compress)
+ * @param nFlags compression flags
+ * @param nCompressionLevel compression level (LZ4ULTRA_MIN_LEVEL..LZ4ULTRA_MAX_LEVEL, out of range values select LZ4ULTRA_MAX_LEVEL)
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int lz4ultra_ctx_prepare(lz4ultra_ctx *pCtx, const int nThreads, const int nMaxWindowSize, const int nFlags, int nCompressionLevel) {
+   int nUseSuffixArray;
+   int i;
+
+   if (nThreads < 1 || nThreads > pCtx->nThreads)
+      return 100;
+
+   if (nCompressionLevel < LZ4ULTRA_MIN_LEVEL || nCompressionLevel > LZ4ULTRA_MAX_LEVEL)
+      nCompressionLevel = LZ4ULTRA_MAX_LEVEL;
+   nUseSuffixArray = (nCompressionLevel >= LZ4ULTRA_MAX_LEVEL) ? 1 : 0;
+
+   for (i = 0; i < nThreads; i++) {
+      lz4ultra_thread_ctx *pThread = &pCtx->pThreads[i];
+
+      /* Reinitialize when the window grows, or when switching between the suffix array and hash chain match finders */
+      if (pThread->nMaxWindowSize < nMaxWindowSize ||
+         (pThread->nMaxWindowSize && ((pThread->compressor.level >= LZ4ULTRA_MAX_LEVEL) ? 1 : 0) != nUseSuffixArray)) {
+         if (pThread->nMaxWindowSize) {
+            lz4ultra_compressor_destroy(&pThread->compressor);
+            pThread->nMaxWindowSize = 0;
+         }
+
+         if (lz4ultra_compressor_init(&pThread->compressor, &pThread->allocator, nMaxWindowSize, nFlags, nCompressionLevel))
+            return 100;
+         pThread->nMaxWindowSize = nMaxWindowSize;
+      }
+
+      if (nUseSuffixArray && pThread->compressor.match_candidates != pCtx->nMatchCandidates) {
+         if (lz4ultra_compressor_set_match_candidates(&pThread->compressor, pThread->nMaxWindowSize, pCtx->nMatchCandidates))
+            return 100;
+      }
+
+      pThread->compressor.level = nCompressionLevel;
+      pThread->compressor.flags = nFlags;
+      pThread->compressor.decode_cost = pCtx->nDecodeCost;
+   }
+
+   if (pCtx->nThreads > 1 && !pCtx->pPool) {
+      pCtx->pPool = lz4ultra_threadpool_create(pCtx->nThreads);
+      if (!pCtx->pPool)
+         return 100;
+   }
+
+   return 0;
+}
+
+/**
+ * Run suffix sorting jobs on a thread pool
+ *
+ * @param pRunner thread pool
+ * @param pJobFunc job function
+ * @param pUserData opaque pointer passed to the job function
+ * @param nJobs number of jobs to run
+ */
+static void lz4ultra_ctx_run_divsufsort_jobs(void *pRunner, divsufsort_job_t pJobFunc, void *pUserData, const int nJobs) {
+   lz4ultra_threadpool_run((lz4ultra_threadpool *)pRunner, pJobFunc, pUserData, nJobs);
+}
+
+/**
+ * Set the allocator that a reusable compression context takes its memory from, instead of malloc(), for instance to use a pool of huge pages, or
+ * memory that is local to the NUMA node of each thread. It must be set before the memory is allocated, that is before compressing. The context
+ * itself is still allocated with malloc() by lz4ultra_ctx_create()
+ *
+ * @param pCtx compression context
+ * @param nThread index of the thread whose compression context and streaming output buffer are taken from the allocator, or -1 for all the
+ *                threads, and for the input window and the state of each compression call, that are shared by the threads
+ * @param pAllocator allocator, that is copied, or NULL to use malloc()
+ *
+ * @return 0 for success, non-zero for failure (invalid thread, or memory already allocated)
+ */
+int lz4ultra_ctx_set_allocator(lz4ultra_ctx *pCtx, const int nThread, const lz4ultra_allocator *pAllocator) {
+   lz4ultra_allocator allocator;
+   int i;
+
+   if (nThread < -1 || nThread >= pCtx->nThreads)
+      return 100;
+
+   if (pAllocator && pAllocator->alloc_mem && !pAllocator->free_mem)
+      return 100;
+
+   if (pAllocator)
+      allocator = *pAllocator;
+   else
+      memset(&allocator, 0, sizeof(lz4ultra_allocator));
+
+   for (i = 0; i < pCtx->nThreads; i++) {
+      lz4ultra_thread_ctx *pThread = &pCtx->pThreads[i];
+
+      if ((nThread < 0 || nThread == i) && (pThread->nMaxWindowSize || pThread->nMaxBlockSize || pThread->nMaxVerifySize))
+         return 100;
+   }
+   if (nThread < 0 && pCtx->nInWindowSize)
+      return 100;
+
+   for (i = 0; i < pCtx->nThreads; i++) {
+      if (nThread < 0 || nThread == i)
+         pCtx->pThreads[i].allocator = allocator;
+   }
+   if (nThread < 0)
+      pCtx->allocator = allocator;
+
+   return 0;
+}
+
+/**
+ * Set the weight of the modeled decompression time in the optimal parse of the best compression level: instead of the smallest output, the parser
+ * then picks the commands that minimize the output size plus the modeled time of each token and of its slow decompression paths
+ *
+ * @param pCtx compression context
+ * @param nDecodeCost bits of compressed data that one unit of modeled decompression time (about a nanosecond) is worth, or 0 to only minimize the size (default)
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int lz4ultra_ctx_set_decode_cost(lz4ultra_ctx *pCtx, const int nDecodeCost) {
+   if (nDecodeCost < 0 || nDecodeCost > LZ4ULTRA_MAX_DECODE_COST)
+      return 100;
+
+   pCtx->nDecodeCost = nDecodeCost;
+   return 0;
+}
+
+/**
+ * Set the number of match candidates that the best compression level keeps for each position: the longest match, and then shorter matches
+ * with closer offsets, that the optimal parser also considers. More candidates use more memory and compress more slowly
+ *
+ * @param pCtx compression context
+ * @param nMatchCandidates number of match candidates (1..LZ4ULTRA_MAX_MATCH_CANDIDATES, 1 to only keep the longest match, default)
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int lz4ultra_ctx_set_match_candidates(lz4ultra_ctx *pCtx, const int nMatchCandidates) {
+   if (nMatchCandidates < 1 || nMatchCandidates > LZ4ULTRA_MAX_MATCH_CANDIDATES)
+      return 100;
+
+   pCtx->nMatchCandidates = nMatchCandidates;
+   return 0;
+}
+
+/**
+ * Set the number of blocks that are about to be compressed at the same time. When there is only one, the first thread's
+ * compression context sorts the block's suffixes on all the threads of the pool, which would otherwise be idle
+ *
+ * @param pCtx compression context
+ * @param nBlocks number of blocks compressed in parallel
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int lz4ultra_ctx_set_parallel_blocks(lz4ultra_ctx *pCtx, const int nBlocks) {
+   lz4ultra_thread_ctx *pThread = &pCtx->pThreads[0];
+   divsufsort_ctx_t *pDivSufSortCtx = &pThread->compressor.divsufsort_context;
+
+   if (!pThread->nMaxWindowSize || pThread->compressor.level < LZ4ULTRA_MAX_LEVEL)
+      return 0;
+
+   /* Blocks compressed in parallel already keep the pool busy, and can't run jobs on it themselves */
+   if (nBlocks == 1 && pCtx->pPool)
+      return divsufsort_set_threads(pDivSufSortCtx, lz4ultra_threadpool_get_thread_count(pCtx->pPool), lz4ultra_ctx_run_divsufsort_jobs, pCtx->pPool);
+   else
+      return divsufsort_set_threads(pDivSufSortCtx, 1, NULL, NULL);
+}
+
+/**
+ * Make sure that streaming buffers for the specified number of threads are allocated for a block size, and that the input window is at least
+ * as large as requested, growing them if required. The contents of the input window are preserved when it grows
+ *
+ * @param pCtx compression context
+ * @param nThreads number of threads to allocate buffers for (at most the number of threads that the context was created with)
+ * @param nBlockMaxSize maximum block size, in bytes
+ * @param nInWindowSize minimum size of the input window, in bytes, or 0 if it isn't needed
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int lz4ultra_ctx_prepare_stream_buffers(lz4ultra_ctx *pCtx, const int nThreads, const int nBlockMaxSize, const int nInWindowSize) {
+   int i;
+
+   if (nThreads < 1 || nThreads > pCtx->nThreads)
+      return 100;
+
+   if (pCtx->nInWindowSize < nInWindowSize) {
+      unsigned char *pNewInWindow = (unsigned char*)lz4ultra_alloc(&pCtx->allocator, nInWindowSize);
+      if (!pNewInWindow)
+         return 100;
+
+      if (pCtx->pInWindow) {
+         memcpy(pNewInWindow, pCtx->pInWindow, pCtx->nInWindowSize);
+         lz4ultra_free(&pCtx->allocator, pCtx->pInWindow);
+      }
+      memset(pNewInWindow + pCtx->nInWindowSize, 0, nInWindowSize - pCtx->nInWindowSize);
+      pCtx->pInWindow = pNewInWindow;
+      pCtx->nInWindowSize = nInWindowSize;
+   }
+
+   for (i = 0; i < nThreads; i++) {
+      lz4ultra_thread_ctx *pThread = &pCtx->pThreads[i];
+
+      if (pThread->nMaxBlockSize < nBlockMaxSize) {
+         if (pThread->pOutData) {
+            lz4ultra_free(&pThread->allocator, pThread->pOutData);
+            pThread->pOutData = NULL;
+         }
+
+         pThread->nMaxBlockSize = 0;
+
+         pThread->pOutData = (unsigned char*)lz4ultra_alloc(&pThread->allocator, nBlockMaxSize);
+         if (!pThread->pOutData)
+            return 100;
+
+         pThread->nMaxBlockSize = nBlockMaxSize;
+      }
+   }
+
+   return 0;
+}
+
+/**
+ * Make sure that the buffers that blocks are decompressed back into, to verify them with LZ4ULTRA_FLAG_VERIFY, are allocated for the specified
+ * number of threads and block size, growing them if required
+ *
+ * @param pCtx compression context
+ * @param nThreads number of threads to allocate buffers for (at most the number of threads that the context was created with)
+ * @param nBlockMaxSize maximum block size, in bytes
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int lz4ultra_ctx_prepare_verify_buffers(lz4ultra_ctx *pCtx, const int nThreads, const int nBlockMaxSize) {
+   /* Each block is decompressed after (at most) the window of history that its matches can reach */
+   const int nVerifySize = HISTORY_SIZE + nBlockMaxSize;
+   int i;
+
+   if (nThreads < 1 || nThreads > pCtx->nThreads)
+      return 100;
+
+   for (i = 0; i < nThreads; i++) {
+      lz4ultra_thread_ctx *pThread = &pCtx->pThreads[i];
+
+      if (pThread->nMaxVerifySize < nVerifySize) {
+         if (pThread->pVerifyData) {
+            lz4ultra_free(&pThread->allocator, pThread->pVerifyData);
+            pThread->pVerifyData = NULL;
+         }
+
+         pThread->nMaxVerifySize = 0;
+
+         pThread->pVerifyData = (unsigned char*)lz4ultra_alloc(&pThread->allocator, nVerifySize);
+         if (!pThread->pVerifyData)
+            return 100;
+
+         pThread->nMaxVerifySize = nVerifySize;
+      }
+   }
+
+   return 0;
+}
+
+/**
+ * Get the total amount of memory allocated by a reusable compression context
+ *
+ * @param pCtx compression context
+ *
+ * @return size in bytes
+ */
+size_t lz4ultra_ctx_get_memory_size(lz4ultra_ctx *pCtx) {
+   size_t nMemorySize = 0;
+   int i;
+
+   for (i = 0; i < pCtx->nThreads; i++) {
+      lz4ultra_thread_ctx *pThread = &pCtx->pThreads[i];
+
+      if (pThread->nMaxWindowSize)
+         nMemorySize += lz4ultra_compressor_get_memory_size(&pThread->compressor);
+      if (pThread->nMaxBlockSize)
+         nMemorySize += (size_t)pThread->nMaxBlockSize;
+      if (pThread->nMaxVerifySize)
+         nMemorySize += (size_t)pThread->nMaxVerifySize;
+   }
+   nMemorySize += (size_t)pCtx->nInWindowSize;
+
+   return nMemorySize;
+}
+
+/**
+ * Get the total number of compression commands issued in compressed data blocks by all the threads of a compression context
+ *
+ * @param pCtx compression context
+ *
+ * @return number of commands
+ */
+int lz4ultra_ctx_get_command_count(lz4ultra_ctx *pCtx) {
+   int nCommandCount = 0;
+   int i;
+
+   for (i = 0; i < pCtx->nThreads; i++) {
+      if (pCtx->pThreads[i].nMaxWindowSize)
+         nCommandCount += lz4ultra_compressor_get_command_count(&pCtx->pThreads[i].compressor);
+   }
+
+   return nCommandCount;
+}
+
+/**
+ * Get the compression statistics of all the threads of a compression context, accumulated since the context was last reset
+ *
+ * @param pCtx compression context
+ * @param pStats pointer to returned statistics
+ */
+void lz4ultra_ctx_get_stats(lz4ultra_ctx *pCtx, lz4ultra_stats *pStats) {
+   int i, j;
+
+   memset(pStats, 0, sizeof(lz4ultra_stats));
+
+   for (i = 0; i < pCtx->nThreads; i++) {
+      const lz4ultra_stats *pThreadStats = &pCtx->pThreads[i].compressor.stats;
+
+      if (!pCtx->pThreads[i].nMaxWindowSize)
+         continue;
+
+      for (j = 0; j < LZ4ULTRA_NUM_PHASES; j++)
+         pStats->phase_time[j] += pThreadStats->phase_time[j];
+      pStats->num_blocks += pThreadStats->num_blocks;
+      pStats->bytes_processed += pThreadStats->bytes_processed;
+      pStats->matches_found += pThreadStats->matches_found;
+      pStats->match_bytes_found += pThreadStats->match_bytes_found;
+      pStats->num_tokens += pThreadStats->num_tokens;
+      pStats->literal_bytes += pThreadStats->literal_bytes;
+      pStats->match_bytes += pThreadStats->match_bytes;
+      pStats->joined_matches += pThreadStats->joined_matches;
+      pStats->reduced_matches += pThreadStats->reduced_matches;
+   }
+}
@@ -1,109 +1,303 @@
-/*
- * shrink_context.h - compression context definitions
- *
- * Copyright (C) 2019 Emmanuel Marty
- *
- * This software is provided 'as-is', without any express or implied
- * warranty.  In no event will the authors be held liable for any damages
- * arising from the use of this software.
- *
- * Permission is granted to anyone to use this software for any purpose,
- * including commercial applications, and to alter it and redistribute it
- * freely, subject to the following restrictions:
- *
- * 1. The origin of this software must not be misrepresented; you must not
- *    claim that you wrote the original software. If you use this software
- *    in a product, an acknowledgment in the product documentation would be
- *    appreciated but is not required.
- * 2. Altered source versions must be plainly marked as such, and must not be
- *    misrepresented as being the original software.
- * 3. This notice may not be removed or altered from any source distribution.
- */
-
-/*
- * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
- *
- * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
- * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
- * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
- * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
- *
- */
-
-#ifndef _SHRINK_CONTEXT_H
-#define _SHRINK_CONTEXT_H
-
-#include "divsufsort.h"
-
-#define LCP_BITS 15
-#define LCP_MAX (1LL<<(LCP_BITS - 1))
-#define LCP_SHIFT (39-LCP_BITS)
-#define LCP_MASK (((1ULL<<LCP_BITS) - 1) << LCP_SHIFT)
-#define POS_MASK ((1ULL<<LCP_SHIFT) - 1)
-#define VISITED_FLAG 0x8000000000ULL
-#define EXCL_VISITED_MASK  0x7fffffffffULL
-
-#define LEAVE_ALONE_MATCH_SIZE 1100
-
-#define LAST_MATCH_OFFSET 12
-#define LAST_LITERALS 5
-
-#define MODESWITCH_PENALTY 1
-
-/** One match */
-typedef struct _lz4ultra_match {
-   unsigned int length;
-   unsigned int offset;
-} lz4ultra_match;
-
-/** Compression context */
-typedef struct _lz4ultra_compressor {
-   divsufsort_ctx_t divsufsort_context;
-   unsigned long long *intervals;
-   unsigned long long *pos_data;
-   unsigned long long *open_intervals;
-   lz4ultra_match *match;
-   int flags;
-   int num_commands;
-} lz4ultra_compressor;
-
-/**
- * Initialize compression context
- *
- * @param pCompressor compression context to initialize
- * @param nMaxWindowSize maximum size of input data window (previously compressed bytes + bytes to compress)
- * @param nFlags compression flags
- *
- * @return 0 for success, non-zero for failure
- */
-int lz4ultra_compressor_init(lz4ultra_compressor *pCompressor, const int nMaxWindowSize, const int nFlags);
-
-/**
- * Clean up compression context and free up any associated resources
- *
- * @param pCompressor compression context to clean up
- */
-void lz4ultra_compressor_destroy(lz4ultra_compressor *pCompressor);
-
-/**
- * Compress one block of data
- *
- * @param pCompressor compression context
- * @param pInWindow pointer to input data window (previously compressed bytes + bytes to compress)
- * @param nPreviousBlockSize number of previously compressed bytes (or 0 for none)
- * @param nInDataSize number of input bytes to compress
- * @param pOutData pointer to output buffer
- * @param nMaxOutDataSize maximum size of output buffer, in bytes
- *
- * @return size of compressed data in output buffer, or -1 if the data is uncompressible
- */
-int lz4ultra_compressor_shrink_block(lz4ultra_compressor *pCompressor, const unsigned char *pInWindow, const int nPreviousBlockSize, const int nInDataSize, unsigned char *pOutData, const int nMaxOutDataSize);
-
-/**
- * Get the number of compression commands issued in compressed data blocks
- *
- * @return number of commands
- */
-int lz4ultra_compressor_get_command_count(lz4ultra_compressor *pCompressor);
-
-#endif /* _SHRINK_CONTEXT_H */
+/*
+ * shrink_context.h - compression context definitions
+ *
+ * Copyright (C) 2019 Emmanuel Marty
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*
+ * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
+ *
+ * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
+ * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
+ * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
+ * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
+ *
+ */
+
+#ifndef _SHRINK_CONTEXT_H
+#define _SHRINK_CONTEXT_H
+
+#include <stdlib.h>
+#include "divsufsort.h"
+#include "lz4ultra.h"
+#include "allocator.h"
+
+#define LCP_BITS 15
+#define LCP_MAX (1LL<<(LCP_BITS - 1))
+#define LCP_SHIFT (39-LCP_BITS)
+#define LCP_MASK (((1ULL<<LCP_BITS) - 1) << LCP_SHIFT)
+#define POS_MASK ((1ULL<<LCP_SHIFT) - 1)
+#define VISITED_FLAG 0x8000000000ULL
+#define EXCL_VISITED_MASK  0x7fffffffffULL
+
+/* Packed 32-bit LCP intervals, for windows of up to 512 Kb (64 and 256 Kb blocks with history) */
+#define LCP32_POS_BITS 19
+#define LCP32_BITS (31-LCP32_POS_BITS)
+#define LCP32_MAX (1U<<(LCP32_BITS - 1))
+#define LCP32_SHIFT (31-LCP32_BITS)
+#define LCP32_MASK (((1U<<LCP32_BITS) - 1) << LCP32_SHIFT)
+#define POS32_MASK ((1U<<LCP32_SHIFT) - 1)
+#define VISITED32_FLAG 0x80000000U
+#define EXCL_VISITED32_MASK  0x7fffffffU
+#define COMPACT_INTERVALS_MAX_WINDOW_SIZE (1<<LCP32_POS_BITS)
+
+/* Hash table size for the hash chain match finder of the fast compression levels */
+#define HASH_BITS 16
+#define HASH_SIZE (1<<HASH_BITS)
+
+#define LEAVE_ALONE_MATCH_SIZE 1100
+
+#define LAST_MATCH_OFFSET 12
+#define LAST_LITERALS 5
+
+#define MODESWITCH_PENALTY 1
+
+#define DIVSUFSORT_BUCKETS_SIZE ((256 + 256 * 256) * sizeof(saidx_t))   /**< size of the suffix sorting context's type A and B buckets */
+#define DIVSUFSORT_BSTAR_RANGES_SIZE (256 * 256 * sizeof(saidx_t))       /**< size of the ranges of the type B* buckets, to sort them on several threads */
+
+/* Adaptive block splitting, with LZ4ULTRA_FLAG_ADAPTIVE_BLOCKS */
+#define ADAPTIVE_CHUNK_SIZE 4096          /**< granularity of the compressibility estimate, in bytes */
+#define ADAPTIVE_MIN_RUN_SIZE 16384       /**< minimum size of a run of chunks of the other kind that ends a block early, in bytes */
+#define ADAPTIVE_MIN_SAVINGS_SHIFT 5      /**< a chunk is compressible if matches are estimated to save at least 1/32 of its size */
+#define ADAPTIVE_HASH_BITS 12
+
+/* Early-out for incompressible blocks, before building the suffix array */
+#define INCOMPRESSIBLE_MIN_BLOCK_SIZE 4096      /**< smallest block that is checked, in bytes */
+
+/* Modeled decompression time, in units of about one nanosecond of lz4ultra_decompressor_expand_block() on a 3 GHz x86-64 core, measured over
+ * mixes of fast and slow tokens so that the slow paths include their branch mispredictions */
+#define DECODE_TOKEN_COST          4     /**< token that takes the fast paths: up to 14 literals, then a match of up to 18 bytes with an offset of 16 or more */
+#define DECODE_LONG_LITERALS_COST  17    /**< extra time for 15 literals or more, with an extended length and a variable-sized copy */
+#define DECODE_LONG_MATCH_COST     17    /**< extra time for a match of 19 bytes or more, with an extended length and a copy loop */
+#define DECODE_SHORT_OFFSET_COST   22    /**< extra time for a match offset below 8, that is copied as a repeated pattern */
+#define DECODE_NEAR_OFFSET_COST    7     /**< extra time for a match offset of 8..15, that reads bytes just written by the previous copies */
+
+/** One match */
+typedef struct _lz4ultra_match {
+   unsigned int length;
+   unsigned int offset;
+} lz4ultra_match;
+
+/** One more match candidate at a position, shorter than the longest match, and with the same or a closer offset */
+typedef struct _lz4ultra_candidate {
+   unsigned short length;
+   unsigned short offset;
+} lz4ultra_candidate;
+
+/** Compression context */
+typedef struct _lz4ultra_compressor {
+   divsufsort_ctx_t divsufsort_context;
+   void *intervals;              /**< LCP intervals: unsigned long long entries, or packed unsigned int entries if compact_intervals is set */
+   void *pos_data;               /**< deepest LCP interval for each position, same entry size as intervals */
+   void *open_intervals;         /**< stack of open LCP intervals, same entry size as intervals */
+   lz4ultra_match *match;
+   lz4ultra_candidate *candidates;  /**< match_candidates - 1 shorter match candidates for each position, ending with a zero length when there are fewer, or NULL */
+   int *hash_heads;              /**< most recent position for each hash value, for fast compression levels */
+   int *hash_chain;              /**< previous position with the same hash, for each position in the window, for fast compression levels */
+   int compact_intervals;
+   int level;
+   int flags;
+   int match_candidates;         /**< number of match candidates that the suffix array match finder keeps for each position, 1 to only keep the longest match */
+   int decode_cost;              /**< weight of the modeled decompression time in the optimal parse, in bits of compressed data per DECODE_xxx_COST unit, or 0 to only minimize the size */
+   int num_commands;
+   size_t memory_size;
+   lz4ultra_stats stats;
+   long long phase_start_time;   /**< time at which the current compression phase started, when LZ4ULTRA_FLAG_STATS is set */
+   lz4ultra_allocator allocator; /**< allocator of this context's memory */
+} lz4ultra_compressor;
+
+/* Forward declarations */
+typedef struct _lz4ultra_threadpool lz4ultra_threadpool;
+typedef struct _lz4ultra_dictionary lz4ultra_dictionary;
+
+/** Compression context and streaming buffers owned by one thread */
+typedef struct _lz4ultra_thread_ctx {
+   lz4ultra_compressor compressor;
+   int nMaxWindowSize;           /**< window size that the compression context was initialized for, or 0 if it isn't initialized */
+   unsigned char *pOutData;      /**< streaming output buffer: one block of compressed data */
+   int nMaxBlockSize;            /**< block size that the streaming output buffer is allocated for, or 0 if it isn't allocated */
+   unsigned char *pVerifyData;   /**< verification buffer: the history and one block of data decompressed back, with LZ4ULTRA_FLAG_VERIFY */
+   int nMaxVerifySize;           /**< size of the verification buffer, or 0 if it isn't allocated */
+   lz4ultra_allocator allocator; /**< allocator of the compression context and of the streaming output buffer */
+} lz4ultra_thread_ctx;
+
+/** Reusable compression context, for compressing many buffers or streams without reallocating memory each time */
+typedef struct _lz4ultra_ctx {
+   int nThreads;
+   lz4ultra_thread_ctx *pThreads;
+   lz4ultra_threadpool *pPool;
+   unsigned char *pInWindow;     /**< streaming input window: history, followed by blocks of data to compress, read one after the other */
+   int nInWindowSize;            /**< size of the streaming input window, or 0 if it isn't allocated */
+   int nDecodeCost;              /**< weight of the modeled decompression time, set with lz4ultra_ctx_set_decode_cost() */
+   int nMatchCandidates;         /**< number of match candidates for each position, set with lz4ultra_ctx_set_match_candidates() */
+   lz4ultra_allocator allocator; /**< allocator of the input window and of the state of each compression call, set with lz4ultra_ctx_set_allocator() */
+} lz4ultra_ctx;
+
+/**
+ * Initialize compression context
+ *
+ * @param pCompressor compression context to initialize
+ * @param pAllocator allocator of the context's memory, or NULL to use malloc()
+ * @param nMaxWindowSize maximum size of input data window (previously compressed bytes + bytes to compress)
+ * @param nFlags compression flags
+ * @param nCompressionLevel compression level (LZ4ULTRA_MIN_LEVEL..LZ4ULTRA_MAX_LEVEL)
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int lz4ultra_compressor_init(lz4ultra_compressor *pCompressor, const lz4ultra_allocator *pAllocator, const int nMaxWindowSize, const int nFlags, const int nCompressionLevel);
+
+/**
+ * Get the amount of memory that a compression context allocates when it is initialized
+ *
+ * @param nMaxWindowSize maximum size of input data window (previously compressed bytes + bytes to compress)
+ * @param nCompressionLevel compression level (LZ4ULTRA_MIN_LEVEL..LZ4ULTRA_MAX_LEVEL)
+ * @param nMatchCandidates number of match candidates for each position, that the best compression level allocates room for
+ *
+ * @return size in bytes
+ */
+size_t lz4ultra_compressor_get_init_memory_size(const int nMaxWindowSize, const int nCompressionLevel, const int nMatchCandidates);
+
+/**
+ * Clean up compression context and free up any associated resources
+ *
+ * @param pCompressor compression context to clean up
+ */
+void lz4ultra_compressor_destroy(lz4ultra_compressor *pCompressor);
+
+/**
+ * Set the number of match candidates that a compression context using the suffix array match finder keeps for each position, allocating
+ * room for the shorter candidates
+ *
+ * @param pCompressor compression context
+ * @param nMaxWindowSize maximum size of input data window that the compression context was initialized for
+ * @param nMatchCandidates number of match candidates (1..LZ4ULTRA_MAX_MATCH_CANDIDATES)
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int lz4ultra_compressor_set_match_candidates(lz4ultra_compressor *pCompressor, const int nMaxWindowSize, const int nMatchCandidates);
+
+/**
+ * Get the size of the next block to compress, ending it early where the data changes between compressible and incompressible runs, according to a
+ * quick estimate of the savings of 4-byte matches in each chunk. Only runs of at least ADAPTIVE_MIN_RUN_SIZE bytes of the other kind end the block
+ *
+ * @param pInData pointer to the input data that the next block starts at
+ * @param nInDataSize number of bytes available for the next block (up to the maximum block size)
+ * @param pIsIncompressible pointer to returned flag, set to 1 if the block is estimated to be incompressible, so that it should be stored
+ *                          uncompressed without searching for matches, or 0 if it should be compressed
+ *
+ * @return size of the next block, in bytes
+ */
+int lz4ultra_get_adaptive_block_size(const unsigned char *pInData, const int nInDataSize, int *pIsIncompressible);
+
+/**
+ * Compress one block of data
+ *
+ * @param pCompressor compression context
+ * @param pDictionary prepared dictionary that the previously compressed bytes consist of, to merge the block's suffixes with its sorted suffixes, or NULL to sort them all
+ * @param pInWindow pointer to input data window (previously compressed bytes + bytes to compress)
+ * @param nPreviousBlockSize number of previously compressed bytes (or 0 for none)
+ * @param nInDataSize number of input bytes to compress
+ * @param pOutData pointer to output buffer
+ * @param nMaxOutDataSize maximum size of output buffer, in bytes
+ *
+ * @return size of compressed data in output buffer, or -1 if the data is uncompressible
+ */
+int lz4ultra_compressor_shrink_block(lz4ultra_compressor *pCompressor, const lz4ultra_dictionary *pDictionary, const unsigned char *pInWindow, const int nPreviousBlockSize, const int nInDataSize, unsigned char *pOutData, const int nMaxOutDataSize);
+
+/**
+ * Get the number of compression commands issued in compressed data blocks
+ *
+ * @return number of commands
+ */
+int lz4ultra_compressor_get_command_count(lz4ultra_compressor *pCompressor);
+
+/**
+ * Get the amount of memory allocated by a compression context
+ *
+ * @param pCompressor compression context
+ *
+ * @return size in bytes
+ */
+size_t lz4ultra_compressor_get_memory_size(lz4ultra_compressor *pCompressor);
+
+/**
+ * Start timing a compression phase, when LZ4ULTRA_FLAG_STATS is set
+ *
+ * @param pCompressor compression context
+ */
+void lz4ultra_compressor_start_phase(lz4ultra_compressor *pCompressor);
+
+/**
+ * Add the time elapsed since the current compression phase started to its statistics, and start timing the next phase, when LZ4ULTRA_FLAG_STATS is set
+ *
+ * @param pCompressor compression context
+ * @param nPhase phase that just ended (LZ4ULTRA_PHASE_xxx)
+ */
+void lz4ultra_compressor_end_phase(lz4ultra_compressor *pCompressor, const int nPhase);
+
+/**
+ * Make sure that the compression contexts for the specified number of threads are initialized for a window size, growing them if required
+ *
+ * @param pCtx compression context
+ * @param nThreads number of threads to initialize compression contexts for (at most the number of threads that the context was created with)
+ * @param nMaxWindowSize maximum size of input data window (previously compressed bytes + bytes to compress)
+ * @param nFlags compression flags
+ * @param nCompressionLevel compression level (LZ4ULTRA_MIN_LEVEL..LZ4ULTRA_MAX_LEVEL, out of range values select LZ4ULTRA_MAX_LEVEL)
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int lz4ultra_ctx_prepare(lz4ultra_ctx *pCtx, const int nThreads, const int nMaxWindowSize, const int nFlags, int nCompressionLevel);
+
+/**
+ * Set the number of blocks that are about to be compressed at the same time. When there is only one, the first thread's
+ * compression context sorts the block's suffixes on all the threads of the pool, which would otherwise be idle
+ *
+ * @param pCtx compression context
+ * @param nBlocks number of blocks compressed in parallel
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int lz4ultra_ctx_set_parallel_blocks(lz4ultra_ctx *pCtx, const int nBlocks);
+
+/**
+ * Make sure that streaming buffers for the specified number of threads are allocated for a block size, and that the input window is at least
+ * as large as requested, growing them if required. The contents of the input window are preserved when it grows
+ *
+ * @param pCtx compression context
+ * @param nThreads number of threads to allocate buffers for (at most the number of threads that the context was created with)
+ * @param nBlockMaxSize maximum block size, in bytes
+ * @param nInWindowSize minimum size of the input window, in bytes, or 0 if it isn't needed
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int lz4ultra_ctx_prepare_stream_buffers(lz4ultra_ctx *pCtx, const int nThreads, const int nBlockMaxSize, const int nInWindowSize);
+
+/**
+ * Make sure that the buffers that blocks are decompressed back into, to verify them with LZ4ULTRA_FLAG_VERIFY, are allocated for the specified
+ * number of threads and block size, growing them if required
+ *
+ * @param pCtx compression context
+ * @param nThreads number of threads to allocate buffers for (at most the number of threads that the context was created with)
+ * @param nBlockMaxSize maximum block size, in bytes
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int lz4ultra_ctx_prepare_verify_buffers(lz4ultra_ctx *pCtx, const int nThreads, const int nBlockMaxSize);
+
+#endif /* _SHRINK_CONTEXT_H */
@@ -1,251 +1,621 @@
-/*
- * shrink_inmem.c - in-memory compression implementation
- *
- * Copyright (C) 2019 Emmanuel Marty
- *
- * This software is provided 'as-is', without any express or implied
- * warranty.  In no event will the authors be held liable for any damages
- * arising from the use of this software.
- *
- * Permission is granted to anyone to use this software for any purpose,
- * including commercial applications, and to alter it and redistribute it
- * freely, subject to the following restrictions:
- *
- * 1. The origin of this software must not be misrepresented; you must not
- *    claim that you wrote the original software. If you use this software
- *    in a product, an acknowledgment in the product documentation would be
- *    appreciated but is not required.
- * 2. Altered source versions must be plainly marked as such, and must not be
- *    misrepresented as being the original software.
- * 3. This notice may not be removed or altered from any source distribution.
- */
-
-/*
- * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
- *
- * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
- * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
- * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
- * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
- *
- */
-
-#include <stdlib.h>
-#include <string.h>
-#include "shrink_inmem.h"
-#include "frame.h"
-#include "format.h"
-#include "lib.h"
-
-/**
- * Get maximum compressed size of input(source) data
- *
- * @param nInputSize input(source) size in bytes
- * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
- * @param nBlockMaxCode maximum block size code (4..7 for 64 Kb..4 Mb)
- *
- * @return maximum compressed size
- */
-size_t lz4ultra_get_max_compressed_size_inmem(size_t nInputSize, unsigned int nFlags, int nBlockMaxCode) {
-   int nBlockMaxBits;
-   int nBlockMaxSize;
-
-   if (nFlags & LZ4ULTRA_FLAG_LEGACY_FRAMES) {
-      nBlockMaxBits = 23;
-   }
-   else {
-      nBlockMaxBits = 8 + (nBlockMaxCode << 1);
-   }
-   nBlockMaxSize = 1 << nBlockMaxBits;
-
-   if (nInputSize < nBlockMaxSize && (nFlags & LZ4ULTRA_FLAG_LEGACY_FRAMES) == 0) {
-      /* If the entire input data is shorter than the specified block size, try to reduce the
-       * block size until is the smallest one that can fit the data */
-
-      do {
-         nBlockMaxBits = 8 + (nBlockMaxCode << 1);
-         nBlockMaxSize = 1 << nBlockMaxBits;
-
-         int nPrevBlockMaxBits = 8 + ((nBlockMaxCode - 1) << 1);
-         int nPrevBlockMaxSize = 1 << nPrevBlockMaxBits;
-         if (nBlockMaxCode > 4 && nPrevBlockMaxSize > nInputSize) {
-            nBlockMaxCode--;
-         }
-         else
-            break;
-      } while (1);
-   }
-
-   return LZ4ULTRA_MAX_HEADER_SIZE + ((nInputSize + (nBlockMaxSize - 1)) >> nBlockMaxBits) * LZ4ULTRA_FRAME_SIZE + nInputSize + LZ4ULTRA_FRAME_SIZE /* footer */;
-}
-
-/**
- * Compress memory
- *
- * @param pInputData pointer to input(source) data to compress
- * @param pOutBuffer buffer for compressed data
- * @param nInputSize input(source) size in bytes
- * @param nMaxOutBufferSize maximum capacity of compression buffer
- * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
- * @param nBlockMaxCode maximum block size code (4..7 for 64 Kb..4 Mb)
- *
- * @return actual compressed size, or -1 for error
- */
-size_t lz4ultra_compress_inmem(const unsigned char *pInputData, unsigned char *pOutBuffer, size_t nInputSize, size_t nMaxOutBufferSize, unsigned int nFlags, int nBlockMaxCode) {
-   lz4ultra_compressor compressor;
-   size_t nOriginalSize = 0L;
-   size_t nCompressedSize = 0L;
-   int nBlockMaxBits;
-   int nBlockMaxSize;
-   int nResult;
-   int nError = 0;
-
-   if (nFlags & LZ4ULTRA_FLAG_LEGACY_FRAMES) {
-      nBlockMaxBits = 23;
-      nFlags |= LZ4ULTRA_FLAG_INDEP_BLOCKS;
-   }
-   else {
-      nBlockMaxBits = 8 + (nBlockMaxCode << 1);
-   }
-   nBlockMaxSize = 1 << nBlockMaxBits;
-
-   if (nInputSize < nBlockMaxSize && (nFlags & LZ4ULTRA_FLAG_LEGACY_FRAMES) == 0) {
-      /* If the entire input data is shorter than the specified block size, try to reduce the
-       * block size until is the smallest one that can fit the data */
-
-      do {
-         nBlockMaxBits = 8 + (nBlockMaxCode << 1);
-         nBlockMaxSize = 1 << nBlockMaxBits;
-
-         int nPrevBlockMaxBits = 8 + ((nBlockMaxCode - 1) << 1);
-         int nPrevBlockMaxSize = 1 << nPrevBlockMaxBits;
-         if (nBlockMaxCode > 4 && nPrevBlockMaxSize > nInputSize) {
-            nBlockMaxCode--;
-         }
-         else
-            break;
-      } while (1);
-   }
-
-   nResult = lz4ultra_compressor_init(&compressor, nBlockMaxSize + HISTORY_SIZE, nFlags);
-   if (nResult != 0) {
-      return LZ4ULTRA_ERROR_MEMORY;
-   }
-
-   if ((nFlags & LZ4ULTRA_FLAG_RAW_BLOCK) == 0) {
-      int nHeaderSize = lz4ultra_encode_header(pOutBuffer + nCompressedSize, (int)(nMaxOutBufferSize - nCompressedSize), nFlags, nBlockMaxCode);
-      if (nHeaderSize < 0)
-         nError = LZ4ULTRA_ERROR_COMPRESSION;
-      else {
-         nCompressedSize += nHeaderSize;
-      }
-   }
-
-   int nPreviousBlockSize = 0;
-   int nNumBlocks = 0;
-
-   while (nOriginalSize < nInputSize && !nError) {
-      int nInDataSize;
-
-      nInDataSize = (int)(nInputSize - nOriginalSize);
-      if (nInDataSize > nBlockMaxSize)
-         nInDataSize = nBlockMaxSize;
-
-      if (nInDataSize > 0) {
-         if ((nFlags & LZ4ULTRA_FLAG_RAW_BLOCK) != 0 && (nNumBlocks || nInDataSize > 0x400000)) {
-            nError = LZ4ULTRA_ERROR_RAW_TOOLARGE;
-            break;
-         }
-
-         int nOutDataSize;
-         int nOutDataEnd = (int)(nMaxOutBufferSize - LZ4ULTRA_FRAME_SIZE - LZ4ULTRA_FRAME_SIZE /* footer */ - nCompressedSize);
-         int nHeaderOffset = LZ4ULTRA_FRAME_SIZE;
-
-         if ((nFlags & LZ4ULTRA_FLAG_RAW_BLOCK) != 0) {
-            nHeaderOffset = 0;
-            nOutDataEnd = (int)(nMaxOutBufferSize - nCompressedSize);
-         }
-
-         if (nOutDataEnd > nBlockMaxSize)
-            nOutDataEnd = nBlockMaxSize;
-
-         nOutDataSize = lz4ultra_compressor_shrink_block(&compressor, pInputData + nOriginalSize - nPreviousBlockSize, nPreviousBlockSize, nInDataSize, pOutBuffer + nHeaderOffset + nCompressedSize, nOutDataEnd);
-         if (nOutDataSize >= 0) {
-            int nFrameHeaderSize = 0;
-
-            /* Compressed block */
-
-            if ((nFlags & LZ4ULTRA_FLAG_RAW_BLOCK) == 0) {
-               nFrameHeaderSize = lz4ultra_encode_compressed_block_frame(pOutBuffer + nCompressedSize, (int)(nMaxOutBufferSize - nCompressedSize), nFlags, nOutDataSize);
-               if (nFrameHeaderSize < 0)
-                  nError = LZ4ULTRA_ERROR_COMPRESSION;
-            }
-
-            if (!nError) {
-               nOriginalSize += nInDataSize;
-               nCompressedSize += nFrameHeaderSize + nOutDataSize;
-            }
-         }
-         else {
-            /* Write uncompressible, literal block */
-
-            if ((nFlags & LZ4ULTRA_FLAG_RAW_BLOCK) != 0) {
-               /* Uncompressible data isn't supported by raw blocks */
-               nError = LZ4ULTRA_ERROR_RAW_UNCOMPRESSED;
-               break;
-            }
-
-            int nFrameHeaderSize;
-
-            nFrameHeaderSize = lz4ultra_encode_uncompressed_block_frame(pOutBuffer + nCompressedSize, (int)(nMaxOutBufferSize - nCompressedSize), nFlags, nInDataSize);
-            if (nFrameHeaderSize < 0)
-               nError = LZ4ULTRA_ERROR_COMPRESSION;
-            else {
-               if (nInDataSize > (nMaxOutBufferSize - (nCompressedSize + nFrameHeaderSize)))
-                  nError = LZ4ULTRA_ERROR_DST;
-               else {
-                  memcpy(pOutBuffer + nFrameHeaderSize + nCompressedSize, pInputData + nOriginalSize, nInDataSize);
-                  nOriginalSize += nInDataSize;
-                  nCompressedSize += nFrameHeaderSize + (long long)nInDataSize;
-               }
-            }
-         }
-
-         if (!(nFlags & LZ4ULTRA_FLAG_INDEP_BLOCKS)) {
-            nPreviousBlockSize = nInDataSize;
-            if (nPreviousBlockSize > HISTORY_SIZE)
-               nPreviousBlockSize = HISTORY_SIZE;
-         }
-         else {
-            nPreviousBlockSize = 0;
-         }
-
-         nNumBlocks++;
-      }
-   }
-
-   int nFooterSize;
-
-   if ((nFlags & LZ4ULTRA_FLAG_RAW_BLOCK) != 0) {
-      nFooterSize = 0;
-   }
-   else {
-      nFooterSize = lz4ultra_encode_footer_frame(pOutBuffer + nCompressedSize, (int)(nMaxOutBufferSize - nCompressedSize), nFlags);
-      if (nFooterSize < 0)
-         nError = LZ4ULTRA_ERROR_COMPRESSION;
-   }
-
-   if (!nError) {
-      nCompressedSize += nFooterSize;
-   }
-
-
-   lz4ultra_compressor_destroy(&compressor);
-
-   if (nError) {
-      return -1;
-   }
-   else {
-      return nCompressedSize;
-   }
-}
+/*
+ * shrink_inmem.c - in-memory compression implementation
+ *
+ * Copyright (C) 2019 Emmanuel Marty
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*
+ * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
+ *
+ * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
+ * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
+ * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
+ * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "shrink_inmem.h"
+#include "frame.h"
+#include "format.h"
+#include "lib.h"
+#define XXH_STATIC_LINKING_ONLY
+#include "xxhash.h"
+#include "threadpool.h"
+
+/**
+ * Get the block size code to compress input data with: the smallest block size that fits all the data, if it is shorter than the specified
+ * maximum block size
+ *
+ * @param nInputSize input(source) size in bytes
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
+ * @param nBlockMaxCode maximum block size code (4..7 for 64 Kb..4 Mb)
+ *
+ * @return block size code
+ */
+static int lz4ultra_get_inmem_block_max_code(size_t nInputSize, unsigned int nFlags, int nBlockMaxCode) {
+   if (nFlags & LZ4ULTRA_FLAG_LEGACY_FRAMES)
+      return nBlockMaxCode;
+
+   /* If the entire input data is shorter than the specified block size, try to reduce the
+    * block size until is the smallest one that can fit the data */
+   while (nBlockMaxCode > 4 && (size_t)(1 << (8 + ((nBlockMaxCode - 1) << 1))) > nInputSize)
+      nBlockMaxCode--;
+
+   return nBlockMaxCode;
+}
+
+/**
+ * Get maximum compressed size of input(source) data
+ *
+ * @param nInputSize input(source) size in bytes
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
+ * @param nBlockMaxCode maximum block size code (4..7 for 64 Kb..4 Mb)
+ *
+ * @return maximum compressed size
+ */
+size_t lz4ultra_get_max_compressed_size_inmem(size_t nInputSize, unsigned int nFlags, int nBlockMaxCode) {
+   int nBlockMaxBits;
+   int nBlockMaxSize;
+
+   if (nFlags & LZ4ULTRA_FLAG_RAW_TABLE) {
+      /* Table of block ends, followed by blocks that are at most stored as is */
+      nBlockMaxBits = 8 + (lz4ultra_get_inmem_block_max_code(nInputSize, 0, nBlockMaxCode) << 1);
+      nBlockMaxSize = 1 << nBlockMaxBits;
+      return RAW_TABLE_HEADER_SIZE + ((nInputSize + (nBlockMaxSize - 1)) >> nBlockMaxBits) * RAW_TABLE_ENTRY_SIZE + nInputSize;
+   }
+
+   if (nFlags & LZ4ULTRA_FLAG_LEGACY_FRAMES) {
+      nBlockMaxBits = 23;
+   }
+   else {
+      nBlockMaxBits = 8 + (nBlockMaxCode << 1);
+   }
+   nBlockMaxSize = 1 << nBlockMaxBits;
+
+   if (nInputSize < nBlockMaxSize && (nFlags & LZ4ULTRA_FLAG_LEGACY_FRAMES) == 0) {
+      /* If the entire input data is shorter than the specified block size, try to reduce the
+       * block size until is the smallest one that can fit the data */
+
+      do {
+         nBlockMaxBits = 8 + (nBlockMaxCode << 1);
+         nBlockMaxSize = 1 << nBlockMaxBits;
+
+         int nPrevBlockMaxBits = 8 + ((nBlockMaxCode - 1) << 1);
+         int nPrevBlockMaxSize = 1 << nPrevBlockMaxBits;
+         if (nBlockMaxCode > 4 && nPrevBlockMaxSize > nInputSize) {
+            nBlockMaxCode--;
+         }
+         else
+            break;
+      } while (1);
+   }
+
+   return LZ4ULTRA_MAX_HEADER_SIZE + ((nInputSize + (nBlockMaxSize - 1)) >> nBlockMaxBits) * (LZ4ULTRA_FRAME_SIZE + lz4ultra_get_block_checksum_size(nFlags)) + nInputSize +
+      LZ4ULTRA_FRAME_SIZE /* footer */ + lz4ultra_get_content_checksum_size(nFlags);
+}
+
+/**
+ * Get the compression flags that in-memory compression actually uses: legacy frames and raw block tables always have independent blocks, and raw
+ * blocks, raw block tables and legacy frames have nowhere to store checksums, nor blocks that end early
+ *
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
+ *
+ * @return compression flags
+ */
+static unsigned int lz4ultra_get_inmem_flags(unsigned int nFlags) {
+   if (nFlags & LZ4ULTRA_FLAG_RAW_TABLE)
+      nFlags = (nFlags & ~(LZ4ULTRA_FLAG_RAW_BLOCK | LZ4ULTRA_FLAG_LEGACY_FRAMES)) | LZ4ULTRA_FLAG_INDEP_BLOCKS;
+   if (nFlags & LZ4ULTRA_FLAG_LEGACY_FRAMES)
+      nFlags |= LZ4ULTRA_FLAG_INDEP_BLOCKS;
+   if (nFlags & (LZ4ULTRA_FLAG_RAW_BLOCK | LZ4ULTRA_FLAG_RAW_TABLE | LZ4ULTRA_FLAG_LEGACY_FRAMES))
+      nFlags &= ~(LZ4ULTRA_FLAG_BLOCK_CHECKSUM | LZ4ULTRA_FLAG_CONTENT_CHECKSUM | LZ4ULTRA_FLAG_ADAPTIVE_BLOCKS);
+   return nFlags;
+}
+
+/**
+ * Get the maximum block size for a block size code
+ *
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
+ * @param nBlockMaxCode block size code (4..7 for 64 Kb..4 Mb), ignored for legacy frames
+ *
+ * @return block size in bytes
+ */
+static int lz4ultra_get_inmem_block_max_size(const unsigned int nFlags, const int nBlockMaxCode) {
+   if (nFlags & LZ4ULTRA_FLAG_LEGACY_FRAMES)
+      return 1 << 23;
+   else
+      return 1 << (8 + (nBlockMaxCode << 1));
+}
+
+/**
+ * Write a little-endian 32-bit value to a raw block table
+ *
+ * @param pData pointer to value
+ * @param nValue value to write
+ */
+static inline void lz4ultra_raw_table_write_u32(unsigned char *pData, const unsigned int nValue) {
+   pData[0] = nValue & 0xff;
+   pData[1] = (nValue >> 8) & 0xff;
+   pData[2] = (nValue >> 16) & 0xff;
+   pData[3] = (nValue >> 24) & 0xff;
+}
+
+/** Blocks of a raw block table, shared with the worker threads */
+typedef struct {
+   lz4ultra_ctx *pCtx;
+   lz4ultra_compressor *pCompressor;
+   const unsigned char *pInputData;
+   size_t nInputSize;
+   unsigned char *pOutBlocks;
+   int nBlockMaxSize;
+   int *pBlockSizes;
+} lz4ultra_inmem_raw_table_jobs;
+
+/**
+ * Compress one block of a raw block table into its own slot, as large as its input, as a thread pool job
+ *
+ * @param pUserData blocks to compress (lz4ultra_inmem_raw_table_jobs)
+ * @param nThreadIndex index of the thread running the job, selecting the compression context to use when there is no single one
+ * @param nJobIndex index of the block to compress
+ */
+static void lz4ultra_compress_raw_table_block_job(void *pUserData, const int nThreadIndex, const int nJobIndex) {
+   lz4ultra_inmem_raw_table_jobs *pJobs = (lz4ultra_inmem_raw_table_jobs *)pUserData;
+   lz4ultra_compressor *pCompressor = pJobs->pCompressor ? pJobs->pCompressor : &pJobs->pCtx->pThreads[nThreadIndex].compressor;
+   const size_t nOffset = (size_t)nJobIndex * (size_t)pJobs->nBlockMaxSize;
+   const int nInDataSize = ((pJobs->nInputSize - nOffset) > (size_t)pJobs->nBlockMaxSize) ? pJobs->nBlockMaxSize : (int)(pJobs->nInputSize - nOffset);
+   unsigned char *pOutData = pJobs->pOutBlocks + nOffset;
+   int nOutDataSize;
+
+   nOutDataSize = lz4ultra_compressor_shrink_block(pCompressor, NULL, pJobs->pInputData + nOffset, 0, nInDataSize, pOutData, nInDataSize);
+   if (nOutDataSize < 0 || nOutDataSize >= nInDataSize) {
+      /* Store blocks that don't get any smaller; they decompress with a copy */
+      memcpy(pOutData, pJobs->pInputData + nOffset, nInDataSize);
+      pJobs->pBlockSizes[nJobIndex] = -nInDataSize;
+   }
+   else {
+      pJobs->pBlockSizes[nJobIndex] = nOutDataSize;
+   }
+}
+
+/**
+ * Compress memory into a raw block table: the number of blocks, the block size and the size of the last block, the end offset of each block,
+ * and then the independent blocks, each one either a raw LZ4 block without an EOD marker, or stored as is. Each block is first compressed into
+ * a slot as large as its input, so that all blocks can be compressed in parallel, and the slots are then packed together. The slots are in the
+ * output buffer when it has room for them, and in a temporary buffer, taken from the context's allocator, otherwise.
+ *
+ * @param pCtx compression context whose threads compress the blocks in parallel, if pCompressor is NULL
+ * @param pCompressor compression context to compress all the blocks with, or NULL to use pCtx
+ * @param nThreads number of threads to compress blocks with (1 for single-threaded compression)
+ * @param pInputData pointer to input(source) data to compress
+ * @param pOutBuffer buffer for compressed data
+ * @param nInputSize input(source) size in bytes
+ * @param nMaxOutBufferSize maximum capacity of compression buffer
+ * @param nBlockMaxCode block size code, as returned by lz4ultra_get_inmem_block_max_code()
+ *
+ * @return actual compressed size, or -1 for error
+ */
+static size_t lz4ultra_compressor_shrink_raw_table(lz4ultra_ctx *pCtx, lz4ultra_compressor *pCompressor, const int nThreads, const unsigned char *pInputData, unsigned char *pOutBuffer,
+                                                   size_t nInputSize, size_t nMaxOutBufferSize, const int nBlockMaxCode) {
+   const int nBlockMaxSize = lz4ultra_get_inmem_block_max_size(0, nBlockMaxCode);
+   const size_t nNumBlocks = (nInputSize + (nBlockMaxSize - 1)) / nBlockMaxSize;
+   const size_t nTableSize = RAW_TABLE_HEADER_SIZE + nNumBlocks * RAW_TABLE_ENTRY_SIZE;
+   const lz4ultra_allocator *pAllocator = pCtx ? &pCtx->allocator : &pCompressor->allocator;
+   lz4ultra_inmem_raw_table_jobs jobs;
+   unsigned char *pOutBlocks;
+   unsigned char *pSlots = NULL;
+   size_t nCompressedSize = 0;
+   int i;
+
+   if (nNumBlocks > RAW_TABLE_MAX_OFFSET || nMaxOutBufferSize < nTableSize)
+      return -1;
+
+   pOutBlocks = pOutBuffer + nTableSize;
+   lz4ultra_raw_table_write_u32(pOutBuffer, (unsigned int)nNumBlocks);
+   lz4ultra_raw_table_write_u32(pOutBuffer + 4, (unsigned int)nBlockMaxSize);
+   lz4ultra_raw_table_write_u32(pOutBuffer + 8, nNumBlocks ? (unsigned int)(nInputSize - (nNumBlocks - 1) * nBlockMaxSize) : 0);
+
+   if (nNumBlocks) {
+      jobs.pBlockSizes = (int *)lz4ultra_alloc(pAllocator, nNumBlocks * sizeof(int));
+      if (!jobs.pBlockSizes)
+         return -1;
+
+      if ((nMaxOutBufferSize - nTableSize) < nInputSize) {
+         pSlots = (unsigned char *)lz4ultra_alloc(pAllocator, nInputSize);
+         if (!pSlots) {
+            lz4ultra_free(pAllocator, jobs.pBlockSizes);
+            return -1;
+         }
+      }
+
+      jobs.pCtx = pCtx;
+      jobs.pCompressor = pCompressor;
+      jobs.pInputData = pInputData;
+      jobs.nInputSize = nInputSize;
+      jobs.pOutBlocks = pSlots ? pSlots : pOutBlocks;
+      jobs.nBlockMaxSize = nBlockMaxSize;
+      lz4ultra_threadpool_run((nThreads > 1) ? pCtx->pPool : NULL, lz4ultra_compress_raw_table_block_job, &jobs, (int)nNumBlocks);
+
+      /* Pack the blocks after one another, and record where each one ends */
+      for (i = 0; i < (int)nNumBlocks; i++) {
+         const int nBlockSize = jobs.pBlockSizes[i];
+         const size_t nStoredSize = (nBlockSize < 0) ? (size_t)-nBlockSize : (size_t)nBlockSize;
+
+         const unsigned char *pSlot = jobs.pOutBlocks + (size_t)i * (size_t)nBlockMaxSize;
+
+         if (nCompressedSize + nStoredSize > RAW_TABLE_MAX_OFFSET || nStoredSize > (nMaxOutBufferSize - nTableSize - nCompressedSize)) {
+            lz4ultra_free(pAllocator, pSlots);
+            lz4ultra_free(pAllocator, jobs.pBlockSizes);
+            return -1;
+         }
+
+         if (pSlot != pOutBlocks + nCompressedSize)
+            memmove(pOutBlocks + nCompressedSize, pSlot, nStoredSize);
+         nCompressedSize += nStoredSize;
+
+         lz4ultra_raw_table_write_u32(pOutBuffer + RAW_TABLE_HEADER_SIZE + i * RAW_TABLE_ENTRY_SIZE,
+            (unsigned int)nCompressedSize | ((nBlockSize < 0) ? RAW_TABLE_STORED_BLOCK : 0));
+      }
+
+      lz4ultra_free(pAllocator, pSlots);
+      lz4ultra_free(pAllocator, jobs.pBlockSizes);
+   }
+
+   return nTableSize + nCompressedSize;
+}
+
+/**
+ * Compress memory with a compression context that is already prepared for the block size
+ *
+ * @param pCompressor compression context
+ * @param pInputData pointer to input(source) data to compress
+ * @param pOutBuffer buffer for compressed data
+ * @param nInputSize input(source) size in bytes
+ * @param nMaxOutBufferSize maximum capacity of compression buffer
+ * @param nFlags compression flags, as returned by lz4ultra_get_inmem_flags()
+ * @param nBlockMaxCode block size code, as returned by lz4ultra_get_inmem_block_max_code()
+ *
+ * @return actual compressed size, or -1 for error
+ */
+static size_t lz4ultra_compressor_shrink_inmem(lz4ultra_compressor *pCompressor, const unsigned char *pInputData, unsigned char *pOutBuffer, size_t nInputSize, size_t nMaxOutBufferSize,
+                                               const unsigned int nFlags, const int nBlockMaxCode) {
+   size_t nOriginalSize = 0L;
+   size_t nCompressedSize = 0L;
+   const int nBlockMaxSize = lz4ultra_get_inmem_block_max_size(nFlags, nBlockMaxCode);
+   int nError = 0;
+   XXH32_state_t contentChecksum;
+
+   if (nFlags & LZ4ULTRA_FLAG_RAW_TABLE)
+      return lz4ultra_compressor_shrink_raw_table(NULL, pCompressor, 1, pInputData, pOutBuffer, nInputSize, nMaxOutBufferSize, nBlockMaxCode);
+
+   XXH32_reset(&contentChecksum, 0);
+
+   if ((nFlags & LZ4ULTRA_FLAG_RAW_BLOCK) == 0) {
+      int nHeaderSize = lz4ultra_encode_header(pOutBuffer + nCompressedSize, (int)(nMaxOutBufferSize - nCompressedSize), nFlags, nBlockMaxCode, (long long)nInputSize);
+      if (nHeaderSize < 0)
+         nError = LZ4ULTRA_ERROR_COMPRESSION;
+      else {
+         nCompressedSize += nHeaderSize;
+      }
+   }
+
+   int nPreviousBlockSize = 0;
+   int nNumBlocks = 0;
+   const int nBlockChecksumSize = lz4ultra_get_block_checksum_size(nFlags);
+   const int nContentChecksumSize = lz4ultra_get_content_checksum_size(nFlags);
+
+   while (nOriginalSize < nInputSize && !nError) {
+      int nInDataSize;
+
+      nInDataSize = (int)(nInputSize - nOriginalSize);
+      if (nInDataSize > nBlockMaxSize)
+         nInDataSize = nBlockMaxSize;
+
+      if (nInDataSize > 0) {
+         if ((nFlags & LZ4ULTRA_FLAG_RAW_BLOCK) != 0 && (nNumBlocks || nInDataSize > 0x400000)) {
+            nError = LZ4ULTRA_ERROR_RAW_TOOLARGE;
+            break;
+         }
+
+         int nIsIncompressible = 0;
+         if (nFlags & LZ4ULTRA_FLAG_ADAPTIVE_BLOCKS) {
+            /* End the block early where the data changes between compressible and incompressible */
+            nInDataSize = lz4ultra_get_adaptive_block_size(pInputData + nOriginalSize, nInDataSize, &nIsIncompressible);
+         }
+
+         int nOutDataSize;
+         int nOutDataEnd = (int)(nMaxOutBufferSize - LZ4ULTRA_FRAME_SIZE - nBlockChecksumSize - LZ4ULTRA_FRAME_SIZE /* footer */ - nContentChecksumSize - nCompressedSize);
+         int nHeaderOffset = LZ4ULTRA_FRAME_SIZE;
+
+         if ((nFlags & LZ4ULTRA_FLAG_RAW_BLOCK) != 0) {
+            nHeaderOffset = 0;
+            nOutDataEnd = (int)(nMaxOutBufferSize - nCompressedSize);
+         }
+
+         if (nOutDataEnd > nBlockMaxSize)
+            nOutDataEnd = nBlockMaxSize;
+
+         if (nFlags & LZ4ULTRA_FLAG_CONTENT_CHECKSUM) {
+            /* Update the content checksum with the block, that is about to be compressed */
+            XXH32_update(&contentChecksum, pInputData + nOriginalSize, nInDataSize);
+         }
+
+         if (nIsIncompressible)
+            nOutDataSize = -1;
+         else
+            nOutDataSize = lz4ultra_compressor_shrink_block(pCompressor, NULL, pInputData + nOriginalSize - nPreviousBlockSize, nPreviousBlockSize, nInDataSize, pOutBuffer + nHeaderOffset + nCompressedSize, nOutDataEnd);
+         if (nOutDataSize >= 0) {
+            int nFrameHeaderSize = 0;
+
+            /* Compressed block */
+
+            if ((nFlags & LZ4ULTRA_FLAG_RAW_BLOCK) == 0) {
+               nFrameHeaderSize = lz4ultra_encode_compressed_block_frame(pOutBuffer + nCompressedSize, (int)(nMaxOutBufferSize - nCompressedSize), nOutDataSize);
+               if (nFrameHeaderSize < 0)
+                  nError = LZ4ULTRA_ERROR_COMPRESSION;
+            }
+
+            if (!nError) {
+               nOriginalSize += nInDataSize;
+               nCompressedSize += nFrameHeaderSize + nOutDataSize;
+            }
+         }
+         else {
+            /* Write uncompressible, literal block */
+
+            if ((nFlags & (LZ4ULTRA_FLAG_RAW_BLOCK | LZ4ULTRA_FLAG_LEGACY_FRAMES)) != 0) {
+               /* Uncompressible data isn't supported by raw blocks and legacy frames */
+               nError = LZ4ULTRA_ERROR_RAW_UNCOMPRESSED;
+               break;
+            }
+
+            int nFrameHeaderSize;
+
+            nFrameHeaderSize = lz4ultra_encode_uncompressed_block_frame(pOutBuffer + nCompressedSize, (int)(nMaxOutBufferSize - nCompressedSize), nFlags, nInDataSize);
+            if (nFrameHeaderSize < 0)
+               nError = LZ4ULTRA_ERROR_COMPRESSION;
+            else {
+               if (nInDataSize > (nMaxOutBufferSize - (nCompressedSize + nFrameHeaderSize)))
+                  nError = LZ4ULTRA_ERROR_DST;
+               else {
+                  memcpy(pOutBuffer + nFrameHeaderSize + nCompressedSize, pInputData + nOriginalSize, nInDataSize);
+                  nOriginalSize += nInDataSize;
+                  nCompressedSize += nFrameHeaderSize + (long long)nInDataSize;
+               }
+            }
+         }
+
+         if (!nError && nBlockChecksumSize) {
+            /* Checksum the block's data as stored, while it is still in cache */
+            size_t nBlockDataSize = (nOutDataSize >= 0) ? (size_t)nOutDataSize : (size_t)nInDataSize;
+            int nChecksumSize = lz4ultra_encode_block_checksum(pOutBuffer + nCompressedSize, (int)(nMaxOutBufferSize - nCompressedSize), nFlags,
+               XXH32(pOutBuffer + nCompressedSize - nBlockDataSize, nBlockDataSize, 0));
+            if (nChecksumSize < 0)
+               nError = LZ4ULTRA_ERROR_DST;
+            else
+               nCompressedSize += nChecksumSize;
+         }
+
+         if (!(nFlags & LZ4ULTRA_FLAG_INDEP_BLOCKS)) {
+            /* Blocks that ended early are shorter than the history, that may then span several blocks */
+            nPreviousBlockSize += nInDataSize;
+            if (nPreviousBlockSize > HISTORY_SIZE)
+               nPreviousBlockSize = HISTORY_SIZE;
+         }
+         else {
+            nPreviousBlockSize = 0;
+         }
+
+         nNumBlocks++;
+      }
+   }
+
+   int nFooterSize;
+
+   if ((nFlags & LZ4ULTRA_FLAG_RAW_BLOCK) != 0) {
+      nFooterSize = 0;
+   }
+   else {
+      nFooterSize = lz4ultra_encode_footer_frame(pOutBuffer + nCompressedSize, (int)(nMaxOutBufferSize - nCompressedSize), nFlags, XXH32_digest(&contentChecksum));
+      if (nFooterSize < 0)
+         nError = LZ4ULTRA_ERROR_COMPRESSION;
+   }
+
+   if (!nError) {
+      nCompressedSize += nFooterSize;
+   }
+
+   if (nError) {
+      return -1;
+   }
+   else {
+      return nCompressedSize;
+   }
+}
+
+/**
+ * Compress memory, using a reusable compression context
+ *
+ * @param pCtx compression context
+ * @param pInputData pointer to input(source) data to compress
+ * @param pOutBuffer buffer for compressed data
+ * @param nInputSize input(source) size in bytes
+ * @param nMaxOutBufferSize maximum capacity of compression buffer
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
+ * @param nBlockMaxCode maximum block size code (4..7 for 64 Kb..4 Mb)
+ * @param nCompressionLevel compression level (LZ4ULTRA_MIN_LEVEL..LZ4ULTRA_MAX_LEVEL, LZ4ULTRA_MAX_LEVEL for the best ratio)
+ *
+ * @return actual compressed size, or -1 for error
+ */
+size_t lz4ultra_compress_inmem_ctx(lz4ultra_ctx *pCtx, const unsigned char *pInputData, unsigned char *pOutBuffer, size_t nInputSize, size_t nMaxOutBufferSize, unsigned int nFlags, int nBlockMaxCode, int nCompressionLevel) {
+   int nResult;
+
+   nFlags = lz4ultra_get_inmem_flags(nFlags);
+   nBlockMaxCode = lz4ultra_get_inmem_block_max_code(nInputSize, nFlags, nBlockMaxCode);
+
+   if (nFlags & LZ4ULTRA_FLAG_RAW_TABLE) {
+      /* Blocks are independent, and are compressed in parallel when the context has several threads */
+      const int nBlockMaxSize = lz4ultra_get_inmem_block_max_size(nFlags, nBlockMaxCode);
+      const int nThreads = (nInputSize > (size_t)nBlockMaxSize) ? pCtx->nThreads : 1;
+
+      nResult = lz4ultra_ctx_prepare(pCtx, nThreads, nBlockMaxSize, nFlags, nCompressionLevel);
+      if (nResult == 0)
+         nResult = lz4ultra_ctx_set_parallel_blocks(pCtx, nThreads);
+      if (nResult != 0) {
+         return -1;
+      }
+
+      lz4ultra_ctx_reset(pCtx);
+      return lz4ultra_compressor_shrink_raw_table(pCtx, NULL, nThreads, pInputData, pOutBuffer, nInputSize, nMaxOutBufferSize, nBlockMaxCode);
+   }
+
+   nResult = lz4ultra_ctx_prepare(pCtx, 1, lz4ultra_get_inmem_block_max_size(nFlags, nBlockMaxCode) + HISTORY_SIZE, nFlags, nCompressionLevel);
+   if (nResult == 0)
+      nResult = lz4ultra_ctx_set_parallel_blocks(pCtx, 1);
+   if (nResult != 0) {
+      return -1;
+   }
+
+   lz4ultra_ctx_reset(pCtx);
+   return lz4ultra_compressor_shrink_inmem(&pCtx->pThreads[0].compressor, pInputData, pOutBuffer, nInputSize, nMaxOutBufferSize, nFlags, nBlockMaxCode);
+}
+
+/** Buffers of a batch, shared with the worker threads */
+typedef struct {
+   lz4ultra_ctx *pCtx;
+   lz4ultra_batch_buffer *pBuffers;
+   unsigned int nFlags;
+   int nBlockMaxCode;
+} lz4ultra_inmem_batch_jobs;
+
+/**
+ * Compress one buffer of a batch, as a thread pool job
+ *
+ * @param pUserData buffers to compress (lz4ultra_inmem_batch_jobs)
+ * @param nThreadIndex index of the thread running the job, selecting the compression context to use
+ * @param nJobIndex index of the buffer to compress
+ */
+static void lz4ultra_compress_batch_job(void *pUserData, const int nThreadIndex, const int nJobIndex) {
+   lz4ultra_inmem_batch_jobs *pJobs = (lz4ultra_inmem_batch_jobs *)pUserData;
+   lz4ultra_batch_buffer *pBuffer = &pJobs->pBuffers[nJobIndex];
+
+   pBuffer->nCompressedSize = lz4ultra_compressor_shrink_inmem(&pJobs->pCtx->pThreads[nThreadIndex].compressor, pBuffer->pInputData, pBuffer->pOutBuffer, pBuffer->nInputSize,
+      pBuffer->nMaxOutBufferSize, pJobs->nFlags, lz4ultra_get_inmem_block_max_code(pBuffer->nInputSize, pJobs->nFlags, pJobs->nBlockMaxCode));
+}
+
+/**
+ * Compress a batch of independent buffers, each into its own frame, sharing one compression context that is prepared once for the largest buffer.
+ * When the context was created with several threads, the buffers are compressed in parallel, one per thread at a time
+ *
+ * @param pCtx compression context, or NULL to create a single-threaded one for this batch
+ * @param pBuffers buffers to compress, whose nCompressedSize is set to the actual compressed size, or to -1 for error
+ * @param nBuffers number of buffers to compress
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
+ * @param nBlockMaxCode maximum block size code (4..7 for 64 Kb..4 Mb)
+ * @param nCompressionLevel compression level (LZ4ULTRA_MIN_LEVEL..LZ4ULTRA_MAX_LEVEL, LZ4ULTRA_MAX_LEVEL for the best ratio)
+ *
+ * @return number of buffers that couldn't be compressed (0 for success), or -1 if the compression context couldn't be prepared
+ */
+int lz4ultra_compress_batch(lz4ultra_ctx *pCtx, lz4ultra_batch_buffer *pBuffers, int nBuffers, unsigned int nFlags, int nBlockMaxCode, int nCompressionLevel) {
+   lz4ultra_inmem_batch_jobs jobs;
+   lz4ultra_ctx *pOwnCtx = NULL;
+   size_t nMaxInputSize = 0;
+   int nBlockMaxSize;
+   int nMaxWindowSize;
+   int nThreads;
+   int nFailed = 0;
+   int i;
+
+   if (nBuffers <= 0)
+      return 0;
+
+   if (!pCtx) {
+      pOwnCtx = lz4ultra_ctx_create(1);
+      if (!pOwnCtx)
+         return -1;
+      pCtx = pOwnCtx;
+   }
+
+   nFlags = lz4ultra_get_inmem_flags(nFlags);
+   for (i = 0; i < nBuffers; i++) {
+      if (nMaxInputSize < pBuffers[i].nInputSize)
+         nMaxInputSize = pBuffers[i].nInputSize;
+   }
+
+   /* Size the window for the largest buffer only: buffers that fit in one block have no history, so that small records share a small window, that
+    * stays in cache */
+   nBlockMaxSize = lz4ultra_get_inmem_block_max_size(nFlags, lz4ultra_get_inmem_block_max_code(nMaxInputSize, nFlags, nBlockMaxCode));
+   if (nMaxInputSize <= (size_t)nBlockMaxSize)
+      nMaxWindowSize = (nMaxInputSize > 0) ? (int)nMaxInputSize : 1;
+   else
+      nMaxWindowSize = nBlockMaxSize + HISTORY_SIZE;
+
+   nThreads = (nBuffers > 1) ? pCtx->nThreads : 1;
+   if (lz4ultra_ctx_prepare(pCtx, nThreads, nMaxWindowSize, nFlags, nCompressionLevel) ||
+       lz4ultra_ctx_set_parallel_blocks(pCtx, nThreads)) {
+      if (pOwnCtx)
+         lz4ultra_ctx_destroy(pOwnCtx);
+      return -1;
+   }
+
+   lz4ultra_ctx_reset(pCtx);
+
+   jobs.pCtx = pCtx;
+   jobs.pBuffers = pBuffers;
+   jobs.nFlags = nFlags;
+   jobs.nBlockMaxCode = nBlockMaxCode;
+   lz4ultra_threadpool_run((nThreads > 1) ? pCtx->pPool : NULL, lz4ultra_compress_batch_job, &jobs, nBuffers);
+
+   for (i = 0; i < nBuffers; i++) {
+      if (pBuffers[i].nCompressedSize == (size_t)-1)
+         nFailed++;
+   }
+
+   if (pOwnCtx)
+      lz4ultra_ctx_destroy(pOwnCtx);
+   return nFailed;
+}
+
+/**
+ * Compress memory
+ *
+ * @param pInputData pointer to input(source) data to compress
+ * @param pOutBuffer buffer for compressed data
+ * @param nInputSize input(source) size in bytes
+ * @param nMaxOutBufferSize maximum capacity of compression buffer
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
+ * @param nBlockMaxCode maximum block size code (4..7 for 64 Kb..4 Mb)
+ * @param nCompressionLevel compression level (LZ4ULTRA_MIN_LEVEL..LZ4ULTRA_MAX_LEVEL, LZ4ULTRA_MAX_LEVEL for the best ratio)
+ *
+ * @return actual compressed size, or -1 for error
+ */
+size_t lz4ultra_compress_inmem(const unsigned char *pInputData, unsigned char *pOutBuffer, size_t nInputSize, size_t nMaxOutBufferSize, unsigned int nFlags, int nBlockMaxCode, int nCompressionLevel) {
+   lz4ultra_ctx *pCtx;
+   size_t nCompressedSize;
+
+   pCtx = lz4ultra_ctx_create(1);
+   if (!pCtx)
+      return -1;
+
+   nCompressedSize = lz4ultra_compress_inmem_ctx(pCtx, pInputData, pOutBuffer, nInputSize, nMaxOutBufferSize, nFlags, nBlockMaxCode, nCompressionLevel);
+
+   lz4ultra_ctx_destroy(pCtx);
+   return nCompressedSize;
+}
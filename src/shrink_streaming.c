@@ -1,344 +1,1681 @@
-/*
- * shrink_streaming.c - streaming compression implementation
- *
- * Copyright (C) 2019 Emmanuel Marty
- *
- * This software is provided 'as-is', without any express or implied
- * warranty.  In no event will the authors be held liable for any damages
- * arising from the use of this software.
- *
- * Permission is granted to anyone to use this software for any purpose,
- * including commercial applications, and to alter it and redistribute it
- * freely, subject to the following restrictions:
- *
- * 1. The origin of this software must not be misrepresented; you must not
- *    claim that you wrote the original software. If you use this software
- *    in a product, an acknowledgment in the product documentation would be
- *    appreciated but is not required.
- * 2. Altered source versions must be plainly marked as such, and must not be
- *    misrepresented as being the original software.
- * 3. This notice may not be removed or altered from any source distribution.
- */
-
-/*
- * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
- *
- * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
- * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
- * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
- * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
- *
- */
-
-#include <stdlib.h>
-#include <string.h>
-#include "shrink_streaming.h"
-#include "format.h"
-#include "frame.h"
-#include "lib.h"
-
-/*-------------- File API -------------- */
-
-/**
- * Compress file
- *
- * @param pszInFilename name of input(source) file to compress
- * @param pszOutFilename name of output(compressed) file to generate
- * @param pszDictionaryFilename name of dictionary file, or NULL for none
- * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
- * @param nBlockMaxCode maximum block size code (4..7 for 64 Kb..4 Mb)
- * @param start start function, called when the max block size is finalized and compression is about to start, or NULL for none
- * @param progress progress function, called after compressing each block, or NULL for none
- * @param pOriginalSize pointer to returned input(source) size, updated when this function is successful
- * @param pCompressedSize pointer to returned output(compressed) size, updated when this function is successful
- * @param pCommandCount pointer to returned token(compression commands) count, updated when this function is successful
- *
- * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
- */
-lz4ultra_status_t lz4ultra_compress_file(const char *pszInFilename, const char *pszOutFilename, const char *pszDictionaryFilename,
-                                         const unsigned int nFlags, int nBlockMaxCode,
-                                         void(*start)(int nBlockMaxCode, const unsigned int nFlags),
-                                         void(*progress)(long long nOriginalSize, long long nCompressedSize), long long *pOriginalSize, long long *pCompressedSize, int *pCommandCount) {
-   lz4ultra_stream_t inStream, outStream;
-   void *pDictionaryData = NULL;
-   int nDictionaryDataSize = 0;
-   lz4ultra_status_t nStatus;
-
-   if (lz4ultra_filestream_open(&inStream, pszInFilename, "rb") < 0) {
-      return LZ4ULTRA_ERROR_SRC;
-   }
-
-   if (lz4ultra_filestream_open(&outStream, pszOutFilename, "wb") < 0) {
-      inStream.close(&inStream);
-      return LZ4ULTRA_ERROR_DST;
-   }
-
-   nStatus = lz4ultra_dictionary_load(pszDictionaryFilename, &pDictionaryData, &nDictionaryDataSize);
-   if (nStatus) {
-      outStream.close(&outStream);
-      inStream.close(&inStream);
-
-      return nStatus;
-   }
-
-   nStatus = lz4ultra_compress_stream(&inStream, &outStream, pDictionaryData, nDictionaryDataSize, nFlags, nBlockMaxCode, start, progress, pOriginalSize, pCompressedSize, pCommandCount);
-   
-   lz4ultra_dictionary_free(&pDictionaryData);
-   outStream.close(&outStream);
-   inStream.close(&inStream);
-   return nStatus;
-}
-
-/*-------------- Streaming API -------------- */
-
-/**
- * Compress stream
- *
- * @param pInStream input(source) stream to compress
- * @param pOutStream output(compressed) stream to write to
- * @param pDictionaryData dictionary contents, or NULL for none
- * @param nDictionaryDataSize size of dictionary contents, or 0
- * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
- * @param nBlockMaxCode maximum block size code (4..7 for 64 Kb..4 Mb)
- * @param start start function, called when the max block size is finalized and compression is about to start, or NULL for none
- * @param progress progress function, called after compressing each block, or NULL for none
- * @param pOriginalSize pointer to returned input(source) size, updated when this function is successful
- * @param pCompressedSize pointer to returned output(compressed) size, updated when this function is successful
- * @param pCommandCount pointer to returned token(compression commands) count, updated when this function is successful
- *
- * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
- */
-lz4ultra_status_t lz4ultra_compress_stream(lz4ultra_stream_t *pInStream, lz4ultra_stream_t *pOutStream, const void *pDictionaryData, int nDictionaryDataSize, unsigned int nFlags,
-                                           int nBlockMaxCode,
-                                           void(*start)(int nBlockMaxCode, const unsigned int nFlags),
-                                           void(*progress)(long long nOriginalSize, long long nCompressedSize), long long *pOriginalSize, long long *pCompressedSize, int *pCommandCount) {
-   unsigned char *pInData, *pOutData;
-   lz4ultra_compressor compressor;
-   long long nOriginalSize = 0LL, nCompressedSize = 0LL;
-   int nBlockMaxBits;
-   int nBlockMaxSize;
-   int nPreloadedInDataSize;
-   int nResult;
-   unsigned char cFrameData[16];
-   int nError = 0;
-
-   memset(cFrameData, 0, 16);
-
-   if (nFlags & LZ4ULTRA_FLAG_LEGACY_FRAMES) {
-      nBlockMaxBits = 23;
-      nFlags |= LZ4ULTRA_FLAG_INDEP_BLOCKS;
-   }
-   else {
-      nBlockMaxBits = 8 + (nBlockMaxCode << 1);
-   }
-   nBlockMaxSize = 1 << nBlockMaxBits;
-
-   pInData = (unsigned char*)malloc(nBlockMaxSize + HISTORY_SIZE);
-   if (!pInData) {
-      return LZ4ULTRA_ERROR_MEMORY;
-   }
-   memset(pInData, 0, nBlockMaxSize + HISTORY_SIZE);
-
-   pOutData = (unsigned char*)malloc(nBlockMaxSize);
-   if (!pOutData) {
-      free(pInData);
-      pInData = NULL;
-
-      return LZ4ULTRA_ERROR_MEMORY;
-   }
-   memset(pInData, 0, nBlockMaxSize);
-
-   /* Load first block of input data */
-   nPreloadedInDataSize = (int)pInStream->read(pInStream, pInData + HISTORY_SIZE, nBlockMaxSize);
-   if (nPreloadedInDataSize < nBlockMaxSize && (nFlags & LZ4ULTRA_FLAG_LEGACY_FRAMES) == 0) {
-      /* If the entire input data is shorter than the specified block size, try to reduce the
-       * block size until is the smallest one that can fit the data */
-
-      do {
-         nBlockMaxBits = 8 + (nBlockMaxCode << 1);
-         nBlockMaxSize = 1 << nBlockMaxBits;
-
-         int nPrevBlockMaxBits = 8 + ((nBlockMaxCode - 1) << 1);
-         int nPrevBlockMaxSize = 1 << nPrevBlockMaxBits;
-         if (nBlockMaxCode > 4 && nPrevBlockMaxSize > nPreloadedInDataSize) {
-            nBlockMaxCode--;
-         }
-         else
-            break;
-      } while (1);
-   }
-
-   nResult = lz4ultra_compressor_init(&compressor, nBlockMaxSize + HISTORY_SIZE, nFlags);
-   if (nResult != 0) {
-      free(pOutData);
-      pOutData = NULL;
-
-      free(pInData);
-      pInData = NULL;
-
-      return LZ4ULTRA_ERROR_MEMORY;
-   }
-
-   if ((nFlags & LZ4ULTRA_FLAG_RAW_BLOCK) == 0) {
-      int nHeaderSize = lz4ultra_encode_header(cFrameData, 16, nFlags, nBlockMaxCode);
-      if (nHeaderSize < 0)
-         nError = LZ4ULTRA_ERROR_COMPRESSION;
-      else {
-         if (pOutStream->write(pOutStream, cFrameData, nHeaderSize) != nHeaderSize)
-            nError = LZ4ULTRA_ERROR_DST;
-         nCompressedSize += (long long)nHeaderSize;
-      }
-   }
-
-   if (start)
-      start(nBlockMaxCode, nFlags);
-
-   int nPreviousBlockSize = 0;
-   int nNumBlocks = 0;
-
-   while ((nPreloadedInDataSize > 0 || (!pInStream->eof(pInStream))) && !nError) {
-      int nInDataSize;
-
-      if (nPreviousBlockSize) {
-         memcpy(pInData + HISTORY_SIZE - nPreviousBlockSize, pInData + HISTORY_SIZE + (nBlockMaxSize - nPreviousBlockSize), nPreviousBlockSize);
-      }
-      else if (nDictionaryDataSize && pDictionaryData) {
-         memcpy(pInData + HISTORY_SIZE - nDictionaryDataSize, pDictionaryData, nDictionaryDataSize);
-         nPreviousBlockSize = nDictionaryDataSize;
-      }
-
-      if (nPreloadedInDataSize > 0) {
-         nInDataSize = nPreloadedInDataSize;
-         nPreloadedInDataSize = 0;
-      }
-      else {
-         nInDataSize = (int)pInStream->read(pInStream, pInData + HISTORY_SIZE, nBlockMaxSize);
-      }
-
-      if (nInDataSize > 0) {
-         if ((nFlags & LZ4ULTRA_FLAG_RAW_BLOCK) != 0 && (nNumBlocks || nInDataSize > 0x400000)) {
-            nError = LZ4ULTRA_ERROR_RAW_TOOLARGE;
-            break;
-         }
-         if (!(nFlags & LZ4ULTRA_FLAG_INDEP_BLOCKS))
-            nDictionaryDataSize = 0;
-
-         int nOutDataSize;
-
-         nOutDataSize = lz4ultra_compressor_shrink_block(&compressor, pInData + HISTORY_SIZE - nPreviousBlockSize, nPreviousBlockSize, nInDataSize, pOutData, (nInDataSize >= nBlockMaxSize) ? nBlockMaxSize : nInDataSize);
-         if (nOutDataSize >= 0) {
-            int nFrameHeaderSize = 0;
-
-            /* Write compressed block */
-
-            if ((nFlags & LZ4ULTRA_FLAG_RAW_BLOCK) == 0) {
-               nFrameHeaderSize = lz4ultra_encode_compressed_block_frame(cFrameData, 16, nFlags, nOutDataSize);
-               if (nFrameHeaderSize < 0)
-                  nError = LZ4ULTRA_ERROR_COMPRESSION;
-               else {
-                  if (pOutStream->write(pOutStream, cFrameData, nFrameHeaderSize) != (size_t)nFrameHeaderSize) {
-                     nError = LZ4ULTRA_ERROR_DST;
-                  }
-               }
-            }
-
-            if (!nError) {
-               if (pOutStream->write(pOutStream, pOutData, (size_t)nOutDataSize) != (size_t)nOutDataSize) {
-                  nError = LZ4ULTRA_ERROR_DST;
-               }
-               else {
-                  nOriginalSize += (long long)nInDataSize;
-                  nCompressedSize += (long long)nFrameHeaderSize + (long long)nOutDataSize;
-               }
-            }
-         }
-         else {
-            /* Write uncompressible, literal block */
-
-            if ((nFlags & LZ4ULTRA_FLAG_RAW_BLOCK) != 0) {
-               /* Uncompressible data isn't supported by raw blocks */
-               nError = LZ4ULTRA_ERROR_RAW_UNCOMPRESSED;
-               break;
-            }
-
-            int nFrameHeaderSize;
-
-            nFrameHeaderSize = lz4ultra_encode_uncompressed_block_frame(cFrameData, 16, nFlags, nInDataSize);
-            if (nFrameHeaderSize < 0)
-               nError = LZ4ULTRA_ERROR_COMPRESSION;
-            else {
-               if (pOutStream->write(pOutStream, cFrameData, nFrameHeaderSize) != (size_t)nFrameHeaderSize) {
-                  nError = LZ4ULTRA_ERROR_DST;
-               }
-               else {
-                  if (pOutStream->write(pOutStream, pInData + HISTORY_SIZE, (size_t)nInDataSize) != (size_t)nInDataSize) {
-                     nError = LZ4ULTRA_ERROR_DST;
-                  }
-                  else {
-                     nOriginalSize += (long long)nInDataSize;
-                     nCompressedSize += (long long)nFrameHeaderSize + (long long)nInDataSize;
-                  }
-               }
-            }
-         }
-
-         if (!(nFlags & LZ4ULTRA_FLAG_INDEP_BLOCKS)) {
-            nPreviousBlockSize = nInDataSize;
-            if (nPreviousBlockSize > HISTORY_SIZE)
-               nPreviousBlockSize = HISTORY_SIZE;
-         }
-         else {
-            nPreviousBlockSize = 0;
-         }
-
-         nNumBlocks++;
-      }
-
-      if (!nError && !pInStream->eof(pInStream)) {
-         if (progress)
-            progress(nOriginalSize, nCompressedSize);
-      }
-   }
-
-   int nFooterSize;
-
-   if ((nFlags & LZ4ULTRA_FLAG_RAW_BLOCK) != 0) {
-      nFooterSize = 0;
-   }
-   else {
-      nFooterSize = lz4ultra_encode_footer_frame(cFrameData, 16, nFlags);
-      if (nFooterSize < 0)
-         nError = LZ4ULTRA_ERROR_COMPRESSION;
-   }
-
-   if (!nError) {
-      if (pOutStream->write(pOutStream, cFrameData, nFooterSize) != nFooterSize)
-         nError = LZ4ULTRA_ERROR_DST;
-   }
-   nCompressedSize += (long long)nFooterSize;
-
-   if (progress)
-      progress(nOriginalSize, nCompressedSize);
-
-   int nCommandCount = lz4ultra_compressor_get_command_count(&compressor);
-   lz4ultra_compressor_destroy(&compressor);
-
-   free(pOutData);
-   pOutData = NULL;
-
-   free(pInData);
-   pInData = NULL;
-
-   if (nError) {
-      return nError;
-   }
-   else {
-      if (pOriginalSize)
-         *pOriginalSize = nOriginalSize;
-      if (pCompressedSize)
-         *pCompressedSize = nCompressedSize;
-      if (pCommandCount)
-         *pCommandCount = nCommandCount;
-      return LZ4ULTRA_OK;
-   }
-}
+/*
+ * shrink_streaming.c - streaming compression implementation
+ *
+ * Copyright (C) 2019 Emmanuel Marty
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*
+ * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
+ *
+ * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
+ * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
+ * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
+ * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "shrink_streaming.h"
+#include "format.h"
+#include "frame.h"
+#include "lib.h"
+#include "threadpool.h"
+#include "filemap.h"
+#include "asyncstream.h"
+#include "expand_block.h"
+#include "dedup.h"
+#define XXH_STATIC_LINKING_ONLY
+#include "xxhash.h"
+
+static lz4ultra_status_t lz4ultra_compress_blocks(lz4ultra_ctx *pCtx, lz4ultra_stream_t *pInStream, const unsigned char *pInMap, size_t nInMapSize, lz4ultra_stream_t *pOutStream,
+                                                  const lz4ultra_dictionary *pDictionary, unsigned int nFlags, int nBlockMaxCode, int nCompressionLevel, long long nContentSize,
+                                                  const XXH32_state_t *pAppendChecksum, void(*start)(int nBlockMaxCode, const unsigned int nFlags),
+                                                  void(*progress)(long long nOriginalSize, long long nCompressedSize), long long *pOriginalSize, long long *pCompressedSize, int *pCommandCount);
+static lz4ultra_status_t lz4ultra_compress_stream_blocks(lz4ultra_ctx *pCtx, lz4ultra_stream_t *pInStream, lz4ultra_stream_t *pOutStream, const lz4ultra_dictionary *pDictionary, unsigned int nFlags,
+                                                         int nBlockMaxCode, int nCompressionLevel, long long nContentSize, const XXH32_state_t *pAppendChecksum,
+                                                         void(*start)(int nBlockMaxCode, const unsigned int nFlags),
+                                                         void(*progress)(long long nOriginalSize, long long nCompressedSize), long long *pOriginalSize, long long *pCompressedSize, int *pCommandCount);
+
+/*-------------- File API -------------- */
+
+/**
+ * Compress file, using a reusable compression context
+ *
+ * @param pCtx compression context, that also selects the number of threads to compress blocks with
+ * @param pszInFilename name of input(source) file to compress
+ * @param pszOutFilename name of output(compressed) file to generate
+ * @param pszDictionaryFilename name of dictionary file, or NULL for none
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
+ * @param nBlockMaxCode maximum block size code (4..7 for 64 Kb..4 Mb)
+ * @param nCompressionLevel compression level (LZ4ULTRA_MIN_LEVEL..LZ4ULTRA_MAX_LEVEL, LZ4ULTRA_MAX_LEVEL for the best ratio)
+ * @param start start function, called when the max block size is finalized and compression is about to start, or NULL for none
+ * @param progress progress function, called after compressing each block, or NULL for none
+ * @param pOriginalSize pointer to returned input(source) size, updated when this function is successful
+ * @param pCompressedSize pointer to returned output(compressed) size, updated when this function is successful
+ * @param pCommandCount pointer to returned token(compression commands) count, updated when this function is successful
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+lz4ultra_status_t lz4ultra_compress_file_ctx(lz4ultra_ctx *pCtx, const char *pszInFilename, const char *pszOutFilename, const char *pszDictionaryFilename,
+                                             const unsigned int nFlags, int nBlockMaxCode, int nCompressionLevel,
+                                             void(*start)(int nBlockMaxCode, const unsigned int nFlags),
+                                             void(*progress)(long long nOriginalSize, long long nCompressedSize), long long *pOriginalSize, long long *pCompressedSize, int *pCommandCount) {
+   lz4ultra_filemap_t inMap;
+   lz4ultra_stream_t inStream, outStream;
+   void *pDictionaryData = NULL;
+   int nDictionaryDataSize = 0;
+   lz4ultra_dictionary dictionary;
+   long long nContentSize = -1LL;
+   lz4ultra_dedup dedup;
+   int nMapped;
+   lz4ultra_status_t nStatus;
+
+   memset(&dedup, 0, sizeof(lz4ultra_dedup));
+
+   /* Compress regular files straight from a memory mapping, where each block is already preceded by its history, so that input data
+    * doesn't need to be read into buffers; fall back to reading it otherwise, for instance from a pipe, or when asked to read ahead */
+   nMapped = (!lz4ultra_filestream_is_stdio(pszInFilename) && lz4ultra_filemap_open(&inMap, pszInFilename) == 0) ? 1 : 0;
+   if (nMapped) {
+      /* The size of regular files is known upfront, to be stored in the header */
+      nContentSize = (long long)inMap.nSize;
+
+      /* Ranges that repeat earlier data are found over the whole mapping. Raw blocks, raw block tables and legacy frames have nowhere to store their index */
+      if ((nFlags & (LZ4ULTRA_FLAG_DEDUP | LZ4ULTRA_FLAG_RAW_BLOCK | LZ4ULTRA_FLAG_RAW_TABLE | LZ4ULTRA_FLAG_LEGACY_FRAMES)) == LZ4ULTRA_FLAG_DEDUP) {
+         if (lz4ultra_dedup_find(&dedup, &pCtx->allocator, inMap.pData, inMap.nSize)) {
+            lz4ultra_filemap_close(&inMap);
+            return LZ4ULTRA_ERROR_MEMORY;
+         }
+      }
+
+      if ((nFlags & LZ4ULTRA_FLAG_ASYNC_IO) && !dedup.nNumRefs) {
+         lz4ultra_filemap_close(&inMap);
+         nMapped = 0;
+      }
+   }
+   if (!nMapped && lz4ultra_filestream_open(&inStream, pszInFilename, "rb") < 0) {
+      return LZ4ULTRA_ERROR_SRC;
+   }
+
+   if (lz4ultra_filestream_open(&outStream, pszOutFilename, "wb") < 0) {
+      lz4ultra_dedup_free(&dedup);
+      if (nMapped)
+         lz4ultra_filemap_close(&inMap);
+      else
+         inStream.close(&inStream);
+      return LZ4ULTRA_ERROR_DST;
+   }
+
+   nStatus = lz4ultra_dictionary_load(pszDictionaryFilename, &pDictionaryData, &nDictionaryDataSize);
+   if (nStatus) {
+      lz4ultra_dedup_free(&dedup);
+      outStream.close(&outStream);
+      if (nMapped)
+         lz4ultra_filemap_close(&inMap);
+      else
+         inStream.close(&inStream);
+
+      return nStatus;
+   }
+
+   dictionary.pData = (const unsigned char *)pDictionaryData;
+   dictionary.nSize = nDictionaryDataSize;
+   dictionary.pSuffixArray = NULL;
+   dictionary.pPLCP = NULL;
+
+   if (dedup.nNumRefs) {
+      /* Write the index of the repeated ranges first, so that they are restored as the rest of the data is decompressed, and only compress the
+       * rest of the data. A seek table would index offsets of the data without the repeated ranges, it isn't stored. The header always stores
+       * the size of the original data: decoders that skip the index and don't restore the ranges then fail on the size, instead of silently
+       * returning the data without the ranges */
+      lz4ultra_stream_t dedupStream;
+      long long nIndexSize = 0LL;
+
+      if (lz4ultra_dedup_write_index(&dedup, &outStream, &nIndexSize))
+         nStatus = LZ4ULTRA_ERROR_DST;
+      else if (lz4ultra_dedup_reader_open(&dedupStream, &dedup, inMap.pData))
+         nStatus = LZ4ULTRA_ERROR_MEMORY;
+      else {
+         nStatus = lz4ultra_compress_stream_blocks(pCtx, &dedupStream, &outStream, pDictionaryData ? &dictionary : NULL, (nFlags & ~LZ4ULTRA_FLAG_SEEK_TABLE) | LZ4ULTRA_FLAG_CONTENT_SIZE,
+            nBlockMaxCode, nCompressionLevel, nContentSize, NULL, start, progress, pOriginalSize, pCompressedSize, pCommandCount);
+         dedupStream.close(&dedupStream);
+
+         if (nStatus == LZ4ULTRA_OK) {
+            if (pOriginalSize)
+               *pOriginalSize = nContentSize;
+            if (pCompressedSize)
+               *pCompressedSize += nIndexSize;
+         }
+      }
+   }
+   else if (nMapped)
+      nStatus = lz4ultra_compress_blocks(pCtx, NULL, inMap.pData, inMap.nSize, &outStream, pDictionaryData ? &dictionary : NULL, nFlags & ~LZ4ULTRA_FLAG_DEDUP, nBlockMaxCode, nCompressionLevel, nContentSize, NULL, start, progress, pOriginalSize, pCompressedSize, pCommandCount);
+   else
+      nStatus = lz4ultra_compress_stream_blocks(pCtx, &inStream, &outStream, pDictionaryData ? &dictionary : NULL, nFlags & ~LZ4ULTRA_FLAG_DEDUP, nBlockMaxCode, nCompressionLevel, nContentSize, NULL, start, progress, pOriginalSize, pCompressedSize, pCommandCount);
+
+   lz4ultra_dictionary_free(&pDictionaryData);
+   lz4ultra_dedup_free(&dedup);
+   outStream.close(&outStream);
+   if (nMapped)
+      lz4ultra_filemap_close(&inMap);
+   else
+      inStream.close(&inStream);
+   return nStatus;
+}
+
+/**
+ * Compress file
+ *
+ * @param pszInFilename name of input(source) file to compress
+ * @param pszOutFilename name of output(compressed) file to generate
+ * @param pszDictionaryFilename name of dictionary file, or NULL for none
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
+ * @param nBlockMaxCode maximum block size code (4..7 for 64 Kb..4 Mb)
+ * @param nCompressionLevel compression level (LZ4ULTRA_MIN_LEVEL..LZ4ULTRA_MAX_LEVEL, LZ4ULTRA_MAX_LEVEL for the best ratio)
+ * @param nThreads number of threads to compress blocks with (1 for single-threaded compression)
+ * @param start start function, called when the max block size is finalized and compression is about to start, or NULL for none
+ * @param progress progress function, called after compressing each block, or NULL for none
+ * @param pOriginalSize pointer to returned input(source) size, updated when this function is successful
+ * @param pCompressedSize pointer to returned output(compressed) size, updated when this function is successful
+ * @param pCommandCount pointer to returned token(compression commands) count, updated when this function is successful
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+lz4ultra_status_t lz4ultra_compress_file(const char *pszInFilename, const char *pszOutFilename, const char *pszDictionaryFilename,
+                                         const unsigned int nFlags, int nBlockMaxCode, int nCompressionLevel, int nThreads,
+                                         void(*start)(int nBlockMaxCode, const unsigned int nFlags),
+                                         void(*progress)(long long nOriginalSize, long long nCompressedSize), long long *pOriginalSize, long long *pCompressedSize, int *pCommandCount) {
+   lz4ultra_ctx *pCtx;
+   lz4ultra_status_t nStatus;
+
+   if (nThreads < 1)
+      nThreads = 1;
+
+   pCtx = lz4ultra_ctx_create(nThreads);
+   if (!pCtx)
+      return LZ4ULTRA_ERROR_MEMORY;
+
+   nStatus = lz4ultra_compress_file_ctx(pCtx, pszInFilename, pszOutFilename, pszDictionaryFilename, nFlags, nBlockMaxCode, nCompressionLevel, start, progress, pOriginalSize, pCompressedSize, pCommandCount);
+
+   lz4ultra_ctx_destroy(pCtx);
+   return nStatus;
+}
+
+/**
+ * Walk the frame of a compressed file that blocks are to be appended to, and recover what compressing them needs: the frame's flags and block
+ * size, where its end starts, and, when blocks are linked or the frame ends with a checksum, the history of the next block and the checksum of
+ * all the decompressed data, which requires decompressing every block
+ *
+ * @param pInData compressed file contents
+ * @param nInSize size of compressed file, in bytes
+ * @param pDictionaryData dictionary contents, or NULL for none
+ * @param nDictionaryDataSize size of dictionary contents, or 0
+ * @param pAllocator allocator of the history buffer
+ * @param pFrameFlags pointer to returned frame flags (LZ4ULTRA_FLAG_xxx)
+ * @param pBlockMaxCode pointer to returned maximum block size code (4..7 for 64 Kb..4 Mb)
+ * @param pContentSize pointer to returned decompressed size stored in the header, or -1 if the header doesn't store it
+ * @param pEndOffset pointer to returned offset of the end of the frame, that appended blocks overwrite
+ * @param ppHistory pointer to returned history buffer, holding the history of the next block at its start, to be freed by the caller, or NULL when
+ *                  no block needed to be decompressed
+ * @param pHistorySize pointer to returned size of the history of the next block, 0 if the blocks are independent
+ * @param pContentChecksum checksum of the decompressed data, updated with LZ4ULTRA_FLAG_CONTENT_CHECKSUM
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+static lz4ultra_status_t lz4ultra_append_scan_frame(const unsigned char *pInData, const size_t nInSize, const void *pDictionaryData, const int nDictionaryDataSize,
+                                                    const lz4ultra_allocator *pAllocator, unsigned int *pFrameFlags, int *pBlockMaxCode, long long *pContentSize,
+                                                    size_t *pEndOffset, unsigned char **ppHistory, int *pHistorySize, XXH32_state_t *pContentChecksum) {
+   int nHeaderSize = LZ4ULTRA_HEADER_SIZE;
+   int nExtraHeaderSize = LZ4ULTRA_DECODE_ERR_FORMAT;
+   unsigned int nFrameFlags = 0;
+   int nBlockMaxCode = 0;
+   unsigned int nSkipSize = 0;
+
+   /* A deduplication index, or any other skippable frame, would have to stay in front of the whole data */
+   if (nInSize >= LZ4ULTRA_SKIPPABLE_HEADER_SIZE && lz4ultra_decode_skippable_header(pInData, LZ4ULTRA_SKIPPABLE_HEADER_SIZE, &nSkipSize) == LZ4ULTRA_DECODE_OK)
+      return LZ4ULTRA_ERROR_APPEND;
+
+   if (nInSize >= (size_t)nHeaderSize) {
+      while ((nExtraHeaderSize = lz4ultra_check_header(pInData, nHeaderSize)) > 0) {
+         if ((nInSize - (size_t)nHeaderSize) < (size_t)nExtraHeaderSize) {
+            nExtraHeaderSize = LZ4ULTRA_DECODE_ERR_FORMAT;
+            break;
+         }
+         nHeaderSize += nExtraHeaderSize;
+      }
+   }
+   if (nExtraHeaderSize < 0 || lz4ultra_decode_header(pInData, nHeaderSize, &nBlockMaxCode, &nFrameFlags, pContentSize) != LZ4ULTRA_DECODE_OK)
+      return LZ4ULTRA_ERROR_FORMAT;
+   if (nFrameFlags & LZ4ULTRA_FLAG_LEGACY_FRAMES)
+      return LZ4ULTRA_ERROR_APPEND;
+   if (nBlockMaxCode < 4 || nBlockMaxCode > 7)
+      return LZ4ULTRA_ERROR_FORMAT;
+
+   const int nBlockMaxSize = 1 << (8 + (nBlockMaxCode << 1));
+   const int nBlockChecksumSize = lz4ultra_get_block_checksum_size(nFrameFlags);
+   const int nDecompress = (nFrameFlags & (LZ4ULTRA_FLAG_INDEP_BLOCKS | LZ4ULTRA_FLAG_CONTENT_CHECKSUM)) != LZ4ULTRA_FLAG_INDEP_BLOCKS;
+   size_t nBlockOffset = (size_t)nHeaderSize;
+   int nHistorySize;
+   unsigned char *pHistory;
+
+   /* Blocks are decompressed after their history, in front of the buffer: the dictionary to start with, as with the first block, and then the last
+    * HISTORY_SIZE bytes of decompressed data for linked blocks */
+   pHistory = NULL;
+   nHistorySize = (pDictionaryData && nDictionaryDataSize > 0) ? nDictionaryDataSize : 0;
+   if (nDecompress) {
+      pHistory = (unsigned char *)lz4ultra_alloc(pAllocator, HISTORY_SIZE + nBlockMaxSize);
+      if (!pHistory)
+         return LZ4ULTRA_ERROR_MEMORY;
+      if (nHistorySize)
+         memcpy(pHistory, pDictionaryData, nHistorySize);
+   }
+
+   while (1) {
+      unsigned int nBlockSize = 0;
+      int nIsUncompressed = 0;
+
+      if ((nInSize - nBlockOffset) < LZ4ULTRA_FRAME_SIZE || lz4ultra_decode_frame(pInData + nBlockOffset, LZ4ULTRA_FRAME_SIZE, &nBlockSize, &nIsUncompressed) != LZ4ULTRA_DECODE_OK) {
+         lz4ultra_free(pAllocator, pHistory);
+         return LZ4ULTRA_ERROR_FORMAT;
+      }
+      if (nBlockSize == 0)
+         break;
+
+      const unsigned char *pBlockData = pInData + nBlockOffset + LZ4ULTRA_FRAME_SIZE;
+      if ((nInSize - nBlockOffset - LZ4ULTRA_FRAME_SIZE) < ((size_t)nBlockSize + (size_t)nBlockChecksumSize) || nBlockSize > (unsigned int)nBlockMaxSize) {
+         lz4ultra_free(pAllocator, pHistory);
+         return LZ4ULTRA_ERROR_FORMAT;
+      }
+
+      if (nDecompress) {
+         int nDecompressedSize;
+
+         if (nIsUncompressed) {
+            memcpy(pHistory + nHistorySize, pBlockData, nBlockSize);
+            nDecompressedSize = (int)nBlockSize;
+         }
+         else {
+            nDecompressedSize = lz4ultra_decompressor_expand_block(pBlockData, (int)nBlockSize, pHistory, nHistorySize, HISTORY_SIZE + nBlockMaxSize - nHistorySize);
+         }
+         if (nDecompressedSize < 0) {
+            lz4ultra_free(pAllocator, pHistory);
+            return LZ4ULTRA_ERROR_DECOMPRESSION;
+         }
+
+         if (nFrameFlags & LZ4ULTRA_FLAG_CONTENT_CHECKSUM)
+            XXH32_update(pContentChecksum, pHistory + nHistorySize, nDecompressedSize);
+
+         if (!(nFrameFlags & LZ4ULTRA_FLAG_INDEP_BLOCKS)) {
+            /* Keep the last HISTORY_SIZE bytes, that may span several small blocks, in front of the next block */
+            const int nNewHistorySize = ((nHistorySize + nDecompressedSize) > HISTORY_SIZE) ? HISTORY_SIZE : (nHistorySize + nDecompressedSize);
+
+            memmove(pHistory, pHistory + nHistorySize + nDecompressedSize - nNewHistorySize, nNewHistorySize);
+            nHistorySize = nNewHistorySize;
+         }
+      }
+
+      nBlockOffset += LZ4ULTRA_FRAME_SIZE + (size_t)nBlockSize + (size_t)nBlockChecksumSize;
+   }
+
+   /* Nothing may follow the end of the frame, such as a seek table, that would index the old blocks only, or another frame */
+   const int nContentChecksumSize = lz4ultra_get_content_checksum_size(nFrameFlags);
+   if ((nInSize - nBlockOffset - LZ4ULTRA_FRAME_SIZE) < (size_t)nContentChecksumSize) {
+      lz4ultra_free(pAllocator, pHistory);
+      return LZ4ULTRA_ERROR_FORMAT;
+   }
+   if (nContentChecksumSize &&
+       lz4ultra_decode_checksum(pInData + nBlockOffset + LZ4ULTRA_FRAME_SIZE, nContentChecksumSize, XXH32_digest(pContentChecksum)) != LZ4ULTRA_DECODE_OK) {
+      lz4ultra_free(pAllocator, pHistory);
+      return LZ4ULTRA_ERROR_CHECKSUM;
+   }
+   if ((nInSize - nBlockOffset - LZ4ULTRA_FRAME_SIZE) != (size_t)nContentChecksumSize) {
+      lz4ultra_free(pAllocator, pHistory);
+      return LZ4ULTRA_ERROR_APPEND;
+   }
+
+   *pFrameFlags = nFrameFlags;
+   *pBlockMaxCode = nBlockMaxCode;
+   *pEndOffset = nBlockOffset;
+   *ppHistory = pHistory;
+   *pHistorySize = (nFrameFlags & LZ4ULTRA_FLAG_INDEP_BLOCKS) ? 0 : nHistorySize;
+   return LZ4ULTRA_OK;
+}
+
+/**
+ * Compress file and append it to an existing compressed file, using a reusable compression context. The blocks are added to the file's frame,
+ * overwriting its end, and are compressed with its block size and flags, after the last HISTORY_SIZE bytes of its decompressed data when its
+ * blocks are linked. Linked blocks, and frames that end with a checksum, are decompressed to find those bytes and the checksum. The frame must
+ * end the file, which rules out a seek table, a deduplication index or legacy frames. If appending fails, the compressed file is left without
+ * the end of its frame
+ *
+ * @param pCtx compression context, that also selects the number of threads to compress blocks with
+ * @param pszInFilename name of input(source) file to compress
+ * @param pszOutFilename name of existing output(compressed) file to append to
+ * @param pszDictionaryFilename name of dictionary file that the compressed file was created with, or NULL for none
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx), except the ones that select the frame format, taken from the compressed file
+ * @param nCompressionLevel compression level (LZ4ULTRA_MIN_LEVEL..LZ4ULTRA_MAX_LEVEL, LZ4ULTRA_MAX_LEVEL for the best ratio)
+ * @param start start function, called when the max block size is finalized and compression is about to start, or NULL for none
+ * @param progress progress function, called after compressing each block, or NULL for none
+ * @param pOriginalSize pointer to returned input(source) size, updated when this function is successful
+ * @param pCompressedSize pointer to returned number of bytes written to the output, from the end of the frame that was overwritten, updated when
+ *                        this function is successful
+ * @param pCommandCount pointer to returned token(compression commands) count, updated when this function is successful
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+lz4ultra_status_t lz4ultra_append_file_ctx(lz4ultra_ctx *pCtx, const char *pszInFilename, const char *pszOutFilename, const char *pszDictionaryFilename,
+                                           const unsigned int nFlags, int nCompressionLevel,
+                                           void(*start)(int nBlockMaxCode, const unsigned int nFlags),
+                                           void(*progress)(long long nOriginalSize, long long nCompressedSize), long long *pOriginalSize, long long *pCompressedSize, int *pCommandCount) {
+   const unsigned int nFrameFormatFlags = LZ4ULTRA_FLAG_RAW_BLOCK | LZ4ULTRA_FLAG_RAW_TABLE | LZ4ULTRA_FLAG_INDEP_BLOCKS | LZ4ULTRA_FLAG_LEGACY_FRAMES | LZ4ULTRA_FLAG_BLOCK_CHECKSUM |
+      LZ4ULTRA_FLAG_CONTENT_CHECKSUM | LZ4ULTRA_FLAG_CONTENT_SIZE | LZ4ULTRA_FLAG_SEEK_TABLE | LZ4ULTRA_FLAG_DEDUP;
+   lz4ultra_filemap_t outMap;
+   lz4ultra_stream_t inStream, outStream;
+   void *pDictionaryData = NULL;
+   int nDictionaryDataSize = 0;
+   lz4ultra_dictionary history;
+   unsigned int nFrameFlags = 0;
+   int nBlockMaxCode = 7;
+   long long nContentSize = -1LL;
+   size_t nEndOffset = 0;
+   unsigned char *pHistory = NULL;
+   int nHistorySize = 0;
+   XXH32_state_t contentChecksum;
+   long long nOriginalSize = 0LL;
+   lz4ultra_status_t nStatus;
+
+   if (lz4ultra_filestream_is_stdio(pszOutFilename))
+      return LZ4ULTRA_ERROR_APPEND;
+
+   nStatus = lz4ultra_dictionary_load(pszDictionaryFilename, &pDictionaryData, &nDictionaryDataSize);
+   if (nStatus)
+      return nStatus;
+
+   if (lz4ultra_filemap_open(&outMap, pszOutFilename)) {
+      lz4ultra_dictionary_free(&pDictionaryData);
+      return LZ4ULTRA_ERROR_DST;
+   }
+   XXH32_reset(&contentChecksum, 0);
+   nStatus = lz4ultra_append_scan_frame(outMap.pData, outMap.nSize, pDictionaryData, nDictionaryDataSize, &pCtx->allocator, &nFrameFlags, &nBlockMaxCode, &nContentSize,
+      &nEndOffset, &pHistory, &nHistorySize, &contentChecksum);
+   lz4ultra_filemap_close(&outMap);
+   if (nStatus) {
+      lz4ultra_dictionary_free(&pDictionaryData);
+      return nStatus;
+   }
+
+   /* Linked blocks continue from the history of the frame, that starts with the dictionary if the frame is short; independent blocks each start
+    * with the dictionary */
+   if (nHistorySize) {
+      history.pData = pHistory;
+      history.nSize = nHistorySize;
+   }
+   else {
+      history.pData = (const unsigned char *)pDictionaryData;
+      history.nSize = pDictionaryData ? nDictionaryDataSize : 0;
+   }
+   history.pSuffixArray = NULL;
+   history.pPLCP = NULL;
+
+   if (lz4ultra_filestream_open(&inStream, pszInFilename, "rb") < 0) {
+      lz4ultra_free(&pCtx->allocator, pHistory);
+      lz4ultra_dictionary_free(&pDictionaryData);
+      return LZ4ULTRA_ERROR_SRC;
+   }
+   if (lz4ultra_filestream_open(&outStream, pszOutFilename, "r+b") < 0) {
+      inStream.close(&inStream);
+      lz4ultra_free(&pCtx->allocator, pHistory);
+      lz4ultra_dictionary_free(&pDictionaryData);
+      return LZ4ULTRA_ERROR_DST;
+   }
+   if (lz4ultra_filestream_seek(&outStream, (long long)nEndOffset)) {
+      outStream.close(&outStream);
+      inStream.close(&inStream);
+      lz4ultra_free(&pCtx->allocator, pHistory);
+      lz4ultra_dictionary_free(&pDictionaryData);
+      return LZ4ULTRA_ERROR_DST;
+   }
+
+   nStatus = lz4ultra_compress_stream_blocks(pCtx, &inStream, &outStream, history.nSize ? &history : NULL, (nFlags & ~nFrameFormatFlags) | (nFrameFlags & ~LZ4ULTRA_FLAG_CONTENT_SIZE),
+      nBlockMaxCode, nCompressionLevel, -1LL, &contentChecksum, start, progress, &nOriginalSize, pCompressedSize, pCommandCount);
+
+   if (!nStatus && (nFrameFlags & LZ4ULTRA_FLAG_CONTENT_SIZE)) {
+      /* Update the decompressed size in the header, that keeps the same size */
+      unsigned char cFrameData[16];
+      int nHeaderSize;
+
+      memset(cFrameData, 0, 16);
+      nHeaderSize = lz4ultra_encode_header(cFrameData, 16, nFrameFlags, nBlockMaxCode, nContentSize + nOriginalSize);
+      if (nHeaderSize < 0)
+         nStatus = LZ4ULTRA_ERROR_COMPRESSION;
+      else if (lz4ultra_filestream_seek(&outStream, 0LL) || outStream.write(&outStream, cFrameData, nHeaderSize) != (size_t)nHeaderSize)
+         nStatus = LZ4ULTRA_ERROR_DST;
+   }
+
+   outStream.close(&outStream);
+   inStream.close(&inStream);
+   lz4ultra_free(&pCtx->allocator, pHistory);
+   lz4ultra_dictionary_free(&pDictionaryData);
+
+   if (!nStatus && pOriginalSize)
+      *pOriginalSize = nOriginalSize;
+   return nStatus;
+}
+
+/**
+ * Compress file and append it to an existing compressed file, see lz4ultra_append_file_ctx()
+ *
+ * @param pszInFilename name of input(source) file to compress
+ * @param pszOutFilename name of existing output(compressed) file to append to
+ * @param pszDictionaryFilename name of dictionary file that the compressed file was created with, or NULL for none
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx), except the ones that select the frame format, taken from the compressed file
+ * @param nCompressionLevel compression level (LZ4ULTRA_MIN_LEVEL..LZ4ULTRA_MAX_LEVEL, LZ4ULTRA_MAX_LEVEL for the best ratio)
+ * @param nThreads number of threads to compress blocks with (1 for single-threaded compression)
+ * @param start start function, called when the max block size is finalized and compression is about to start, or NULL for none
+ * @param progress progress function, called after compressing each block, or NULL for none
+ * @param pOriginalSize pointer to returned input(source) size, updated when this function is successful
+ * @param pCompressedSize pointer to returned number of bytes written to the output, from the end of the frame that was overwritten, updated when
+ *                        this function is successful
+ * @param pCommandCount pointer to returned token(compression commands) count, updated when this function is successful
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+lz4ultra_status_t lz4ultra_append_file(const char *pszInFilename, const char *pszOutFilename, const char *pszDictionaryFilename,
+                                       const unsigned int nFlags, int nCompressionLevel, int nThreads,
+                                       void(*start)(int nBlockMaxCode, const unsigned int nFlags),
+                                       void(*progress)(long long nOriginalSize, long long nCompressedSize), long long *pOriginalSize, long long *pCompressedSize, int *pCommandCount) {
+   lz4ultra_ctx *pCtx;
+   lz4ultra_status_t nStatus;
+
+   if (nThreads < 1)
+      nThreads = 1;
+
+   pCtx = lz4ultra_ctx_create(nThreads);
+   if (!pCtx)
+      return LZ4ULTRA_ERROR_MEMORY;
+
+   nStatus = lz4ultra_append_file_ctx(pCtx, pszInFilename, pszOutFilename, pszDictionaryFilename, nFlags, nCompressionLevel, start, progress, pOriginalSize, pCompressedSize, pCommandCount);
+
+   lz4ultra_ctx_destroy(pCtx);
+   return nStatus;
+}
+
+/*-------------- Streaming API -------------- */
+
+/** One block of input data, compressed by a worker thread */
+typedef struct {
+   const unsigned char *pInWindow;
+   const lz4ultra_dictionary *pDictionary;
+   unsigned char *pOutData;
+   int nPreviousBlockSize;
+   int nInDataSize;
+   int nIsIncompressible;
+   int nOutDataSize;
+   unsigned int nBlockChecksum;
+   int nVerifyFailed;
+} lz4ultra_stream_block;
+
+/** Blocks and compression contexts shared with the worker threads */
+typedef struct {
+   lz4ultra_ctx *pCtx;
+   lz4ultra_stream_block *pBlocks;
+   int nBlockMaxSize;
+   unsigned int nFlags;
+} lz4ultra_stream_jobs;
+
+/**
+ * Compress one block of input data, as a thread pool job
+ *
+ * @param pUserData blocks and compression contexts (lz4ultra_stream_jobs)
+ * @param nThreadIndex index of the thread running the job, selecting the compression context to use
+ * @param nJobIndex index of the block to compress
+ */
+static void lz4ultra_compress_stream_block_job(void *pUserData, const int nThreadIndex, const int nJobIndex) {
+   lz4ultra_stream_jobs *pJobs = (lz4ultra_stream_jobs *)pUserData;
+   lz4ultra_stream_block *pBlock = &pJobs->pBlocks[nJobIndex];
+   const int nBlockMaxSize = pJobs->nBlockMaxSize;
+
+   if (pBlock->nIsIncompressible) {
+      /* Adaptive splitting already found that this block doesn't compress, store it without searching for matches */
+      pBlock->nOutDataSize = -1;
+   }
+   else {
+      /* Legacy frames have no uncompressed blocks, so let a short last block grow up to the block size rather than fail to compress */
+      pBlock->nOutDataSize = lz4ultra_compressor_shrink_block(&pJobs->pCtx->pThreads[nThreadIndex].compressor, pBlock->pDictionary, pBlock->pInWindow, pBlock->nPreviousBlockSize, pBlock->nInDataSize,
+         pBlock->pOutData, (pBlock->nInDataSize >= nBlockMaxSize || (pJobs->nFlags & LZ4ULTRA_FLAG_LEGACY_FRAMES)) ? nBlockMaxSize : pBlock->nInDataSize);
+   }
+
+   if (pJobs->nFlags & LZ4ULTRA_FLAG_BLOCK_CHECKSUM) {
+      /* Checksum the block's data as it will be stored, while it is still in cache */
+      if (pBlock->nOutDataSize >= 0)
+         pBlock->nBlockChecksum = XXH32(pBlock->pOutData, pBlock->nOutDataSize, 0);
+      else
+         pBlock->nBlockChecksum = XXH32(pBlock->pInWindow + pBlock->nPreviousBlockSize, pBlock->nInDataSize, 0);
+   }
+
+   pBlock->nVerifyFailed = 0;
+   if ((pJobs->nFlags & LZ4ULTRA_FLAG_VERIFY) && pBlock->nOutDataSize >= 0) {
+      /* Decompress the block right away, after the history that its matches can reach, and compare it with the input data that is still in
+       * the window, instead of decompressing the whole output again once it is written */
+      unsigned char *pVerifyData = pJobs->pCtx->pThreads[nThreadIndex].pVerifyData;
+      const int nHistorySize = (pBlock->nPreviousBlockSize > HISTORY_SIZE) ? HISTORY_SIZE : pBlock->nPreviousBlockSize;
+      const int nCompressedSize = (pJobs->nFlags & LZ4ULTRA_FLAG_RAW_BLOCK) ? (pBlock->nOutDataSize - 2 /* EOD marker */) : pBlock->nOutDataSize;
+      int nDecompressedSize;
+
+      memcpy(pVerifyData, pBlock->pInWindow + pBlock->nPreviousBlockSize - nHistorySize, nHistorySize);
+      nDecompressedSize = lz4ultra_decompressor_expand_block(pBlock->pOutData, nCompressedSize, pVerifyData, nHistorySize, nBlockMaxSize);
+      if (nDecompressedSize != pBlock->nInDataSize || memcmp(pVerifyData + nHistorySize, pBlock->pInWindow + pBlock->nPreviousBlockSize, nDecompressedSize))
+         pBlock->nVerifyFailed = 1;
+   }
+}
+
+/**
+ * Check if all the input data was read
+ *
+ * @param pInStream input(source) stream, when pInMap is NULL
+ * @param pInMap input(source) data, or NULL when reading from pInStream
+ * @param nInMapSize size of input data, when pInMap isn't NULL
+ * @param nInMapOffset number of bytes of input data that were read, when pInMap isn't NULL
+ *
+ * @return nonzero if the end of the data has been reached, 0 if there is more data
+ */
+static int lz4ultra_compress_input_eof(lz4ultra_stream_t *pInStream, const unsigned char *pInMap, size_t nInMapSize, size_t nInMapOffset) {
+   if (pInMap)
+      return (nInMapOffset >= nInMapSize) ? 1 : 0;
+   else
+      return pInStream->eof(pInStream);
+}
+
+/** Index of the blocks written so far, that follows the frame as a skippable frame with LZ4ULTRA_FLAG_SEEK_TABLE */
+typedef struct {
+   unsigned char *pData;
+   size_t nSize;
+   size_t nCapacity;
+   const lz4ultra_allocator *pAllocator;  /**< allocator of the entries, of the compression context */
+} lz4ultra_stream_seek_table;
+
+/**
+ * Write one compressed block to the output stream, as a compressed or an uncompressed block frame, along with its checksum, and index it
+ *
+ * @param pOutStream output(compressed) stream to write to
+ * @param pBlock block, compressed by lz4ultra_compress_stream_block_job()
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
+ * @param pSeekTable seek table to index the block in, with LZ4ULTRA_FLAG_SEEK_TABLE
+ * @param pOriginalSize pointer to input(source) size, updated with the size of the block's data
+ * @param pCompressedSize pointer to output(compressed) size, updated with the number of bytes written
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+static lz4ultra_status_t lz4ultra_write_stream_block(lz4ultra_stream_t *pOutStream, const lz4ultra_stream_block *pBlock, const unsigned int nFlags, lz4ultra_stream_seek_table *pSeekTable,
+                                                     long long *pOriginalSize, long long *pCompressedSize) {
+   const int nInDataSize = pBlock->nInDataSize;
+   const int nOutDataSize = pBlock->nOutDataSize;
+   const long long nBlockStartOffset = *pCompressedSize;
+   unsigned char cFrameData[16];
+   lz4ultra_status_t nError = LZ4ULTRA_OK;
+
+   memset(cFrameData, 0, 16);
+
+   if (pBlock->nVerifyFailed) {
+      /* The block doesn't decompress back to its input data */
+      return LZ4ULTRA_ERROR_VERIFY;
+   }
+
+   if (nOutDataSize >= 0) {
+      int nFrameHeaderSize = 0;
+
+      /* Write compressed block */
+
+      if ((nFlags & LZ4ULTRA_FLAG_RAW_BLOCK) == 0) {
+         nFrameHeaderSize = lz4ultra_encode_compressed_block_frame(cFrameData, 16, nOutDataSize);
+         if (nFrameHeaderSize < 0)
+            nError = LZ4ULTRA_ERROR_COMPRESSION;
+         else {
+            if (pOutStream->write(pOutStream, cFrameData, nFrameHeaderSize) != (size_t)nFrameHeaderSize) {
+               nError = LZ4ULTRA_ERROR_DST;
+            }
+         }
+      }
+
+      if (!nError) {
+         if (pOutStream->write(pOutStream, pBlock->pOutData, (size_t)nOutDataSize) != (size_t)nOutDataSize) {
+            nError = LZ4ULTRA_ERROR_DST;
+         }
+         else {
+            *pOriginalSize += (long long)nInDataSize;
+            *pCompressedSize += (long long)nFrameHeaderSize + (long long)nOutDataSize;
+         }
+      }
+   }
+   else {
+      /* Write uncompressible, literal block */
+
+      if ((nFlags & (LZ4ULTRA_FLAG_RAW_BLOCK | LZ4ULTRA_FLAG_LEGACY_FRAMES)) != 0) {
+         /* Uncompressible data isn't supported by raw blocks and legacy frames */
+         return LZ4ULTRA_ERROR_RAW_UNCOMPRESSED;
+      }
+
+      int nFrameHeaderSize;
+
+      nFrameHeaderSize = lz4ultra_encode_uncompressed_block_frame(cFrameData, 16, nFlags, nInDataSize);
+      if (nFrameHeaderSize < 0)
+         nError = LZ4ULTRA_ERROR_COMPRESSION;
+      else {
+         if (pOutStream->write(pOutStream, cFrameData, nFrameHeaderSize) != (size_t)nFrameHeaderSize) {
+            nError = LZ4ULTRA_ERROR_DST;
+         }
+         else {
+            if (pOutStream->write(pOutStream, (void *)(pBlock->pInWindow + pBlock->nPreviousBlockSize), (size_t)nInDataSize) != (size_t)nInDataSize) {
+               nError = LZ4ULTRA_ERROR_DST;
+            }
+            else {
+               *pOriginalSize += (long long)nInDataSize;
+               *pCompressedSize += (long long)nFrameHeaderSize + (long long)nInDataSize;
+            }
+         }
+      }
+   }
+
+   if (!nError) {
+      int nChecksumSize = lz4ultra_encode_block_checksum(cFrameData, 16, nFlags, pBlock->nBlockChecksum);
+      if (nChecksumSize < 0)
+         nError = LZ4ULTRA_ERROR_COMPRESSION;
+      else if (nChecksumSize > 0) {
+         if (pOutStream->write(pOutStream, cFrameData, nChecksumSize) != (size_t)nChecksumSize)
+            nError = LZ4ULTRA_ERROR_DST;
+         else
+            *pCompressedSize += (long long)nChecksumSize;
+      }
+   }
+
+   if (!nError && (nFlags & LZ4ULTRA_FLAG_SEEK_TABLE)) {
+      /* Index the block that was just written */
+      if ((pSeekTable->nSize + LZ4ULTRA_SEEK_TABLE_ENTRY_SIZE) > pSeekTable->nCapacity) {
+         size_t nNewSeekTableCapacity = pSeekTable->nCapacity ? (pSeekTable->nCapacity * 2) : (256 * LZ4ULTRA_SEEK_TABLE_ENTRY_SIZE);
+         unsigned char *pNewSeekTable = (unsigned char *)lz4ultra_alloc(pSeekTable->pAllocator, nNewSeekTableCapacity);
+
+         if (pNewSeekTable) {
+            if (pSeekTable->pData) {
+               memcpy(pNewSeekTable, pSeekTable->pData, pSeekTable->nSize);
+               lz4ultra_free(pSeekTable->pAllocator, pSeekTable->pData);
+            }
+            pSeekTable->pData = pNewSeekTable;
+            pSeekTable->nCapacity = nNewSeekTableCapacity;
+         }
+         else {
+            nError = LZ4ULTRA_ERROR_MEMORY;
+         }
+      }
+
+      if (!nError) {
+         if (lz4ultra_encode_seek_table_entry(pSeekTable->pData + pSeekTable->nSize, LZ4ULTRA_SEEK_TABLE_ENTRY_SIZE, (unsigned int)(*pCompressedSize - nBlockStartOffset), (unsigned int)nInDataSize) < 0)
+            nError = LZ4ULTRA_ERROR_COMPRESSION;
+         else
+            pSeekTable->nSize += LZ4ULTRA_SEEK_TABLE_ENTRY_SIZE;
+      }
+   }
+
+   return nError;
+}
+
+/**
+ * Write the end of the frame to the output stream, with the checksum of the input data, followed by the seek table
+ *
+ * @param pOutStream output(compressed) stream to write to
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
+ * @param nContentChecksum checksum of all the input data, stored with LZ4ULTRA_FLAG_CONTENT_CHECKSUM
+ * @param pSeekTable index of the blocks in the frame, stored with LZ4ULTRA_FLAG_SEEK_TABLE
+ * @param pCompressedSize pointer to output(compressed) size, updated with the number of bytes written
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+static lz4ultra_status_t lz4ultra_write_stream_footer(lz4ultra_stream_t *pOutStream, const unsigned int nFlags, const unsigned int nContentChecksum, const lz4ultra_stream_seek_table *pSeekTable,
+                                                      long long *pCompressedSize) {
+   unsigned char cFrameData[16];
+   int nFooterSize;
+
+   memset(cFrameData, 0, 16);
+
+   if ((nFlags & LZ4ULTRA_FLAG_RAW_BLOCK) != 0) {
+      nFooterSize = 0;
+   }
+   else {
+      nFooterSize = lz4ultra_encode_footer_frame(cFrameData, 16, nFlags, nContentChecksum);
+      if (nFooterSize < 0)
+         return LZ4ULTRA_ERROR_COMPRESSION;
+   }
+
+   if (pOutStream->write(pOutStream, cFrameData, nFooterSize) != nFooterSize)
+      return LZ4ULTRA_ERROR_DST;
+   *pCompressedSize += (long long)nFooterSize;
+
+   if (nFlags & LZ4ULTRA_FLAG_SEEK_TABLE) {
+      /* Follow the frame with the seek table, as a skippable frame that lz4 decompressors ignore */
+      const unsigned int nSeekTableBlocks = (unsigned int)(pSeekTable->nSize / LZ4ULTRA_SEEK_TABLE_ENTRY_SIZE);
+      int nSeekTableHeaderSize = lz4ultra_encode_seek_table_header(cFrameData, 16, nSeekTableBlocks);
+      int nSeekTableFooterSize = lz4ultra_encode_seek_table_footer(cFrameData + LZ4ULTRA_SEEK_TABLE_HEADER_SIZE, 16 - LZ4ULTRA_SEEK_TABLE_HEADER_SIZE, nSeekTableBlocks);
+
+      if (nSeekTableHeaderSize < 0 || nSeekTableFooterSize < 0)
+         return LZ4ULTRA_ERROR_COMPRESSION;
+      else if (pOutStream->write(pOutStream, cFrameData, nSeekTableHeaderSize) != (size_t)nSeekTableHeaderSize ||
+               (pSeekTable->nSize && pOutStream->write(pOutStream, pSeekTable->pData, pSeekTable->nSize) != pSeekTable->nSize) ||
+               pOutStream->write(pOutStream, cFrameData + nSeekTableHeaderSize, nSeekTableFooterSize) != (size_t)nSeekTableFooterSize)
+         return LZ4ULTRA_ERROR_DST;
+      else
+         *pCompressedSize += (long long)nSeekTableHeaderSize + (long long)pSeekTable->nSize + (long long)nSeekTableFooterSize;
+   }
+
+   return LZ4ULTRA_OK;
+}
+
+/**
+ * Compress input data, read from a stream or from memory, into a raw block table. The table sits in front of the blocks, so that the whole
+ * input is compressed in memory before anything is written
+ *
+ * @param pCtx compression context, that also selects the number of threads to compress blocks with
+ * @param pInStream input(source) stream to compress, when pInMap is NULL
+ * @param pInMap input(source) data to compress, or NULL to read it from pInStream
+ * @param nInMapSize size of input data, when pInMap isn't NULL
+ * @param pOutStream output(compressed) stream to write to
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
+ * @param nBlockMaxCode maximum block size code (4..7 for 64 Kb..4 Mb)
+ * @param nCompressionLevel compression level (LZ4ULTRA_MIN_LEVEL..LZ4ULTRA_MAX_LEVEL, LZ4ULTRA_MAX_LEVEL for the best ratio)
+ * @param start start function, called when the max block size is finalized and compression is about to start, or NULL for none
+ * @param progress progress function, called after compressing all the blocks, or NULL for none
+ * @param pOriginalSize pointer to returned input(source) size, updated when this function is successful
+ * @param pCompressedSize pointer to returned output(compressed) size, updated when this function is successful
+ * @param pCommandCount pointer to returned token(compression commands) count, updated when this function is successful
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+static lz4ultra_status_t lz4ultra_compress_raw_table(lz4ultra_ctx *pCtx, lz4ultra_stream_t *pInStream, const unsigned char *pInMap, size_t nInMapSize, lz4ultra_stream_t *pOutStream,
+                                                     unsigned int nFlags, int nBlockMaxCode, int nCompressionLevel, void(*start)(int nBlockMaxCode, const unsigned int nFlags),
+                                                     void(*progress)(long long nOriginalSize, long long nCompressedSize), long long *pOriginalSize, long long *pCompressedSize, int *pCommandCount) {
+   unsigned char *pInData = NULL;
+   unsigned char *pOutData;
+   size_t nInDataSize, nMaxOutDataSize, nOutDataSize;
+
+   if (pInMap) {
+      nInDataSize = nInMapSize;
+   }
+   else {
+      if (lz4ultra_stream_read_all(pInStream, &pCtx->allocator, &pInData, &nInDataSize))
+         return LZ4ULTRA_ERROR_MEMORY;
+      pInMap = pInData;
+   }
+
+   /* Use the block size that compression settles on, so that short inputs get smaller blocks */
+   while (nBlockMaxCode > 4 && (size_t)(1 << (8 + ((nBlockMaxCode - 1) << 1))) > nInDataSize)
+      nBlockMaxCode--;
+   if (start)
+      start(nBlockMaxCode, (nFlags & ~(LZ4ULTRA_FLAG_RAW_BLOCK | LZ4ULTRA_FLAG_LEGACY_FRAMES)) | LZ4ULTRA_FLAG_INDEP_BLOCKS);
+
+   nMaxOutDataSize = lz4ultra_get_max_compressed_size_inmem(nInDataSize, nFlags, nBlockMaxCode);
+   pOutData = (unsigned char *)lz4ultra_alloc(&pCtx->allocator, nMaxOutDataSize);
+   if (!pOutData) {
+      lz4ultra_free(&pCtx->allocator, pInData);
+      return LZ4ULTRA_ERROR_MEMORY;
+   }
+
+   nOutDataSize = lz4ultra_compress_inmem_ctx(pCtx, pInMap, pOutData, nInDataSize, nMaxOutDataSize, nFlags, nBlockMaxCode, nCompressionLevel);
+   lz4ultra_free(&pCtx->allocator, pInData);
+   if (nOutDataSize == (size_t)-1) {
+      lz4ultra_free(&pCtx->allocator, pOutData);
+      return LZ4ULTRA_ERROR_COMPRESSION;
+   }
+
+   if (pOutStream->write(pOutStream, pOutData, nOutDataSize) != nOutDataSize) {
+      lz4ultra_free(&pCtx->allocator, pOutData);
+      return LZ4ULTRA_ERROR_DST;
+   }
+   lz4ultra_free(&pCtx->allocator, pOutData);
+
+   if (progress && nInDataSize)
+      progress((long long)nInDataSize, (long long)nOutDataSize);
+
+   if (pOriginalSize)
+      *pOriginalSize = (long long)nInDataSize;
+   if (pCompressedSize)
+      *pCompressedSize = (long long)nOutDataSize;
+   if (pCommandCount)
+      *pCommandCount = lz4ultra_ctx_get_command_count(pCtx);
+   return LZ4ULTRA_OK;
+}
+
+/**
+ * Compress input data, read from a stream or from memory, using a reusable compression context
+ *
+ * @param pCtx compression context, that also selects the number of threads to compress blocks with
+ * @param pInStream input(source) stream to compress, when pInMap is NULL
+ * @param pInMap input(source) data to compress, or NULL to read it from pInStream
+ * @param nInMapSize size of input data, when pInMap isn't NULL
+ * @param pOutStream output(compressed) stream to write to
+ * @param pDictionary dictionary, prepared or not, or NULL for none
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
+ * @param nBlockMaxCode maximum block size code (4..7 for 64 Kb..4 Mb)
+ * @param nCompressionLevel compression level (LZ4ULTRA_MIN_LEVEL..LZ4ULTRA_MAX_LEVEL, LZ4ULTRA_MAX_LEVEL for the best ratio)
+ * @param nContentSize size of the input data, stored in the header with LZ4ULTRA_FLAG_CONTENT_SIZE, or -1 if unknown; with LZ4ULTRA_FLAG_DEDUP,
+ *                     the size of the original data that the input is without the repeated ranges of
+ * @param pAppendChecksum checksum of the decompressed data of the frame that the blocks are appended to, whose header and blocks are already
+ *                        written and that pDictionary holds the history of, or NULL to write a new frame
+ * @param start start function, called when the max block size is finalized and compression is about to start, or NULL for none
+ * @param progress progress function, called after compressing each block, or NULL for none
+ * @param pOriginalSize pointer to returned input(source) size, updated when this function is successful
+ * @param pCompressedSize pointer to returned output(compressed) size, updated when this function is successful
+ * @param pCommandCount pointer to returned token(compression commands) count, updated when this function is successful
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+static lz4ultra_status_t lz4ultra_compress_blocks(lz4ultra_ctx *pCtx, lz4ultra_stream_t *pInStream, const unsigned char *pInMap, size_t nInMapSize, lz4ultra_stream_t *pOutStream,
+                                                  const lz4ultra_dictionary *pDictionary, unsigned int nFlags, int nBlockMaxCode, int nCompressionLevel, long long nContentSize,
+                                                  const XXH32_state_t *pAppendChecksum, void(*start)(int nBlockMaxCode, const unsigned int nFlags),
+                                                  void(*progress)(long long nOriginalSize, long long nCompressedSize), long long *pOriginalSize, long long *pCompressedSize, int *pCommandCount) {
+   const void *pDictionaryData = pDictionary ? pDictionary->pData : NULL;
+   int nDictionaryDataSize = pDictionary ? pDictionary->nSize : 0;
+   lz4ultra_stream_block *pBlocks;
+   int nThreads;
+   lz4ultra_stream_jobs jobs;
+   long long nOriginalSize = 0LL, nCompressedSize = 0LL;
+   int nBlockMaxBits;
+   int nBlockMaxSize;
+   int nBlockStride;
+   long long nWindowBlocks;
+   int nInWindowSize;
+   int nPreloadedInDataSize;
+   int nResult;
+   unsigned char cFrameData[16];
+   XXH32_state_t contentChecksum;
+   lz4ultra_stream_seek_table seekTable;
+   int nError = 0;
+   int i;
+
+   if (nFlags & LZ4ULTRA_FLAG_RAW_TABLE) {
+      /* A raw block table is self-contained: its blocks can't refer to a dictionary, nor be appended to */
+      if (pDictionary || pAppendChecksum)
+         return LZ4ULTRA_ERROR_DICTIONARY;
+      return lz4ultra_compress_raw_table(pCtx, pInStream, pInMap, nInMapSize, pOutStream, nFlags, nBlockMaxCode, nCompressionLevel, start, progress,
+         pOriginalSize, pCompressedSize, pCommandCount);
+   }
+
+   memset(cFrameData, 0, 16);
+   memset(&seekTable, 0, sizeof(lz4ultra_stream_seek_table));
+   seekTable.pAllocator = &pCtx->allocator;
+
+   if (nFlags & LZ4ULTRA_FLAG_LEGACY_FRAMES) {
+      nBlockMaxBits = 23;
+      nFlags |= LZ4ULTRA_FLAG_INDEP_BLOCKS;
+   }
+   else {
+      nBlockMaxBits = 8 + (nBlockMaxCode << 1);
+   }
+   nBlockMaxSize = 1 << nBlockMaxBits;
+
+   /* Raw blocks and legacy frames have nowhere to store checksums or a seek table */
+   if (nFlags & (LZ4ULTRA_FLAG_RAW_BLOCK | LZ4ULTRA_FLAG_LEGACY_FRAMES))
+      nFlags &= ~(LZ4ULTRA_FLAG_BLOCK_CHECKSUM | LZ4ULTRA_FLAG_CONTENT_CHECKSUM | LZ4ULTRA_FLAG_SEEK_TABLE);
+   /* A raw block can't be split, and legacy frames have no uncompressed blocks and expect full blocks */
+   if (nFlags & (LZ4ULTRA_FLAG_RAW_BLOCK | LZ4ULTRA_FLAG_LEGACY_FRAMES))
+      nFlags &= ~LZ4ULTRA_FLAG_ADAPTIVE_BLOCKS;
+   XXH32_reset(&contentChecksum, 0);
+   if (pAppendChecksum)
+      contentChecksum = *pAppendChecksum;
+
+   /* Raw blocks are limited to one block, there is nothing to compress in parallel */
+   nThreads = pCtx->nThreads;
+   if (nFlags & LZ4ULTRA_FLAG_RAW_BLOCK)
+      nThreads = 1;
+
+   if (lz4ultra_ctx_prepare_stream_buffers(pCtx, 1, nBlockMaxSize, pInMap ? 0 : (HISTORY_SIZE + nBlockMaxSize))) {
+      return LZ4ULTRA_ERROR_MEMORY;
+   }
+
+   /* Load first block of input data */
+   if (pInMap)
+      nPreloadedInDataSize = (nInMapSize > (size_t)nBlockMaxSize) ? nBlockMaxSize : (int)nInMapSize;
+   else
+      nPreloadedInDataSize = (int)pInStream->read(pInStream, pCtx->pInWindow + HISTORY_SIZE, nBlockMaxSize);
+   if (nPreloadedInDataSize < nBlockMaxSize) {
+      /* The entire input data fits in one block, there is nothing to compress in parallel */
+      nThreads = 1;
+
+      if ((nFlags & LZ4ULTRA_FLAG_LEGACY_FRAMES) == 0) {
+         /* If the entire input data is shorter than the specified block size, try to reduce the
+          * block size until is the smallest one that can fit the data */
+
+         do {
+            nBlockMaxBits = 8 + (nBlockMaxCode << 1);
+            nBlockMaxSize = 1 << nBlockMaxBits;
+
+            int nPrevBlockMaxBits = 8 + ((nBlockMaxCode - 1) << 1);
+            int nPrevBlockMaxSize = 1 << nPrevBlockMaxBits;
+            if (nBlockMaxCode > 4 && nPrevBlockMaxSize > nPreloadedInDataSize) {
+               nBlockMaxCode--;
+            }
+            else
+               break;
+         } while (1);
+      }
+   }
+
+   /* Blocks are read one after the other into the input window, following the history, so that each block's history is referenced in place.
+    * History is only moved back to the front of the window when the next batch of blocks doesn't fit anymore. Independent blocks that each
+    * start with the dictionary are spaced apart to make room for it, as the previous block may still be compressing. The input window isn't
+    * needed for data in memory, except to place the dictionary in front of blocks */
+   nBlockStride = nBlockMaxSize;
+   if ((nFlags & LZ4ULTRA_FLAG_INDEP_BLOCKS) && nDictionaryDataSize && pDictionaryData)
+      nBlockStride += nDictionaryDataSize;
+
+   if (nPreloadedInDataSize < nBlockMaxSize) {
+      nWindowBlocks = 1;
+   }
+   else {
+      nWindowBlocks = (MIN_STREAM_WINDOW_SIZE + nBlockStride - 1) / nBlockStride;
+      if (nWindowBlocks < nThreads)
+         nWindowBlocks = nThreads;
+   }
+
+   if (pInMap && !(nDictionaryDataSize && pDictionaryData))
+      nInWindowSize = 0;
+   else if ((HISTORY_SIZE + nWindowBlocks * (long long)nBlockStride) <= 0x7fffffffLL)
+      nInWindowSize = HISTORY_SIZE + (int)(nWindowBlocks * nBlockStride);
+   else
+      return LZ4ULTRA_ERROR_MEMORY;
+
+   /* Only allocate the compression contexts once the actual block size is known */
+   if (lz4ultra_ctx_prepare_stream_buffers(pCtx, nThreads, nBlockMaxSize, nInWindowSize)) {
+      return LZ4ULTRA_ERROR_MEMORY;
+   }
+
+   nResult = lz4ultra_ctx_prepare(pCtx, nThreads, nBlockMaxSize + HISTORY_SIZE, nFlags, nCompressionLevel);
+   if (nResult != 0) {
+      return LZ4ULTRA_ERROR_MEMORY;
+   }
+
+   if ((nFlags & LZ4ULTRA_FLAG_VERIFY) && lz4ultra_ctx_prepare_verify_buffers(pCtx, nThreads, nBlockMaxSize)) {
+      return LZ4ULTRA_ERROR_MEMORY;
+   }
+
+   pBlocks = (lz4ultra_stream_block *)lz4ultra_alloc(&pCtx->allocator, nThreads * sizeof(lz4ultra_stream_block));
+   if (!pBlocks) {
+      return LZ4ULTRA_ERROR_MEMORY;
+   }
+   memset(pBlocks, 0, nThreads * sizeof(lz4ultra_stream_block));
+
+   for (i = 0; i < nThreads; i++) {
+      pBlocks[i].pOutData = pCtx->pThreads[i].pOutData;
+   }
+
+   lz4ultra_ctx_reset(pCtx);
+
+   jobs.pCtx = pCtx;
+   jobs.pBlocks = pBlocks;
+   jobs.nBlockMaxSize = nBlockMaxSize;
+   jobs.nFlags = nFlags;
+
+   if ((nFlags & LZ4ULTRA_FLAG_RAW_BLOCK) == 0 && !pAppendChecksum) {
+      int nHeaderSize = lz4ultra_encode_header(cFrameData, 16, nFlags, nBlockMaxCode, nContentSize);
+      if (nHeaderSize < 0)
+         nError = LZ4ULTRA_ERROR_COMPRESSION;
+      else {
+         if (pOutStream->write(pOutStream, cFrameData, nHeaderSize) != nHeaderSize)
+            nError = LZ4ULTRA_ERROR_DST;
+         nCompressedSize += (long long)nHeaderSize;
+      }
+   }
+
+   if (start)
+      start(nBlockMaxCode, nFlags);
+
+   size_t nInMapOffset = 0;
+   int nInWindowPos = HISTORY_SIZE;
+   int nPreviousBlockSize = 0;
+   int nNumBlocks = 0;
+
+   while ((nPreloadedInDataSize > 0 || !lz4ultra_compress_input_eof(pInStream, pInMap, nInMapSize, nInMapOffset)) && !nError) {
+      int nBatchBlocks = 0;
+
+      if (nInWindowSize && (nInWindowPos + nThreads * nBlockStride) > nInWindowSize) {
+         /* Rewind the input window, moving the history of the next block back in front of it, along with the data left over from a block
+          * that ended early. History only depends on the input data, so each block of a batch can then be compressed independently by a
+          * different thread. */
+         if ((nPreviousBlockSize || nPreloadedInDataSize) && !pInMap)
+            memmove(pCtx->pInWindow + HISTORY_SIZE - nPreviousBlockSize, pCtx->pInWindow + nInWindowPos - nPreviousBlockSize, nPreviousBlockSize + nPreloadedInDataSize);
+         nInWindowPos = HISTORY_SIZE;
+      }
+
+      /* Read one block of input data for each thread */
+      do {
+         lz4ultra_stream_block *pBlock = &pBlocks[nBatchBlocks];
+         int nUseDictionary = 0;
+         int nInDataSize;
+
+         if (!nPreviousBlockSize && nDictionaryDataSize && pDictionaryData) {
+            nPreviousBlockSize = nDictionaryDataSize;
+            nUseDictionary = 1;
+         }
+
+         if (!pInMap || nUseDictionary) {
+            if (nUseDictionary) {
+               if (nInWindowPos > HISTORY_SIZE) {
+                  if (nPreloadedInDataSize && !pInMap)
+                     memmove(pCtx->pInWindow + nInWindowPos + nDictionaryDataSize, pCtx->pInWindow + nInWindowPos, nPreloadedInDataSize);
+                  nInWindowPos += nDictionaryDataSize;
+               }
+               memcpy(pCtx->pInWindow + nInWindowPos - nDictionaryDataSize, pDictionaryData, nDictionaryDataSize);
+            }
+            pBlock->pInWindow = pCtx->pInWindow + nInWindowPos - nPreviousBlockSize;
+         }
+         else {
+            /* In memory, the history is simply the data that precedes the block */
+            pBlock->pInWindow = pInMap + nInMapOffset - nPreviousBlockSize;
+         }
+         pBlock->pDictionary = nUseDictionary ? pDictionary : NULL;
+
+         if (pInMap) {
+            nInDataSize = ((nInMapSize - nInMapOffset) > (size_t)nBlockMaxSize) ? nBlockMaxSize : (int)(nInMapSize - nInMapOffset);
+            nPreloadedInDataSize = 0;
+         }
+         else {
+            /* The first block, and the data left over from a block that ended early, are already in the input window */
+            nInDataSize = nPreloadedInDataSize;
+            nPreloadedInDataSize = 0;
+            if (nInDataSize < nBlockMaxSize && !pInStream->eof(pInStream))
+               nInDataSize += (int)pInStream->read(pInStream, pCtx->pInWindow + nInWindowPos + nInDataSize, nBlockMaxSize - nInDataSize);
+         }
+
+         if (nInDataSize <= 0)
+            break;
+
+         if ((nFlags & LZ4ULTRA_FLAG_RAW_BLOCK) != 0 && ((nNumBlocks + nBatchBlocks) || nInDataSize > 0x400000)) {
+            nError = LZ4ULTRA_ERROR_RAW_TOOLARGE;
+            break;
+         }
+
+         pBlock->nIsIncompressible = 0;
+         if (nFlags & LZ4ULTRA_FLAG_ADAPTIVE_BLOCKS) {
+            /* End the block early where the data changes between compressible and incompressible; the rest starts the next block */
+            const int nSplitInDataSize = lz4ultra_get_adaptive_block_size(pInMap ? (pInMap + nInMapOffset) : (pCtx->pInWindow + nInWindowPos), nInDataSize, &pBlock->nIsIncompressible);
+
+            if (!pInMap)
+               nPreloadedInDataSize = nInDataSize - nSplitInDataSize;
+            nInDataSize = nSplitInDataSize;
+         }
+
+         if (pInMap) {
+            if (nUseDictionary)
+               memcpy(pCtx->pInWindow + nInWindowPos, pInMap + nInMapOffset, nInDataSize);
+            nInMapOffset += (size_t)nInDataSize;
+         }
+         if (!pInMap || nUseDictionary)
+            nInWindowPos += nInDataSize;
+         if (nFlags & LZ4ULTRA_FLAG_CONTENT_CHECKSUM) {
+            /* Update the content checksum with the block that was just read */
+            XXH32_update(&contentChecksum, pBlock->pInWindow + nPreviousBlockSize, nInDataSize);
+         }
+         if (!(nFlags & LZ4ULTRA_FLAG_INDEP_BLOCKS))
+            nDictionaryDataSize = 0;
+
+         pBlock->nPreviousBlockSize = nPreviousBlockSize;
+         pBlock->nInDataSize = nInDataSize;
+         nBatchBlocks++;
+
+         if (!(nFlags & LZ4ULTRA_FLAG_INDEP_BLOCKS)) {
+            /* Blocks that ended early are shorter than the history, that may then span several blocks; the dictionary is only in front of the
+             * first block in memory */
+            nPreviousBlockSize = (nUseDictionary ? 0 : nPreviousBlockSize) + nInDataSize;
+            if (nPreviousBlockSize > HISTORY_SIZE)
+               nPreviousBlockSize = HISTORY_SIZE;
+         }
+         else {
+            nPreviousBlockSize = 0;
+         }
+      } while (nBatchBlocks < nThreads && (nPreloadedInDataSize > 0 || !lz4ultra_compress_input_eof(pInStream, pInMap, nInMapSize, nInMapOffset)));
+
+      if (nError)
+         break;
+
+      /* Compress all the blocks that were read, in parallel */
+      if (lz4ultra_ctx_set_parallel_blocks(pCtx, nBatchBlocks)) {
+         nError = LZ4ULTRA_ERROR_MEMORY;
+         break;
+      }
+      lz4ultra_threadpool_run((nThreads > 1) ? pCtx->pPool : NULL, lz4ultra_compress_stream_block_job, &jobs, nBatchBlocks);
+
+      /* Write compressed blocks, in order */
+      for (i = 0; i < nBatchBlocks && !nError; i++) {
+         nError = lz4ultra_write_stream_block(pOutStream, &pBlocks[i], nFlags, &seekTable, &nOriginalSize, &nCompressedSize);
+         nNumBlocks++;
+
+         if (!nError && ((i + 1) < nBatchBlocks || nPreloadedInDataSize > 0 || !lz4ultra_compress_input_eof(pInStream, pInMap, nInMapSize, nInMapOffset))) {
+            if (progress)
+               progress(nOriginalSize, nCompressedSize);
+         }
+      }
+   }
+
+   if (!nError)
+      nError = lz4ultra_write_stream_footer(pOutStream, nFlags, XXH32_digest(&contentChecksum), &seekTable, &nCompressedSize);
+   if (seekTable.pData) {
+      lz4ultra_free(seekTable.pAllocator, seekTable.pData);
+      seekTable.pData = NULL;
+   }
+
+   if (!nError && (nFlags & (LZ4ULTRA_FLAG_CONTENT_SIZE | LZ4ULTRA_FLAG_DEDUP)) == LZ4ULTRA_FLAG_CONTENT_SIZE && nContentSize >= 0 && nOriginalSize != nContentSize) {
+      /* The input data changed size while it was compressed; the header is wrong */
+      nError = LZ4ULTRA_ERROR_SRC;
+   }
+
+   if (progress)
+      progress(nOriginalSize, nCompressedSize);
+
+   lz4ultra_free(&pCtx->allocator, pBlocks);
+   pBlocks = NULL;
+
+   int nCommandCount = lz4ultra_ctx_get_command_count(pCtx);
+
+   if (nError) {
+      return nError;
+   }
+   else {
+      if (pOriginalSize)
+         *pOriginalSize = nOriginalSize;
+      if (pCompressedSize)
+         *pCompressedSize = nCompressedSize;
+      if (pCommandCount)
+         *pCommandCount = nCommandCount;
+      return LZ4ULTRA_OK;
+   }
+}
+
+/**
+ * Compress stream, reading ahead and writing behind on background threads when LZ4ULTRA_FLAG_ASYNC_IO is set
+ *
+ * @param pCtx compression context, that also selects the number of threads to compress blocks with
+ * @param pInStream input(source) stream to compress
+ * @param pOutStream output(compressed) stream to write to
+ * @param pDictionary dictionary, prepared or not, or NULL for none
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
+ * @param nBlockMaxCode maximum block size code (4..7 for 64 Kb..4 Mb)
+ * @param nCompressionLevel compression level (LZ4ULTRA_MIN_LEVEL..LZ4ULTRA_MAX_LEVEL, LZ4ULTRA_MAX_LEVEL for the best ratio)
+ * @param nContentSize size of the input data, stored in the header with LZ4ULTRA_FLAG_CONTENT_SIZE, or -1 if unknown
+ * @param pAppendChecksum checksum of the decompressed data of the frame that the blocks are appended to, whose header and blocks are already
+ *                        written and that pDictionary holds the history of, or NULL to write a new frame
+ * @param start start function, called when the max block size is finalized and compression is about to start, or NULL for none
+ * @param progress progress function, called after compressing each block, or NULL for none
+ * @param pOriginalSize pointer to returned input(source) size, updated when this function is successful
+ * @param pCompressedSize pointer to returned output(compressed) size, updated when this function is successful
+ * @param pCommandCount pointer to returned token(compression commands) count, updated when this function is successful
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+static lz4ultra_status_t lz4ultra_compress_stream_blocks(lz4ultra_ctx *pCtx, lz4ultra_stream_t *pInStream, lz4ultra_stream_t *pOutStream, const lz4ultra_dictionary *pDictionary, unsigned int nFlags,
+                                                         int nBlockMaxCode, int nCompressionLevel, long long nContentSize, const XXH32_state_t *pAppendChecksum,
+                                                         void(*start)(int nBlockMaxCode, const unsigned int nFlags),
+                                                         void(*progress)(long long nOriginalSize, long long nCompressedSize), long long *pOriginalSize, long long *pCompressedSize, int *pCommandCount) {
+   lz4ultra_stream_t asyncInStream, asyncOutStream;
+   lz4ultra_status_t nStatus;
+
+   if ((nFlags & LZ4ULTRA_FLAG_ASYNC_IO) == 0)
+      return lz4ultra_compress_blocks(pCtx, pInStream, NULL, 0, pOutStream, pDictionary, nFlags, nBlockMaxCode, nCompressionLevel, nContentSize, pAppendChecksum, start, progress, pOriginalSize, pCompressedSize, pCommandCount);
+
+   /* Read the next batch of blocks ahead and write the previous one behind, while the current batch compresses */
+   size_t nBufferSize = (size_t)((nFlags & LZ4ULTRA_FLAG_LEGACY_FRAMES) ? (1 << 23) : (1 << (8 + (nBlockMaxCode << 1)))) * (size_t)pCtx->nThreads;
+   if (nBufferSize < MIN_STREAM_WINDOW_SIZE)
+      nBufferSize = MIN_STREAM_WINDOW_SIZE;
+
+   if (lz4ultra_asyncstream_open(&asyncInStream, pInStream, 0, nBufferSize))
+      return LZ4ULTRA_ERROR_MEMORY;
+   if (lz4ultra_asyncstream_open(&asyncOutStream, pOutStream, 1, nBufferSize)) {
+      lz4ultra_asyncstream_finish(&asyncInStream);
+      return LZ4ULTRA_ERROR_MEMORY;
+   }
+
+   nStatus = lz4ultra_compress_blocks(pCtx, &asyncInStream, NULL, 0, &asyncOutStream, pDictionary, nFlags, nBlockMaxCode, nCompressionLevel, nContentSize, pAppendChecksum, start, progress, pOriginalSize, pCompressedSize, pCommandCount);
+
+   if (lz4ultra_asyncstream_finish(&asyncOutStream) && nStatus == LZ4ULTRA_OK)
+      nStatus = LZ4ULTRA_ERROR_DST;
+   lz4ultra_asyncstream_finish(&asyncInStream);
+   return nStatus;
+}
+
+/**
+ * Compress stream, using a reusable compression context
+ *
+ * @param pCtx compression context, that also selects the number of threads to compress blocks with
+ * @param pInStream input(source) stream to compress
+ * @param pOutStream output(compressed) stream to write to
+ * @param pDictionaryData dictionary contents, or NULL for none
+ * @param nDictionaryDataSize size of dictionary contents, or 0
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
+ * @param nBlockMaxCode maximum block size code (4..7 for 64 Kb..4 Mb)
+ * @param nCompressionLevel compression level (LZ4ULTRA_MIN_LEVEL..LZ4ULTRA_MAX_LEVEL, LZ4ULTRA_MAX_LEVEL for the best ratio)
+ * @param start start function, called when the max block size is finalized and compression is about to start, or NULL for none
+ * @param progress progress function, called after compressing each block, or NULL for none
+ * @param pOriginalSize pointer to returned input(source) size, updated when this function is successful
+ * @param pCompressedSize pointer to returned output(compressed) size, updated when this function is successful
+ * @param pCommandCount pointer to returned token(compression commands) count, updated when this function is successful
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+lz4ultra_status_t lz4ultra_compress_stream_ctx(lz4ultra_ctx *pCtx, lz4ultra_stream_t *pInStream, lz4ultra_stream_t *pOutStream, const void *pDictionaryData, int nDictionaryDataSize, unsigned int nFlags,
+                                               int nBlockMaxCode, int nCompressionLevel,
+                                               void(*start)(int nBlockMaxCode, const unsigned int nFlags),
+                                               void(*progress)(long long nOriginalSize, long long nCompressedSize), long long *pOriginalSize, long long *pCompressedSize, int *pCommandCount) {
+   lz4ultra_dictionary dictionary;
+
+   dictionary.pData = (const unsigned char *)pDictionaryData;
+   dictionary.nSize = nDictionaryDataSize;
+   dictionary.pSuffixArray = NULL;
+   dictionary.pPLCP = NULL;
+
+   return lz4ultra_compress_stream_blocks(pCtx, pInStream, pOutStream, (nDictionaryDataSize && pDictionaryData) ? &dictionary : NULL, nFlags, nBlockMaxCode, nCompressionLevel, -1LL, NULL, start, progress, pOriginalSize, pCompressedSize, pCommandCount);
+}
+
+/**
+ * Compress stream with a prepared dictionary, using a reusable compression context. Each block that starts with the dictionary, that is every
+ * block with LZ4ULTRA_FLAG_INDEP_BLOCKS, then only needs its own suffixes sorted when it is small compared to the dictionary
+ *
+ * @param pCtx compression context, that also selects the number of threads to compress blocks with
+ * @param pInStream input(source) stream to compress
+ * @param pOutStream output(compressed) stream to write to
+ * @param pDictionary prepared dictionary, or NULL for none
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
+ * @param nBlockMaxCode maximum block size code (4..7 for 64 Kb..4 Mb)
+ * @param nCompressionLevel compression level (LZ4ULTRA_MIN_LEVEL..LZ4ULTRA_MAX_LEVEL, LZ4ULTRA_MAX_LEVEL for the best ratio)
+ * @param start start function, called when the max block size is finalized and compression is about to start, or NULL for none
+ * @param progress progress function, called after compressing each block, or NULL for none
+ * @param pOriginalSize pointer to returned input(source) size, updated when this function is successful
+ * @param pCompressedSize pointer to returned output(compressed) size, updated when this function is successful
+ * @param pCommandCount pointer to returned token(compression commands) count, updated when this function is successful
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+lz4ultra_status_t lz4ultra_compress_stream_dict(lz4ultra_ctx *pCtx, lz4ultra_stream_t *pInStream, lz4ultra_stream_t *pOutStream, const lz4ultra_dictionary *pDictionary, unsigned int nFlags,
+                                                int nBlockMaxCode, int nCompressionLevel,
+                                                void(*start)(int nBlockMaxCode, const unsigned int nFlags),
+                                                void(*progress)(long long nOriginalSize, long long nCompressedSize), long long *pOriginalSize, long long *pCompressedSize, int *pCommandCount) {
+   return lz4ultra_compress_stream_blocks(pCtx, pInStream, pOutStream, (pDictionary && pDictionary->nSize) ? pDictionary : NULL, nFlags, nBlockMaxCode, nCompressionLevel, -1LL, NULL, start, progress, pOriginalSize, pCompressedSize, pCommandCount);
+}
+
+/**
+ * Compress stream
+ *
+ * @param pInStream input(source) stream to compress
+ * @param pOutStream output(compressed) stream to write to
+ * @param pDictionaryData dictionary contents, or NULL for none
+ * @param nDictionaryDataSize size of dictionary contents, or 0
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
+ * @param nBlockMaxCode maximum block size code (4..7 for 64 Kb..4 Mb)
+ * @param nCompressionLevel compression level (LZ4ULTRA_MIN_LEVEL..LZ4ULTRA_MAX_LEVEL, LZ4ULTRA_MAX_LEVEL for the best ratio)
+ * @param nThreads number of threads to compress blocks with (1 for single-threaded compression)
+ * @param start start function, called when the max block size is finalized and compression is about to start, or NULL for none
+ * @param progress progress function, called after compressing each block, or NULL for none
+ * @param pOriginalSize pointer to returned input(source) size, updated when this function is successful
+ * @param pCompressedSize pointer to returned output(compressed) size, updated when this function is successful
+ * @param pCommandCount pointer to returned token(compression commands) count, updated when this function is successful
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+lz4ultra_status_t lz4ultra_compress_stream(lz4ultra_stream_t *pInStream, lz4ultra_stream_t *pOutStream, const void *pDictionaryData, int nDictionaryDataSize, unsigned int nFlags,
+                                           int nBlockMaxCode, int nCompressionLevel, int nThreads,
+                                           void(*start)(int nBlockMaxCode, const unsigned int nFlags),
+                                           void(*progress)(long long nOriginalSize, long long nCompressedSize), long long *pOriginalSize, long long *pCompressedSize, int *pCommandCount) {
+   lz4ultra_ctx *pCtx;
+   lz4ultra_status_t nStatus;
+
+   if (nThreads < 1)
+      nThreads = 1;
+
+   pCtx = lz4ultra_ctx_create(nThreads);
+   if (!pCtx)
+      return LZ4ULTRA_ERROR_MEMORY;
+
+   nStatus = lz4ultra_compress_stream_ctx(pCtx, pInStream, pOutStream, pDictionaryData, nDictionaryDataSize, nFlags, nBlockMaxCode, nCompressionLevel, start, progress, pOriginalSize, pCompressedSize, pCommandCount);
+
+   lz4ultra_ctx_destroy(pCtx);
+   return nStatus;
+}
+
+/**
+ * Get the amount of memory that a reusable compression context allocates for compressing a stream, with its number of threads and of match
+ * candidates, when the data to compress is larger than the maximum block size
+ *
+ * @param pCtx compression context
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
+ * @param nBlockMaxCode maximum block size code (4..7 for 64 Kb..4 Mb)
+ * @param nCompressionLevel compression level (LZ4ULTRA_MIN_LEVEL..LZ4ULTRA_MAX_LEVEL, LZ4ULTRA_MAX_LEVEL for the best ratio)
+ * @param nDictionaryDataSize size of dictionary contents, or 0
+ *
+ * @return size in bytes
+ */
+size_t lz4ultra_ctx_get_stream_memory_size(lz4ultra_ctx *pCtx, const unsigned int nFlags, const int nBlockMaxCode, int nCompressionLevel, const int nDictionaryDataSize) {
+   const int nBlockMaxSize = (nFlags & LZ4ULTRA_FLAG_LEGACY_FRAMES) ? (1 << 23) : (1 << (8 + (nBlockMaxCode << 1)));
+   int nThreads = pCtx->nThreads;
+   int nBlockStride = nBlockMaxSize;
+   int nWindowBlocks;
+   size_t nMemorySize;
+
+   if (nCompressionLevel < LZ4ULTRA_MIN_LEVEL || nCompressionLevel > LZ4ULTRA_MAX_LEVEL)
+      nCompressionLevel = LZ4ULTRA_MAX_LEVEL;
+   if (nFlags & LZ4ULTRA_FLAG_RAW_BLOCK)
+      nThreads = 1;
+   if ((nFlags & (LZ4ULTRA_FLAG_INDEP_BLOCKS | LZ4ULTRA_FLAG_LEGACY_FRAMES)) && nDictionaryDataSize)
+      nBlockStride += nDictionaryDataSize;
+
+   /* Compression context and output buffer of each thread */
+   nMemorySize = (size_t)nThreads * (lz4ultra_compressor_get_init_memory_size(nBlockMaxSize + HISTORY_SIZE, nCompressionLevel,
+      (nCompressionLevel >= LZ4ULTRA_MAX_LEVEL) ? pCtx->nMatchCandidates : 1) + (size_t)nBlockMaxSize + sizeof(lz4ultra_stream_block));
+
+   /* Verification buffer of each thread */
+   if (nFlags & LZ4ULTRA_FLAG_VERIFY)
+      nMemorySize += (size_t)nThreads * (size_t)(HISTORY_SIZE + nBlockMaxSize);
+
+   /* Ranges of the first thread's buckets, to sort them on all the threads */
+   if (nThreads > 1 && nCompressionLevel >= LZ4ULTRA_MAX_LEVEL)
+      nMemorySize += DIVSUFSORT_BSTAR_RANGES_SIZE;
+
+   /* Input window, for data read from a stream */
+   nWindowBlocks = (MIN_STREAM_WINDOW_SIZE + nBlockStride - 1) / nBlockStride;
+   if (nWindowBlocks < nThreads)
+      nWindowBlocks = nThreads;
+   nMemorySize += (size_t)HISTORY_SIZE + (size_t)nWindowBlocks * (size_t)nBlockStride;
+
+   return nMemorySize;
+}
+
+/**
+ * Get the largest maximum block size code, up to the requested one, that compressing a stream with a reusable compression context fits in a
+ * memory budget with. Windows of up to COMPACT_INTERVALS_MAX_WINDOW_SIZE bytes, that is 64 and 256 Kb blocks, also use the match finder's
+ * 32-bit layout, that takes half the memory
+ *
+ * @param pCtx compression context
+ * @param nMaxMemorySize memory budget, in bytes
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx)
+ * @param nBlockMaxCode largest maximum block size code to return (4..7 for 64 Kb..4 Mb)
+ * @param nCompressionLevel compression level (LZ4ULTRA_MIN_LEVEL..LZ4ULTRA_MAX_LEVEL, LZ4ULTRA_MAX_LEVEL for the best ratio)
+ * @param nDictionaryDataSize size of dictionary contents, or 0
+ *
+ * @return maximum block size code (4..7), or -1 if the budget is too small for 64 Kb blocks or for legacy frames
+ */
+int lz4ultra_ctx_get_block_max_code_for_memory(lz4ultra_ctx *pCtx, const size_t nMaxMemorySize, const unsigned int nFlags, int nBlockMaxCode, const int nCompressionLevel,
+                                                const int nDictionaryDataSize) {
+   if (nFlags & LZ4ULTRA_FLAG_LEGACY_FRAMES) {
+      /* Legacy frames always use 8 Mb blocks */
+      return (lz4ultra_ctx_get_stream_memory_size(pCtx, nFlags, 7, nCompressionLevel, nDictionaryDataSize) <= nMaxMemorySize) ? nBlockMaxCode : -1;
+   }
+
+   for (; nBlockMaxCode >= 4; nBlockMaxCode--) {
+      if (lz4ultra_ctx_get_stream_memory_size(pCtx, nFlags, nBlockMaxCode, nCompressionLevel, nDictionaryDataSize) <= nMaxMemorySize)
+         return nBlockMaxCode;
+   }
+
+   return -1;
+}
+
+/*-------------- Push API -------------- */
+
+/** Compression stream that input data is pushed into, and that writes compressed blocks out as they fill up or when flushed */
+struct _lz4ultra_cstream {
+   lz4ultra_ctx *pCtx;                    /**< compression context */
+   int nOwnCtx;                           /**< 1 if the compression context was created for this stream, and is destroyed with it */
+   lz4ultra_stream_t *pOutStream;         /**< output(compressed) stream to write to */
+   const unsigned char *pDictionaryData;  /**< dictionary contents, or NULL for none */
+   int nDictionaryDataSize;               /**< size of dictionary contents, or 0 */
+   unsigned int nFlags;                   /**< compression flags (LZ4ULTRA_FLAG_xxx) */
+   int nBlockMaxCode;                     /**< maximum block size code (4..7 for 64 Kb..4 Mb) */
+   int nBlockMaxSize;                     /**< maximum block size, in bytes */
+   int nHistorySize;                      /**< number of bytes of history in the input window, in front of the pending data */
+   int nPendingSize;                      /**< number of bytes that were pushed, but not compressed yet, at HISTORY_SIZE in the input window */
+   int nHeaderWritten;                    /**< 1 once the frame header was written */
+   lz4ultra_status_t nError;              /**< first error that occurred, reported by all the following calls */
+   XXH32_state_t contentChecksum;         /**< checksum of the input data, with LZ4ULTRA_FLAG_CONTENT_CHECKSUM */
+   lz4ultra_stream_seek_table seekTable;  /**< index of the blocks written so far, with LZ4ULTRA_FLAG_SEEK_TABLE */
+   long long nOriginalSize;               /**< number of input bytes written out as blocks */
+   long long nCompressedSize;             /**< number of output bytes written */
+};
+
+/**
+ * Place the history of the next block in front of it in the input window: the dictionary, when it starts a frame or starts every block, or
+ * otherwise up to the last HISTORY_SIZE bytes of input data, that may span several small blocks
+ *
+ * @param pStream compression stream
+ * @param nInDataSize number of bytes in the block that was just compressed, following the current history, or 0 when starting the frame
+ */
+static void lz4ultra_cstream_set_history(lz4ultra_cstream *pStream, const int nInDataSize) {
+   unsigned char *pInWindow = pStream->pCtx->pInWindow;
+
+   if ((nInDataSize == 0 || (pStream->nFlags & LZ4ULTRA_FLAG_INDEP_BLOCKS)) && pStream->nDictionaryDataSize) {
+      memcpy(pInWindow + HISTORY_SIZE - pStream->nDictionaryDataSize, pStream->pDictionaryData, pStream->nDictionaryDataSize);
+      pStream->nHistorySize = pStream->nDictionaryDataSize;
+   }
+   else if (pStream->nFlags & LZ4ULTRA_FLAG_INDEP_BLOCKS) {
+      pStream->nHistorySize = 0;
+   }
+   else {
+      int nHistorySize = pStream->nHistorySize + nInDataSize;
+
+      if (nHistorySize > HISTORY_SIZE)
+         nHistorySize = HISTORY_SIZE;
+      memmove(pInWindow + HISTORY_SIZE - nHistorySize, pInWindow + HISTORY_SIZE + nInDataSize - nHistorySize, nHistorySize);
+      pStream->nHistorySize = nHistorySize;
+   }
+}
+
+/**
+ * Compress the pending input data as one block, and write it out, preceded by the frame header if it wasn't written yet
+ *
+ * @param pStream compression stream
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+static lz4ultra_status_t lz4ultra_cstream_write_block(lz4ultra_cstream *pStream) {
+   lz4ultra_ctx *pCtx = pStream->pCtx;
+   lz4ultra_stream_block block;
+   lz4ultra_stream_jobs jobs;
+   lz4ultra_dictionary dictionary;
+   const int nInDataSize = pStream->nPendingSize;
+   lz4ultra_status_t nError;
+
+   if (!pStream->nHeaderWritten) {
+      unsigned char cFrameData[16];
+      int nHeaderSize;
+
+      memset(cFrameData, 0, 16);
+      nHeaderSize = lz4ultra_encode_header(cFrameData, 16, pStream->nFlags, pStream->nBlockMaxCode, -1LL);
+      if (nHeaderSize < 0)
+         return LZ4ULTRA_ERROR_COMPRESSION;
+      if (pStream->pOutStream->write(pStream->pOutStream, cFrameData, nHeaderSize) != (size_t)nHeaderSize)
+         return LZ4ULTRA_ERROR_DST;
+      pStream->nCompressedSize += (long long)nHeaderSize;
+      pStream->nHeaderWritten = 1;
+   }
+
+   if (nInDataSize == 0)
+      return LZ4ULTRA_OK;
+
+   dictionary.pData = pStream->pDictionaryData;
+   dictionary.nSize = pStream->nDictionaryDataSize;
+   dictionary.pSuffixArray = NULL;
+   dictionary.pPLCP = NULL;
+
+   memset(&block, 0, sizeof(lz4ultra_stream_block));
+   block.pInWindow = pCtx->pInWindow + HISTORY_SIZE - pStream->nHistorySize;
+   block.pDictionary = (pStream->nDictionaryDataSize && pStream->nHistorySize == pStream->nDictionaryDataSize) ? &dictionary : NULL;
+   block.pOutData = pCtx->pThreads[0].pOutData;
+   block.nPreviousBlockSize = pStream->nHistorySize;
+   block.nInDataSize = nInDataSize;
+
+   jobs.pCtx = pCtx;
+   jobs.pBlocks = &block;
+   jobs.nBlockMaxSize = pStream->nBlockMaxSize;
+   jobs.nFlags = pStream->nFlags;
+   lz4ultra_compress_stream_block_job(&jobs, 0, 0);
+
+   if (pStream->nFlags & LZ4ULTRA_FLAG_CONTENT_CHECKSUM)
+      XXH32_update(&pStream->contentChecksum, pCtx->pInWindow + HISTORY_SIZE, nInDataSize);
+
+   /* Write the block before its data moves into the history of the next one, as it may be stored uncompressed */
+   nError = lz4ultra_write_stream_block(pStream->pOutStream, &block, pStream->nFlags, &pStream->seekTable, &pStream->nOriginalSize, &pStream->nCompressedSize);
+
+   pStream->nPendingSize = 0;
+   lz4ultra_cstream_set_history(pStream, nInDataSize);
+   return nError;
+}
+
+/**
+ * Create a compression stream, that input data is pushed into with lz4ultra_cstream_update(), and that writes a frame of compressed blocks to an
+ * output stream: one block whenever the maximum block size worth of data was pushed, and one block with the pending data on each
+ * lz4ultra_cstream_flush(). Blocks are compressed in the calling thread, one at a time
+ *
+ * @param pCtx compression context, or NULL to create a single-threaded one for this stream
+ * @param pOutStream output(compressed) stream to write to
+ * @param pDictionaryData dictionary contents, that must stay valid until the stream is ended, or NULL for none
+ * @param nDictionaryDataSize size of dictionary contents (up to HISTORY_SIZE), or 0
+ * @param nFlags compression flags (LZ4ULTRA_FLAG_xxx), LZ4ULTRA_FLAG_RAW_BLOCK, LZ4ULTRA_FLAG_RAW_TABLE and LZ4ULTRA_FLAG_LEGACY_FRAMES aren't
+ *               supported, and LZ4ULTRA_FLAG_CONTENT_SIZE is ignored as the size isn't known upfront
+ * @param nBlockMaxCode maximum block size code (4..7 for 64 Kb..4 Mb)
+ * @param nCompressionLevel compression level (LZ4ULTRA_MIN_LEVEL..LZ4ULTRA_MAX_LEVEL, LZ4ULTRA_MAX_LEVEL for the best ratio)
+ *
+ * @return compression stream, or NULL for failure
+ */
+lz4ultra_cstream *lz4ultra_cstream_create(lz4ultra_ctx *pCtx, lz4ultra_stream_t *pOutStream, const void *pDictionaryData, int nDictionaryDataSize, unsigned int nFlags,
+                                          int nBlockMaxCode, int nCompressionLevel) {
+   lz4ultra_cstream *pStream;
+
+   if ((nFlags & (LZ4ULTRA_FLAG_RAW_BLOCK | LZ4ULTRA_FLAG_RAW_TABLE | LZ4ULTRA_FLAG_LEGACY_FRAMES)) || nBlockMaxCode < 4 || nBlockMaxCode > 7 ||
+       nDictionaryDataSize < 0 || nDictionaryDataSize > HISTORY_SIZE || (nDictionaryDataSize && !pDictionaryData))
+      return NULL;
+
+   pStream = (lz4ultra_cstream *)malloc(sizeof(lz4ultra_cstream));
+   if (!pStream)
+      return NULL;
+   memset(pStream, 0, sizeof(lz4ultra_cstream));
+
+   pStream->pCtx = pCtx;
+   if (!pStream->pCtx) {
+      pStream->pCtx = lz4ultra_ctx_create(1);
+      pStream->nOwnCtx = 1;
+      if (!pStream->pCtx) {
+         free(pStream);
+         return NULL;
+      }
+   }
+
+   pStream->seekTable.pAllocator = &pStream->pCtx->allocator;
+   pStream->pOutStream = pOutStream;
+   pStream->pDictionaryData = (const unsigned char *)pDictionaryData;
+   pStream->nDictionaryDataSize = pDictionaryData ? nDictionaryDataSize : 0;
+   pStream->nFlags = nFlags & ~(LZ4ULTRA_FLAG_CONTENT_SIZE | LZ4ULTRA_FLAG_ASYNC_IO);
+   pStream->nBlockMaxCode = nBlockMaxCode;
+   pStream->nBlockMaxSize = 1 << (8 + (nBlockMaxCode << 1));
+   pStream->nError = LZ4ULTRA_OK;
+   XXH32_reset(&pStream->contentChecksum, 0);
+
+   if (lz4ultra_ctx_prepare_stream_buffers(pStream->pCtx, 1, pStream->nBlockMaxSize, HISTORY_SIZE + pStream->nBlockMaxSize) ||
+       lz4ultra_ctx_prepare(pStream->pCtx, 1, pStream->nBlockMaxSize + HISTORY_SIZE, pStream->nFlags, nCompressionLevel) ||
+       ((pStream->nFlags & LZ4ULTRA_FLAG_VERIFY) && lz4ultra_ctx_prepare_verify_buffers(pStream->pCtx, 1, pStream->nBlockMaxSize)) ||
+       lz4ultra_ctx_set_parallel_blocks(pStream->pCtx, 1)) {
+      if (pStream->nOwnCtx)
+         lz4ultra_ctx_destroy(pStream->pCtx);
+      free(pStream);
+      return NULL;
+   }
+
+   lz4ultra_ctx_reset(pStream->pCtx);
+   lz4ultra_cstream_set_history(pStream, 0);
+   return pStream;
+}
+
+/**
+ * Push input data into a compression stream. Each time the maximum block size worth of data is pending, it is compressed and written out
+ *
+ * @param pStream compression stream
+ * @param pData input data to compress
+ * @param nDataSize size of input data, in bytes
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+lz4ultra_status_t lz4ultra_cstream_update(lz4ultra_cstream *pStream, const void *pData, size_t nDataSize) {
+   const unsigned char *pCurData = (const unsigned char *)pData;
+
+   while (nDataSize && !pStream->nError) {
+      size_t nCopySize = (size_t)(pStream->nBlockMaxSize - pStream->nPendingSize);
+
+      if (nCopySize > nDataSize)
+         nCopySize = nDataSize;
+      memcpy(pStream->pCtx->pInWindow + HISTORY_SIZE + pStream->nPendingSize, pCurData, nCopySize);
+      pStream->nPendingSize += (int)nCopySize;
+      pCurData += nCopySize;
+      nDataSize -= nCopySize;
+
+      if (pStream->nPendingSize == pStream->nBlockMaxSize)
+         pStream->nError = lz4ultra_cstream_write_block(pStream);
+   }
+
+   return pStream->nError;
+}
+
+/**
+ * Compress all the pending input data of a compression stream as one block, and write it out before returning, so that the output stream holds
+ * everything that was pushed so far. The following blocks still reference the data as history
+ *
+ * @param pStream compression stream
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+lz4ultra_status_t lz4ultra_cstream_flush(lz4ultra_cstream *pStream) {
+   if (!pStream->nError)
+      pStream->nError = lz4ultra_cstream_write_block(pStream);
+   return pStream->nError;
+}
+
+/**
+ * End a compression stream: flush the pending input data, write the end of the frame, and free the stream. The stream can't be used afterwards,
+ * even if an error is returned
+ *
+ * @param pStream compression stream
+ * @param pOriginalSize pointer to returned input(source) size, updated when this function is successful, or NULL
+ * @param pCompressedSize pointer to returned output(compressed) size, updated when this function is successful, or NULL
+ *
+ * @return LZ4ULTRA_OK for success, or an error value from lz4ultra_status_t
+ */
+lz4ultra_status_t lz4ultra_cstream_end(lz4ultra_cstream *pStream, long long *pOriginalSize, long long *pCompressedSize) {
+   lz4ultra_status_t nError = lz4ultra_cstream_flush(pStream);
+
+   if (!nError)
+      nError = lz4ultra_write_stream_footer(pStream->pOutStream, pStream->nFlags, XXH32_digest(&pStream->contentChecksum), &pStream->seekTable, &pStream->nCompressedSize);
+
+   if (!nError) {
+      if (pOriginalSize)
+         *pOriginalSize = pStream->nOriginalSize;
+      if (pCompressedSize)
+         *pCompressedSize = pStream->nCompressedSize;
+   }
+
+   if (pStream->seekTable.pData) {
+      lz4ultra_free(pStream->seekTable.pAllocator, pStream->seekTable.pData);
+      pStream->seekTable.pData = NULL;
+   }
+   if (pStream->nOwnCtx)
+      lz4ultra_ctx_destroy(pStream->pCtx);
+   pStream->pCtx = NULL;
+   free(pStream);
+
+   return nError;
+}
@@ -1,111 +1,250 @@
-/*
- * stream.c - streaming I/O implementation
- *
- * Copyright (C) 2019 Emmanuel Marty
- *
- * This software is provided 'as-is', without any express or implied
- * warranty.  In no event will the authors be held liable for any damages
- * arising from the use of this software.
- *
- * Permission is granted to anyone to use this software for any purpose,
- * including commercial applications, and to alter it and redistribute it
- * freely, subject to the following restrictions:
- *
- * 1. The origin of this software must not be misrepresented; you must not
- *    claim that you wrote the original software. If you use this software
- *    in a product, an acknowledgment in the product documentation would be
- *    appreciated but is not required.
- * 2. Altered source versions must be plainly marked as such, and must not be
- *    misrepresented as being the original software.
- * 3. This notice may not be removed or altered from any source distribution.
- */
-
-/*
- * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
- *
- * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
- * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
- * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
- * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
- *
- */
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include "stream.h"
-
-/**
- * Close file stream
- *
- * @param stream stream
- */
-static void lz4ultra_filestream_close(lz4ultra_stream_t *stream) {
-   if (stream->obj) {
-      fclose((FILE*)stream->obj);
-      stream->obj = NULL;
-      stream->read = NULL;
-      stream->write = NULL;
-      stream->eof = NULL;
-      stream->close = NULL;
-   }
-}
-
-/**
- * Read from file stream
- *
- * @param stream stream
- * @param ptr buffer to read into
- * @param size number of bytes to read
- *
- * @return number of bytes read
- */
-static size_t lz4ultra_filestream_read(lz4ultra_stream_t *stream, void *ptr, size_t size) {
-   return fread(ptr, 1, size, (FILE*)stream->obj);
-}
-
-/**
- * Write to file stream
- *
- * @param stream stream
- * @param ptr buffer to write from
- * @param size number of bytes to write
- *
- * @return number of bytes written
- */
-static size_t lz4ultra_filestream_write(lz4ultra_stream_t *stream, void *ptr, size_t size) {
-   return fwrite(ptr, 1, size, (FILE*)stream->obj);
-}
-
-/**
- * Check if file stream has reached the end of the data
- *
- * @param stream stream
- *
- * @return nonzero if the end of the data has been reached, 0 if there is more data
- */
-static int lz4ultra_filestream_eof(lz4ultra_stream_t *stream) {
-   return feof((FILE*)stream->obj);
-}
-
-/**
- * Open file and create an I/O stream from it
- *
- * @param stream stream to fill out
- * @param pszInFilename filename
- * @param pszMode open mode, as with fopen()
- *
- * @return 0 for success, nonzero for failure
- */
-int lz4ultra_filestream_open(lz4ultra_stream_t *stream, const char *pszInFilename, const char *pszMode) {
-   stream->obj = (void*)fopen(pszInFilename, pszMode);
-   if (stream->obj) {
-      stream->read = lz4ultra_filestream_read;
-      stream->write = lz4ultra_filestream_write;
-      stream->eof = lz4ultra_filestream_eof;
-      stream->close = lz4ultra_filestream_close;
-      return 0;
-   }
-   else
-      return -1;
-}
+/*
+ * stream.c - streaming I/O implementation
+ *
+ * Copyright (C) 2019 Emmanuel Marty
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*
+ * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
+ *
+ * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
+ * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
+ * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
+ * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+#include "stream.h"
+#include "allocator.h"
+
+/** Size of the buffers of the standard input and output, that are read and written in small pieces by other tools in a pipeline */
+#define STDIO_BUFFER_SIZE 0x100000
+
+/** Buffer of the standard input, set up when it is first opened as a stream */
+static char *pStdinBuffer = NULL;
+
+/** Buffer of the standard output, set up when it is first opened as a stream */
+static char *pStdoutBuffer = NULL;
+
+/**
+ * Close file stream
+ *
+ * @param stream stream
+ */
+static void lz4ultra_filestream_close(lz4ultra_stream_t *stream) {
+   if (stream->obj) {
+      fclose((FILE*)stream->obj);
+      stream->obj = NULL;
+      stream->read = NULL;
+      stream->write = NULL;
+      stream->eof = NULL;
+      stream->close = NULL;
+   }
+}
+
+/**
+ * Close standard input or output stream, that stays open for the rest of the process
+ *
+ * @param stream stream
+ */
+static void lz4ultra_stdiostream_close(lz4ultra_stream_t *stream) {
+   if (stream->obj) {
+      fflush((FILE*)stream->obj);
+      stream->obj = NULL;
+      stream->read = NULL;
+      stream->write = NULL;
+      stream->eof = NULL;
+      stream->close = NULL;
+   }
+}
+
+/**
+ * Read from file stream
+ *
+ * @param stream stream
+ * @param ptr buffer to read into
+ * @param size number of bytes to read
+ *
+ * @return number of bytes read
+ */
+static size_t lz4ultra_filestream_read(lz4ultra_stream_t *stream, void *ptr, size_t size) {
+   return fread(ptr, 1, size, (FILE*)stream->obj);
+}
+
+/**
+ * Write to file stream
+ *
+ * @param stream stream
+ * @param ptr buffer to write from
+ * @param size number of bytes to write
+ *
+ * @return number of bytes written
+ */
+static size_t lz4ultra_filestream_write(lz4ultra_stream_t *stream, void *ptr, size_t size) {
+   return fwrite(ptr, 1, size, (FILE*)stream->obj);
+}
+
+/**
+ * Check if file stream has reached the end of the data
+ *
+ * @param stream stream
+ *
+ * @return nonzero if the end of the data has been reached, 0 if there is more data
+ */
+static int lz4ultra_filestream_eof(lz4ultra_stream_t *stream) {
+   return feof((FILE*)stream->obj);
+}
+
+/**
+ * Check if a filename designates the standard input or output rather than a file: "-", "stdin" or "stdout"
+ *
+ * @param pszFilename filename
+ *
+ * @return nonzero for the standard input or output, 0 for a file
+ */
+int lz4ultra_filestream_is_stdio(const char *pszFilename) {
+   return !strcmp(pszFilename, "-") || !strcmp(pszFilename, "stdin") || !strcmp(pszFilename, "stdout");
+}
+
+/**
+ * Open file and create an I/O stream from it. A filename that lz4ultra_filestream_is_stdio() accepts opens the standard input when reading,
+ * and the standard output when writing, in binary mode
+ *
+ * @param stream stream to fill out
+ * @param pszInFilename filename
+ * @param pszMode open mode, as with fopen()
+ *
+ * @return 0 for success, nonzero for failure
+ */
+int lz4ultra_filestream_open(lz4ultra_stream_t *stream, const char *pszInFilename, const char *pszMode) {
+   if (lz4ultra_filestream_is_stdio(pszInFilename)) {
+      const int nWrite = (pszMode[0] != 'r') ? 1 : 0;
+      FILE *f = nWrite ? stdout : stdin;
+      char **ppBuffer = nWrite ? &pStdoutBuffer : &pStdinBuffer;
+
+#ifdef _WIN32
+      _setmode(_fileno(f), _O_BINARY);
+#endif
+
+      /* The buffer can only be changed before the first read or write, and is kept until the process exits */
+      if (!*ppBuffer) {
+         *ppBuffer = (char *)malloc(STDIO_BUFFER_SIZE);
+         if (*ppBuffer)
+            setvbuf(f, *ppBuffer, _IOFBF, STDIO_BUFFER_SIZE);
+      }
+
+      stream->obj = (void*)f;
+      stream->read = lz4ultra_filestream_read;
+      stream->write = lz4ultra_filestream_write;
+      stream->eof = lz4ultra_filestream_eof;
+      stream->close = lz4ultra_stdiostream_close;
+      return 0;
+   }
+
+   stream->obj = (void*)fopen(pszInFilename, pszMode);
+   if (stream->obj) {
+      stream->read = lz4ultra_filestream_read;
+      stream->write = lz4ultra_filestream_write;
+      stream->eof = lz4ultra_filestream_eof;
+      stream->close = lz4ultra_filestream_close;
+      return 0;
+   }
+   else
+      return -1;
+}
+
+/**
+ * Move the read or write position of a stream opened from a file with lz4ultra_filestream_open(), that designates neither the standard input
+ * nor the standard output
+ *
+ * @param stream stream
+ * @param nOffset new position, in bytes from the start of the file
+ *
+ * @return 0 for success, nonzero for failure
+ */
+int lz4ultra_filestream_seek(lz4ultra_stream_t *stream, long long nOffset) {
+   FILE *f = (FILE*)stream->obj;
+
+   if (stream->close != lz4ultra_filestream_close || nOffset < 0)
+      return -1;
+#ifdef _WIN32
+   return _fseeki64(f, nOffset, SEEK_SET);
+#else
+   return fseeko(f, (off_t)nOffset, SEEK_SET);
+#endif
+}
+
+/**
+ * Read all the remaining data of a stream into a newly allocated buffer, for formats that can only be processed in memory
+ *
+ * @param stream stream
+ * @param pAllocator allocator to take the buffer from, or NULL to use malloc()
+ * @param ppData pointer to returned buffer, to be freed with lz4ultra_free() and the same allocator, updated when this function is successful
+ * @param pDataSize pointer to returned size of data, in bytes, updated when this function is successful
+ *
+ * @return 0 for success, nonzero for failure
+ */
+int lz4ultra_stream_read_all(lz4ultra_stream_t *stream, const lz4ultra_allocator *pAllocator, unsigned char **ppData, size_t *pDataSize) {
+   unsigned char *pData = NULL;
+   size_t nDataSize = 0;
+   size_t nMaxDataSize = 0;
+
+   do {
+      size_t nReadBytes;
+
+      if (nDataSize == nMaxDataSize) {
+         /* Grow the buffer geometrically, so that large inputs are copied a bounded number of times */
+         size_t nNewMaxDataSize = nMaxDataSize ? (nMaxDataSize << 1) : STDIO_BUFFER_SIZE;
+         unsigned char *pNewData;
+
+         if (nNewMaxDataSize < nMaxDataSize) {
+            lz4ultra_free(pAllocator, pData);
+            return -1;
+         }
+
+         /* Allocators have no realloc(), move the data over to the larger buffer */
+         pNewData = (unsigned char *)lz4ultra_alloc(pAllocator, nNewMaxDataSize);
+         if (!pNewData) {
+            lz4ultra_free(pAllocator, pData);
+            return -1;
+         }
+         if (nDataSize)
+            memcpy(pNewData, pData, nDataSize);
+         lz4ultra_free(pAllocator, pData);
+         pData = pNewData;
+         nMaxDataSize = nNewMaxDataSize;
+      }
+
+      nReadBytes = stream->read(stream, pData + nDataSize, nMaxDataSize - nDataSize);
+      if (!nReadBytes)
+         break;
+      nDataSize += nReadBytes;
+   } while (1);
+
+   *ppData = pData;
+   *pDataSize = nDataSize;
+   return 0;
+}
@@ -1,95 +1,70 @@
-/*
- * stream.h - streaming I/O definitions
- *
- * Copyright (C) 2019 Emmanuel Marty
- *
- * This software is provided 'as-is', without any express or implied
- * warranty.  In no event will the authors be held liable for any damages
- * arising from the use of this software.
- *
- * Permission is granted to anyone to use this software for any purpose,
- * including commercial applications, and to alter it and redistribute it
- * freely, subject to the following restrictions:
- *
- * 1. The origin of this software must not be misrepresented; you must not
- *    claim that you wrote the original software. If you use this software
- *    in a product, an acknowledgment in the product documentation would be
- *    appreciated but is not required.
- * 2. Altered source versions must be plainly marked as such, and must not be
- *    misrepresented as being the original software.
- * 3. This notice may not be removed or altered from any source distribution.
- */
-
-/*
- * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
- *
- * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
- * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
- * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
- * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
- *
- */
-
-#ifndef _STREAM_H
-#define _STREAM_H
-
-/* Forward declaration */
-typedef struct _lz4ultra_stream_t lz4ultra_stream_t;
-
-/* I/O stream */
-typedef struct _lz4ultra_stream_t {
-   /** Opaque stream-specific pointer */
-   void *obj;
-
-   /**
-    * Read from stream
-    *
-    * @param stream stream
-    * @param ptr buffer to read into
-    * @param size number of bytes to read
-    *
-    * @return number of bytes read
-    */
-   size_t(*read)(lz4ultra_stream_t *stream, void *ptr, size_t size);
-
-   /**
-    * Write to stream
-    *
-    * @param stream stream
-    * @param ptr buffer to write from
-    * @param size number of bytes to write
-    *
-    * @return number of bytes written
-    */
-   size_t(*write)(lz4ultra_stream_t *stream, void *ptr, size_t size);
-
-
-   /**
-    * Check if stream has reached the end of the data
-    *
-    * @param stream stream
-    *
-    * @return nonzero if the end of the data has been reached, 0 if there is more data
-    */
-   int(*eof)(lz4ultra_stream_t *stream);
-
-   /**
-    * Close stream
-    *
-    * @param stream stream
-    */
-   void(*close)(lz4ultra_stream_t *stream);
-} lz4ultra_stream_t;
-
-/**
- * Open file and create an I/O stream from it
- *
- * @param stream stream to fill out
- * @param pszInFilename filename
- * @param pszMode open mode, as with fopen()
- *
- * @return 0 for success, nonzero for failure
- */
-int lz4ultra_filestream_open(lz4ultra_stream_t *stream, const char *pszInFilename, const char *pszMode);
-
-#endif /* _STREAM_H */
+/*
+ * stream.h - streaming I/O definitions
+ *
+ * Copyright (C) 2019 Emmanuel Marty
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*
+ * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
+ *
+ * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
+ * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
+ * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
+ * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
+ *
+ */
+
+#ifndef _STREAM_H
+#define _STREAM_H
+
+#include "lz4ultra.h"
+
+/**
+ * Check if a filename designates the standard input or output rather than a file: "-", "stdin" or "stdout"
+ *
+ * @param pszFilename filename
+ *
+ * @return nonzero for the standard input or output, 0 for a file
+ */
+int lz4ultra_filestream_is_stdio(const char *pszFilename);
+
+/**
+ * Move the read or write position of a stream opened from a file with lz4ultra_filestream_open(), that designates neither the standard input
+ * nor the standard output
+ *
+ * @param stream stream
+ * @param nOffset new position, in bytes from the start of the file
+ *
+ * @return 0 for success, nonzero for failure
+ */
+int lz4ultra_filestream_seek(lz4ultra_stream_t *stream, long long nOffset);
+
+/**
+ * Read all the remaining data of a stream into a newly allocated buffer, for formats that can only be processed in memory
+ *
+ * @param stream stream
+ * @param pAllocator allocator to take the buffer from, or NULL to use malloc()
+ * @param ppData pointer to returned buffer, to be freed with lz4ultra_free() and the same allocator, updated when this function is successful
+ * @param pDataSize pointer to returned size of data, in bytes, updated when this function is successful
+ *
+ * @return 0 for success, nonzero for failure
+ */
+int lz4ultra_stream_read_all(lz4ultra_stream_t *stream, const lz4ultra_allocator *pAllocator, unsigned char **ppData, size_t *pDataSize);
+
+#endif /* _STREAM_H */
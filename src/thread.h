@@ -0,0 +1,83 @@
+/*
+ * thread.h - portable threading primitives
+ *
+ * Copyright (C) 2019 Emmanuel Marty
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*
+ * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
+ *
+ * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
+ * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
+ * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
+ * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
+ *
+ */
+
+#ifndef _THREAD_H
+#define _THREAD_H
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#endif
+
+#ifdef _WIN32
+typedef HANDLE lz4ultra_thread_t;
+typedef CRITICAL_SECTION lz4ultra_mutex_t;
+typedef CONDITION_VARIABLE lz4ultra_cond_t;
+
+#define LZ4ULTRA_THREAD_FUNC(__name, __arg) unsigned __stdcall __name(void *__arg)
+#define LZ4ULTRA_THREAD_RETURN return 0
+
+#define lz4ultra_thread_create(__t, __func, __arg) ((*(__t) = (HANDLE)_beginthreadex(NULL, 0, __func, __arg, 0, NULL)) ? 0 : -1)
+#define lz4ultra_thread_join(__t) (WaitForSingleObject(__t, INFINITE), CloseHandle(__t))
+#define lz4ultra_mutex_init(__m) (InitializeCriticalSection(__m), 0)
+#define lz4ultra_mutex_destroy(__m) DeleteCriticalSection(__m)
+#define lz4ultra_mutex_lock(__m) EnterCriticalSection(__m)
+#define lz4ultra_mutex_unlock(__m) LeaveCriticalSection(__m)
+#define lz4ultra_cond_init(__c) (InitializeConditionVariable(__c), 0)
+#define lz4ultra_cond_destroy(__c)
+#define lz4ultra_cond_wait(__c, __m) SleepConditionVariableCS(__c, __m, INFINITE)
+#define lz4ultra_cond_signal(__c) WakeConditionVariable(__c)
+#define lz4ultra_cond_broadcast(__c) WakeAllConditionVariable(__c)
+#else
+typedef pthread_t lz4ultra_thread_t;
+typedef pthread_mutex_t lz4ultra_mutex_t;
+typedef pthread_cond_t lz4ultra_cond_t;
+
+#define LZ4ULTRA_THREAD_FUNC(__name, __arg) void *__name(void *__arg)
+#define LZ4ULTRA_THREAD_RETURN return NULL
+
+#define lz4ultra_thread_create(__t, __func, __arg) (pthread_create(__t, NULL, __func, __arg) ? -1 : 0)
+#define lz4ultra_thread_join(__t) pthread_join(__t, NULL)
+#define lz4ultra_mutex_init(__m) pthread_mutex_init(__m, NULL)
+#define lz4ultra_mutex_destroy(__m) pthread_mutex_destroy(__m)
+#define lz4ultra_mutex_lock(__m) pthread_mutex_lock(__m)
+#define lz4ultra_mutex_unlock(__m) pthread_mutex_unlock(__m)
+#define lz4ultra_cond_init(__c) pthread_cond_init(__c, NULL)
+#define lz4ultra_cond_destroy(__c) pthread_cond_destroy(__c)
+#define lz4ultra_cond_wait(__c, __m) pthread_cond_wait(__c, __m)
+#define lz4ultra_cond_signal(__c) pthread_cond_signal(__c)
+#define lz4ultra_cond_broadcast(__c) pthread_cond_broadcast(__c)
+#endif
+
+#endif /* _THREAD_H */
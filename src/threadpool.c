@@ -0,0 +1,243 @@
+/*
+ * threadpool.c - worker thread pool implementation
+ *
+ * Copyright (C) 2019 Emmanuel Marty
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*
+ * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
+ *
+ * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
+ * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
+ * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
+ * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "thread.h"
+#include "threadpool.h"
+
+/** One worker thread */
+typedef struct {
+   lz4ultra_threadpool *pPool;
+   lz4ultra_thread_t thread;
+   int nThreadIndex;
+} lz4ultra_worker;
+
+/** Thread pool */
+struct _lz4ultra_threadpool {
+   int nThreads;
+   int nStartedWorkers;
+   lz4ultra_worker *pWorkers;
+   lz4ultra_mutex_t mutex;
+   lz4ultra_cond_t work_cond;
+   lz4ultra_cond_t done_cond;
+   lz4ultra_threadpool_job pJobFunc;
+   void *pUserData;
+   int nJobs;
+   int nNextJob;
+   int nPendingJobs;
+   unsigned int nGeneration;
+   int nQuit;
+};
+
+/**
+ * Run queued jobs until there are none left. The pool mutex must be held when calling this function.
+ *
+ * @param pPool thread pool
+ * @param nThreadIndex index of the thread running the jobs
+ */
+static void lz4ultra_threadpool_run_queued(lz4ultra_threadpool *pPool, const int nThreadIndex) {
+   while (pPool->nNextJob < pPool->nJobs) {
+      const int nJobIndex = pPool->nNextJob++;
+
+      lz4ultra_mutex_unlock(&pPool->mutex);
+      pPool->pJobFunc(pPool->pUserData, nThreadIndex, nJobIndex);
+      lz4ultra_mutex_lock(&pPool->mutex);
+
+      if (--pPool->nPendingJobs == 0)
+         lz4ultra_cond_signal(&pPool->done_cond);
+   }
+}
+
+/**
+ * Worker thread main loop
+ *
+ * @param pWorker worker thread
+ */
+static void lz4ultra_threadpool_worker_loop(lz4ultra_worker *pWorker) {
+   lz4ultra_threadpool *pPool = pWorker->pPool;
+   unsigned int nSeenGeneration;
+
+   lz4ultra_mutex_lock(&pPool->mutex);
+   nSeenGeneration = pPool->nGeneration;
+
+   for (;;) {
+      while (!pPool->nQuit && nSeenGeneration == pPool->nGeneration)
+         lz4ultra_cond_wait(&pPool->work_cond, &pPool->mutex);
+      if (pPool->nQuit)
+         break;
+
+      nSeenGeneration = pPool->nGeneration;
+      lz4ultra_threadpool_run_queued(pPool, pWorker->nThreadIndex);
+   }
+
+   lz4ultra_mutex_unlock(&pPool->mutex);
+}
+
+static LZ4ULTRA_THREAD_FUNC(lz4ultra_threadpool_worker_main, pArg) {
+   lz4ultra_threadpool_worker_loop((lz4ultra_worker *)pArg);
+   LZ4ULTRA_THREAD_RETURN;
+}
+
+/**
+ * Create thread pool
+ *
+ * @param nThreads total number of threads, including the calling thread (1 to run jobs serially)
+ *
+ * @return thread pool, or NULL for failure
+ */
+lz4ultra_threadpool *lz4ultra_threadpool_create(int nThreads) {
+   lz4ultra_threadpool *pPool;
+   int i;
+
+   if (nThreads < 1)
+      nThreads = 1;
+
+   pPool = (lz4ultra_threadpool *)malloc(sizeof(lz4ultra_threadpool));
+   if (!pPool)
+      return NULL;
+
+   memset(pPool, 0, sizeof(lz4ultra_threadpool));
+   pPool->nThreads = nThreads;
+
+   if (nThreads == 1)
+      return pPool;
+
+   pPool->pWorkers = (lz4ultra_worker *)malloc((nThreads - 1) * sizeof(lz4ultra_worker));
+   if (!pPool->pWorkers) {
+      free(pPool);
+      return NULL;
+   }
+
+   if (lz4ultra_mutex_init(&pPool->mutex) != 0) {
+      free(pPool->pWorkers);
+      free(pPool);
+      return NULL;
+   }
+   lz4ultra_cond_init(&pPool->work_cond);
+   lz4ultra_cond_init(&pPool->done_cond);
+
+   for (i = 0; i < nThreads - 1; i++) {
+      lz4ultra_worker *pWorker = &pPool->pWorkers[i];
+
+      pWorker->pPool = pPool;
+      pWorker->nThreadIndex = i + 1;
+      if (lz4ultra_thread_create(&pWorker->thread, lz4ultra_threadpool_worker_main, pWorker) != 0)
+         break;
+      pPool->nStartedWorkers++;
+   }
+
+   if (pPool->nStartedWorkers != (nThreads - 1)) {
+      lz4ultra_threadpool_destroy(pPool);
+      return NULL;
+   }
+
+   return pPool;
+}
+
+/**
+ * Stop worker threads and free up thread pool
+ *
+ * @param pPool thread pool, or NULL for none
+ */
+void lz4ultra_threadpool_destroy(lz4ultra_threadpool *pPool) {
+   int i;
+
+   if (!pPool)
+      return;
+
+   if (pPool->pWorkers) {
+      lz4ultra_mutex_lock(&pPool->mutex);
+      pPool->nQuit = 1;
+      lz4ultra_cond_broadcast(&pPool->work_cond);
+      lz4ultra_mutex_unlock(&pPool->mutex);
+
+      for (i = 0; i < pPool->nStartedWorkers; i++) {
+         lz4ultra_thread_join(pPool->pWorkers[i].thread);
+      }
+
+      lz4ultra_cond_destroy(&pPool->done_cond);
+      lz4ultra_cond_destroy(&pPool->work_cond);
+      lz4ultra_mutex_destroy(&pPool->mutex);
+
+      free(pPool->pWorkers);
+      pPool->pWorkers = NULL;
+   }
+
+   free(pPool);
+}
+
+/**
+ * Get number of threads in thread pool, including the calling thread
+ *
+ * @param pPool thread pool, or NULL for none
+ *
+ * @return number of threads
+ */
+int lz4ultra_threadpool_get_thread_count(const lz4ultra_threadpool *pPool) {
+   return pPool ? pPool->nThreads : 1;
+}
+
+/**
+ * Run jobs on the thread pool and wait for all of them to complete. The calling thread also runs jobs.
+ *
+ * @param pPool thread pool, or NULL to run all jobs on the calling thread
+ * @param pJobFunc job function
+ * @param pUserData opaque pointer passed to the job function
+ * @param nJobs number of jobs to run
+ */
+void lz4ultra_threadpool_run(lz4ultra_threadpool *pPool, lz4ultra_threadpool_job pJobFunc, void *pUserData, const int nJobs) {
+   int i;
+
+   if (!pPool || !pPool->pWorkers || nJobs <= 1) {
+      /* Run serially */
+      for (i = 0; i < nJobs; i++)
+         pJobFunc(pUserData, 0, i);
+      return;
+   }
+
+   lz4ultra_mutex_lock(&pPool->mutex);
+
+   pPool->pJobFunc = pJobFunc;
+   pPool->pUserData = pUserData;
+   pPool->nJobs = nJobs;
+   pPool->nNextJob = 0;
+   pPool->nPendingJobs = nJobs;
+   pPool->nGeneration++;
+   lz4ultra_cond_broadcast(&pPool->work_cond);
+
+   lz4ultra_threadpool_run_queued(pPool, 0);
+   while (pPool->nPendingJobs)
+      lz4ultra_cond_wait(&pPool->done_cond, &pPool->mutex);
+
+   lz4ultra_mutex_unlock(&pPool->mutex);
+}
@@ -0,0 +1,83 @@
+/*
+ * threadpool.h - worker thread pool definitions
+ *
+ * Copyright (C) 2019 Emmanuel Marty
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*
+ * Uses the libdivsufsort library Copyright (c) 2003-2008 Yuta Mori
+ *
+ * Inspired by LZ4 by Yann Collet. https://github.com/lz4/lz4
+ * With help, ideas, optimizations and speed measurements by spke <zxintrospec@gmail.com>
+ * With ideas from Lizard by Przemyslaw Skibinski and Yann Collet. https://github.com/inikep/lizard
+ * Also with ideas from smallz4 by Stephan Brumme. https://create.stephan-brumme.com/smallz4/
+ *
+ */
+
+#ifndef _THREADPOOL_H
+#define _THREADPOOL_H
+
+/* Forward declaration */
+typedef struct _lz4ultra_threadpool lz4ultra_threadpool;
+
+/**
+ * Job function, run by the thread pool for each job
+ *
+ * @param pUserData opaque pointer passed to lz4ultra_threadpool_run()
+ * @param nThreadIndex index of the thread running the job (0 for the calling thread, 1..nThreads-1 for the workers)
+ * @param nJobIndex index of the job to run (0..nJobs-1)
+ */
+typedef void (*lz4ultra_threadpool_job)(void *pUserData, const int nThreadIndex, const int nJobIndex);
+
+/**
+ * Create thread pool
+ *
+ * @param nThreads total number of threads, including the calling thread (1 to run jobs serially)
+ *
+ * @return thread pool, or NULL for failure
+ */
+lz4ultra_threadpool *lz4ultra_threadpool_create(int nThreads);
+
+/**
+ * Stop worker threads and free up thread pool
+ *
+ * @param pPool thread pool, or NULL for none
+ */
+void lz4ultra_threadpool_destroy(lz4ultra_threadpool *pPool);
+
+/**
+ * Get number of threads in thread pool, including the calling thread
+ *
+ * @param pPool thread pool, or NULL for none
+ *
+ * @return number of threads
+ */
+int lz4ultra_threadpool_get_thread_count(const lz4ultra_threadpool *pPool);
+
+/**
+ * Run jobs on the thread pool and wait for all of them to complete. The calling thread also runs jobs.
+ *
+ * @param pPool thread pool, or NULL to run all jobs on the calling thread
+ * @param pJobFunc job function
+ * @param pUserData opaque pointer passed to the job function
+ * @param nJobs number of jobs to run
+ */
+void lz4ultra_threadpool_run(lz4ultra_threadpool *pPool, lz4ultra_threadpool_job pJobFunc, void *pUserData, const int nJobs);
+
+#endif /* _THREADPOOL_H */